@@ -2,7 +2,7 @@
  * @file     : bsp_SI5351.c
  * @brief    : SI5351 clock generator BSP driver
  * @details  : This file provides functions to configure and control the SI5351
- *             clock generator chip via software I2C. Supports frequency synthesis,
+ *             clock generator chip on I2C1 (PB6/PB7). Supports frequency synthesis,
  *             PLL configuration, and multi-synth divider settings.
  * @author   : Refactored from original implementation
  * @date     : 2025-01-25
@@ -14,7 +14,7 @@
 #include "stm32f10x_conf.h"
 #include "stm32f10x_pwr.h"
 #include "bsp_SI5351.h"
-#include "drv_soft_i2c.h"
+#include "bsp_i2c.h"
 #include "delay.h"
 #include "math.h"
 #include <string.h>
@@ -27,8 +27,8 @@ SI5351A_FRACTION_TypeDef St_fraction = {0};
 /* ==================== Private Definitions ==================== */
 
 /* SI5351 I2C Configuration */
-#define SI5351_I2C_ADDR        0x60    /* SI5351 I2C device address (7-bit) */
-#define SI5351_I2C_INSTANCE    DRV_SOFT_I2C_INSTANCE_1  /* Use I2C instance 1 */
+#define SI5351_I2C_ADDR        0xC0    /* 0x60 (7-bit), I2C_Send7bitAddress takes it left-aligned */
+#define SI5351_BURST_MAX       8u      /* registers per burst: one PLL or multisynth block */
 
 /* ==================== Private Types ==================== */
 
@@ -137,15 +137,34 @@ si5351a_revb_register_t const si5351a_1000_CLK1_registers[SI5351A_REVB_REG_CONFI
 /* ==================== Private Functions ==================== */
 
 /**
- * @brief Send a register value to SI5351 via software I2C
+ * @brief Write consecutive registers in one burst (auto-increment)
+ * @param regAddr: First register address
+ * @param pData: Register values
+ * @param len: Number of registers, SI5351_BURST_MAX at most
+ * @return uint8_t: 0 on success, 1 if the device did not acknowledge
+ * @note I2C1 is set up by BSP_I2C1_Init() with the other GPIO at boot
+ */
+uint8_t BSP_SI5351_WriteRegs(uint8_t regAddr, const uint8_t *pData, uint8_t len)
+{
+    uint8_t buf[1u + SI5351_BURST_MAX];
+
+    if(len > SI5351_BURST_MAX)
+    {
+        return 1;
+    }
+    buf[0] = regAddr;
+    memcpy(&buf[1], pData, len);
+    return (BSP_I2C1_Transmit(SI5351_I2C_ADDR, buf, (uint16_t)(len + 1u)) == 0) ? 0 : 1;
+}
+
+/**
+ * @brief Send a register value to SI5351
  * @param regAddr: Register address (8-bit)
  * @param value: Register value (8-bit)
- * @note This function replaces the old IICsendreg implementation
- *       and uses drv_soft_i2c driver functions
  */
 static void IICsendreg(uint8_t regAddr, uint8_t value)
 {
-    Drv_SoftI2C_WriteReg(SI5351_I2C_INSTANCE, SI5351_I2C_ADDR, regAddr, &value, 1);
+    (void)BSP_SI5351_WriteRegs(regAddr, &value, 1);
 }
 
 /**
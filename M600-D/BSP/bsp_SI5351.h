@@ -27,6 +27,7 @@ extern "C" {
 #define SI5351A_REVB_REG_CONFIG_NUM_REGS				43
 
 /* Register definitions */
+#define SI_OUTPUT_ENABLE	0x03	/* OEB: a set bit disables CLKn */
 #define SI_CLK0_CONTROL		0x10
 #define SI_CLK1_CONTROL		0x11
 #define SI_CLK2_CONTROL		0x12
@@ -39,6 +40,7 @@ extern "C" {
 #define SI_SYNTH_MS_2		0x3A
 
 #define SI_PLL_RESET		0xB1
+#define SI_XTAL_LOAD		0xB7
 #define DEFAULT_FREQUENCY   840		/* Default frequency: 840 kHz */
 
 /* R-division ratio definitions */
@@ -153,6 +155,7 @@ void Si5351_SetFrequency_ALL_RESET(void);
 void Si5351_CLK0_OUT(void);
 void Si5351_CLK1_OUT(void);
 void Si5351_PWM_TIM(uint32_t freq);
+uint8_t BSP_SI5351_WriteRegs(uint8_t regAddr, const uint8_t *pData, uint8_t len);
 
 int8_t Si5351_SetFrequency(uint8_t ch, uint32_t frequency);
 int8_t Si5351_SetFrequency_Pro(uint8_t ch, uint32_t frequency);
@@ -1,7 +1,10 @@
 /************************************************************************************
  * @file     : bsp_adc.c
- * @brief    : M600 ADC1 init with DMA - ported from M600 HAL
- * @details  : DMA continuous conversion, scan mode, 1.5 cycle sample. Channels PA0,1,5,6 / PB0,1 / PC2,3.
+ * @brief    : M600 ADC1/ADC2 init with DMA - ported from M600 HAL
+ * @details  : Dual regular simultaneous mode, continuous scan, 28.5 cycle sample. ADC1 converts
+ *             the even channels and ADC2 the odd ones at the same instant; DMA1 Channel1 moves
+ *             one 32-bit word per rank (ADC1 low half, ADC2 high half) into a ring of
+ *             2 x BSP_ADC_BLOCK_SCANS scans. Channels PA0,1,5,6 / PB0,1 / PC2,3.
  ***********************************************************************************/
 #include "bsp_adc.h"
 
@@ -16,16 +19,27 @@ static const uint8_t s_adc_ch[] = {
     ADC_Channel_13,  /* HAND_NTC PC3 */
 };
 
-/* DMA buffer for ADC values - continuously updated */
-static uint16_t s_adc_dma_buffer[BSP_ADC_CH_MAX];
+#define BSP_ADC_RING_SCANS    (2u * BSP_ADC_BLOCK_SCANS)
+#define BSP_ADC_RING_WORDS    (BSP_ADC_RING_SCANS * BSP_ADC_RANKS)
+
+/* DMA ring, continuously updated; word-sized for the 32-bit dual-mode transfers */
+static uint32_t s_adc_dma_ring[BSP_ADC_RING_WORDS];
+#define s_adc_dma_buffer      ((const uint16_t *)s_adc_dma_ring)
+
+/* ADC2 converts the odd channels (see BSP_ADC_Channel_t) */
+static ADC_TypeDef* BSP_ADC_Unit(BSP_ADC_Channel_t ch)
+{
+    return (ch & 1u) ? ADC2 : ADC1;
+}
 
 void BSP_ADC_Init(void)
 {
     GPIO_InitTypeDef GPIO_InitStructure;
     ADC_InitTypeDef ADC_InitStructure;
     DMA_InitTypeDef DMA_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
 
-    RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1 | RCC_APB2Periph_GPIOA |
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_ADC1 | RCC_APB2Periph_ADC2 | RCC_APB2Periph_GPIOA |
                            RCC_APB2Periph_GPIOB | RCC_APB2Periph_GPIOC, ENABLE);
     RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
 
@@ -44,43 +58,63 @@ void BSP_ADC_Init(void)
 
     RCC_ADCCLKConfig(RCC_PCLK2_Div6);
 
-    /* Configure DMA1 Channel1 for ADC1 */
+    /* Configure DMA1 Channel1 for ADC1+ADC2: one word per rank, IRQ per half ring */
     DMA_DeInit(DMA1_Channel1);
-    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&ADC1->DR;
-    DMA_InitStructure.DMA_MemoryBaseAddr      = (uint32_t)s_adc_dma_buffer;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&ADC1->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr      = (uint32_t)(uintptr_t)s_adc_dma_ring;
     DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralSRC;
-    DMA_InitStructure.DMA_BufferSize         = BSP_ADC_CH_MAX;
+    DMA_InitStructure.DMA_BufferSize         = BSP_ADC_RING_WORDS;
     DMA_InitStructure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
     DMA_InitStructure.DMA_MemoryInc          = DMA_MemoryInc_Enable;
-    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
-    DMA_InitStructure.DMA_MemoryDataSize     = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    DMA_InitStructure.DMA_MemoryDataSize     = DMA_MemoryDataSize_Word;
     DMA_InitStructure.DMA_Mode               = DMA_Mode_Circular;
     DMA_InitStructure.DMA_Priority           = DMA_Priority_High;
     DMA_InitStructure.DMA_M2M                = DMA_M2M_Disable;
     DMA_Init(DMA1_Channel1, &DMA_InitStructure);
+    DMA_ITConfig(DMA1_Channel1, DMA_IT_HT | DMA_IT_TC, ENABLE);
     DMA_Cmd(DMA1_Channel1, ENABLE);
 
-    /* Configure ADC1: scan mode, continuous conversion */
-    ADC_InitStructure.ADC_Mode               = ADC_Mode_Independent;
+    /* Configure ADC1 (master) and ADC2 (slave): regular simultaneous, scan, continuous */
+    ADC_InitStructure.ADC_Mode               = ADC_Mode_RegSimult;
     ADC_InitStructure.ADC_ScanConvMode       = ENABLE;
     ADC_InitStructure.ADC_ContinuousConvMode = ENABLE;
     ADC_InitStructure.ADC_ExternalTrigConv   = ADC_ExternalTrigConv_None;
     ADC_InitStructure.ADC_DataAlign          = ADC_DataAlign_Right;
-    ADC_InitStructure.ADC_NbrOfChannel       = BSP_ADC_CH_MAX;
+    ADC_InitStructure.ADC_NbrOfChannel       = BSP_ADC_RANKS;
     ADC_Init(ADC1, &ADC_InitStructure);
+    ADC_Init(ADC2, &ADC_InitStructure);
 
-    /* Configure regular channel sequence */
+    /* Configure regular channel sequence: rank n pairs ADC1 channel 2n-2 with ADC2 channel 2n-1 */
     ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_US_I],       1, ADC_SampleTime_28Cycles5);
-    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_RF_I],        2, ADC_SampleTime_28Cycles5);
-    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_Heat_REF02], 3, ADC_SampleTime_28Cycles5);
-    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_Heat_REF01], 4, ADC_SampleTime_28Cycles5);
-    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_ESW_U],      5, ADC_SampleTime_28Cycles5);
-    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_ESW_I],      6, ADC_SampleTime_28Cycles5);
-    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_HP_PRE],      7, ADC_SampleTime_28Cycles5);
-    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_HAND_NTC],   8, ADC_SampleTime_28Cycles5);
-
-    /* Enable ADC DMA */
+    ADC_RegularChannelConfig(ADC2, s_adc_ch[BSP_ADC_CH_RF_I],       1, ADC_SampleTime_28Cycles5);
+    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_Heat_REF02], 2, ADC_SampleTime_28Cycles5);
+    ADC_RegularChannelConfig(ADC2, s_adc_ch[BSP_ADC_CH_Heat_REF01], 2, ADC_SampleTime_28Cycles5);
+    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_ESW_U],      3, ADC_SampleTime_28Cycles5);
+    ADC_RegularChannelConfig(ADC2, s_adc_ch[BSP_ADC_CH_ESW_I],      3, ADC_SampleTime_28Cycles5);
+    ADC_RegularChannelConfig(ADC1, s_adc_ch[BSP_ADC_CH_HP_PRE],     4, ADC_SampleTime_28Cycles5);
+    ADC_RegularChannelConfig(ADC2, s_adc_ch[BSP_ADC_CH_HAND_NTC],   4, ADC_SampleTime_28Cycles5);
+
+    /* Analog watchdog: armed per treatment mode via BSP_ADC_AWD_Config, off by default */
+    BSP_ADC_AWD_Disable();
+
+    /* NVIC: ADC1_2 (AWD over-current trip), highest preemption */
+    NVIC_InitStructure.NVIC_IRQChannel                   = ADC1_2_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority        = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd                = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    /* NVIC: DMA1 Channel1 (half ring ready for the energy meter), below the AWD trip */
+    NVIC_InitStructure.NVIC_IRQChannel                   = DMA1_Channel1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority        = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd                = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    /* Enable ADC DMA (master only, the slave result rides in ADC1->DR[31:16]) */
     ADC_DMACmd(ADC1, ENABLE);
+    ADC_ExternalTrigConvCmd(ADC2, ENABLE);
 
     /* Enable ADC */
     ADC_Cmd(ADC1, ENABLE);
@@ -89,15 +123,26 @@ void BSP_ADC_Init(void)
     ADC_StartCalibration(ADC1);
     while (ADC_GetCalibrationStatus(ADC1)) { }
 
-    /* Start ADC conversion */
+    ADC_Cmd(ADC2, ENABLE);
+    ADC_ResetCalibration(ADC2);
+    while (ADC_GetResetCalibrationStatus(ADC2)) { }
+    ADC_StartCalibration(ADC2);
+    while (ADC_GetCalibrationStatus(ADC2)) { }
+
+    /* Start ADC conversion (the master starts both) */
     ADC_SoftwareStartConvCmd(ADC1, ENABLE);
 }
 
+/* Latest complete scan: the one before the scan DMA is currently filling */
 uint16_t BSP_ADC_ReadChannel(BSP_ADC_Channel_t ch)
 {
+    uint32_t scan;
+
     if (ch >= BSP_ADC_CH_MAX)
         return 0;
-    return s_adc_dma_buffer[ch];
+    scan = (BSP_ADC_RING_WORDS - DMA1_Channel1->CNDTR) / BSP_ADC_RANKS;
+    scan = (scan == 0) ? (BSP_ADC_RING_SCANS - 1u) : (scan - 1u);
+    return s_adc_dma_buffer[scan * BSP_ADC_CH_MAX + ch];
 }
 
 uint32_t BSP_ADC_ReadVoltage(BSP_ADC_Channel_t ch)
@@ -110,3 +155,56 @@ const uint16_t* BSP_ADC_GetDmaBuffer(void)
 {
     return s_adc_dma_buffer;
 }
+
+const uint16_t* BSP_ADC_GetBlock(uint8_t half)
+{
+    return s_adc_dma_buffer + (half ? BSP_ADC_BLOCK_SCANS * BSP_ADC_CH_MAX : 0u);
+}
+
+/* One scan = BSP_ADC_SCAN_CYCLES ADC clocks */
+uint32_t BSP_ADC_GetScanNs(void)
+{
+    RCC_ClocksTypeDef clocks;
+
+    RCC_GetClocksFreq(&clocks);
+    return (BSP_ADC_SCAN_CYCLES * 1000000u) / (clocks.ADCCLK_Frequency / 1000u);
+}
+
+void BSP_ADC_AWD_Config(BSP_ADC_Channel_t ch, uint16_t high_raw)
+{
+    ADC_TypeDef *adc;
+
+    if (ch >= BSP_ADC_CH_MAX)
+        return;
+    if (high_raw > (BSP_ADC_RESOLUTION - 1u))
+        high_raw = BSP_ADC_RESOLUTION - 1u;
+
+    BSP_ADC_AWD_Disable();
+    adc = BSP_ADC_Unit(ch);
+    ADC_AnalogWatchdogThresholdsConfig(adc, high_raw, 0);
+    ADC_AnalogWatchdogSingleChannelConfig(adc, s_adc_ch[ch]);
+    ADC_AnalogWatchdogCmd(adc, ADC_AnalogWatchdog_SingleRegEnable);
+    ADC_ClearITPendingBit(adc, ADC_IT_AWD);
+    ADC_ITConfig(adc, ADC_IT_AWD, ENABLE);
+}
+
+/* From the AWD interrupt: ReadChannel gives the scan before the trip, but the tripping
+ * pair is still in ADC1->DR (ADC2 in the upper half) until the next rank ends */
+uint16_t BSP_ADC_AWD_ReadTrip(BSP_ADC_Channel_t ch)
+{
+    uint32_t dr = ADC1->DR;
+
+    if (ch >= BSP_ADC_CH_MAX)
+        return 0;
+    return (uint16_t)((BSP_ADC_Unit(ch) == ADC2) ? (dr >> 16) : (dr & 0xFFFFu));
+}
+
+void BSP_ADC_AWD_Disable(void)
+{
+    ADC_ITConfig(ADC1, ADC_IT_AWD, DISABLE);
+    ADC_AnalogWatchdogCmd(ADC1, ADC_AnalogWatchdog_None);
+    ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+    ADC_ITConfig(ADC2, ADC_IT_AWD, DISABLE);
+    ADC_AnalogWatchdogCmd(ADC2, ADC_AnalogWatchdog_None);
+    ADC_ClearITPendingBit(ADC2, ADC_IT_AWD);
+}
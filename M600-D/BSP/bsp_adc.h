@@ -1,7 +1,8 @@
 /************************************************************************************
  * @file     : bsp_adc.h
- * @brief    : M600 ADC module - ADC1 init and channel read (STM32 Standard Library)
- * @details  : Ported from M600 HAL. ADC1 channels: PA0,1,5,6 / PB0,1 / PC2,3.
+ * @brief    : M600 ADC module - ADC1/ADC2 init and channel read (STM32 Standard Library)
+ * @details  : Ported from M600 HAL. Channels: PA0,1,5,6 / PB0,1 / PC2,3, converted in
+ *             pairs by ADC1 and ADC2 in regular simultaneous mode.
  * @hardware : STM32F103xE (M600)
  ***********************************************************************************/
 #ifndef __BSP_ADC_H
@@ -14,26 +15,39 @@
 extern "C" {
 #endif
 
-/* M600 ADC channels (ADC1): PA0(0), PA1(1), PA5(5), PA6(6), PB0(8), PB1(9), PC2(12), PC3(13) */
+/* M600 ADC channels: PA0(0), PA1(1), PA5(5), PA6(6), PB0(8), PB1(9), PC2(12), PC3(13).
+ * Even entries are converted by ADC1, odd ones by ADC2 at the same instant, so each
+ * scan in the DMA buffer holds BSP_ADC_CH_MAX values in this order. */
 typedef enum {
-    BSP_ADC_CH_US_I = 0,       /* ADC1_IN0  PA0 */
-    BSP_ADC_CH_RF_I,           /* ADC1_IN1  PA1 */
-    BSP_ADC_CH_Heat_REF02,     /* ADC1_IN5  PA5 */
-    BSP_ADC_CH_Heat_REF01,     /* ADC1_IN6  PA6 */
-    BSP_ADC_CH_ESW_U,          /* ADC1_IN8  PB0 */
-    BSP_ADC_CH_ESW_I,          /* ADC1_IN9  PB1 */
-    BSP_ADC_CH_HP_PRE,         /* ADC1_IN12 PC2 */
-    BSP_ADC_CH_HAND_NTC,       /* ADC1_IN13 PC3 */
+    BSP_ADC_CH_US_I = 0,       /* ADC1_IN0  PA0, rank 1 */
+    BSP_ADC_CH_RF_I,           /* ADC2_IN1  PA1, rank 1 */
+    BSP_ADC_CH_Heat_REF02,     /* ADC1_IN5  PA5, rank 2 */
+    BSP_ADC_CH_Heat_REF01,     /* ADC2_IN6  PA6, rank 2 */
+    BSP_ADC_CH_ESW_U,          /* ADC1_IN8  PB0, rank 3 */
+    BSP_ADC_CH_ESW_I,          /* ADC2_IN9  PB1, rank 3 */
+    BSP_ADC_CH_HP_PRE,         /* ADC1_IN12 PC2, rank 4 */
+    BSP_ADC_CH_HAND_NTC,       /* ADC2_IN13 PC3, rank 4 */
     BSP_ADC_CH_MAX
 } BSP_ADC_Channel_t;
 
 #define BSP_ADC_REF_MV        3300u
 #define BSP_ADC_RESOLUTION    4096u
+#define BSP_ADC_RANKS         (BSP_ADC_CH_MAX / 2u)
+#define BSP_ADC_SCAN_CYCLES   (BSP_ADC_RANKS * 41u)     /* (28.5 sample + 12.5) ADC clocks per rank */
+#define BSP_ADC_BLOCK_SCANS   16u                       /* scans per half ring (DMA1_Channel1 HT/TC) */
 
 void BSP_ADC_Init(void);
 uint16_t BSP_ADC_ReadChannel(BSP_ADC_Channel_t ch);
 uint32_t BSP_ADC_ReadVoltage(BSP_ADC_Channel_t ch);
 const uint16_t* BSP_ADC_GetDmaBuffer(void);
+/* Half ring 0/1: BSP_ADC_BLOCK_SCANS scans, stable until DMA wraps back into it */
+const uint16_t* BSP_ADC_GetBlock(uint8_t half);
+uint32_t BSP_ADC_GetScanNs(void);
+
+/* Analog watchdog: single regular channel on its ADC, trips when raw > high_raw (ADC1_2_IRQn) */
+void BSP_ADC_AWD_Config(BSP_ADC_Channel_t ch, uint16_t high_raw);
+void BSP_ADC_AWD_Disable(void);
+uint16_t BSP_ADC_AWD_ReadTrip(BSP_ADC_Channel_t ch);    /* sample that tripped, from the AWD ISR */
 
 #ifdef __cplusplus
 }
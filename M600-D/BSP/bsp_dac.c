@@ -1,30 +1,55 @@
 /************************************************************************************
  * @file     : bsp_dac.c
  * @brief    : M600 DAC Ch1 init - PA4, ported from M600 HAL
- * @details  : Trigger none, output buffer enable. 12-bit right align.
+ * @details  : Trigger TIM6 TRGO, output buffer enable. 12-bit right align.
+ *             Ramp samples via DMA2 Channel3 (DAC1 request), TC in stm32f103_it.c.
  ***********************************************************************************/
 #include "bsp_dac.h"
 
+#define BSP_DAC_TIM6_TICK_HZ   1000000u
 
+/* DHR -> DOR transfer needs a trigger once TEN is set: UG on TIM6 raises TRGO */
+static void BSP_DAC_Latch(void)
+{
+    TIM6->EGR = TIM_EGR_UG;
+}
 
 void BSP_DAC_Init(void)
 {
     GPIO_InitTypeDef GPIO_InitStructure;
     DAC_InitTypeDef DAC_InitStructure;
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
 
-    RCC_APB1PeriphClockCmd(RCC_APB1Periph_DAC, ENABLE);
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_DAC | RCC_APB1Periph_TIM6, ENABLE);
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);
 
     GPIO_InitStructure.GPIO_Pin  = GPIO_Pin_4;
     GPIO_InitStructure.GPIO_Mode = GPIO_Mode_AIN;
     GPIO_Init(GPIOA, &GPIO_InitStructure);
 
+    /* TIM6: 1 us tick, TRGO on update, started only while a ramp runs */
+    TIM_TimeBaseStructure.TIM_Period        = 0xFFFF;
+    TIM_TimeBaseStructure.TIM_Prescaler     = (uint16_t)(SystemCoreClock / BSP_DAC_TIM6_TICK_HZ - 1);
+    TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStructure.TIM_CounterMode   = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM6, &TIM_TimeBaseStructure);
+    TIM_SelectOutputTrigger(TIM6, TIM_TRGOSource_Update);
+
     DAC_StructInit(&DAC_InitStructure);
-    DAC_InitStructure.DAC_Trigger      = DAC_Trigger_None;
+    DAC_InitStructure.DAC_Trigger      = DAC_Trigger_T6_TRGO;
     DAC_InitStructure.DAC_OutputBuffer = DAC_OutputBuffer_Enable;
     DAC_Init(DAC_Channel_1, &DAC_InitStructure);
     DAC_Cmd(DAC_Channel_1, ENABLE);
     DAC_SetChannel1Data(DAC_Align_12b_R, 0);
+    BSP_DAC_Latch();
+
+    NVIC_InitStructure.NVIC_IRQChannel                   = DMA2_Channel3_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 2;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority        = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd                = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
 }
 
 void BSP_DAC_SetValue(uint16_t value)
@@ -32,6 +57,7 @@ void BSP_DAC_SetValue(uint16_t value)
     if (value > 4095)
         value = 4095;
     DAC_SetChannel1Data(DAC_Align_12b_R, value);
+    BSP_DAC_Latch();
 }
 
 void BSP_DAC_SetVoltage(uint16_t mv)
@@ -40,5 +66,60 @@ void BSP_DAC_SetVoltage(uint16_t mv)
     if (mv > BSP_DAC_REF_MV)
         mv = BSP_DAC_REF_MV;
     v = ((uint32_t)mv * (BSP_DAC_RES - 1)) / BSP_DAC_REF_MV;
-    DAC_SetChannel1Data(DAC_Align_12b_R, (uint16_t)v);
+    BSP_DAC_SetValue((uint16_t)v);
+}
+
+uint16_t BSP_DAC_GetValue(void)
+{
+    return DAC_GetDataOutputValue(DAC_Channel_1);
+}
+
+void BSP_DAC_RampStart(const uint16_t *pSamples, uint16_t count, uint16_t period_us)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+
+    BSP_DAC_RampStop();
+    if (pSamples == 0 || count < 2)
+        return;
+    if (period_us == 0)
+        period_us = 1;
+
+    /* The first sample waits in DHR and goes out at the first update; the DMA streams the rest */
+    DAC_SetChannel1Data(DAC_Align_12b_R, pSamples[0]);
+
+    DMA_DeInit(DMA2_Channel3);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&DAC->DHR12R1;
+    DMA_InitStructure.DMA_MemoryBaseAddr     = (uint32_t)(uintptr_t)(pSamples + 1);
+    DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize         = (uint16_t)(count - 1u);
+    DMA_InitStructure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc          = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize     = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode               = DMA_Mode_Normal;
+    DMA_InitStructure.DMA_Priority           = DMA_Priority_Medium;
+    DMA_InitStructure.DMA_M2M                = DMA_M2M_Disable;
+    DMA_Init(DMA2_Channel3, &DMA_InitStructure);
+    DMA_ITConfig(DMA2_Channel3, DMA_IT_TC, ENABLE);
+    DMA_Cmd(DMA2_Channel3, ENABLE);
+
+    /* Each TIM6 update latches DHR into DOR and requests the next sample */
+    DAC_DMACmd(DAC_Channel_1, ENABLE);
+
+    TIM_SetAutoreload(TIM6, (uint16_t)(period_us - 1));
+    TIM_SetCounter(TIM6, 0);
+    TIM_Cmd(TIM6, ENABLE);
+}
+
+/* Safe from DMA2_Channel3 TC interrupt. TC fires when the last sample reaches DHR, at the
+ * update that latched the one before it, so the caller ends the profile with a repeat. The
+ * latch here is then a no-op; on an abort it puts out the sample already waiting in DHR. */
+void BSP_DAC_RampStop(void)
+{
+    TIM_Cmd(TIM6, DISABLE);
+    DAC_DMACmd(DAC_Channel_1, DISABLE);
+    DMA_ITConfig(DMA2_Channel3, DMA_IT_TC, DISABLE);
+    DMA_Cmd(DMA2_Channel3, DISABLE);
+    DMA_ClearITPendingBit(DMA2_IT_GL3);
+    BSP_DAC_Latch();
 }
@@ -1,7 +1,9 @@
 /************************************************************************************
  * @file     : bsp_dac.h
  * @brief    : M600 DAC module - DAC Ch1 on PA4 (STM32 Standard Library)
- * @details  : Ported from M600 HAL. Trigger none, output buffer enable.
+ * @details  : Ported from M600 HAL. Trigger TIM6 TRGO, output buffer enable.
+ *             Direct writes fire a TIM6 update; ramps stream a sample table through
+ *             DMA2 Channel3 paced by TIM6 (1 us tick).
  * @hardware : STM32F103xE (M600)
  ***********************************************************************************/
 #ifndef __BSP_DAC_H
@@ -20,6 +22,13 @@ extern "C" {
 void BSP_DAC_Init(void);
 void BSP_DAC_SetValue(uint16_t value);   /* 12-bit, 0..4095 */
 void BSP_DAC_SetVoltage(uint16_t mv);    /* 0..3300 mV, 3.3V ref */
+uint16_t BSP_DAC_GetValue(void);         /* current output code (DOR) */
+
+/* Ramp: pSamples[k] goes out at TIM6 update k + 1, count >= 2. TC comes at update count - 1,
+ * when pSamples[count - 2] goes out: end with a repeat so TC marks the final step. pSamples
+ * must stay valid until DMA2_Channel3 TC (BSP_DAC_RampStop from the ISR) */
+void BSP_DAC_RampStart(const uint16_t *pSamples, uint16_t count, uint16_t period_us);
+void BSP_DAC_RampStop(void);
 
 #ifdef __cplusplus
 }
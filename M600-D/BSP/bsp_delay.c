@@ -1,10 +1,15 @@
 /************************************************************************************
  * @file     : bsp_delay.c
  * @brief    : M600 SysTick delay and tick - Std lib
- * @details  : 1ms period SysTick, BSP_Delay_ms, BSP_GetTick_ms.
+ * @details  : 1ms period SysTick, BSP_Delay_ms, BSP_GetTick_ms, DWT CYCCNT.
  ***********************************************************************************/
 #include "bsp_delay.h"
 
+/* CMSIS 1.30 core_cm3.h has no DWT block definition */
+#define BSP_DWT_CTRL        (*(volatile uint32_t *)0xE0001000u)
+#define BSP_DWT_CYCCNT      (*(volatile uint32_t *)0xE0001004u)
+#define BSP_DWT_CYCCNTENA   (1u << 0)
+
 static volatile uint32_t s_tick_ms = 0;
 
 void BSP_SysTick_Init(void)
@@ -14,6 +19,17 @@ void BSP_SysTick_Init(void)
         while (1) { }
     }
     s_tick_ms = 0;
+    BSP_Cycles_Init();
+}
+
+/* DWT cycle counter for cheap profiling, may already run since main() entry */
+void BSP_Cycles_Init(void)
+{
+    if (BSP_DWT_CTRL & BSP_DWT_CYCCNTENA)
+        return;
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    BSP_DWT_CYCCNT = 0;
+    BSP_DWT_CTRL |= BSP_DWT_CYCCNTENA;
 }
 
 void BSP_SysTick_Inc(void)
@@ -21,6 +37,11 @@ void BSP_SysTick_Inc(void)
     s_tick_ms++;
 }
 
+void BSP_SysTick_Advance(uint32_t ms)
+{
+    s_tick_ms += ms;
+}
+
 void BSP_Delay_ms(uint32_t ms)
 {
     uint32_t start = s_tick_ms;
@@ -33,3 +54,26 @@ uint32_t BSP_GetTick_ms(void)
 {
     return s_tick_ms;
 }
+
+/* A wrap between the tick and VAL reads retries; with SysTick held off (masked or a
+ * higher priority ISR) a pending reload already counts as the next millisecond */
+uint32_t BSP_GetTickFine_ms(uint16_t *pUs)
+{
+    uint32_t ms, val, pend, load = SysTick->LOAD;
+
+    do {
+        ms = s_tick_ms;
+        val = SysTick->VAL;
+        pend = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+    } while (ms != s_tick_ms);
+    if (pend != 0 && val > load / 2u)
+        ms++;
+    if (pUs != 0)
+        *pUs = (uint16_t)(((load - val) * 1000u) / (load + 1u));
+    return ms;
+}
+
+uint32_t BSP_GetCycles(void)
+{
+    return BSP_DWT_CYCCNT;
+}
@@ -1,7 +1,7 @@
 /************************************************************************************
  * @file     : bsp_delay.h
  * @brief    : M600 SysTick-based delay and tick (STM32 Standard Library)
- * @details  : 1ms SysTick IRQ, BSP_Delay_ms, BSP_GetTick_ms. BSP only.
+ * @details  : 1ms SysTick IRQ, BSP_Delay_ms, BSP_GetTick_ms, DWT cycle counter. BSP only.
  * @hardware : STM32F103xE (M600-D)
  ***********************************************************************************/
 #ifndef __BSP_DELAY_H
@@ -17,15 +17,27 @@ extern "C" {
 /** SysTick 1ms init. Call from BSP_Init. */
 void BSP_SysTick_Init(void);
 
+/** Start the DWT cycle counter if not running yet (it is never reset once started). */
+void BSP_Cycles_Init(void);
+
 /** Increment tick. Call from SysTick_Handler only. */
 void BSP_SysTick_Inc(void);
 
+/** Advance the tick by ms that passed with SysTick stopped (STOP mode). */
+void BSP_SysTick_Advance(uint32_t ms);
+
 /** Blocking delay, milliseconds. */
 void BSP_Delay_ms(uint32_t ms);
 
 /** Get tick count in milliseconds (since BSP_SysTick_Init). */
 uint32_t BSP_GetTick_ms(void);
 
+/** Tick in milliseconds and, in *pUs, microseconds into that millisecond (SysTick count). */
+uint32_t BSP_GetTickFine_ms(uint16_t *pUs);
+
+/** Core clock cycles from the free-running DWT counter (wraps every ~59 s at 72 MHz). */
+uint32_t BSP_GetCycles(void);
+
 #ifdef __cplusplus
 }
 #endif
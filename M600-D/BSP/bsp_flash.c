@@ -0,0 +1,36 @@
+/************************************************************************************
+ * @file     : bsp_flash.c
+ * @brief    : M600 internal flash erase/program (STM32 Standard Library)
+ ***********************************************************************************/
+#include "bsp_flash.h"
+
+void BSP_Flash_Unlock(void)
+{
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+}
+
+void BSP_Flash_Lock(void)
+{
+    FLASH_Lock();
+}
+
+bool BSP_Flash_ErasePage(uint32_t addr)
+{
+    return FLASH_ErasePage(addr) == FLASH_COMPLETE;
+}
+
+bool BSP_Flash_ProgramHalfWord(uint32_t addr, uint16_t data)
+{
+    return FLASH_ProgramHalfWord(addr, data) == FLASH_COMPLETE;
+}
+
+bool BSP_Flash_IsWriteProtected(uint32_t wrpMask)
+{
+    return (FLASH_GetWriteProtectionOptionByte() & wrpMask) == 0u;
+}
+
+bool BSP_Flash_WriteProtect(uint32_t wrpMask)
+{
+    return FLASH_EnableWriteProtection(wrpMask) == FLASH_COMPLETE;
+}
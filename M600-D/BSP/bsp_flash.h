@@ -0,0 +1,36 @@
+/************************************************************************************
+ * @file     : bsp_flash.h
+ * @brief    : M600 internal flash erase/program (STM32 Standard Library)
+ * @details  : 2 KB pages, half-word programming. The CPU stalls on flash fetches
+ *             while an erase or program is in progress; DMA keeps running.
+ * @hardware : STM32F103xE (M600-D)
+ ***********************************************************************************/
+#ifndef __BSP_FLASH_H
+#define __BSP_FLASH_H
+
+#include "stm32f10x.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BSP_FLASH_BASE          0x08000000u
+#define BSP_FLASH_SIZE          0x00040000u     /* 256 KB */
+#define BSP_FLASH_PAGE_SIZE     0x00000800u     /* 2 KB */
+
+void BSP_Flash_Unlock(void);
+void BSP_Flash_Lock(void);
+bool BSP_Flash_ErasePage(uint32_t addr);
+bool BSP_Flash_ProgramHalfWord(uint32_t addr, uint16_t data);
+/** wrpMask: WRPR bits (bit n = pages 2n, 2n+1), all of them must be protected */
+bool BSP_Flash_IsWriteProtected(uint32_t wrpMask);
+/** Program the WRP option bytes (flash unlocked); effective after the next reset */
+bool BSP_Flash_WriteProtect(uint32_t wrpMask);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BSP_FLASH_H */
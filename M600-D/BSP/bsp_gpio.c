@@ -59,43 +59,120 @@ void BSP_GPIO_Init(void)
     GPIO_Init(CTR_FAN_Port, &GPIO_InitStructure);
 }
 
+typedef struct {
+    GPIO_TypeDef *port;
+    uint16_t      pin;
+} BSP_GPIO_Map_t;
+
+/* Indexed by BSP_GPIO_Input_t / BSP_GPIO_Output_t, resolved at compile time */
+static const BSP_GPIO_Map_t s_gpio_in_map[BSP_GPIO_IN_MAX] = {
+    [BSP_GPIO_IN_FOOT]    = { MCU_FOOT_Port,   MCU_FOOT_Pin   },
+    [BSP_GPIO_IN_SYN_US]  = { IO_SYN_US_Port,  IO_SYN_US_Pin  },
+    [BSP_GPIO_IN_SYN_RF]  = { IO_SYN_RF_Port,  IO_SYN_RF_Pin  },
+    [BSP_GPIO_IN_SYN_ESW] = { IO_SYN_ESW_Port, IO_SYN_ESW_Pin },
+};
+
+static const BSP_GPIO_Map_t s_gpio_out_map[BSP_GPIO_OUT_MAX] = {
+    [BSP_GPIO_OUT_BUZZER]       = { MCU_Buzzer_Port,    MCU_Buzzer_Pin    },
+    [BSP_GPIO_OUT_CTR_US_RF]    = { MCU_CTR_US_RF_Port, MCU_CTR_US_RF_Pin },
+    [BSP_GPIO_OUT_CTR_OUT]      = { MCU_CTR_OUT_Port,   MCU_CTR_OUT_Pin   },
+    [BSP_GPIO_OUT_MCU_IO]       = { MCU_I_O_Port,       MCU_I_O_Pin       },
+    [BSP_GPIO_OUT_PWR_CTRL1]    = { pwr_control1_Port,  pwr_control1_Pin  },
+    [BSP_GPIO_OUT_PWR_CTRL2]    = { pwr_control2_Port,  pwr_control2_Pin  },
+    [BSP_GPIO_OUT_PWR_CTRL3]    = { pwr_control3_Port,  pwr_control3_Pin  },
+    [BSP_GPIO_OUT_PWR_CTRL4]    = { pwr_control4_Port,  pwr_control4_Pin  },
+    [BSP_GPIO_OUT_CTR_FAN]      = { CTR_FAN_Port,       CTR_FAN_Pin       },
+    [BSP_GPIO_OUT_CTR_HP_MOTOR] = { CTR_HP_motor_Port,  CTR_HP_motor_Pin  },
+    [BSP_GPIO_OUT_CTR_HP_LOSE]  = { CTR_HP_lose_Port,   CTR_HP_lose_Pin   },
+    [BSP_GPIO_OUT_CTR_HEAT_HP]  = { CTR_HEAT_HP_Port,   CTR_HEAT_HP_Pin   },
+};
+
 uint8_t BSP_GPIO_ReadPin(BSP_GPIO_Input_t pin)
 {
-    GPIO_TypeDef *port;
-    uint16_t gpio_pin;
-    switch (pin) {
-        case BSP_GPIO_IN_FOOT:    port = MCU_FOOT_Port;    gpio_pin = MCU_FOOT_Pin;    break;
-        case BSP_GPIO_IN_SYN_US:  port = IO_SYN_US_Port;   gpio_pin = IO_SYN_US_Pin;   break;
-        case BSP_GPIO_IN_SYN_RF:  port = IO_SYN_RF_Port;   gpio_pin = IO_SYN_RF_Pin;   break;
-        case BSP_GPIO_IN_SYN_ESW: port = IO_SYN_ESW_Port;  gpio_pin = IO_SYN_ESW_Pin;  break;
-        default: return 0;
-    }
-    return GPIO_ReadInputDataBit(port, gpio_pin) ? 1 : 0;
+    if (pin >= BSP_GPIO_IN_MAX)
+        return 0;
+    return (s_gpio_in_map[pin].port->IDR & s_gpio_in_map[pin].pin) ? 1 : 0;
 }
 
 void BSP_GPIO_WritePin(BSP_GPIO_Output_t pin, uint8_t state)
 {
-    GPIO_TypeDef *port;
-    uint16_t gpio_pin;
-    switch (pin) {
-        case BSP_GPIO_OUT_BUZZER:      port = MCU_Buzzer_Port;     gpio_pin = MCU_Buzzer_Pin;     break;
-        case BSP_GPIO_OUT_CTR_US_RF:   port = MCU_CTR_US_RF_Port;  gpio_pin = MCU_CTR_US_RF_Pin;  break;
-        case BSP_GPIO_OUT_CTR_OUT:     port = MCU_CTR_OUT_Port;    gpio_pin = MCU_CTR_OUT_Pin;    break;
-        case BSP_GPIO_OUT_MCU_IO:      port = MCU_I_O_Port;        gpio_pin = MCU_I_O_Pin;        break;
-        case BSP_GPIO_OUT_PWR_CTRL1:   port = pwr_control1_Port;   gpio_pin = pwr_control1_Pin;   break;
-        case BSP_GPIO_OUT_PWR_CTRL2:   port = pwr_control2_Port;   gpio_pin = pwr_control2_Pin;   break;
-        case BSP_GPIO_OUT_PWR_CTRL3:   port = pwr_control3_Port;   gpio_pin = pwr_control3_Pin;   break;
-        case BSP_GPIO_OUT_PWR_CTRL4:   port = pwr_control4_Port;   gpio_pin = pwr_control4_Pin;   break;
-        case BSP_GPIO_OUT_CTR_FAN:     port = CTR_FAN_Port;        gpio_pin = CTR_FAN_Pin;        break;
-        case BSP_GPIO_OUT_CTR_HP_MOTOR: port = CTR_HP_motor_Port;  gpio_pin = CTR_HP_motor_Pin;   break;
-        case BSP_GPIO_OUT_CTR_HP_LOSE: port = CTR_HP_lose_Port;    gpio_pin = CTR_HP_lose_Pin;    break;
-        case BSP_GPIO_OUT_CTR_HEAT_HP: port = CTR_HEAT_HP_Port;    gpio_pin = CTR_HEAT_HP_Pin;    break;
-        default: return;
-    }
+    if (pin >= BSP_GPIO_OUT_MAX)
+        return;
     if (state)
-        GPIO_SetBits(port, gpio_pin);
+        s_gpio_out_map[pin].port->BSRR = s_gpio_out_map[pin].pin;
     else
-        GPIO_ResetBits(port, gpio_pin);
+        s_gpio_out_map[pin].port->BRR = s_gpio_out_map[pin].pin;
+}
+
+/* One BSRR store per port: set and reset bits of a port change on the same bus write */
+void BSP_GPIO_WriteBatch(const BSP_GPIO_Batch_t *pBatch)
+{
+    if (pBatch == 0)
+        return;
+    if (pBatch->bsrrB)
+        GPIOB->BSRR = pBatch->bsrrB;
+    if (pBatch->bsrrC)
+        GPIOC->BSRR = pBatch->bsrrC;
+    if (pBatch->bsrrD)
+        GPIOD->BSRR = pBatch->bsrrD;
+}
+
+void BSP_GPIO_EXTI_Init(void)
+{
+    EXTI_InitTypeDef EXTI_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_APB2PeriphClockCmd(RCC_APB2Periph_AFIO, ENABLE);
+
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource14);   /* MCU_FOOT   */
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource10);   /* IO_SYN_US  */
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource11);   /* IO_SYN_RF  */
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource12);   /* IO_SYN_ESW */
+
+    EXTI_ClearITPendingBit(EXTI_Line10 | EXTI_Line11 | EXTI_Line12 | EXTI_Line14);
+    EXTI_InitStructure.EXTI_Line    = EXTI_Line10 | EXTI_Line11 | EXTI_Line12 | EXTI_Line14;
+    EXTI_InitStructure.EXTI_Mode    = EXTI_Mode_Interrupt;
+    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising_Falling;
+    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&EXTI_InitStructure);
+
+    /* Same preemption level as SysTick: edge and debounce-tick handlers never nest */
+    NVIC_InitStructure.NVIC_IRQChannel                   = EXTI15_10_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority        = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd                = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+uint8_t BSP_GPIO_EXTI_GetAndClear(void)
+{
+    uint32_t pr = EXTI->PR & (EXTI_Line10 | EXTI_Line11 | EXTI_Line12 | EXTI_Line14);
+    uint8_t mask = 0;
+
+    EXTI->PR = pr;   /* write 1 to clear */
+    if (pr & EXTI_Line14) mask |= (uint8_t)(1u << BSP_GPIO_IN_FOOT);
+    if (pr & EXTI_Line10) mask |= (uint8_t)(1u << BSP_GPIO_IN_SYN_US);
+    if (pr & EXTI_Line11) mask |= (uint8_t)(1u << BSP_GPIO_IN_SYN_RF);
+    if (pr & EXTI_Line12) mask |= (uint8_t)(1u << BSP_GPIO_IN_SYN_ESW);
+    return mask;
+}
+
+uint8_t BSP_GPIO_ReadInputMask(void)
+{
+    uint16_t idr = (uint16_t)GPIOC->IDR;   /* all four inputs are on GPIOC */
+    uint8_t mask = 0;
+
+    if (idr & MCU_FOOT_Pin)   mask |= (uint8_t)(1u << BSP_GPIO_IN_FOOT);
+    if (idr & IO_SYN_US_Pin)  mask |= (uint8_t)(1u << BSP_GPIO_IN_SYN_US);
+    if (idr & IO_SYN_RF_Pin)  mask |= (uint8_t)(1u << BSP_GPIO_IN_SYN_RF);
+    if (idr & IO_SYN_ESW_Pin) mask |= (uint8_t)(1u << BSP_GPIO_IN_SYN_ESW);
+    return mask;
+}
+
+/* Open pwr_control1~4 with a single BRR write (all on GPIOC), safe from interrupt context */
+void BSP_GPIO_PwrCtrlOffAll(void)
+{
+    GPIOC->BRR = pwr_control1_Pin | pwr_control2_Pin | pwr_control3_Pin | pwr_control4_Pin;
 }
 
 void BSP_Init(void)
@@ -106,6 +183,8 @@ void BSP_Init(void)
     BSP_DAC_Init();
     BSP_TIM1_Init();
     BSP_TIM4_Init();
+    BSP_TIM3_GateInit();
+    BSP_TIM7_FanInit();
     BSP_USART1_Init(115200);
     BSP_USART2_Init(115200);
     BSP_I2C1_Init();
@@ -81,9 +81,26 @@ typedef enum {
     BSP_GPIO_OUT_MAX
 } BSP_GPIO_Output_t;
 
+/* Multi-pin output transition: per-port BSRR words (set in low half, reset in high half) */
+#define BSP_GPIO_BSRR(set, reset)   ((uint32_t)(set) | ((uint32_t)(reset) << 16))
+
+typedef struct {
+    uint32_t bsrrB;
+    uint32_t bsrrC;
+    uint32_t bsrrD;
+} BSP_GPIO_Batch_t;
+
 void BSP_GPIO_Init(void);
 uint8_t BSP_GPIO_ReadPin(BSP_GPIO_Input_t pin);   /* 0=low, 1=high */
 void BSP_GPIO_WritePin(BSP_GPIO_Output_t pin, uint8_t state);  /* 0=low, 1=high */
+void BSP_GPIO_PwrCtrlOffAll(void);                             /* pwr_control1~4 low */
+void BSP_GPIO_WriteBatch(const BSP_GPIO_Batch_t *pBatch);      /* ports with 0 are skipped */
+
+/* EXTI on MCU_FOOT(PC14), IO_SYN_US/RF/ESW(PC10/11/12), both edges, EXTI15_10_IRQn.
+ * Masks below are bit-per-BSP_GPIO_Input_t (1u << BSP_GPIO_IN_x). */
+void BSP_GPIO_EXTI_Init(void);
+uint8_t BSP_GPIO_EXTI_GetAndClear(void);   /* pending inputs, pending bits cleared */
+uint8_t BSP_GPIO_ReadInputMask(void);      /* all inputs, one IDR read */
 
 /** Call all M600 BSP inits: GPIO, ADC, TIM1, TIM4, USART1(115200), USART2(115200). */
 void BSP_Init(void);
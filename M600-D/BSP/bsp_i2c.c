@@ -97,6 +97,8 @@ static int i2c1_master_rx(I2C_TypeDef *I2Cx, uint8_t devAddr, uint8_t *buf, uint
         return -1;
     if (len == 0)
         return 0;
+    /* The previous read turned ACK off for its last byte */
+    I2C_AcknowledgeConfig(I2Cx, ENABLE);
     I2C_GenerateSTART(I2Cx, ENABLE);
     if (i2c1_wait_event(I2Cx, I2C_EVENT_MASTER_MODE_SELECT) != 0)
         return -1;
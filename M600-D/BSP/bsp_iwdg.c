@@ -1,7 +1,7 @@
 /************************************************************************************
  * @file     : bsp_iwdg.c
  * @brief    : M600 IWDG init - ported from M600 HAL
- * @details  : Prescaler 4, Reload 4095. LSI 40kHz -> Tout �� 1.64s.
+ * @details  : Prescaler 4, Reload 4095. LSI 40kHz -> Tout = 4 * 4096 / 40k = 410 ms.
  ***********************************************************************************/
 #include "bsp_iwdg.h"
 
@@ -1,7 +1,7 @@
 /************************************************************************************
  * @file     : bsp_iwdg.h
  * @brief    : M600 IWDG module - prescaler 4, reload 4095 (STM32 Standard Library)
- * @details  : Ported from M600 HAL. Tout = (4*4*4095)/40k �� 1.64s.
+ * @details  : Ported from M600 HAL. Tout = 4 * 4096 / 40 kHz = 410 ms.
  * @hardware : STM32F103xE (M600)
  ***********************************************************************************/
 #ifndef __BSP_IWDG_H
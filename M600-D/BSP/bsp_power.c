@@ -0,0 +1,155 @@
+/************************************************************************************
+ * @file     : bsp_power.c
+ * @brief    : M600 low-power modes - WFI sleep and STOP with RTC wake-up (STM32 Standard Library)
+ ***********************************************************************************/
+#include "bsp_power.h"
+#include "bsp_gpio.h"
+#include <stddef.h>
+
+#define BSP_POWER_RTC_PRESCALER     39u     /* LSI 40 kHz / 40 -> 1 ms */
+#define BSP_POWER_EXTI_WAKE_LINES   (EXTI_Line10 | EXTI_Line11 | EXTI_Line12 | EXTI_Line14 | EXTI_Line17)
+
+void BSP_Power_Init(void)
+{
+    EXTI_InitTypeDef EXTI_InitStructure;
+    NVIC_InitTypeDef NVIC_InitStructure;
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_PWR | RCC_APB1Periph_BKP, ENABLE);
+    PWR_BackupAccessCmd(ENABLE);
+
+    RCC_LSICmd(ENABLE);
+    while (RCC_GetFlagStatus(RCC_FLAG_LSIRDY) == RESET) { }
+    /* RTC clock source can only be changed after a backup domain reset */
+    if ((RCC->BDCR & RCC_BDCR_RTCSEL) != RCC_RTCCLKSource_LSI) {
+        RCC_BackupResetCmd(ENABLE);
+        RCC_BackupResetCmd(DISABLE);
+    }
+    RCC_RTCCLKConfig(RCC_RTCCLKSource_LSI);
+    RCC_RTCCLKCmd(ENABLE);
+    RTC_WaitForSynchro();
+    RTC_WaitForLastTask();
+    RTC_SetPrescaler(BSP_POWER_RTC_PRESCALER);
+    RTC_WaitForLastTask();
+
+    /* RTC alarm -> EXTI17, rising edge */
+    EXTI_ClearITPendingBit(EXTI_Line17);
+    EXTI_InitStructure.EXTI_Line    = EXTI_Line17;
+    EXTI_InitStructure.EXTI_Mode    = EXTI_Mode_Interrupt;
+    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&EXTI_InitStructure);
+    RTC_ITConfig(RTC_IT_ALR, ENABLE);
+    RTC_WaitForLastTask();
+
+    NVIC_InitStructure.NVIC_IRQChannel                   = RTCAlarm_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority        = 0;
+    NVIC_InitStructure.NVIC_IRQChannelCmd                = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
+    /* PVD -> EXTI16: PVDO rises when VDD falls below the level */
+    PWR_PVDLevelConfig(BSP_POWER_PVD_LEVEL);
+    PWR_PVDCmd(ENABLE);
+    EXTI_ClearITPendingBit(EXTI_Line16);
+    EXTI_InitStructure.EXTI_Line    = EXTI_Line16;
+    EXTI_InitStructure.EXTI_Mode    = EXTI_Mode_Interrupt;
+    EXTI_InitStructure.EXTI_Trigger = EXTI_Trigger_Rising;
+    EXTI_InitStructure.EXTI_LineCmd = ENABLE;
+    EXTI_Init(&EXTI_InitStructure);
+
+    NVIC_InitStructure.NVIC_IRQChannel                   = PVD_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;
+    NVIC_Init(&NVIC_InitStructure);
+}
+
+void BSP_Power_Sleep(void)
+{
+    __WFI();
+}
+
+/* STOP leaves the HSI as system clock: bring HSE and the PLL back (PLL settings are kept) */
+static void BSP_Power_RestoreClock(void)
+{
+    RCC_HSEConfig(RCC_HSE_ON);
+    if (RCC_WaitForHSEStartUp() != SUCCESS)
+        return;     /* stay on HSI; SystemCoreClock-based timings are then off by 9/8 */
+    RCC_PLLCmd(ENABLE);
+    while (RCC_GetFlagStatus(RCC_FLAG_PLLRDY) == RESET) { }
+    RCC_SYSCLKConfig(RCC_SYSCLKSource_PLLCLK);
+    while (RCC_GetSYSCLKSource() != 0x08) { }
+}
+
+uint8_t BSP_Power_Stop(uint32_t ms, uint32_t *pElapsedMs)
+{
+    uint32_t start;
+    uint32_t now;
+    uint32_t step;
+    uint32_t pending;
+    uint16_t syncUs;
+    uint8_t wake = 0;
+
+    if (ms == 0 || ms > BSP_POWER_STOP_MAX_MS)
+        ms = BSP_POWER_STOP_MAX_MS;
+
+    /* EXTI10: IO_SYN_US -> USART1_RX for the duration of STOP, IO_SYN_US is polled */
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOA, GPIO_PinSource10);
+    RTC_ClearFlag(RTC_FLAG_ALR);
+    EXTI->PR = BSP_POWER_EXTI_WAKE_LINES;
+    syncUs = (uint16_t)(IO_SYN_US_Port->IDR & IO_SYN_US_Pin);
+    start = now = RTC_GetCounter();
+
+    for (;;) {
+        step = ms - (now - start);
+        RTC_SetAlarm(now + (step < BSP_POWER_SYNC_POLL_MS ? step : BSP_POWER_SYNC_POLL_MS));
+        RTC_WaitForLastTask();
+
+        PWR_EnterSTOPMode(PWR_Regulator_LowPower, PWR_STOPEntry_WFI);
+        RTC_WaitForSynchro();   /* APB1 was stopped: CNT is stale until RSF */
+
+        pending = EXTI->PR & BSP_POWER_EXTI_WAKE_LINES;
+        now = RTC_GetCounter();
+        if ((uint16_t)(IO_SYN_US_Port->IDR & IO_SYN_US_Pin) != syncUs)
+            wake |= BSP_POWER_WAKE_SYNC;
+        if (wake != 0 || pending != EXTI_Line17 || now - start >= ms)
+            break;
+        /* Poll alarm only: back to STOP still on the HSI. The NVIC keeps the alarm
+         * pending after EXTI17 is cleared and would end the next WFI at once. */
+        EXTI->PR = EXTI_Line17;
+        RTC_ClearFlag(RTC_FLAG_ALR);
+        NVIC_ClearPendingIRQ(RTCAlarm_IRQn);
+    }
+
+    BSP_Power_RestoreClock();
+    if (pElapsedMs != NULL)
+        *pElapsedMs = now - start;
+    GPIO_EXTILineConfig(GPIO_PortSourceGPIOC, GPIO_PinSource10);
+    /* The alarm and the UART edge are handled here; sync/foot stay pending for EXTI15_10 */
+    EXTI->PR = pending & (EXTI_Line10 | EXTI_Line17);
+    RTC_ClearFlag(RTC_FLAG_ALR);
+
+    if (pending & EXTI_Line14)
+        wake |= BSP_POWER_WAKE_FOOT;
+    if (pending & (EXTI_Line11 | EXTI_Line12))
+        wake |= BSP_POWER_WAKE_SYNC;
+    if (pending & EXTI_Line10)
+        wake |= BSP_POWER_WAKE_UART;
+    if ((pending & EXTI_Line17) && now - start >= ms)
+        wake |= BSP_POWER_WAKE_ALARM;
+    return wake;
+}
+
+void BSP_Power_AlarmFromISR(void)
+{
+    RTC_ClearITPendingBit(RTC_IT_ALR);
+    EXTI_ClearITPendingBit(EXTI_Line17);
+}
+
+void BSP_Power_PvdFromISR(void)
+{
+    EXTI_ClearITPendingBit(EXTI_Line16);
+}
+
+uint8_t BSP_Power_IsSupplyLow(void)
+{
+    return PWR_GetFlagStatus(PWR_FLAG_PVDO) == SET;
+}
@@ -0,0 +1,52 @@
+/************************************************************************************
+ * @file     : bsp_power.h
+ * @brief    : M600 low-power modes - WFI sleep and STOP with RTC wake-up (STM32 Standard Library)
+ * @details  : The RTC runs from LSI with a ~1 ms tick and only serves as the STOP
+ *             wake-up alarm. The IWDG runs from the same LSI and keeps counting in
+ *             STOP, so an alarm period below BSP_POWER_STOP_MAX_MS always wakes in
+ *             time to feed it, whatever the actual LSI frequency.
+ *             USART1_RX (PA10) shares EXTI line 10 with IO_SYN_US (PC10): during STOP
+ *             the line is moved to PA10 so host traffic wakes the MCU. IO_SYN_US is
+ *             sampled instead every BSP_POWER_SYNC_POLL_MS: the poll alarm goes back
+ *             to STOP on the HSI, the PLL is only restored for a real wake-up.
+ *             The PVD (EXTI16) warns when VDD falls below BSP_POWER_PVD_LEVEL, the
+ *             last moment to commit RAM state before the brown-out reset.
+ * @hardware : STM32F103xE (M600)
+ ***********************************************************************************/
+#ifndef __BSP_POWER_H
+#define __BSP_POWER_H
+
+#include "stm32f10x.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BSP_POWER_STOP_MAX_MS   300u    /* < IWDG timeout (4 x 4096 LSI clocks, 410 ms) */
+#define BSP_POWER_SYNC_POLL_MS  20u     /* IO_SYN_US sampling while EXTI10 serves USART1_RX */
+
+/* STOP wake-up sources, returned by BSP_Power_Stop */
+#define BSP_POWER_WAKE_FOOT     (1u << 0)   /* MCU_FOOT, EXTI14 */
+#define BSP_POWER_WAKE_SYNC     (1u << 1)   /* IO_SYN_RF/ESW, EXTI11/12; IO_SYN_US, polled */
+#define BSP_POWER_WAKE_UART     (1u << 2)   /* USART1_RX start bit, EXTI10 */
+#define BSP_POWER_WAKE_ALARM    (1u << 3)   /* RTC alarm, EXTI17 */
+
+#define BSP_POWER_PVD_LEVEL     PWR_PVDLevel_2V9    /* highest level, longest warning */
+
+void BSP_Power_Init(void);
+/** Sleep until the next interrupt (SysTick at the latest). */
+void BSP_Power_Sleep(void);
+/** Call with interrupts disabled; returns the wake-up sources, *pElapsedMs = time in STOP.
+ *  The PLL clock is restored before returning. */
+uint8_t BSP_Power_Stop(uint32_t ms, uint32_t *pElapsedMs);
+void BSP_Power_AlarmFromISR(void);
+void BSP_Power_PvdFromISR(void);
+/** 1 while VDD is below BSP_POWER_PVD_LEVEL. */
+uint8_t BSP_Power_IsSupplyLow(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BSP_POWER_H */
@@ -2,8 +2,11 @@
  * @file     : bsp_tim.c
  * @brief    : M600 TIM1/TIM4 init - ported from M600 HAL
  * @details  : TIM1: external clock ETR(PA12), PWM CH1(PA8)/CH1N(PB13). TIM4: PWM CH3(PB8)/CH4(PB9).
+ *             TIM3: US burst gate on MCU_CTR_US_RF (PB14) through DMA1 Ch3 (UP) / Ch2 (CC3).
+ *             TIM7: fan PWM on CTR_FAN (PD2, no timer channel) through DMA2 Ch4 (UP).
  ***********************************************************************************/
 #include "bsp_tim.h"
+#include "bsp_gpio.h"
 
 void BSP_TIM1_Init(void)
 {
@@ -50,11 +53,16 @@ void BSP_TIM1_Init(void)
     TIM_OCInitStructure.TIM_OCIdleState = TIM_OCIdleState_Reset;
     TIM_OCInitStructure.TIM_OCNIdleState = TIM_OCNIdleState_Reset;
     TIM_OC1Init(TIM1, &TIM_OCInitStructure);
-    TIM_OC1PreloadConfig(TIM1, TIM_OCPreload_Disable);
+    /* ARR/CCR1 preloaded: a retune takes effect at the update event, never mid-period */
+    TIM_OC1PreloadConfig(TIM1, TIM_OCPreload_Enable);
+    TIM_ARRPreloadConfig(TIM1, ENABLE);
 
+    /* OSSR/OSSI on: while MOE is cleared CH1/CH1N are driven to the idle level (both low)
+     * instead of floating. BKIN (PB12) is used as MCU_CTR_OUT, so the break input stays
+     * disabled; the AWD trip raises the same break in software (BSP_TIM_EmergencyOff). */
     TIM_BDTRInitTypeDef TIM_BDTRInitStructure;
-    TIM_BDTRInitStructure.TIM_OSSRState       = TIM_OSSRState_Disable;
-    TIM_BDTRInitStructure.TIM_OSSIState       = TIM_OSSIState_Disable;
+    TIM_BDTRInitStructure.TIM_OSSRState       = TIM_OSSRState_Enable;
+    TIM_BDTRInitStructure.TIM_OSSIState       = TIM_OSSIState_Enable;
     TIM_BDTRInitStructure.TIM_LOCKLevel       = TIM_LOCKLevel_OFF;
     TIM_BDTRInitStructure.TIM_DeadTime        = 0;
     TIM_BDTRInitStructure.TIM_Break           = TIM_Break_Disable;
@@ -62,7 +70,7 @@ void BSP_TIM1_Init(void)
     TIM_BDTRInitStructure.TIM_AutomaticOutput = TIM_AutomaticOutput_Disable;
     TIM_BDTRConfig(TIM1, &TIM_BDTRInitStructure);
 
-    TIM_CtrlPWMOutputs(TIM1, ENABLE);
+    /* MOE stays off until BSP_TIM1_PwmStart: with CCR1 = 0 CH1N would sit high */
     TIM_Cmd(TIM1, ENABLE);
 }
 
@@ -105,6 +113,202 @@ void BSP_TIM1_SetCompare1(uint16_t pulse)
     TIM_SetCompare1(TIM1, pulse);
 }
 
+/* BSRR words the gate DMA copies: set at the update event, reset at the CC3 match */
+static const uint32_t s_gateOn  = MCU_CTR_US_RF_Pin;
+static const uint32_t s_gateOff = (uint32_t)MCU_CTR_US_RF_Pin << 16;
+static volatile uint8_t s_tim3Run = 0;
+
+static void BSP_TIM3_GateDmaInit(DMA_Channel_TypeDef *pCh, const uint32_t *pWord)
+{
+    DMA_InitTypeDef DMA_InitStructure;
+
+    DMA_DeInit(pCh);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&MCU_CTR_US_RF_Port->BSRR;
+    DMA_InitStructure.DMA_MemoryBaseAddr     = (uint32_t)(uintptr_t)pWord;
+    DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize         = 1;
+    DMA_InitStructure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc          = DMA_MemoryInc_Disable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    DMA_InitStructure.DMA_MemoryDataSize     = DMA_MemoryDataSize_Word;
+    DMA_InitStructure.DMA_Mode               = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority           = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M                = DMA_M2M_Disable;
+    DMA_Init(pCh, &DMA_InitStructure);
+    DMA_Cmd(pCh, ENABLE);
+}
+
+/**
+ * TIM3 counts 1 us; the update event turns the gate on, CC3 turns it off. The edges come
+ * from the DMA, not from an ISR or the main loop. CC3 has no output (PB0 stays analog).
+ */
+void BSP_TIM3_GateInit(void)
+{
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    TIM_OCInitTypeDef TIM_OCInitStructure;
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM3, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
+
+    TIM_TimeBaseStructure.TIM_Period        = 65535;
+    TIM_TimeBaseStructure.TIM_Prescaler     = (uint16_t)(SystemCoreClock / 1000000u - 1u);
+    TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStructure.TIM_CounterMode   = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM3, &TIM_TimeBaseStructure);
+
+    TIM_OCStructInit(&TIM_OCInitStructure);
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+    TIM_OC3Init(TIM3, &TIM_OCInitStructure);
+    /* ARR/CCR3 preloaded: a new period/on-time starts at the next period boundary */
+    TIM_OC3PreloadConfig(TIM3, TIM_OCPreload_Enable);
+    TIM_ARRPreloadConfig(TIM3, ENABLE);
+
+    BSP_TIM3_GateDmaInit(DMA1_Channel3, &s_gateOn);
+    BSP_TIM3_GateDmaInit(DMA1_Channel2, &s_gateOff);
+    TIM_DMACmd(TIM3, TIM_DMA_Update | TIM_DMA_CC3, ENABLE);
+}
+
+/* UG loads the preloads and its update DMA request opens the first burst */
+static void BSP_TIM3_GateRun(void)
+{
+    TIM3->CNT = 0;
+    TIM3->EGR = TIM_EGR_UG;
+    TIM3->CR1 |= TIM_CR1_CEN;
+}
+
+/* on_us >= period_us keeps the gate on (CC3 never matches). After a trip (TIM1 BIF) the
+ * gate waits for BSP_TIM_OutputsRestore */
+void BSP_TIM3_GateSet(uint16_t period_us, uint16_t on_us)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    /* Back to back: a boundary between the two writes gives one period mixing old and
+     * new values, never a cut pulse */
+    TIM3->CCR3 = on_us;
+    TIM3->ARR = (uint16_t)(period_us - 1u);
+    if (!s_tim3Run) {
+        s_tim3Run = 1;
+        if ((TIM1->SR & TIM_SR_BIF) == 0)
+            BSP_TIM3_GateRun();
+    }
+    __set_PRIMASK(primask);
+}
+
+/* Counter first, so no DMA request can follow the reset */
+void BSP_TIM3_GateStop(void)
+{
+    s_tim3Run = 0;
+    TIM3->CR1 &= (uint16_t)~TIM_CR1_CEN;
+    MCU_CTR_US_RF_Port->BRR = MCU_CTR_US_RF_Pin;
+}
+
+/* One BSRR word per slot, the DMA walks the ring at every TIM7 update */
+static uint32_t s_fanSlots[BSP_TIM7_FAN_SLOTS];
+static volatile uint8_t s_tim7Run = 0;
+
+/**
+ * TIM7 updates every BSP_TIM7_FAN_SLOT_US; each update copies the next slot into GPIOD BSRR,
+ * so one pass of the ring is one PWM period (20 ms) with no ISR and no main loop timing.
+ */
+void BSP_TIM7_FanInit(void)
+{
+    TIM_TimeBaseInitTypeDef TIM_TimeBaseStructure;
+    DMA_InitTypeDef DMA_InitStructure;
+
+    RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM7, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);
+
+    TIM_TimeBaseStructure.TIM_Period        = BSP_TIM7_FAN_SLOT_US - 1u;
+    TIM_TimeBaseStructure.TIM_Prescaler     = (uint16_t)(SystemCoreClock / 1000000u - 1u);
+    TIM_TimeBaseStructure.TIM_ClockDivision = TIM_CKD_DIV1;
+    TIM_TimeBaseStructure.TIM_CounterMode   = TIM_CounterMode_Up;
+    TIM_TimeBaseInit(TIM7, &TIM_TimeBaseStructure);
+
+    DMA_DeInit(DMA2_Channel4);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&CTR_FAN_Port->BSRR;
+    DMA_InitStructure.DMA_MemoryBaseAddr     = (uint32_t)(uintptr_t)s_fanSlots;
+    DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize         = BSP_TIM7_FAN_SLOTS;
+    DMA_InitStructure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc          = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_Word;
+    DMA_InitStructure.DMA_MemoryDataSize     = DMA_MemoryDataSize_Word;
+    DMA_InitStructure.DMA_Mode               = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority           = DMA_Priority_Low;
+    DMA_InitStructure.DMA_M2M                = DMA_M2M_Disable;
+    DMA_Init(DMA2_Channel4, &DMA_InitStructure);
+    DMA_Cmd(DMA2_Channel4, ENABLE);
+    TIM_DMACmd(TIM7, TIM_DMA_Update, ENABLE);
+}
+
+/* 0 and BSP_TIM7_FAN_SLOTS stop the timer and hold the pin; otherwise the ring is rewritten
+ * in place, the period being copied may mix old and new slots once */
+void BSP_TIM7_FanSet(uint8_t on_slots)
+{
+    uint8_t i;
+
+    if (on_slots == 0 || on_slots >= BSP_TIM7_FAN_SLOTS) {
+        s_tim7Run = 0;
+        TIM7->CR1 &= (uint16_t)~TIM_CR1_CEN;
+        if (on_slots == 0)
+            CTR_FAN_Port->BRR = CTR_FAN_Pin;
+        else
+            CTR_FAN_Port->BSRR = CTR_FAN_Pin;
+        return;
+    }
+    for (i = 0; i < BSP_TIM7_FAN_SLOTS; i++)
+        s_fanSlots[i] = (i < on_slots) ? CTR_FAN_Pin : ((uint32_t)CTR_FAN_Pin << 16);
+    if (!s_tim7Run) {
+        s_tim7Run = 1;
+        TIM7->CNT = 0;
+        TIM7->CR1 |= TIM_CR1_CEN;
+    }
+}
+
+static volatile uint8_t s_tim1Run = 0;
+
+/* BDTR is shared with the trip ISR: a read-modify-write must not resurrect a cleared MOE */
+static void BSP_TIM1_WriteBdtr(uint16_t clear, uint16_t set)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    TIM1->BDTR = (uint16_t)((TIM1->BDTR & ~clear) | set);
+    __set_PRIMASK(primask);
+}
+
+/* period/pulse in ETR ticks, dtg: BDTR.DTG. After a trip (BIF) MOE waits for BSP_TIM_OutputsRestore */
+void BSP_TIM1_PwmStart(uint16_t period, uint16_t pulse, uint8_t dtg)
+{
+    uint32_t primask;
+
+    BSP_TIM1_WriteBdtr(TIM_BDTR_MOE | TIM_BDTR_DTG, dtg);
+    TIM1->ARR = (uint16_t)(period - 1u);
+    TIM1->CCR1 = pulse;
+    s_tim1Run = 1;
+
+    primask = __get_PRIMASK();
+    __disable_irq();
+    /* UG loads the preloads and restarts the count, so the first pulse is a whole one */
+    TIM1->EGR = TIM_EGR_UG;
+    if ((TIM1->SR & TIM_SR_BIF) == 0)
+        TIM1->BDTR |= TIM_BDTR_MOE;
+    __set_PRIMASK(primask);
+}
+
+void BSP_TIM1_PwmStop(void)
+{
+    s_tim1Run = 0;
+    BSP_TIM1_WriteBdtr(TIM_BDTR_MOE, 0);
+}
+
+/* Not preloaded by the hardware: applies from the next CH1/CH1N edge */
+void BSP_TIM1_SetDeadTime(uint8_t dtg)
+{
+    BSP_TIM1_WriteBdtr(TIM_BDTR_DTG, dtg);
+}
+
 void BSP_TIM4_SetCompare3(uint16_t pulse)
 {
     TIM_SetCompare3(TIM4, pulse);
@@ -114,3 +318,40 @@ void BSP_TIM4_SetCompare4(uint16_t pulse)
 {
     TIM_SetCompare4(TIM4, pulse);
 }
+
+/* Interrupt-safe, register writes only: ESW+/ESW- low now, whatever CCR3/CCR4 are written next */
+void BSP_TIM4_OutputsOff(void)
+{
+    TIM_ForcedOC3Config(TIM4, TIM_ForcedAction_InActive);
+    TIM_ForcedOC4Config(TIM4, TIM_ForcedAction_InActive);
+    TIM_SetCompare3(TIM4, 0);
+    TIM_SetCompare4(TIM4, 0);
+}
+
+void BSP_TIM4_OutputsOn(void)
+{
+    TIM_SelectOCxM(TIM4, TIM_Channel_3, TIM_OCMode_PWM1);
+    TIM_SelectOCxM(TIM4, TIM_Channel_4, TIM_OCMode_PWM1);
+    TIM_CCxCmd(TIM4, TIM_Channel_3, TIM_CCx_Enable);
+    TIM_CCxCmd(TIM4, TIM_Channel_4, TIM_CCx_Enable);
+}
+
+/* Over-current trip: called from interrupt context, register writes only. Software break:
+ * MOE cleared by the hardware, CH1/CH1N to idle, BIF latched until BSP_TIM_OutputsRestore */
+void BSP_TIM_EmergencyOff(void)
+{
+    TIM1->EGR = TIM_EGR_BG;
+    TIM3->CR1 &= (uint16_t)~TIM_CR1_CEN;
+    MCU_CTR_US_RF_Port->BRR = MCU_CTR_US_RF_Pin;
+    BSP_TIM4_OutputsOff();
+}
+
+void BSP_TIM_OutputsRestore(void)
+{
+    BSP_TIM4_OutputsOn();
+    TIM1->SR = (uint16_t)~TIM_SR_BIF;
+    if (s_tim1Run)
+        BSP_TIM1_WriteBdtr(0, TIM_BDTR_MOE);
+    if (s_tim3Run)
+        BSP_TIM3_GateRun();
+}
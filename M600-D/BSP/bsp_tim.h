@@ -1,6 +1,6 @@
 /************************************************************************************
  * @file     : bsp_tim.h
- * @brief    : M600 TIM module - TIM1 (ETR+PWM CH1/CH1N), TIM4 (PWM CH3/CH4)
+ * @brief    : M600 TIM module - TIM1 (ETR+PWM CH1/CH1N), TIM4 (PWM CH3/CH4), TIM7 (fan PWM)
  * @details  : Ported from M600 HAL. TIM1: PA12 ETR, PA8 CH1, PB13 CH1N. TIM4: PB8 CH3, PB9 CH4.
  * @hardware : STM32F103xE (M600)
  ***********************************************************************************/
@@ -14,12 +14,31 @@
 extern "C" {
 #endif
 
+#define BSP_TIM7_FAN_SLOTS      40u     /* fan PWM resolution, 2.5 % per slot */
+#define BSP_TIM7_FAN_SLOT_US    500u    /* 40 x 500 us = 20 ms, 50 Hz */
+
 void BSP_TIM1_Init(void);   /* TIM1: ETR(PA12), CH1(PA8), CH1N(PB13), PWM, period 65535 */
 void BSP_TIM4_Init(void);   /* TIM4: CH3(PB8), CH4(PB9), PWM, period 65535 */
+void BSP_TIM3_GateInit(void);   /* TIM3: 1 us tick, UP/CC3 DMA -> MCU_CTR_US_RF (PB14) */
+void BSP_TIM7_FanInit(void);    /* TIM7: slot tick, UP DMA ring -> CTR_FAN (PD2) */
 
 void BSP_TIM1_SetCompare1(uint16_t pulse);
+/* Complementary CH1/CH1N: period/pulse in ETR ticks, dtg = BDTR.DTG (tDTS = 1/72 MHz) */
+void BSP_TIM1_PwmStart(uint16_t period, uint16_t pulse, uint8_t dtg);
+void BSP_TIM1_PwmStop(void);         /* MOE off, CH1/CH1N idle low */
+void BSP_TIM1_SetDeadTime(uint8_t dtg);
+/* US burst gate: period/on-time in us, preloaded (next period boundary), starts if stopped */
+void BSP_TIM3_GateSet(uint16_t period_us, uint16_t on_us);
+void BSP_TIM3_GateStop(void);        /* gate low now */
 void BSP_TIM4_SetCompare3(uint16_t pulse);
 void BSP_TIM4_SetCompare4(uint16_t pulse);
+void BSP_TIM4_OutputsOff(void);      /* CH3/CH4 forced inactive, CCR3/CCR4 = 0; from an ISR too */
+void BSP_TIM4_OutputsOn(void);       /* CH3/CH4 back to PWM1 */
+/* Fan on for on_slots of BSP_TIM7_FAN_SLOTS; 0 = off, >= BSP_TIM7_FAN_SLOTS = on, timer stopped */
+void BSP_TIM7_FanSet(uint8_t on_slots);
+
+void BSP_TIM_EmergencyOff(void);     /* TIM1 break (MOE off, OSSI idle low), TIM3 gate low, TIM4 CH3/CH4 forced inactive */
+void BSP_TIM_OutputsRestore(void);   /* Undo BSP_TIM_EmergencyOff; TIM1/TIM3 only if started */
 
 #ifdef __cplusplus
 }
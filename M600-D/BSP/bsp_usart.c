@@ -30,8 +30,8 @@ void BSP_USART1_Init(uint32_t Baud)
 
     /* DMA1 Ch5: USART1 RX, peripheral -> memory */
     DMA_DeInit(DMA1_Channel5);
-    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&USART1->DR;
-    DMA_InitStructure.DMA_MemoryBaseAddr     = (uint32_t)BSP_USART1_RxBuf;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&USART1->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr     = (uint32_t)(uintptr_t)BSP_USART1_RxBuf;
     DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralSRC;
     DMA_InitStructure.DMA_BufferSize         = BSP_USART_REC_LEN;
     DMA_InitStructure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
@@ -47,7 +47,7 @@ void BSP_USART1_Init(uint32_t Baud)
 
     /* DMA1 Ch4: USART1 TX, memory -> peripheral (buffer set at send time) */
     DMA_DeInit(DMA1_Channel4);
-    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&USART1->DR;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&USART1->DR;
     DMA_InitStructure.DMA_MemoryBaseAddr     = 0;  /* set in BSP_USART1_DMA_Send */
     DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralDST;
     DMA_InitStructure.DMA_BufferSize         = 0;
@@ -71,14 +71,14 @@ void BSP_USART1_Init(uint32_t Baud)
 
     USART_ITConfig(USART1, USART_IT_RXNE, DISABLE);
     USART_ITConfig(USART1, USART_IT_TC,  DISABLE);
-    USART_ITConfig(USART1, USART_IT_IDLE, DISABLE);  /* enable for frame end; handler in stm32f103_it.c */
+    USART_ITConfig(USART1, USART_IT_IDLE, ENABLE);   /* frame end; handler in stm32f103_it.c */
 
     USART_DMACmd(USART1, USART_DMAReq_Rx, ENABLE);
     USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
 
     /* NVIC: DMA Ch4/Ch5 + USART1 (for IDLE when enabled) */
     NVIC_InitStructure.NVIC_IRQChannel                   = DMA1_Channel4_IRQn;
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;   /* below ADC AWD trip */
     NVIC_InitStructure.NVIC_IRQChannelSubPriority        = 0;
     NVIC_InitStructure.NVIC_IRQChannelCmd                = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
@@ -115,8 +115,8 @@ void BSP_USART2_Init(uint32_t Baud)
 
     /* DMA1 Ch6: USART2 RX, peripheral -> memory */
     DMA_DeInit(DMA1_Channel6);
-    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&USART2->DR;
-    DMA_InitStructure.DMA_MemoryBaseAddr     = (uint32_t)BSP_USART2_RxBuf;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&USART2->DR;
+    DMA_InitStructure.DMA_MemoryBaseAddr     = (uint32_t)(uintptr_t)BSP_USART2_RxBuf;
     DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralSRC;
     DMA_InitStructure.DMA_BufferSize         = BSP_USART_REC_LEN;
     DMA_InitStructure.DMA_PeripheralInc      = DMA_PeripheralInc_Disable;
@@ -132,7 +132,7 @@ void BSP_USART2_Init(uint32_t Baud)
 
     /* DMA1 Ch7: USART2 TX, memory -> peripheral (buffer set at send time) */
     DMA_DeInit(DMA1_Channel7);
-    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)&USART2->DR;
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (uint32_t)(uintptr_t)&USART2->DR;
     DMA_InitStructure.DMA_MemoryBaseAddr     = 0;  /* set in BSP_USART2_DMA_Send */
     DMA_InitStructure.DMA_DIR                = DMA_DIR_PeripheralDST;
     DMA_InitStructure.DMA_BufferSize         = 0;
@@ -163,7 +163,7 @@ void BSP_USART2_Init(uint32_t Baud)
 
     /* NVIC: DMA Ch6/Ch7 + USART2 (for IDLE when enabled) */
     NVIC_InitStructure.NVIC_IRQChannel                   = DMA1_Channel6_IRQn;
-    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 0;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 1;   /* below ADC AWD trip */
     NVIC_InitStructure.NVIC_IRQChannelSubPriority        = 3;
     NVIC_InitStructure.NVIC_IRQChannelCmd                = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
@@ -185,7 +185,7 @@ void BSP_USART1_DMA_Send(const uint8_t *pData, uint32_t Len)
     DMA_Cmd(DMA1_Channel4, DISABLE);
     while (DMA1_Channel4->CCR & DMA_CCR4_EN) { }
 
-    DMA1_Channel4->CMAR = (uint32_t)pData;
+    DMA1_Channel4->CMAR = (uint32_t)(uintptr_t)pData;
     DMA_SetCurrDataCounter(DMA1_Channel4, Len);
     DMA_Cmd(DMA1_Channel4, ENABLE);
 }
@@ -198,7 +198,7 @@ void BSP_USART2_DMA_Send(const uint8_t *pData, uint32_t Len)
     DMA_Cmd(DMA1_Channel7, DISABLE);
     while (DMA1_Channel7->CCR & DMA_CCR7_EN) { }
 
-    DMA1_Channel7->CMAR = (uint32_t)pData;
+    DMA1_Channel7->CMAR = (uint32_t)(uintptr_t)pData;
     DMA_SetCurrDataCounter(DMA1_Channel7, Len);
     DMA_Cmd(DMA1_Channel7, ENABLE);
 }
@@ -0,0 +1,25 @@
+/************************************************************************************
+ * @file     : boot_main.c
+ * @brief    : M600 bootloader - fixed first stage in the write-protected low pages
+ * @details  : Owns the reset vector and never changes in the field. Runs the pending
+ *             slot exchange or rollback (drv_fwswap), then starts the application
+ *             linked at FWSWAP_ACTIVE_ADDR. No peripheral besides flash is touched
+ *             and no interrupt is enabled, so the application starts from reset state.
+ *             Built by Project/M600_Boot.uvprojx, programmed once through SWD.
+ ***********************************************************************************/
+#include "stm32f10x.h"
+#include "drv_fwswap.h"
+
+int main(void)
+{
+    Drv_FwSwap_BootCheck();     /* may exchange the slots and reset */
+
+    /* A trial image that does not even have a vector table is rolled back at once */
+    if (!Drv_FwSwap_AppValid() && Drv_FwSwap_GetState() == E_FWSWAP_TRIAL && Drv_FwSwap_MarkRevert())
+        Drv_FwSwap_Exec(true);
+    if (Drv_FwSwap_AppValid())
+        Drv_FwSwap_StartApp();
+
+    /* Nothing to start: stay here until the application is programmed through SWD */
+    while (1) { }
+}
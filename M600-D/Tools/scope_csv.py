@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Decode the RTT scope stream (RTT up-buffer 1, see drv_scope.h) to CSV.
+
+Capture:  JLinkRTTLogger -Device STM32F103RE -If SWD -Speed 4000 -RTTChannel 1 scope.bin
+Select:   on RTT channel 0, e.g.  scope us_i dac tgt state div 2
+Decode:   python3 scope_csv.py scope.bin > scope.csv
+
+ADC and DAC columns are converted to mV at the pin; tgt and state are written as sent.
+Samples skipped on target (RTT buffer full) are counted from seq gaps and reported
+on stderr; time_s keeps counting across them.
+"""
+import struct
+import sys
+
+# Scope_Source_EnumDef order
+SOURCES = ["us_i", "rf_i", "esw_u", "esw_i", "hp_pre", "ntc", "dac", "tgt", "state"]
+RAW_SOURCES = {"us_i", "rf_i", "esw_u", "esw_i", "hp_pre", "ntc", "dac"}
+REF_MV = 3300.0
+FULL_SCALE = 4096.0
+HEADER_MAGIC = 0xFFFF
+SEQ_MASK = 0x7FFF
+
+
+def decode(data, out):
+    pos = 0
+    names = None
+    period_s = 0.0
+    sample = 0
+    last = None
+    lost = 0
+    written = 0
+
+    while pos + 2 <= len(data):
+        (word,) = struct.unpack_from("<H", data, pos)
+        if word == HEADER_MAGIC:
+            if pos + 8 > len(data):
+                break
+            count, div, period_ns = struct.unpack_from("<BBI", data, pos + 2)
+            ids = data[pos + 8:pos + 8 + count]
+            pos += 8 + ((count + 1) & ~1)
+            names = [SOURCES[i] if i < len(SOURCES) else "src%d" % i for i in ids]
+            period_s = period_ns * 1e-9
+            sample = 0
+            last = None
+            out.write("# period_us=%.1f div=%d\n" % (period_ns / 1000.0, div))
+            out.write(",".join(["time_s", "seq"] + names) + "\n")
+            continue
+        if names is None:
+            # capture started mid-stream: nothing is decodable before a header
+            pos += 2
+            continue
+        size = 2 * (1 + len(names))
+        if pos + size > len(data):
+            break
+        words = struct.unpack_from("<%dH" % (1 + len(names)), data, pos)
+        pos += size
+        seq = words[0]
+        if last is not None:
+            gap = (seq - last - 1) & SEQ_MASK
+            lost += gap
+            sample += gap + 1
+        last = seq
+        cols = ["%.6f" % (sample * period_s), str(seq)]
+        for name, value in zip(names, words[1:]):
+            if name in RAW_SOURCES:
+                cols.append("%.1f" % (value * REF_MV / FULL_SCALE))
+            else:
+                cols.append(str(value))
+        out.write(",".join(cols) + "\n")
+        written += 1
+
+    sys.stderr.write("%d samples, %d lost\n" % (written, lost))
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: scope_csv.py <rtt channel 1 capture>\n")
+        return 2
+    with open(sys.argv[1], "rb") as f:
+        decode(f.read(), sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
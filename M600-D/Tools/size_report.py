@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Flash/RAM per object file, from a Keil map or from a compile of the sources.
+
+Keil:     python3 size_report.py map ../Project/Listings/M600.map app_
+GCC:      python3 size_report.py build ../User/APP/app_*.c
+Host:     python3 size_report.py build --host ../User/APP/app_*.c
+
+map reads the "Image component sizes" table of an armlink map and prints the objects
+whose name contains the filter. build compiles each source on its own with
+arm-none-eabi-gcc -mcpu=cortex-m3 -mthumb -Os -ffunction-sections (CC, CFLAGS and
+SIZE override) using the include paths and defines of Project/M600.uvprojx, then reads
+the sections with size. --host uses gcc -m32 -Os, freestanding, with the simulator's
+device header when no ARM toolchain is installed: a 32-bit proxy for comparing two
+trees, not the numbers the part will see.
+
+flash = code + const (+ initialised data), RAM = data + bss, as armlink counts them.
+"""
+import os
+import re
+import shlex
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.normpath(os.path.join(os.path.dirname(os.path.abspath(__file__)), ".."))
+PROJECT = os.path.join(ROOT, "Project", "M600.uvprojx")
+ARM_CC = "arm-none-eabi-gcc"
+ARM_CFLAGS = "-mcpu=cortex-m3 -mthumb -Os -ffunction-sections -fdata-sections"
+ARM_SIZE = "arm-none-eabi-size"
+HOST_CC = "gcc"
+HOST_SIZE = "size"
+HOST_CFLAGS = "-m32 -Os -ffunction-sections -fdata-sections -fno-pic -fno-asynchronous-unwind-tables"
+
+# --host compiles freestanding: 32-bit libc headers are often missing, prototypes are enough
+HOST_LIBC = {
+    "string.h": "void *memcpy(void *, const void *, size_t); void *memset(void *, int, size_t);\n"
+                "int memcmp(const void *, const void *, size_t); void *memmove(void *, const void *, size_t);\n"
+                "size_t strlen(const char *); int strcmp(const char *, const char *);\n"
+                "int strncmp(const char *, const char *, size_t); char *strncpy(char *, const char *, size_t);\n"
+                "char *strcpy(char *, const char *); char *strchr(const char *, int);\n",
+    "stdio.h": "#include <stdarg.h>\nint snprintf(char *, size_t, const char *, ...);\n"
+               "int vsnprintf(char *, size_t, const char *, va_list); int printf(const char *, ...);\n",
+    "stdlib.h": "int abs(int); int atoi(const char *); long strtol(const char *, char **, int);\n"
+                "unsigned long strtoul(const char *, char **, int);\n",
+    "ctype.h": "int isdigit(int); int isspace(int); int isalpha(int); int tolower(int); int toupper(int);\n",
+}
+
+
+def print_table(rows):
+    total = [0, 0, 0, 0]
+    print("%8s %8s %8s %8s  %s" % ("code", "const", "data", "bss", "object"))
+    for name, sizes in rows:
+        print("%8d %8d %8d %8d  %s" % (sizes[0], sizes[1], sizes[2], sizes[3], name))
+        total = [t + s for t, s in zip(total, sizes)]
+    print("%8d %8d %8d %8d  total: flash %d, RAM %d" % (total[0], total[1], total[2], total[3],
+          total[0] + total[1] + total[2], total[2] + total[3]))
+
+
+def from_map(path, pattern):
+    rows = []
+    in_table = False
+    with open(path, errors="replace") as f:
+        for line in f:
+            if "Code (inc. data)" in line:
+                in_table = "Object Name" in line
+                continue
+            if not in_table:
+                continue
+            fields = line.split()
+            if len(fields) == 7 and fields[0].isdigit() and pattern in fields[6]:
+                code, _, ro, rw, zi = (int(x) for x in fields[:5])
+                rows.append((fields[6], (code, ro, rw, zi)))
+    print_table(rows)
+
+
+def project_flags():
+    with open(PROJECT, errors="replace") as f:
+        text = f.read()
+    defines = re.search(r"<Define>([^<]+)</Define>", text).group(1).split(",")
+    incs = re.search(r"<IncludePath>([^<]+)</IncludePath>", text).group(1).split(";")
+    paths = []
+    for inc in incs:
+        path = os.path.normpath(os.path.join(ROOT, "Project", inc.replace("\\", "/")))
+        if path not in paths:
+            paths.append(path)
+    return ["-D" + d.strip() for d in defines if d.strip()], ["-I" + p for p in paths]
+
+
+def section_sizes(size, obj):
+    # size -A: one line per section, name and size
+    out = subprocess.run(size + ["-A", obj], check=True, capture_output=True, text=True).stdout
+    code = const = data = bss = 0
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) < 2 or not fields[1].isdigit():
+            continue
+        name, size = fields[0], int(fields[1])
+        if name.startswith(".text"):
+            code += size
+        elif name.startswith(".rodata"):
+            const += size
+        elif name.startswith(".data"):
+            data += size
+        elif name.startswith(".bss") or name == "COMMON":
+            bss += size
+    return code, const, data, bss
+
+
+def from_build(sources, host):
+    cc = shlex.split(os.environ.get("CC", HOST_CC if host else ARM_CC))
+    cflags = shlex.split(os.environ.get("CFLAGS", HOST_CFLAGS if host else ARM_CFLAGS))
+    size = shlex.split(os.environ.get("SIZE", HOST_SIZE if host else ARM_SIZE))
+    defines, incs = project_flags()
+    rows = []
+    with tempfile.TemporaryDirectory() as tmp:
+        if host:
+            for name, body in HOST_LIBC.items():
+                with open(os.path.join(tmp, name), "w") as f:
+                    f.write("#pragma once\n#include <stddef.h>\n" + body)
+            incs = ["-I" + os.path.join(ROOT, "sim", "include")] + incs + ["-isystem", tmp]
+            cflags = cflags + ["-ffreestanding", "-nostdinc", "-isystem",
+                               subprocess.run(cc + ["-print-file-name=include"], check=True,
+                                              capture_output=True, text=True).stdout.strip()]
+        for src in sources:
+            obj = os.path.join(tmp, os.path.splitext(os.path.basename(src))[0] + ".o")
+            subprocess.run(cc + cflags + defines + incs + ["-w", "-c", src, "-o", obj], check=True)
+            rows.append((os.path.basename(obj), section_sizes(size, obj)))
+    print_table(rows)
+
+
+def main():
+    args = sys.argv[1:]
+    if len(args) >= 2 and args[0] == "map":
+        from_map(args[1], args[2] if len(args) > 2 else "")
+    elif len(args) >= 2 and args[0] == "build":
+        host = "--host" in args
+        from_build([a for a in args[1:] if a != "--host"], host)
+    else:
+        print(__doc__, file=sys.stderr)
+        sys.exit(2)
+
+
+if __name__ == "__main__":
+    main()
@@ -9,19 +9,224 @@
 **********************************************************************************/
 #include "app_comm.h"
 #include "lib_ringbuffer.h"
+#include "drv_trace.h"
+#include "drv_usart.h"
+#include "drv_delay.h"
+#include "drv_boottime.h"
+#include "app_memory.h"
+#include "app_update.h"
+#include "app_program.h"
 
 App_Comm_Info_t s_AppCommInfo;
+static uint32_t s_lastRxMs = 0;     ///< 最近一次收到USART1数据的时刻
+
+/* 共享状态槽：锁 + 数据，按模块/命令查表 */
+typedef struct
+{
+    SeqLock_t *pLock;
+    void *pData;
+    uint16_t size;
+} App_Comm_Slot_t;
+
+#define APP_COMM_MODULE_NUM     4   ///< PROTOCOL_MODULE_ULTRASOUND .. PROTOCOL_MODULE_HEAT
+#define APP_COMM_RX_CHUNK       64  ///< 每次从USART1接收缓冲取出的字节数
+
+static const App_Comm_Slot_t s_StatusSlot[APP_COMM_MODULE_NUM] =
+{
+    { &s_AppCommInfo.US.TxStatusLock,   &s_AppCommInfo.US.TxStatus,   sizeof(US_GetStatus_Reply_t) },
+    { &s_AppCommInfo.RF.TxStatusLock,   &s_AppCommInfo.RF.TxStatus,   sizeof(RF_GetStatus_Reply_t) },
+    { &s_AppCommInfo.SW.TxStatusLock,   &s_AppCommInfo.SW.TxStatus,   sizeof(SW_GetStatus_Reply_t) },
+    { &s_AppCommInfo.Heat.TxStatusLock, &s_AppCommInfo.Heat.TxStatus, sizeof(Heat_GetStatus_Reply_t) },
+};
+
+/* 状态回复按字段顺序小端打包（结构体含对齐填充，不能整体发送），偏移和长度取自结构体定义 */
+typedef struct
+{
+    uint8_t offset;
+    uint8_t size;
+} App_Comm_Field_t;
+
+typedef struct
+{
+    const App_Comm_Field_t *pFields;
+    uint8_t num;
+    uint8_t baseNum;            ///< PROTOCOL_STATUS_BASE应答的字段数（到error_code为止）
+} App_Comm_Fields_t;
+
+#define APP_COMM_FIELD(type, field)     { (uint8_t)offsetof(type, field), (uint8_t)sizeof(((type *)0)->field) }
+/* 编译期检查：条件不成立时数组长度为负 */
+#define APP_COMM_STATIC_ASSERT(cond, name)  typedef char App_Comm_Assert_##name[(cond) ? 1 : -1]
+/* 表中最后一个字段之后只剩结构体尾部填充：结构体末尾新增字段而未加入表时编译失败 */
+#define APP_COMM_FIELDS_END(type, field, name) \
+    APP_COMM_STATIC_ASSERT(sizeof(type) - offsetof(type, field) - sizeof(((type *)0)->field) < 4u, name)
+
+static const App_Comm_Field_t s_USStatusFields[] =
+{
+    APP_COMM_FIELD(US_GetStatus_Reply_t, work_state),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, frequency),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, temp_limit),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, remain_time),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, work_level),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, head_temp),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, conn_state),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, error_code),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, deliver_time),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, program_step),
+    APP_COMM_FIELD(US_GetStatus_Reply_t, step_remain),
+};
+APP_COMM_FIELDS_END(US_GetStatus_Reply_t, step_remain, USStatusEnd);
+
+static const App_Comm_Field_t s_RFStatusFields[] =
+{
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, work_state),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, temp_limit),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, remain_time),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, work_level),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, head_temp),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, conn_state),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, error_code),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, deliver_time),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, power),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, energy),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, program_step),
+    APP_COMM_FIELD(RF_GetStatus_Reply_t, step_remain),
+};
+APP_COMM_FIELDS_END(RF_GetStatus_Reply_t, step_remain, RFStatusEnd);
+
+static const App_Comm_Field_t s_SWStatusFields[] =
+{
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, work_state),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, frequency),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, remain_time),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, work_level),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, head_temp),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, conn_state),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, error_code),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, shot_energy),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, energy),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, program_step),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, step_remain),
+    APP_COMM_FIELD(SW_GetStatus_Reply_t, max_rate),
+};
+APP_COMM_FIELDS_END(SW_GetStatus_Reply_t, max_rate, SWStatusEnd);
+
+static const App_Comm_Field_t s_HeatStatusFields[] =
+{
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, work_state),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, temp_limit),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, remain_heat_time),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, suck_time),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, release_time),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, pressure),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, head_temp),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, preheat_state),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, preheat_temp_limit),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, remain_preheat_time),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, conn_state),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, error_code),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, deliver_heat_time),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, program_step),
+    APP_COMM_FIELD(Heat_GetStatus_Reply_t, step_remain),
+};
+APP_COMM_FIELDS_END(Heat_GetStatus_Reply_t, step_remain, HeatStatusEnd);
+
+/* App_Comm_ReplyStatus按最大的状态结构体分配缓冲 */
+APP_COMM_STATIC_ASSERT(sizeof(US_GetStatus_Reply_t) <= sizeof(Heat_GetStatus_Reply_t) &&
+                       sizeof(RF_GetStatus_Reply_t) <= sizeof(Heat_GetStatus_Reply_t) &&
+                       sizeof(SW_GetStatus_Reply_t) <= sizeof(Heat_GetStatus_Reply_t), StatusMax);
+
+/* 基础应答保持V1.0长度，旧上位机不受新增字段影响；EXT字段只在请求PROTOCOL_STATUS_EXT时追加 */
+static const App_Comm_Fields_t s_StatusFields[APP_COMM_MODULE_NUM] =
+{
+    { s_USStatusFields,   sizeof(s_USStatusFields) / sizeof(s_USStatusFields[0]),     8 },
+    { s_RFStatusFields,   sizeof(s_RFStatusFields) / sizeof(s_RFStatusFields[0]),     7 },
+    { s_SWStatusFields,   sizeof(s_SWStatusFields) / sizeof(s_SWStatusFields[0]),     7 },
+    { s_HeatStatusFields, sizeof(s_HeatStatusFields) / sizeof(s_HeatStatusFields[0]), 12 },
+};
+
+/* [module][cmd - PROTOCOL_CMD_SET_WORK_STATE] */
+static const App_Comm_Slot_t s_RxSlot[APP_COMM_MODULE_NUM][2] =
+{
+    {
+        { &s_AppCommInfo.US.RxWorkStateLock, &s_AppCommInfo.US.RxWorkState, sizeof(US_SetWorkState_Send_t) },
+        { &s_AppCommInfo.US.RxConfigLock,    &s_AppCommInfo.US.RxConfig,    sizeof(US_SetConfig_Send_t) },
+    },
+    {
+        { &s_AppCommInfo.RF.RxWorkStateLock, &s_AppCommInfo.RF.RxWorkState, sizeof(RF_SetWorkState_Send_t) },
+        { &s_AppCommInfo.RF.RxConfigLock,    &s_AppCommInfo.RF.RxConfig,    sizeof(RF_SetConfig_Send_t) },
+    },
+    {
+        { &s_AppCommInfo.SW.RxWorkStateLock, &s_AppCommInfo.SW.RxWorkState, sizeof(SW_SetWorkState_Send_t) },
+        { NULL, NULL, 0 },
+    },
+    {
+        { &s_AppCommInfo.Heat.RxWorkStateLock, &s_AppCommInfo.Heat.RxWorkState, sizeof(Heat_SetWorkState_Send_t) },
+        { &s_AppCommInfo.Heat.RxPreheatLock,   &s_AppCommInfo.Heat.RxPreheat,   sizeof(Heat_SetPreheat_Send_t) },
+    },
+};
 
 /* =============================================================================
  * Private Functions
  * ============================================================================= */
 
+/* 黑匣子分块下载：block(1) total_len(2) crc(2) len(1) data(len) */
+static void App_Comm_ReplyBlackBox(uint8_t block)
+{
+    uint8_t reply[6 + PROTOCOL_BLACKBOX_BLOCK_LEN];
+    uint16_t total = 0;
+    uint16_t crc = 0;
+    uint16_t len;
+
+    len = App_Memory_ReadBlackBox((uint16_t)block * PROTOCOL_BLACKBOX_BLOCK_LEN, &reply[6],
+                                  PROTOCOL_BLACKBOX_BLOCK_LEN, &total, &crc);
+    reply[0] = block;
+    reply[1] = (uint8_t)total;
+    reply[2] = (uint8_t)(total >> 8);
+    reply[3] = (uint8_t)crc;
+    reply[4] = (uint8_t)(crc >> 8);
+    reply[5] = (uint8_t)len;
+    App_Comm_SendFrame(PROTOCOL_MODULE_SYSTEM, PROTOCOL_CMD_GET_BLACKBOX, reply, (uint8_t)(6 + len));
+}
+
+/**
+ * @brief GET_STATUS直接由共享状态区应答，不等治疗模式运行（上电即可应答，未识别探头时也应答）
+ * @param Data 请求帧：数据字节为应答格式，无数据或PROTOCOL_STATUS_BASE只回基础字段
+ */
+static void App_Comm_ReplyStatus(uint8_t module, const uint8_t *Data)
+{
+    const App_Comm_Slot_t *pSlot = &s_StatusSlot[module - PROTOCOL_MODULE_ULTRASOUND];
+    const App_Comm_Fields_t *pFields = &s_StatusFields[module - PROTOCOL_MODULE_ULTRASOUND];
+    Heat_GetStatus_Reply_t status;      // 最大的状态结构体
+    uint8_t reply[sizeof(Heat_GetStatus_Reply_t)];
+    uint32_t version = SeqLock_GetVersion(pSlot->pLock) + 1u;    // 与当前版本不同：总是取快照
+    const App_Comm_Field_t *pField;
+    uint8_t num = pFields->baseNum;
+    uint8_t out = 0;
+    uint8_t i;
+
+    if(Data[5] > 0 && Data[PROTOCOL_FRAME_HEAD_LEN] == PROTOCOL_STATUS_EXT){
+        num = pFields->num;
+    }
+    if(!SeqLock_Read(pSlot->pLock, &status, pSlot->pData, pSlot->size, &version)){
+        return;
+    }
+    for(i = 0; i < num; i++){
+        pField = &pFields->pFields[i];
+        memcpy(&reply[out], (const uint8_t *)&status + pField->offset, pField->size);
+        out += pField->size;
+    }
+    App_Comm_SendFrame(module, PROTOCOL_CMD_GET_STATUS, reply, out);
+}
 
 void App_Comm_RecvDataHandle(uint8_t *Data)
 {
     if(Data == NULL){
         return;
     }
+    // 记录接收帧，用于现场问题复现（升级数据帧不记录，回放时不可重放升级）
+    if(Data[3] != PROTOCOL_MODULE_SYSTEM){
+        Drv_Trace_RecordFrame(Data, PROTOCOL_FRAME_HEAD_LEN + Data[5]);
+    }
 
     switch(Data[3])
     {
@@ -29,20 +234,25 @@ void App_Comm_RecvDataHandle(uint8_t *Data)
             switch(Data[4]) 
             {
                 case PROTOCOL_CMD_GET_STATUS:
-                    s_AppCommInfo.US.flag.bits.Rely_Status = 1;
+                    App_Comm_ReplyStatus(PROTOCOL_MODULE_ULTRASOUND, Data);
                     break;
                 case PROTOCOL_CMD_SET_WORK_STATE:
+                    SeqLock_WriteBegin(&s_AppCommInfo.US.RxWorkStateLock);
                     s_AppCommInfo.US.RxWorkState.work_state = Data[6];
                     s_AppCommInfo.US.RxWorkState.work_time = Data[7]  | Data[8] << 8;
                     s_AppCommInfo.US.RxWorkState.work_level = Data[9];
-                    s_AppCommInfo.US.RxValidFlag[PROTOCOL_CMD_SET_WORK_STATE] = true;
+                    SeqLock_WriteEnd(&s_AppCommInfo.US.RxWorkStateLock);
                     break; 
                 case PROTOCOL_CMD_SET_CONFIG:
+                    SeqLock_WriteBegin(&s_AppCommInfo.US.RxConfigLock);
                     s_AppCommInfo.US.RxConfig.frequency = Data[6] | Data[7] << 8;
                     s_AppCommInfo.US.RxConfig.voltage = Data[8] | Data[9] << 8;
                     s_AppCommInfo.US.RxConfig.temp_limit = Data[10] | Data[11] << 8;
+                    SeqLock_WriteEnd(&s_AppCommInfo.US.RxConfigLock);
                     s_AppCommInfo.US.flag.bits.Rely_Config = 1;
-                    s_AppCommInfo.US.RxValidFlag[PROTOCOL_CMD_SET_CONFIG] = true;
+                    break;
+                case PROTOCOL_CMD_SET_PROGRAM:
+                    App_Program_Upload(PROTOCOL_MODULE_ULTRASOUND, &Data[PROTOCOL_FRAME_HEAD_LEN], Data[5]);
                     break;
             }
             break;
@@ -50,53 +260,95 @@ void App_Comm_RecvDataHandle(uint8_t *Data)
             switch(Data[4]) 
             {
                 case PROTOCOL_CMD_GET_STATUS:
-                    s_AppCommInfo.RF.flag.bits.Rely_Status = 1;
+                    App_Comm_ReplyStatus(PROTOCOL_MODULE_RADIO_FREQ, Data);
                     break;
                 case PROTOCOL_CMD_SET_WORK_STATE:
+                    SeqLock_WriteBegin(&s_AppCommInfo.RF.RxWorkStateLock);
                     s_AppCommInfo.RF.RxWorkState.work_state = Data[6];
                     s_AppCommInfo.RF.RxWorkState.work_time = Data[7] | Data[8] << 8;
                     s_AppCommInfo.RF.RxWorkState.work_level = Data[9];
+                    SeqLock_WriteEnd(&s_AppCommInfo.RF.RxWorkStateLock);
                     break; 
                 case PROTOCOL_CMD_SET_CONFIG:
+                    SeqLock_WriteBegin(&s_AppCommInfo.RF.RxConfigLock);
                     s_AppCommInfo.RF.RxConfig.temp_limit = Data[6] | Data[7] << 8;
+                    SeqLock_WriteEnd(&s_AppCommInfo.RF.RxConfigLock);
                     s_AppCommInfo.RF.flag.bits.Rely_Config = 1;
                     break;
+                case PROTOCOL_CMD_SET_PROGRAM:
+                    App_Program_Upload(PROTOCOL_MODULE_RADIO_FREQ, &Data[PROTOCOL_FRAME_HEAD_LEN], Data[5]);
+                    break;
             }
             break;
         case PROTOCOL_MODULE_SHOCKWAVE:
             switch(Data[4]) 
             {
                 case PROTOCOL_CMD_GET_STATUS:
-                    s_AppCommInfo.SW.flag.bits.Rely_Status = 1;
+                    App_Comm_ReplyStatus(PROTOCOL_MODULE_SHOCKWAVE, Data);
                     break;
                 case PROTOCOL_CMD_SET_WORK_STATE:
+                    SeqLock_WriteBegin(&s_AppCommInfo.SW.RxWorkStateLock);
                     s_AppCommInfo.SW.RxWorkState.work_state = Data[6];
                     s_AppCommInfo.SW.RxWorkState.work_time = Data[7] | Data[8] << 8;
                     s_AppCommInfo.SW.RxWorkState.work_level = Data[9];
                     s_AppCommInfo.SW.RxWorkState.frequency = Data[10];
+                    SeqLock_WriteEnd(&s_AppCommInfo.SW.RxWorkStateLock);
                     break; 
+                case PROTOCOL_CMD_SET_PROGRAM:
+                    App_Program_Upload(PROTOCOL_MODULE_SHOCKWAVE, &Data[PROTOCOL_FRAME_HEAD_LEN], Data[5]);
+                    break;
             }
             break;
         case PROTOCOL_MODULE_HEAT:
             switch(Data[4]) 
             {
                 case PROTOCOL_CMD_GET_STATUS:
-                    s_AppCommInfo.Heat.flag.bits.Rely_Status = 1;
+                    App_Comm_ReplyStatus(PROTOCOL_MODULE_HEAT, Data);
                     break;
                 case PROTOCOL_CMD_SET_WORK_STATE:
+                    SeqLock_WriteBegin(&s_AppCommInfo.Heat.RxWorkStateLock);
                     s_AppCommInfo.Heat.RxWorkState.work_state = Data[6];
                     s_AppCommInfo.Heat.RxWorkState.work_time = Data[7] | Data[8] << 8;
                     s_AppCommInfo.Heat.RxWorkState.pressure = Data[9];
                     s_AppCommInfo.Heat.RxWorkState.suck_time = Data[10] | Data[11] << 8;
                     s_AppCommInfo.Heat.RxWorkState.release_time = Data[12] | Data[13] << 8;
                     s_AppCommInfo.Heat.RxWorkState.temp_limit = Data[14] | Data[15] << 8;
+                    SeqLock_WriteEnd(&s_AppCommInfo.Heat.RxWorkStateLock);
                     break; 
                 case PROTOCOL_CMD_SET_CONFIG:
+                    SeqLock_WriteBegin(&s_AppCommInfo.Heat.RxPreheatLock);
                     s_AppCommInfo.Heat.RxPreheat.preheat_state = Data[6];
                     s_AppCommInfo.Heat.RxPreheat.work_time = Data[7] | Data[8] << 8;
                     s_AppCommInfo.Heat.RxPreheat.temp_limit = Data[9] | Data[10] << 8;
+                    SeqLock_WriteEnd(&s_AppCommInfo.Heat.RxPreheatLock);
                     s_AppCommInfo.Heat.flag.bits.Rely_Config = 1;
                     break;
+                case PROTOCOL_CMD_SET_PROGRAM:
+                    App_Program_Upload(PROTOCOL_MODULE_HEAT, &Data[PROTOCOL_FRAME_HEAD_LEN], Data[5]);
+                    break;
+            }
+            break;
+        case PROTOCOL_MODULE_SYSTEM:
+            switch(Data[4])
+            {
+                case PROTOCOL_CMD_GET_BLACKBOX:
+                    App_Comm_ReplyBlackBox(Data[6]);
+                    break;
+                case PROTOCOL_CMD_UPDATE_BEGIN:
+                    App_Update_Begin(&Data[PROTOCOL_FRAME_HEAD_LEN], Data[5]);
+                    break;
+                case PROTOCOL_CMD_UPDATE_DATA:
+                    App_Update_Data(&Data[PROTOCOL_FRAME_HEAD_LEN], Data[5]);
+                    break;
+                case PROTOCOL_CMD_UPDATE_END:
+                    App_Update_End();
+                    break;
+                case PROTOCOL_CMD_UPDATE_QUERY:
+                    App_Update_Query();
+                    break;
+                case PROTOCOL_CMD_UPDATE_ABORT:
+                    App_Update_Abort();
+                    break;
             }
             break;
         default:
@@ -126,20 +378,181 @@ Heat_TransData_t *App_Comm_GetHeatTransData(void)
 }
 
 
+static const App_Comm_Slot_t *App_Comm_GetStatusSlot(uint8_t module)
+{
+    if(module < PROTOCOL_MODULE_ULTRASOUND || module > PROTOCOL_MODULE_HEAT){
+        return NULL;
+    }
+    return &s_StatusSlot[module - PROTOCOL_MODULE_ULTRASOUND];
+}
+
+static const App_Comm_Slot_t *App_Comm_GetRxSlot(uint8_t module, uint8_t cmd)
+{
+    const App_Comm_Slot_t *pSlot;
+
+    if(module < PROTOCOL_MODULE_ULTRASOUND || module > PROTOCOL_MODULE_HEAT ||
+       cmd < PROTOCOL_CMD_SET_WORK_STATE || cmd > PROTOCOL_CMD_SET_CONFIG){
+        return NULL;
+    }
+    pSlot = &s_RxSlot[module - PROTOCOL_MODULE_ULTRASOUND][cmd - PROTOCOL_CMD_SET_WORK_STATE];
+    return (pSlot->pLock != NULL) ? pSlot : NULL;
+}
+
+static bool App_Comm_PublishStatus(uint8_t module, uint8_t offset, const void *pValue, uint8_t size)
+{
+    const App_Comm_Slot_t *pSlot = App_Comm_GetStatusSlot(module);
+
+    if(pSlot == NULL || offset + size > pSlot->size){
+        return false;
+    }
+    return SeqLock_Update(pSlot->pLock, (uint8_t *)pSlot->pData + offset, pValue, size);
+}
+
+
 /* =============================================================================
  * Public Functions
  * ============================================================================= */
 
+/**
+ * @brief 组帧并经USART1发送（DMA直接读TxData，发送期间不可复用）
+ */
+void App_Comm_SendFrame(uint8_t module, uint8_t cmd, const uint8_t *pData, uint8_t len)
+{
+    uint8_t *pTx = s_AppCommInfo.TxData;
+
+    if(len > sizeof(s_AppCommInfo.TxData) - PROTOCOL_FRAME_HEAD_LEN - 2){
+        return;
+    }
+    // 等待上一帧发送完成（最长一帧128字节，115200下约11ms）
+    while(Drv_GetUSART1_DMA_SendStatus()){
+    }
+    pTx[0] = PROTOCOL_HEADER_0;
+    pTx[1] = PROTOCOL_HEADER_1;
+    pTx[2] = PROTOCOL_DIR_DEV_TO_HOST;
+    pTx[3] = module;
+    pTx[4] = cmd;
+    pTx[5] = len;
+    memcpy(&pTx[PROTOCOL_FRAME_HEAD_LEN], pData, len);
+    pTx[PROTOCOL_FRAME_HEAD_LEN + len] = PROTOCOL_TAIL_0;
+    pTx[PROTOCOL_FRAME_HEAD_LEN + len + 1] = PROTOCOL_TAIL_1;
+    Drv_USART1_Send(pTx, PROTOCOL_FRAME_HEAD_LEN + len + 2);
+    Drv_BootTime_Mark(E_BOOT_PHASE_READY);
+}
+
+/**
+ * @brief 接收字节流组帧：帧头同步、按data_len收齐、校验帧尾后分发
+ * @retval 本次分发的帧数
+ */
+int8_t App_Comm_ParseReceive(const uint8_t *pRevData, uint8_t revLen)
+{
+    uint8_t *pRx = s_AppCommInfo.RxData;
+    int8_t frames = 0;
+    uint8_t i;
+
+    if(pRevData == NULL){
+        return -1;
+    }
+    for(i = 0; i < revLen; i++){
+        if(s_AppCommInfo.RxLen == 0 && pRevData[i] != PROTOCOL_HEADER_0){
+            continue;
+        }
+        if(s_AppCommInfo.RxLen == 1 && pRevData[i] != PROTOCOL_HEADER_1){
+            s_AppCommInfo.RxLen = (pRevData[i] == PROTOCOL_HEADER_0) ? 1 : 0;
+            continue;
+        }
+        pRx[s_AppCommInfo.RxLen++] = pRevData[i];
+        if(s_AppCommInfo.RxLen < PROTOCOL_FRAME_HEAD_LEN ||
+           s_AppCommInfo.RxLen < PROTOCOL_FRAME_HEAD_LEN + pRx[5] + 2){
+            continue;
+        }
+        if(pRx[s_AppCommInfo.RxLen - 2] == PROTOCOL_TAIL_0 && pRx[s_AppCommInfo.RxLen - 1] == PROTOCOL_TAIL_1 &&
+           pRx[2] == PROTOCOL_DIR_HOST_TO_DEV){
+            App_Comm_RecvDataHandle(pRx);
+            frames++;
+        }
+        s_AppCommInfo.RxLen = 0;
+    }
+    return frames;
+}
+
+/**
+ * @brief Publish one status byte; the version only moves when the value changes
+ * @param module PROTOCOL_MODULE_*
+ * @param offset Field offset in the reply struct (APP_COMM_STATUS_OFFSET)
+ * @retval true if the field changed
+ */
+bool App_Comm_PublishStatusU8(uint8_t module, uint8_t offset, uint8_t value)
+{
+    return App_Comm_PublishStatus(module, offset, &value, sizeof(value));
+}
+
+bool App_Comm_PublishStatusU16(uint8_t module, uint8_t offset, uint16_t value)
+{
+    return App_Comm_PublishStatus(module, offset, &value, sizeof(value));
+}
+
+bool App_Comm_PublishStatusU32(uint8_t module, uint8_t offset, uint32_t value)
+{
+    return App_Comm_PublishStatus(module, offset, &value, sizeof(value));
+}
+
+/**
+ * @brief Snapshot a module status reply if it changed since *pVersion (ISR safe)
+ * @retval true if pOut holds a newer consistent snapshot
+ */
+bool App_Comm_ReadStatus(uint8_t module, void *pOut, uint16_t size, uint32_t *pVersion)
+{
+    const App_Comm_Slot_t *pSlot = App_Comm_GetStatusSlot(module);
+
+    if(pSlot == NULL || pOut == NULL || pVersion == NULL || size != pSlot->size){
+        return false;
+    }
+    return SeqLock_Read(pSlot->pLock, pOut, pSlot->pData, size, pVersion);
+}
+
+/**
+ * @brief Snapshot a received command if a new one arrived since *pVersion
+ * @param module PROTOCOL_MODULE_*
+ * @param cmd PROTOCOL_CMD_SET_WORK_STATE / PROTOCOL_CMD_SET_CONFIG
+ * @retval true if pOut holds a newer consistent snapshot
+ */
+bool App_Comm_FetchRx(uint8_t module, uint8_t cmd, void *pOut, uint16_t size, uint32_t *pVersion)
+{
+    const App_Comm_Slot_t *pSlot = App_Comm_GetRxSlot(module, cmd);
+
+    if(pSlot == NULL || pOut == NULL || pVersion == NULL || size != pSlot->size){
+        return false;
+    }
+    return SeqLock_Read(pSlot->pLock, pOut, pSlot->pData, size, pVersion);
+}
+
 void App_Comm_Init(void)
 {
     memset(&s_AppCommInfo, 0, sizeof(App_Comm_Info_t));
 }
 
+uint32_t App_Comm_GetLastRxMs(void)
+{
+    return s_lastRxMs;
+}
+
 void App_Comm_Process(void)
 {
     // Process the communication module
     // This function can be called periodically to process received data
+    uint8_t frame[TRACE_FRAME_MAX];
+    uint8_t rx[APP_COMM_RX_CHUNK];
+    uint16_t len;
 
+    while((len = Drv_USART1_Read(rx, sizeof(rx))) > 0){
+        s_lastRxMs = Drv_Delay_GetTickMs();
+        Drv_BootTime_Mark(E_BOOT_PHASE_FIRST_RX);
+        App_Comm_ParseReceive(rx, (uint8_t)len);
+    }
+    // 轨迹回放：按记录时刻注入接收帧，同一轮到期的帧依次处理
+    while(Drv_Trace_PopFrame(frame, sizeof(frame)) > 0){
+        App_Comm_RecvDataHandle(frame);
+    }
 }
 
 /**************************End of file********************************/
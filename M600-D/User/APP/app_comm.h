@@ -20,6 +20,8 @@
 extern "C" {
 #endif
 
+#include "lib_seqlock.h"
+
 /* =============================================================================
  * Protocol Constants
  * ============================================================================= */
@@ -37,11 +39,23 @@ extern "C" {
 #define PROTOCOL_MODULE_RADIO_FREQ     0x02    ///< Radio Frequency Module
 #define PROTOCOL_MODULE_SHOCKWAVE      0x03    ///< Shockwave Module
 #define PROTOCOL_MODULE_HEAT           0x04    ///< Heat Therapy Module
+#define PROTOCOL_MODULE_SYSTEM         0x05    ///< System (diagnostics)
 
 /* Command Code */
 #define PROTOCOL_CMD_GET_STATUS        0x00    ///< Get Device Status
 #define PROTOCOL_CMD_SET_WORK_STATE    0x01    ///< Set Working State
 #define PROTOCOL_CMD_SET_CONFIG       0x02    ///< Set Internal Configuration
+#define PROTOCOL_CMD_SET_PROGRAM      0x03    ///< Upload a treatment program (app_program.h)
+#define PROTOCOL_CMD_GET_BLACKBOX     0x10    ///< System: read one block of the stored black-box image
+#define PROTOCOL_CMD_UPDATE_BEGIN     0x20    ///< System: start or resume a firmware update
+#define PROTOCOL_CMD_UPDATE_DATA      0x21    ///< System: one image chunk
+#define PROTOCOL_CMD_UPDATE_END       0x22    ///< System: verify and stage the image, then reset
+#define PROTOCOL_CMD_UPDATE_QUERY     0x23    ///< System: update/boot state
+#define PROTOCOL_CMD_UPDATE_ABORT     0x24    ///< System: end the update session, back to normal mode
+
+/* Get Status request byte: reply layout */
+#define PROTOCOL_STATUS_BASE          0x00    ///< Fields up to error_code, as in protocol V1.0
+#define PROTOCOL_STATUS_EXT           0x01    ///< Base fields followed by the appended ones (marked "EXT")
 
 /* Work State */
 #define WORK_STATE_STOP               0x00    ///< Stop
@@ -67,6 +81,9 @@ extern "C" {
 /* =============================================================================
  * Protocol Frame Structure
  * ============================================================================= */
+#define PROTOCOL_FRAME_HEAD_LEN       6       ///< header[2] + direction + module + cmd + data_len
+#define PROTOCOL_FRAME_MAX            (PROTOCOL_FRAME_HEAD_LEN + 255 + 2)
+
 typedef struct
 {
     uint8_t header[2];           ///< Fixed header: 0x5A 0xA5
@@ -85,7 +102,7 @@ typedef struct
 /* Ultrasound - Get Status (0x00) - Send */
 typedef struct
 {
-    uint8_t dummy;               ///< Always 0x00
+    uint8_t reply_layout;        ///< PROTOCOL_STATUS_BASE (0x00, or no data) / PROTOCOL_STATUS_EXT
 } US_GetStatus_Send_t;
 
 /* Ultrasound - Get Status (0x00) - Reply */
@@ -99,6 +116,9 @@ typedef struct
     uint16_t head_temp;          ///< Head temperature = value/10, 0xFFFF: NTC open, 0xEEFF: NTC short
     uint8_t conn_state;          ///< Connection status
     uint8_t error_code;          ///< Reserved error code
+    uint16_t deliver_time;       ///< EXT: Delivered (energised) time (seconds)
+    uint8_t program_step;        ///< EXT: Program step being executed, 1-based, 0: no program running
+    uint16_t step_remain;        ///< EXT: Remaining time of the program step (seconds)
 } US_GetStatus_Reply_t;
 
 /* Ultrasound - Set Work State (0x01) - Send */
@@ -142,8 +162,10 @@ typedef struct
 
     US_SetWorkState_Send_t RxWorkState;
     US_SetConfig_Send_t RxConfig; 
-    bool RxValidFlag[3];
 
+    SeqLock_t TxStatusLock;
+    SeqLock_t RxWorkStateLock;
+    SeqLock_t RxConfigLock;
 } UltraSound_TransData_t;
 
 UltraSound_TransData_t *App_Comm_GetUSTransData(void);
@@ -155,7 +177,7 @@ UltraSound_TransData_t *App_Comm_GetUSTransData(void);
 /* RF - Get Status (0x00) - Send */
 typedef struct
 {
-    uint8_t dummy;               ///< Always 0x00
+    uint8_t reply_layout;        ///< PROTOCOL_STATUS_BASE (0x00, or no data) / PROTOCOL_STATUS_EXT
 } RF_GetStatus_Send_t;
 
 /* RF - Get Status (0x00) - Reply */
@@ -168,6 +190,11 @@ typedef struct
     uint16_t head_temp;          ///< Head temperature = value/10, 0xFFFF: NTC open, 0xEEFF: NTC short
     uint8_t conn_state;          ///< Connection status
     uint8_t error_code;          ///< Reserved error code
+    uint16_t deliver_time;       ///< EXT: Delivered (energised) time (seconds)
+    uint16_t power;              ///< EXT: Delivered power (0.1 W), 100 ms mean
+    uint32_t energy;             ///< EXT: Delivered energy this session (mJ)
+    uint8_t program_step;        ///< EXT: Program step being executed, 1-based, 0: no program running
+    uint16_t step_remain;        ///< EXT: Remaining time of the program step (seconds)
 } RF_GetStatus_Reply_t;
 
 /* RF - Set Work State (0x01) - Send */
@@ -206,6 +233,10 @@ typedef struct
     RF_SetWorkState_Send_t RxWorkState;
     RF_SetConfig_Send_t RxConfig;
     RF_SetConfig_Reply_t TxConfig;
+
+    SeqLock_t TxStatusLock;
+    SeqLock_t RxWorkStateLock;
+    SeqLock_t RxConfigLock;
 } RF_TransData_t;
 
 RF_TransData_t *App_Comm_GetRFTransData(void);
@@ -216,7 +247,7 @@ RF_TransData_t *App_Comm_GetRFTransData(void);
 /* Shockwave - Get Status (0x00) - Send */
 typedef struct
 {
-    uint8_t dummy;               ///< Always 0x00
+    uint8_t reply_layout;        ///< PROTOCOL_STATUS_BASE (0x00, or no data) / PROTOCOL_STATUS_EXT
 } SW_GetStatus_Send_t;
 
 /* Shockwave - Get Status (0x00) - Reply */
@@ -229,6 +260,11 @@ typedef struct
     uint16_t head_temp;          ///< Head temperature = value/10, 0xFFFF: NTC open, 0xEEFF: NTC short
     uint8_t conn_state;          ///< Connection status
     uint8_t error_code;          ///< Reserved error code
+    uint16_t shot_energy;        ///< EXT: Delivered energy of the last shot (mJ)
+    uint32_t energy;             ///< EXT: Delivered energy this session (mJ)
+    uint8_t program_step;        ///< EXT: Program step being executed, 1-based, 0: no program running
+    uint16_t step_remain;        ///< EXT: Remaining time of the program step (seconds)
+    uint8_t max_rate;            ///< EXT: Highest shot rate the charger sustains at this level (0.1 Hz)
 } SW_GetStatus_Reply_t;
 
 /* Shockwave - Set Work State (0x01) - Send */
@@ -253,6 +289,9 @@ typedef struct
     SW_ByteUnion flag;
     SW_GetStatus_Reply_t TxStatus;
     SW_SetWorkState_Send_t RxWorkState;
+
+    SeqLock_t TxStatusLock;
+    SeqLock_t RxWorkStateLock;
 } SW_TransData_t;
 
 SW_TransData_t *App_Comm_GetSWTransData(void);
@@ -263,7 +302,7 @@ SW_TransData_t *App_Comm_GetSWTransData(void);
 /* Heat - Get Status (0x00) - Send */
 typedef struct
 {
-    uint8_t dummy;               ///< Always 0x00
+    uint8_t reply_layout;        ///< PROTOCOL_STATUS_BASE (0x00, or no data) / PROTOCOL_STATUS_EXT
 } Heat_GetStatus_Send_t;
 
 /* Heat - Get Status (0x00) - Reply */
@@ -281,6 +320,9 @@ typedef struct
     uint16_t remain_preheat_time; ///< Remaining preheat time (seconds), max 3600
     uint8_t conn_state;          ///< Connection status
     uint8_t error_code;          ///< Reserved error code
+    uint16_t deliver_heat_time;  ///< EXT: Delivered heat time (seconds), preheat excluded
+    uint8_t program_step;        ///< EXT: Program step being executed, 1-based, 0: no program running
+    uint16_t step_remain;        ///< EXT: Remaining time of the program step (seconds)
 } Heat_GetStatus_Reply_t;
 
 /* Heat - Set Work State (0x01) - Send */
@@ -318,13 +360,86 @@ typedef struct
     Heat_GetStatus_Reply_t TxStatus;
     Heat_SetWorkState_Send_t RxWorkState;
     Heat_SetPreheat_Send_t RxPreheat;
+
+    SeqLock_t TxStatusLock;
+    SeqLock_t RxWorkStateLock;
+    SeqLock_t RxPreheatLock;
 } Heat_TransData_t;
 
 Heat_TransData_t *App_Comm_GetHeatTransData(void);
 
+/* =============================================================================
+ * System Module Structures
+ * ============================================================================= */
+#define PROTOCOL_BLACKBOX_BLOCK_LEN   32      ///< Image bytes per reply
+
+/* System - Get Black Box (0x10) - Send */
+typedef struct
+{
+    uint8_t block;               ///< Block index, offset = block * PROTOCOL_BLACKBOX_BLOCK_LEN
+} Sys_GetBlackBox_Send_t;
+
+/* System - Get Black Box (0x10) - Reply */
+typedef struct
+{
+    uint8_t block;               ///< Block index
+    uint16_t total_len;          ///< Stored image length, 0: nothing stored
+    uint16_t crc;                ///< CRC16 of the whole image
+    uint8_t len;                 ///< Valid bytes in data
+    uint8_t data[PROTOCOL_BLACKBOX_BLOCK_LEN];
+} Sys_GetBlackBox_Reply_t;
+
+/* Firmware update: chunks must arrive in order and not cross a 2 KB page; the host keeps
+ * at most PROTOCOL_UPDATE_WINDOW chunks unacknowledged and resends from next_offset on
+ * any reply other than UPDATE_RESULT_OK */
+#define PROTOCOL_UPDATE_CHUNK_MAX     128     ///< Image bytes per data frame
+#define PROTOCOL_UPDATE_WINDOW        2       ///< Chunks in flight
+
+#define UPDATE_RESULT_OK              0x00    ///< Accepted
+#define UPDATE_RESULT_BUSY            0x01    ///< Flash pipeline full, resend from next_offset
+#define UPDATE_RESULT_SEQ             0x02    ///< Unexpected offset, resend from next_offset
+#define UPDATE_RESULT_CRC             0x03    ///< Chunk CRC mismatch
+#define UPDATE_RESULT_SIZE            0x04    ///< Bad size or chunk crosses a page
+#define UPDATE_RESULT_STATE           0x05    ///< Refused in the current state
+#define UPDATE_RESULT_FLASH           0x06    ///< Erase/program/verify failed
+#define UPDATE_RESULT_IMAGE           0x07    ///< Image CRC or vector table invalid
+
+/* System - Update Begin (0x20) - Send */
+typedef struct
+{
+    uint32_t size;               ///< Image bytes
+    uint32_t crc32;              ///< CRC-32 (IEEE 802.3) of the image
+    uint32_t version;            ///< Opaque image version
+} Sys_UpdateBegin_Send_t;
+
+/* System - Update Data (0x21) - Send: offset(4) data(n) crc32(4), n = data_len - 8 */
+typedef struct
+{
+    uint32_t offset;             ///< Image offset of data[0]
+    uint8_t data[PROTOCOL_UPDATE_CHUNK_MAX];
+    uint32_t crc32;              ///< CRC-32 of data[0..n-1]
+} Sys_UpdateData_Send_t;
+
+/* System - Update Begin/Data/End - Reply */
+typedef struct
+{
+    uint8_t result;              ///< UPDATE_RESULT_*
+    uint32_t next_offset;        ///< Next image offset the device expects
+} Sys_Update_Reply_t;
+
+/* System - Update Query (0x23) - Reply */
+typedef struct
+{
+    uint8_t state;               ///< FwSwap_State_EnumDef
+    uint32_t next_offset;        ///< Next image offset the device expects
+    uint32_t version;            ///< Version of the recorded update
+    uint8_t trial_boots;         ///< Unconfirmed boots of the new image
+} Sys_UpdateQuery_Reply_t;
+
 typedef struct
 {
-    uint8_t RxData[128];
+    uint8_t RxData[PROTOCOL_FRAME_MAX];
+    uint16_t RxLen;
     uint8_t TxData[128];
     UltraSound_TransData_t US;
     RF_TransData_t RF;
@@ -342,6 +457,20 @@ typedef struct
 /* Initialization and Process */
 void App_Comm_Init(void);
 void App_Comm_Process(void);
+/* 最后一次收到主机数据的时刻，空闲待机判断用。
+ * 待机(STOP)时USART1_RX只作唤醒源：唤醒帧在时钟恢复前到达，会丢失，主机收不到应答时须重发；
+ * 唤醒后s_stopIdleMs内保持运行，后续帧正常接收 */
+uint32_t App_Comm_GetLastRxMs(void);
+
+/* State store: status fields are published on change, readers take versioned snapshots */
+#define APP_COMM_STATUS_OFFSET(type, field)   ((uint8_t)offsetof(type, field))
+
+bool App_Comm_PublishStatusU8(uint8_t module, uint8_t offset, uint8_t value);
+bool App_Comm_PublishStatusU16(uint8_t module, uint8_t offset, uint16_t value);
+bool App_Comm_PublishStatusU32(uint8_t module, uint8_t offset, uint32_t value);
+bool App_Comm_ReadStatus(uint8_t module, void *pOut, uint16_t size, uint32_t *pVersion);
+bool App_Comm_FetchRx(uint8_t module, uint8_t cmd, void *pOut, uint16_t size, uint32_t *pVersion);
+void App_Comm_SendFrame(uint8_t module, uint8_t cmd, const uint8_t *pData, uint8_t len);
 
 /* Send Packet Build Functions */
 int8_t App_Comm_BuildUS_GetStatus_Send(const US_GetStatus_Send_t *pData, uint8_t *pTxData, uint8_t *pLen);
@@ -0,0 +1,282 @@
+/***********************************************************************************
+* @file     : app_fan.c
+* @brief    : Board fan speed control implementation
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#include "app_fan.h"
+#include "drv_adc.h"
+#include "drv_tim.h"
+#include "drv_delay.h"
+#include "drv_blackbox.h"
+#include "log.h"
+
+#define FAN_SENSOR_NUM              2
+#define FAN_SENSOR_MIN_MV           30      ///< 低于此电压视为短路
+#define FAN_SENSOR_MAX_MV           3270    ///< 高于此电压视为开路
+#define FAN_SENSOR_DEBOUNCE         5       ///< 连续几次越界/恢复才切换，避免边界抖动
+#define FAN_FILTER_SHIFT            3       ///< 一阶滤波 1/8，时间常数约0.8s
+#define FAN_MISMATCH_TEMP           150     ///< 两路相差超过15℃视为不一致 (0.1℃)
+#define FAN_MISMATCH_SAMPLES        50      ///< 持续5s才判定
+#define FAN_STALL_WINDOW_MS         60000   ///< 堵转判定窗口 (ms)
+#define FAN_STALL_RISE              20      ///< 全速下每个窗口温升超过2℃ (0.1℃)
+#define FAN_STALL_WINDOWS           2       ///< 连续几个窗口温升才判定堵转
+
+/* 板温曲线：45℃起转，85℃全速（原开关控制的启动点） */
+static const Fan_CurvePoint_t s_FanCurve[] =
+{
+    { 450, FAN_DUTY_MIN },
+    { 600, 500 },
+    { 750, 800 },
+    { 850, FAN_DUTY_FULL },
+};
+
+#define FAN_CURVE_NUM   (sizeof(s_FanCurve) / sizeof(s_FanCurve[0]))
+
+static const ADC_Channel_EnumDef s_FanSensor[FAN_SENSOR_NUM] =
+{
+    E_ADC_CHANNEL_Heat_REF01,
+    E_ADC_CHANNEL_Heat_REF02,
+};
+
+typedef struct
+{
+    uint32_t filt[FAN_SENSOR_NUM];   ///< 滤波累加值 (0.1℃ << FAN_FILTER_SHIFT)
+    bool valid[FAN_SENSOR_NUM];
+    bool primed[FAN_SENSOR_NUM];
+    uint8_t flipCnt[FAN_SENSOR_NUM];  ///< 与当前判定相反的连续次数
+    bool started;                    ///< 已完成首次采样
+    bool mismatch;
+    uint8_t mismatchCnt;
+    uint16_t boardTemp;              ///< 参与调速的板温 (0.1℃)
+    uint16_t duty;                   ///< 目标占空比
+    uint16_t request;                ///< 最近交给驱动的占空比
+    uint16_t applied;                ///< 驱动按PWM步长实际输出的占空比
+    uint32_t kickUntil;              ///< 启动全速截止时间
+    uint32_t windowStart;            ///< 全速窗口起点，0为未开始
+    uint16_t windowTemp;
+    uint16_t windowPower;
+    uint8_t risingWindows;
+    bool stalled;
+} Fan_Ctx_t;
+
+static Fan_Ctx_t s_Fan;
+
+/**
+ * @brief 电压转板温 (0.1℃)
+ * @note 占位线性转换：0V = 0℃，3.3V = 100℃，需按传感器规格书校准
+ */
+static uint16_t App_Fan_VoltageToTemp(uint32_t mv)
+{
+    return (uint16_t)((mv * 1000u) / 3300u);
+}
+
+/**
+ * @brief 逐路量程检查并滤波，超量程的一路保持原滤波值不参与
+ */
+static void App_Fan_SampleSensors(void)
+{
+    uint32_t mv;
+    uint16_t temp;
+    bool inRange;
+    bool change;
+    uint8_t i;
+
+    for(i = 0; i < FAN_SENSOR_NUM; i++){
+        mv = Drv_ADC_ReadVoltage(s_FanSensor[i]);
+        inRange = (mv >= FAN_SENSOR_MIN_MV && mv <= FAN_SENSOR_MAX_MV);
+        change = !s_Fan.started;
+        if(s_Fan.started && inRange != s_Fan.valid[i]){
+            change = (++s_Fan.flipCnt[i] >= FAN_SENSOR_DEBOUNCE);
+        }else{
+            s_Fan.flipCnt[i] = 0;
+        }
+        if(change){
+            s_Fan.flipCnt[i] = 0;
+            s_Fan.valid[i] = inRange;
+            if(!inRange){
+                LOG_W("Fan: board sensor %d out of range (%d mV)", i + 1, mv);
+                Drv_BlackBox_Record(E_BB_EVT_FAN, E_FAN_FAULT_SENSOR1 + i, (uint16_t)mv);
+            }else if(s_Fan.started){
+                LOG_I("Fan: board sensor %d back (%d mV)", i + 1, mv);
+                // 恢复后从新读数重新滤波
+                s_Fan.primed[i] = false;
+            }
+        }
+        if(!inRange || !s_Fan.valid[i]){
+            continue;
+        }
+        temp = App_Fan_VoltageToTemp(mv);
+        if(!s_Fan.primed[i]){
+            s_Fan.filt[i] = (uint32_t)temp << FAN_FILTER_SHIFT;
+            s_Fan.primed[i] = true;
+        }else{
+            s_Fan.filt[i] = s_Fan.filt[i] - (s_Fan.filt[i] >> FAN_FILTER_SHIFT) + temp;
+        }
+    }
+    s_Fan.started = true;
+}
+
+/**
+ * @brief 两路互校得出板温：一致取平均，不一致取高者
+ * @retval false 两路都失效
+ */
+static bool App_Fan_FuseSensors(uint16_t *pTemp)
+{
+    uint16_t t1 = (uint16_t)(s_Fan.filt[0] >> FAN_FILTER_SHIFT);
+    uint16_t t2 = (uint16_t)(s_Fan.filt[1] >> FAN_FILTER_SHIFT);
+    uint16_t diff = (t1 > t2) ? (t1 - t2) : (t2 - t1);
+
+    if(!s_Fan.valid[0] && !s_Fan.valid[1]){
+        return false;
+    }
+    if(!s_Fan.valid[0] || !s_Fan.valid[1]){
+        *pTemp = s_Fan.valid[0] ? t1 : t2;
+        return true;
+    }
+    if(diff > FAN_MISMATCH_TEMP){
+        if(s_Fan.mismatchCnt < FAN_MISMATCH_SAMPLES){
+            s_Fan.mismatchCnt++;
+        }else if(!s_Fan.mismatch){
+            s_Fan.mismatch = true;
+            LOG_W("Fan: board sensors disagree (%d / %d), using the higher", t1, t2);
+            Drv_BlackBox_Record(E_BB_EVT_FAN, E_FAN_FAULT_MISMATCH, diff);
+        }
+    }else{
+        if(s_Fan.mismatch){
+            LOG_I("Fan: board sensors agree again (%d / %d)", t1, t2);
+        }
+        s_Fan.mismatch = false;
+        s_Fan.mismatchCnt = 0;
+    }
+    *pTemp = s_Fan.mismatch ? ((t1 > t2) ? t1 : t2) : (uint16_t)((t1 + t2) / 2u);
+    return true;
+}
+
+/**
+ * @brief 温度曲线插值；运转中在起点以下留回差
+ */
+static uint16_t App_Fan_CurveDuty(uint16_t temp)
+{
+    const Fan_CurvePoint_t *p0;
+    const Fan_CurvePoint_t *p1;
+    uint8_t i;
+
+    if(temp < s_FanCurve[0].temp){
+        if(s_Fan.duty != 0 && temp + FAN_OFF_HYST >= s_FanCurve[0].temp){
+            return s_FanCurve[0].duty;
+        }
+        return 0;
+    }
+    for(i = 1; i < FAN_CURVE_NUM; i++){
+        if(temp < s_FanCurve[i].temp){
+            p0 = &s_FanCurve[i - 1];
+            p1 = &s_FanCurve[i];
+            return (uint16_t)(p0->duty + (uint32_t)(p1->duty - p0->duty) * (temp - p0->temp) /
+                              (p1->temp - p0->temp));
+        }
+    }
+    return s_FanCurve[FAN_CURVE_NUM - 1].duty;
+}
+
+/**
+ * @brief 无测速推断堵转：全速期间输出功率不增加而板温仍逐窗口上升
+ */
+static void App_Fan_CheckStall(uint32_t now, uint16_t outputPermille)
+{
+    if(s_Fan.applied < FAN_DUTY_FULL || (int32_t)(now - s_Fan.kickUntil) < 0){
+        if(s_Fan.stalled){
+            LOG_I("Fan: stall cleared at %d", s_Fan.boardTemp);
+        }
+        s_Fan.windowStart = 0;
+        s_Fan.risingWindows = 0;
+        s_Fan.stalled = false;
+        return;
+    }
+    if(s_Fan.windowStart == 0){
+        s_Fan.windowStart = now;
+        s_Fan.windowTemp = s_Fan.boardTemp;
+        s_Fan.windowPower = outputPermille;
+        return;
+    }
+    if(now - s_Fan.windowStart < FAN_STALL_WINDOW_MS){
+        return;
+    }
+    if(s_Fan.boardTemp > s_Fan.windowTemp + FAN_STALL_RISE && outputPermille <= s_Fan.windowPower){
+        s_Fan.risingWindows++;
+    }else{
+        s_Fan.risingWindows = 0;
+    }
+    if(s_Fan.risingWindows >= FAN_STALL_WINDOWS && !s_Fan.stalled){
+        s_Fan.stalled = true;
+        LOG_E("Fan: stall suspected, board %d still rising at full duty", s_Fan.boardTemp);
+        Drv_BlackBox_Record(E_BB_EVT_FAN, E_FAN_FAULT_STALL, s_Fan.boardTemp);
+    }
+    s_Fan.windowStart = now;
+    s_Fan.windowTemp = s_Fan.boardTemp;
+    s_Fan.windowPower = outputPermille;
+}
+
+void App_Fan_Process(uint16_t outputPermille)
+{
+    static Drv_Timer_t FanTimer;
+    uint32_t now;
+    uint32_t duty;
+
+    if(Drv_Timer_Tick(&FanTimer, FAN_SAMPLE_PERIOD_MS) == false){
+        return;
+    }
+    now = Drv_Delay_GetTickMs();
+    App_Fan_SampleSensors();
+    if(!App_Fan_FuseSensors(&s_Fan.boardTemp)){
+        // 两路都失效，无法判断板温，全速
+        duty = FAN_DUTY_FULL;
+    }else{
+        duty = App_Fan_CurveDuty(s_Fan.boardTemp);
+        if(outputPermille != 0){
+            duty += (uint32_t)outputPermille * FAN_FF_GAIN / FAN_DUTY_FULL;
+            if(duty < FAN_DUTY_MIN){
+                duty = FAN_DUTY_MIN;
+            }
+        }
+        if(duty > FAN_DUTY_FULL){
+            duty = FAN_DUTY_FULL;
+        }
+    }
+
+    if(s_Fan.duty == 0 && duty != 0){
+        s_Fan.kickUntil = now + FAN_KICK_MS;
+        LOG_I("Fan: start at %d, duty %d, output %d", s_Fan.boardTemp, duty, outputPermille);
+    }else if(s_Fan.duty != 0 && duty == 0){
+        LOG_I("Fan: stop at %d", s_Fan.boardTemp);
+    }
+    s_Fan.duty = (uint16_t)duty;
+    if(duty != 0 && (int32_t)(now - s_Fan.kickUntil) < 0){
+        duty = FAN_DUTY_FULL;
+    }
+    if(duty != s_Fan.request){
+        s_Fan.request = (uint16_t)duty;
+        s_Fan.applied = Drv_TIM7_SetFanDuty((uint16_t)duty);
+    }
+    App_Fan_CheckStall(now, outputPermille);
+}
+
+uint16_t App_Fan_GetDuty(void)
+{
+    return s_Fan.applied;
+}
+
+uint16_t App_Fan_GetBoardTemp(void)
+{
+    return s_Fan.boardTemp;
+}
+
+bool App_Fan_IsStalled(void)
+{
+    return s_Fan.stalled;
+}
+
+/**************************End of file********************************/
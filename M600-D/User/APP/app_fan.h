@@ -0,0 +1,64 @@
+/************************************************************************************
+* @file     : app_fan.h
+* @brief    : Board fan speed control
+* @details  : Heat_REF01/Heat_REF02 每FAN_SAMPLE_PERIOD_MS采样、各自滤波并互校：
+*             超量程的传感器不用，两路相差过大时取高者，两路都失效时风扇全速。
+*             占空比 = 温度曲线(s_FanCurve) + 当前模式输出功率前馈，输出一上来就先转，
+*             不等板子热起来。风扇无测速线：全速下输出功率未增加而温度持续上升，
+*             判定为堵转并记入黑匣子。
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_FAN_H
+#define APP_FAN_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#define FAN_SAMPLE_PERIOD_MS        100     ///< 板温采样与调速周期 (ms)
+#define FAN_DUTY_FULL               1000    ///< 占空比满值（千分比）
+#define FAN_DUTY_MIN                300     ///< 最低可靠转动占空比
+#define FAN_KICK_MS                 500     ///< 停转后启动先全速的时间 (ms)
+#define FAN_OFF_HYST                30      ///< 低于曲线起点多少才停转 (0.1℃)
+#define FAN_FF_GAIN                 500     ///< 模式满输出时的前馈占空比（千分比）
+
+typedef enum
+{
+    E_FAN_FAULT_NONE = 0,
+    E_FAN_FAULT_SENSOR1,           ///< Heat_REF01 超量程
+    E_FAN_FAULT_SENSOR2,           ///< Heat_REF02 超量程
+    E_FAN_FAULT_MISMATCH,          ///< 两路读数不一致
+    E_FAN_FAULT_STALL,             ///< 推断堵转
+    E_FAN_FAULT_MAX,
+} Fan_Fault_EnumDef;
+
+/* 温度曲线点，温度升序，点间线性插值 */
+typedef struct
+{
+    uint16_t temp;                 ///< 板温 (0.1℃)
+    uint16_t duty;                 ///< 占空比（千分比）
+} Fan_CurvePoint_t;
+
+/**
+ * 调速，每次主循环调用，内部按FAN_SAMPLE_PERIOD_MS执行
+ * @param outputPermille 当前模式输出功率（千分比，相对该模式满输出），空闲为0
+ */
+void App_Fan_Process(uint16_t outputPermille);
+/** 当前占空比（千分比），0为停转 */
+uint16_t App_Fan_GetDuty(void);
+/** 滤波后的板温 (0.1℃) */
+uint16_t App_Fan_GetBoardTemp(void);
+bool App_Fan_IsStalled(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_FAN_H
+/**************************End of file********************************/
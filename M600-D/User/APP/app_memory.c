@@ -10,6 +10,7 @@
 #include "app_memory.h"
 #include "drv_memory.h"
 #include <stddef.h>
+#include <string.h>
 
 /* CRC16 polynomial: CRC-16-IBM (0x8005) */
 #define CRC16_POLYNOMIAL 0x8005
@@ -20,6 +21,22 @@
 #define MEM_ADDR_SW_PARAMS      0x0010      ///< Shock Wave parameters address
 #define MEM_ADDR_NPH_PARAMS     0x0020      ///< Negative Pressure Heat parameters address
 #define MEM_ADDR_US_PARAMS      0x0030      ///< Ultrasound parameters address
+#define MEM_ADDR_BLACKBOX       0x0100      ///< Black-box image: length u16, CRC16 u16, image
+#define MEM_BLACKBOX_HEAD_LEN   4
+
+/* Parameter blocks, cached in RAM once read or written */
+typedef enum
+{
+    E_MEM_BLOCK_RF = 0,
+    E_MEM_BLOCK_SW,
+    E_MEM_BLOCK_NPH,
+    E_MEM_BLOCK_US,
+    E_MEM_BLOCK_MAX,
+} Mem_Block_EnumDef;
+
+static TreatParams_Union_t s_ParamCache[E_MEM_BLOCK_MAX];
+static uint8_t s_CacheValid = 0;        ///< bit per Mem_Block_EnumDef
+static uint8_t s_PreloadNext = 0;       ///< next block for App_Memory_Preload
 
 /**
  * @brief Calculate CRC16 checksum
@@ -51,6 +68,26 @@ static uint16_t Calculate_CRC16(const uint8_t *data, size_t length)
     return crc;
 }
 
+/**
+ * @brief Copy a cached parameter block
+ * @retval true if the block was cached
+ */
+static bool App_Memory_CacheGet(Mem_Block_EnumDef block, void *params, size_t size)
+{
+    if (!(s_CacheValid & (1u << block)))
+    {
+        return false;
+    }
+    memcpy(params, &s_ParamCache[block], size);
+    return true;
+}
+
+static void App_Memory_CachePut(Mem_Block_EnumDef block, const void *params, size_t size)
+{
+    memcpy(&s_ParamCache[block], params, size);
+    s_CacheValid |= (uint8_t)(1u << block);
+}
+
 /**
  * @brief Initialize memory module
  */
@@ -83,7 +120,14 @@ bool App_Memory_SaveRFParams(const RF_TreatParams_t *params)
     crc = Calculate_CRC16((const uint8_t *)&tempParams, sizeof(RF_TreatParams_t) - sizeof(uint16_t));
     tempParams.CrcCode = crc;
     
-    return Drv_Memory_Write(MEM_ADDR_RF_PARAMS, (const uint8_t *)&tempParams, sizeof(RF_TreatParams_t));
+    /* A failed write leaves the block undefined: drop the cached copy */
+    s_CacheValid &= (uint8_t)~(1u << E_MEM_BLOCK_RF);
+    if (!Drv_Memory_Write(MEM_ADDR_RF_PARAMS, (const uint8_t *)&tempParams, sizeof(RF_TreatParams_t)))
+    {
+        return false;
+    }
+    App_Memory_CachePut(E_MEM_BLOCK_RF, &tempParams, sizeof(RF_TreatParams_t));
+    return true;
 }
 
 /**
@@ -102,6 +146,11 @@ bool App_Memory_LoadRFParams(RF_TreatParams_t *params)
         return false;
     }
     
+    if (App_Memory_CacheGet(E_MEM_BLOCK_RF, params, sizeof(RF_TreatParams_t)))
+    {
+        return true;
+    }
+    
     /* Read parameters from memory */
     if (!Drv_Memory_Read(MEM_ADDR_RF_PARAMS, (uint8_t *)&tempParams, sizeof(RF_TreatParams_t)))
     {
@@ -124,6 +173,7 @@ bool App_Memory_LoadRFParams(RF_TreatParams_t *params)
     /* Restore CRC value and copy to output */
     tempParams.CrcCode = storedCrc;
     *params = tempParams;
+    App_Memory_CachePut(E_MEM_BLOCK_RF, &tempParams, sizeof(RF_TreatParams_t));
     
     return true;
 }
@@ -151,7 +201,14 @@ bool App_Memory_SaveSWParams(const SW_TreatParams_t *params)
     crc = Calculate_CRC16((const uint8_t *)&tempParams, sizeof(SW_TreatParams_t) - sizeof(uint16_t));
     tempParams.CrcCode = crc;
     
-    return Drv_Memory_Write(MEM_ADDR_SW_PARAMS, (const uint8_t *)&tempParams, sizeof(SW_TreatParams_t));
+    /* A failed write leaves the block undefined: drop the cached copy */
+    s_CacheValid &= (uint8_t)~(1u << E_MEM_BLOCK_SW);
+    if (!Drv_Memory_Write(MEM_ADDR_SW_PARAMS, (const uint8_t *)&tempParams, sizeof(SW_TreatParams_t)))
+    {
+        return false;
+    }
+    App_Memory_CachePut(E_MEM_BLOCK_SW, &tempParams, sizeof(SW_TreatParams_t));
+    return true;
 }
 
 /**
@@ -170,6 +227,11 @@ bool App_Memory_LoadSWParams(SW_TreatParams_t *params)
         return false;
     }
     
+    if (App_Memory_CacheGet(E_MEM_BLOCK_SW, params, sizeof(SW_TreatParams_t)))
+    {
+        return true;
+    }
+    
     /* Read parameters from memory */
     if (!Drv_Memory_Read(MEM_ADDR_SW_PARAMS, (uint8_t *)&tempParams, sizeof(SW_TreatParams_t)))
     {
@@ -192,6 +254,7 @@ bool App_Memory_LoadSWParams(SW_TreatParams_t *params)
     /* Restore CRC value and copy to output */
     tempParams.CrcCode = storedCrc;
     *params = tempParams;
+    App_Memory_CachePut(E_MEM_BLOCK_SW, &tempParams, sizeof(SW_TreatParams_t));
     
     return true;
 }
@@ -219,7 +282,14 @@ bool App_Memory_SaveNPHParams(const NPH_TreatParams_t *params)
     crc = Calculate_CRC16((const uint8_t *)&tempParams, sizeof(NPH_TreatParams_t) - sizeof(uint16_t));
     tempParams.CrcCode = crc;
     
-    return Drv_Memory_Write(MEM_ADDR_NPH_PARAMS, (const uint8_t *)&tempParams, sizeof(NPH_TreatParams_t));
+    /* A failed write leaves the block undefined: drop the cached copy */
+    s_CacheValid &= (uint8_t)~(1u << E_MEM_BLOCK_NPH);
+    if (!Drv_Memory_Write(MEM_ADDR_NPH_PARAMS, (const uint8_t *)&tempParams, sizeof(NPH_TreatParams_t)))
+    {
+        return false;
+    }
+    App_Memory_CachePut(E_MEM_BLOCK_NPH, &tempParams, sizeof(NPH_TreatParams_t));
+    return true;
 }
 
 /**
@@ -238,6 +308,11 @@ bool App_Memory_LoadNPHParams(NPH_TreatParams_t *params)
         return false;
     }
     
+    if (App_Memory_CacheGet(E_MEM_BLOCK_NPH, params, sizeof(NPH_TreatParams_t)))
+    {
+        return true;
+    }
+    
     /* Read parameters from memory */
     if (!Drv_Memory_Read(MEM_ADDR_NPH_PARAMS, (uint8_t *)&tempParams, sizeof(NPH_TreatParams_t)))
     {
@@ -260,6 +335,7 @@ bool App_Memory_LoadNPHParams(NPH_TreatParams_t *params)
     /* Restore CRC value and copy to output */
     tempParams.CrcCode = storedCrc;
     *params = tempParams;
+    App_Memory_CachePut(E_MEM_BLOCK_NPH, &tempParams, sizeof(NPH_TreatParams_t));
     
     return true;
 }
@@ -287,7 +363,14 @@ bool App_Memory_SaveUSParams(const US_TreatParams_t *params)
     crc = Calculate_CRC16((const uint8_t *)&tempParams, sizeof(US_TreatParams_t) - sizeof(uint16_t));
     tempParams.CrcCode = crc;
     
-    return Drv_Memory_Write(MEM_ADDR_US_PARAMS, (const uint8_t *)&tempParams, sizeof(US_TreatParams_t));
+    /* A failed write leaves the block undefined: drop the cached copy */
+    s_CacheValid &= (uint8_t)~(1u << E_MEM_BLOCK_US);
+    if (!Drv_Memory_Write(MEM_ADDR_US_PARAMS, (const uint8_t *)&tempParams, sizeof(US_TreatParams_t)))
+    {
+        return false;
+    }
+    App_Memory_CachePut(E_MEM_BLOCK_US, &tempParams, sizeof(US_TreatParams_t));
+    return true;
 }
 
 /**
@@ -306,6 +389,11 @@ bool App_Memory_LoadUSParams(US_TreatParams_t *params)
         return false;
     }
     
+    if (App_Memory_CacheGet(E_MEM_BLOCK_US, params, sizeof(US_TreatParams_t)))
+    {
+        return true;
+    }
+    
     /* Read parameters from memory */
     if (!Drv_Memory_Read(MEM_ADDR_US_PARAMS, (uint8_t *)&tempParams, sizeof(US_TreatParams_t)))
     {
@@ -328,8 +416,105 @@ bool App_Memory_LoadUSParams(US_TreatParams_t *params)
     /* Restore CRC value and copy to output */
     tempParams.CrcCode = storedCrc;
     *params = tempParams;
+    App_Memory_CachePut(E_MEM_BLOCK_US, &tempParams, sizeof(US_TreatParams_t));
     
     return true;
 }
 
+/**
+ * @brief Read one parameter block into the cache per call, off the boot path
+ * @retval true once every block has been read (valid or not)
+ */
+bool App_Memory_Preload(void)
+{
+    TreatParams_Union_t temp;
+
+    switch (s_PreloadNext)
+    {
+        case E_MEM_BLOCK_RF:
+            (void)App_Memory_LoadRFParams(&temp.rfParams);
+            break;
+        case E_MEM_BLOCK_SW:
+            (void)App_Memory_LoadSWParams(&temp.swParams);
+            break;
+        case E_MEM_BLOCK_NPH:
+            (void)App_Memory_LoadNPHParams(&temp.nphParams);
+            break;
+        case E_MEM_BLOCK_US:
+            (void)App_Memory_LoadUSParams(&temp.usParams);
+            break;
+        default:
+            return true;
+    }
+    s_PreloadNext++;
+    return s_PreloadNext >= E_MEM_BLOCK_MAX;
+}
+
+/**
+ * @brief Save the black-box image of the previous run
+ * @param data Pointer to the compact image (Drv_BlackBox_Export)
+ * @param length Image length in bytes
+ * @retval true if success, false if failed
+ */
+bool App_Memory_SaveBlackBox(const uint8_t *data, uint16_t length)
+{
+    uint8_t head[MEM_BLACKBOX_HEAD_LEN];
+    uint16_t crc;
+
+    if (data == NULL || length == 0 || length > MEM_BLACKBOX_SIZE)
+    {
+        return false;
+    }
+
+    /* Image first, header last: a reset in between leaves the old header invalid */
+    crc = Calculate_CRC16(data, length);
+    head[0] = (uint8_t)length;
+    head[1] = (uint8_t)(length >> 8);
+    head[2] = (uint8_t)crc;
+    head[3] = (uint8_t)(crc >> 8);
+    if (!Drv_Memory_Write(MEM_ADDR_BLACKBOX + MEM_BLACKBOX_HEAD_LEN, data, length))
+    {
+        return false;
+    }
+    return Drv_Memory_Write(MEM_ADDR_BLACKBOX, head, sizeof(head));
+}
+
+/**
+ * @brief Read part of the stored black-box image
+ * @param offset Byte offset in the image
+ * @param data Pointer to buffer to store read data
+ * @param length Number of bytes requested
+ * @param pTotal Stored image length (may be NULL)
+ * @param pCrc Stored image CRC16, for the reader to verify the whole image (may be NULL)
+ * @retval Number of bytes read, 0 if nothing stored or past the end
+ */
+uint16_t App_Memory_ReadBlackBox(uint16_t offset, uint8_t *data, uint16_t length, uint16_t *pTotal, uint16_t *pCrc)
+{
+    uint8_t head[MEM_BLACKBOX_HEAD_LEN];
+    uint16_t total;
+
+    if (data == NULL || !Drv_Memory_Read(MEM_ADDR_BLACKBOX, head, sizeof(head)))
+    {
+        return 0;
+    }
+    total = head[0] | (head[1] << 8);
+    if (total == 0 || total > MEM_BLACKBOX_SIZE || offset >= total)
+    {
+        return 0;
+    }
+    if (length > total - offset)
+    {
+        length = total - offset;
+    }
+    if (pTotal != NULL)
+    {
+        *pTotal = total;
+    }
+    if (pCrc != NULL)
+    {
+        *pCrc = head[2] | (head[3] << 8);
+    }
+    return Drv_Memory_Read(MEM_ADDR_BLACKBOX + MEM_BLACKBOX_HEAD_LEN + offset, data, length) ? length : 0;
+}
+
 /**************************End of file********************************/
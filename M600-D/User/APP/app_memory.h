@@ -84,11 +84,19 @@ typedef union
     uint8_t rawData[16];            ///< Raw data buffer
 } TreatParams_Union_t;
 
+#define MEM_BLACKBOX_SIZE       0x0200      ///< Max black-box image length (bytes)
+
 /**
  * @brief Initialize memory module
  */
 void App_Memory_Init(void);
 
+/**
+ * @brief Background preload of the parameter blocks, one per call
+ * @retval true when finished
+ */
+bool App_Memory_Preload(void);
+
 /**
  * @brief Save Radio Frequency treatment parameters
  * @param params Pointer to RF treatment parameters
@@ -145,6 +153,25 @@ bool App_Memory_SaveUSParams(const US_TreatParams_t *params);
  */
 bool App_Memory_LoadUSParams(US_TreatParams_t *params);
 
+/**
+ * @brief Save the black-box image of the previous run
+ * @param data Pointer to the compact image
+ * @param length Image length in bytes (<= MEM_BLACKBOX_SIZE)
+ * @retval true if success, false if failed
+ */
+bool App_Memory_SaveBlackBox(const uint8_t *data, uint16_t length);
+
+/**
+ * @brief Read part of the stored black-box image
+ * @param offset Byte offset in the image
+ * @param data Pointer to buffer to store read data
+ * @param length Number of bytes requested
+ * @param pTotal Stored image length (may be NULL)
+ * @param pCrc Stored image CRC16 (may be NULL)
+ * @retval Number of bytes read, 0 if nothing stored or past the end
+ */
+uint16_t App_Memory_ReadBlackBox(uint16_t offset, uint8_t *data, uint16_t length, uint16_t *pTotal, uint16_t *pCrc);
+
 #ifdef __cplusplus
 }
 #endif
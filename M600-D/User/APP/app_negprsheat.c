@@ -7,6 +7,7 @@
 * @version  : V1.0.0
 * @copyright: Copyright (c) 2050
 **********************************************************************************/
+#define LOG_DOMAIN  LOG_DOMAIN_NPH
 #include "app_negprsheat.h"
 #include "app_treatmgr.h"
 #include "app_memory.h"
@@ -15,6 +16,7 @@
 #include "drv_adc.h"
 #include "log.h"
 #include "drv_delay.h"
+#include "app_program.h"
 #include <string.h>
 
 static NPH_CtrlInfo_t s_NPHCtrlInfo;
@@ -59,51 +61,40 @@ static uint8_t App_NegPrsHeat_VoltageToPressure(uint16_t voltage_mv)
     return pressure;
 }
 
-void App_NegPrsHeat_UpdateStatus(void)
+#define NPH_PUBLISH_U8(field, value)    App_Comm_PublishStatusU8(PROTOCOL_MODULE_HEAT, \
+                                            APP_COMM_STATUS_OFFSET(Heat_GetStatus_Reply_t, field), (value))
+#define NPH_PUBLISH_U16(field, value)   App_Comm_PublishStatusU16(PROTOCOL_MODULE_HEAT, \
+                                            APP_COMM_STATUS_OFFSET(Heat_GetStatus_Reply_t, field), (value))
+
+static void App_NegPrsHeat_UpdateStatus(void)
 {
-    Heat_TransData_t *pTransData = App_Comm_GetHeatTransData();
-    
-    // Update work state
-    if(s_NPHCtrlInfo.runState == E_NPH_RUN_WORKING) {
-        pTransData->TxStatus.work_state = 0x01;
-    } else if(s_NPHCtrlInfo.runState == E_NPH_RUN_PREHEAT) {
-        pTransData->TxStatus.preheat_state = 0x01;
-        pTransData->TxStatus.work_state = 0x00;
+    // Update preheat state
+    if(s_NPHCtrlInfo.Ctx.runState == E_TREAT_RUN_PREPARE) {
+        NPH_PUBLISH_U8(preheat_state, 0x01);
+        NPH_PUBLISH_U8(work_state, 0x00);
     } else {
-        pTransData->TxStatus.work_state = 0x00;
-        pTransData->TxStatus.preheat_state = 0x00;
+        NPH_PUBLISH_U8(preheat_state, 0x00);
     }
     
-    pTransData->TxStatus.temp_limit = s_NPHCtrlInfo.WorkTempLimit;
-    pTransData->TxStatus.remain_heat_time = s_NPHCtrlInfo.RemainTime;
-    pTransData->TxStatus.suck_time = s_NPHCtrlInfo.SuckTime;
-    pTransData->TxStatus.release_time = s_NPHCtrlInfo.ReleaseTime;
-    pTransData->TxStatus.pressure = s_NPHCtrlInfo.Pressure;
-    pTransData->TxStatus.head_temp = s_NPHCtrlInfo.HeadTemp;
-    pTransData->TxStatus.preheat_temp_limit = s_NPHCtrlInfo.PreheatTempLimit;
-    pTransData->TxStatus.remain_preheat_time = s_NPHCtrlInfo.PreheatTime;
-    
-    // Get probe connection status and foot switch state
-    bool headConnected = (s_NPHCtrlInfo.probeStatus == E_IODEVICE_MODE_NEGATIVE_PRESSURE_HEAT);
-    
-    // Combine connection state
-    if (headConnected && s_NPHCtrlInfo.FootSwitchStatus) {
-        pTransData->TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_CLOSED;
-    } else if (!headConnected && s_NPHCtrlInfo.FootSwitchStatus) {
-        pTransData->TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_CLOSED;
-    } else if (headConnected && !s_NPHCtrlInfo.FootSwitchStatus) {
-        pTransData->TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_OPEN;
-    } else {
-        pTransData->TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_OPEN;
-    }
-    pTransData->TxStatus.error_code = s_NPHCtrlInfo.ErrorCode;
+    NPH_PUBLISH_U16(temp_limit, s_NPHCtrlInfo.WorkTempLimit);
+    NPH_PUBLISH_U16(remain_heat_time, s_NPHCtrlInfo.RemainTime);
+    NPH_PUBLISH_U16(suck_time, s_NPHCtrlInfo.SuckTime);
+    NPH_PUBLISH_U16(release_time, s_NPHCtrlInfo.ReleaseTime);
+    NPH_PUBLISH_U8(pressure, s_NPHCtrlInfo.Pressure);
+    NPH_PUBLISH_U16(head_temp, s_NPHCtrlInfo.HeadTemp);
+    NPH_PUBLISH_U16(preheat_temp_limit, s_NPHCtrlInfo.PreheatTempLimit);
+    NPH_PUBLISH_U16(remain_preheat_time, s_NPHCtrlInfo.PreheatTime);
+    NPH_PUBLISH_U16(deliver_heat_time, App_Session_GetDeliveredSec(&s_NPHCtrlInfo.Session));
 }
 
-void App_NegPrsHeat_RxDataHandle(void)
+static void App_NegPrsHeat_RxDataHandle(void)
 {
-    Heat_TransData_t *pTransData = App_Comm_GetHeatTransData();
+    Heat_TransData_t *pTransData = &s_NPHCtrlInfo.Trans;
     
-    if(pTransData->RxWorkState.work_state == WORK_STATE_RESET)
+    // 仅在收到新指令时处理，避免同一条复位指令被重复执行
+    if(App_Comm_FetchRx(PROTOCOL_MODULE_HEAT, PROTOCOL_CMD_SET_WORK_STATE, &pTransData->RxWorkState,
+                        sizeof(pTransData->RxWorkState), &s_NPHCtrlInfo.RxWorkStateVer) &&
+       pTransData->RxWorkState.work_state == WORK_STATE_RESET)
     {
         // 处理复位功能
         // 重置工作温度上限、工作时间、负压大小、负压吸时间、负压放时间
@@ -129,7 +120,8 @@ void App_NegPrsHeat_RxDataHandle(void)
     }
     
     // 处理预热配置
-    if(pTransData->flag.bits.Rely_Config)
+    if(App_Comm_FetchRx(PROTOCOL_MODULE_HEAT, PROTOCOL_CMD_SET_CONFIG, &pTransData->RxPreheat,
+                        sizeof(pTransData->RxPreheat), &s_NPHCtrlInfo.RxPreheatVer))
     {
         // 预热配置通过RxPreheat结构体传递
         if(pTransData->RxPreheat.preheat_state == 0x01)
@@ -149,77 +141,40 @@ void App_NegPrsHeat_RxDataHandle(void)
         s_NPHCtrlInfo.TreatParams.PreheatTime = s_NPHCtrlInfo.PreheatTime;
         App_Memory_SaveNPHParams(&s_NPHCtrlInfo.TreatParams);
         
-        pTransData->flag.bits.Rely_Config = 0;
         LOG_I("NPH Config updated: preheat_enable=%d, preheat_temp=%d, preheat_time=%d", 
               s_NPHCtrlInfo.PreheatEnable, s_NPHCtrlInfo.PreheatTempLimit, s_NPHCtrlInfo.PreheatTime);
     }
 }
 
-void App_NegPrsHeat_ChangeState(NPH_RunState_EnumDef newState)
-{
-    if(newState != s_NPHCtrlInfo.runState && newState < E_NPH_RUN_MAX)
-    {
-        s_NPHCtrlInfo.runState = newState;
-        switch(newState)
-        {
-            case E_NPH_RUN_INIT:
-                LOG_I("NPH state changed to INIT");
-                break;
-            case E_NPH_RUN_IDLE:
-                LOG_I("NPH state changed to IDLE");
-                break;
-            case E_NPH_RUN_PREHEAT:
-                LOG_I("NPH state changed to PREHEAT");
-                break;
-            case E_NPH_RUN_WORKING:
-                LOG_I("NPH state changed to WORKING");
-                // 启动工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            case E_NPH_RUN_STOP:
-                LOG_I("NPH state changed to STOP");
-                // 结束工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            default:
-                break;
-        }
-    }
-}
-
-void App_NegPrsHeat_Monitor(void)
-{
-    // Get the foot switch status and probe status
-    s_NPHCtrlInfo.FootSwitchStatus = Drv_IODevice_GetFootSwitchState();
-    
-    // Get the probe status
-    s_NPHCtrlInfo.probeStatus = Drv_IODevice_GetProbeStatus();
-}
-
-bool App_NegPrsHeat_StartCheck()
+/**
+ * @brief 负压加热特有启动条件（脚踏、治疗头由引擎检查）
+ */
+static bool App_NegPrsHeat_CheckRequest(void)
 {
-    Heat_TransData_t *pTransData = App_Comm_GetHeatTransData();
+    Heat_TransData_t *pTransData = &s_NPHCtrlInfo.Trans;
+    // 已下发治疗程序时，时间和负压大小由程序给出（下发时已校验）
+    bool program = App_Program_IsArmed(PROTOCOL_MODULE_HEAT);
     
     // 1. 检查下位机是否下发了发射负压加热指令
     if(pTransData->RxWorkState.work_state != WORK_STATE_START) {
         LOG_E("NPH: Work state is not start");
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 2. 检查剩余工作时间是否大于0（0-3600s）
-    if(pTransData->RxWorkState.work_time == 0 || pTransData->RxWorkState.work_time > NPH_WORK_TIME_MAX) {
+    if(!program && (pTransData->RxWorkState.work_time == 0 || pTransData->RxWorkState.work_time > NPH_WORK_TIME_MAX)) {
         LOG_E("NPH: Invalid work time: %d", pTransData->RxWorkState.work_time);
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 3. 检查负压大小是否有效（10-100KPa）
-    if(pTransData->RxWorkState.pressure < NPH_PRESSURE_MIN_KPA || 
-       pTransData->RxWorkState.pressure > NPH_PRESSURE_MAX_KPA) {
+    if(!program && (pTransData->RxWorkState.pressure < NPH_PRESSURE_MIN_KPA || 
+                    pTransData->RxWorkState.pressure > NPH_PRESSURE_MAX_KPA)) {
         LOG_E("NPH: Invalid pressure: %d (range: %d-%d)", 
               pTransData->RxWorkState.pressure, NPH_PRESSURE_MIN_KPA, NPH_PRESSURE_MAX_KPA);
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
         return false;
     }
     
@@ -228,7 +183,7 @@ bool App_NegPrsHeat_StartCheck()
        pTransData->RxWorkState.suck_time > (NPH_SUCK_TIME_MAX_MS/100)) {
         LOG_E("NPH: Invalid suck time: %d (range: %d-%d)", 
               pTransData->RxWorkState.suck_time, NPH_SUCK_TIME_MIN_MS/100, NPH_SUCK_TIME_MAX_MS/100);
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
         return false;
     }
     
@@ -237,28 +192,14 @@ bool App_NegPrsHeat_StartCheck()
        pTransData->RxWorkState.release_time > (NPH_RELEASE_TIME_MAX_MS/100)) {
         LOG_E("NPH: Invalid release time: %d (range: %d-%d)", 
               pTransData->RxWorkState.release_time, NPH_RELEASE_TIME_MIN_MS/100, NPH_RELEASE_TIME_MAX_MS/100);
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
-        return false;
-    }
-    
-    // 6. 检查脚踏开关是否闭合
-    if(s_NPHCtrlInfo.FootSwitchStatus == false) {
-        LOG_E("NPH: Foot switch is not closed");
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
         return false;
     }
     
-    // 7. 检查是否正确识别到负压加热治疗头
-    if(s_NPHCtrlInfo.probeStatus != E_IODEVICE_MODE_NEGATIVE_PRESSURE_HEAT) {
-        LOG_E("NPH: Negative pressure heat probe not connected");
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_PROBE_NOT_CONNECTED;
-        return false;
-    }
-    
-    // 8. 检查是否有剩余可治疗次数
+    // 6. 检查是否有剩余可治疗次数
     if(s_NPHCtrlInfo.TreatTimes == 0) {
         LOG_E("NPH: No remaining treat times");
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_INVALID_PARAMS;
         return false;
     }
     
@@ -268,11 +209,12 @@ bool App_NegPrsHeat_StartCheck()
 
 void App_NegPrsHeat_SetWorkParams(void)
 {
-    Heat_TransData_t *pTransData = App_Comm_GetHeatTransData();
+    Heat_TransData_t *pTransData = &s_NPHCtrlInfo.Trans;
     
     // 设置工作参数
     s_NPHCtrlInfo.WorkTempLimit = pTransData->RxWorkState.temp_limit;
     s_NPHCtrlInfo.RemainTime = pTransData->RxWorkState.work_time;
+    App_Session_Start(&s_NPHCtrlInfo.Session, E_TREATMGR_STATE_NEGATIVE_PRESSURE_HEAT, s_NPHCtrlInfo.RemainTime);
     s_NPHCtrlInfo.Pressure = pTransData->RxWorkState.pressure;
     s_NPHCtrlInfo.SuckTime = pTransData->RxWorkState.suck_time;  // 单位：100ms
     s_NPHCtrlInfo.ReleaseTime = pTransData->RxWorkState.release_time;  // 单位：100ms
@@ -306,14 +248,14 @@ bool App_NegPrsHeat_IsHeadTempNormal(void)
     // 检查温度传感器是否出错（NTC开路或短路）
     if(temp == 0xFFFF || temp == 0xEEFF)
     {
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_TEMP_SENSOR_ERROR;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_TEMP_SENSOR_ERROR;
         LOG_W("NPH: Temperature sensor error: %d", temp);
         isNormal = false;
     }
     // 检查温度是否超过65℃（650 * 0.1°C）
     else if(temp > NPH_TEMP_ERROR_THRESHOLD)
     {
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_TEMP_TOO_HIGH;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_TEMP_TOO_HIGH;
         LOG_W("NPH: Head temperature too high: %d (threshold: %d)", temp, NPH_TEMP_ERROR_THRESHOLD);
         isNormal = false;
     }
@@ -329,7 +271,7 @@ bool App_NegPrsHeat_IsHeadTempNormal(void)
             // 如果温度达到或超过65℃，且是在2s内上升的，则报警
             if(temp >= NPH_TEMP_ERROR_THRESHOLD)
             {
-                s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_TEMP_RISE_TOO_FAST;
+                s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_TEMP_RISE_TOO_FAST;
                 LOG_W("NPH: Temperature rise to 65 degree in %d ms (from %d to %d)", 
                       timeElapsed, s_NPHCtrlInfo.lastTemp, temp);
                 isNormal = false;
@@ -352,9 +294,9 @@ bool App_NegPrsHeat_IsHeadTempNormal(void)
     
     s_NPHCtrlInfo.HeadTemp = temp;
     
-    if(isNormal && s_NPHCtrlInfo.ErrorCode != E_NPH_ERROR_NONE)
+    if(isNormal && s_NPHCtrlInfo.Ctx.ErrorCode != E_NPH_ERROR_NONE)
     {
-        s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_NONE;
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_NONE;
     }
     
     return isNormal;
@@ -367,11 +309,11 @@ void App_NegPrsHeat_ControlTemperature(void)
     bool needHeat = false;
     
     // 根据当前状态确定目标温度
-    if(s_NPHCtrlInfo.runState == E_NPH_RUN_PREHEAT)
+    if(s_NPHCtrlInfo.Ctx.runState == E_TREAT_RUN_PREPARE)
     {
         targetTemp = s_NPHCtrlInfo.PreheatTempLimit;
     }
-    else if(s_NPHCtrlInfo.runState == E_NPH_RUN_WORKING)
+    else if(s_NPHCtrlInfo.Ctx.runState == E_TREAT_RUN_WORKING)
     {
         targetTemp = s_NPHCtrlInfo.WorkTempLimit;
     }
@@ -524,135 +466,147 @@ void App_NegPrsHeat_ProcessVacuum(void)
     }
 }
 
-void App_NegPrsHeat_Process(void)
+static void App_NegPrsHeat_LoadParams(void)
 {
-    static Drv_Timer_t TempMonitorTimer;
-    
-    // Process the negative pressure heat module
-    App_NegPrsHeat_UpdateStatus();
-    App_NegPrsHeat_RxDataHandle();
-    App_NegPrsHeat_Monitor();
+    // 加载负压加热参数
+    if(App_Memory_LoadNPHParams(&s_NPHCtrlInfo.TreatParams)) {
+        s_NPHCtrlInfo.TempLimit = s_NPHCtrlInfo.TreatParams.TempLimit;
+        s_NPHCtrlInfo.TreatTimes = s_NPHCtrlInfo.TreatParams.RemainTimes;
+        s_NPHCtrlInfo.PreheatEnable = (s_NPHCtrlInfo.TreatParams.PreheatEnable == 1);
+        s_NPHCtrlInfo.PreheatTempLimit = s_NPHCtrlInfo.TreatParams.PreheatTempLimit;
+        s_NPHCtrlInfo.PreheatTime = s_NPHCtrlInfo.TreatParams.PreheatTime;
+        
+        LOG_I("NPH: Parameters loaded - temp_limit=%d, remain_times=%d, preheat_enable=%d, preheat_temp=%d, preheat_time=%d",
+              s_NPHCtrlInfo.TempLimit, s_NPHCtrlInfo.TreatTimes,
+              s_NPHCtrlInfo.PreheatEnable, s_NPHCtrlInfo.PreheatTempLimit, s_NPHCtrlInfo.PreheatTime);
+    } else {
+        LOG_E("NPH: Failed to load parameters");
+        s_NPHCtrlInfo.Ctx.ErrorCode = E_NPH_ERROR_READ_PARAMS_FAILED;
+    }
+}
 
-    // Handle the negative pressure heat state
-    switch(s_NPHCtrlInfo.runState)
-    {
-        case E_NPH_RUN_INIT:
-            // 加载负压加热参数
-            if(App_Memory_LoadNPHParams(&s_NPHCtrlInfo.TreatParams)) {
-                s_NPHCtrlInfo.TempLimit = s_NPHCtrlInfo.TreatParams.TempLimit;
-                s_NPHCtrlInfo.TreatTimes = s_NPHCtrlInfo.TreatParams.RemainTimes;
-                s_NPHCtrlInfo.PreheatEnable = (s_NPHCtrlInfo.TreatParams.PreheatEnable == 1);
-                s_NPHCtrlInfo.PreheatTempLimit = s_NPHCtrlInfo.TreatParams.PreheatTempLimit;
-                s_NPHCtrlInfo.PreheatTime = s_NPHCtrlInfo.TreatParams.PreheatTime;
-                
-                LOG_I("NPH: Parameters loaded - temp_limit=%d, remain_times=%d, preheat_enable=%d, preheat_temp=%d, preheat_time=%d",
-                      s_NPHCtrlInfo.TempLimit, s_NPHCtrlInfo.TreatTimes,
-                      s_NPHCtrlInfo.PreheatEnable, s_NPHCtrlInfo.PreheatTempLimit, s_NPHCtrlInfo.PreheatTime);
-            } else {
-                LOG_E("NPH: Failed to load parameters");
-                s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_READ_PARAMS_FAILED;
-            }
-            App_NegPrsHeat_ChangeState(E_NPH_RUN_IDLE);
-            break;
-            
-        case E_NPH_RUN_IDLE:
-            // 使用App_NegPrsHeat_StartCheck进行启动前检查
-            if(App_NegPrsHeat_StartCheck()) {
-                // 设置工作参数
-                App_NegPrsHeat_SetWorkParams();
-                
-                // 如果开启了预热功能，先进入预热状态
-                if(s_NPHCtrlInfo.PreheatEnable)
-                {
-                    App_NegPrsHeat_ChangeState(E_NPH_RUN_PREHEAT);
-                }
-                else
-                {
-                    // 直接进入工作状态
-                    Drv_IODevice_ChangeChannel(CHANNEL_NH);
-                    App_NegPrsHeat_ChangeState(E_NPH_RUN_WORKING);
-                }
-            }
-            break;
-            
-        case E_NPH_RUN_PREHEAT:
-            // 预热状态：加热至预热温度上限
-            // 检查温度是否达到预热温度上限
-            if(s_NPHCtrlInfo.HeadTemp >= s_NPHCtrlInfo.PreheatTempLimit)
-            {
-                // 预热完成，进入工作状态
-                Drv_IODevice_ChangeChannel(CHANNEL_NH);
-                App_NegPrsHeat_ChangeState(E_NPH_RUN_WORKING);
-                LOG_I("NPH: Preheat completed, entering working state");
-            }
-            // 检查所有条件
-            else if(App_NegPrsHeat_StartCheck() == false)
-            {
-                App_NegPrsHeat_ChangeState(E_NPH_RUN_STOP);
-            }
-            else
-            {
-                // 温度监控（10ms周期）
-                if(Drv_Timer_Tick(&TempMonitorTimer, NPH_TEMP_MONITOR_PERIOD_MS)) {
-                    if(App_NegPrsHeat_IsHeadTempNormal() == false) {
-                        // 温度异常，立马停止
-                        App_NegPrsHeat_ChangeState(E_NPH_RUN_STOP);
-                    } else {
-                        // 控制温度
-                        App_NegPrsHeat_ControlTemperature();
-                    }
-                }
-            }
-            break;
-            
-        case E_NPH_RUN_WORKING:
-            // 检查所有条件
-            if(App_NegPrsHeat_StartCheck() == false || 
-               s_NPHCtrlInfo.RemainTime == 0){
-                App_NegPrsHeat_ChangeState(E_NPH_RUN_STOP);
-            } else {
-                // 温度监控（10ms周期）
-                if(Drv_Timer_Tick(&TempMonitorTimer, NPH_TEMP_MONITOR_PERIOD_MS)) {
-                    if(App_NegPrsHeat_IsHeadTempNormal() == false) {
-                        // 温度异常，立马停止
-                        App_NegPrsHeat_ChangeState(E_NPH_RUN_STOP);
-                    } else {
-                        // 控制温度
-                        App_NegPrsHeat_ControlTemperature();
-                    }
-                }
-                
-                // 处理负压控制
-                App_NegPrsHeat_ProcessVacuum();
-                
-                // 更新时间
-                if(s_NPHCtrlInfo.RemainTime >= TREAT_TASK_TIME) {
-                    s_NPHCtrlInfo.RemainTime -= TREAT_TASK_TIME;
-                } else {
-                    s_NPHCtrlInfo.RemainTime = 0;
-                }
-            }
-            break;
-            
-        case E_NPH_RUN_STOP:
-            // 关闭加热
-            Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HEAT_HP, 0);
-            s_NPHCtrlInfo.heatControlActive = false;
-            
-            // 关闭负压控制
-            Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HP_MOTOR, 0);
-            Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HP_LOSE, 0);
-            s_NPHCtrlInfo.motorState = false;
-            s_NPHCtrlInfo.vacuumState = E_NPH_VACUUM_STATE_IDLE;
-            
-            // 关闭输出通道
-            Drv_IODevice_ChangeChannel(CHANNEL_CLOSE);
-            App_TreatMgr_ChangeState(E_TREATMGR_STATE_IDLE);
-            break;
-            
-        default:
-            break;
+/**
+ * @brief 预热：加热至预热温度上限后进入工作状态，未开启预热时直接完成
+ */
+static TreatModule_Prepare_EnumDef App_NegPrsHeat_Preheat(void)
+{
+    static Drv_Timer_t PreheatMonitorTimer;
+
+    if(!s_NPHCtrlInfo.PreheatEnable) {
+        return E_TREAT_PREPARE_DONE;
+    }
+    // 检查温度是否达到预热温度上限
+    if(s_NPHCtrlInfo.HeadTemp >= s_NPHCtrlInfo.PreheatTempLimit) {
+        LOG_I("NPH: Preheat completed, entering working state");
+        return E_TREAT_PREPARE_DONE;
+    }
+    // 温度监控（10ms周期）
+    if(Drv_Timer_Tick(&PreheatMonitorTimer, NPH_TEMP_MONITOR_PERIOD_MS)) {
+        if(App_NegPrsHeat_IsHeadTempNormal() == false) {
+            // 温度异常，立马停止
+            return E_TREAT_PREPARE_FAIL;
+        }
+        // 控制温度
+        App_NegPrsHeat_ControlTemperature();
+    }
+    return E_TREAT_PREPARE_BUSY;
+}
+
+/**
+ * @brief 治疗程序换档：档位即负压大小 (KPa)，负压控制下一周期按新目标调节；不使用频率
+ */
+static void App_NegPrsHeat_ApplyStep(uint8_t level, uint16_t frequency)
+{
+    (void)frequency;
+    s_NPHCtrlInfo.Pressure = level;
+    s_NPHCtrlInfo.targetPressure = App_NegPrsHeat_PressureToVoltage(level);
+}
+
+static bool App_NegPrsHeat_WorkCheck(void)
+{
+    // 更新时间（按SysTick时间戳换算，不受循环周期影响）
+    s_NPHCtrlInfo.RemainTime = App_Session_GetRemainSec(&s_NPHCtrlInfo.Session);
+    return s_NPHCtrlInfo.RemainTime != 0;
+}
+
+static bool App_NegPrsHeat_TempLoop(void)
+{
+    if(App_NegPrsHeat_IsHeadTempNormal() == false) {
+        // 温度异常，立马停止
+        return false;
     }
+    // 控制温度
+    App_NegPrsHeat_ControlTemperature();
+    return true;
+}
+
+static bool App_NegPrsHeat_VacuumLoop(void)
+{
+    // 处理负压控制
+    App_NegPrsHeat_ProcessVacuum();
+    return true;
+}
+
+static void App_NegPrsHeat_Stop(void)
+{
+    // 关闭加热
+    Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HEAT_HP, 0);
+    s_NPHCtrlInfo.heatControlActive = false;
+    
+    // 关闭负压控制
+    Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HP_MOTOR, 0);
+    Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HP_LOSE, 0);
+    s_NPHCtrlInfo.motorState = false;
+    s_NPHCtrlInfo.vacuumState = E_NPH_VACUUM_STATE_IDLE;
+}
+
+static const TreatModule_Loop_t s_NPHLoops[] =
+{
+    { NPH_TEMP_MONITOR_PERIOD_MS, true,  App_NegPrsHeat_TempLoop },
+    { 0,                          false, App_NegPrsHeat_VacuumLoop },
+};
+
+/* 负压加热无硬件过流保护通道 */
+static const TreatModule_Desc_t s_NPHModule =
+{
+    .pName = "NPH",
+    .logDomain = LOG_DOMAIN_NPH,
+    .pCtx = &s_NPHCtrlInfo.Ctx,
+    .pSession = &s_NPHCtrlInfo.Session,
+    .probe = E_IODEVICE_MODE_NEGATIVE_PRESSURE_HEAT,
+    .channel = CHANNEL_NH,
+    .protectChannel = E_ADC_CHANNEL_MAX,
+    .errProbe = E_NPH_ERROR_PROBE_NOT_CONNECTED,
+    .errInvalid = E_NPH_ERROR_INVALID_PARAMS,
+    .errOverCurrent = E_NPH_ERROR_NONE,
+    .commModule = PROTOCOL_MODULE_HEAT,
+    .workStateOffset = offsetof(Heat_GetStatus_Reply_t, work_state),
+    .connStateOffset = offsetof(Heat_GetStatus_Reply_t, conn_state),
+    .errorCodeOffset = offsetof(Heat_GetStatus_Reply_t, error_code),
+    .programStepOffset = offsetof(Heat_GetStatus_Reply_t, program_step),
+    .stepRemainOffset = offsetof(Heat_GetStatus_Reply_t, step_remain),
+    .pfLoadParams = App_NegPrsHeat_LoadParams,
+    .pfUpdateStatus = App_NegPrsHeat_UpdateStatus,
+    .pfRxDataHandle = App_NegPrsHeat_RxDataHandle,
+    .pfStartCheck = App_NegPrsHeat_CheckRequest,
+    .pfSetWorkParams = App_NegPrsHeat_SetWorkParams,
+    .pfPrepare = App_NegPrsHeat_Preheat,
+    .pfProtectLimit = NULL,
+    .pfWorkCheck = App_NegPrsHeat_WorkCheck,
+    .pfApplyStep = App_NegPrsHeat_ApplyStep,
+    .pfStop = App_NegPrsHeat_Stop,
+    .pLoops = s_NPHLoops,
+    .loopNum = sizeof(s_NPHLoops) / sizeof(s_NPHLoops[0]),
+};
+
+bool App_NegPrsHeat_StartCheck(void)
+{
+    return App_TreatModule_StartCheck(&s_NPHModule);
+}
+
+void App_NegPrsHeat_Process(void)
+{
+    App_TreatModule_Process(&s_NPHModule);
 }
 
 /**
@@ -664,9 +618,8 @@ void App_NegPrsHeat_Init(void)
     memset(&s_NPHCtrlInfo, 0, sizeof(NPH_CtrlInfo_t));
     
     // 设置初始状态
-    s_NPHCtrlInfo.runState = E_NPH_RUN_INIT;
+    App_TreatModule_Init(&s_NPHModule);
     s_NPHCtrlInfo.vacuumState = E_NPH_VACUUM_STATE_IDLE;
-    s_NPHCtrlInfo.ErrorCode = E_NPH_ERROR_NONE;
     s_NPHCtrlInfo.RemainTime = 0;
     s_NPHCtrlInfo.TreatTimes = 0;
     s_NPHCtrlInfo.heatControlActive = false;
@@ -22,6 +22,8 @@ extern "C" {
 #include "app_comm.h"
 #include "app_memory.h"
 #include "drv_iodevice.h"
+#include "app_session.h"
+#include "app_treatmodule.h"
 
 /* 负压加热工作参数 */
 #define NPH_WORK_TIME_MAX           3600        ///< 最大工作时间 (秒)
@@ -35,16 +37,6 @@ extern "C" {
 #define NPH_TEMP_ERROR_THRESHOLD    650         ///< 温度错误阈值 (65℃ = 650 * 0.1°C)
 #define NPH_TEMP_ERROR_TIME_MS      2000        ///< 温度错误检测时间 (2s = 2000ms)
 
-typedef enum
-{
-    E_NPH_RUN_INIT = 0,
-    E_NPH_RUN_IDLE,
-    E_NPH_RUN_PREHEAT,
-    E_NPH_RUN_WORKING,
-    E_NPH_RUN_STOP,
-    E_NPH_RUN_MAX,
-} NPH_RunState_EnumDef;
-
 typedef enum {
     E_NPH_ERROR_NONE = 0,
     E_NPH_ERROR_PROBE_NOT_CONNECTED,
@@ -67,7 +59,7 @@ typedef enum
 
 typedef struct
 {
-    NPH_RunState_EnumDef runState;
+    TreatModule_Ctx_t Ctx;         ///< 引擎运行状态（状态、错误码、脚踏、治疗头）
     NPH_Vacuum_State_EnumDef vacuumState;
     
     uint16_t TempLimit;            ///< 工作温度上限 (0.1°C)
@@ -77,19 +69,17 @@ typedef struct
     uint16_t PreheatTime;         ///< 预热时间 (秒)
     
     uint16_t WorkTempLimit;        ///< 当前工作温度上限 (0.1°C)
-    uint16_t RemainTime;           ///< 剩余工作时间 (秒)
+    uint16_t RemainTime;           ///< 剩余工作时间 (秒)，由Session换算
+    App_Session_t Session;         ///< 治疗计时，预热期间暂停
     uint8_t Pressure;             ///< 负压大小 (10-100 KPa，发送正值)
     uint16_t SuckTime;             ///< 负压吸时间 (0.1s单位，实际为100ms单位)
     uint16_t ReleaseTime;          ///< 负压放时间 (0.1s单位，实际为100ms单位)
     uint16_t HeadTemp;             ///< 治疗头温度 (0.1°C)
     
-    uint8_t ConnState;
-    uint8_t ErrorCode;
-    bool FootSwitchStatus;
-    IODevice_WorkingMode_EnumDef probeStatus;
-    
     NPH_TreatParams_t TreatParams;
-    Heat_TransData_t Trans;
+    Heat_TransData_t Trans;                ///< 本模式收发快照
+    uint32_t RxWorkStateVer;       ///< 已处理的工作状态指令版本
+    uint32_t RxPreheatVer;  ///< 已处理的配置指令版本
     
     /* 温度控制 */
     bool heatControlActive;        ///< 加热控制是否激活
@@ -0,0 +1,241 @@
+/***********************************************************************************
+* @file     : app_program.c
+* @brief    : On-device treatment programs implementation
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#include "app_program.h"
+#include "app_comm.h"
+#include "app_ultrasound.h"
+#include "app_radiofreq.h"
+#include "app_shockwave.h"
+#include "app_negprsheat.h"
+#include "drv_si5351.h"
+#include "log.h"
+
+#define PROGRAM_MODULE_NUM      4       ///< PROTOCOL_MODULE_ULTRASOUND .. PROTOCOL_MODULE_HEAT
+#define PROGRAM_STEP_NONE       0xFFu
+#define PROGRAM_REPLY_LEN       4
+
+/* 各模式档位与频率范围，freqMax为0表示不接受频率 */
+typedef struct
+{
+    uint8_t levelMin;
+    uint8_t levelMax;
+    uint16_t freqMin;
+    uint16_t freqMax;
+} Program_Limit_t;
+
+static const Program_Limit_t s_ProgramLimit[PROGRAM_MODULE_NUM] =
+{
+    { 1,                    WORK_LEVEL_MAX,       700,                    1400 },                    // 超声 (kHz)
+    { 1,                    RF_WORK_LEVEL_MAX,    SI5351_RF_FREQ_MIN_KHZ, SI5351_RF_FREQ_MAX_KHZ },  // 射频 (kHz)
+    { 1,                    SW_WORK_LEVEL_MAX,    1,                      SW_FREQ_LEVEL_MAX },       // 冲击波 (频率档位)
+    { NPH_PRESSURE_MIN_KPA, NPH_PRESSURE_MAX_KPA, 0,                      0 },                       // 负压加热 (KPa)
+};
+
+typedef struct
+{
+    Program_State_EnumDef eState;
+    uint8_t module;
+    uint8_t count;
+    Program_Step_t steps[PROGRAM_STEP_MAX];
+    uint32_t totalMs;
+    uint8_t stepIdx;             ///< 执行中的步
+    uint8_t appliedIdx;          ///< 已下发频率的步，PROGRAM_STEP_NONE为尚未下发
+    uint8_t level;               ///< 最近下发的档位
+    uint32_t stepEndMs;          ///< 当前步结束时的已输出时长
+    uint32_t elapsedMs;          ///< 最近一次的已输出时长，用于上报进度
+} Program_Ctx_t;
+
+static Program_Ctx_t s_Program;
+
+static uint16_t App_Program_GetU16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static bool App_Program_IsRunning(uint8_t module)
+{
+    return s_Program.eState == E_PROGRAM_STATE_RUNNING && s_Program.module == module;
+}
+
+/**
+ * @brief 解析并校验步骤，全部通过才返回成功
+ * @retval CONFIG_RESULT_*
+ */
+static uint8_t App_Program_Parse(uint8_t module, const uint8_t *pData, uint8_t len,
+                                 Program_Step_t *pSteps, uint8_t *pCount, uint32_t *pTotalS)
+{
+    const Program_Limit_t *pLimit = &s_ProgramLimit[module - PROTOCOL_MODULE_ULTRASOUND];
+    const uint8_t *p = &pData[1];
+    uint8_t i;
+
+    *pTotalS = 0;
+    if(len == 0 || pData[0] > PROGRAM_STEP_MAX || len != 1u + (uint16_t)pData[0] * PROGRAM_STEP_LEN){
+        LOG_W("Program: bad length %d", len);
+        return CONFIG_RESULT_FAIL;
+    }
+    *pCount = pData[0];
+    for(i = 0; i < *pCount; i++, p += PROGRAM_STEP_LEN){
+        pSteps[i].duration_s = App_Program_GetU16(&p[0]);
+        pSteps[i].level = p[2];
+        pSteps[i].frequency = App_Program_GetU16(&p[3]);
+        pSteps[i].ramp_s = p[5];
+        if(pSteps[i].duration_s == 0 || pSteps[i].ramp_s > pSteps[i].duration_s ||
+           pSteps[i].level < pLimit->levelMin || pSteps[i].level > pLimit->levelMax ||
+           (pSteps[i].frequency != 0 &&
+            (pSteps[i].frequency < pLimit->freqMin || pSteps[i].frequency > pLimit->freqMax))){
+            LOG_W("Program: step %d out of range (time %d, level %d, freq %d, ramp %d)", i + 1,
+                  pSteps[i].duration_s, pSteps[i].level, pSteps[i].frequency, pSteps[i].ramp_s);
+            return CONFIG_RESULT_OVER_LIMIT;
+        }
+        *pTotalS += pSteps[i].duration_s;
+    }
+    if(*pTotalS > PROGRAM_TIME_MAX_S){
+        LOG_W("Program: total %d s over %d s", *pTotalS, PROGRAM_TIME_MAX_S);
+        return CONFIG_RESULT_OVER_LIMIT;
+    }
+    return CONFIG_RESULT_SUCCESS;
+}
+
+void App_Program_Upload(uint8_t module, const uint8_t *pData, uint8_t len)
+{
+    Program_Step_t steps[PROGRAM_STEP_MAX];
+    uint8_t reply[PROGRAM_REPLY_LEN];
+    uint8_t count = 0;
+    uint32_t totalS = 0;
+    uint8_t result;
+
+    if(module < PROTOCOL_MODULE_ULTRASOUND || module > PROTOCOL_MODULE_HEAT){
+        return;
+    }
+    result = App_Program_Parse(module, pData, len, steps, &count, &totalS);
+    // 执行中不替换，上位机先停止输出
+    if(result == CONFIG_RESULT_SUCCESS && s_Program.eState == E_PROGRAM_STATE_RUNNING){
+        LOG_W("Program: busy in module %d", s_Program.module);
+        result = CONFIG_RESULT_FAIL;
+    }
+    if(result == CONFIG_RESULT_SUCCESS){
+        memcpy(s_Program.steps, steps, count * sizeof(Program_Step_t));
+        s_Program.module = module;
+        s_Program.count = count;
+        s_Program.totalMs = totalS * 1000u;
+        s_Program.eState = (count != 0) ? E_PROGRAM_STATE_LOADED : E_PROGRAM_STATE_EMPTY;
+        LOG_I("Program: module %d, %d steps, %d s", module, count, totalS);
+    }else{
+        count = 0;
+        totalS = 0;
+    }
+    reply[0] = result;
+    reply[1] = count;
+    reply[2] = (uint8_t)totalS;
+    reply[3] = (uint8_t)(totalS >> 8);
+    App_Comm_SendFrame(module, PROTOCOL_CMD_SET_PROGRAM, reply, sizeof(reply));
+}
+
+bool App_Program_IsArmed(uint8_t module)
+{
+    return s_Program.eState != E_PROGRAM_STATE_EMPTY && s_Program.module == module;
+}
+
+uint32_t App_Program_Start(uint8_t module)
+{
+    if(!App_Program_IsArmed(module)){
+        return 0;
+    }
+    s_Program.eState = E_PROGRAM_STATE_RUNNING;
+    s_Program.stepIdx = 0;
+    s_Program.appliedIdx = PROGRAM_STEP_NONE;
+    s_Program.stepEndMs = s_Program.steps[0].duration_s * 1000u;
+    s_Program.elapsedMs = 0;
+    LOG_I("Program: start, %d steps, %d s", s_Program.count, s_Program.totalMs / 1000u);
+    return s_Program.totalMs;
+}
+
+/**
+ * @brief 定位当前步并求档位：斜坡期内由上一步档位（第一步由最低档）线性过渡，
+ *        档位变化或进入新步时返回APPLY；新步频率为0时沿用之前的频率
+ */
+Program_Result_EnumDef App_Program_Process(uint8_t module, uint32_t elapsedMs, Program_Target_t *pTarget)
+{
+    const Program_Step_t *pStep;
+    uint32_t inStepMs;
+    uint32_t rampMs;
+    int32_t from;
+    uint16_t frequency = 0;
+    uint8_t level;
+    bool newStep = false;
+
+    if(!App_Program_IsRunning(module) || pTarget == NULL){
+        return E_PROGRAM_HOLD;
+    }
+    s_Program.elapsedMs = elapsedMs;
+    if(elapsedMs >= s_Program.totalMs){
+        return E_PROGRAM_END;
+    }
+    if(s_Program.appliedIdx == PROGRAM_STEP_NONE){
+        newStep = true;
+        frequency = s_Program.steps[0].frequency;
+    }
+    // 循环停顿跨过的步只取其频率
+    while(elapsedMs >= s_Program.stepEndMs){
+        s_Program.stepIdx++;
+        s_Program.stepEndMs += s_Program.steps[s_Program.stepIdx].duration_s * 1000u;
+        if(s_Program.steps[s_Program.stepIdx].frequency != 0){
+            frequency = s_Program.steps[s_Program.stepIdx].frequency;
+        }
+        newStep = true;
+    }
+
+    pStep = &s_Program.steps[s_Program.stepIdx];
+    inStepMs = elapsedMs - (s_Program.stepEndMs - pStep->duration_s * 1000u);
+    rampMs = pStep->ramp_s * 1000u;
+    level = pStep->level;
+    if(inStepMs < rampMs){
+        from = (s_Program.stepIdx == 0) ? s_ProgramLimit[module - PROTOCOL_MODULE_ULTRASOUND].levelMin :
+                                          s_Program.steps[s_Program.stepIdx - 1].level;
+        level = (uint8_t)(from + ((int32_t)pStep->level - from) * (int32_t)inStepMs / (int32_t)rampMs);
+    }
+    if(!newStep && level == s_Program.level){
+        return E_PROGRAM_HOLD;
+    }
+    if(newStep){
+        LOG_I("Program: step %d/%d, level %d, freq %d, ramp %d s", s_Program.stepIdx + 1, s_Program.count,
+              pStep->level, pStep->frequency, pStep->ramp_s);
+    }
+    s_Program.appliedIdx = s_Program.stepIdx;
+    s_Program.level = level;
+    pTarget->level = level;
+    pTarget->frequency = frequency;
+    return E_PROGRAM_APPLY;
+}
+
+void App_Program_Stop(uint8_t module)
+{
+    if(!App_Program_IsRunning(module)){
+        return;
+    }
+    s_Program.eState = E_PROGRAM_STATE_LOADED;
+    LOG_I("Program: stopped at step %d/%d, %d ms delivered", s_Program.stepIdx + 1, s_Program.count,
+          s_Program.elapsedMs);
+}
+
+void App_Program_GetProgress(uint8_t module, uint8_t *pStep, uint16_t *pStepRemain)
+{
+    uint32_t remainMs = 0;
+
+    *pStep = 0;
+    if(App_Program_IsRunning(module)){
+        *pStep = s_Program.stepIdx + 1u;
+        if(s_Program.elapsedMs < s_Program.stepEndMs){
+            remainMs = s_Program.stepEndMs - s_Program.elapsedMs;
+        }
+    }
+    *pStepRemain = (uint16_t)((remainMs + 999u) / 1000u);
+}
+
+/**************************End of file********************************/
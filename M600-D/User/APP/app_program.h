@@ -0,0 +1,75 @@
+/************************************************************************************
+* @file     : app_program.h
+* @brief    : On-device treatment programs
+* @details  : 上位机一次下发 (时长, 档位, 频率, 斜坡) 步骤序列，设备按已输出时长
+*             自行切换档位/频率并在状态回复中上报进度，治疗中无需再发指令。
+*             同一时刻只保存一个程序（属于某一模式），下发后对该模式每次启动都有效，
+*             下发0步清除。步边界由会话已输出时长求得，循环抖动不累积。
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_PROGRAM_H
+#define APP_PROGRAM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#define PROGRAM_STEP_MAX            16      ///< 每个程序最多步数
+#define PROGRAM_STEP_LEN            6       ///< 每步字节数：duration(2) level(1) frequency(2) ramp(1)
+#define PROGRAM_TIME_MAX_S          3600    ///< 程序总时长上限 (s)，与单次治疗时长一致
+
+/* 一步：frequency为0保持当前频率；ramp_s内档位由上一步线性过渡到本步 */
+typedef struct
+{
+    uint16_t duration_s;
+    uint16_t frequency;          ///< 超声/射频kHz，冲击波频率档位，负压加热不使用
+    uint8_t level;               ///< 工作档位，负压加热为负压大小 (KPa)
+    uint8_t ramp_s;
+} Program_Step_t;
+
+typedef enum
+{
+    E_PROGRAM_STATE_EMPTY = 0,
+    E_PROGRAM_STATE_LOADED,        ///< 已下发，所属模式下次启动时执行
+    E_PROGRAM_STATE_RUNNING,
+    E_PROGRAM_STATE_MAX,
+} Program_State_EnumDef;
+
+typedef enum
+{
+    E_PROGRAM_HOLD = 0,            ///< 输出参数不变
+    E_PROGRAM_APPLY,               ///< 档位或频率变化，按目标值设置
+    E_PROGRAM_END,                 ///< 程序执行完
+} Program_Result_EnumDef;
+
+typedef struct
+{
+    uint8_t level;
+    uint16_t frequency;            ///< 0：保持当前频率（仅在进入新步时非0）
+} Program_Target_t;
+
+/** SET_PROGRAM：count(1) + count*step，校验后应答 result(1) count(1) total_s(2) */
+void App_Program_Upload(uint8_t module, const uint8_t *pData, uint8_t len);
+/** 该模式有程序（已下发或执行中），工作时间/档位由程序给出 */
+bool App_Program_IsArmed(uint8_t module);
+/** 开始执行，返回程序总时长 (ms) */
+uint32_t App_Program_Start(uint8_t module);
+/** 按已输出时长 (ms) 求当前目标，elapsedMs须单调 */
+Program_Result_EnumDef App_Program_Process(uint8_t module, uint32_t elapsedMs, Program_Target_t *pTarget);
+/** 输出停止，程序保留供下次启动 */
+void App_Program_Stop(uint8_t module);
+/** 执行进度：step为当前步 (1起)，未执行时为0；stepRemain为本步剩余秒数 */
+void App_Program_GetProgress(uint8_t module, uint8_t *pStep, uint16_t *pStepRemain);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_PROGRAM_H
+/**************************End of file********************************/
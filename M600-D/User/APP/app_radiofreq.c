@@ -7,6 +7,7 @@
 * @version  : V1.0.0
 * @copyright: Copyright (c) 2050
 **********************************************************************************/
+#define LOG_DOMAIN  LOG_DOMAIN_RF
 #include "app_radiofreq.h"
 #include "app_treatmgr.h"
 #include "app_memory.h"
@@ -14,9 +15,14 @@
 #include "drv_iodevice.h"
 #include "drv_dac.h"
 #include "drv_adc.h"
+#include "drv_scope.h"
 #include "log.h"
 #include "drv_si5351.h"
 #include "drv_delay.h"
+#include "drv_protect.h"
+#include "drv_meter.h"
+#include "drv_probeid.h"
+#include "app_program.h"
 #include <string.h>
 
 static RF_CtrlInfo_t s_RFCtrlInfo;
@@ -39,40 +45,42 @@ static uint16_t App_RadioFreq_CalculateVoltage(uint8_t level)
     return RF_VOLTAGE_MIN_MV + ((level - 1) * (RF_VOLTAGE_MAX_MV - RF_VOLTAGE_MIN_MV)) / (RF_WORK_LEVEL_MAX - 1);
 }
 
-void App_RadioFreq_UpdateStatus(void)
+#define RF_PUBLISH_U8(field, value)     App_Comm_PublishStatusU8(PROTOCOL_MODULE_RADIO_FREQ, \
+                                            APP_COMM_STATUS_OFFSET(RF_GetStatus_Reply_t, field), (value))
+#define RF_PUBLISH_U16(field, value)    App_Comm_PublishStatusU16(PROTOCOL_MODULE_RADIO_FREQ, \
+                                            APP_COMM_STATUS_OFFSET(RF_GetStatus_Reply_t, field), (value))
+#define RF_PUBLISH_U32(field, value)    App_Comm_PublishStatusU32(PROTOCOL_MODULE_RADIO_FREQ, \
+                                            APP_COMM_STATUS_OFFSET(RF_GetStatus_Reply_t, field), (value))
+
+/**
+ * @brief 实测输出功率（0.1W），电压取DAC设定值、电流取RF_I同步采样
+ */
+static uint16_t App_RadioFreq_GetPowerDeciW(void)
 {
-    // Update work state
-    if(s_RFCtrlInfo.runState == E_RF_RUN_WORKING) {
-        s_RFCtrlInfo.Trans.TxStatus.work_state = 0x01;
-    } else if(s_RFCtrlInfo.runState == E_RF_RUN_STOP) {
-        s_RFCtrlInfo.Trans.TxStatus.work_state = 0x00;
-    }
-    s_RFCtrlInfo.Trans.TxStatus.temp_limit = s_RFCtrlInfo.TempLimit;
-    s_RFCtrlInfo.Trans.TxStatus.remain_time = s_RFCtrlInfo.RemainTime;
-    s_RFCtrlInfo.Trans.TxStatus.work_level = s_RFCtrlInfo.WorkLevel;
-    s_RFCtrlInfo.Trans.TxStatus.head_temp = s_RFCtrlInfo.HeadTemp;
-    
-    // Get probe connection status and foot switch state
-    bool headConnected = (s_RFCtrlInfo.probeStatus == E_IODEVICE_MODE_RADIO_FREQUENCY);
-    
-    // Combine connection state: bit[4]=head connection, bit[0]=foot switch
-    if (headConnected && s_RFCtrlInfo.FootSwitchStatus) {
-        s_RFCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_CLOSED;
-    } else if (!headConnected && s_RFCtrlInfo.FootSwitchStatus) {
-        s_RFCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_CLOSED;
-    } else if (headConnected && !s_RFCtrlInfo.FootSwitchStatus) {
-        s_RFCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_OPEN;
-    } else {
-        s_RFCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_OPEN;
-    }
-    s_RFCtrlInfo.Trans.TxStatus.error_code = s_RFCtrlInfo.ErrorCode;
+    uint32_t power = Drv_Meter_GetPowerMw(E_METER_CH_RF) / 100u;
+
+    return (power > 0xFFFFu) ? 0xFFFFu : (uint16_t)power;
+}
+
+static void App_RadioFreq_UpdateStatus(void)
+{
+    RF_PUBLISH_U16(temp_limit, s_RFCtrlInfo.TempLimit);
+    RF_PUBLISH_U16(remain_time, s_RFCtrlInfo.RemainTime);
+    RF_PUBLISH_U8(work_level, s_RFCtrlInfo.WorkLevel);
+    RF_PUBLISH_U16(head_temp, s_RFCtrlInfo.HeadTemp);
+    RF_PUBLISH_U16(deliver_time, App_Session_GetDeliveredSec(&s_RFCtrlInfo.Session));
+    RF_PUBLISH_U16(power, App_RadioFreq_GetPowerDeciW());
+    RF_PUBLISH_U32(energy, App_Session_GetEnergyMj(&s_RFCtrlInfo.Session));
 }
 
-void App_RadioFreq_RxDataHandle(void)
+static void App_RadioFreq_RxDataHandle(void)
 {
-    RF_TransData_t *pTransData = App_Comm_GetRFTransData();
+    RF_TransData_t *pTransData = &s_RFCtrlInfo.Trans;
     
-    if(pTransData->RxWorkState.work_state == WORK_STATE_RESET)
+    // 仅在收到新指令时处理，避免同一条复位指令被重复执行
+    if(App_Comm_FetchRx(PROTOCOL_MODULE_RADIO_FREQ, PROTOCOL_CMD_SET_WORK_STATE, &pTransData->RxWorkState,
+                        sizeof(pTransData->RxWorkState), &s_RFCtrlInfo.RxWorkStateVer) &&
+       pTransData->RxWorkState.work_state == WORK_STATE_RESET)
     {
         // 处理复位功能
         // 重置治疗时间和治疗档位
@@ -93,98 +101,51 @@ void App_RadioFreq_RxDataHandle(void)
     }
     
     // 处理配置更新
-    if(pTransData->flag.bits.Rely_Config)
+    if(App_Comm_FetchRx(PROTOCOL_MODULE_RADIO_FREQ, PROTOCOL_CMD_SET_CONFIG, &pTransData->RxConfig,
+                        sizeof(pTransData->RxConfig), &s_RFCtrlInfo.RxConfigVer))
     {
         s_RFCtrlInfo.TempLimit = pTransData->RxConfig.temp_limit;
         // 保存到存储器
         s_RFCtrlInfo.TreatParams.TempLimit = s_RFCtrlInfo.TempLimit;
         App_Memory_SaveRFParams(&s_RFCtrlInfo.TreatParams);
-        pTransData->flag.bits.Rely_Config = 0;
         LOG_I("RF Config updated: temp_limit=%d", s_RFCtrlInfo.TempLimit);
     }
 }
 
-void App_RadioFreq_ChangeState(RF_RunState_EnumDef newState)
-{
-    if(newState != s_RFCtrlInfo.runState && newState < E_RF_RUN_MAX)
-    {
-        s_RFCtrlInfo.runState = newState;
-        switch(newState)
-        {
-            case E_RF_RUN_INIT:
-                LOG_I("RF state changed to INIT");
-                break;
-            case E_RF_RUN_IDLE:
-                LOG_I("RF state changed to IDLE");
-                break;
-            case E_RF_RUN_WORKING:
-                LOG_I("RF state changed to WORKING");
-                // 启动工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            case E_RF_RUN_STOP:
-                LOG_I("RF state changed to STOP");
-                // 结束工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            default:
-                break;
-        }
-    }
-}
-
-void App_RadioFreq_Monitor(void)
-{
-    // Get the foot switch status and probe status
-    s_RFCtrlInfo.FootSwitchStatus = Drv_IODevice_GetFootSwitchState();
-    
-    // Get the probe status
-    s_RFCtrlInfo.probeStatus = Drv_IODevice_GetProbeStatus();
-}
-
-bool App_RadioFreq_StartCheck()
+/**
+ * @brief 射频特有启动条件（脚踏、治疗头由引擎检查）
+ */
+static bool App_RadioFreq_CheckRequest(void)
 {
-    RF_TransData_t *pTransData = App_Comm_GetRFTransData();
+    RF_TransData_t *pTransData = &s_RFCtrlInfo.Trans;
+    // 已下发治疗程序时，时间和档位由程序给出（下发时已校验）
+    bool program = App_Program_IsArmed(PROTOCOL_MODULE_RADIO_FREQ);
     
     // 1. 检查下位机是否下发了发射射频指令
     if(pTransData->RxWorkState.work_state != WORK_STATE_START) {
         LOG_E("RF: Work state is not start");
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 2. 检查剩余工作时间是否大于0（0-3600s）
-    if(pTransData->RxWorkState.work_time == 0 || pTransData->RxWorkState.work_time > 3600) {
+    if(!program && (pTransData->RxWorkState.work_time == 0 || pTransData->RxWorkState.work_time > 3600)) {
         LOG_E("RF: Invalid work time: %d", pTransData->RxWorkState.work_time);
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 3. 检查工作档位是否不等于0（0-20）
-    if(pTransData->RxWorkState.work_level == 0 || pTransData->RxWorkState.work_level > RF_WORK_LEVEL_MAX) {
+    if(!program && (pTransData->RxWorkState.work_level == 0 || pTransData->RxWorkState.work_level > RF_WORK_LEVEL_MAX)) {
         LOG_E("RF: Invalid work level: %d (range: 1-%d)", pTransData->RxWorkState.work_level, RF_WORK_LEVEL_MAX);
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
         return false;
     }
     
-    // 4. 检查脚踏开关是否闭合
-    if(s_RFCtrlInfo.FootSwitchStatus == false) {
-        LOG_E("RF: Foot switch is not closed");
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
-        return false;
-    }
-    
-    // 5. 检查是否正确识别到射频治疗头
-    if(s_RFCtrlInfo.probeStatus != E_IODEVICE_MODE_RADIO_FREQUENCY) {
-        LOG_E("RF: Radio frequency probe not connected");
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_PROBE_NOT_CONNECTED;
-        return false;
-    }
-    
-    // 6. 检查是否有剩余可治疗次数
+    // 4. 检查是否有剩余可治疗次数
     if(s_RFCtrlInfo.TreatTimes == 0) {
         LOG_E("RF: No remaining treat times");
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_INVALID_PARAMS;
         return false;
     }
     
@@ -194,22 +155,34 @@ bool App_RadioFreq_StartCheck()
 
 void App_RadioFreq_SetWorkParams(void)
 {
-    RF_TransData_t *pTransData = App_Comm_GetRFTransData();
+    RF_TransData_t *pTransData = &s_RFCtrlInfo.Trans;
+    const ProbeId_Info_t *pProbe = Drv_ProbeId_Get();
     
     // 设置工作参数
     s_RFCtrlInfo.WorkLevel = pTransData->RxWorkState.work_level;
     s_RFCtrlInfo.RemainTime = pTransData->RxWorkState.work_time;
+    App_Session_Start(&s_RFCtrlInfo.Session, E_TREATMGR_STATE_RADIO_FREQUENCY, s_RFCtrlInfo.RemainTime);
+    
+    // 探头标定的温度上限更严时以探头为准
+    s_RFCtrlInfo.TempLimit = s_RFCtrlInfo.TreatParams.TempLimit;
+    if(pProbe != NULL && pProbe->rfTempLimit != 0 && pProbe->rfTempLimit < s_RFCtrlInfo.TempLimit)
+    {
+        s_RFCtrlInfo.TempLimit = pProbe->rfTempLimit;
+    }
     
     // 计算目标工作电压（根据档位）
     s_RFCtrlInfo.VoltageTarget = App_RadioFreq_CalculateVoltage(s_RFCtrlInfo.WorkLevel);
+    App_Thermal_Start(&s_RFCtrlInfo.Thermal, s_RFCtrlInfo.HeadTemp);
     
-    // 设置初始工作电压为7V
+    // 设置初始工作电压为7V（斜坡软启动）
     s_RFCtrlInfo.Voltage = RF_VOLTAGE_INIT_MV;
-    Drv_DAC_SetVoltage(s_RFCtrlInfo.Voltage);
+    Drv_DAC_RampTo(s_RFCtrlInfo.Voltage, RF_DAC_RAMP_SLOPE_MV_PER_MS, E_DAC_EASE_SCURVE, NULL);
     
-    // 配置SI5351输出1MHz互补PWM（带死区时间）
-    // 死区时间根据实际需求设置，例如100ns
-    Drv_SI5351_SetComplementaryPWM(RF_FREQUENCY_KHZ, 100);
+    // SI5351 CLK1经TIM1 ETR产生1MHz互补PWM（带死区时间）
+    if(!Drv_SI5351_SetComplementaryPWM(RF_FREQUENCY_KHZ, RF_DEADTIME_NS))
+    {
+        LOG_E("RF: SI5351 not responding, drive stays off");
+    }
     
     // 切换继电器pwr_control1至射频通道
     Drv_IODevice_ChangeChannel(CHANNEL_READY);
@@ -221,52 +194,92 @@ void App_RadioFreq_SetWorkParams(void)
           s_RFCtrlInfo.WorkLevel, s_RFCtrlInfo.RemainTime, s_RFCtrlInfo.VoltageTarget);
 }
 
+/**
+ * @brief 热降额后的工作电压：功率与电压平方成正比，电压按sqrt(降额系数)下调
+ */
+static uint16_t App_RadioFreq_GetDeratedVoltage(void)
+{
+    uint32_t voltage = s_RFCtrlInfo.VoltageTarget;
+
+    if(s_RFCtrlInfo.Thermal.scale != 0 && s_RFCtrlInfo.Thermal.scale < THERMAL_SCALE_FULL)
+    {
+        voltage = voltage * App_Thermal_SqrtScale(s_RFCtrlInfo.Thermal.scale) / THERMAL_SCALE_FULL;
+        voltage -= voltage % RF_DERATE_STEP_MV;
+        if(voltage < RF_VOLTAGE_INIT_MV)
+        {
+            voltage = RF_VOLTAGE_INIT_MV;
+        }
+    }
+    return (uint16_t)voltage;
+}
+
+/**
+ * @brief 输出电压对应的功率（千分比，相对最高电压）
+ */
+static uint16_t App_RadioFreq_PowerPermille(uint16_t voltage)
+{
+    return (uint16_t)((uint32_t)voltage * voltage /
+                      ((uint32_t)RF_VOLTAGE_MAX_MV * RF_VOLTAGE_MAX_MV / THERMAL_SCALE_FULL));
+}
+
+/**
+ * @brief DAC实际输出的设定值：超出DAC量程的目标被夹到量程上限，与Drv_DAC_GetVoltage()比较需用此值
+ */
+static uint16_t App_RadioFreq_DacVoltage(uint16_t voltage)
+{
+    return (voltage > DAC_OUTPUT_MAX_MV) ? (uint16_t)DAC_OUTPUT_MAX_MV : voltage;
+}
+
 bool App_RadioFreq_IsCurrentNormal(void)
 {
     uint16_t current = Drv_ADC_GetRealValue(E_ADC_CHANNEL_RF_I);
     uint16_t currentVoltage = Drv_DAC_GetVoltage();
+    uint16_t initVoltage = App_RadioFreq_DacVoltage(RF_VOLTAGE_INIT_MV);
+    uint16_t targetVoltage = App_RadioFreq_DacVoltage(App_RadioFreq_GetDeratedVoltage());
     uint16_t newVoltage = currentVoltage;
     bool isNormal = true;
     
     if(current < RF_CURRENT_THRESHOLD_MV)
     {
         // 射频电流低于0.5V，工作电压维持在7V
-        if(currentVoltage != RF_VOLTAGE_INIT_MV)
+        if(currentVoltage != initVoltage)
         {
-            newVoltage = RF_VOLTAGE_INIT_MV;
-            Drv_DAC_SetVoltage(newVoltage);
+            newVoltage = initVoltage;
+            Drv_DAC_RampTo(newVoltage, RF_DAC_RAMP_SLOPE_MV_PER_MS, E_DAC_EASE_SCURVE, NULL);
             s_RFCtrlInfo.Voltage = newVoltage;
             LOG_I("RF: Current too low (%d mV), voltage set to 7V", current);
         }
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_CURRENT_TOO_LOW;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_CURRENT_TOO_LOW;
         isNormal = false;
     }
     else if(current >= s_RFCtrlInfo.CurrentLow)
     {
-        // 射频电流大于工作电流下限，电压切换至档位对应的工作电压
-        if(currentVoltage != s_RFCtrlInfo.VoltageTarget)
+        // 射频电流大于工作电流下限，电压切换至档位对应的工作电压（热降额时下调）
+        if(currentVoltage != targetVoltage)
         {
-            newVoltage = s_RFCtrlInfo.VoltageTarget;
-            Drv_DAC_SetVoltage(newVoltage);
+            newVoltage = targetVoltage;
+            Drv_DAC_RampTo(newVoltage, RF_DAC_RAMP_SLOPE_MV_PER_MS, E_DAC_EASE_SCURVE, NULL);
             s_RFCtrlInfo.Voltage = newVoltage;
             LOG_I("RF: Current normal (%d mV), voltage set to %d mV (level %d)", 
                   current, newVoltage, s_RFCtrlInfo.WorkLevel);
         }
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_NONE;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_NONE;
     }
     else
     {
         // 电流在工作电流区间以下，自动切换至7V
-        if(currentVoltage != RF_VOLTAGE_INIT_MV)
+        if(currentVoltage != initVoltage)
         {
-            newVoltage = RF_VOLTAGE_INIT_MV;
-            Drv_DAC_SetVoltage(newVoltage);
+            newVoltage = initVoltage;
+            Drv_DAC_RampTo(newVoltage, RF_DAC_RAMP_SLOPE_MV_PER_MS, E_DAC_EASE_SCURVE, NULL);
             s_RFCtrlInfo.Voltage = newVoltage;
             LOG_I("RF: Current below range (%d mV), voltage set to 7V", current);
         }
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_CURRENT_TOO_LOW;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_CURRENT_TOO_LOW;
         isNormal = false;
     }
+    Drv_Scope_SetVar(E_SCOPE_SRC_TARGET, targetVoltage);
+    Drv_Scope_SetVar(E_SCOPE_SRC_STATE, s_RFCtrlInfo.Ctx.ErrorCode);
     
     return isNormal;
 }
@@ -281,7 +294,7 @@ bool App_RadioFreq_IsHeadTempNormal(void)
     
     if(s_RFCtrlInfo.HeadTemp > s_RFCtrlInfo.TempLimit)
     {
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_TEMP_TOO_HIGH;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_TEMP_TOO_HIGH;
         LOG_W("RF: Head temperature too high: %d (limit: %d)", 
               s_RFCtrlInfo.HeadTemp, s_RFCtrlInfo.TempLimit);
         // 温度超限，自动停止输出
@@ -289,104 +302,140 @@ bool App_RadioFreq_IsHeadTempNormal(void)
     }
     else
     {
-        s_RFCtrlInfo.ErrorCode = E_RF_ERROR_NONE;
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_NONE;
     }
     
     return isNormal;
 }
 
-void App_RadioFreq_Process(void)
+uint16_t App_RadioFreq_GetOutputPermille(void)
 {
-    static Drv_Timer_t CurrentMonitorTimer;
-    static Drv_Timer_t TempMonitorTimer;
-    
-    // Process the radio frequency module
-    App_RadioFreq_UpdateStatus();
-    App_RadioFreq_RxDataHandle();
-    App_RadioFreq_Monitor();
-
-    // Handle the radio frequency state
-    switch(s_RFCtrlInfo.runState)
+    if(s_RFCtrlInfo.Ctx.runState != E_TREAT_RUN_WORKING)
     {
-        case E_RF_RUN_INIT:
-            // 加载射频参数
-            if(App_Memory_LoadRFParams(&s_RFCtrlInfo.TreatParams)) {
-                s_RFCtrlInfo.TempLimit = s_RFCtrlInfo.TreatParams.TempLimit;
-                s_RFCtrlInfo.TreatTimes = s_RFCtrlInfo.TreatParams.RemainTimes;
-                s_RFCtrlInfo.CurrentHigh = s_RFCtrlInfo.TreatParams.CurrentHigh;
-                s_RFCtrlInfo.CurrentLow = s_RFCtrlInfo.TreatParams.CurrentLow;
-                
-                // 更新串口配置
-                RF_TransData_t *pTransData = App_Comm_GetRFTransData();
-                pTransData->RxConfig.temp_limit = s_RFCtrlInfo.TempLimit;
-                
-                LOG_I("RF: Parameters loaded - temp_limit=%d, remain_times=%d, current_range=[%d, %d]",
-                      s_RFCtrlInfo.TempLimit, s_RFCtrlInfo.TreatTimes,
-                      s_RFCtrlInfo.CurrentLow, s_RFCtrlInfo.CurrentHigh);
-            } else {
-                LOG_E("RF: Failed to load parameters");
-                s_RFCtrlInfo.ErrorCode = E_RF_ERROR_READ_PARAMS_FAILED;
-            }
-            App_RadioFreq_ChangeState(E_RF_RUN_IDLE);
-            break;
-            
-        case E_RF_RUN_IDLE:
-            // 使用App_RadioFreq_StartCheck进行启动前检查
-            if(App_RadioFreq_StartCheck()) {
-                // 设置工作参数并启动射频发射
-                App_RadioFreq_SetWorkParams();
+        return 0;
+    }
+    return App_RadioFreq_PowerPermille(Drv_DAC_GetVoltage());
+}
 
-                // pwr_control2切换至可输出（平常为不可输出）
-                Drv_IODevice_ChangeChannel(CHANNEL_RF);
-                App_RadioFreq_ChangeState(E_RF_RUN_WORKING);
-            }
-            break;
-            
-        case E_RF_RUN_WORKING:
-            // 检查所有条件
-            if(App_RadioFreq_StartCheck() == false || 
-               s_RFCtrlInfo.RemainTime == 0){
-                App_RadioFreq_ChangeState(E_RF_RUN_STOP);
-            } else {
-                // 电流监控（10ms周期）
-                if(Drv_Timer_Tick(&CurrentMonitorTimer, RF_CURRENT_MONITOR_PERIOD_MS)) {
-                    if(App_RadioFreq_IsCurrentNormal() == false) {
-                        // 电流异常，但不立即停止，继续监控
-                    }
-                }
-                
-                // 温度监控（1s周期）
-                if(Drv_Timer_Tick(&TempMonitorTimer, RF_TEMP_MONITOR_PERIOD_MS)) {
-                    if(App_RadioFreq_IsHeadTempNormal() == false) {
-                        // 温度超限，停止输出
-                        App_RadioFreq_ChangeState(E_RF_RUN_STOP);
-                    }
-                }
-                
-                // 更新时间
-                if(s_RFCtrlInfo.RemainTime >= TREAT_TASK_TIME) {
-                    s_RFCtrlInfo.RemainTime -= TREAT_TASK_TIME;
-                } else {
-                    s_RFCtrlInfo.RemainTime = 0;
-                }
-            }
-            break;
-            
-        case E_RF_RUN_STOP:
-            // 关闭输出通道
-            Drv_IODevice_ChangeChannel(CHANNEL_CLOSE);
-            // 停止DAC输出
-            Drv_DAC_SetVoltage(0);
-            // CTR_HEAT_HP恢复为低电平
-            Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HEAT_HP, 0);
-            App_TreatMgr_ChangeState(E_TREATMGR_STATE_IDLE);
-            break;
-            
-        default:
-            break;
+/**
+ * @brief 热降额：按模型预测的功率上限下调工作电压，由电流环斜坡至新电压
+ * @note HeadTemp待治疗头串口温度接入后生效，此前温升恒为0不降额
+ */
+static bool App_RadioFreq_Derate(void)
+{
+    App_Thermal_Update(&s_RFCtrlInfo.Thermal, s_RFCtrlInfo.HeadTemp, s_RFCtrlInfo.TempLimit,
+                       App_RadioFreq_GetOutputPermille(),
+                       App_RadioFreq_PowerPermille(s_RFCtrlInfo.VoltageTarget));
+    return true;
+}
+
+static void App_RadioFreq_LoadParams(void)
+{
+    // 加载射频参数
+    if(App_Memory_LoadRFParams(&s_RFCtrlInfo.TreatParams)) {
+        s_RFCtrlInfo.TempLimit = s_RFCtrlInfo.TreatParams.TempLimit;
+        s_RFCtrlInfo.TreatTimes = s_RFCtrlInfo.TreatParams.RemainTimes;
+        s_RFCtrlInfo.CurrentHigh = s_RFCtrlInfo.TreatParams.CurrentHigh;
+        s_RFCtrlInfo.CurrentLow = s_RFCtrlInfo.TreatParams.CurrentLow;
+        
+        // 同步本地配置快照
+        s_RFCtrlInfo.Trans.RxConfig.temp_limit = s_RFCtrlInfo.TempLimit;
+        
+        LOG_I("RF: Parameters loaded - temp_limit=%d, remain_times=%d, current_range=[%d, %d]",
+              s_RFCtrlInfo.TempLimit, s_RFCtrlInfo.TreatTimes,
+              s_RFCtrlInfo.CurrentLow, s_RFCtrlInfo.CurrentHigh);
+    } else {
+        LOG_E("RF: Failed to load parameters");
+        s_RFCtrlInfo.Ctx.ErrorCode = E_RF_ERROR_READ_PARAMS_FAILED;
     }
 }
 
+static uint16_t App_RadioFreq_ProtectLimit(void)
+{
+    // 硬件过流保护：ADC看门狗阈值取工作电流上限
+    return s_RFCtrlInfo.CurrentHigh;
+}
+
+static bool App_RadioFreq_WorkCheck(void)
+{
+    // 更新时间（按SysTick时间戳换算，不受循环周期影响）
+    s_RFCtrlInfo.RemainTime = App_Session_GetRemainSec(&s_RFCtrlInfo.Session);
+    return s_RFCtrlInfo.RemainTime != 0;
+}
+
+/**
+ * @brief 治疗程序换档：电流环在下一周期把输出电压斜坡至新目标；换频由SI5351平滑调谐
+ */
+static void App_RadioFreq_ApplyStep(uint8_t level, uint16_t frequency)
+{
+    s_RFCtrlInfo.WorkLevel = level;
+    s_RFCtrlInfo.VoltageTarget = App_RadioFreq_CalculateVoltage(level);
+    if(frequency != 0 && !Drv_SI5351_SetComplementaryPWM(frequency, RF_DEADTIME_NS))
+    {
+        LOG_E("RF: Program frequency %d kHz not applied", frequency);
+    }
+}
+
+static void App_RadioFreq_Stop(void)
+{
+    // 停止DAC输出
+    Drv_DAC_SetVoltage(0);
+    // 互补输出回到空闲低电平，关闭CLK1
+    Drv_SI5351_StopComplementaryPWM();
+    // CTR_HEAT_HP恢复为低电平
+    Drv_IODevice_WritePin(E_GPIO_OUT_CTR_HEAT_HP, 0);
+}
+
+/* 电流异常只报警继续监控，温度超限停止输出，热降额在此之前下调电压 */
+static const TreatModule_Loop_t s_RFLoops[] =
+{
+    { RF_CURRENT_MONITOR_PERIOD_MS, false, App_RadioFreq_IsCurrentNormal },
+    { RF_TEMP_MONITOR_PERIOD_MS,    true,  App_RadioFreq_IsHeadTempNormal },
+    { THERMAL_PERIOD_MS,            false, App_RadioFreq_Derate },
+};
+
+static const TreatModule_Desc_t s_RFModule =
+{
+    .pName = "RF",
+    .logDomain = LOG_DOMAIN_RF,
+    .pCtx = &s_RFCtrlInfo.Ctx,
+    .pSession = &s_RFCtrlInfo.Session,
+    .probe = E_IODEVICE_MODE_RADIO_FREQUENCY,
+    .channel = CHANNEL_RF,
+    .protectChannel = E_ADC_CHANNEL_RF_I,
+    .errProbe = E_RF_ERROR_PROBE_NOT_CONNECTED,
+    .errInvalid = E_RF_ERROR_INVALID_PARAMS,
+    .errOverCurrent = E_RF_ERROR_OVER_CURRENT,
+    .commModule = PROTOCOL_MODULE_RADIO_FREQ,
+    .workStateOffset = offsetof(RF_GetStatus_Reply_t, work_state),
+    .connStateOffset = offsetof(RF_GetStatus_Reply_t, conn_state),
+    .errorCodeOffset = offsetof(RF_GetStatus_Reply_t, error_code),
+    .programStepOffset = offsetof(RF_GetStatus_Reply_t, program_step),
+    .stepRemainOffset = offsetof(RF_GetStatus_Reply_t, step_remain),
+    .pfLoadParams = App_RadioFreq_LoadParams,
+    .pfUpdateStatus = App_RadioFreq_UpdateStatus,
+    .pfRxDataHandle = App_RadioFreq_RxDataHandle,
+    .pfStartCheck = App_RadioFreq_CheckRequest,
+    .pfSetWorkParams = App_RadioFreq_SetWorkParams,
+    .pfPrepare = NULL,
+    .pfProtectLimit = App_RadioFreq_ProtectLimit,
+    .pfWorkCheck = App_RadioFreq_WorkCheck,
+    .pfApplyStep = App_RadioFreq_ApplyStep,
+    .pfStop = App_RadioFreq_Stop,
+    .pLoops = s_RFLoops,
+    .loopNum = sizeof(s_RFLoops) / sizeof(s_RFLoops[0]),
+};
+
+bool App_RadioFreq_StartCheck(void)
+{
+    return App_TreatModule_StartCheck(&s_RFModule);
+}
+
+void App_RadioFreq_Process(void)
+{
+    App_TreatModule_Process(&s_RFModule);
+}
+
 /**
  * @brief Initialize radio frequency module
  */
@@ -396,8 +445,7 @@ void App_RadioFreq_Init(void)
     memset(&s_RFCtrlInfo, 0, sizeof(RF_CtrlInfo_t));
     
     // 设置初始状态
-    s_RFCtrlInfo.runState = E_RF_RUN_INIT;
-    s_RFCtrlInfo.ErrorCode = E_RF_ERROR_NONE;
+    App_TreatModule_Init(&s_RFModule);
     s_RFCtrlInfo.WorkLevel = 0;
     s_RFCtrlInfo.RemainTime = 0;
     s_RFCtrlInfo.TreatTimes = 0;
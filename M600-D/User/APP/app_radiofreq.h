@@ -22,9 +22,13 @@ extern "C" {
 #include "app_comm.h"
 #include "app_memory.h"
 #include "drv_iodevice.h"
+#include "app_session.h"
+#include "app_treatmodule.h"
+#include "app_thermal.h"
 
 /* 射频工作频率固定为1MHz */
 #define RF_FREQUENCY_KHZ           1000        ///< 射频工作频率 (kHz)
+#define RF_DEADTIME_NS             100         ///< 互补输出死区时间 (ns)
 #define RF_WORK_LEVEL_MAX          20          ///< 最大档位 (0-20)
 #define RF_VOLTAGE_MIN_MV          11000       ///< 最小工作电压 (11V = 11000mV)
 #define RF_VOLTAGE_MAX_MV          30000       ///< 最大工作电压 (30V = 30000mV)
@@ -32,19 +36,12 @@ extern "C" {
 #define RF_CURRENT_THRESHOLD_MV    500         ///< 电流阈值 (0.5V = 500mV)
 #define RF_CURRENT_MONITOR_PERIOD_MS   10      ///< 电流监控周期 (10ms)
 #define RF_TEMP_MONITOR_PERIOD_MS      1000    ///< 温度监控周期 (1s)
+#define RF_DAC_RAMP_SLOPE_MV_PER_MS    10      ///< 电压切换斜率 (mV/ms)，避免阶跃冲击输出级
+#define RF_DERATE_STEP_MV          500         ///< 热降额电压量化步长 (mV)，避免频繁斜坡
 
 /* 档位到电压的映射：1-20档位对应11-30V */
 #define RF_VOLTAGE_PER_LEVEL_MV    ((RF_VOLTAGE_MAX_MV - RF_VOLTAGE_MIN_MV) / RF_WORK_LEVEL_MAX)
 
-typedef enum
-{
-    E_RF_RUN_INIT = 0,
-    E_RF_RUN_IDLE,
-    E_RF_RUN_WORKING,
-    E_RF_RUN_STOP,
-    E_RF_RUN_MAX,
-} RF_RunState_EnumDef;
-
 typedef enum {
     E_RF_ERROR_NONE = 0,
     E_RF_ERROR_PROBE_NOT_CONNECTED,
@@ -52,12 +49,13 @@ typedef enum {
     E_RF_ERROR_INVALID_PARAMS,
     E_RF_ERROR_CURRENT_TOO_LOW,
     E_RF_ERROR_TEMP_TOO_HIGH,
+    E_RF_ERROR_OVER_CURRENT,
     E_RF_ERROR_MAX,
 } RF_ErrorCode_EnumDef;
 
 typedef struct
 {
-    RF_RunState_EnumDef runState;
+    TreatModule_Ctx_t Ctx;         ///< 引擎运行状态（状态、错误码、脚踏、治疗头）
     uint16_t Voltage;              ///< 当前工作电压 (mV)
     uint16_t VoltageTarget;        ///< 目标工作电压 (mV)，根据档位计算
     uint16_t CurrentHigh;         ///< 工作电流上限 (mV)
@@ -67,15 +65,14 @@ typedef struct
     
     uint8_t WorkLevel;             ///< 工作档位 (0-20)
     uint16_t HeadTemp;             ///< 治疗头温度 (0.1°C)
-    uint16_t RemainTime;           ///< 剩余工作时间 (秒)
-    
-    uint8_t ConnState;
-    uint8_t ErrorCode;
-    bool FootSwitchStatus;
-    IODevice_WorkingMode_EnumDef probeStatus;
+    uint16_t RemainTime;           ///< 剩余工作时间 (秒)，由Session换算
+    App_Session_t Session;         ///< 治疗计时
     
     RF_TreatParams_t TreatParams;
-    RF_TransData_t Trans;
+    RF_TransData_t Trans;                ///< 本模式收发快照
+    uint32_t RxWorkStateVer;       ///< 已处理的工作状态指令版本
+    uint32_t RxConfigVer;   ///< 已处理的配置指令版本
+    App_Thermal_t Thermal;         ///< 热降额模型
     
     /* 监控定时器 */
     uint32_t lastCurrentMonitorTime;   ///< 上次电流监控时间
@@ -86,6 +83,8 @@ void App_RadioFreq_Init(void);
 void App_RadioFreq_Process(void);
 bool App_RadioFreq_StartCheck(void);
 void App_RadioFreq_SetWorkParams(void);
+/** 输出中的功率（千分比，相对最高电压），未输出为0 */
+uint16_t App_RadioFreq_GetOutputPermille(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,276 @@
+/***********************************************************************************
+* @file     : app_session.c
+* @brief    : Treatment session clock implementation
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#include "app_session.h"
+#include "drv_delay.h"
+#include "drv_meter.h"
+#include "app_usage.h"
+#include "log.h"
+
+/* 各治疗模式累计输出时长 (ms)，上电清零 */
+static uint32_t s_SessionModeTotalMs[E_TREATMGR_STATE_MAX];
+
+/* 当前输出中的会话（同一时刻只有一个模式输出），电源预警时结算 */
+static App_Session_t *s_pSessionRunning = NULL;
+
+/* 各治疗模式对应的能量计通道，无电压/电流采样对的模式不计量 */
+static const uint8_t s_SessionMeter[E_TREATMGR_STATE_MAX] =
+{
+    E_METER_CH_MAX,     // IDLE
+    E_METER_CH_RF,      // RADIO_FREQUENCY
+    E_METER_CH_ESW,     // SHOCK_WAVE
+    E_METER_CH_MAX,     // NEGATIVE_PRESSURE_HEAT
+    E_METER_CH_MAX,     // ULTRASOUND
+    E_METER_CH_MAX,     // ERROR
+};
+
+static uint32_t App_Session_ReadMeter(const App_Session_t *pSession)
+{
+    return Drv_Meter_GetEnergyMj((Meter_Channel_EnumDef)pSession->meter);
+}
+
+/**
+ * @brief Time since the segment start plus a sub-ms remainder
+ * @param pSession Session
+ * @param nowMs Current tick (ms)
+ * @param nowUs Microseconds into nowMs
+ * @param remUs Remainder carried by the counter (us)
+ * @param pUs Remainder after the whole ms (us)
+ * @return Whole ms
+ */
+static uint32_t App_Session_Since(const App_Session_t *pSession, uint32_t nowMs, uint16_t nowUs,
+                                  uint16_t remUs, uint16_t *pUs)
+{
+    uint32_t ms = nowMs - pSession->segStartMs;
+    uint32_t us = (uint32_t)nowUs + remUs + 1000u - pSession->segStartUs;
+
+    // us为0..2998，借位的1ms在这里还回去
+    ms = ms - 1u + us / 1000u;
+    *pUs = (uint16_t)(us % 1000u);
+    return ms;
+}
+
+/**
+ * @brief Close the current segment into the energised/paused counters
+ * @param pSession Session
+ * @param nowMs Current tick (ms)
+ * @param nowUs Microseconds into nowMs
+ */
+static void App_Session_CloseSegment(App_Session_t *pSession, uint32_t nowMs, uint16_t nowUs)
+{
+    uint32_t meterMj = App_Session_ReadMeter(pSession);
+    uint32_t elapsed;
+
+    if(pSession->state == E_SESSION_STATE_RUNNING) {
+        elapsed = App_Session_Since(pSession, nowMs, nowUs, pSession->energisedUs, &pSession->energisedUs);
+        pSession->energisedMs += elapsed;
+        pSession->energyMj += meterMj - pSession->segStartMj;
+        if(pSession->mode < E_TREATMGR_STATE_MAX) {
+            s_SessionModeTotalMs[pSession->mode] += elapsed;
+        }
+        App_Usage_AddEnergisedMs(elapsed);
+    } else if(pSession->state == E_SESSION_STATE_PAUSED) {
+        pSession->pausedMs += App_Session_Since(pSession, nowMs, nowUs, pSession->pausedUs, &pSession->pausedUs);
+    }
+    pSession->segStartMs = nowMs;
+    pSession->segStartUs = nowUs;
+    pSession->segStartMj = meterMj;
+}
+
+/**
+ * @brief Close the current segment at the current time
+ */
+static void App_Session_CloseSegmentNow(App_Session_t *pSession)
+{
+    uint16_t us;
+    uint32_t ms = Drv_Delay_GetTickFineMs(&us);
+
+    App_Session_CloseSegment(pSession, ms, us);
+}
+
+/**
+ * @brief Arm a new session; it stays paused until App_Session_Resume
+ * @param pSession Session
+ * @param mode Owning treatment mode
+ * @param budget_s Treatment time (s)
+ */
+void App_Session_Start(App_Session_t *pSession, TreatMgr_State_EnumDef mode, uint16_t budget_s)
+{
+    if(pSession == NULL) {
+        return;
+    }
+    // 未正常结束的上一次会话先结算
+    App_Session_Stop(pSession);
+
+    pSession->mode = mode;
+    pSession->meter = (mode < E_TREATMGR_STATE_MAX) ? s_SessionMeter[mode] : E_METER_CH_MAX;
+    pSession->budgetMs = (uint32_t)budget_s * 1000u;
+    pSession->energisedMs = 0;
+    pSession->pausedMs = 0;
+    pSession->energisedUs = 0;
+    pSession->pausedUs = 0;
+    pSession->energyMj = 0;
+    pSession->segStartMs = Drv_Delay_GetTickFineMs(&pSession->segStartUs);
+    pSession->segStartMj = App_Session_ReadMeter(pSession);
+    pSession->state = E_SESSION_STATE_PAUSED;
+}
+
+/**
+ * @brief Start counting energised time
+ */
+void App_Session_Resume(App_Session_t *pSession)
+{
+    if(pSession == NULL || pSession->state != E_SESSION_STATE_PAUSED) {
+        return;
+    }
+    App_Session_CloseSegmentNow(pSession);
+    pSession->state = E_SESSION_STATE_RUNNING;
+    s_pSessionRunning = pSession;
+}
+
+/**
+ * @brief Stop counting energised time, keep the session armed
+ */
+void App_Session_Pause(App_Session_t *pSession)
+{
+    if(pSession == NULL || pSession->state != E_SESSION_STATE_RUNNING) {
+        return;
+    }
+    App_Session_CloseSegmentNow(pSession);
+    pSession->state = E_SESSION_STATE_PAUSED;
+    s_pSessionRunning = NULL;
+}
+
+/**
+ * @brief End the session; counters are kept for status replies
+ */
+void App_Session_Stop(App_Session_t *pSession)
+{
+    if(pSession == NULL || pSession->state == E_SESSION_STATE_IDLE) {
+        return;
+    }
+    App_Session_CloseSegmentNow(pSession);
+    pSession->state = E_SESSION_STATE_IDLE;
+    if(s_pSessionRunning == pSession) {
+        s_pSessionRunning = NULL;
+    }
+    // 有输出的治疗才计入探头使用次数
+    if(pSession->energisedMs != 0) {
+        App_Usage_EndSession();
+    }
+    LOG_I("Session end: mode=%d, delivered=%d ms, paused=%d ms, energy=%d mJ",
+          pSession->mode, pSession->energisedMs, pSession->pausedMs, pSession->energyMj);
+}
+
+/**
+ * @brief Close the running segment without changing state (supply failing)
+ */
+void App_Session_Checkpoint(void)
+{
+    if(s_pSessionRunning != NULL) {
+        App_Session_CloseSegmentNow(s_pSessionRunning);
+    }
+}
+
+/**
+ * @brief Replace the treatment time, e.g. by the length of a treatment program
+ */
+void App_Session_SetBudget(App_Session_t *pSession, uint32_t budgetMs)
+{
+    if(pSession != NULL) {
+        pSession->budgetMs = budgetMs;
+    }
+}
+
+uint32_t App_Session_GetEnergisedMs(const App_Session_t *pSession)
+{
+    uint16_t nowUs, us;
+    uint32_t nowMs;
+
+    if(pSession == NULL) {
+        return 0;
+    }
+    if(pSession->state == E_SESSION_STATE_RUNNING) {
+        nowMs = Drv_Delay_GetTickFineMs(&nowUs);
+        return pSession->energisedMs + App_Session_Since(pSession, nowMs, nowUs, pSession->energisedUs, &us);
+    }
+    return pSession->energisedMs;
+}
+
+uint32_t App_Session_GetPausedMs(const App_Session_t *pSession)
+{
+    uint16_t nowUs, us;
+    uint32_t nowMs;
+
+    if(pSession == NULL) {
+        return 0;
+    }
+    if(pSession->state == E_SESSION_STATE_PAUSED) {
+        nowMs = Drv_Delay_GetTickFineMs(&nowUs);
+        return pSession->pausedMs + App_Session_Since(pSession, nowMs, nowUs, pSession->pausedUs, &us);
+    }
+    return pSession->pausedMs;
+}
+
+uint32_t App_Session_GetRemainMs(const App_Session_t *pSession)
+{
+    uint32_t energised = App_Session_GetEnergisedMs(pSession);
+
+    if(pSession == NULL || energised >= pSession->budgetMs) {
+        return 0;
+    }
+    return pSession->budgetMs - energised;
+}
+
+/**
+ * @brief Remaining time for display, rounded up so 0 means expired
+ */
+uint16_t App_Session_GetRemainSec(const App_Session_t *pSession)
+{
+    return (uint16_t)((App_Session_GetRemainMs(pSession) + 999u) / 1000u);
+}
+
+uint16_t App_Session_GetDeliveredSec(const App_Session_t *pSession)
+{
+    uint32_t sec = App_Session_GetEnergisedMs(pSession) / 1000u;
+
+    return (sec > 0xFFFFu) ? 0xFFFFu : (uint16_t)sec;
+}
+
+/**
+ * @brief Energy delivered while energised (mJ), 0 for modes without a meter
+ */
+uint32_t App_Session_GetEnergyMj(const App_Session_t *pSession)
+{
+    if(pSession == NULL) {
+        return 0;
+    }
+    if(pSession->state == E_SESSION_STATE_RUNNING) {
+        return pSession->energyMj + (App_Session_ReadMeter(pSession) - pSession->segStartMj);
+    }
+    return pSession->energyMj;
+}
+
+bool App_Session_IsExpired(const App_Session_t *pSession)
+{
+    return App_Session_GetRemainMs(pSession) == 0;
+}
+
+/**
+ * @brief Energised time accumulated by a mode since power-up (closed segments)
+ */
+uint32_t App_Session_GetModeTotalMs(TreatMgr_State_EnumDef mode)
+{
+    if(mode >= E_TREATMGR_STATE_MAX) {
+        return 0;
+    }
+    return s_SessionModeTotalMs[mode];
+}
+
+/**************************End of file********************************/
@@ -0,0 +1,74 @@
+/************************************************************************************
+* @file     : app_session.h
+* @brief    : Treatment session clock
+* @details  : 基于SysTick毫秒计数的治疗计时，与主循环周期解耦
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_SESSION_H
+#define APP_SESSION_H
+
+#include <string.h>
+#include <stdbool.h>
+#include "stdint.h"
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#include "app_treatmgr.h"
+
+typedef enum
+{
+    E_SESSION_STATE_IDLE = 0,      ///< 未启动
+    E_SESSION_STATE_RUNNING,       ///< 输出中，计入治疗时间
+    E_SESSION_STATE_PAUSED,        ///< 已启动但未输出（预热、等待）
+    E_SESSION_STATE_MAX,
+} Session_State_EnumDef;
+
+/**
+ * 时间均由时间戳差值求得，不做每周期累减：
+ * 循环超时或抖动只影响刷新时刻，不会累积误差。
+ * 时间戳精确到us，片段切换时不足1ms的部分留在余量里，暂停/恢复多次也不丢。
+ */
+typedef struct
+{
+    TreatMgr_State_EnumDef mode;   ///< 所属治疗模式，用于分模式累计
+    Session_State_EnumDef state;
+    uint32_t budgetMs;             ///< 设定治疗时长 (ms)
+    uint32_t energisedMs;          ///< 已结束片段的输出时长 (ms)
+    uint32_t pausedMs;             ///< 已结束片段的暂停时长 (ms)
+    uint32_t segStartMs;           ///< 当前片段起始时刻 (ms)
+    uint16_t segStartUs;           ///< 当前片段起始时刻的不足1ms部分 (us)
+    uint16_t energisedUs;          ///< 输出时长不足1ms的余量 (us)
+    uint16_t pausedUs;             ///< 暂停时长不足1ms的余量 (us)
+    uint8_t meter;                 ///< 能量计通道 (Meter_Channel_EnumDef)，E_METER_CH_MAX为不计量
+    uint32_t energyMj;             ///< 已结束片段的输出能量 (mJ)
+    uint32_t segStartMj;           ///< 当前片段起始时的能量计读数 (mJ)
+} App_Session_t;
+
+void App_Session_Start(App_Session_t *pSession, TreatMgr_State_EnumDef mode, uint16_t budget_s);
+void App_Session_Resume(App_Session_t *pSession);
+void App_Session_Pause(App_Session_t *pSession);
+void App_Session_Stop(App_Session_t *pSession);
+void App_Session_Checkpoint(void);
+void App_Session_SetBudget(App_Session_t *pSession, uint32_t budgetMs);
+
+uint32_t App_Session_GetEnergisedMs(const App_Session_t *pSession);
+uint32_t App_Session_GetPausedMs(const App_Session_t *pSession);
+uint32_t App_Session_GetRemainMs(const App_Session_t *pSession);
+uint16_t App_Session_GetRemainSec(const App_Session_t *pSession);
+uint16_t App_Session_GetDeliveredSec(const App_Session_t *pSession);
+uint32_t App_Session_GetEnergyMj(const App_Session_t *pSession);
+bool App_Session_IsExpired(const App_Session_t *pSession);
+
+uint32_t App_Session_GetModeTotalMs(TreatMgr_State_EnumDef mode);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_SESSION_H
+/**************************End of file********************************/
@@ -7,14 +7,20 @@
 * @version  : V1.0.0
 * @copyright: Copyright (c) 2050
 **********************************************************************************/
+#define LOG_DOMAIN  LOG_DOMAIN_SW
 #include "app_shockwave.h"
 #include "app_treatmgr.h"
 #include "app_memory.h"
 #include "app_comm.h"
 #include "drv_iodevice.h"
 #include "drv_adc.h"
+#include "drv_scope.h"
 #include "drv_tim.h"
 #include "drv_delay.h"
+#include "drv_protect.h"
+#include "drv_meter.h"
+#include "app_usage.h"
+#include "app_program.h"
 #include "log.h"
 #include <string.h>
 
@@ -56,40 +62,178 @@ static uint32_t App_Shockwave_CalculateESW_NHighTime(uint8_t level)
     return (time_us + 500) / 1000;  // 四舍五入到毫秒
 }
 
-void App_Shockwave_UpdateStatus(void)
+/**
+ * @brief 每发开始时按当前档位装载周期和PWM_ESW-高电平时间，治疗程序换档从下一发生效；
+ *        热降额按系数加长周期（降低发射率），每发能量不变
+ */
+static void App_Shockwave_LoadShotParams(void)
 {
-    // Update work state
-    if(s_SWCtrlInfo.runState == E_SW_RUN_WORKING) {
-        s_SWCtrlInfo.Trans.TxStatus.work_state = 0x01;
-    } else if(s_SWCtrlInfo.runState == E_SW_RUN_STOP) {
-        s_SWCtrlInfo.Trans.TxStatus.work_state = 0x00;
+    s_SWCtrlInfo.cyclePeriodMs = App_Shockwave_CalculateCyclePeriod(s_SWCtrlInfo.FreqLevel);
+    if(s_SWCtrlInfo.Thermal.scale != 0 && s_SWCtrlInfo.Thermal.scale < THERMAL_SCALE_FULL) {
+        s_SWCtrlInfo.cyclePeriodMs = s_SWCtrlInfo.cyclePeriodMs * THERMAL_SCALE_FULL / s_SWCtrlInfo.Thermal.scale;
     }
-    s_SWCtrlInfo.Trans.TxStatus.frequency = s_SWCtrlInfo.FreqLevel;
-    s_SWCtrlInfo.Trans.TxStatus.remain_time = s_SWCtrlInfo.RemainPoints;
-    s_SWCtrlInfo.Trans.TxStatus.work_level = s_SWCtrlInfo.WorkLevel;
-    s_SWCtrlInfo.Trans.TxStatus.head_temp = s_SWCtrlInfo.HeadTemp;
-    
-    // Get probe connection status and foot switch state
-    bool headConnected = (s_SWCtrlInfo.probeStatus == E_IODEVICE_MODE_SHOCKWAVE);
-    
-    // Combine connection state
-    if (headConnected && s_SWCtrlInfo.FootSwitchStatus) {
-        s_SWCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_CLOSED;
-    } else if (!headConnected && s_SWCtrlInfo.FootSwitchStatus) {
-        s_SWCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_CLOSED;
-    } else if (headConnected && !s_SWCtrlInfo.FootSwitchStatus) {
-        s_SWCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_OPEN;
-    } else {
-        s_SWCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_OPEN;
+    s_SWCtrlInfo.pwmESW_NHighTimeMs = App_Shockwave_CalculateESW_NHighTime(s_SWCtrlInfo.WorkLevel);
+}
+
+/**
+ * @brief 按周期求平均功率（千分比，相对最高档位、最高频率），每发能量近似与PWM_ESW-高电平时间成正比
+ */
+static uint16_t App_Shockwave_PowerPermille(uint32_t periodMs)
+{
+    uint32_t fullHighMs = App_Shockwave_CalculateESW_NHighTime(SW_WORK_LEVEL_MAX);
+    uint32_t fullPeriodMs = App_Shockwave_CalculateCyclePeriod(SW_FREQ_LEVEL_MAX);
+
+    if(periodMs == 0) {
+        return 0;
     }
-    s_SWCtrlInfo.Trans.TxStatus.error_code = s_SWCtrlInfo.ErrorCode;
+    return (uint16_t)(App_Shockwave_CalculateESW_NHighTime(s_SWCtrlInfo.WorkLevel) * fullPeriodMs *
+                      THERMAL_SCALE_FULL / (fullHighMs * periodMs));
+}
+
+#define SW_PUBLISH_U8(field, value)     App_Comm_PublishStatusU8(PROTOCOL_MODULE_SHOCKWAVE, \
+                                            APP_COMM_STATUS_OFFSET(SW_GetStatus_Reply_t, field), (value))
+#define SW_PUBLISH_U16(field, value)    App_Comm_PublishStatusU16(PROTOCOL_MODULE_SHOCKWAVE, \
+                                            APP_COMM_STATUS_OFFSET(SW_GetStatus_Reply_t, field), (value))
+#define SW_PUBLISH_U32(field, value)    App_Comm_PublishStatusU32(PROTOCOL_MODULE_SHOCKWAVE, \
+                                            APP_COMM_STATUS_OFFSET(SW_GetStatus_Reply_t, field), (value))
+
+static void App_Shockwave_UpdateStatus(void)
+{
+    SW_PUBLISH_U8(frequency, s_SWCtrlInfo.FreqLevel);
+    SW_PUBLISH_U16(remain_time, s_SWCtrlInfo.RemainPoints);
+    SW_PUBLISH_U8(work_level, s_SWCtrlInfo.WorkLevel);
+    SW_PUBLISH_U16(head_temp, s_SWCtrlInfo.HeadTemp);
+    SW_PUBLISH_U16(shot_energy, s_SWCtrlInfo.ShotEnergy);
+    SW_PUBLISH_U32(energy, App_Session_GetEnergyMj(&s_SWCtrlInfo.Session));
+    SW_PUBLISH_U8(max_rate, s_SWCtrlInfo.MaxRate);
+}
+
+/**
+ * @brief 本档开始下一发所需的ESW_U：档位越高放电越深，要求越接近满电压
+ */
+static uint16_t App_Shockwave_ChargeTarget(void)
+{
+    uint32_t level = (s_SWCtrlInfo.WorkLevel > 1) ? s_SWCtrlInfo.WorkLevel : 1;
+    uint32_t pct = SW_CHARGE_READY_PCT_MIN + (SW_CHARGE_READY_PCT_MAX - SW_CHARGE_READY_PCT_MIN) *
+                   (level - 1) / (SW_WORK_LEVEL_MAX - 1);
+
+    uint32_t target = (uint32_t)s_SWCtrlInfo.ChargeFullMv * pct / 100u;
+
+    // ESW+和等待期间电容仍在充电，放电开始时达到目标即可
+    return (uint16_t)((target > s_SWCtrlInfo.ChargeLeadMv) ? (target - s_SWCtrlInfo.ChargeLeadMv) : 0);
 }
 
-void App_Shockwave_RxDataHandle(void)
+/**
+ * @brief 储能电容是否已充到本档目标；电压不再上升（电源小幅下降）时以当前值为满电压，
+ *        低于报警阈值则不发射，由电压检查报警；停在最高满电压SW_CHARGE_RELEARN_PCT以下
+ *        则为充电故障，不发射直到重新充到目标
+ */
+static bool App_Shockwave_IsCharged(uint32_t now)
 {
-    SW_TransData_t *pTransData = App_Comm_GetSWTransData();
+    uint16_t voltage = Drv_ADC_GetRealValue(E_ADC_CHANNEL_ESW_U);
+    uint16_t target;
+
+    if(voltage > s_SWCtrlInfo.ChargeFullMv) {
+        s_SWCtrlInfo.ChargeFullMv = voltage;
+    }
+    if(voltage > s_SWCtrlInfo.ChargeRefMv) {
+        s_SWCtrlInfo.ChargeRefMv = voltage;
+    }
+    target = App_Shockwave_ChargeTarget();
+    Drv_Scope_SetVar(E_SCOPE_SRC_TARGET, target);
+    if(voltage >= target) {
+        if(s_SWCtrlInfo.Ctx.ErrorCode == E_SW_ERROR_CHARGE_FAULT) {
+            LOG_I("SW: charge back at %d mV, firing resumes", voltage);
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_NONE;
+        }
+        return true;
+    }
+    if(voltage > s_SWCtrlInfo.ChargePeakMv + SW_CHARGE_NOISE_MV) {
+        s_SWCtrlInfo.ChargePeakMv = voltage;
+        s_SWCtrlInfo.ChargePeakTime = now;
+        return false;
+    }
+    if(now - s_SWCtrlInfo.ChargePeakTime < SW_CHARGE_SETTLE_MS || voltage < SW_VOLTAGE_THRESHOLD_MV) {
+        return false;
+    }
+    // 只跟随电源小幅下降：再低则每发能量不足，不发射
+    if((uint32_t)voltage * 100u < (uint32_t)s_SWCtrlInfo.ChargeRefMv * SW_CHARGE_RELEARN_PCT) {
+        if(s_SWCtrlInfo.Ctx.ErrorCode != E_SW_ERROR_CHARGE_FAULT) {
+            LOG_E("SW: charge stuck at %d mV (full %d mV), holding fire", voltage, s_SWCtrlInfo.ChargeRefMv);
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_CHARGE_FAULT;
+        }
+        return false;
+    }
+    LOG_W("SW: charge settled at %d mV below target (full %d mV), relearned", voltage, s_SWCtrlInfo.ChargeFullMv);
+    s_SWCtrlInfo.ChargeFullMv = voltage;
+    return true;
+}
+
+/**
+ * @brief 下一发开始：按实测充电时间更新可达发射率，重新开始充电跟踪
+ */
+static void App_Shockwave_StartCharge(uint32_t now, bool measured)
+{
+    uint32_t rate;
+    bool limited;
+
+    if(measured) {
+        s_SWCtrlInfo.ChargeAvgMs = (s_SWCtrlInfo.ChargeAvgMs == 0) ? (uint16_t)s_SWCtrlInfo.ChargeReadyMs :
+                                   (uint16_t)((s_SWCtrlInfo.ChargeAvgMs * 3u + s_SWCtrlInfo.ChargeReadyMs) / 4u);
+        rate = 10000u / s_SWCtrlInfo.ChargeAvgMs;
+        s_SWCtrlInfo.MaxRate = (uint8_t)((rate > SW_RATE_MAX_X10) ? SW_RATE_MAX_X10 : rate);
+        limited = (s_SWCtrlInfo.ChargeReadyMs > s_SWCtrlInfo.cyclePeriodMs);
+        if(limited != s_SWCtrlInfo.ChargeLimited) {
+            s_SWCtrlInfo.ChargeLimited = limited;
+            if(limited) {
+                LOG_I("SW: charge-limited at level %d, %d.%d Hz max", s_SWCtrlInfo.WorkLevel,
+                      s_SWCtrlInfo.MaxRate / 10, s_SWCtrlInfo.MaxRate % 10);
+            } else {
+                LOG_I("SW: charge keeps up with the requested rate again");
+            }
+        }
+    }
+    s_SWCtrlInfo.ChargeReadyMs = 0;
+    s_SWCtrlInfo.ChargeStartMv = Drv_ADC_GetRealValue(E_ADC_CHANNEL_ESW_U);
+    s_SWCtrlInfo.ChargePeakMv = 0;
+    s_SWCtrlInfo.ChargePeakTime = now;
+}
+
+/**
+ * @brief 放电开始前学习ESW+和等待期间充入的电压，下一发据此提前开始
+ */
+static void App_Shockwave_LearnLead(void)
+{
+    uint16_t voltage = Drv_ADC_GetRealValue(E_ADC_CHANNEL_ESW_U);
+
+    s_SWCtrlInfo.ChargeLeadMv = (voltage > s_SWCtrlInfo.ChargeStartMv) ?
+                                (uint16_t)((voltage - s_SWCtrlInfo.ChargeStartMv) * SW_CHARGE_LEAD_PCT / 100u) : 0;
+}
+
+/**
+ * @brief 结算上一发能量并开始下一发计量
+ * @param closePrev 是否有上一发需要结算
+ * @note  放电电流在下一周期开始前早已结束，此时结算不会漏掉尾部采样块
+ */
+static void App_Shockwave_MarkShot(bool closePrev)
+{
+    uint32_t meterMj = Drv_Meter_GetEnergyMj(E_METER_CH_ESW);
+    uint32_t shotMj = meterMj - s_SWCtrlInfo.shotStartMj;
+
+    if(closePrev) {
+        s_SWCtrlInfo.ShotEnergy = (shotMj > 0xFFFFu) ? 0xFFFFu : (uint16_t)shotMj;
+    }
+    s_SWCtrlInfo.shotStartMj = meterMj;
+}
+
+static void App_Shockwave_RxDataHandle(void)
+{
+    SW_TransData_t *pTransData = &s_SWCtrlInfo.Trans;
     
-    if(pTransData->RxWorkState.work_state == WORK_STATE_RESET)
+    // 仅在收到新指令时处理，避免同一条复位指令被重复执行
+    if(App_Comm_FetchRx(PROTOCOL_MODULE_SHOCKWAVE, PROTOCOL_CMD_SET_WORK_STATE, &pTransData->RxWorkState,
+                        sizeof(pTransData->RxWorkState), &s_SWCtrlInfo.RxWorkStateVer) &&
+       pTransData->RxWorkState.work_state == WORK_STATE_RESET)
     {
         // 处理复位功能
         // 重置治疗点数、治疗档位、治疗频率档位
@@ -112,94 +256,47 @@ void App_Shockwave_RxDataHandle(void)
     }
 }
 
-void App_Shockwave_ChangeState(SW_RunState_EnumDef newState)
-{
-    if(newState != s_SWCtrlInfo.runState && newState < E_SW_RUN_MAX)
-    {
-        s_SWCtrlInfo.runState = newState;
-        switch(newState)
-        {
-            case E_SW_RUN_INIT:
-                LOG_I("SW state changed to INIT");
-                break;
-            case E_SW_RUN_IDLE:
-                LOG_I("SW state changed to IDLE");
-                break;
-            case E_SW_RUN_WORKING:
-                LOG_I("SW state changed to WORKING");
-                // 启动工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            case E_SW_RUN_STOP:
-                LOG_I("SW state changed to STOP");
-                // 结束工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            default:
-                break;
-        }
-    }
-}
-
-void App_Shockwave_Monitor(void)
-{
-    // Get the foot switch status and probe status
-    s_SWCtrlInfo.FootSwitchStatus = Drv_IODevice_GetFootSwitchState();
-    
-    // Get the probe status
-    s_SWCtrlInfo.probeStatus = Drv_IODevice_GetProbeStatus();
-}
-
-bool App_Shockwave_StartCheck()
+/**
+ * @brief 冲击波特有启动条件（脚踏、治疗头由引擎检查）
+ */
+static bool App_Shockwave_CheckRequest(void)
 {
-    SW_TransData_t *pTransData = App_Comm_GetSWTransData();
+    SW_TransData_t *pTransData = &s_SWCtrlInfo.Trans;
+    // 已下发治疗程序时，档位和频率由程序给出（下发时已校验），工作点数仍由指令给出
+    bool program = App_Program_IsArmed(PROTOCOL_MODULE_SHOCKWAVE);
     
     // 1. 检查下位机是否下发了发射冲击波指令
     if(pTransData->RxWorkState.work_state != WORK_STATE_START) {
         LOG_E("SW: Work state is not start");
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 2. 检查剩余工作点数是否大于0（0-10000）
     if(pTransData->RxWorkState.work_time == 0 || pTransData->RxWorkState.work_time > SW_WORK_POINT_MAX) {
         LOG_E("SW: Invalid work points: %d", pTransData->RxWorkState.work_time);
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 3. 检查工作档位是否不等于0（0-26）
-    if(pTransData->RxWorkState.work_level == 0 || pTransData->RxWorkState.work_level > SW_WORK_LEVEL_MAX) {
+    if(!program && (pTransData->RxWorkState.work_level == 0 || pTransData->RxWorkState.work_level > SW_WORK_LEVEL_MAX)) {
         LOG_E("SW: Invalid work level: %d (range: 1-%d)", pTransData->RxWorkState.work_level, SW_WORK_LEVEL_MAX);
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 4. 检查工作频率档位是否有效（1-16）
-    if(pTransData->RxWorkState.frequency == 0 || pTransData->RxWorkState.frequency > SW_FREQ_LEVEL_MAX) {
+    if(!program && (pTransData->RxWorkState.frequency == 0 || pTransData->RxWorkState.frequency > SW_FREQ_LEVEL_MAX)) {
         LOG_E("SW: Invalid frequency level: %d (range: 1-%d)", pTransData->RxWorkState.frequency, SW_FREQ_LEVEL_MAX);
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
         return false;
     }
     
-    // 5. 检查脚踏开关是否闭合
-    if(s_SWCtrlInfo.FootSwitchStatus == false) {
-        LOG_E("SW: Foot switch is not closed");
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
-        return false;
-    }
-    
-    // 6. 检查是否正确识别到冲击波治疗头
-    if(s_SWCtrlInfo.probeStatus != E_IODEVICE_MODE_SHOCKWAVE) {
-        LOG_E("SW: Shockwave probe not connected");
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_PROBE_NOT_CONNECTED;
-        return false;
-    }
-    
-    // 7. 检查是否有剩余可治疗次数
+    // 5. 检查是否有剩余可治疗次数
     if(s_SWCtrlInfo.TreatTimes == 0) {
         LOG_E("SW: No remaining treat times");
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_INVALID_PARAMS;
         return false;
     }
     
@@ -209,12 +306,15 @@ bool App_Shockwave_StartCheck()
 
 void App_Shockwave_SetWorkParams(void)
 {
-    SW_TransData_t *pTransData = App_Comm_GetSWTransData();
+    SW_TransData_t *pTransData = &s_SWCtrlInfo.Trans;
     
     // 设置工作参数
     s_SWCtrlInfo.WorkLevel = pTransData->RxWorkState.work_level;
     s_SWCtrlInfo.FreqLevel = pTransData->RxWorkState.frequency;
     s_SWCtrlInfo.RemainPoints = pTransData->RxWorkState.work_time;
+    s_SWCtrlInfo.ShotEnergy = 0;
+    App_Session_Start(&s_SWCtrlInfo.Session, E_TREATMGR_STATE_SHOCK_WAVE, 0);
+    App_Thermal_Start(&s_SWCtrlInfo.Thermal, Drv_ADC_GetRealValue(E_ADC_CHANNEL_HAND_NTC));
     
     // 计算周期时间
     s_SWCtrlInfo.cyclePeriodMs = App_Shockwave_CalculateCyclePeriod(s_SWCtrlInfo.FreqLevel);
@@ -228,6 +328,15 @@ void App_Shockwave_SetWorkParams(void)
 	// 初始化PWM状态
 	s_SWCtrlInfo.pwmState = E_SW_PWM_STATE_IDLE;
 	s_SWCtrlInfo.cycleStartTime = 0;  // 重置周期开始时间
+    // 空闲时电容已充满，以此为满电压起点，工作中继续学习
+    s_SWCtrlInfo.ChargeFullMv = Drv_ADC_GetRealValue(E_ADC_CHANNEL_ESW_U);
+    s_SWCtrlInfo.ChargeRefMv = s_SWCtrlInfo.ChargeFullMv;
+    s_SWCtrlInfo.ChargeAvgMs = 0;
+    s_SWCtrlInfo.ChargeLeadMv = 0;
+    s_SWCtrlInfo.ChargeLimited = false;
+    s_SWCtrlInfo.MaxRate = (uint8_t)((10000u / s_SWCtrlInfo.cyclePeriodMs > SW_RATE_MAX_X10) ?
+                                     SW_RATE_MAX_X10 : 10000u / s_SWCtrlInfo.cyclePeriodMs);
+    App_Shockwave_StartCharge(Drv_Delay_GetTickMs(), false);
 	Drv_TIM4_SetESW_P(false);
 	Drv_TIM4_SetESW_N(false);
     
@@ -247,14 +356,14 @@ bool App_Shockwave_IsCurrentNormal(void)
         // PWM_ESW+高电平时，监控电压应该大于PWM_ESW+工作电流区间
         if(current < s_SWCtrlInfo.CurrentLow_ESW_P)
         {
-            s_SWCtrlInfo.ErrorCode = E_SW_ERROR_CURRENT_ESW_P_LOW;
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_CURRENT_ESW_P_LOW;
             LOG_W("SW: PWM_ESW+ current too low: %d (range: %d-%d)", 
                   current, s_SWCtrlInfo.CurrentLow_ESW_P, s_SWCtrlInfo.CurrentHigh_ESW_P);
             isNormal = false;
         }
         else
         {
-            s_SWCtrlInfo.ErrorCode = E_SW_ERROR_NONE;
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_NONE;
         }
     }
     else if(s_SWCtrlInfo.pwmState == E_SW_PWM_STATE_ESW_N_HIGH)
@@ -262,14 +371,14 @@ bool App_Shockwave_IsCurrentNormal(void)
         // PWM_ESW-高电平时，监控电压应该大于PWM_ESW-工作电流区间
         if(current < s_SWCtrlInfo.CurrentLow_ESW_N)
         {
-            s_SWCtrlInfo.ErrorCode = E_SW_ERROR_CURRENT_ESW_N_LOW;
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_CURRENT_ESW_N_LOW;
             LOG_W("SW: PWM_ESW- current too low: %d (range: %d-%d)", 
                   current, s_SWCtrlInfo.CurrentLow_ESW_N, s_SWCtrlInfo.CurrentHigh_ESW_N);
             isNormal = false;
         }
         else
         {
-            s_SWCtrlInfo.ErrorCode = E_SW_ERROR_NONE;
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_NONE;
         }
     }
     
@@ -284,15 +393,15 @@ bool App_Shockwave_IsVoltageNormal(void)
     // 采样电压低于3V时报警
     if(voltage < SW_VOLTAGE_THRESHOLD_MV)
     {
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_VOLTAGE_LOW;
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_VOLTAGE_LOW;
         LOG_W("SW: Voltage too low: %d mV (threshold: %d mV)", voltage, SW_VOLTAGE_THRESHOLD_MV);
         isNormal = false;
     }
     else
     {
-        if(s_SWCtrlInfo.ErrorCode == E_SW_ERROR_VOLTAGE_LOW)
+        if(s_SWCtrlInfo.Ctx.ErrorCode == E_SW_ERROR_VOLTAGE_LOW)
         {
-            s_SWCtrlInfo.ErrorCode = E_SW_ERROR_NONE;
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_NONE;
         }
     }
     
@@ -307,22 +416,49 @@ bool App_Shockwave_IsHeadTempNormal(void)
     
     if(temp > s_SWCtrlInfo.TempLimit)
     {
-        s_SWCtrlInfo.ErrorCode = E_SW_ERROR_TEMP_TOO_HIGH;
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_TEMP_TOO_HIGH;
         LOG_W("SW: Head temperature too high: %d (limit: %d)", temp, s_SWCtrlInfo.TempLimit);
         // 温度超限，立马停止工作
         isNormal = false;
     }
     else
     {
-        if(s_SWCtrlInfo.ErrorCode == E_SW_ERROR_TEMP_TOO_HIGH)
+        if(s_SWCtrlInfo.Ctx.ErrorCode == E_SW_ERROR_TEMP_TOO_HIGH)
         {
-            s_SWCtrlInfo.ErrorCode = E_SW_ERROR_NONE;
+            s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_NONE;
         }
     }
     
     return isNormal;
 }
 
+uint16_t App_Shockwave_GetOutputPermille(void)
+{
+    uint32_t periodMs = s_SWCtrlInfo.cyclePeriodMs;
+
+    if(s_SWCtrlInfo.Ctx.runState != E_TREAT_RUN_WORKING)
+    {
+        return 0;
+    }
+    // 充电跟不上时实际间隔更长
+    if(s_SWCtrlInfo.ChargeLimited && s_SWCtrlInfo.ChargeAvgMs > periodMs)
+    {
+        periodMs = s_SWCtrlInfo.ChargeAvgMs;
+    }
+    return App_Shockwave_PowerPermille(periodMs);
+}
+
+/**
+ * @brief 热降额：按模型预测的功率上限降低发射率，下一发开始时生效
+ */
+static bool App_Shockwave_Derate(void)
+{
+    App_Thermal_Update(&s_SWCtrlInfo.Thermal, s_SWCtrlInfo.HeadTemp, s_SWCtrlInfo.TempLimit,
+                       App_Shockwave_GetOutputPermille(),
+                       App_Shockwave_PowerPermille(App_Shockwave_CalculateCyclePeriod(s_SWCtrlInfo.FreqLevel)));
+    return true;
+}
+
 void App_Shockwave_ProcessPWM(void)
 {
     uint32_t currentTime = Drv_Delay_GetTickMs();
@@ -331,10 +467,27 @@ void App_Shockwave_ProcessPWM(void)
     switch(s_SWCtrlInfo.pwmState)
     {
         case E_SW_PWM_STATE_IDLE:
-            // 检查是否应该开始新周期
+            // 放电结束后跟踪充电，充到本档目标的时刻即为本档可达的最短间隔
+            if(s_SWCtrlInfo.ChargeReadyMs == 0 && App_Shockwave_IsCharged(currentTime))
+            {
+                s_SWCtrlInfo.ChargeReadyMs = currentTime - s_SWCtrlInfo.cycleStartTime;
+                if(s_SWCtrlInfo.ChargeReadyMs == 0)
+                {
+                    s_SWCtrlInfo.ChargeReadyMs = 1;
+                }
+            }
+            // 检查是否应该开始新周期，未充到目标不发射
+            if(s_SWCtrlInfo.ChargeReadyMs == 0)
+            {
+                break;
+            }
             if(s_SWCtrlInfo.cycleStartTime == 0)
             {
-                // 第一次启动，立即开始
+                // 第一次启动，充好即开始
+                App_Shockwave_StartCharge(currentTime, false);
+                App_Shockwave_MarkShot(false);
+                App_Usage_AddShot();
+                App_Shockwave_LoadShotParams();
                 s_SWCtrlInfo.cycleStartTime = currentTime;
                 s_SWCtrlInfo.pwmState = E_SW_PWM_STATE_ESW_P_HIGH;
                 s_SWCtrlInfo.pwmStateStartTime = currentTime;
@@ -348,6 +501,10 @@ void App_Shockwave_ProcessPWM(void)
                 if(cycleElapsed >= s_SWCtrlInfo.cyclePeriodMs)
                 {
                     // 周期完成，开始新周期
+                    App_Shockwave_StartCharge(currentTime, true);
+                    App_Shockwave_MarkShot(true);
+                    App_Usage_AddShot();
+                    App_Shockwave_LoadShotParams();
                     s_SWCtrlInfo.cycleStartTime = currentTime;
                     s_SWCtrlInfo.pwmState = E_SW_PWM_STATE_ESW_P_HIGH;
                     s_SWCtrlInfo.pwmStateStartTime = currentTime;
@@ -374,6 +531,7 @@ void App_Shockwave_ProcessPWM(void)
             elapsedTime = currentTime - s_SWCtrlInfo.pwmStateStartTime;
             if(elapsedTime >= SW_PWM_ESW_P_WAIT_TIME_MS)
             {
+                App_Shockwave_LearnLead();
                 // 等待17ms后，PWM_ESW-高电平
                 Drv_TIM4_SetESW_N(true);
                 s_SWCtrlInfo.pwmState = E_SW_PWM_STATE_ESW_N_HIGH;
@@ -397,102 +555,127 @@ void App_Shockwave_ProcessPWM(void)
         default:
             break;
     }
+    Drv_Scope_SetVar(E_SCOPE_SRC_STATE, s_SWCtrlInfo.pwmState);
 }
 
-void App_Shockwave_Process(void)
+static void App_Shockwave_LoadParams(void)
 {
-    static Drv_Timer_t TempMonitorTimer;
-    
-    // Process the shockwave module
-    App_Shockwave_UpdateStatus();
-    App_Shockwave_RxDataHandle();
-    App_Shockwave_Monitor();
+    // 加载冲击波参数
+    if(App_Memory_LoadSWParams(&s_SWCtrlInfo.TreatParams)) {
+        s_SWCtrlInfo.TempLimit = s_SWCtrlInfo.TreatParams.TempLimit;
+        s_SWCtrlInfo.TreatTimes = s_SWCtrlInfo.TreatParams.RemainTimes;
+        s_SWCtrlInfo.CurrentHigh_ESW_P = s_SWCtrlInfo.TreatParams.CurrentHigh_ESW_P;
+        s_SWCtrlInfo.CurrentLow_ESW_P = s_SWCtrlInfo.TreatParams.CurrentLow_ESW_P;
+        s_SWCtrlInfo.CurrentHigh_ESW_N = s_SWCtrlInfo.TreatParams.CurrentHigh_ESW_N;
+        s_SWCtrlInfo.CurrentLow_ESW_N = s_SWCtrlInfo.TreatParams.CurrentLow_ESW_N;
+        
+        LOG_I("SW: Parameters loaded - temp_limit=%d, remain_times=%d, ESW_P=[%d, %d], ESW_N=[%d, %d]",
+              s_SWCtrlInfo.TempLimit, s_SWCtrlInfo.TreatTimes,
+              s_SWCtrlInfo.CurrentLow_ESW_P, s_SWCtrlInfo.CurrentHigh_ESW_P,
+              s_SWCtrlInfo.CurrentLow_ESW_N, s_SWCtrlInfo.CurrentHigh_ESW_N);
+    } else {
+        LOG_E("SW: Failed to load parameters");
+        s_SWCtrlInfo.Ctx.ErrorCode = E_SW_ERROR_READ_PARAMS_FAILED;
+    }
+}
+
+static uint16_t App_Shockwave_ProtectLimit(void)
+{
+    // 硬件过流保护：ESW_I共用一路采样，阈值取ESW+/ESW-上限中较大者
+    return (s_SWCtrlInfo.CurrentHigh_ESW_P > s_SWCtrlInfo.CurrentHigh_ESW_N) ?
+           s_SWCtrlInfo.CurrentHigh_ESW_P : s_SWCtrlInfo.CurrentHigh_ESW_N;
+}
+
+static bool App_Shockwave_WorkCheck(void)
+{
+    return s_SWCtrlInfo.RemainPoints != 0;
+}
+
+static bool App_Shockwave_PWMLoop(void)
+{
+    // 处理PWM时序
+    App_Shockwave_ProcessPWM();
+    return true;
+}
 
-    // Handle the shockwave state
-    switch(s_SWCtrlInfo.runState)
+/**
+ * @brief 治疗程序换档：frequency为频率档位，下一发开始时生效
+ */
+static void App_Shockwave_ApplyStep(uint8_t level, uint16_t frequency)
+{
+    s_SWCtrlInfo.WorkLevel = level;
+    if(frequency != 0)
     {
-        case E_SW_RUN_INIT:
-            // 加载冲击波参数
-            if(App_Memory_LoadSWParams(&s_SWCtrlInfo.TreatParams)) {
-                s_SWCtrlInfo.TempLimit = s_SWCtrlInfo.TreatParams.TempLimit;
-                s_SWCtrlInfo.TreatTimes = s_SWCtrlInfo.TreatParams.RemainTimes;
-                s_SWCtrlInfo.CurrentHigh_ESW_P = s_SWCtrlInfo.TreatParams.CurrentHigh_ESW_P;
-                s_SWCtrlInfo.CurrentLow_ESW_P = s_SWCtrlInfo.TreatParams.CurrentLow_ESW_P;
-                s_SWCtrlInfo.CurrentHigh_ESW_N = s_SWCtrlInfo.TreatParams.CurrentHigh_ESW_N;
-                s_SWCtrlInfo.CurrentLow_ESW_N = s_SWCtrlInfo.TreatParams.CurrentLow_ESW_N;
-                
-                LOG_I("SW: Parameters loaded - temp_limit=%d, remain_times=%d, ESW_P=[%d, %d], ESW_N=[%d, %d]",
-                      s_SWCtrlInfo.TempLimit, s_SWCtrlInfo.TreatTimes,
-                      s_SWCtrlInfo.CurrentLow_ESW_P, s_SWCtrlInfo.CurrentHigh_ESW_P,
-                      s_SWCtrlInfo.CurrentLow_ESW_N, s_SWCtrlInfo.CurrentHigh_ESW_N);
-            } else {
-                LOG_E("SW: Failed to load parameters");
-                s_SWCtrlInfo.ErrorCode = E_SW_ERROR_READ_PARAMS_FAILED;
-            }
-            App_Shockwave_ChangeState(E_SW_RUN_IDLE);
-            break;
-            
-        case E_SW_RUN_IDLE:
-            // 使用App_Shockwave_StartCheck进行启动前检查
-            if(App_Shockwave_StartCheck()) {
-                // 设置工作参数并启动冲击波发射
-                App_Shockwave_SetWorkParams();
-
-                // pwr_control3、pwr_control4切换至可输出（平常为不可输出）
-                Drv_IODevice_ChangeChannel(CHANNEL_SW);
-                App_Shockwave_ChangeState(E_SW_RUN_WORKING);
-            }
-            break;
-            
-        case E_SW_RUN_WORKING:
-            // 检查所有条件
-            if(App_Shockwave_StartCheck() == false || 
-               s_SWCtrlInfo.RemainPoints == 0){
-                App_Shockwave_ChangeState(E_SW_RUN_STOP);
-            } else {
-                // 处理PWM时序
-                App_Shockwave_ProcessPWM();
-                
-                // 监控电流（在PWM高电平时）
-                if(s_SWCtrlInfo.pwmState == E_SW_PWM_STATE_ESW_P_HIGH || 
-                   s_SWCtrlInfo.pwmState == E_SW_PWM_STATE_ESW_N_HIGH) {
-                    if(App_Shockwave_IsCurrentNormal() == false) {
-                        // 电流异常，报警但不立即停止
-                    }
-                }
-                
-                // 监控电压
-                if(App_Shockwave_IsVoltageNormal() == false) {
-                    // 电压异常，报警但不立即停止
-                }
-                
-                // 温度监控（10ms周期）
-                if(Drv_Timer_Tick(&TempMonitorTimer, SW_TEMP_MONITOR_PERIOD_MS)) {
-                    if(App_Shockwave_IsHeadTempNormal() == false) {
-                        // 温度超限，立马停止工作
-                        App_Shockwave_ChangeState(E_SW_RUN_STOP);
-                    }
-                }
-            }
-            break;
-            
-        case E_SW_RUN_STOP:
-            // 关闭PWM输出
-            Drv_TIM4_SetESW_P(false);
-            Drv_TIM4_SetESW_N(false);
-            // 重置PWM状态
-            s_SWCtrlInfo.pwmState = E_SW_PWM_STATE_IDLE;
-            s_SWCtrlInfo.cycleStartTime = 0;
-            // 关闭输出通道
-            Drv_IODevice_ChangeChannel(CHANNEL_CLOSE);
-            App_TreatMgr_ChangeState(E_TREATMGR_STATE_IDLE);
-            break;
-            
-        default:
-            break;
+        s_SWCtrlInfo.FreqLevel = (uint8_t)frequency;
     }
 }
 
+static void App_Shockwave_Stop(void)
+{
+    // 关闭PWM输出
+    Drv_TIM4_SetESW_P(false);
+    Drv_TIM4_SetESW_N(false);
+    // 结算最后一发
+    if(s_SWCtrlInfo.cycleStartTime != 0) {
+        App_Shockwave_MarkShot(true);
+    }
+    // 重置PWM状态
+    s_SWCtrlInfo.pwmState = E_SW_PWM_STATE_IDLE;
+    s_SWCtrlInfo.cycleStartTime = 0;
+}
+
+/* 电流（仅PWM高电平时判定）、电压异常只报警，温度超限立马停止 */
+static const TreatModule_Loop_t s_SWLoops[] =
+{
+    { 0,                         false, App_Shockwave_PWMLoop },
+    { 0,                         false, App_Shockwave_IsCurrentNormal },
+    { 0,                         false, App_Shockwave_IsVoltageNormal },
+    { SW_TEMP_MONITOR_PERIOD_MS, true,  App_Shockwave_IsHeadTempNormal },
+    { THERMAL_PERIOD_MS,         false, App_Shockwave_Derate },
+};
+
+static const TreatModule_Desc_t s_SWModule =
+{
+    .pName = "SW",
+    .logDomain = LOG_DOMAIN_SW,
+    .pCtx = &s_SWCtrlInfo.Ctx,
+    .pSession = &s_SWCtrlInfo.Session,
+    .probe = E_IODEVICE_MODE_SHOCKWAVE,
+    .channel = CHANNEL_SW,
+    .protectChannel = E_ADC_CHANNEL_ESW_I,
+    .errProbe = E_SW_ERROR_PROBE_NOT_CONNECTED,
+    .errInvalid = E_SW_ERROR_INVALID_PARAMS,
+    .errOverCurrent = E_SW_ERROR_OVER_CURRENT,
+    .commModule = PROTOCOL_MODULE_SHOCKWAVE,
+    .workStateOffset = offsetof(SW_GetStatus_Reply_t, work_state),
+    .connStateOffset = offsetof(SW_GetStatus_Reply_t, conn_state),
+    .errorCodeOffset = offsetof(SW_GetStatus_Reply_t, error_code),
+    .programStepOffset = offsetof(SW_GetStatus_Reply_t, program_step),
+    .stepRemainOffset = offsetof(SW_GetStatus_Reply_t, step_remain),
+    .pfLoadParams = App_Shockwave_LoadParams,
+    .pfUpdateStatus = App_Shockwave_UpdateStatus,
+    .pfRxDataHandle = App_Shockwave_RxDataHandle,
+    .pfStartCheck = App_Shockwave_CheckRequest,
+    .pfSetWorkParams = App_Shockwave_SetWorkParams,
+    .pfPrepare = NULL,
+    .pfProtectLimit = App_Shockwave_ProtectLimit,
+    .pfWorkCheck = App_Shockwave_WorkCheck,
+    .pfApplyStep = App_Shockwave_ApplyStep,
+    .pfStop = App_Shockwave_Stop,
+    .pLoops = s_SWLoops,
+    .loopNum = sizeof(s_SWLoops) / sizeof(s_SWLoops[0]),
+};
+
+bool App_Shockwave_StartCheck(void)
+{
+    return App_TreatModule_StartCheck(&s_SWModule);
+}
+
+void App_Shockwave_Process(void)
+{
+    App_TreatModule_Process(&s_SWModule);
+}
+
 /**
  * @brief Initialize shockwave module
  */
@@ -502,9 +685,8 @@ void App_Shockwave_Init(void)
     memset(&s_SWCtrlInfo, 0, sizeof(SW_CtrlInfo_t));
     
     // 设置初始状态
-    s_SWCtrlInfo.runState = E_SW_RUN_INIT;
+    App_TreatModule_Init(&s_SWModule);
     s_SWCtrlInfo.pwmState = E_SW_PWM_STATE_IDLE;
-    s_SWCtrlInfo.ErrorCode = E_SW_ERROR_NONE;
     s_SWCtrlInfo.WorkLevel = 0;
     s_SWCtrlInfo.FreqLevel = 0;
     s_SWCtrlInfo.RemainPoints = 0;
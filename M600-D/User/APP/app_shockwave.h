@@ -22,6 +22,9 @@ extern "C" {
 #include "app_comm.h"
 #include "app_memory.h"
 #include "drv_iodevice.h"
+#include "app_session.h"
+#include "app_treatmodule.h"
+#include "app_thermal.h"
 
 /* 冲击波工作参数 */
 #define SW_WORK_LEVEL_MAX          26          ///< 最大档位 (0-26)
@@ -36,14 +39,14 @@ extern "C" {
 #define SW_PWM_ESW_N_BASE_TIME_MS     3       ///< PWM_ESW-基础高电平时间 (3ms)
 #define SW_PWM_ESW_N_STEP_TIME_MS     0.28f   ///< PWM_ESW-每档增加时间 (0.28ms)
 
-typedef enum
-{
-    E_SW_RUN_INIT = 0,
-    E_SW_RUN_IDLE,
-    E_SW_RUN_WORKING,
-    E_SW_RUN_STOP,
-    E_SW_RUN_MAX,
-} SW_RunState_EnumDef;
+/* 发射率调节：储能电容充到本档目标才开始下一发，最快为请求频率 */
+#define SW_CHARGE_READY_PCT_MIN    90          ///< 最低档开始下一发所需电压（占满电压%）
+#define SW_CHARGE_READY_PCT_MAX    98          ///< 最高档，放电深、每发能量对电压更敏感
+#define SW_CHARGE_NOISE_MV         20          ///< ESW_U仍在上升的判定量 (采样mV)
+#define SW_CHARGE_SETTLE_MS        200         ///< 不再上升多久视为已充满，按当前值重新学习满电压
+#define SW_CHARGE_RELEARN_PCT      94          ///< 重新学习的满电压不低于本次工作最高满电压的此比例，否则判为充电故障
+#define SW_CHARGE_LEAD_PCT         75          ///< ESW+到ESW-期间电压增量只计入此比例，留余量
+#define SW_RATE_MAX_X10            (SW_FREQ_LEVEL_MAX * 10)    ///< 上报发射率上限 (0.1Hz)
 
 typedef enum {
     E_SW_ERROR_NONE = 0,
@@ -54,6 +57,8 @@ typedef enum {
     E_SW_ERROR_CURRENT_ESW_N_LOW,
     E_SW_ERROR_VOLTAGE_LOW,
     E_SW_ERROR_TEMP_TOO_HIGH,
+    E_SW_ERROR_OVER_CURRENT,
+    E_SW_ERROR_CHARGE_FAULT,
     E_SW_ERROR_MAX,
 } SW_ErrorCode_EnumDef;
 
@@ -68,7 +73,7 @@ typedef enum
 
 typedef struct
 {
-    SW_RunState_EnumDef runState;
+    TreatModule_Ctx_t Ctx;         ///< 引擎运行状态（状态、错误码、脚踏、治疗头）
     SW_PWM_State_EnumDef pwmState;
     
     uint16_t TempLimit;            ///< 治疗头温度上限 (0.1°C)
@@ -82,20 +87,32 @@ typedef struct
     uint8_t FreqLevel;             ///< 工作频率档位 (1-16)
     uint16_t RemainPoints;         ///< 剩余工作点数
     uint16_t HeadTemp;             ///< 治疗头温度 (0.1°C)
-    
-    uint8_t ConnState;
-    uint8_t ErrorCode;
-    bool FootSwitchStatus;
-    IODevice_WorkingMode_EnumDef probeStatus;
+    App_Session_t Session;         ///< 输出计时与能量（无时长限制，按点数结束）
+    uint16_t ShotEnergy;           ///< 上一发实测能量 (mJ)
+    uint32_t shotStartMj;          ///< 本发开始时的能量计读数 (mJ)
+    App_Thermal_t Thermal;         ///< 热降额模型
     
     SW_TreatParams_t TreatParams;
-    SW_TransData_t Trans;
+    SW_TransData_t Trans;                ///< 本模式收发快照
+    uint32_t RxWorkStateVer;       ///< 已处理的工作状态指令版本
     
     /* PWM控制定时器 */
     uint32_t pwmStateStartTime;    ///< PWM状态开始时间 (ms)
     uint32_t cycleStartTime;       ///< 周期开始时间 (ms)
-    uint32_t cyclePeriodMs;        ///< 周期时间 (ms)，根据频率档位计算
+    uint32_t cyclePeriodMs;        ///< 周期时间 (ms)，根据频率档位计算，热降额时加长
     uint32_t pwmESW_NHighTimeMs;   ///< PWM_ESW-高电平时间 (ms)
+
+    /* 充电状态 */
+    uint16_t ChargeFullMv;         ///< 学习到的储能电容满电压 (ESW_U采样mV)
+    uint16_t ChargeRefMv;          ///< 本次工作学到的最高满电压，重新学习的下限以此为准
+    uint16_t ChargePeakMv;         ///< 本次充电的最高采样
+    uint16_t ChargeStartMv;        ///< 本发开始(ESW+)时的采样
+    uint16_t ChargeLeadMv;         ///< ESW+到ESW-期间继续充入的电压，可提前开始
+    uint32_t ChargePeakTime;       ///< 最高采样的时间
+    uint32_t ChargeReadyMs;        ///< 本发开始到充到目标的时间，0为尚未充到
+    uint16_t ChargeAvgMs;          ///< 充电所需间隔的平滑值
+    uint8_t MaxRate;               ///< 当前档位可达的最高发射率 (0.1Hz)
+    bool ChargeLimited;            ///< 充电跟不上请求频率
     
     /* 监控定时器 */
     uint32_t lastTempMonitorTime;  ///< 上次温度监控时间
@@ -105,6 +122,8 @@ void App_Shockwave_Init(void);
 void App_Shockwave_Process(void);
 bool App_Shockwave_StartCheck(void);
 void App_Shockwave_SetWorkParams(void);
+/** 输出中的平均功率（千分比，相对最高档位、最高频率），未输出为0 */
+uint16_t App_Shockwave_GetOutputPermille(void);
 
 #ifdef __cplusplus
 }
@@ -9,11 +9,308 @@
 #include "log.h"
 #include "cm_backtrace.h"
 #include "drv_wdg.h"
+#include "drv_delay.h"
+#include "drv_trace.h"
+#include "drv_blackbox.h"
+#include "drv_power.h"
+#include "drv_iodevice.h"
+#include "drv_boottime.h"
+#include "drv_meter.h"
+#include "drv_scope.h"
 #include "app_treatmgr.h"
+#include "app_comm.h"
+#include "app_memory.h"
+#include "app_update.h"
+#include <stdlib.h>
+
+#define SYSTEM_LOG_TASK_TIME    10      // 10ms, RTT command polling
+#define SYSTEM_TRACE_DUMP_CHUNK 16      // records per hex line block
+#define SYSTEM_STOP_IDLE_MS_DEFAULT 300000u  // 5 min without probe/host before STOP, 0 = never
+#define SYSTEM_STOP_POLL_MS     DRV_POWER_STOP_MAX_MS   // STOP period: IWDG feed
+
+#if BLACKBOX_EXPORT_MAX > MEM_BLACKBOX_SIZE
+#error "black-box image does not fit its EEPROM area"
+#endif
 
 static System_Mgr_t s_SystemMgr = {E_SYSTEM_STANDBY_MODE, 0};
+static uint32_t s_stopIdleMs = SYSTEM_STOP_IDLE_MS_DEFAULT;
+static uint32_t s_busySinceMs = 0;     // 最近一次不满足待机条件的时刻
+
+/**
+* @brief RTT command: trace rec|play|stop|stat|dump
+**/
+static void System_TraceCmd(char *arg)
+{
+    const Trace_Stats_t *pStats = Drv_Trace_GetStats();
+    Trace_Record_t recs[SYSTEM_TRACE_DUMP_CHUNK];
+    uint16_t first = 0;
+    uint16_t n;
+
+    if(strncmp(arg, "rec", 3) == 0){
+        Drv_Trace_Start(E_TRACE_MODE_RECORD);
+        LOG_I("Trace recording");
+    }else if(strncmp(arg, "play", 4) == 0){
+        if(Drv_Trace_Start(E_TRACE_MODE_REPLAY)){
+            LOG_I("Trace replay: %d records", Drv_Trace_GetCount());
+        }else{
+            LOG_W("Trace replay: no records");
+        }
+    }else if(strncmp(arg, "stop", 4) == 0){
+        Drv_Trace_Stop();
+        LOG_I("Trace stopped");
+    }else if(strncmp(arg, "stat", 4) == 0){
+        LOG_I("Trace: mode=%d count=%d records=%d lost=%d cycles/rec=%d",
+              Drv_Trace_GetMode(), Drv_Trace_GetCount(), pStats->records, pStats->overwritten,
+              pStats->records ? pStats->cycles / pStats->records : 0);
+        LOG_I("Trace replay: done=%d mismatches=%d first=%d",
+              Drv_Trace_IsReplayDone(), pStats->mismatches, pStats->firstMismatch);
+    }else if(strncmp(arg, "dump", 4) == 0){
+        // 8字节/条：tick(4, LE) type(1) arg(1) value(2, LE)，最旧在前
+        while((n = Drv_Trace_Copy(first, recs, SYSTEM_TRACE_DUMP_CHUNK)) > 0){
+            Log_Hex(LOG_LEVEL_INFO, "trace", recs, (uint16_t)(n * sizeof(Trace_Record_t)));
+            first += n;
+        }
+    }
+}
+
+
+/**
+* @brief RTT command: bbox, dump the black-box ring and the last fault snapshot
+**/
+static void System_BlackBoxCmd(char *arg)
+{
+    const BlackBox_Fault_t *pFault = Drv_BlackBox_GetFault();
+    BlackBox_Event_t evts[SYSTEM_TRACE_DUMP_CHUNK];
+    uint16_t first = 0;
+    uint16_t n;
+
+    (void)arg;
+    LOG_I("BlackBox: %d events", Drv_BlackBox_GetCount());
+    // 8字节/条：tick(4, LE) type(1) arg(1) value(2, LE)，最旧在前
+    while((n = Drv_BlackBox_Copy(first, evts, SYSTEM_TRACE_DUMP_CHUNK)) > 0){
+        Log_Hex(LOG_LEVEL_INFO, "bbox", evts, (uint16_t)(n * sizeof(BlackBox_Event_t)));
+        first += n;
+    }
+    if(pFault != NULL){
+        Log_Hex(LOG_LEVEL_INFO, "fault", pFault, sizeof(BlackBox_Fault_t));
+    }
+}
+
+/**
+* @brief RTT command: boot, phase timestamps from main() entry
+**/
+static void System_BootCmd(char *arg)
+{
+    static const char * const s_PhaseName[E_BOOT_PHASE_MAX] =
+    {
+        "main", "drv", "system", "first_rx", "ready", "preload", "si5351",
+    };
+    uint32_t us;
+    uint8_t i;
+
+    (void)arg;
+    for(i = 0; i < E_BOOT_PHASE_MAX; i++){
+        us = Drv_BootTime_GetUs((BootTime_Phase_EnumDef)i);
+        if(us == BOOTTIME_NOT_REACHED){
+            LOG_I("Boot %s: -", s_PhaseName[i]);
+        }else{
+            LOG_I("Boot %s: %d.%03d ms", s_PhaseName[i], us / 1000u, us % 1000u);
+        }
+    }
+}
+
+/**
+* @brief RTT command: meter, delivered power/energy and the per-block cycle budget
+**/
+static void System_MeterCmd(char *arg)
+{
+    const Meter_Stats_t *pStats = Drv_Meter_GetStats();
+
+    (void)arg;
+    LOG_I("Meter RF: %d mW, %d mJ total", Drv_Meter_GetPowerMw(E_METER_CH_RF), Drv_Meter_GetEnergyMj(E_METER_CH_RF));
+    LOG_I("Meter ESW: %d mW, %d mJ total", Drv_Meter_GetPowerMw(E_METER_CH_ESW), Drv_Meter_GetEnergyMj(E_METER_CH_ESW));
+    LOG_I("Meter: scan=%d ns blocks=%d cycles last=%d max=%d budget=%d (%d.%d%%)",
+          pStats->scanNs, pStats->blocks, pStats->lastCycles, pStats->maxCycles, pStats->budgetCycles,
+          pStats->maxCycles * 100u / (pStats->budgetCycles + 1u),
+          (pStats->maxCycles * 1000u / (pStats->budgetCycles + 1u)) % 10u);
+}
+
+/**
+* @brief RTT command: scope <src>... [div <n>] | off | stat, binary samples on RTT channel 1
+* @note  选择命令走共用的命令下行缓冲 0，不另开 scope 下行缓冲（见 drv_scope.h）
+**/
+static void System_ScopeCmd(char *arg)
+{
+    static const char * const s_SourceName[E_SCOPE_SRC_MAX] =
+    {
+        "us_i", "rf_i", "esw_u", "esw_i", "hp_pre", "ntc", "dac", "tgt", "state",
+    };
+    const Scope_Stats_t *pStats = Drv_Scope_GetStats();
+    uint8_t sources[SCOPE_SEL_MAX];
+    uint8_t count = 0;
+    uint8_t div = 1;
+    char *tok;
+    uint8_t i;
+
+    if(strncmp(arg, "stat", 4) == 0){
+        LOG_I("Scope: %d sources every %d us, samples=%d dropped=%d cycles/sample=%d max=%d",
+              Drv_Scope_GetCount(), Drv_Scope_GetPeriodNs() / 1000u, pStats->samples, pStats->dropped,
+              pStats->samples ? pStats->cycles / pStats->samples : 0, pStats->maxCycles);
+        return;
+    }
+    for(tok = strtok(arg, " "); tok != NULL; tok = strtok(NULL, " ")){
+        if(strcmp(tok, "off") == 0){
+            count = 0;
+            break;
+        }
+        if(strcmp(tok, "div") == 0){
+            tok = strtok(NULL, " ");
+            div = (tok != NULL) ? (uint8_t)strtoul(tok, NULL, 10) : 0;
+            continue;
+        }
+        for(i = 0; i < E_SCOPE_SRC_MAX && strcmp(tok, s_SourceName[i]) != 0; i++){
+        }
+        if(i == E_SCOPE_SRC_MAX || count >= SCOPE_SEL_MAX){
+            LOG_W("Scope: unknown source or more than %d: %s", SCOPE_SEL_MAX, tok);
+            return;
+        }
+        sources[count++] = i;
+    }
+    if(!Drv_Scope_Select(sources, count, div)){
+        LOG_W("Scope: bad selection");
+    }else if(count == 0){
+        LOG_I("Scope: off");
+    }else{
+        LOG_I("Scope: %d sources every %d us on RTT channel %d", count, Drv_Scope_GetPeriodNs() / 1000u,
+              SCOPE_RTT_CHANNEL);
+    }
+}
+
+/**
+* @brief RTT command: power [stop <s>], CPU load, sleep/STOP residency, STOP idle delay
+**/
+static void System_PowerCmd(char *arg)
+{
+    const Power_Stats_t *pStats = Drv_Power_GetStats();
+
+    if(strncmp(arg, "stop", 4) == 0){
+        s_stopIdleMs = (uint32_t)strtoul(arg + 4, NULL, 10) * 1000u;
+    }
+    LOG_I("Power: load=%d.%d%% peak=%d.%d%% sleeps=%d",
+          pStats->loadPermille / 10, pStats->loadPermille % 10,
+          pStats->peakPermille / 10, pStats->peakPermille % 10, pStats->sleeps);
+    LOG_I("Power: stops=%d stop=%dms (%d%% of uptime) lastWake=0x%02X stopAfter=%ds",
+          pStats->stops, pStats->stopMs,
+          (int)((uint64_t)pStats->stopMs * 100u / (Drv_Delay_GetTickMs() + 1u)),
+          pStats->lastWake, s_stopIdleMs / 1000u);
+    LOG_I("Power: supply warnings=%d low=%d", pStats->supplyWarnings, Drv_Power_IsSupplyLow());
+}
+
+/**
+* @brief 无探头、无治疗、无脚踏、风扇停且主机静默时才允许进入STOP
+**/
+static bool System_IsStandbyIdle(void)
+{
+    return s_SystemMgr.eMode == E_SYSTEM_NORMAL_MODE &&
+           App_TreatMgr_GetState() == E_TREATMGR_STATE_IDLE &&
+           Drv_IODevice_GetProbeStatus() == E_IODEVICE_MODE_NOT_CONNECTED &&
+           !Drv_IODevice_GetFootSwitchState() &&
+           !App_TreatMgr_IsFanOn();
+}
+
+/**
+* @brief 空闲超过s_stopIdleMs后进入STOP，每SYSTEM_STOP_POLL_MS由RTC唤醒喂狗（IO_SYN_US由BSP每20ms采样）；
+*        脚踏、同步信号、USART1接收或输入电平变化时退出（唤醒帧丢失，由主机重发）
+**/
+static void System_PowerManage(void)
+{
+    uint32_t now = Drv_Delay_GetTickMs();
+    uint32_t start;
+    uint8_t wake;
 
+    if(!System_IsStandbyIdle()){
+        s_busySinceMs = now;
+        return;
+    }
+    if(s_stopIdleMs == 0 || now - s_busySinceMs < s_stopIdleMs ||
+       now - App_Comm_GetLastRxMs() < s_stopIdleMs){
+        return;
+    }
+    LOG_I("Standby: no activity for %ds, entering STOP", s_stopIdleMs / 1000u);
+    start = now;
+    do{
+        wake = Drv_Power_Stop(SYSTEM_STOP_POLL_MS);
+    }while(wake == DRV_POWER_WAKE_TIMER);
+    s_busySinceMs = Drv_Delay_GetTickMs();
+    LOG_I("Standby: woke after %dms, reason 0x%02X", s_busySinceMs - start, wake);
+}
 
+/**
+* @brief 上次运行的黑匣子（看门狗/软件/故障复位后仍保留）压缩写入EEPROM，供协议下载
+**/
+static void System_PersistBlackBox(void)
+{
+    static uint8_t s_image[BLACKBOX_EXPORT_MAX];
+    const BlackBox_Fault_t *pFault = Drv_BlackBox_GetFault();
+    uint16_t len;
+
+    if(!Drv_BlackBox_HasHistory()){
+        return;
+    }
+    if(pFault != NULL){
+        LOG_E("Last reset by fault: exc=%d pc=0x%08X lr=0x%08X cfsr=0x%08X hfsr=0x%08X",
+              pFault->exception, pFault->frame[6], pFault->frame[5], pFault->cfsr, pFault->hfsr);
+    }
+    len = Drv_BlackBox_Export(s_image, sizeof(s_image));
+    if(len > 0 && App_Memory_SaveBlackBox(s_image, len)){
+        Drv_BlackBox_ClearFault();
+        LOG_I("BlackBox: %d events persisted (%d bytes)", Drv_BlackBox_GetCount(), len);
+    }else{
+        LOG_W("BlackBox: persist failed");
+    }
+}
+
+/**
+* @brief 上电后的非关键工作，在主循环中逐步完成：黑匣子持久化、参数块预读
+**/
+static void System_BackgroundInit(void)
+{
+    static uint8_t s_step = 0;
+
+    switch(s_step)
+    {
+        case 0:
+            System_PersistBlackBox();
+            s_step++;
+            break;
+        case 1:
+            if(App_Memory_Preload()){
+                Drv_BootTime_Mark(E_BOOT_PHASE_PRELOAD);
+                s_step++;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+* @brief 新镜像在正常模式下稳定运行UPDATE_CONFIRM_MS后确认，否则数次复位后回退
+**/
+static void System_ConfirmImage(void)
+{
+    static bool s_checked = false;
+
+    if(!s_checked && Drv_Delay_GetTickMs() >= UPDATE_CONFIRM_MS){
+        s_checked = true;
+        App_Update_Confirm();
+    }
+}
+
+System_Mode_EnumDef System_GetMode(void)
+{
+    return s_SystemMgr.eMode;
+}
 
 void System_ChangeMode(System_Mode_EnumDef newMode)
 {
@@ -40,12 +337,24 @@ void System_ChangeMode(System_Mode_EnumDef newMode)
 
 void System_Init(void)
 {
+    // 黑匣子读取并清除复位标志，复位原因只在此读取一次
+    uint32_t resetFlags = Drv_BlackBox_Init();
+
     Log_Init();
-    Drv_WatchDogResartCheck();
+    Log_RegisterFunction("trace", System_TraceCmd);
+    Log_RegisterFunction("bbox", System_BlackBoxCmd);
+    Log_RegisterFunction("power", System_PowerCmd);
+    Log_RegisterFunction("boot", System_BootCmd);
+    Log_RegisterFunction("meter", System_MeterCmd);
+    Log_RegisterFunction("scope", System_ScopeCmd);
+    Drv_Trace_Start(E_TRACE_MODE_RECORD);
+    Drv_WatchDogResartCheck(resetFlags);
     cm_backtrace_init(FIRMWARE_NAME, FIRMWARE_VERSION, HARDWARE_VERSION);
     LOG_I("&&&&&&&&&&&&&&&&& BOOT LOADER &&&&&&&&&&&&&&&&&");
     LOG_I("System initialized.");
     LOG_I("Firmware: %s, Version: %s, Hardware: %s", FIRMWARE_NAME, FIRMWARE_VERSION, HARDWARE_VERSION);        
+    App_Memory_Init();
+    App_Update_Init();
 
     // Initialize the treatment manager
     App_TreatMgr_Init();
@@ -58,14 +367,20 @@ void SystemManager(void)
     {
         case E_SYSTEM_STANDBY_MODE:
             // Handle standby mode
+            App_Comm_Process();
             System_ChangeMode(E_SYSTEM_NORMAL_MODE);
             break;
         case E_SYSTEM_NORMAL_MODE:
             // Handle normal mode
+            App_Comm_Process();
             App_TreatMgr_Process();
+            System_ConfirmImage();
+            System_PowerManage();
             break;
         case E_SYSTEM_UPDATE_MODE:
-            // Handle update mode
+            // 治疗暂停，只处理通信与升级擦写
+            App_Comm_Process();
+            App_Update_Process();
             break;
         case E_SYSTEM_MODE_MAX:
         default:
@@ -81,8 +396,16 @@ void SystemManager(void)
 **/
 void SystemProcess(void)
 {
+    static Drv_Timer_t LogTimer;
+
+    if(Drv_Timer_Tick(&LogTimer, SYSTEM_LOG_TASK_TIME)){
+        Log_Process(SYSTEM_LOG_TASK_TIME);
+    }
     SystemManager();
+    System_BackgroundInit();
     Drv_WatchDogFeed();
+    // 升级模式下Flash擦写与接收并行，有页待擦写时不睡眠
+    Drv_Power_Idle(s_SystemMgr.eMode != E_SYSTEM_UPDATE_MODE || !App_Update_IsBusy());
 }
 /**************************End of file********************************/
 
@@ -52,6 +52,8 @@ typedef struct
 
 void System_Init(void);
 void SystemProcess(void);
+void System_ChangeMode(System_Mode_EnumDef newMode);
+System_Mode_EnumDef System_GetMode(void);
 #ifdef __cplusplus
 }
 #endif
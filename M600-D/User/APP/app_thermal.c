@@ -0,0 +1,178 @@
+/***********************************************************************************
+* @file     : app_thermal.c
+* @brief    : Predictive thermal derating implementation
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#include "app_thermal.h"
+#include "app_comm.h"
+#include "log.h"
+
+/* 先验：tau约180s，满功率稳态温升约20℃；a = exp(-1/180)，b = 20 * (1 - a) */
+#define THERMAL_PRIOR_A             0.99446f
+#define THERMAL_PRIOR_B             0.1108f
+#define THERMAL_PRIOR_VAR_A         2.5e-5f     ///< tau约60~600s
+#define THERMAL_PRIOR_VAR_B         1.0e-1f     ///< 稳态温升约5~50℃，tau可短至约60s
+#define THERMAL_A_MIN               0.95f       ///< tau >= 20s
+#define THERMAL_A_MAX               0.9995f     ///< tau <= 2000s
+#define THERMAL_B_MIN               0.005f
+#define THERMAL_B_MAX               1.0f
+#define THERMAL_LAMBDA              0.995f      ///< 遗忘因子，约200个周期
+#define THERMAL_P_MAX               1.0f        ///< 激励不足时协方差不再放大
+
+static bool App_Thermal_IsSensorError(uint16_t temp)
+{
+    return temp == TEMP_ERROR_NTC_OPEN || temp == TEMP_ERROR_NTC_SHORT;
+}
+
+static float App_Thermal_Clamp(float v, float min, float max)
+{
+    return (v < min) ? min : ((v > max) ? max : v);
+}
+
+/**
+ * @brief 递推最小二乘：rise = a * lastRise + b * lastPower
+ */
+static void App_Thermal_Fit(App_Thermal_t *p, float rise)
+{
+    float x0 = p->lastRise;
+    float x1 = p->lastPower;
+    float px0 = p->P[0][0] * x0 + p->P[0][1] * x1;
+    float px1 = p->P[1][0] * x0 + p->P[1][1] * x1;
+    float k0 = px0 / (THERMAL_LAMBDA + x0 * px0 + x1 * px1);
+    float k1 = px1 / (THERMAL_LAMBDA + x0 * px0 + x1 * px1);
+    float err = rise - (p->a * x0 + p->b * x1);
+    float lambda = THERMAL_LAMBDA;
+
+    p->a = App_Thermal_Clamp(p->a + k0 * err, THERMAL_A_MIN, THERMAL_A_MAX);
+    p->b = App_Thermal_Clamp(p->b + k1 * err, THERMAL_B_MIN, THERMAL_B_MAX);
+    if(p->P[0][0] + p->P[1][1] > THERMAL_P_MAX){
+        lambda = 1.0f;
+    }
+    p->P[0][0] = (p->P[0][0] - k0 * px0) / lambda;
+    p->P[0][1] = (p->P[0][1] - k0 * px1) / lambda;
+    p->P[1][0] = (p->P[1][0] - k1 * px0) / lambda;
+    p->P[1][1] = (p->P[1][1] - k1 * px1) / lambda;
+}
+
+/**
+ * @brief 功率保持不变时到达上限温升所需周期数
+ */
+static uint16_t App_Thermal_Forecast(const App_Thermal_t *p, float rise, float limitRise, float power)
+{
+    uint16_t n;
+
+    if(rise >= limitRise){
+        return 0;
+    }
+    // 稳态温升不超过上限则不会到达
+    if(p->b * power <= limitRise * (1.0f - p->a)){
+        return THERMAL_FORECAST_NONE;
+    }
+    for(n = 1; n <= THERMAL_FORECAST_MAX_S; n++){
+        rise = p->a * rise + p->b * power;
+        if(rise >= limitRise){
+            return n;
+        }
+    }
+    return THERMAL_FORECAST_NONE;
+}
+
+void App_Thermal_Start(App_Thermal_t *pThermal, uint16_t temp)
+{
+    memset(pThermal, 0, sizeof(App_Thermal_t));
+    pThermal->a = THERMAL_PRIOR_A;
+    pThermal->b = THERMAL_PRIOR_B;
+    pThermal->P[0][0] = THERMAL_PRIOR_VAR_A;
+    pThermal->P[1][1] = THERMAL_PRIOR_VAR_B;
+    pThermal->ambient = App_Thermal_IsSensorError(temp) ? 0.0f : temp / 10.0f;
+    pThermal->scale = THERMAL_SCALE_FULL;
+    pThermal->minScale = THERMAL_SCALE_FULL;
+    pThermal->forecastS = THERMAL_FORECAST_NONE;
+}
+
+uint16_t App_Thermal_Update(App_Thermal_t *pThermal, uint16_t temp, uint16_t limit,
+                            uint16_t applied, uint16_t nominal)
+{
+    float rise;
+    float target;
+    float an = 1.0f;
+    float cap;
+    int32_t want;
+    uint8_t i;
+
+    if(App_Thermal_IsSensorError(temp)){
+        pThermal->primed = false;
+        return pThermal->scale;
+    }
+    rise = temp / 10.0f - pThermal->ambient;
+    if(pThermal->primed){
+        App_Thermal_Fit(pThermal, rise);
+    }
+    pThermal->lastRise = rise;
+    pThermal->lastPower = applied / (float)THERMAL_SCALE_FULL;
+    pThermal->primed = true;
+
+    // 时域末温升恰为目标时的恒定功率：rise_n = a^n * rise + b * u * (1 - a^n) / (1 - a)
+    target = (limit - THERMAL_MARGIN) / 10.0f - pThermal->ambient;
+    for(i = 0; i < THERMAL_HORIZON_S * 1000u / THERMAL_PERIOD_MS; i++){
+        an *= pThermal->a;
+    }
+    cap = (target - an * rise) * (1.0f - pThermal->a) / (pThermal->b * (1.0f - an));
+    want = THERMAL_SCALE_FULL;
+    if(nominal != 0 && cap * THERMAL_SCALE_FULL < nominal){
+        want = (cap <= 0.0f) ? 0 : (int32_t)(cap * THERMAL_SCALE_FULL * THERMAL_SCALE_FULL / nominal);
+    }
+    if(want < THERMAL_SCALE_MIN){
+        want = THERMAL_SCALE_MIN;
+    }
+
+    // 平滑：下降快、回升慢
+    if(want < pThermal->scale - THERMAL_SLEW_DOWN){
+        want = pThermal->scale - THERMAL_SLEW_DOWN;
+    }else if(want > pThermal->scale + THERMAL_SLEW_UP){
+        want = pThermal->scale + THERMAL_SLEW_UP;
+    }
+    pThermal->scale = (uint16_t)want;
+    if(pThermal->scale < pThermal->minScale){
+        pThermal->minScale = pThermal->scale;
+    }
+    pThermal->forecastS = App_Thermal_Forecast(pThermal, rise, limit / 10.0f - pThermal->ambient,
+                                               (float)nominal * pThermal->scale / (THERMAL_SCALE_FULL * THERMAL_SCALE_FULL));
+
+    if(!pThermal->derating && pThermal->scale < THERMAL_SCALE_FULL){
+        pThermal->derating = true;
+        LOG_I("Thermal: derating at %d (limit %d), tau %d s, gain %d C", temp, limit,
+              (int)(1.0f / (1.0f - pThermal->a)), (int)(pThermal->b / (1.0f - pThermal->a)));
+    }else if(pThermal->derating && pThermal->scale == THERMAL_SCALE_FULL){
+        pThermal->derating = false;
+        LOG_I("Thermal: full power again, lowest scale %d", pThermal->minScale);
+    }
+    return pThermal->scale;
+}
+
+uint16_t App_Thermal_SqrtScale(uint16_t scale)
+{
+    uint32_t v = (uint32_t)scale * THERMAL_SCALE_FULL;
+    uint32_t r = 0;
+    uint32_t bit = 1u << 20;
+
+    while(bit > v){
+        bit >>= 2;
+    }
+    while(bit != 0){
+        if(v >= r + bit){
+            v -= r + bit;
+            r = (r >> 1) + bit;
+        }else{
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint16_t)r;
+}
+
+/**************************End of file********************************/
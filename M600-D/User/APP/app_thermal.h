@@ -0,0 +1,69 @@
+/************************************************************************************
+* @file     : app_thermal.h
+* @brief    : Predictive thermal derating
+* @details  : 每个治疗模式一个一阶热模型：温升(相对会话开始时的治疗头温度)
+*             rise[k+1] = a * rise[k] + b * power[k]，Ts = THERMAL_PERIOD_MS，
+*             a、b由递推最小二乘在线拟合（先验为典型治疗头）。按模型预测
+*             THERMAL_HORIZON_S 内的温升，求出不超过“上限-余量”的最大功率，
+*             以降额系数平滑交给模式（超声拉长脉冲周期、射频降电压、冲击波降发射率），
+*             使治疗头稳定在上限以下继续治疗。原有温度上限停机保留为兜底。
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_THERMAL_H
+#define APP_THERMAL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#define THERMAL_PERIOD_MS           1000    ///< 模型采样与降额周期 (ms)
+#define THERMAL_SCALE_FULL          1000    ///< 降额系数满值（千分比），功率同此单位
+#define THERMAL_SCALE_MIN           200     ///< 最低降额系数，仍超限由温度上限停机兜底
+#define THERMAL_MARGIN              10      ///< 控制目标低于温度上限的余量 (0.1℃)
+#define THERMAL_HORIZON_S           60      ///< 功率上限的预测时域 (s)
+#define THERMAL_FORECAST_MAX_S      600     ///< 到达上限时间的最长预测 (s)
+#define THERMAL_SLEW_DOWN           100     ///< 降额系数每周期最多下降（千分比）
+#define THERMAL_SLEW_UP             20      ///< 降额系数每周期最多回升（千分比）
+#define THERMAL_FORECAST_NONE       0xFFFF  ///< 当前功率下不会到达上限
+
+typedef struct
+{
+    float a;                       ///< 温升保持系数 exp(-Ts/tau)
+    float b;                       ///< 满功率时每周期温升 (℃)
+    float P[2][2];                 ///< 递推最小二乘协方差
+    float ambient;                 ///< 会话开始时的治疗头温度 (℃)
+    float lastRise;                ///< 上一周期温升 (℃)
+    float lastPower;               ///< 上一周期施加功率 (0-1)
+    bool primed;                   ///< 已有上一周期样本
+    bool derating;
+    uint16_t scale;                ///< 降额系数（千分比）
+    uint16_t minScale;             ///< 本次会话最低降额系数
+    uint16_t forecastS;            ///< 当前功率下到达上限的预计时间 (s)
+} App_Thermal_t;
+
+/** 会话开始：当前温度 (0.1℃) 作为环境温度，模型回到先验 */
+void App_Thermal_Start(App_Thermal_t *pThermal, uint16_t temp);
+/**
+ * 每THERMAL_PERIOD_MS调用一次，返回新的降额系数（千分比）
+ * @param temp 治疗头温度 (0.1℃)，NTC开路/短路时保持原系数
+ * @param limit 温度上限 (0.1℃)
+ * @param applied 上一周期实际施加的功率（千分比，相对本模式满功率）
+ * @param nominal 当前档位不降额时的功率（千分比）
+ */
+uint16_t App_Thermal_Update(App_Thermal_t *pThermal, uint16_t temp, uint16_t limit,
+                            uint16_t applied, uint16_t nominal);
+/** sqrt(scale/1000)，千分比：按功率降额电压时用 */
+uint16_t App_Thermal_SqrtScale(uint16_t scale);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_THERMAL_H
+/**************************End of file********************************/
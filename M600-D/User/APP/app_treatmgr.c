@@ -16,74 +16,32 @@
 #include "app_radiofreq.h"
 #include "app_negprsheat.h"
 #include "drv_delay.h"
+#include "drv_protect.h"
+#include "drv_blackbox.h"
+#include "drv_si5351.h"
+#include "drv_boottime.h"
+#include "drv_probeid.h"
+#include "app_usage.h"
+#include "app_fan.h"
 
 TreatMgr_t s_TreatMgr;
 
-/* 板上温度监控参数 */
-#define BOARD_TEMP_FAN_ON_THRESHOLD     850     ///< 风扇启动温度阈值 (85℃ = 850 * 0.1°C)
-#define BOARD_TEMP_FAN_OFF_THRESHOLD    800     ///< 风扇关闭温度阈值 (80℃ = 800 * 0.1°C)，添加回差避免频繁开关
-#define BOARD_TEMP_MONITOR_PERIOD_MS    1000    ///< 板上温度监控周期 (1s)
-
 /**
- * @brief Read board temperature from Heat_REF01 and Heat_REF02
- * @retval Board temperature in 0.1°C, returns average of two sensors
- * @note 需要根据实际温度传感器特性进行校准
- *       如果是NTC热敏电阻，需要使用Steinhart-Hart方程或查表法
- *       如果是线性传感器，使用线性转换公式
+ * @brief 当前模式的输出功率（千分比），作为风扇前馈；负压加热的热量在治疗头，不计入
  */
-static uint16_t App_TreatMgr_ReadBoardTemp(void)
+static uint16_t App_TreatMgr_GetOutputPermille(void)
 {
-    uint16_t temp1_voltage = Drv_ADC_ReadVoltage(E_ADC_CHANNEL_Heat_REF01);
-    uint16_t temp2_voltage = Drv_ADC_ReadVoltage(E_ADC_CHANNEL_Heat_REF02);
-    
-    // TODO: 根据实际温度传感器特性转换电压到温度
-    // 这里使用简化的线性转换作为占位实现
-    // 实际需要根据传感器规格书进行校准：
-    // - 如果是NTC热敏电阻：需要使用Steinhart-Hart方程或查表法
-    // - 如果是线性传感器：使用线性转换公式
-    // - 如果是其他类型传感器：根据其特性曲线转换
-    
-    // 取两个传感器的平均值（如果两个传感器都有效）
-    uint16_t avg_voltage = (temp1_voltage + temp2_voltage) / 2;
-    
-    // 简化的线性转换（需要根据实际硬件校准）
-    // 假设：0V = 0℃，3.3V = 100℃ = 1000 * 0.1°C
-    // 温度 = (voltage_mv * 1000) / 3300
-    // 注意：这个转换公式是占位实现，需要根据实际传感器特性替换
-    uint16_t board_temp = (avg_voltage * 1000) / 3300;
-    
-    return board_temp;
-}
-
-/**
- * @brief Control fan based on board temperature
- */
-static void App_TreatMgr_ControlFan(void)
-{
-    static bool fanState = false;
-    uint16_t boardTemp = App_TreatMgr_ReadBoardTemp();
-    
-    if(boardTemp > BOARD_TEMP_FAN_ON_THRESHOLD)
-    {
-        // 温度超过85℃，启动风扇
-        if(!fanState)
-        {
-            Drv_IODevice_WritePin(E_GPIO_OUT_CTR_FAN, 1);
-            fanState = true;
-            LOG_I("Board temperature too high (%d * 0.1°C), fan started", boardTemp);
-        }
-    }
-    else if(boardTemp < BOARD_TEMP_FAN_OFF_THRESHOLD)
+    switch(s_TreatMgr.eState)
     {
-        // 温度低于80℃，关闭风扇（添加回差避免频繁开关）
-        if(fanState)
-        {
-            Drv_IODevice_WritePin(E_GPIO_OUT_CTR_FAN, 0);
-            fanState = false;
-            LOG_I("Board temperature normal (%d * 0.1°C), fan stopped", boardTemp);
-        }
+        case E_TREATMGR_STATE_ULTRASOUND:
+            return App_UltraSound_GetOutputPermille();
+        case E_TREATMGR_STATE_RADIO_FREQUENCY:
+            return App_RadioFreq_GetOutputPermille();
+        case E_TREATMGR_STATE_SHOCK_WAVE:
+            return App_Shockwave_GetOutputPermille();
+        default:
+            return 0;
     }
-    // 在80-85℃之间保持当前状态
 }
 
 void App_TreatMgr_Init(void)
@@ -98,6 +56,7 @@ void App_TreatMgr_ChangeState(TreatMgr_State_EnumDef newState)
     {
         s_TreatMgr.eState = newState;
         s_TreatMgr.preState = s_TreatMgr.eState;
+        Drv_BlackBox_Record(E_BB_EVT_STATE, 0, newState);
         switch(newState)
         {
             case E_TREATMGR_STATE_IDLE:
@@ -118,26 +77,89 @@ void App_TreatMgr_ChangeState(TreatMgr_State_EnumDef newState)
             case E_TREATMGR_STATE_ERROR:
                 LOG_I("TreatMgr state changed to ERROR");
                 break;
+            default:
+                break;
         }
     }
 }
 
+TreatMgr_State_EnumDef App_TreatMgr_GetState(void)
+{
+    return s_TreatMgr.eState;
+}
+
+bool App_TreatMgr_IsFanOn(void)
+{
+    return App_Fan_GetDuty() != 0;
+}
+
+
+/**
+ * @brief SI5351只有超声/射频用到，探头识别后才编程，不占用上电时间
+ */
+static void App_TreatMgr_PrepareClock(void)
+{
+    if(!Drv_SI5351_IsReady())
+    {
+        Drv_SI5351_Init();
+        Drv_BootTime_Mark(E_BOOT_PHASE_SI5351);
+    }
+}
+
+/**
+ * @brief 探头EEPROM识别结果：每个10ms节拍最多一次总线读，完成时打印一次
+ */
+static void App_TreatMgr_ProbeIdentify(void)
+{
+    const ProbeId_Info_t *pInfo;
+
+    if(!Drv_ProbeId_Process())
+    {
+        return;
+    }
+    pInfo = Drv_ProbeId_Get();
+    if(pInfo != NULL)
+    {
+        LOG_I("Probe id: SN %s model %d crc %04X state %d (%d ms, %d cached hits)",
+              pInfo->snLen ? pInfo->sn : "-", pInfo->model, pInfo->crc, Drv_ProbeId_GetState(),
+              Drv_ProbeId_GetStats()->lastMs, Drv_ProbeId_GetStats()->hits);
+    }
+    else if(Drv_ProbeId_GetState() == E_PROBEID_CORRUPT)
+    {
+        LOG_E("Probe id: calibration CRC error, treatment blocked");
+    }
+    else
+    {
+        LOG_W("Probe id: no EEPROM answer, host parameters only");
+    }
+}
 
 void ProbeStatusCheck()
 {
     s_TreatMgr.eProbeStatus = Drv_IODevice_GetProbeStatus();
     if(s_TreatMgr.eProbeStatus != s_TreatMgr.preProbeStaus){
         s_TreatMgr.preProbeStaus = s_TreatMgr.eProbeStatus;
+        // 插入（或更换）治疗头后重新识别，拔出时清除
+        if(s_TreatMgr.eProbeStatus == E_IODEVICE_MODE_NOT_CONNECTED || s_TreatMgr.eProbeStatus == E_IODEVICE_MODE_ERROR)
+        {
+            Drv_ProbeId_Detach();
+        }
+        else
+        {
+            Drv_ProbeId_Attach();
+        }
         switch(s_TreatMgr.eProbeStatus)
         {
             case E_IODEVICE_MODE_ULTRASOUND:
                 LOG_I("Probe status changed to ULTRASOUND");
+                App_TreatMgr_PrepareClock();
                 break;
             case E_IODEVICE_MODE_SHOCKWAVE:
                 LOG_I("Probe status changed to SHOCKWAVE");
                 break;
             case E_IODEVICE_MODE_RADIO_FREQUENCY:
                 LOG_I("Probe status changed to RADIO_FREQUENCY");
+                App_TreatMgr_PrepareClock();
                 break;
             case E_IODEVICE_MODE_NEGATIVE_PRESSURE_HEAT:
                 LOG_I("Probe status changed to NEGATIVE_PRESSURE_HEAT");
@@ -153,6 +175,21 @@ void ProbeStatusCheck()
                 break;
         }
     }
+    App_TreatMgr_ProbeIdentify();
+}
+
+/**
+ * @brief Drain debounced input events queued by the EXTI/SysTick handlers
+ */
+static void App_TreatMgr_ProcessIOEvents(void)
+{
+    IODevice_Event_t evt;
+
+    while(Drv_IODevice_PopEvent(&evt))
+    {
+        LOG_D("IO event: input=%d level=%d latency=%d ms",
+              evt.input, evt.level, evt.stable_ms - evt.edge_ms);
+    }
 }
 
 // void App_TreatMgr_ChangeCheck(IODevice_WorkingMode_EnumDef curProbe) 
@@ -165,24 +202,34 @@ void ProbeStatusCheck()
 void App_TreatMgr_Process(void)
 {
     static Drv_Timer_t TreatMgrTimer;
-    static Drv_Timer_t BoardTempMonitorTimer;
 
     // 处理蜂鸣器控制（每次循环都处理，确保及时响应）
     Drv_IODevice_ProcessBuzzer();
+    // 探头使用记录：电源跌落预警须在本轮响应
+    App_Usage_Process();
     
     if(Drv_Timer_Tick(&TreatMgrTimer, TREAT_TASK_TIME) == false){
         return;
     }
     // Process the treatment manager module
+    App_TreatMgr_ProcessIOEvents();
     ProbeStatusCheck();
     
-    // 板上温度监控和风扇控制（1s周期）
-    if(Drv_Timer_Tick(&BoardTempMonitorTimer, BOARD_TEMP_MONITOR_PERIOD_MS)){
-        App_TreatMgr_ControlFan();
-    }
+    // 板温调速，输出功率前馈
+    App_Fan_Process(App_TreatMgr_GetOutputPermille());
     switch(s_TreatMgr.eState)
     {
         case E_TREATMGR_STATE_IDLE:
+            // 过流跳闸后保持空闲，松开脚踏后才解除锁存
+            if(Drv_Protect_IsTripped())
+            {
+                if(Drv_IODevice_GetFootSwitchState() == false)
+                {
+                    Drv_Protect_Clear();
+                    LOG_W("Over current latch cleared (trips: %d)", Drv_Protect_GetFault()->trip_count);
+                }
+                break;
+            }
             // Handle idle state
             switch(s_TreatMgr.eProbeStatus)
             {
@@ -47,6 +47,8 @@ typedef struct
 void App_TreatMgr_Init(void);
 void App_TreatMgr_Process(void);
 void App_TreatMgr_ChangeState(TreatMgr_State_EnumDef newState);
+TreatMgr_State_EnumDef App_TreatMgr_GetState(void);
+bool App_TreatMgr_IsFanOn(void);
 
 #ifdef __cplusplus
 }
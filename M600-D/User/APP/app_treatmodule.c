@@ -0,0 +1,294 @@
+/***********************************************************************************
+* @file     : app_treatmodule.c
+* @brief    : Generic treatment module engine implementation
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#include "app_treatmodule.h"
+#include "app_treatmgr.h"
+#include "app_comm.h"
+#include "app_program.h"
+#include "drv_iodevice.h"
+#include "drv_protect.h"
+#include "drv_blackbox.h"
+#include "drv_probeid.h"
+/* 引擎日志归入当前模式的域：本文件每个LOG_*调用处都有pDesc */
+#define LOG_DOMAIN  (pDesc->logDomain)
+#include "log.h"
+
+static const char * const s_TreatModuleStateName[E_TREAT_RUN_MAX] =
+{
+    "INIT", "IDLE", "PREPARE", "WORKING", "STOP",
+};
+
+void App_TreatModule_ChangeState(const TreatModule_Desc_t *pDesc, TreatModule_RunState_EnumDef newState)
+{
+    TreatModule_Ctx_t *pCtx = pDesc->pCtx;
+
+    if(newState == pCtx->runState || newState >= E_TREAT_RUN_MAX) {
+        return;
+    }
+    pCtx->runState = newState;
+    LOG_I("%s state changed to %s", pDesc->pName, s_TreatModuleStateName[newState]);
+    Drv_BlackBox_Record(E_BB_EVT_STATE, pDesc->commModule, newState);
+
+    if(newState == E_TREAT_RUN_WORKING) {
+        App_Session_Resume(pDesc->pSession);
+        // 启动工作时蜂鸣器提示（2s）
+        Drv_IODevice_StartBuzzer(TREAT_MODULE_BUZZER_MS);
+    } else if(newState == E_TREAT_RUN_STOP) {
+        App_Session_Stop(pDesc->pSession);
+        // 结束工作时蜂鸣器提示（2s）
+        Drv_IODevice_StartBuzzer(TREAT_MODULE_BUZZER_MS);
+    }
+}
+
+static void App_TreatModule_Monitor(const TreatModule_Desc_t *pDesc)
+{
+    // Get the foot switch status and probe status
+    pDesc->pCtx->FootSwitchStatus = Drv_IODevice_GetFootSwitchState();
+    pDesc->pCtx->probeStatus = Drv_IODevice_GetProbeStatus();
+}
+
+static void App_TreatModule_UpdateStatus(const TreatModule_Desc_t *pDesc)
+{
+    TreatModule_Ctx_t *pCtx = pDesc->pCtx;
+    uint8_t connState;
+    uint8_t programStep;
+    uint16_t stepRemain;
+    bool headConnected = (pCtx->probeStatus == pDesc->probe);
+
+    // Update work state
+    if(pCtx->runState == E_TREAT_RUN_WORKING) {
+        App_Comm_PublishStatusU8(pDesc->commModule, pDesc->workStateOffset, 0x01);
+    } else if(pCtx->runState == E_TREAT_RUN_STOP) {
+        App_Comm_PublishStatusU8(pDesc->commModule, pDesc->workStateOffset, 0x00);
+    }
+
+    // Combine connection state: bit[4]=head connection, bit[0]=foot switch
+    if (headConnected && pCtx->FootSwitchStatus) {
+        connState = CONN_STATE_CONNECTED_FOOT_CLOSED;
+    } else if (!headConnected && pCtx->FootSwitchStatus) {
+        connState = CONN_STATE_DISCONNECTED_FOOT_CLOSED;
+    } else if (headConnected && !pCtx->FootSwitchStatus) {
+        connState = CONN_STATE_CONNECTED_FOOT_OPEN;
+    } else {
+        connState = CONN_STATE_DISCONNECTED_FOOT_OPEN;
+    }
+    App_Comm_PublishStatusU8(pDesc->commModule, pDesc->connStateOffset, connState);
+    // 错误码变化时记入黑匣子
+    if(App_Comm_PublishStatusU8(pDesc->commModule, pDesc->errorCodeOffset, pCtx->ErrorCode) && pCtx->ErrorCode != 0) {
+        Drv_BlackBox_Record(E_BB_EVT_ERROR, pDesc->commModule, pCtx->ErrorCode);
+    }
+    // 治疗程序进度
+    App_Program_GetProgress(pDesc->commModule, &programStep, &stepRemain);
+    App_Comm_PublishStatusU8(pDesc->commModule, pDesc->programStepOffset, programStep);
+    App_Comm_PublishStatusU16(pDesc->commModule, pDesc->stepRemainOffset, stepRemain);
+
+    if(pDesc->pfUpdateStatus != NULL) {
+        pDesc->pfUpdateStatus();
+    }
+}
+
+/**
+ * @brief 启动条件检查：脚踏、治疗头由引擎统一检查，其余交给模式钩子
+ */
+bool App_TreatModule_StartCheck(const TreatModule_Desc_t *pDesc)
+{
+    TreatModule_Ctx_t *pCtx = pDesc->pCtx;
+
+    // 检查脚踏开关是否闭合
+    if(pCtx->FootSwitchStatus == false) {
+        LOG_E("%s: Foot switch is not closed", pDesc->pName);
+        pCtx->ErrorCode = pDesc->errInvalid;
+        return false;
+    }
+
+    // 检查是否正确识别到本模式治疗头
+    if(pCtx->probeStatus != pDesc->probe) {
+        LOG_E("%s: Probe not connected", pDesc->pName);
+        pCtx->ErrorCode = pDesc->errProbe;
+        return false;
+    }
+
+    // 治疗头身份识别未完成，或探头标定数据CRC错误
+    if(!Drv_ProbeId_IsUsable()) {
+        LOG_E("%s: Probe identity %s", pDesc->pName,
+              Drv_ProbeId_GetState() == E_PROBEID_BUSY ? "pending" : "corrupt");
+        pCtx->ErrorCode = pDesc->errProbe;
+        return false;
+    }
+
+    if(pDesc->pfStartCheck != NULL) {
+        return pDesc->pfStartCheck();
+    }
+    return true;
+}
+
+/**
+ * @brief 治疗程序：按已输出时长定位步骤，档位/频率变化时交给模式钩子
+ * @retval false 程序已执行完
+ */
+static bool App_TreatModule_RunProgram(const TreatModule_Desc_t *pDesc)
+{
+    Program_Target_t target;
+    Program_Result_EnumDef result;
+
+    if(pDesc->pfApplyStep == NULL) {
+        return true;
+    }
+    result = App_Program_Process(pDesc->commModule, App_Session_GetEnergisedMs(pDesc->pSession), &target);
+    if(result == E_PROGRAM_END) {
+        LOG_I("%s: Program completed", pDesc->pName);
+        return false;
+    }
+    if(result == E_PROGRAM_APPLY) {
+        pDesc->pfApplyStep(target.level, target.frequency);
+    }
+    return true;
+}
+
+/**
+ * @brief 已下发治疗程序时由程序给出治疗时长，输出前先设置第一步
+ */
+static void App_TreatModule_StartProgram(const TreatModule_Desc_t *pDesc)
+{
+    if(pDesc->pfApplyStep == NULL || !App_Program_IsArmed(pDesc->commModule)) {
+        return;
+    }
+    App_Session_SetBudget(pDesc->pSession, App_Program_Start(pDesc->commModule));
+    App_TreatModule_RunProgram(pDesc);
+}
+
+static void App_TreatModule_StartOutput(const TreatModule_Desc_t *pDesc)
+{
+    // 切换至本模式输出通道
+    Drv_IODevice_ChangeChannel(pDesc->channel);
+    // 硬件过流保护
+    if(pDesc->protectChannel < E_ADC_CHANNEL_MAX && pDesc->pfProtectLimit != NULL) {
+        Drv_Protect_Arm(pDesc->protectChannel, pDesc->pfProtectLimit());
+    }
+    App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_WORKING);
+}
+
+static void App_TreatModule_RunPrepare(const TreatModule_Desc_t *pDesc)
+{
+    TreatModule_Prepare_EnumDef result = E_TREAT_PREPARE_DONE;
+
+    if(pDesc->pfPrepare != NULL) {
+        result = pDesc->pfPrepare();
+    }
+    if(result == E_TREAT_PREPARE_DONE) {
+        App_TreatModule_StartOutput(pDesc);
+    } else if(result == E_TREAT_PREPARE_FAIL) {
+        App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_STOP);
+    } else {
+        App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_PREPARE);
+    }
+}
+
+static void App_TreatModule_RunLoops(const TreatModule_Desc_t *pDesc)
+{
+    TreatModule_Ctx_t *pCtx = pDesc->pCtx;
+    const TreatModule_Loop_t *pLoop;
+    uint8_t i;
+
+    for(i = 0; i < pDesc->loopNum && i < TREAT_MODULE_LOOP_MAX; i++) {
+        pLoop = &pDesc->pLoops[i];
+        if(pLoop->period_ms != 0 && !Drv_Timer_Tick(&pCtx->loopTimer[i], pLoop->period_ms)) {
+            continue;
+        }
+        if(pLoop->pfRun() == false && pLoop->stopOnFail) {
+            App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_STOP);
+            return;
+        }
+    }
+}
+
+void App_TreatModule_Process(const TreatModule_Desc_t *pDesc)
+{
+    TreatModule_Ctx_t *pCtx = pDesc->pCtx;
+
+    if(pDesc->pfRxDataHandle != NULL) {
+        pDesc->pfRxDataHandle();
+    }
+    App_TreatModule_Monitor(pDesc);
+
+    switch(pCtx->runState)
+    {
+        case E_TREAT_RUN_INIT:
+            if(pDesc->pfLoadParams != NULL) {
+                pDesc->pfLoadParams();
+            }
+            App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_IDLE);
+            break;
+
+        case E_TREAT_RUN_IDLE:
+            if(App_TreatModule_StartCheck(pDesc)) {
+                if(pDesc->pfSetWorkParams != NULL) {
+                    pDesc->pfSetWorkParams();
+                }
+                App_TreatModule_StartProgram(pDesc);
+                App_TreatModule_RunPrepare(pDesc);
+            }
+            break;
+
+        case E_TREAT_RUN_PREPARE:
+            if(App_TreatModule_StartCheck(pDesc) == false) {
+                App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_STOP);
+            } else {
+                App_TreatModule_RunPrepare(pDesc);
+            }
+            break;
+
+        case E_TREAT_RUN_WORKING:
+            // 硬件过流已在中断中切断输出
+            if(pDesc->protectChannel < E_ADC_CHANNEL_MAX && Drv_Protect_IsTripped()) {
+                pCtx->ErrorCode = pDesc->errOverCurrent;
+                LOG_E("%s: Over current trip: %d mV (limit: %d mV)", pDesc->pName,
+                      Drv_Protect_GetFault()->value_mv, Drv_Protect_GetFault()->limit_mv);
+                App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_STOP);
+            }
+            // 检查所有条件
+            else if(App_TreatModule_StartCheck(pDesc) == false ||
+                    App_TreatModule_RunProgram(pDesc) == false ||
+                    (pDesc->pfWorkCheck != NULL && pDesc->pfWorkCheck() == false)) {
+                App_TreatModule_ChangeState(pDesc, E_TREAT_RUN_STOP);
+            } else {
+                App_TreatModule_RunLoops(pDesc);
+            }
+            break;
+
+        case E_TREAT_RUN_STOP:
+            if(pDesc->protectChannel < E_ADC_CHANNEL_MAX) {
+                Drv_Protect_Disarm();
+            }
+            if(pDesc->pfStop != NULL) {
+                pDesc->pfStop();
+            }
+            App_Program_Stop(pDesc->commModule);
+            // 关闭输出通道
+            Drv_IODevice_ChangeChannel(CHANNEL_CLOSE);
+            App_TreatMgr_ChangeState(E_TREATMGR_STATE_IDLE);
+            break;
+
+        default:
+            break;
+    }
+    // 本轮处理后发布，程序步/档位与输出同一轮生效，停止后进度即清零
+    App_TreatModule_UpdateStatus(pDesc);
+}
+
+/**
+ * @brief Reset the run-time data of a module
+ */
+void App_TreatModule_Init(const TreatModule_Desc_t *pDesc)
+{
+    memset(pDesc->pCtx, 0, sizeof(TreatModule_Ctx_t));
+    pDesc->pCtx->runState = E_TREAT_RUN_INIT;
+}
+
+/**************************End of file********************************/
@@ -0,0 +1,117 @@
+/************************************************************************************
+* @file     : app_treatmodule.h
+* @brief    : Generic treatment module engine
+* @details  : 各治疗模式共用 INIT→IDLE→(PREPARE)→WORKING→STOP 状态机，
+*             模式差异由Flash中的常量描述表（限值、检查、控制环周期、状态字段映射）给出
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_TREATMODULE_H
+#define APP_TREATMODULE_H
+
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "stdint.h"
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#include "drv_iodevice.h"
+#include "drv_adc.h"
+#include "drv_delay.h"
+#include "app_session.h"
+
+#define TREAT_MODULE_LOOP_MAX       5       ///< 每个模式最多控制环数
+#define TREAT_MODULE_BUZZER_MS      2000    ///< 启停蜂鸣器提示时长 (ms)
+
+typedef enum
+{
+    E_TREAT_RUN_INIT = 0,
+    E_TREAT_RUN_IDLE,
+    E_TREAT_RUN_PREPARE,           ///< 输出前准备（如负压加热预热），不计治疗时间
+    E_TREAT_RUN_WORKING,
+    E_TREAT_RUN_STOP,
+    E_TREAT_RUN_MAX,
+} TreatModule_RunState_EnumDef;
+
+typedef enum
+{
+    E_TREAT_PREPARE_BUSY = 0,      ///< 继续准备
+    E_TREAT_PREPARE_DONE,          ///< 准备完成，进入输出
+    E_TREAT_PREPARE_FAIL,          ///< 准备失败，停止
+} TreatModule_Prepare_EnumDef;
+
+/* 控制环：WORKING期间按周期调用，返回false表示检测异常 */
+typedef struct
+{
+    uint16_t period_ms;            ///< 调用周期，0为每次调用
+    bool stopOnFail;               ///< 异常时是否停止输出（否则仅报警）
+    bool (*pfRun)(void);
+} TreatModule_Loop_t;
+
+/* 各模式运行时数据（RAM），由模式控制信息结构体持有 */
+typedef struct
+{
+    TreatModule_RunState_EnumDef runState;
+    uint8_t ErrorCode;
+    bool FootSwitchStatus;
+    IODevice_WorkingMode_EnumDef probeStatus;
+    Drv_Timer_t loopTimer[TREAT_MODULE_LOOP_MAX];
+} TreatModule_Ctx_t;
+
+/* 模式描述表（Flash），新增模式只需一张表加对应钩子 */
+typedef struct
+{
+    const char *pName;                      ///< 日志前缀
+    uint8_t logDomain;                      ///< LOG_DOMAIN_*，引擎日志按本模式的域输出和过滤
+    TreatModule_Ctx_t *pCtx;                ///< 运行时数据
+    App_Session_t *pSession;                ///< 治疗计时，NULL为不计时
+
+    /* 限值与资源 */
+    IODevice_WorkingMode_EnumDef probe;     ///< 对应治疗头
+    IODevice_Channel_EnumDef channel;       ///< 输出通道
+    ADC_Channel_EnumDef protectChannel;     ///< 硬件过流采样通道，E_ADC_CHANNEL_MAX为不使用
+    uint8_t errProbe;                       ///< 治疗头未连接错误码
+    uint8_t errInvalid;                     ///< 参数/条件无效错误码
+    uint8_t errOverCurrent;                 ///< 硬件过流错误码
+
+    /* 状态发布：共享状态区模块号及 work_state/conn_state/error_code 在回复结构体中的偏移 */
+    uint8_t commModule;                     ///< PROTOCOL_MODULE_*
+    uint8_t workStateOffset;
+    uint8_t connStateOffset;
+    uint8_t errorCodeOffset;
+    uint8_t programStepOffset;              ///< 治疗程序进度 program_step/step_remain
+    uint8_t stepRemainOffset;
+
+    /* 钩子，NULL为不需要 */
+    void (*pfLoadParams)(void);             ///< INIT：加载存储参数
+    void (*pfUpdateStatus)(void);           ///< 模式特有状态字段
+    void (*pfRxDataHandle)(void);           ///< 上位机指令处理
+    bool (*pfStartCheck)(void);             ///< 模式特有启动条件（脚踏、治疗头由引擎检查）
+    void (*pfSetWorkParams)(void);          ///< IDLE→输出前装载工作参数
+    TreatModule_Prepare_EnumDef (*pfPrepare)(void);
+    uint16_t (*pfProtectLimit)(void);       ///< 硬件过流阈值 (mV)
+    bool (*pfWorkCheck)(void);              ///< WORKING每周期检查，false停止（剩余时间/点数等）
+    void (*pfApplyStep)(uint8_t level, uint16_t frequency); ///< 治疗程序换档，frequency为0不换频，NULL为不支持程序
+    void (*pfStop)(void);                   ///< STOP：关闭模式输出
+
+    /* 控制环检查表 */
+    const TreatModule_Loop_t *pLoops;
+    uint8_t loopNum;
+} TreatModule_Desc_t;
+
+void App_TreatModule_Init(const TreatModule_Desc_t *pDesc);
+void App_TreatModule_Process(const TreatModule_Desc_t *pDesc);
+bool App_TreatModule_StartCheck(const TreatModule_Desc_t *pDesc);
+void App_TreatModule_ChangeState(const TreatModule_Desc_t *pDesc, TreatModule_RunState_EnumDef newState);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_TREATMODULE_H
+/**************************End of file********************************/
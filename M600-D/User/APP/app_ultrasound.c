@@ -7,6 +7,7 @@
 * @version  : V1.0.0
 * @copyright: Copyright (c) 2050
 **********************************************************************************/
+#define LOG_DOMAIN  LOG_DOMAIN_US
 #include "app_ultrasound.h"
 #include "app_treatmgr.h"
 #include "app_memory.h"
@@ -14,52 +15,38 @@
 #include "drv_iodevice.h"
 #include "drv_dac.h"
 #include "drv_adc.h"
+#include "drv_scope.h"
 #include "log.h"
 #include "drv_si5351.h"
+#include "drv_protect.h"
+#include "drv_probeid.h"
+#include "app_usage.h"
+#include "app_program.h"
 
 static US_CtrlInfo_t s_USCtrlInfo;
 
-void App_UltraSound_UpdateStatus(void)
+#define US_PUBLISH_U8(field, value)     App_Comm_PublishStatusU8(PROTOCOL_MODULE_ULTRASOUND, \
+                                            APP_COMM_STATUS_OFFSET(US_GetStatus_Reply_t, field), (value))
+#define US_PUBLISH_U16(field, value)    App_Comm_PublishStatusU16(PROTOCOL_MODULE_ULTRASOUND, \
+                                            APP_COMM_STATUS_OFFSET(US_GetStatus_Reply_t, field), (value))
+
+static void App_UltraSound_UpdateStatus(void)
 {
-    // Update work state
-    if(s_USCtrlInfo.runState == E_US_RUN_WORKING) {
-        s_USCtrlInfo.Trans.TxStatus.work_state = 0x01;
-    } else if(s_USCtrlInfo.runState == E_US_RUN_STOP) {
-        s_USCtrlInfo.Trans.TxStatus.work_state = 0x00;
-    }
-    s_USCtrlInfo.Trans.TxStatus.frequency = s_USCtrlInfo.Frequency;
-    s_USCtrlInfo.Trans.TxStatus.temp_limit = s_USCtrlInfo.TempLimit;
-    s_USCtrlInfo.Trans.TxStatus.remain_time = s_USCtrlInfo.RemainTime;
-    s_USCtrlInfo.Trans.TxStatus.work_level = s_USCtrlInfo.WorkLevel;
-    s_USCtrlInfo.Trans.TxStatus.head_temp = s_USCtrlInfo.HeadTemp;
-    // Get probe connection status and foot switch state
-    bool headConnected = (s_USCtrlInfo.probeStatus == E_IODEVICE_MODE_ULTRASOUND);
-    
-    // Combine connection state: bit[4]=head connection, bit[0]=foot switch
-    // 0x00: Head connected, foot closed
-    // 0x10: Head disconnected, foot closed
-    // 0x01: Head connected, foot open
-    // 0x11: Head disconnected, foot open
-    if (headConnected && s_USCtrlInfo.FootSwitchStatus) {
-        s_USCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_CLOSED;
-    } else if (!headConnected && s_USCtrlInfo.FootSwitchStatus) {
-        s_USCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_CLOSED;
-    } else if (headConnected && !s_USCtrlInfo.FootSwitchStatus) {
-        s_USCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_CONNECTED_FOOT_OPEN;
-    } else {
-        s_USCtrlInfo.Trans.TxStatus.conn_state = CONN_STATE_DISCONNECTED_FOOT_OPEN;
-    }
-    s_USCtrlInfo.Trans.TxStatus.error_code = s_USCtrlInfo.ErrorCode;
+    US_PUBLISH_U16(frequency, s_USCtrlInfo.Frequency);
+    US_PUBLISH_U16(temp_limit, s_USCtrlInfo.TempLimit);
+    US_PUBLISH_U16(remain_time, s_USCtrlInfo.RemainTime);
+    US_PUBLISH_U8(work_level, s_USCtrlInfo.WorkLevel);
+    US_PUBLISH_U16(head_temp, s_USCtrlInfo.HeadTemp);
+    US_PUBLISH_U16(deliver_time, App_Session_GetDeliveredSec(&s_USCtrlInfo.Session));
 }
 
 
-void App_UltraSound_RxDataHandle(void)
+static void App_UltraSound_RxDataHandle(void)
 {
-    UltraSound_TransData_t *pTransData = App_Comm_GetUSTransData();
-    if(pTransData->RxValidFlag[PROTOCOL_CMD_SET_WORK_STATE])
+    // 仅在收到新指令时处理，避免同一条复位指令被重复执行
+    if(App_Comm_FetchRx(PROTOCOL_MODULE_ULTRASOUND, PROTOCOL_CMD_SET_WORK_STATE, &s_USCtrlInfo.Trans.RxWorkState,
+                        sizeof(s_USCtrlInfo.Trans.RxWorkState), &s_USCtrlInfo.RxWorkStateVer))
     {
-        s_USCtrlInfo.Trans.RxWorkState = pTransData->RxWorkState;
-        
         // 处理复位功能
         if(s_USCtrlInfo.Trans.RxWorkState.work_state == WORK_STATE_RESET)
         {
@@ -80,63 +67,61 @@ void App_UltraSound_RxDataHandle(void)
             LOG_I("Reset: Work time=%d, Work level=%d", s_USCtrlInfo.RemainTime, s_USCtrlInfo.WorkLevel);
         }
     }
-    if(pTransData->RxValidFlag[PROTOCOL_CMD_SET_CONFIG])
+    App_Comm_FetchRx(PROTOCOL_MODULE_ULTRASOUND, PROTOCOL_CMD_SET_CONFIG, &s_USCtrlInfo.Trans.RxConfig,
+                     sizeof(s_USCtrlInfo.Trans.RxConfig), &s_USCtrlInfo.RxConfigVer);
+}
+
+void App_Ultrasound_SetFrequency(uint16_t frequency)
+{
+    if(frequency > 1400 || frequency < 700)
     {
-        s_USCtrlInfo.Trans.RxConfig = pTransData->RxConfig;
+        LOG_E("Invalid frequency: %d (range: 700-1400kHz)", frequency);
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        return;
     }
+    // 设置频率到SI5351
+    frequency = Drv_SI5351_SetFrequency(frequency);
+    s_USCtrlInfo.Frequency = frequency;
+    LOG_I("Ultrasound frequency set to: %d kHz", frequency);
 }
 
-void App_Ultrasound_ChangeState(US_RunState_EnumDef newState)
+/**
+ * @brief 搜索/跟踪中的换频，不打印日志
+ */
+static void App_UltraSound_ApplyFrequency(uint16_t frequency)
 {
-    if(newState != s_USCtrlInfo.runState && newState < E_US_RUN_MAX)
+    if(frequency != s_USCtrlInfo.Frequency)
     {
-        s_USCtrlInfo.runState = newState;
-        switch(newState)
-        {
-            case E_US_RUN_INIT:
-                LOG_I("Ultrasound state changed to INIT");
-                break;
-            case E_US_RUN_IDLE:
-                LOG_I("Ultrasound state changed to IDLE");
-                break;
-            case E_US_RUN_WORKING:
-                LOG_I("Ultrasound state changed to WORKING");
-                // 启动工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            case E_US_RUN_STOP:
-                LOG_I("Ultrasound state changed to STOP");
-                // 结束工作时蜂鸣器提示（2s）
-                Drv_IODevice_StartBuzzer(2000);
-                break;
-            default:
-                break;
-        }
+        s_USCtrlInfo.Frequency = Drv_SI5351_SetFrequency(frequency);
     }
 }
 
-void App_Ultrasound_Monitor(void)
+static uint32_t App_UltraSound_Admittance(void)
 {
-    // Get the foot switch status and probe status
-    s_USCtrlInfo.FootSwitchStatus = Drv_IODevice_GetFootSwitchState();
-
-    // Get the probe status
-    s_USCtrlInfo.probeStatus = Drv_IODevice_GetProbeStatus();
-
+    return App_USTune_Admittance(Drv_ADC_GetRealValue(E_ADC_CHANNEL_US_I), Drv_DAC_GetVoltage());
 }
 
-void App_Ultrasound_SetFrequency(uint16_t frequency)
+/**
+ * @brief 按热降额系数拉长脉冲周期（导通时间不变，占空比随之下降），周期不变时不重写门控
+ */
+static void App_UltraSound_ApplyBurst(void)
 {
-    if(frequency > 1400 || frequency < 700)
+    uint32_t period = s_USCtrlInfo.PeriodUs;
+
+    if(s_USCtrlInfo.Thermal.scale != 0 && s_USCtrlInfo.Thermal.scale < THERMAL_SCALE_FULL)
+    {
+        period = period * THERMAL_SCALE_FULL / s_USCtrlInfo.Thermal.scale;
+    }
+    if(period > SI5351_US_PERIOD_MAX_US)
+    {
+        period = SI5351_US_PERIOD_MAX_US;
+    }
+    period -= period % SI5351_US_PERIOD_STEP_US;
+    if(period == s_USCtrlInfo.BurstUs)
     {
-        LOG_E("Invalid frequency: %d (range: 700-1400kHz)", frequency);
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return;
     }
-    // 设置频率到SI5351
-    frequency = Drv_SI5351_SetFrequency(frequency);
-    s_USCtrlInfo.Frequency = frequency;
-    LOG_I("Ultrasound frequency set to: %d kHz", frequency);
+    s_USCtrlInfo.BurstUs = Drv_SI5351_SetPulseWidthus((uint16_t)period);
 }
 
 void App_UltraSound_SetLevel(uint8_t level)
@@ -144,7 +129,7 @@ void App_UltraSound_SetLevel(uint8_t level)
     if(level > WORK_LEVEL_MAX)
     {
         LOG_E("Invalid level: %d (range: 0-%d)", level, WORK_LEVEL_MAX);
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return;
     }
     
@@ -162,74 +147,93 @@ void App_UltraSound_SetLevel(uint8_t level)
         pulse_time_ms = PULSE_REPEAT_TIME_MAX_MS;
     }
     
-    // 转换为微秒并设置到SI5351 (输入单位是微秒，0.5ms = 500us)
-    uint16_t pulse_time_us = (uint16_t)(pulse_time_ms * 1000);
-    Drv_SI5351_SetPulseWidthus(pulse_time_us);
+    // 转换为微秒作为脉冲门控周期，下一个周期边界生效 (0.5ms = 500us)
+    s_USCtrlInfo.PeriodUs = (uint16_t)(pulse_time_ms * 1000);
+    s_USCtrlInfo.BurstUs = 0;
+    App_UltraSound_ApplyBurst();
     s_USCtrlInfo.WorkLevel = level;
     LOG_I("Ultrasound level set to: %d (pulse time: %.1f ms)", level, pulse_time_ms);
 }
 
+uint16_t App_UltraSound_GetOutputPermille(void)
+{
+    if(s_USCtrlInfo.Ctx.runState != E_TREAT_RUN_WORKING || s_USCtrlInfo.BurstUs == 0)
+    {
+        return 0;
+    }
+    return (uint16_t)(SI5351_US_BURST_ON_US * THERMAL_SCALE_FULL / s_USCtrlInfo.BurstUs);
+}
 
-bool App_UltraSound_StartCheck()
+/**
+ * @brief 热降额：按模型预测的功率上限调整脉冲周期，治疗头稳定在温度上限以下
+ */
+static bool App_UltraSound_Derate(void)
 {
+    uint16_t applied = App_UltraSound_GetOutputPermille();
+    uint16_t nominal = 0;
+
+    if(s_USCtrlInfo.PeriodUs != 0)
+    {
+        nominal = (uint16_t)(SI5351_US_BURST_ON_US * THERMAL_SCALE_FULL / s_USCtrlInfo.PeriodUs);
+    }
+    App_Thermal_Update(&s_USCtrlInfo.Thermal, s_USCtrlInfo.HeadTemp, s_USCtrlInfo.TempLimit, applied, nominal);
+    App_UltraSound_ApplyBurst();
+    return true;
+}
+
+
+/**
+ * @brief 超声特有启动条件（脚踏、治疗头由引擎检查）
+ */
+static bool App_UltraSound_CheckRequest(void)
+{
+    // 已下发治疗程序时，时间和档位由程序给出（下发时已校验）
+    bool program = App_Program_IsArmed(PROTOCOL_MODULE_ULTRASOUND);
+
     // 1. 检查下位机是否下发了发射超声指令
     if(s_USCtrlInfo.Trans.RxWorkState.work_state != 0x01) {
         LOG_E("Work state is not start");
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 2. 检查剩余工作时间是否大于0（0-3600s）
-    if(s_USCtrlInfo.Trans.RxWorkState.work_time == 0 || s_USCtrlInfo.Trans.RxWorkState.work_time > 3600) {
+    if(!program && (s_USCtrlInfo.Trans.RxWorkState.work_time == 0 || s_USCtrlInfo.Trans.RxWorkState.work_time > 3600)) {
         LOG_E("Invalid work time: %d", s_USCtrlInfo.Trans.RxWorkState.work_time);
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return false;
     }
     
     // 3. 检查工作档位是否不等于0（0-40）
-    if(s_USCtrlInfo.Trans.RxWorkState.work_level == 0 || s_USCtrlInfo.Trans.RxWorkState.work_level > WORK_LEVEL_MAX) {
+    if(!program && (s_USCtrlInfo.Trans.RxWorkState.work_level == 0 || s_USCtrlInfo.Trans.RxWorkState.work_level > WORK_LEVEL_MAX)) {
         LOG_E("Invalid work level: %d (range: 1-%d)", s_USCtrlInfo.Trans.RxWorkState.work_level, WORK_LEVEL_MAX);
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return false;
     }
     
-    // 4. 检查脚踏开关是否闭合
-    if(s_USCtrlInfo.FootSwitchStatus == false) {
-        LOG_E("Foot switch is not closed");
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
-        return false;
-    }
-    
-    // 5. 检查是否正确识别到超声治疗头
-    if(s_USCtrlInfo.probeStatus != E_IODEVICE_MODE_ULTRASOUND) {
-        LOG_E("Ultrasound probe not connected");
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_PROBE_NOT_CONNECTED;
-        return false;
-    }
-    
-    // 6. 检查是否有剩余可治疗次数
+    // 4. 检查是否有剩余可治疗次数
     if(s_USCtrlInfo.TreatTimes == 0) {
         LOG_E("No remaining treat times");
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return false;
     }
     
-    // 7. 检查配置参数是否有效
-    if(s_USCtrlInfo.Trans.RxConfig.frequency == 0 || s_USCtrlInfo.Trans.RxConfig.temp_limit == 0 || s_USCtrlInfo.Trans.RxConfig.voltage == 0) {
+    // 5. 检查配置参数是否有效（频率为US_FREQUENCY_AUTO时自动搜索谐振）
+    if(s_USCtrlInfo.Trans.RxConfig.temp_limit == 0 || s_USCtrlInfo.Trans.RxConfig.voltage == 0) {
         LOG_E("Invalid ultrasound config parameters: freq=%d, temp_limit=%d, voltage=%d", 
               s_USCtrlInfo.Trans.RxConfig.frequency, 
               s_USCtrlInfo.Trans.RxConfig.temp_limit, 
               s_USCtrlInfo.Trans.RxConfig.voltage);
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return false;
     }
     
-    // 8. 检查治疗参数是否有效
+    // 6. 检查治疗参数是否有效
     if(s_USCtrlInfo.TreatParams.CurrentHigh == 0 || s_USCtrlInfo.TreatParams.CurrentLow == 0) {
         LOG_E("Invalid treatment parameters: CurrentHigh=%d, CurrentLow=%d", 
               s_USCtrlInfo.TreatParams.CurrentHigh, 
               s_USCtrlInfo.TreatParams.CurrentLow);
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_INVALID_PARAMS;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_INVALID_PARAMS;
         return false;
     }
     
@@ -239,15 +243,34 @@ bool App_UltraSound_StartCheck()
 
 void App_UltraSound_SetWorkParams(void)
 {
+    const ProbeId_Info_t *pProbe = Drv_ProbeId_Get();
+    ProbeId_Usage_t usage;
+    uint16_t hintKHz = 0;
+
     // 设置工作参数
     s_USCtrlInfo.WorkLevel = s_USCtrlInfo.Trans.RxWorkState.work_level;
     s_USCtrlInfo.RemainTime = s_USCtrlInfo.Trans.RxWorkState.work_time;
+    App_Session_Start(&s_USCtrlInfo.Session, E_TREATMGR_STATE_ULTRASOUND, s_USCtrlInfo.RemainTime);
     s_USCtrlInfo.Voltage = s_USCtrlInfo.Trans.RxConfig.voltage;
     s_USCtrlInfo.VoltageBase = s_USCtrlInfo.Trans.RxConfig.voltage;  // 保存基础电压用于超限检测
     s_USCtrlInfo.CurrentHigh = s_USCtrlInfo.TreatParams.CurrentHigh;
     s_USCtrlInfo.CurrentLow = s_USCtrlInfo.TreatParams.CurrentLow;
+    s_USCtrlInfo.AutoTune = (s_USCtrlInfo.Trans.RxConfig.frequency == US_FREQUENCY_AUTO);
     s_USCtrlInfo.Frequency = s_USCtrlInfo.Trans.RxConfig.frequency;
     s_USCtrlInfo.TempLimit = s_USCtrlInfo.Trans.RxConfig.temp_limit;
+    // 探头标定：温度上限取更严者；搜索起点优先用本探头上次测得的谐振点，其次出厂值
+    if(pProbe != NULL)
+    {
+        if(pProbe->headTempLimit != 0 && pProbe->headTempLimit < s_USCtrlInfo.TempLimit)
+        {
+            s_USCtrlInfo.TempLimit = pProbe->headTempLimit;
+        }
+        hintKHz = pProbe->usFreqKHz;
+        if(App_Usage_GetTotals(&usage) && usage.resonanceKHz != 0)
+        {
+            hintKHz = usage.resonanceKHz;
+        }
+    }
     
     // 剩余可治疗次数减一
     if(s_USCtrlInfo.TreatTimes > 0)
@@ -260,11 +283,22 @@ void App_UltraSound_SetWorkParams(void)
     }
     
     // 配置工作电压和工作频率
-    App_Ultrasound_SetFrequency(s_USCtrlInfo.Frequency);
+    App_Thermal_Start(&s_USCtrlInfo.Thermal, Drv_ADC_GetRealValue(E_ADC_CHANNEL_HAND_NTC));
     App_UltraSound_SetLevel(s_USCtrlInfo.WorkLevel);
-    
-    // 设置初始工作电压
-    Drv_DAC_SetVoltage(s_USCtrlInfo.Voltage);
+    if(s_USCtrlInfo.AutoTune)
+    {
+        // 先以降低的电压搜索谐振，找到后在PREPARE中升至工作电压
+        App_USTune_Search(&s_USCtrlInfo.Tune, hintKHz);
+        App_UltraSound_ApplyFrequency(s_USCtrlInfo.Tune.freq);
+        Drv_DAC_RampTo((uint16_t)((uint32_t)s_USCtrlInfo.Voltage * US_TUNE_VOLTAGE_PCT / 100u),
+                       US_DAC_RAMP_SLOPE_MV_PER_MS, E_DAC_EASE_SCURVE, NULL);
+    }
+    else
+    {
+        App_Ultrasound_SetFrequency(s_USCtrlInfo.Frequency);
+        // 设置初始工作电压（斜坡软启动）
+        Drv_DAC_RampTo(s_USCtrlInfo.Voltage, US_DAC_RAMP_SLOPE_MV_PER_MS, E_DAC_EASE_SCURVE, NULL);
+    }
     
     // 切换继电器pwr_control1至超声通道
     Drv_IODevice_ChangeChannel(CHANNEL_READY);
@@ -285,7 +319,7 @@ bool App_UltraSound_IsCurrentNormal(void)
         int16_t currentError = current - ((s_USCtrlInfo.CurrentHigh + s_USCtrlInfo.CurrentLow) / 2);
         voltageAdjust = -(currentError * 10) / 100;  // 简单的比例控制
         
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_CURRENT_TOO_HIGH;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_CURRENT_TOO_HIGH;
         LOG_W("Current is too high: %d (target: %d-%d)", current, s_USCtrlInfo.CurrentLow, s_USCtrlInfo.CurrentHigh);
     }
     else if(current < s_USCtrlInfo.CurrentLow)
@@ -294,16 +328,16 @@ bool App_UltraSound_IsCurrentNormal(void)
         int16_t currentError = ((s_USCtrlInfo.CurrentHigh + s_USCtrlInfo.CurrentLow) / 2) - current;
         voltageAdjust = (currentError * 10) / 100;  // 简单的比例控制
         
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_CURRENT_TOO_LOW;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_CURRENT_TOO_LOW;
         LOG_W("Current is too low: %d (target: %d-%d)", current, s_USCtrlInfo.CurrentLow, s_USCtrlInfo.CurrentHigh);
     }
     else
     {
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_NONE;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_NONE;
     }
     
-    // 如果需要进行电压调节
-    if(voltageAdjust != 0)
+    // 如果需要进行电压调节（软启动斜坡期间不调节，避免打断斜坡）
+    if(voltageAdjust != 0 && Drv_DAC_IsRamping() == false)
     {
         newVoltage = currentVoltage + voltageAdjust;
         
@@ -312,7 +346,7 @@ bool App_UltraSound_IsCurrentNormal(void)
         if(voltageDiff > VOLTAGE_ADJUST_LIMIT_MV || voltageDiff < -VOLTAGE_ADJUST_LIMIT_MV)
         {
             // 电压超限，报警
-            s_USCtrlInfo.ErrorCode = E_US_ERROR_VOLTAGE_OVER_LIMIT;
+            s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_VOLTAGE_OVER_LIMIT;
             LOG_E("Voltage adjust over limit: %d mV (base: %d mV, limit: ±%d mV)", 
                   newVoltage, s_USCtrlInfo.VoltageBase, VOLTAGE_ADJUST_LIMIT_MV);
             isNormal = false;
@@ -334,6 +368,8 @@ bool App_UltraSound_IsCurrentNormal(void)
             LOG_I("Voltage adjusted: %d -> %d mV (current: %d)", currentVoltage, newVoltage, current);
         }
     }
+    Drv_Scope_SetVar(E_SCOPE_SRC_TARGET, (s_USCtrlInfo.CurrentHigh + s_USCtrlInfo.CurrentLow) / 2);
+    Drv_Scope_SetVar(E_SCOPE_SRC_STATE, s_USCtrlInfo.Ctx.ErrorCode);
     
     return isNormal;
 }
@@ -346,7 +382,7 @@ bool App_UltraSound_IsHeadTempNormal(void)
     
     if(temp > s_USCtrlInfo.TempLimit)
     {
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_TEMP_TOO_HIGH;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_TEMP_TOO_HIGH;
         LOG_W("Head temperature too high: %d (limit: %d)", temp, s_USCtrlInfo.TempLimit);
         
         // 温度超限，自动降低档位（可低至0档）
@@ -364,72 +400,195 @@ bool App_UltraSound_IsHeadTempNormal(void)
     }
     else
     {
-        s_USCtrlInfo.ErrorCode = E_US_ERROR_NONE;
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_NONE;
     }
     return isNormal;
 }
 
 
-void App_Ultrasound_Process(void)
+static uint16_t App_UltraSound_ProtectLimit(void)
 {
-    // Process the ultrasound module
-    App_UltraSound_UpdateStatus();
-    App_UltraSound_RxDataHandle();
-    App_Ultrasound_Monitor();
-
-    // Handle the ultrasound state
-    switch(s_USCtrlInfo.runState)
-    {
-        case E_US_RUN_INIT:
-            if(App_Memory_LoadUSParams(&s_USCtrlInfo.TreatParams)) {
-                s_USCtrlInfo.Trans.RxConfig.frequency = s_USCtrlInfo.TreatParams.Frequency;
-                s_USCtrlInfo.Trans.RxConfig.temp_limit = s_USCtrlInfo.TreatParams.TempLimit;
-                s_USCtrlInfo.Trans.RxConfig.voltage = s_USCtrlInfo.TreatParams.Voltage;
-                s_USCtrlInfo.TreatTimes = s_USCtrlInfo.TreatParams.RemainTimes;
-                
-            } else {
-                LOG_E("Failed to load ultrasound parameters");
-                s_USCtrlInfo.ErrorCode = E_US_ERROR_READ_PARAMS_FAILED;
-            }
-            App_Ultrasound_ChangeState(E_US_RUN_IDLE);
-            break;
-        case E_US_RUN_IDLE:
-            // 使用App_UltraSound_StartCheck进行启动前检查（包含所有参数检查）
-            if(App_UltraSound_StartCheck()) {
-                // 设置工作参数并启动超声发射
-                App_UltraSound_SetWorkParams();
-
-                // pwr_control2切换至可输出（平常为不可输出）
-                Drv_IODevice_ChangeChannel(CHANNEL_US);
-                App_Ultrasound_ChangeState(E_US_RUN_WORKING);
-            }
-            break;
-        case E_US_RUN_WORKING:
-            // 检查所有条件
-            if(App_UltraSound_StartCheck() == false || 
-            App_UltraSound_IsCurrentNormal() == false || 
-            App_UltraSound_IsHeadTempNormal() == false ||
-            s_USCtrlInfo.RemainTime == 0){
-                App_Ultrasound_ChangeState(E_US_RUN_STOP);
-            } else {
-                if(s_USCtrlInfo.RemainTime >= TREAT_TASK_TIME) {
-                    s_USCtrlInfo.RemainTime -= TREAT_TASK_TIME;
-                } else {
-                    s_USCtrlInfo.RemainTime = 0;
-                }
-            }
-            break;
-        case E_US_RUN_STOP:
-            // 关闭输出通道
-            Drv_IODevice_ChangeChannel(CHANNEL_CLOSE);
-            // 停止DAC输出
-            Drv_DAC_SetVoltage(0);
-            App_TreatMgr_ChangeState(E_TREATMGR_STATE_IDLE);
-            break;
-        default:
-            break;
+    return s_USCtrlInfo.CurrentHigh + US_CURRENT_TRIP_MARGIN_MV;
+}
+
+/**
+ * @brief PREPARE：自动模式下驱动换能器扫频搜索谐振（每TREAT_TASK_TIME一步），找到后升至工作电压
+ */
+static TreatModule_Prepare_EnumDef App_UltraSound_Prepare(void)
+{
+    US_Tune_t *pTune = &s_USCtrlInfo.Tune;
+
+    if(!s_USCtrlInfo.AutoTune)
+    {
+        return E_TREAT_PREPARE_DONE;
+    }
+    if(Drv_Protect_IsTripped())
+    {
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_OVER_CURRENT;
+        return E_TREAT_PREPARE_FAIL;
+    }
+    if(Drv_DAC_IsRamping())
+    {
+        return E_TREAT_PREPARE_BUSY;
+    }
+    if(pTune->steps == 0)
+    {
+        // 搜索期间换能器已通电：输出通道与硬件过流保护同治疗时
+        Drv_IODevice_ChangeChannel(CHANNEL_US);
+        Drv_Protect_Arm(E_ADC_CHANNEL_US_I, App_UltraSound_ProtectLimit());
+    }
+    App_UltraSound_ApplyFrequency(App_USTune_Step(pTune, App_UltraSound_Admittance()));
+
+    if(pTune->eState == E_US_TUNE_FAILED)
+    {
+        LOG_E("Resonance not found (%d points)", pTune->points);
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_RESONANCE_NOT_FOUND;
+        return E_TREAT_PREPARE_FAIL;
+    }
+    if(pTune->eState != E_US_TUNE_FOUND)
+    {
+        return E_TREAT_PREPARE_BUSY;
     }
+    LOG_I("Resonance found: %d kHz (%d points, %d ms)", pTune->anchor, pTune->points,
+          pTune->steps * TREAT_TASK_TIME);
+    App_USTune_Track(pTune);
+    App_UltraSound_ApplyFrequency(pTune->freq);
+    Drv_DAC_RampTo(s_USCtrlInfo.Voltage, US_DAC_RAMP_SLOPE_MV_PER_MS, E_DAC_EASE_SCURVE, NULL);
+    return E_TREAT_PREPARE_DONE;
 }
+
+/**
+ * @brief WORKING：谐振跟踪，每次调用一步
+ */
+static bool App_UltraSound_TrackResonance(void)
+{
+    if(s_USCtrlInfo.AutoTune && s_USCtrlInfo.Tune.eState == E_US_TUNE_TRACKING)
+    {
+        App_UltraSound_ApplyFrequency(App_USTune_Step(&s_USCtrlInfo.Tune, App_UltraSound_Admittance()));
+    }
+    return true;
+}
+
+/**
+ * @brief 治疗结束时把谐振点存到探头自身（随使用记录写入），下次只需细扫
+ */
+static void App_UltraSound_SaveResonance(void)
+{
+    uint16_t found = s_USCtrlInfo.Tune.center;
+    ProbeId_Usage_t usage;
+
+    if(!s_USCtrlInfo.AutoTune || s_USCtrlInfo.Tune.eState != E_US_TUNE_TRACKING)
+    {
+        return;
+    }
+    if(!App_Usage_GetTotals(&usage))
+    {
+        return;
+    }
+    if(found + US_RESONANCE_SAVE_KHZ > usage.resonanceKHz && found < usage.resonanceKHz + US_RESONANCE_SAVE_KHZ)
+    {
+        return;
+    }
+    App_Usage_SetResonance(found);
+    LOG_I("Resonance saved to probe: %d -> %d kHz", usage.resonanceKHz, found);
+}
+
+static void App_UltraSound_LoadParams(void)
+{
+    if(App_Memory_LoadUSParams(&s_USCtrlInfo.TreatParams)) {
+        s_USCtrlInfo.Trans.RxConfig.frequency = s_USCtrlInfo.TreatParams.Frequency;
+        s_USCtrlInfo.Trans.RxConfig.temp_limit = s_USCtrlInfo.TreatParams.TempLimit;
+        s_USCtrlInfo.Trans.RxConfig.voltage = s_USCtrlInfo.TreatParams.Voltage;
+        s_USCtrlInfo.TreatTimes = s_USCtrlInfo.TreatParams.RemainTimes;
+        
+    } else {
+        LOG_E("Failed to load ultrasound parameters");
+        s_USCtrlInfo.Ctx.ErrorCode = E_US_ERROR_READ_PARAMS_FAILED;
+    }
+}
+
+static bool App_UltraSound_WorkCheck(void)
+{
+    // 更新时间（按SysTick时间戳换算，不受循环周期影响）
+    s_USCtrlInfo.RemainTime = App_Session_GetRemainSec(&s_USCtrlInfo.Session);
+    return s_USCtrlInfo.RemainTime != 0;
+}
+
+/**
+ * @brief 治疗程序换档：脉冲门控在下一周期边界生效；自动跟踪谐振时不用程序频率
+ */
+static void App_UltraSound_ApplyStep(uint8_t level, uint16_t frequency)
+{
+    if(level != s_USCtrlInfo.WorkLevel)
+    {
+        App_UltraSound_SetLevel(level);
+    }
+    if(frequency != 0 && !s_USCtrlInfo.AutoTune)
+    {
+        App_Ultrasound_SetFrequency(frequency);
+    }
+}
+
+static void App_UltraSound_Stop(void)
+{
+    // 停止DAC输出，关闭脉冲门控
+    Drv_DAC_SetVoltage(0);
+    Drv_SI5351_StopBurst();
+    s_USCtrlInfo.BurstUs = 0;
+    App_UltraSound_SaveResonance();
+    s_USCtrlInfo.Tune.eState = E_US_TUNE_IDLE;
+}
+
+static const TreatModule_Loop_t s_USLoops[] =
+{
+    { 0, true, App_UltraSound_IsCurrentNormal },
+    { 0, true, App_UltraSound_IsHeadTempNormal },
+    { 0, false, App_UltraSound_TrackResonance },
+    { THERMAL_PERIOD_MS, false, App_UltraSound_Derate },
+};
+
+static const TreatModule_Desc_t s_USModule =
+{
+    .pName = "Ultrasound",
+    .logDomain = LOG_DOMAIN_US,
+    .pCtx = &s_USCtrlInfo.Ctx,
+    .pSession = &s_USCtrlInfo.Session,
+    .probe = E_IODEVICE_MODE_ULTRASOUND,
+    .channel = CHANNEL_US,
+    .protectChannel = E_ADC_CHANNEL_US_I,
+    .errProbe = E_US_ERROR_PROBE_NOT_CONNECTED,
+    .errInvalid = E_US_ERROR_INVALID_PARAMS,
+    .errOverCurrent = E_US_ERROR_OVER_CURRENT,
+    .commModule = PROTOCOL_MODULE_ULTRASOUND,
+    .workStateOffset = offsetof(US_GetStatus_Reply_t, work_state),
+    .connStateOffset = offsetof(US_GetStatus_Reply_t, conn_state),
+    .errorCodeOffset = offsetof(US_GetStatus_Reply_t, error_code),
+    .programStepOffset = offsetof(US_GetStatus_Reply_t, program_step),
+    .stepRemainOffset = offsetof(US_GetStatus_Reply_t, step_remain),
+    .pfLoadParams = App_UltraSound_LoadParams,
+    .pfUpdateStatus = App_UltraSound_UpdateStatus,
+    .pfRxDataHandle = App_UltraSound_RxDataHandle,
+    .pfStartCheck = App_UltraSound_CheckRequest,
+    .pfSetWorkParams = App_UltraSound_SetWorkParams,
+    .pfPrepare = App_UltraSound_Prepare,
+    .pfProtectLimit = App_UltraSound_ProtectLimit,
+    .pfWorkCheck = App_UltraSound_WorkCheck,
+    .pfApplyStep = App_UltraSound_ApplyStep,
+    .pfStop = App_UltraSound_Stop,
+    .pLoops = s_USLoops,
+    .loopNum = sizeof(s_USLoops) / sizeof(s_USLoops[0]),
+};
+
+bool App_UltraSound_StartCheck(void)
+{
+    return App_TreatModule_StartCheck(&s_USModule);
+}
+
+void App_Ultrasound_Process(void)
+{
+    App_TreatModule_Process(&s_USModule);
+}
+
 /**
  * @brief Initialize ultrasound module
  */
@@ -439,8 +598,7 @@ void App_Ultrasound_Init(void)
     memset(&s_USCtrlInfo, 0, sizeof(US_CtrlInfo_t));
     
     // 设置初始状态
-    s_USCtrlInfo.runState = E_US_RUN_INIT;
-    s_USCtrlInfo.ErrorCode = E_US_ERROR_NONE;
+    App_TreatModule_Init(&s_USModule);
     s_USCtrlInfo.WorkLevel = 0;
     s_USCtrlInfo.RemainTime = 0;
     s_USCtrlInfo.TreatTimes = 0;
@@ -22,6 +22,10 @@ extern "C" {
 #include "app_comm.h"
 #include "app_memory.h"
 #include "drv_iodevice.h"
+#include "app_session.h"
+#include "app_treatmodule.h"
+#include "app_ustune.h"
+#include "app_thermal.h"
 
 
 /* 档位到脉冲重复时间的映射：20ms基准，0.5ms步进 */
@@ -35,15 +39,15 @@ extern "C" {
 /* 电压调节限制 */
 #define VOLTAGE_ADJUST_LIMIT_MV       2000    ///< 电压调节限制 ±2V = 2000mV
 
-typedef enum
-{
-    E_US_RUN_INIT = 0,
-    E_US_RUN_IDLE,
-    E_US_RUN_WORKING,
-    E_US_RUN_STOP,
-    E_US_RUN_MAX,
-} US_RunState_EnumDef;
+/* 硬件过流保护：CurrentHigh为调压区间上限，跳闸点留出余量 */
+#define US_CURRENT_TRIP_MARGIN_MV     300     ///< 过流跳闸余量 (mV)
+
+#define US_DAC_RAMP_SLOPE_MV_PER_MS   10      ///< 启动电压斜率 (mV/ms)
 
+/* 谐振自动搜索：上位机配置频率为0时启用，搜索在PREPARE中进行，不计治疗时间 */
+#define US_FREQUENCY_AUTO             0       ///< 配置频率：自动搜索并跟踪谐振
+#define US_TUNE_VOLTAGE_PCT           50      ///< 搜索时电压为工作电压的百分比
+#define US_RESONANCE_SAVE_KHZ         2       ///< 谐振点变化超过此值才写入探头
 
 typedef enum {
     E_US_ERROR_NONE = 0,
@@ -55,12 +59,14 @@ typedef enum {
     E_US_ERROR_TEMP_TOO_HIGH,
     E_US_ERROR_TEMP_TOO_LOW,
     E_US_ERROR_VOLTAGE_OVER_LIMIT,
+    E_US_ERROR_OVER_CURRENT,
+    E_US_ERROR_RESONANCE_NOT_FOUND,
     E_US_ERROR_MAX,
 }Ultrasound_ErrorCode_EnumDef;
 
 typedef struct
 {
-    US_RunState_EnumDef runState;
+    TreatModule_Ctx_t Ctx;         ///< 引擎运行状态（状态、错误码、脚踏、治疗头）
     uint16_t Voltage;              ///< 工作电压 (mV)
     uint16_t VoltageBase;          ///< 基础工作电压 (mV)，用于超限检测
     uint16_t CurrentHigh;
@@ -71,15 +77,18 @@ typedef struct
 
     uint8_t WorkLevel;
     uint16_t HeadTemp;
-    uint16_t RemainTime;
-    
-    uint8_t ConnState;
-    uint8_t ErrorCode;
-    bool FootSwitchStatus;
-    IODevice_WorkingMode_EnumDef probeStatus;
+    uint16_t RemainTime;           ///< 剩余工作时间 (秒)，由Session换算
+    App_Session_t Session;         ///< 治疗计时
     
     US_TreatParams_t TreatParams;
-    UltraSound_TransData_t Trans;
+    UltraSound_TransData_t Trans;                ///< 本模式收发快照
+    uint32_t RxWorkStateVer;       ///< 已处理的工作状态指令版本
+    uint32_t RxConfigVer;   ///< 已处理的配置指令版本
+    bool AutoTune;                 ///< 本次治疗自动搜索/跟踪谐振
+    US_Tune_t Tune;                ///< 谐振搜索与跟踪
+    App_Thermal_t Thermal;         ///< 热降额模型
+    uint16_t PeriodUs;             ///< 档位对应的脉冲周期 (us)
+    uint16_t BurstUs;              ///< 降额后实际下发的脉冲周期 (us)，0为未输出
 } US_CtrlInfo_t;
 
 
@@ -87,6 +96,8 @@ void App_Ultrasound_Init(void);
 void App_Ultrasound_Process(void);
 bool App_UltraSound_StartCheck(void);
 void App_UltraSound_SetWorkParams(void);
+/** 输出中的脉冲占空比（千分比，相对最高档），未输出为0 */
+uint16_t App_UltraSound_GetOutputPermille(void);
 
 
 #ifdef __cplusplus
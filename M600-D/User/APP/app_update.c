@@ -0,0 +1,578 @@
+/***********************************************************************************
+* @file     : app_update.c
+* @brief    : Firmware update service over USART1 (E_SYSTEM_UPDATE_MODE)
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#define LOG_DOMAIN  LOG_DOMAIN_MEM
+#include "app_update.h"
+#include "app_comm.h"
+#include "app_system.h"
+#include "app_treatmgr.h"
+#include "drv_fwswap.h"
+#include "drv_delay.h"
+#include "log.h"
+
+#define UPDATE_BUF_NUM          2       // 双页缓冲：一页接收，另一页擦除/编程
+#define UPDATE_BUF_NONE         0xFF
+#define UPDATE_SLICE_LEN        256     // 每轮主循环最多编程的字节数（CPU停顿约6ms）
+#define UPDATE_RESTART_MS       50      // END应答发出后复位，进入换区
+#define UPDATE_SRAM_START       0x20000000u
+#define UPDATE_SRAM_END         0x2000C000u
+#define UPDATE_REPLY_LEN        5       // result(1) next_offset(4)
+// 链路模型：数据帧与应答帧字节数（8N1，每字节10位）
+#define UPDATE_LINK_FRAME_LEN   (PROTOCOL_FRAME_HEAD_LEN + 8 + PROTOCOL_UPDATE_CHUNK_MAX + 2)
+#define UPDATE_LINK_ACK_LEN     (PROTOCOL_FRAME_HEAD_LEN + UPDATE_REPLY_LEN + 2)
+
+typedef enum
+{
+    E_UPDATE_BUF_FREE = 0,
+    E_UPDATE_BUF_FILL,          // 正在接收
+    E_UPDATE_BUF_ERASE,         // 已收满，待擦除
+    E_UPDATE_BUF_PROGRAM,       // 分片编程中
+} Update_BufState_EnumDef;
+
+typedef struct
+{
+    uint8_t data[FWSWAP_PAGE_SIZE];
+    uint16_t page;
+    uint16_t len;               // 有效字节（奇数长度补0xFF至偶数）
+    uint16_t done;              // 已编程字节
+    Update_BufState_EnumDef eState;
+} Update_PageBuf_t;
+
+typedef enum
+{
+    E_UPDATE_IDLE = 0,
+    E_UPDATE_RECEIVING,
+    E_UPDATE_FINISHING,         // 已收到END，等待最后的页写完后校验
+    E_UPDATE_RESTART,           // 已暂存，应答发出后复位
+    E_UPDATE_FAILED,            // 擦写失败，需重新BEGIN（从已写页续传）
+} Update_State_EnumDef;
+
+typedef struct
+{
+    Update_State_EnumDef eState;
+    FwSwap_Header_t hdr;
+    uint32_t nextOffset;        // 期望主机发送的下一个偏移
+    uint8_t fill;               // 正在接收的缓冲，UPDATE_BUF_NONE表示两页均在擦写
+    uint32_t busyUsStart;
+    Drv_Timer_t restartTimer;
+    Update_Stats_t stats;
+} Update_Ctx_t;
+
+static Update_PageBuf_t s_UpdateBuf[UPDATE_BUF_NUM];
+static Update_Ctx_t s_Update;
+
+static const char * const s_FwSwapStateName[E_FWSWAP_STATE_MAX] =
+{
+    "EMPTY", "RECEIVING", "STAGED", "SWAPPING", "TRIAL", "CONFIRMED", "REVERTING", "REVERTED",
+};
+
+static uint32_t App_Update_GetU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void App_Update_PutU32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+/**
+ * @brief CRC-32 (IEEE 802.3, 与zlib一致)，半字节查表
+ */
+static uint32_t App_Update_Crc32(uint32_t crc, const uint8_t *p, uint32_t len)
+{
+    static const uint32_t s_Crc32Nibble[16] =
+    {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    while(len--){
+        crc ^= *p++;
+        crc = (crc >> 4) ^ s_Crc32Nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ s_Crc32Nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static void App_Update_Reply(uint8_t cmd, uint8_t result)
+{
+    uint8_t reply[UPDATE_REPLY_LEN];
+
+    reply[0] = result;
+    App_Update_PutU32(&reply[1], s_Update.nextOffset);
+    App_Comm_SendFrame(PROTOCOL_MODULE_SYSTEM, cmd, reply, sizeof(reply));
+}
+
+static void App_Update_StartFill(uint8_t index)
+{
+    s_UpdateBuf[index].page = (uint16_t)(s_Update.nextOffset / FWSWAP_PAGE_SIZE);
+    s_UpdateBuf[index].len = 0;
+    s_UpdateBuf[index].done = 0;
+    s_UpdateBuf[index].eState = E_UPDATE_BUF_FILL;
+    s_Update.fill = index;
+}
+
+/**
+ * @brief 当前接收页交给擦写，另一页空闲则立即接着接收
+ */
+static void App_Update_SealFill(void)
+{
+    Update_PageBuf_t *pBuf = &s_UpdateBuf[s_Update.fill];
+    uint8_t other = (uint8_t)(s_Update.fill ^ 1u);
+
+    if(pBuf->len & 1u){
+        pBuf->data[pBuf->len++] = 0xFF;
+    }
+    pBuf->eState = E_UPDATE_BUF_ERASE;
+    if(s_UpdateBuf[other].eState == E_UPDATE_BUF_FREE){
+        App_Update_StartFill(other);
+    }else{
+        s_Update.fill = UPDATE_BUF_NONE;
+    }
+}
+
+/**
+ * @brief 取页号最小的待擦写缓冲，保证按页顺序写入（续传点为连续已写页）
+ */
+static Update_PageBuf_t *App_Update_GetFlashBuf(void)
+{
+    Update_PageBuf_t *pBuf = NULL;
+    uint8_t i;
+
+    for(i = 0; i < UPDATE_BUF_NUM; i++){
+        if(s_UpdateBuf[i].eState >= E_UPDATE_BUF_ERASE && (pBuf == NULL || s_UpdateBuf[i].page < pBuf->page)){
+            pBuf = &s_UpdateBuf[i];
+        }
+    }
+    return pBuf;
+}
+
+static void App_Update_Fail(const char *pWhat, uint16_t page)
+{
+    uint8_t i;
+
+    LOG_E("Update: %s failed at page %d", pWhat, page);
+    for(i = 0; i < UPDATE_BUF_NUM; i++){
+        s_UpdateBuf[i].eState = E_UPDATE_BUF_FREE;
+    }
+    s_Update.fill = UPDATE_BUF_NONE;
+    s_Update.eState = E_UPDATE_FAILED;
+}
+
+/**
+ * @brief 结束会话回到正常模式，缓冲中未写完的页丢弃；已校验页的标记保留，可续传
+ */
+static void App_Update_Stop(const char *pWhy)
+{
+    uint8_t i;
+
+    for(i = 0; i < UPDATE_BUF_NUM; i++){
+        s_UpdateBuf[i].eState = E_UPDATE_BUF_FREE;
+    }
+    s_Update.fill = UPDATE_BUF_NONE;
+    s_Update.eState = E_UPDATE_IDLE;
+    LOG_W("Update: session %s at offset %d", pWhy, s_Update.nextOffset);
+    System_ChangeMode(E_SYSTEM_NORMAL_MODE);
+}
+
+/**
+ * @brief 一轮主循环最多一次擦除或一个编程分片，接收在DMA中并行进行
+ */
+static void App_Update_FlashStep(void)
+{
+    Update_PageBuf_t *pBuf = App_Update_GetFlashBuf();
+    uint32_t offset;
+    uint16_t n;
+
+    if(pBuf == NULL){
+        return;
+    }
+    if(pBuf->eState == E_UPDATE_BUF_ERASE){
+        if(!Drv_FwSwap_ErasePage(pBuf->page)){
+            App_Update_Fail("erase", pBuf->page);
+            return;
+        }
+        pBuf->eState = E_UPDATE_BUF_PROGRAM;
+        return;
+    }
+
+    offset = (uint32_t)pBuf->page * FWSWAP_PAGE_SIZE;
+    n = (uint16_t)(pBuf->len - pBuf->done);
+    if(n > UPDATE_SLICE_LEN){
+        n = UPDATE_SLICE_LEN;
+    }
+    if(!Drv_FwSwap_Program(offset + pBuf->done, &pBuf->data[pBuf->done], n)){
+        App_Update_Fail("program", pBuf->page);
+        return;
+    }
+    pBuf->done += n;
+    if(pBuf->done < pBuf->len){
+        return;
+    }
+    // 整页回读校验后再记页标记，续传只从已确认的页之后开始
+    if(memcmp(Drv_FwSwap_GetStaging() + offset, pBuf->data, pBuf->len) != 0 || !Drv_FwSwap_MarkPage(pBuf->page)){
+        App_Update_Fail("verify", pBuf->page);
+        return;
+    }
+    pBuf->eState = E_UPDATE_BUF_FREE;
+    s_Update.stats.pages++;
+    if(s_Update.fill == UPDATE_BUF_NONE && s_Update.eState == E_UPDATE_RECEIVING &&
+       s_Update.nextOffset < s_Update.hdr.size){
+        App_Update_StartFill((uint8_t)(pBuf - s_UpdateBuf));
+    }
+}
+
+/**
+ * @brief 整镜像CRC与向量表检查：栈顶在SRAM内，复位向量在本槽内
+ */
+static bool App_Update_CheckImage(void)
+{
+    const uint8_t *pImage = Drv_FwSwap_GetStaging();
+    uint32_t sp = App_Update_GetU32(&pImage[0]);
+    uint32_t reset = App_Update_GetU32(&pImage[4]) & ~1u;
+
+    if(App_Update_Crc32(0, pImage, s_Update.hdr.size) != s_Update.hdr.crc32){
+        LOG_E("Update: image CRC mismatch");
+        return false;
+    }
+    if(sp < UPDATE_SRAM_START || sp > UPDATE_SRAM_END || (sp & 3u) != 0 ||
+       reset < FWSWAP_ACTIVE_ADDR || reset >= FWSWAP_ACTIVE_ADDR + s_Update.hdr.size){
+        LOG_E("Update: bad vector table sp=0x%08X reset=0x%08X", sp, reset);
+        return false;
+    }
+    return true;
+}
+
+static void App_Update_Finish(void)
+{
+    uint8_t i;
+
+    for(i = 0; i < UPDATE_BUF_NUM; i++){
+        if(s_UpdateBuf[i].eState >= E_UPDATE_BUF_ERASE){
+            return;
+        }
+    }
+    if(!App_Update_CheckImage()){
+        s_Update.eState = E_UPDATE_IDLE;
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_END, UPDATE_RESULT_IMAGE);
+        System_ChangeMode(E_SYSTEM_NORMAL_MODE);
+        return;
+    }
+    if(!Drv_FwSwap_MarkStaged()){
+        s_Update.eState = E_UPDATE_FAILED;
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_END, UPDATE_RESULT_FLASH);
+        return;
+    }
+    s_Update.stats.flashUs = Drv_FwSwap_GetBusyUs() - s_Update.busyUsStart;
+    LOG_I("Update: image staged (%d bytes, version 0x%08X), restarting", s_Update.hdr.size, s_Update.hdr.version);
+    App_Update_Reply(PROTOCOL_CMD_UPDATE_END, UPDATE_RESULT_OK);
+    s_Update.restartTimer.running = false;
+    s_Update.eState = E_UPDATE_RESTART;
+}
+
+/**
+ * @brief RTT command: update，会话统计与链路/闪存吞吐估算
+ */
+static void App_Update_Cmd(char *arg)
+{
+    const Update_Stats_t *pStats = &s_Update.stats;
+    uint32_t elapsed = pStats->lastMs - pStats->startMs;
+    uint32_t flashUs = (s_Update.eState == E_UPDATE_RESTART) ? pStats->flashUs :
+                       Drv_FwSwap_GetBusyUs() - s_Update.busyUsStart;
+    uint32_t flashBps = 0;
+    uint32_t linkBps;
+    uint32_t baud;
+    uint8_t i;
+    static const uint32_t s_Baud[2] = {115200, 921600};
+
+    (void)arg;
+    LOG_I("Update: state=%s session=%d next=%d/%d trial=%d", s_FwSwapStateName[Drv_FwSwap_GetState()],
+          s_Update.eState, s_Update.nextOffset, s_Update.hdr.size, Drv_FwSwap_GetTrialBoots());
+    LOG_I("Update: %d bytes in %d ms (%d B/s), pages=%d flash=%d ms, nak busy=%d seq=%d crc=%d",
+          pStats->bytes, elapsed, elapsed ? (uint32_t)((uint64_t)pStats->bytes * 1000u / elapsed) : 0,
+          pStats->pages, flashUs / 1000u, pStats->busyNaks, pStats->seqNaks, pStats->crcNaks);
+    // 实测闪存吞吐与链路模型：流水线下有效吞吐取两者较小值，串行则为两段时间之和
+    if(flashUs > 0){
+        flashBps = (uint32_t)((uint64_t)pStats->pages * FWSWAP_PAGE_SIZE * 1000000u / flashUs);
+    }
+    for(i = 0; i < 2; i++){
+        baud = s_Baud[i];
+        linkBps = baud / 10u * PROTOCOL_UPDATE_CHUNK_MAX / (UPDATE_LINK_FRAME_LEN + UPDATE_LINK_ACK_LEN / PROTOCOL_UPDATE_WINDOW);
+        LOG_I("Update @%d: link %d B/s, flash %d B/s, pipelined %d B/s, serial %d B/s", baud, linkBps, flashBps,
+              (flashBps && flashBps < linkBps) ? flashBps : linkBps,
+              flashBps ? (uint32_t)((uint64_t)linkBps * flashBps / (linkBps + flashBps)) : linkBps);
+    }
+}
+
+/* =============================================================================
+ * Public Functions
+ * ============================================================================= */
+
+void App_Update_Init(void)
+{
+    FwSwap_State_EnumDef eState = Drv_FwSwap_GetState();
+    const FwSwap_Header_t *pHdr = Drv_FwSwap_GetHeader();
+
+    memset(&s_Update, 0, sizeof(s_Update));
+    s_Update.fill = UPDATE_BUF_NONE;
+    Log_RegisterFunction("update", App_Update_Cmd);
+
+    switch(eState)
+    {
+        case E_FWSWAP_TRIAL:
+            LOG_W("Update: running version 0x%08X on trial (boot %d/%d)", pHdr->version,
+                  Drv_FwSwap_GetTrialBoots(), FWSWAP_TRIAL_BOOTS);
+            break;
+        case E_FWSWAP_REVERTED:
+            LOG_E("Update: version 0x%08X was not confirmed, previous image restored", pHdr->version);
+            break;
+        case E_FWSWAP_STAGED:
+        case E_FWSWAP_SWAPPING:
+        case E_FWSWAP_REVERTING:
+            // 换区由引导程序执行，到这里说明引导程序缺失（仅通过SWD烧录了应用）
+            LOG_E("Update: slot exchange pending (%s) but not executed", s_FwSwapStateName[eState]);
+            break;
+        default:
+            break;
+    }
+}
+
+void App_Update_Confirm(void)
+{
+    if(Drv_FwSwap_GetState() == E_FWSWAP_TRIAL){
+        if(Drv_FwSwap_Confirm()){
+            LOG_I("Update: version 0x%08X confirmed", Drv_FwSwap_GetHeader()->version);
+        }else{
+            LOG_E("Update: confirm failed");
+        }
+    }
+}
+
+/**
+ * @brief BEGIN: size(4) crc32(4) version(4)，同一镜像再次BEGIN时从已写页续传
+ */
+void App_Update_Begin(const uint8_t *pData, uint8_t len)
+{
+    const FwSwap_Header_t *pOld = Drv_FwSwap_GetHeader();
+    FwSwap_State_EnumDef eState = Drv_FwSwap_GetState();
+    FwSwap_Header_t hdr;
+    uint8_t i;
+
+    if(len < 12){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_BEGIN, UPDATE_RESULT_SIZE);
+        return;
+    }
+    hdr.magic = FWSWAP_MAGIC;
+    hdr.size = App_Update_GetU32(&pData[0]);
+    hdr.crc32 = App_Update_GetU32(&pData[4]);
+    hdr.version = App_Update_GetU32(&pData[8]);
+    s_Update.nextOffset = 0;
+
+    // 试运行镜像未确认前不接受新镜像，否则回退目标会被覆盖；治疗输出中不升级
+    if(eState == E_FWSWAP_TRIAL || App_TreatMgr_GetState() != E_TREATMGR_STATE_IDLE ||
+       s_Update.eState == E_UPDATE_RESTART){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_BEGIN, UPDATE_RESULT_STATE);
+        return;
+    }
+    if(hdr.size < 8 || hdr.size > FWSWAP_SLOT_SIZE){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_BEGIN, UPDATE_RESULT_SIZE);
+        return;
+    }
+
+    if(eState == E_FWSWAP_RECEIVING && pOld->size == hdr.size && pOld->crc32 == hdr.crc32 &&
+       pOld->version == hdr.version){
+        s_Update.nextOffset = (uint32_t)Drv_FwSwap_GetWrittenPages() * FWSWAP_PAGE_SIZE;
+        if(s_Update.nextOffset > hdr.size){
+            s_Update.nextOffset = hdr.size;
+        }
+    }else if(!Drv_FwSwap_Begin(&hdr)){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_BEGIN, UPDATE_RESULT_FLASH);
+        return;
+    }
+
+    s_Update.hdr = hdr;
+    for(i = 0; i < UPDATE_BUF_NUM; i++){
+        s_UpdateBuf[i].eState = E_UPDATE_BUF_FREE;
+    }
+    s_Update.fill = UPDATE_BUF_NONE;
+    if(s_Update.nextOffset < hdr.size){
+        App_Update_StartFill(0);
+    }
+    memset(&s_Update.stats, 0, sizeof(s_Update.stats));
+    s_Update.stats.startMs = Drv_Delay_GetTickMs();
+    s_Update.stats.lastMs = s_Update.stats.startMs;
+    s_Update.busyUsStart = Drv_FwSwap_GetBusyUs();
+    s_Update.eState = E_UPDATE_RECEIVING;
+    System_ChangeMode(E_SYSTEM_UPDATE_MODE);
+    LOG_I("Update: begin %d bytes, version 0x%08X, from offset %d", hdr.size, hdr.version, s_Update.nextOffset);
+    App_Update_Reply(PROTOCOL_CMD_UPDATE_BEGIN, UPDATE_RESULT_OK);
+}
+
+/**
+ * @brief DATA: offset(4) data(n) crc32(4)，按序接收，否则应答期望偏移由主机回退重发
+ */
+void App_Update_Data(const uint8_t *pData, uint8_t len)
+{
+    Update_PageBuf_t *pBuf;
+    uint32_t offset;
+    uint16_t n;
+
+    if(s_Update.eState != E_UPDATE_RECEIVING){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_DATA,
+                         (s_Update.eState == E_UPDATE_FAILED) ? UPDATE_RESULT_FLASH : UPDATE_RESULT_STATE);
+        return;
+    }
+    if(len <= 8 || len - 8 > PROTOCOL_UPDATE_CHUNK_MAX){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_DATA, UPDATE_RESULT_SIZE);
+        return;
+    }
+    offset = App_Update_GetU32(pData);
+    n = (uint16_t)(len - 8);
+    if(App_Update_Crc32(0, &pData[4], n) != App_Update_GetU32(&pData[4 + n])){
+        s_Update.stats.crcNaks++;
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_DATA, UPDATE_RESULT_CRC);
+        return;
+    }
+    if(offset != s_Update.nextOffset){
+        s_Update.stats.seqNaks++;
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_DATA, UPDATE_RESULT_SEQ);
+        return;
+    }
+    if(offset + n > s_Update.hdr.size || offset / FWSWAP_PAGE_SIZE != (offset + n - 1) / FWSWAP_PAGE_SIZE){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_DATA, UPDATE_RESULT_SIZE);
+        return;
+    }
+    if(s_Update.fill == UPDATE_BUF_NONE){
+        s_Update.stats.busyNaks++;
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_DATA, UPDATE_RESULT_BUSY);
+        return;
+    }
+
+    pBuf = &s_UpdateBuf[s_Update.fill];
+    memcpy(&pBuf->data[pBuf->len], &pData[4], n);
+    pBuf->len += n;
+    s_Update.nextOffset += n;
+    s_Update.stats.bytes += n;
+    s_Update.stats.lastMs = Drv_Delay_GetTickMs();
+    if(pBuf->len == FWSWAP_PAGE_SIZE || s_Update.nextOffset == s_Update.hdr.size){
+        App_Update_SealFill();
+    }
+    App_Update_Reply(PROTOCOL_CMD_UPDATE_DATA, UPDATE_RESULT_OK);
+}
+
+/**
+ * @brief END: 最后的页写完后校验镜像并暂存，应答在App_Update_Process中发出
+ */
+void App_Update_End(void)
+{
+    if(s_Update.eState == E_UPDATE_FINISHING){
+        return;
+    }
+    if(s_Update.eState != E_UPDATE_RECEIVING){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_END, UPDATE_RESULT_STATE);
+        return;
+    }
+    if(s_Update.nextOffset != s_Update.hdr.size){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_END, UPDATE_RESULT_SIZE);
+        return;
+    }
+    s_Update.eState = E_UPDATE_FINISHING;
+}
+
+/**
+ * @brief QUERY: state(1) next_offset(4) version(4) trial_boots(1)
+ */
+void App_Update_Query(void)
+{
+    const FwSwap_Header_t *pHdr = Drv_FwSwap_GetHeader();
+    uint8_t reply[10];
+    uint32_t next = s_Update.nextOffset;
+
+    // 会话外查询：报告可续传的偏移
+    if(s_Update.eState == E_UPDATE_IDLE && Drv_FwSwap_GetState() == E_FWSWAP_RECEIVING){
+        next = (uint32_t)Drv_FwSwap_GetWrittenPages() * FWSWAP_PAGE_SIZE;
+        if(next > pHdr->size){
+            next = pHdr->size;
+        }
+    }
+    reply[0] = (uint8_t)Drv_FwSwap_GetState();
+    App_Update_PutU32(&reply[1], next);
+    App_Update_PutU32(&reply[5], (pHdr != NULL) ? pHdr->version : 0);
+    reply[9] = Drv_FwSwap_GetTrialBoots();
+    App_Comm_SendFrame(PROTOCOL_MODULE_SYSTEM, PROTOCOL_CMD_UPDATE_QUERY, reply, sizeof(reply));
+}
+
+/**
+ * @brief ABORT: 会话中止并回到正常模式；已暂存（等待复位）时拒绝
+ */
+void App_Update_Abort(void)
+{
+    if(s_Update.eState == E_UPDATE_RESTART){
+        App_Update_Reply(PROTOCOL_CMD_UPDATE_ABORT, UPDATE_RESULT_STATE);
+        return;
+    }
+    if(s_Update.eState != E_UPDATE_IDLE){
+        App_Update_Stop("aborted");
+    }
+    App_Update_Reply(PROTOCOL_CMD_UPDATE_ABORT, UPDATE_RESULT_OK);
+}
+
+/**
+ * @brief E_SYSTEM_UPDATE_MODE主循环：擦写流水线、END校验、复位
+ */
+void App_Update_Process(void)
+{
+    switch(s_Update.eState)
+    {
+        case E_UPDATE_RECEIVING:
+        case E_UPDATE_FAILED:
+            // 主机掉线：超时无有效数据帧则退出升级模式，治疗与低功耗恢复
+            if(Drv_Delay_GetTickMs() - s_Update.stats.lastMs >= UPDATE_IDLE_TIMEOUT_MS){
+                App_Update_Stop("timed out");
+                break;
+            }
+            App_Update_FlashStep();
+            break;
+        case E_UPDATE_FINISHING:
+            App_Update_FlashStep();
+            if(s_Update.eState == E_UPDATE_FINISHING){
+                App_Update_Finish();
+            }else{
+                App_Update_Reply(PROTOCOL_CMD_UPDATE_END, UPDATE_RESULT_FLASH);
+            }
+            break;
+        case E_UPDATE_RESTART:
+            if(Drv_Timer_Tick(&s_Update.restartTimer, UPDATE_RESTART_MS)){
+                Drv_FwSwap_Restart();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief 擦写流水线有待处理的页：主循环不可睡眠；否则接收由DMA与IDLE中断唤醒
+ */
+bool App_Update_IsBusy(void)
+{
+    return App_Update_GetFlashBuf() != NULL || s_Update.eState == E_UPDATE_FINISHING;
+}
+
+const Update_Stats_t *App_Update_GetStats(void)
+{
+    return &s_Update.stats;
+}
+
+/**************************End of file********************************/
@@ -0,0 +1,60 @@
+/************************************************************************************
+* @file     : app_update.h
+* @brief    : Firmware update service over USART1 (E_SYSTEM_UPDATE_MODE)
+* @details  : Chunks are collected into two page buffers: while one fills from the
+*             link, the other is erased and programmed into the staging slot a slice
+*             per main-loop pass, so flash stalls overlap reception. The swap itself
+*             happens at the next boot, in the bootloader (drv_fwswap_exec).
+*             A session ends on ABORT or after UPDATE_IDLE_TIMEOUT_MS without an
+*             accepted chunk; the verified pages stay, BEGIN with the same image resumes.
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_UPDATE_H
+#define APP_UPDATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#define UPDATE_CONFIRM_MS           10000   ///< NORMAL mode run time that confirms a trial image
+#define UPDATE_IDLE_TIMEOUT_MS      5000    ///< No accepted chunk for this long ends the session
+
+typedef struct
+{
+    uint32_t bytes;              ///< Image bytes accepted this session
+    uint32_t startMs;            ///< First BEGIN of the session
+    uint32_t lastMs;             ///< Last accepted chunk
+    uint32_t flashUs;            ///< CPU stall in erase/program this session
+    uint16_t pages;              ///< Staging pages written and verified
+    uint16_t busyNaks;           ///< Chunks refused because both page buffers were busy
+    uint16_t seqNaks;            ///< Chunks at an unexpected offset
+    uint16_t crcNaks;            ///< Chunks with a bad CRC
+} Update_Stats_t;
+
+void App_Update_Init(void);
+void App_Update_Process(void);
+bool App_Update_IsBusy(void);
+/** Confirm the running image if it is on trial; call once it has proven itself. */
+void App_Update_Confirm(void);
+
+/* Protocol handlers (PROTOCOL_MODULE_SYSTEM), pData points at the frame data field */
+void App_Update_Begin(const uint8_t *pData, uint8_t len);
+void App_Update_Data(const uint8_t *pData, uint8_t len);
+void App_Update_End(void);
+void App_Update_Query(void);
+void App_Update_Abort(void);
+
+const Update_Stats_t *App_Update_GetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_UPDATE_H
+/**************************End of file********************************/
@@ -0,0 +1,205 @@
+/***********************************************************************************
+* @file     : app_usage.c
+* @brief    : Per-probe usage metering implementation
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#define LOG_DOMAIN  LOG_DOMAIN_MEM
+#include "app_usage.h"
+#include "app_session.h"
+#include "drv_power.h"
+#include "log.h"
+
+typedef struct
+{
+    uint32_t energisedMs;
+    uint32_t shots;
+    uint16_t sessions;
+    uint16_t resonanceKHz;       ///< 新测得的谐振点，0：不变
+} Usage_Delta_t;
+
+static Usage_Delta_t s_pending;          ///< 尚未提交
+static Usage_Delta_t s_inFlight;         ///< 已交给驱动，等待写入结果
+static bool s_inFlightValid = false;
+static uint16_t s_expectSeq = 0;         ///< 写入成功后记录应有的序号
+static bool s_commitReq = false;
+static Usage_Stats_t s_stats;
+
+/* 不足1s的时长余数不算待提交 */
+static bool App_Usage_HasPending(void)
+{
+    return s_pending.energisedMs >= 1000u || s_pending.shots != 0 || s_pending.sessions != 0 ||
+           s_pending.resonanceKHz != 0;
+}
+
+/* pDst为较新的一批：计数相加，谐振点以较新的为准 */
+static void App_Usage_Merge(Usage_Delta_t *pDst, const Usage_Delta_t *pSrc)
+{
+    pDst->energisedMs += pSrc->energisedMs;
+    pDst->shots += pSrc->shots;
+    pDst->sessions += pSrc->sessions;
+    if(pDst->resonanceKHz == 0)
+    {
+        pDst->resonanceKHz = pSrc->resonanceKHz;
+    }
+}
+
+void App_Usage_AddEnergisedMs(uint32_t ms)
+{
+    s_pending.energisedMs += ms;
+}
+
+void App_Usage_AddShot(void)
+{
+    s_pending.shots++;
+}
+
+void App_Usage_SetResonance(uint16_t kHz)
+{
+    s_pending.resonanceKHz = kHz;
+    s_commitReq = true;
+}
+
+void App_Usage_EndSession(void)
+{
+    s_pending.sessions++;
+    s_commitReq = true;
+}
+
+/**
+ * @brief 记录 = 探头现有记录 + 待提交；不足1s的时长留待下次
+ */
+static void App_Usage_Commit(bool urgent)
+{
+    const ProbeId_Usage_t *pBase = Drv_ProbeId_GetUsage();
+    ProbeId_Usage_t next;
+    Usage_Delta_t delta;
+
+    if(pBase == NULL)
+    {
+        return;
+    }
+    if(s_inFlightValid)
+    {
+        if(!urgent)
+        {
+            return;
+        }
+        // 紧急提交接管进行中的写入，其批次并入本次
+        App_Usage_Merge(&s_pending, &s_inFlight);
+        s_inFlightValid = false;
+    }
+    delta = s_pending;
+    delta.energisedMs -= delta.energisedMs % 1000u;
+    next = *pBase;
+    next.energisedS += delta.energisedMs / 1000u;
+    next.shots += delta.shots;
+    next.sessions += delta.sessions;
+    if(delta.resonanceKHz != 0)
+    {
+        next.resonanceKHz = delta.resonanceKHz;
+    }
+    if(!Drv_ProbeId_WriteUsage(&next, urgent))
+    {
+        return;
+    }
+    s_pending.energisedMs %= 1000u;
+    s_pending.shots = 0;
+    s_pending.sessions = 0;
+    s_pending.resonanceKHz = 0;
+    s_inFlight = delta;
+    s_inFlightValid = true;
+    s_expectSeq = (uint16_t)(pBase->seq + 1u);
+    s_commitReq = false;
+}
+
+/**
+ * @brief 驱动空闲后按记录序号判断写入结果，失败则退回待提交
+ */
+static void App_Usage_CheckResult(void)
+{
+    const ProbeId_Usage_t *pUsage = Drv_ProbeId_GetUsage();
+
+    if(!s_inFlightValid || Drv_ProbeId_IsWriting())
+    {
+        return;
+    }
+    s_inFlightValid = false;
+    if(pUsage != NULL && pUsage->seq == s_expectSeq)
+    {
+        s_stats.commits++;
+        LOG_I("Probe usage: %d s, %d shots, %d sessions (seq %d)",
+              pUsage->energisedS, pUsage->shots, pUsage->sessions, pUsage->seq);
+        return;
+    }
+    s_stats.failures++;
+    App_Usage_Merge(&s_pending, &s_inFlight);
+    s_commitReq = true;
+    LOG_W("Probe usage: commit failed, kept in RAM");
+}
+
+void App_Usage_Process(void)
+{
+    // 先确认已完成的写入，紧急提交才不会重复计入
+    App_Usage_CheckResult();
+    if(Drv_Power_TakeSupplyWarning())
+    {
+        // 电源跌落：把输出中的片段结算进来，立即写入
+        App_Session_Checkpoint();
+        s_stats.urgent++;
+        App_Usage_Commit(true);
+    }
+
+    if(Drv_ProbeId_GetUsage() == NULL)
+    {
+        // 探头已拔出或未识别，计数无法归属
+        if(App_Usage_HasPending() || s_inFlightValid)
+        {
+            s_stats.lost++;
+            LOG_W("Probe usage: %d ms, %d shots dropped, probe gone",
+                  s_pending.energisedMs, s_pending.shots);
+        }
+        memset(&s_pending, 0, sizeof(s_pending));
+        s_inFlightValid = false;
+        s_commitReq = false;
+        return;
+    }
+    if(s_commitReq)
+    {
+        App_Usage_Commit(false);
+    }
+}
+
+bool App_Usage_GetTotals(ProbeId_Usage_t *pTotals)
+{
+    const ProbeId_Usage_t *pBase = Drv_ProbeId_GetUsage();
+    Usage_Delta_t delta = s_pending;
+
+    if(pBase == NULL || pTotals == NULL)
+    {
+        return false;
+    }
+    if(s_inFlightValid && pBase->seq != s_expectSeq)
+    {
+        App_Usage_Merge(&delta, &s_inFlight);
+    }
+    *pTotals = *pBase;
+    pTotals->energisedS += delta.energisedMs / 1000u;
+    pTotals->shots += delta.shots;
+    pTotals->sessions += delta.sessions;
+    if(delta.resonanceKHz != 0)
+    {
+        pTotals->resonanceKHz = delta.resonanceKHz;
+    }
+    return true;
+}
+
+const Usage_Stats_t *App_Usage_GetStats(void)
+{
+    return &s_stats;
+}
+
+/**************************End of file********************************/
@@ -0,0 +1,49 @@
+/************************************************************************************
+* @file     : app_usage.h
+* @brief    : Per-probe usage metering
+* @details  : 输出时长、冲击波发数、治疗次数先在RAM中累计，会话结束或电源跌落
+*             预警时才合并进探头上的使用记录（drv_probeid，双副本），每次治疗
+*             只写一次EEPROM。未提交时探头被拔出，这部分计数丢弃并计入lost。
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_USAGE_H
+#define APP_USAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#include "drv_probeid.h"
+
+typedef struct
+{
+    uint16_t commits;            ///< 已写入并校验的记录
+    uint16_t failures;           ///< 写入失败，计数退回待提交
+    uint16_t lost;               ///< 探头拔出时丢弃的待提交批次
+    uint16_t urgent;             ///< 电源跌落时的紧急提交
+} Usage_Stats_t;
+
+void App_Usage_AddEnergisedMs(uint32_t ms);
+void App_Usage_AddShot(void);
+/** 一次有输出的治疗结束：次数加一并请求提交 */
+void App_Usage_EndSession(void);
+/** 本探头新测得的超声谐振点（kHz），随下一次记录写入探头 */
+void App_Usage_SetResonance(uint16_t kHz);
+/** 每次主循环调用：电源预警、提交与结果确认 */
+void App_Usage_Process(void);
+/** 探头记录加上未提交部分；未识别探头时返回false */
+bool App_Usage_GetTotals(ProbeId_Usage_t *pTotals);
+const Usage_Stats_t *App_Usage_GetStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_USAGE_H
+/**************************End of file********************************/
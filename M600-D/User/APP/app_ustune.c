@@ -0,0 +1,190 @@
+/***********************************************************************************
+* @file     : app_ustune.c
+* @brief    : Ultrasound transducer resonance search and tracking implementation
+* @details  :
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+**********************************************************************************/
+#include "app_ustune.h"
+#include <string.h>
+
+/**
+ * @brief Start scanning [lo, hi] from lo
+ */
+static void App_USTune_StartScan(US_Tune_t *pTune, US_Tune_State_EnumDef state, uint16_t lo, uint16_t hi)
+{
+    pTune->eState = state;
+    pTune->scanLo = lo;
+    pTune->scanHi = hi;
+    pTune->freq = lo;
+    pTune->bestFreq = lo;
+    pTune->bestY = 0;
+    pTune->sumY = 0;
+    pTune->acc = 0;
+    pTune->step = 0;
+}
+
+/**
+ * @brief Fine scan one coarse step either side of the peak, within the output range
+ */
+static void App_USTune_StartFine(US_Tune_t *pTune, uint16_t peak)
+{
+    uint16_t lo = (peak > US_TUNE_FREQ_MIN_KHZ + US_TUNE_COARSE_STEP_KHZ) ?
+                  (uint16_t)(peak - US_TUNE_COARSE_STEP_KHZ) : (uint16_t)(US_TUNE_FREQ_MIN_KHZ + 1);
+    uint16_t hi = (peak + US_TUNE_COARSE_STEP_KHZ < US_TUNE_FREQ_MAX_KHZ) ?
+                  (uint16_t)(peak + US_TUNE_COARSE_STEP_KHZ) : (uint16_t)US_TUNE_FREQ_MAX_KHZ;
+
+    App_USTune_StartScan(pTune, E_US_TUNE_FINE, lo, hi);
+}
+
+static void App_USTune_StartCoarse(US_Tune_t *pTune)
+{
+    pTune->coarseDone = true;
+    App_USTune_StartScan(pTune, E_US_TUNE_COARSE, US_TUNE_FREQ_MIN_KHZ + US_TUNE_COARSE_STEP_KHZ / 2,
+                         US_TUNE_FREQ_MAX_KHZ - US_TUNE_COARSE_STEP_KHZ / 2);
+}
+
+/**
+ * @brief One averaged point of a coarse or fine scan
+ */
+static void App_USTune_ScanPoint(US_Tune_t *pTune, uint32_t y)
+{
+    uint16_t step = (pTune->eState == E_US_TUNE_COARSE) ? US_TUNE_COARSE_STEP_KHZ : US_TUNE_FINE_STEP_KHZ;
+    uint16_t points;
+    bool edge;
+
+    pTune->points++;
+    pTune->sumY += y;
+    if(y > pTune->bestY) {
+        pTune->bestY = y;
+        pTune->bestFreq = pTune->freq;
+    }
+    if(pTune->freq + step <= pTune->scanHi) {
+        pTune->freq += step;
+        return;
+    }
+
+    if(pTune->eState == E_US_TUNE_COARSE) {
+        // 峰值不明显：未耦合的治疗头导纳曲线平坦
+        points = (uint16_t)((pTune->scanHi - pTune->scanLo) / step + 1u);
+        if((uint64_t)pTune->bestY * points * 100u < (uint64_t)pTune->sumY * US_TUNE_PEAK_MIN_PCT) {
+            pTune->eState = E_US_TUNE_FAILED;
+            return;
+        }
+        App_USTune_StartFine(pTune, pTune->bestFreq);
+        return;
+    }
+
+    // 仅细扫时峰落在窗口边缘，说明谐振已移出窗口：改做全程粗扫
+    edge = (pTune->bestFreq == pTune->scanLo && pTune->scanLo > US_TUNE_FREQ_MIN_KHZ + 1) ||
+           (pTune->bestFreq == pTune->scanHi && pTune->scanHi < US_TUNE_FREQ_MAX_KHZ);
+    if(edge && !pTune->coarseDone) {
+        App_USTune_StartCoarse(pTune);
+        return;
+    }
+    pTune->eState = E_US_TUNE_FOUND;
+    pTune->anchor = pTune->bestFreq;
+    pTune->center = pTune->bestFreq;
+    pTune->freq = pTune->bestFreq;
+}
+
+/**
+ * @brief One averaged point of the +/-/centre dither cycle
+ */
+static void App_USTune_TrackPoint(US_Tune_t *pTune, uint32_t y)
+{
+    uint32_t margin;
+
+    pTune->y[pTune->dither] = y;
+    if(pTune->dither == 0) {
+        pTune->dither = 1;
+        pTune->freq = (uint16_t)(pTune->center - US_TUNE_DITHER_KHZ);
+        return;
+    }
+    if(pTune->dither == 1) {
+        pTune->dither = 2;
+        pTune->freq = pTune->center;
+        return;
+    }
+
+    // 超过噪声余量才移动，避免在峰顶来回摆动
+    margin = pTune->y[2] >> 6;
+    if(pTune->y[0] > pTune->y[2] + margin && pTune->y[0] >= pTune->y[1] &&
+       pTune->center + US_TUNE_DITHER_KHZ <= pTune->anchor + US_TUNE_TRACK_RANGE_KHZ &&
+       pTune->center + US_TUNE_DITHER_KHZ <= US_TUNE_FREQ_MAX_KHZ - US_TUNE_DITHER_KHZ) {
+        pTune->center += US_TUNE_DITHER_KHZ;
+        pTune->moves++;
+    } else if(pTune->y[1] > pTune->y[2] + margin &&
+              pTune->center - US_TUNE_DITHER_KHZ + US_TUNE_TRACK_RANGE_KHZ >= pTune->anchor &&
+              pTune->center - US_TUNE_DITHER_KHZ > US_TUNE_FREQ_MIN_KHZ + US_TUNE_DITHER_KHZ) {
+        pTune->center -= US_TUNE_DITHER_KHZ;
+        pTune->moves++;
+    }
+    pTune->dither = 0;
+    pTune->freq = (uint16_t)(pTune->center + US_TUNE_DITHER_KHZ);
+}
+
+void App_USTune_Search(US_Tune_t *pTune, uint16_t hintKHz)
+{
+    memset(pTune, 0, sizeof(US_Tune_t));
+    if(hintKHz > US_TUNE_FREQ_MIN_KHZ && hintKHz <= US_TUNE_FREQ_MAX_KHZ) {
+        App_USTune_StartFine(pTune, hintKHz);
+    } else {
+        App_USTune_StartCoarse(pTune);
+    }
+}
+
+void App_USTune_Track(US_Tune_t *pTune)
+{
+    if(pTune->eState != E_US_TUNE_FOUND) {
+        return;
+    }
+    pTune->eState = E_US_TUNE_TRACKING;
+    pTune->center = pTune->anchor;
+    pTune->dither = 0;
+    pTune->freq = (uint16_t)(pTune->center + US_TUNE_DITHER_KHZ);
+    pTune->acc = 0;
+    pTune->step = 0;
+}
+
+uint16_t App_USTune_Step(US_Tune_t *pTune, uint32_t admittance)
+{
+    bool tracking = (pTune->eState == E_US_TUNE_TRACKING);
+    uint8_t settle = tracking ? US_TUNE_TRACK_SETTLE_STEPS : US_TUNE_SETTLE_STEPS;
+    uint8_t avg = tracking ? US_TUNE_TRACK_AVG_STEPS : US_TUNE_AVG_STEPS;
+
+    if(pTune->eState != E_US_TUNE_COARSE && pTune->eState != E_US_TUNE_FINE && !tracking) {
+        return pTune->freq;
+    }
+    if(!tracking) {
+        pTune->steps++;
+    }
+    if(++pTune->step <= settle) {
+        return pTune->freq;
+    }
+    pTune->acc += admittance;
+    if(pTune->step < settle + avg) {
+        return pTune->freq;
+    }
+    admittance = pTune->acc / avg;
+    pTune->acc = 0;
+    pTune->step = 0;
+    if(tracking) {
+        App_USTune_TrackPoint(pTune, admittance);
+    } else {
+        App_USTune_ScanPoint(pTune, admittance);
+    }
+    return pTune->freq;
+}
+
+uint32_t App_USTune_Admittance(uint16_t current_mv, uint16_t voltage_mv)
+{
+    if(voltage_mv == 0) {
+        return 0;
+    }
+    return ((uint32_t)current_mv << US_TUNE_ADMITTANCE_SHIFT) / voltage_mv;
+}
+
+/**************************End of file********************************/
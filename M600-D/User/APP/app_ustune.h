@@ -0,0 +1,94 @@
+/************************************************************************************
+* @file     : app_ustune.h
+* @brief    : Ultrasound transducer resonance search and tracking
+* @details  : 换能器串联谐振处导纳最大。每个测量点先丢弃若干步（SI5351换频后等待稳定），
+*             再平均若干步的导纳样本（US_I / DAC电压，与调压环解耦）。
+*             搜索：700-1400kHz粗扫后在峰值±一个粗步长内细扫；有上次谐振点时只做细扫，
+*             峰落在细扫窗口边缘才退回全程粗扫。
+*             跟踪：治疗中在中心频率两侧±抖动步长轮流测量，向导纳大的一侧移动一步，
+*             偏离搜索结果不超过US_TUNE_TRACK_RANGE_KHZ。
+*             本模块只做算法，不访问硬件：调用方每步传入导纳，按返回频率输出。
+* @author   : \.rumi
+* @date     : 2025-01-23
+* @version  : V1.0.0
+* @copyright: Copyright (c) 2050
+***********************************************************************************/
+#ifndef APP_USTUNE_H
+#define APP_USTUNE_H
+
+#include <stdbool.h>
+#include "stdint.h"
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+#define US_TUNE_FREQ_MIN_KHZ        700     ///< SI5351输出下限（不含）
+#define US_TUNE_FREQ_MAX_KHZ        1400
+#define US_TUNE_COARSE_STEP_KHZ     20      ///< 粗扫步长，点位于步长中点
+#define US_TUNE_FINE_STEP_KHZ       2
+#define US_TUNE_DITHER_KHZ          1       ///< 跟踪抖动/移动步长
+#define US_TUNE_TRACK_RANGE_KHZ     30      ///< 跟踪相对搜索结果的最大偏移
+#define US_TUNE_SETTLE_STEPS        1       ///< 搜索：换频后丢弃的步数
+#define US_TUNE_AVG_STEPS           2       ///< 搜索：每点平均的步数
+#define US_TUNE_TRACK_SETTLE_STEPS  2       ///< 跟踪：换频后丢弃的步数
+#define US_TUNE_TRACK_AVG_STEPS     4       ///< 跟踪：每点平均的步数
+#define US_TUNE_PEAK_MIN_PCT        125     ///< 粗扫峰值须高于粗扫均值的百分比
+#define US_TUNE_ADMITTANCE_SHIFT    10      ///< 导纳 = US_I(mV) << 10 / DAC(mV)
+
+typedef enum
+{
+    E_US_TUNE_IDLE = 0,
+    E_US_TUNE_COARSE,
+    E_US_TUNE_FINE,
+    E_US_TUNE_FOUND,
+    E_US_TUNE_FAILED,              ///< 无明显谐振峰（治疗头未耦合或损坏）
+    E_US_TUNE_TRACKING,
+} US_Tune_State_EnumDef;
+
+typedef struct
+{
+    US_Tune_State_EnumDef eState;
+    uint16_t freq;                 ///< 当前应输出的频率 (kHz)
+    uint16_t center;               ///< 跟踪中心 (kHz)
+    uint16_t anchor;               ///< 搜索结果 (kHz)
+    uint16_t scanLo;               ///< 当前扫描区间 (kHz)
+    uint16_t scanHi;
+    uint16_t bestFreq;
+    uint32_t bestY;
+    uint32_t sumY;                 ///< 粗扫导纳和，用于峰值判定
+    uint32_t acc;                  ///< 当前点导纳累加
+    uint8_t step;                  ///< 当前点已过步数
+    uint8_t dither;                ///< 跟踪：0 测+侧，1 测-侧，2 测中心
+    bool coarseDone;               ///< 本次搜索已做过粗扫
+    uint32_t y[3];                 ///< 跟踪：+侧、-侧、中心导纳
+    uint16_t points;               ///< 本次搜索测量点数
+    uint16_t steps;                ///< 本次搜索总步数
+    uint16_t moves;                ///< 跟踪移动次数
+} US_Tune_t;
+
+/**
+ * @brief Start a resonance search
+ * @param hintKHz Last known resonance of this probe, 0 for a full sweep
+ */
+void App_USTune_Search(US_Tune_t *pTune, uint16_t hintKHz);
+/**
+ * @brief Switch a finished search (E_US_TUNE_FOUND) to tracking
+ */
+void App_USTune_Track(US_Tune_t *pTune);
+/**
+ * @brief Feed one admittance sample for the frequency returned last time
+ * @retval Frequency to output until the next step (kHz)
+ */
+uint16_t App_USTune_Step(US_Tune_t *pTune, uint32_t admittance);
+/**
+ * @brief Admittance sample from US_I and the DAC set-point, 0 when not driven
+ */
+uint32_t App_USTune_Admittance(uint16_t current_mv, uint16_t voltage_mv);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // APP_USTUNE_H
+/**************************End of file********************************/
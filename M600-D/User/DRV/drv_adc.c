@@ -3,6 +3,7 @@
  * @brief    : ADC driver - DRV calls DAL, DAL calls BSP (Std lib)
  ***********************************************************************************/
 #include "drv_adc.h"
+#include "drv_trace.h"
 #include "bsp_adc.h"
 
 #define ADC_REF_MV      3300u
@@ -30,8 +31,11 @@ static uint16_t Dal_ADC_ReadChannel(ADC_Channel_EnumDef channel)
         return 0;
     if (channel == E_ADC_CHANNEL_VER_ID || channel == E_ADC_CHANNEL_VOUT)
         return 0;
-    BSP_ADC_Channel_t bch = Dal_ADC_MapChannel(channel);
-    return BSP_ADC_ReadChannel(bch);
+    uint16_t raw;
+    if (Drv_Trace_ReplayAdc(channel, &raw))
+        return raw;
+    raw = BSP_ADC_ReadChannel(Dal_ADC_MapChannel(channel));
+    return Drv_Trace_RecordAdc(channel, raw);
 }
 
 uint16_t Drv_ADC_ReadChannel(ADC_Channel_EnumDef channel)
@@ -5,7 +5,6 @@
 #ifndef DRV_ADC_H
 #define DRV_ADC_H
 
-#include "stm32f10x.h"
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -0,0 +1,247 @@
+/************************************************************************************
+ * @file     : drv_blackbox.c
+ * @brief    : Reset-surviving black-box event recorder - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_blackbox.h"
+#include "bsp_delay.h"
+#include "stm32f10x.h"
+#include <stddef.h>
+#include <string.h>
+
+#define BLACKBOX_RING_MASK      (BLACKBOX_RING_SIZE - 1u)
+#define BLACKBOX_MAGIC          0x42424F58u     /* "BBOX" */
+#define BLACKBOX_FAULT_MAGIC    0x464C5421u     /* "FLT!" */
+#define BLACKBOX_RAM_START      0x20000000u
+#define BLACKBOX_RAM_END        0x2000C000u
+#define BLACKBOX_CSR_PORRST     (1u << 27)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t head;
+    uint16_t count;
+    uint16_t boots;             /* resets survived since the last power-on */
+    uint16_t reserved;
+    BlackBox_Event_t ring[BLACKBOX_RING_SIZE];
+    uint32_t faultMagic;
+    BlackBox_Fault_t fault;
+} BlackBox_NoInit_t;
+
+/* Kept out of the C startup's zero-init; see BLACKBOX_NOINIT_ADDR */
+#if defined(__CC_ARM)
+static BlackBox_NoInit_t s_bb __attribute__((at(BLACKBOX_NOINIT_ADDR), zero_init));
+#else
+static BlackBox_NoInit_t s_bb __attribute__((section(".noinit")));
+#endif
+
+static bool s_hasHistory = false;
+
+/* DAL: only called from DRV; calls BSP */
+static uint32_t Dal_BlackBox_GetTick(void)
+{
+    return BSP_GetTick_ms();
+}
+
+static uint32_t Dal_BlackBox_Lock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static void Dal_BlackBox_Unlock(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+static uint32_t Dal_BlackBox_GetResetFlags(void)
+{
+    return RCC->CSR;
+}
+
+static void Dal_BlackBox_ClearResetFlags(void)
+{
+    RCC->CSR |= RCC_CSR_RMVF;
+}
+
+static bool BlackBox_IsRam(uint32_t addr, uint32_t len)
+{
+    return addr >= BLACKBOX_RAM_START && addr <= BLACKBOX_RAM_END - len;
+}
+
+static const BlackBox_Event_t* BlackBox_At(uint16_t index)
+{
+    return &s_bb.ring[(uint16_t)(s_bb.head - s_bb.count + index) & BLACKBOX_RING_MASK];
+}
+
+static void BlackBox_Clear(void)
+{
+    memset(&s_bb, 0, sizeof(s_bb));
+    s_bb.magic = BLACKBOX_MAGIC;
+}
+
+static uint8_t* BlackBox_PutU16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    return p + 2;
+}
+
+static uint8_t* BlackBox_PutU32(uint8_t *p, uint32_t v)
+{
+    p = BlackBox_PutU16(p, (uint16_t)v);
+    return BlackBox_PutU16(p, (uint16_t)(v >> 16));
+}
+
+uint32_t Drv_BlackBox_Init(void)
+{
+    uint32_t csr = Dal_BlackBox_GetResetFlags();
+
+    /* Flags accumulate until cleared: without this a later reset would still show PORRST */
+    Dal_BlackBox_ClearResetFlags();
+
+    if ((csr & BLACKBOX_CSR_PORRST) || s_bb.magic != BLACKBOX_MAGIC ||
+        s_bb.head >= BLACKBOX_RING_SIZE || s_bb.count > BLACKBOX_RING_SIZE) {
+        BlackBox_Clear();
+        s_hasHistory = false;
+    } else {
+        s_bb.boots++;
+        s_hasHistory = true;
+    }
+    Drv_BlackBox_Record(E_BB_EVT_BOOT, 0, (uint16_t)(csr >> 24));
+    return csr;
+}
+
+void Drv_BlackBox_Record(BlackBox_EvtType_EnumDef type, uint8_t arg, uint16_t value)
+{
+    uint32_t primask = Dal_BlackBox_Lock();
+    BlackBox_Event_t *pEvt = &s_bb.ring[s_bb.head];
+
+    pEvt->tick_ms = Dal_BlackBox_GetTick();
+    pEvt->type = (uint8_t)type;
+    pEvt->arg = arg;
+    pEvt->value = value;
+    s_bb.head = (uint16_t)((s_bb.head + 1u) & BLACKBOX_RING_MASK);
+    if (s_bb.count < BLACKBOX_RING_SIZE)
+        s_bb.count++;
+    Dal_BlackBox_Unlock(primask);
+}
+
+bool Drv_BlackBox_HasHistory(void)
+{
+    return s_hasHistory;
+}
+
+uint16_t Drv_BlackBox_GetCount(void)
+{
+    return s_bb.count;
+}
+
+/** Copy events oldest-first starting at index first; returns events copied. */
+uint16_t Drv_BlackBox_Copy(uint16_t first, BlackBox_Event_t *pOut, uint16_t max)
+{
+    uint16_t n = 0;
+    uint32_t primask;
+
+    if (pOut == NULL)
+        return 0;
+    primask = Dal_BlackBox_Lock();
+    while (n < max && (uint16_t)(first + n) < s_bb.count) {
+        pOut[n] = *BlackBox_At((uint16_t)(first + n));
+        n++;
+    }
+    Dal_BlackBox_Unlock(primask);
+    return n;
+}
+
+const BlackBox_Fault_t* Drv_BlackBox_GetFault(void)
+{
+    return (s_bb.faultMagic == BLACKBOX_FAULT_MAGIC) ? &s_bb.fault : NULL;
+}
+
+void Drv_BlackBox_ClearFault(void)
+{
+    s_bb.faultMagic = 0;
+}
+
+/** Compact image for persistence; returns bytes written or 0 if size is too small. */
+uint16_t Drv_BlackBox_Export(uint8_t *pBuf, uint16_t size)
+{
+    const BlackBox_Fault_t *pFault = Drv_BlackBox_GetFault();
+    const BlackBox_Event_t *pEvt;
+    uint8_t *p = pBuf;
+    uint32_t prevTick;
+    uint32_t delta;
+    uint32_t primask;
+    uint16_t i;
+
+    if (pBuf == NULL || size < BLACKBOX_EXPORT_MAX)
+        return 0;
+
+    primask = Dal_BlackBox_Lock();
+    prevTick = (s_bb.count > 0) ? BlackBox_At(0)->tick_ms : 0;
+    *p++ = (uint8_t)s_bb.count;
+    *p++ = (pFault != NULL) ? BLACKBOX_EXPORT_FLAG_FAULT : 0u;
+    p = BlackBox_PutU16(p, s_bb.boots);
+    p = BlackBox_PutU32(p, prevTick);
+    if (pFault != NULL) {
+        p = BlackBox_PutU32(p, pFault->excReturn);
+        p = BlackBox_PutU32(p, pFault->sp);
+        for (i = 0; i < 8u; i++)
+            p = BlackBox_PutU32(p, pFault->frame[i]);
+        p = BlackBox_PutU32(p, pFault->cfsr);
+        p = BlackBox_PutU32(p, pFault->hfsr);
+        p = BlackBox_PutU32(p, pFault->mmfar);
+        p = BlackBox_PutU32(p, pFault->bfar);
+        for (i = 0; i < BLACKBOX_FAULT_STACK_WORDS; i++)
+            p = BlackBox_PutU32(p, pFault->stack[i]);
+    }
+    for (i = 0; i < s_bb.count; i++) {
+        pEvt = BlackBox_At(i);
+        /* The tick restarts at every boot: a backwards step is the new boot's own tick */
+        delta = (pEvt->tick_ms >= prevTick) ? pEvt->tick_ms - prevTick : pEvt->tick_ms;
+        p = BlackBox_PutU16(p, (uint16_t)(delta > 0xFFFFu ? 0xFFFFu : delta));
+        *p++ = pEvt->type;
+        *p++ = pEvt->arg;
+        p = BlackBox_PutU16(p, pEvt->value);
+        prevTick = pEvt->tick_ms;
+    }
+    Dal_BlackBox_Unlock(primask);
+    return (uint16_t)(p - pBuf);
+}
+
+void Drv_BlackBox_SaveFault(uint32_t excReturn, uint32_t sp)
+{
+    BlackBox_Fault_t *pFault = &s_bb.fault;
+    const uint32_t *pStack;
+    uint32_t i;
+
+    if (s_bb.magic != BLACKBOX_MAGIC)
+        BlackBox_Clear();
+
+    memset(pFault, 0, sizeof(*pFault));
+    if (excReturn & 0x4u)
+        sp = __get_PSP();
+    pFault->excReturn = excReturn;
+    pFault->sp = sp;
+    pFault->cfsr = SCB->CFSR;
+    pFault->hfsr = SCB->HFSR;
+    pFault->mmfar = SCB->MMFAR;
+    pFault->bfar = SCB->BFAR;
+    pFault->exception = SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk;
+
+    /* A corrupted SP must not fault again inside the fault handler */
+    if (BlackBox_IsRam(sp, sizeof(pFault->frame))) {
+        pStack = (const uint32_t *)(uintptr_t)sp;
+        for (i = 0; i < 8u; i++)
+            pFault->frame[i] = pStack[i];
+        for (i = 0; i < BLACKBOX_FAULT_STACK_WORDS && BlackBox_IsRam(sp + (8u + i) * 4u, 4u); i++)
+            pFault->stack[i] = pStack[8u + i];
+    }
+    s_bb.faultMagic = BLACKBOX_FAULT_MAGIC;
+    Drv_BlackBox_Record(E_BB_EVT_FAULT, (uint8_t)pFault->exception, (uint16_t)pFault->frame[6]);
+}
+
+void Drv_BlackBox_Reset(void)
+{
+    NVIC_SystemReset();
+}
@@ -0,0 +1,88 @@
+/************************************************************************************
+ * @file     : drv_blackbox.h
+ * @brief    : Reset-surviving black-box event recorder - DRV API, DAL calls BSP (Std lib)
+ * @details  : Fixed 8-byte events (tick, type, arg, value) in a RAM ring that is not
+ *             cleared by the C startup, so it survives watchdog, software and fault
+ *             resets. Fault handlers snapshot the stacked registers, fault status
+ *             registers and the top of the stack into the same block, then reset.
+ *             At the next boot the block is exported in a compact form (16-bit tick
+ *             deltas) for the application to persist and serve over the protocol.
+ *             Power-on resets start a fresh ring.
+ ***********************************************************************************/
+#ifndef DRV_BLACKBOX_H
+#define DRV_BLACKBOX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BLACKBOX_RING_SIZE          64u         /* events, power of 2 (512 B) */
+#define BLACKBOX_FAULT_STACK_WORDS  8u          /* words above the exception frame */
+#define BLACKBOX_NOINIT_ADDR        0x2000BC00u /* IRAM2, NoInit in the project memory layout */
+
+typedef enum {
+    E_BB_EVT_BOOT = 0,          /* value: RCC_CSR[31:24] reset flags */
+    E_BB_EVT_WDG_RESET,         /* independent watchdog reset seen at boot */
+    E_BB_EVT_STATE,             /* arg: PROTOCOL_MODULE_* (0 = treat manager), value: new state */
+    E_BB_EVT_ERROR,             /* arg: PROTOCOL_MODULE_*, value: error code */
+    E_BB_EVT_TRIP,              /* arg: ADC_Channel_EnumDef, value: sample (mV) */
+    E_BB_EVT_FAULT,             /* arg: exception number, value: faulting PC[15:0] */
+    E_BB_EVT_FAN,               /* arg: Fan_Fault_EnumDef, value: board temperature (0.1 C) */
+    E_BB_EVT_MAX,
+} BlackBox_EvtType_EnumDef;
+
+typedef struct {
+    uint32_t tick_ms;           /* BSP tick when recorded (restarts at every boot) */
+    uint8_t type;               /* BlackBox_EvtType_EnumDef */
+    uint8_t arg;
+    uint16_t value;
+} BlackBox_Event_t;
+
+typedef struct {
+    uint32_t excReturn;         /* EXC_RETURN (LR on entry) */
+    uint32_t sp;                /* stack pointer holding the exception frame */
+    uint32_t frame[8];          /* r0, r1, r2, r3, r12, lr, pc, xpsr */
+    uint32_t cfsr;
+    uint32_t hfsr;
+    uint32_t mmfar;
+    uint32_t bfar;
+    uint32_t exception;         /* ICSR.VECTACTIVE */
+    uint32_t stack[BLACKBOX_FAULT_STACK_WORDS];
+} BlackBox_Fault_t;
+
+/* Compact export: header, optional fault block, then 6 bytes per event
+ * (tick delta u16 LE, type, arg, value u16 LE), oldest first */
+#define BLACKBOX_EXPORT_HEAD_LEN    8u          /* count, flags, boots u16, base tick u32 */
+#define BLACKBOX_EXPORT_FAULT_LEN   (56u + BLACKBOX_FAULT_STACK_WORDS * 4u) /* excReturn sp r0-r3 r12 lr pc xpsr
+                                                                           cfsr hfsr mmfar bfar, stack[] */
+#define BLACKBOX_EXPORT_EVT_LEN     6u
+#define BLACKBOX_EXPORT_MAX         (BLACKBOX_EXPORT_HEAD_LEN + BLACKBOX_EXPORT_FAULT_LEN + \
+                                     BLACKBOX_RING_SIZE * BLACKBOX_EXPORT_EVT_LEN)
+#define BLACKBOX_EXPORT_FLAG_FAULT  0x01u
+
+/** Call first in System_Init: latches RCC_CSR, then clears the reset flags for the next boot.
+ *  Returns the latched RCC_CSR. */
+uint32_t Drv_BlackBox_Init(void);
+void Drv_BlackBox_Record(BlackBox_EvtType_EnumDef type, uint8_t arg, uint16_t value);
+
+/** True if the ring survived a reset (not a power-on) and holds the previous run. */
+bool Drv_BlackBox_HasHistory(void);
+uint16_t Drv_BlackBox_GetCount(void);
+uint16_t Drv_BlackBox_Copy(uint16_t first, BlackBox_Event_t *pOut, uint16_t max);
+/** Fault snapshot from the previous run, or NULL. */
+const BlackBox_Fault_t* Drv_BlackBox_GetFault(void);
+void Drv_BlackBox_ClearFault(void);
+uint16_t Drv_BlackBox_Export(uint8_t *pBuf, uint16_t size);
+
+/** Fault entry (cmb_fault.S): excReturn = LR, sp = SP on entry. */
+void Drv_BlackBox_SaveFault(uint32_t excReturn, uint32_t sp);
+void Drv_BlackBox_Reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_BLACKBOX_H */
@@ -0,0 +1,55 @@
+/************************************************************************************
+ * @file     : drv_boottime.c
+ * @brief    : Boot-phase timestamps - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_boottime.h"
+#include "bsp_delay.h"
+
+#define BOOTTIME_CYCLES_MAX_MS  50000u      /* DWT wraps after 59.6 s at 72 MHz */
+
+static uint32_t s_startCycles = 0;
+static uint32_t s_phaseUs[E_BOOT_PHASE_MAX] = {
+    BOOTTIME_NOT_REACHED, BOOTTIME_NOT_REACHED, BOOTTIME_NOT_REACHED, BOOTTIME_NOT_REACHED,
+    BOOTTIME_NOT_REACHED, BOOTTIME_NOT_REACHED, BOOTTIME_NOT_REACHED,
+};
+
+/* DAL: only called from DRV; calls BSP */
+static void Dal_BootTime_Init(void)
+{
+    BSP_Cycles_Init();
+}
+
+static uint32_t Dal_BootTime_GetCycles(void)
+{
+    return BSP_GetCycles();
+}
+
+static uint32_t Dal_BootTime_GetTick(void)
+{
+    return BSP_GetTick_ms();
+}
+
+void Drv_BootTime_Start(void)
+{
+    Dal_BootTime_Init();
+    s_startCycles = Dal_BootTime_GetCycles();
+    s_phaseUs[E_BOOT_PHASE_MAIN] = 0;
+}
+
+void Drv_BootTime_Mark(BootTime_Phase_EnumDef phase)
+{
+    uint32_t tick;
+
+    if (phase >= E_BOOT_PHASE_MAX || s_phaseUs[phase] != BOOTTIME_NOT_REACHED)
+        return;
+    tick = Dal_BootTime_GetTick();
+    if (tick < BOOTTIME_CYCLES_MAX_MS)
+        s_phaseUs[phase] = (Dal_BootTime_GetCycles() - s_startCycles) / (SystemCoreClock / 1000000u);
+    else
+        s_phaseUs[phase] = tick * 1000u;
+}
+
+uint32_t Drv_BootTime_GetUs(BootTime_Phase_EnumDef phase)
+{
+    return (phase < E_BOOT_PHASE_MAX) ? s_phaseUs[phase] : BOOTTIME_NOT_REACHED;
+}
@@ -0,0 +1,43 @@
+/************************************************************************************
+ * @file     : drv_boottime.h
+ * @brief    : Boot-phase timestamps - DRV API, DAL calls BSP (Std lib)
+ * @details  : Drv_BootTime_Start() is the first call in main() and starts the DWT
+ *             cycle counter; every later phase records its first occurrence in
+ *             microseconds from that point. The reset handler (SystemInit, clock
+ *             start-up) and the C library init run before main() and are not
+ *             included. Past ~50 s the SysTick tick is used, the DWT counter wraps.
+ ***********************************************************************************/
+#ifndef DRV_BOOTTIME_H
+#define DRV_BOOTTIME_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BOOTTIME_NOT_REACHED    0xFFFFFFFFu
+
+typedef enum {
+    E_BOOT_PHASE_MAIN = 0,      /* main() entry, time base */
+    E_BOOT_PHASE_DRV,           /* BSP and drivers initialised */
+    E_BOOT_PHASE_SYSTEM,        /* System_Init done, main loop starts */
+    E_BOOT_PHASE_FIRST_RX,      /* first byte from the host */
+    E_BOOT_PHASE_READY,         /* first protocol reply sent */
+    E_BOOT_PHASE_PRELOAD,       /* background EEPROM work finished */
+    E_BOOT_PHASE_SI5351,        /* SI5351 programmed (US/RF probe detected) */
+    E_BOOT_PHASE_MAX,
+} BootTime_Phase_EnumDef;
+
+void Drv_BootTime_Start(void);
+/** Record a phase; only the first call per phase counts. */
+void Drv_BootTime_Mark(BootTime_Phase_EnumDef phase);
+/** Microseconds from main() entry, or BOOTTIME_NOT_REACHED. */
+uint32_t Drv_BootTime_GetUs(BootTime_Phase_EnumDef phase);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_BOOTTIME_H */
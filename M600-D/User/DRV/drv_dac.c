@@ -4,13 +4,29 @@
  ***********************************************************************************/
 #include "drv_dac.h"
 #include "drv_adc.h"
+#include "drv_trace.h"
+#include "drv_protect.h"
 #include "bsp_dac.h"
+#include "stm32f10x.h"
 
-#define DAC_REF_MV      3300u
+#define DAC_REF_MV      DAC_OUTPUT_MAX_MV
 #define DAC_RESOLUTION  4096u
 #define DAC_VOLTAGE_TOLERANCE_MV  50u
 
 static uint16_t s_currentVoltage = 0;
+static volatile bool s_rampActive = false;
+static Drv_DAC_RampDone_t s_rampDone = 0;
+static uint16_t s_rampBuf[DAC_RAMP_MAX_SAMPLES + 1];   /* + repeat of the last sample */
+
+/* Easing curves, 17 points over t = 0..1, Q10 (1024 = target) */
+static const uint16_t s_easeTable[E_DAC_EASE_MAX][17] = {
+    /* LINEAR */
+    {    0,   64,  128,  192,  256,  320,  384,  448,  512,
+       576,  640,  704,  768,  832,  896,  960, 1024 },
+    /* SCURVE: 3t^2 - 2t^3 */
+    {    0,   12,   44,   94,  160,  238,  324,  416,  512,
+       608,  700,  786,  864,  930,  980, 1012, 1024 },
+};
 
 /* DAL_DAC_Init: only called from DRV; calls BSP */
 static void Dal_DAC_Init(void)
@@ -18,18 +34,62 @@ static void Dal_DAC_Init(void)
     BSP_DAC_Init();
 }
 
+static void Dal_DAC_RampStart(const uint16_t *pSamples, uint16_t count, uint16_t period_us)
+{
+    BSP_DAC_RampStart(pSamples, count, period_us);
+}
+
+static void Dal_DAC_RampStop(void)
+{
+    BSP_DAC_RampStop();
+}
+
+/* The foot release cut is an interrupt: checked and started under one lock */
+static uint32_t Dal_DAC_Lock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static void Dal_DAC_Unlock(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+static uint16_t Dal_DAC_GetOutputMv(void)
+{
+    return (uint16_t)(((uint32_t)BSP_DAC_GetValue() * DAC_REF_MV) / (DAC_RESOLUTION - 1));
+}
+
 void Drv_DAC_Init(void)
 {
     Dal_DAC_Init();
     s_currentVoltage = 0;
+    s_rampActive = false;
 }
 
+/* Refused while the foot release cut stands, except for 0 */
 bool Drv_DAC_SetVoltage(uint16_t voltage_mv)
 {
+    uint32_t primask;
+
     if (voltage_mv > DAC_REF_MV)
         voltage_mv = DAC_REF_MV;
+    primask = Dal_DAC_Lock();
+    if (voltage_mv != 0 && Drv_Protect_IsCut()) {
+        Dal_DAC_Unlock(primask);
+        return false;
+    }
+    /* Still driven in replay: the DAC only sets a reference, readback stays real */
+    (void)Drv_Trace_Output(E_TRACE_REC_DAC, 0, voltage_mv);
+    if (s_rampActive) {
+        Dal_DAC_RampStop();
+        s_rampActive = false;
+    }
     BSP_DAC_SetVoltage(voltage_mv);
     s_currentVoltage = voltage_mv;
+    Dal_DAC_Unlock(primask);
     return true;
 }
 
@@ -42,3 +102,93 @@ uint16_t Drv_DAC_GetActualVoltage(void)
 {
     return Drv_ADC_ReadVOUT();
 }
+
+/**
+ * Ramp from the present output to target_mv at slope_mv_per_ms, shaped by ease.
+ * The profile is precomputed here; TIM6 + DMA2 stream it with no CPU involvement.
+ * Drv_DAC_GetVoltage() reports the target as soon as the ramp is started.
+ * Refused while the foot release cut stands: the output stays at 0 until the next press.
+ */
+bool Drv_DAC_RampTo(uint16_t target_mv, uint16_t slope_mv_per_ms, DAC_Ease_EnumDef ease, Drv_DAC_RampDone_t done)
+{
+    uint16_t start_mv, n, k, period_us;
+    uint32_t delta, duration_us, pos, primask;
+    int32_t span, frac;
+    const uint16_t *t;
+
+    if (ease >= E_DAC_EASE_MAX || slope_mv_per_ms == 0 || Drv_Protect_IsCut())
+        return false;
+    if (target_mv > DAC_REF_MV)
+        target_mv = DAC_REF_MV;
+    (void)Drv_Trace_Output(E_TRACE_REC_DAC, 0, target_mv);
+
+    /* Stop first: the DMA must not read s_rampBuf while it is rewritten */
+    if (s_rampActive) {
+        Dal_DAC_RampStop();
+        s_rampActive = false;
+    }
+    start_mv = Dal_DAC_GetOutputMv();
+    span = (int32_t)target_mv - (int32_t)start_mv;
+    delta = (uint32_t)((span < 0) ? -span : span);
+
+    duration_us = (delta * 1000u) / slope_mv_per_ms;
+    if (duration_us > DAC_RAMP_MAX_TIME_MS * 1000u)
+        duration_us = DAC_RAMP_MAX_TIME_MS * 1000u;
+    n = (uint16_t)(duration_us / DAC_RAMP_MIN_PERIOD_US);
+    if (n > DAC_RAMP_MAX_SAMPLES)
+        n = DAC_RAMP_MAX_SAMPLES;
+    /* Too short for a profile: still one step through the DMA, so done always comes from its ISR */
+    if (n == 0)
+        n = 1;
+    period_us = (uint16_t)(duration_us / n);
+    if (period_us < DAC_RAMP_MIN_PERIOD_US)
+        period_us = DAC_RAMP_MIN_PERIOD_US;
+
+    t = s_easeTable[ease];
+    for (k = 1; k <= n; k++) {
+        pos = ((uint32_t)k * 16u * 256u) / n;   /* Q8 index into the 17-point table */
+        if ((pos >> 8) >= 16u)
+            frac = t[16];
+        else
+            frac = t[pos >> 8] + (((int32_t)t[(pos >> 8) + 1] - t[pos >> 8]) * (int32_t)(pos & 0xFFu)) / 256;
+        s_rampBuf[k - 1] = (uint16_t)((((int32_t)start_mv + (span * frac) / 1024) * (int32_t)(DAC_RESOLUTION - 1)) / (int32_t)DAC_REF_MV);
+    }
+    /* TC comes as this repeat reaches DHR, i.e. at the update that puts the last step out */
+    s_rampBuf[n] = s_rampBuf[n - 1];
+
+    primask = Dal_DAC_Lock();
+    if (Drv_Protect_IsCut()) {
+        Dal_DAC_Unlock(primask);
+        return false;
+    }
+    s_currentVoltage = target_mv;
+    s_rampDone = done;
+    s_rampActive = true;
+    Dal_DAC_RampStart(s_rampBuf, (uint16_t)(n + 1u), period_us);
+    Dal_DAC_Unlock(primask);
+    return true;
+}
+
+bool Drv_DAC_IsRamping(void)
+{
+    return s_rampActive;
+}
+
+/* Foot release: any ramp stops where it is, without its done callback, and the output drops to 0 */
+void Drv_DAC_CutFromISR(void)
+{
+    Dal_DAC_RampStop();
+    s_rampActive = false;
+    BSP_DAC_SetVoltage(0);
+    s_currentVoltage = 0;
+}
+
+void Drv_DAC_RampDoneFromISR(void)
+{
+    Dal_DAC_RampStop();
+    if (!s_rampActive)
+        return;
+    s_rampActive = false;
+    if (s_rampDone)
+        s_rampDone(s_currentVoltage);
+}
@@ -5,7 +5,6 @@
 #ifndef DRV_DAC_H
 #define DRV_DAC_H
 
-#include "stm32f10x.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -13,11 +12,32 @@
 extern "C" {
 #endif
 
+#define DAC_OUTPUT_MAX_MV        3300u    /* targets are clamped to the reference */
+#define DAC_RAMP_MAX_SAMPLES     64u      /* samples per ramp */
+#define DAC_RAMP_MIN_PERIOD_US   50u      /* fastest TIM6 pacing */
+#define DAC_RAMP_MAX_TIME_MS     4000u    /* 64 samples x 62.5 ms */
+
+typedef enum {
+    E_DAC_EASE_LINEAR = 0,
+    E_DAC_EASE_SCURVE,        /* smoothstep, zero slope at both ends */
+    E_DAC_EASE_MAX
+} DAC_Ease_EnumDef;
+
+/* Always called from the DMA2_Channel3 interrupt, when the last step is on the output,
+ * short ramps included; not called for a ramp cut short by another RampTo or a cut */
+typedef void (*Drv_DAC_RampDone_t)(uint16_t voltage_mv);
+
 bool Drv_DAC_SetVoltage(uint16_t voltage_mv);
 uint16_t Drv_DAC_GetVoltage(void);
 uint16_t Drv_DAC_GetActualVoltage(void);
 void Drv_DAC_Init(void);
 
+/* SetVoltage (but to 0) and RampTo are refused between a foot release cut and the next press */
+bool Drv_DAC_RampTo(uint16_t target_mv, uint16_t slope_mv_per_ms, DAC_Ease_EnumDef ease, Drv_DAC_RampDone_t done);
+bool Drv_DAC_IsRamping(void);
+void Drv_DAC_RampDoneFromISR(void);   /* DMA2_Channel3_IRQHandler only */
+void Drv_DAC_CutFromISR(void);        /* ramp stopped, output 0 (Drv_Protect_CutFromISR) */
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,11 @@ uint32_t Dal_GetTick(void)
     return BSP_GetTick_ms();
 }
 
+uint32_t Dal_GetTickFine(uint16_t *pUs)
+{
+    return BSP_GetTickFine_ms(pUs);
+}
+
 void Drv_SysTick_Increment(void)
 {
     s_SystemTick += SYSTEM_TICK_PER_SECOND;
@@ -39,6 +44,11 @@ uint32_t Drv_Delay_GetTickMs(void)
     return Dal_GetTick();
 }
 
+uint32_t Drv_Delay_GetTickFineMs(uint16_t *pUs)
+{
+    return Dal_GetTickFine(pUs);
+}
+
 bool Drv_Timer_Tick(Drv_Timer_t *pTimer, uint32_t timeout_ms)
 {
     if (pTimer == NULL)
@@ -16,11 +16,13 @@ extern "C" {
 
 void Dal_Delay(uint32_t ms);   /* DAL: calls BSP_Delay_ms; only used inside DRV */
 uint32_t Dal_GetTick(void);    /* DAL: calls BSP_GetTick_ms; only used inside DRV */
+uint32_t Dal_GetTickFine(uint16_t *pUs);   /* DAL: calls BSP_GetTickFine_ms; only used inside DRV */
 
 void Drv_SysTick_Increment(void);
 uint64_t Drv_GetSystemTickUs(void);
 uint64_t Drv_GetSystemTickMs(void);
 uint32_t Drv_Delay_GetTickMs(void);   /* for APP: ms since boot (BSP tick) */
+uint32_t Drv_Delay_GetTickFineMs(uint16_t *pUs);  /* for APP: same ms, *pUs = us into it (0..999) */
 
 typedef struct {
     uint32_t start_ms;
@@ -0,0 +1,187 @@
+/************************************************************************************
+ * @file     : drv_fwswap.c
+ * @brief    : Firmware staging slot and swap/rollback - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_fwswap.h"
+#include "bsp_flash.h"
+#include "bsp_delay.h"
+#include <stddef.h>
+
+#define FWSWAP_MARK_DONE        0x0000u
+#define FWSWAP_MARK_EMPTY       0xFFFFu
+
+static uint32_t s_busyUs = 0;   /* CPU time stalled in erase/program */
+
+/* DAL: only called from DRV; calls BSP */
+static uint32_t Dal_FwSwap_GetCycles(void)
+{
+    return BSP_GetCycles();
+}
+
+static void Dal_FwSwap_AddBusy(uint32_t t0)
+{
+    s_busyUs += (Dal_FwSwap_GetCycles() - t0) / (SystemCoreClock / 1000000u);
+}
+
+static bool Dal_FwSwap_Erase(uint32_t addr)
+{
+    uint32_t t0 = Dal_FwSwap_GetCycles();
+    bool ok;
+
+    BSP_Flash_Unlock();
+    ok = BSP_Flash_ErasePage(addr);
+    BSP_Flash_Lock();
+    Dal_FwSwap_AddBusy(t0);
+    return ok;
+}
+
+static bool Dal_FwSwap_Program(uint32_t addr, const uint8_t *pData, uint16_t len)
+{
+    uint32_t t0 = Dal_FwSwap_GetCycles();
+    bool ok = true;
+    uint16_t i;
+
+    BSP_Flash_Unlock();
+    for (i = 0; i < len && ok; i += 2u)
+        ok = BSP_Flash_ProgramHalfWord(addr + i, (uint16_t)(pData[i] | (pData[i + 1u] << 8)));
+    BSP_Flash_Lock();
+    Dal_FwSwap_AddBusy(t0);
+    return ok;
+}
+
+static void Dal_FwSwap_Reset(void)
+{
+    NVIC_SystemReset();
+}
+
+static uint16_t FwSwap_Marker(uint16_t index)
+{
+    return *(const volatile uint16_t *)(uintptr_t)(FWSWAP_META_ADDR + index * 2u);
+}
+
+static bool FwSwap_IsMarked(uint16_t index)
+{
+    return FwSwap_Marker(index) != FWSWAP_MARK_EMPTY;
+}
+
+static bool FwSwap_Mark(uint16_t index)
+{
+    static const uint8_t done[2] = {0, 0};
+
+    if (FwSwap_IsMarked(index))
+        return true;
+    return Dal_FwSwap_Program(FWSWAP_META_ADDR + index * 2u, done, sizeof(done)) &&
+           FwSwap_Marker(index) == FWSWAP_MARK_DONE;
+}
+
+const FwSwap_Header_t* Drv_FwSwap_GetHeader(void)
+{
+    const FwSwap_Header_t *pHdr = (const FwSwap_Header_t *)FWSWAP_META_ADDR;
+
+    if (pHdr->magic != FWSWAP_MAGIC || pHdr->size == 0 || pHdr->size > FWSWAP_SLOT_SIZE)
+        return NULL;
+    return pHdr;
+}
+
+FwSwap_State_EnumDef Drv_FwSwap_GetState(void)
+{
+    if (Drv_FwSwap_GetHeader() == NULL)
+        return E_FWSWAP_EMPTY;
+    if (FwSwap_IsMarked(FWSWAP_MK_REVERT_DONE))
+        return E_FWSWAP_REVERTED;
+    if (FwSwap_IsMarked(FWSWAP_MK_REVERT))
+        return E_FWSWAP_REVERTING;
+    if (FwSwap_IsMarked(FWSWAP_MK_CONFIRMED))
+        return E_FWSWAP_CONFIRMED;
+    if (FwSwap_IsMarked(FWSWAP_MK_SWAP_DONE))
+        return E_FWSWAP_TRIAL;
+    if (FwSwap_IsMarked(FWSWAP_MK_SWAP(0u, 0u)))
+        return E_FWSWAP_SWAPPING;
+    if (FwSwap_IsMarked(FWSWAP_MK_STAGED))
+        return E_FWSWAP_STAGED;
+    return E_FWSWAP_RECEIVING;
+}
+
+uint8_t Drv_FwSwap_GetTrialBoots(void)
+{
+    uint8_t n = 0;
+
+    while (n < FWSWAP_TRIAL_BOOTS && FwSwap_IsMarked(FWSWAP_MK_TRIAL(n)))
+        n++;
+    return n;
+}
+
+bool Drv_FwSwap_Begin(const FwSwap_Header_t *pHdr)
+{
+    if (pHdr == NULL || pHdr->magic != FWSWAP_MAGIC)
+        return false;
+    if (!Dal_FwSwap_Erase(FWSWAP_META_ADDR))
+        return false;
+    return Dal_FwSwap_Program(FWSWAP_META_ADDR, (const uint8_t *)pHdr, sizeof(*pHdr)) &&
+           Drv_FwSwap_GetHeader() != NULL;
+}
+
+uint16_t Drv_FwSwap_GetWrittenPages(void)
+{
+    uint16_t n = 0;
+
+    while (n < FWSWAP_SLOT_PAGES && FwSwap_IsMarked(FWSWAP_MK_PAGE(n)))
+        n++;
+    return n;
+}
+
+bool Drv_FwSwap_ErasePage(uint16_t page)
+{
+    if (page >= FWSWAP_SLOT_PAGES)
+        return false;
+    return Dal_FwSwap_Erase(FWSWAP_STAGING_ADDR + (uint32_t)page * FWSWAP_PAGE_SIZE);
+}
+
+bool Drv_FwSwap_Program(uint32_t offset, const uint8_t *pData, uint16_t len)
+{
+    if (pData == NULL || (offset & 1u) || (len & 1u) || offset + len > FWSWAP_SLOT_SIZE)
+        return false;
+    return Dal_FwSwap_Program(FWSWAP_STAGING_ADDR + offset, pData, len);
+}
+
+const uint8_t* Drv_FwSwap_GetStaging(void)
+{
+    return (const uint8_t *)FWSWAP_STAGING_ADDR;
+}
+
+bool Drv_FwSwap_MarkPage(uint16_t page)
+{
+    return page < FWSWAP_SLOT_PAGES && FwSwap_Mark(FWSWAP_MK_PAGE(page));
+}
+
+bool Drv_FwSwap_MarkStaged(void)
+{
+    return Drv_FwSwap_GetState() == E_FWSWAP_RECEIVING && FwSwap_Mark(FWSWAP_MK_STAGED);
+}
+
+bool Drv_FwSwap_Confirm(void)
+{
+    return Drv_FwSwap_GetState() == E_FWSWAP_TRIAL && FwSwap_Mark(FWSWAP_MK_CONFIRMED);
+}
+
+bool Drv_FwSwap_MarkTrialBoot(void)
+{
+    uint8_t boots = Drv_FwSwap_GetTrialBoots();
+
+    return boots < FWSWAP_TRIAL_BOOTS && FwSwap_Mark(FWSWAP_MK_TRIAL(boots));
+}
+
+bool Drv_FwSwap_MarkRevert(void)
+{
+    return FwSwap_Mark(FWSWAP_MK_REVERT);
+}
+
+uint32_t Drv_FwSwap_GetBusyUs(void)
+{
+    return s_busyUs;
+}
+
+void Drv_FwSwap_Restart(void)
+{
+    Dal_FwSwap_Reset();
+}
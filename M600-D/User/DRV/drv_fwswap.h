@@ -0,0 +1,109 @@
+/************************************************************************************
+ * @file     : drv_fwswap.h
+ * @brief    : Firmware staging slot and swap/rollback - DRV API, DAL calls BSP (Std lib)
+ * @details  : Flash is split into a fixed bootloader (vector table at reset, boot
+ *             decision and the swap executor, write-protected, never updated), an
+ *             active slot (the running image, linked right above it), a staging slot
+ *             of the same size, one scratch page and one meta page. An update is
+ *             written into the staging slot, then at the next boot the bootloader
+ *             exchanges both slots page by page through the scratch page, so the
+ *             previous image ends up in the staging slot as the fallback.
+ *             Progress is kept as append-only half-word markers in the meta page
+ *             (0xFFFF = not reached, 0x0000 = done): every step can be resumed after a
+ *             reset and no marker is ever rewritten. A new image boots on trial and is
+ *             swapped back if it is not confirmed within FWSWAP_TRIAL_BOOTS boots.
+ ***********************************************************************************/
+#ifndef DRV_FWSWAP_H
+#define DRV_FWSWAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Layout, must match IROM1 of both projects (bootloader, active slot) and
+ * VECT_TAB_OFFSET of the application */
+#define FWSWAP_PAGE_SIZE        0x00000800u     /* 2 KB flash page */
+#define FWSWAP_BOOT_ADDR        0x08000000u
+#define FWSWAP_BOOT_SIZE        0x00002000u     /* 8 KB, pages 0-3 */
+#define FWSWAP_BOOT_WRP         0x00000003u     /* WRPR bits of the bootloader pages (2 pages per bit) */
+#define FWSWAP_SLOT_SIZE        0x0001E000u     /* 120 KB per slot */
+#define FWSWAP_SLOT_PAGES       (FWSWAP_SLOT_SIZE / FWSWAP_PAGE_SIZE)
+#define FWSWAP_ACTIVE_ADDR      (FWSWAP_BOOT_ADDR + FWSWAP_BOOT_SIZE)
+#define FWSWAP_STAGING_ADDR     (FWSWAP_ACTIVE_ADDR + FWSWAP_SLOT_SIZE)
+#define FWSWAP_SCRATCH_ADDR     (FWSWAP_STAGING_ADDR + FWSWAP_SLOT_SIZE)
+#define FWSWAP_META_ADDR        (FWSWAP_SCRATCH_ADDR + FWSWAP_PAGE_SIZE)
+#define FWSWAP_TRIAL_BOOTS      3u              /* unconfirmed boots before rollback */
+
+/* Meta page: header, then half-word markers by index */
+#define FWSWAP_MAGIC                0x55504446u /* "FDPU" */
+#define FWSWAP_MK_PAGE(page)        (8u + (page))                   /* staging page written */
+#define FWSWAP_MK_STAGED            68u                             /* image verified */
+#define FWSWAP_MK_SWAP(page, step)  (72u + (page) * 3u + (step))    /* swap step done */
+#define FWSWAP_MK_SWAP_DONE         252u
+#define FWSWAP_MK_CONFIRMED         253u
+#define FWSWAP_MK_REVERT            254u                            /* rollback requested */
+#define FWSWAP_MK_REVERT_STEP(page, step) (256u + (page) * 3u + (step))
+#define FWSWAP_MK_REVERT_DONE       436u
+#define FWSWAP_MK_TRIAL(n)          (440u + (n))                    /* trial boot n */
+
+typedef struct {
+    uint32_t magic;
+    uint32_t size;              /* image bytes */
+    uint32_t crc32;             /* CRC-32 (IEEE) of the image */
+    uint32_t version;           /* opaque, reported back to the host */
+} FwSwap_Header_t;
+
+typedef enum {
+    E_FWSWAP_EMPTY = 0,         /* no update recorded */
+    E_FWSWAP_RECEIVING,         /* header written, staging pages being filled */
+    E_FWSWAP_STAGED,            /* image verified, swap at next boot */
+    E_FWSWAP_SWAPPING,          /* swap interrupted, resumed at next boot */
+    E_FWSWAP_TRIAL,             /* new image running, not yet confirmed */
+    E_FWSWAP_CONFIRMED,
+    E_FWSWAP_REVERTING,         /* rollback interrupted, resumed at next boot */
+    E_FWSWAP_REVERTED,          /* previous image restored */
+    E_FWSWAP_STATE_MAX,
+} FwSwap_State_EnumDef;
+
+FwSwap_State_EnumDef Drv_FwSwap_GetState(void);
+/** Header of the recorded update, or NULL. */
+const FwSwap_Header_t* Drv_FwSwap_GetHeader(void);
+uint8_t Drv_FwSwap_GetTrialBoots(void);
+
+/** Start a new update: erases the meta page and writes the header. */
+bool Drv_FwSwap_Begin(const FwSwap_Header_t *pHdr);
+/** Leading staging pages already written and verified (resume point). */
+uint16_t Drv_FwSwap_GetWrittenPages(void);
+bool Drv_FwSwap_ErasePage(uint16_t page);
+/** Program len bytes (even, within one page) at offset into the staging slot. */
+bool Drv_FwSwap_Program(uint32_t offset, const uint8_t *pData, uint16_t len);
+const uint8_t* Drv_FwSwap_GetStaging(void);
+bool Drv_FwSwap_MarkPage(uint16_t page);
+bool Drv_FwSwap_MarkStaged(void);
+bool Drv_FwSwap_Confirm(void);
+/** Count one boot of a trial image; false once FWSWAP_TRIAL_BOOTS are used up. */
+bool Drv_FwSwap_MarkTrialBoot(void);
+bool Drv_FwSwap_MarkRevert(void);
+/** Cumulative CPU stall in flash erase/program, microseconds. */
+uint32_t Drv_FwSwap_GetBusyUs(void);
+/** Reset into Drv_FwSwap_BootCheck (e.g. after the image is staged). */
+void Drv_FwSwap_Restart(void);
+
+/* Bootloader only (drv_fwswap_exec.c), the application is never linked with these */
+/** Staged image swap / trial boot / rollback; may reset. */
+void Drv_FwSwap_BootCheck(void);
+/** Exchanges the slots and resets, does not return. */
+void Drv_FwSwap_Exec(bool revert);
+/** Application vector table: initial SP in SRAM, reset handler in the active slot. */
+bool Drv_FwSwap_AppValid(void);
+/** Hand over to the application in the active slot, does not return. */
+void Drv_FwSwap_StartApp(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_FWSWAP_H */
@@ -0,0 +1,175 @@
+/************************************************************************************
+ * @file     : drv_fwswap_exec.c
+ * @brief    : Boot decision and slot exchange executor - bootloader only (Project/M600_Boot)
+ * @details  : Linked into the bootloader, which sits in write-protected pages below the
+ *             active slot, so an exchange interrupted at any point (page 0 of the
+ *             application included) is resumed at the next reset. Flash is driven at
+ *             register level, the watchdog is fed by hand and interrupts stay disabled
+ *             until the final reset. Each page takes three steps (active -> scratch,
+ *             staging -> active, scratch -> staging), each followed by its own meta
+ *             marker, so an interrupted exchange resumes at the first step without a
+ *             marker.
+ ***********************************************************************************/
+#include "drv_fwswap.h"
+#include "bsp_flash.h"
+#include "stm32f10x.h"
+
+#define FWSWAP_FLASH_KEY1       0x45670123u
+#define FWSWAP_FLASH_KEY2       0xCDEF89ABu
+#define FWSWAP_IWDG_RELOAD      0xAAAAu
+#define FWSWAP_PAGE_SHIFT       11u
+#define FWSWAP_SRAM_START       0x20000000u
+#define FWSWAP_SRAM_END         0x2000C000u
+
+/* DAL: only called from DRV; calls BSP */
+static bool Dal_FwSwap_IsProtected(void)
+{
+    return BSP_Flash_IsWriteProtected(FWSWAP_BOOT_WRP);
+}
+
+static bool Dal_FwSwap_Protect(void)
+{
+    bool ok;
+
+    BSP_Flash_Unlock();
+    ok = BSP_Flash_WriteProtect(FWSWAP_BOOT_WRP);
+    BSP_Flash_Lock();
+    return ok;
+}
+
+/* One feed per operation: a page erase (20 ms max) is far below the watchdog period */
+static void FwSwap_Wait(void)
+{
+    IWDG->KR = FWSWAP_IWDG_RELOAD;
+    while (FLASH->SR & FLASH_SR_BSY) { }
+}
+
+static void FwSwap_ErasePage(uint32_t addr)
+{
+    FLASH->CR |= FLASH_CR_PER;
+    FLASH->AR = addr;
+    FLASH->CR |= FLASH_CR_STRT;
+    FwSwap_Wait();
+    FLASH->CR &= ~FLASH_CR_PER;
+}
+
+static void FwSwap_Program(uint32_t addr, uint16_t data)
+{
+    FLASH->CR |= FLASH_CR_PG;
+    *(volatile uint16_t *)(uintptr_t)addr = data;
+    FwSwap_Wait();
+    FLASH->CR &= ~FLASH_CR_PG;
+}
+
+static void FwSwap_CopyPage(uint32_t dst, uint32_t src)
+{
+    uint32_t i;
+
+    FwSwap_ErasePage(dst);
+    for (i = 0; i < FWSWAP_PAGE_SIZE; i += 2u)
+        FwSwap_Program(dst + i, *(const volatile uint16_t *)(uintptr_t)(src + i));
+}
+
+static uint32_t FwSwap_Step(uint32_t index)
+{
+    uint32_t addr = FWSWAP_META_ADDR + index * 2u;
+
+    return *(const volatile uint16_t *)(uintptr_t)addr == 0xFFFFu ? addr : 0u;
+}
+
+/**
+ * @brief Write-protect the bootloader pages on the first boot after a factory flash.
+ *        The option bytes take effect at the next reset, so this resets once.
+ */
+static void FwSwap_ProtectBoot(void)
+{
+    if (!Dal_FwSwap_IsProtected() && Dal_FwSwap_Protect())
+        NVIC_SystemReset();
+}
+
+void Drv_FwSwap_BootCheck(void)
+{
+    FwSwap_ProtectBoot();
+    switch (Drv_FwSwap_GetState()) {
+    case E_FWSWAP_STAGED:
+    case E_FWSWAP_SWAPPING:
+        Drv_FwSwap_Exec(false);
+        break;
+    case E_FWSWAP_TRIAL:
+        if (Drv_FwSwap_GetTrialBoots() < FWSWAP_TRIAL_BOOTS) {
+            Drv_FwSwap_MarkTrialBoot();
+        } else if (Drv_FwSwap_MarkRevert()) {
+            Drv_FwSwap_Exec(true);
+        }
+        break;
+    case E_FWSWAP_REVERTING:
+        Drv_FwSwap_Exec(true);
+        break;
+    default:
+        break;
+    }
+}
+
+void Drv_FwSwap_Exec(bool revert)
+{
+    const volatile FwSwap_Header_t *pHdr = (const volatile FwSwap_Header_t *)FWSWAP_META_ADDR;
+    uint32_t first = revert ? FWSWAP_MK_REVERT_STEP(0u, 0u) : FWSWAP_MK_SWAP(0u, 0u);
+    uint32_t done = revert ? FWSWAP_MK_REVERT_DONE : FWSWAP_MK_SWAP_DONE;
+    uint32_t pages = (pHdr->size + FWSWAP_PAGE_SIZE - 1u) >> FWSWAP_PAGE_SHIFT;
+    uint32_t page;
+    uint32_t offset;
+    uint32_t mark;
+
+    if (pages > FWSWAP_SLOT_PAGES)
+        pages = FWSWAP_SLOT_PAGES;
+
+    __disable_irq();
+    FLASH->KEYR = FWSWAP_FLASH_KEY1;
+    FLASH->KEYR = FWSWAP_FLASH_KEY2;
+    for (page = 0; page < pages; page++) {
+        offset = page << FWSWAP_PAGE_SHIFT;
+        if ((mark = FwSwap_Step(first + page * 3u)) != 0u) {
+            FwSwap_CopyPage(FWSWAP_SCRATCH_ADDR, FWSWAP_ACTIVE_ADDR + offset);
+            FwSwap_Program(mark, 0u);
+        }
+        if ((mark = FwSwap_Step(first + page * 3u + 1u)) != 0u) {
+            FwSwap_CopyPage(FWSWAP_ACTIVE_ADDR + offset, FWSWAP_STAGING_ADDR + offset);
+            FwSwap_Program(mark, 0u);
+        }
+        if ((mark = FwSwap_Step(first + page * 3u + 2u)) != 0u) {
+            FwSwap_CopyPage(FWSWAP_STAGING_ADDR + offset, FWSWAP_SCRATCH_ADDR);
+            FwSwap_Program(mark, 0u);
+        }
+    }
+    if ((mark = FwSwap_Step(done)) != 0u)
+        FwSwap_Program(mark, 0u);
+    FLASH->CR |= FLASH_CR_LOCK;
+
+    SCB->AIRCR = (0x5FAu << SCB_AIRCR_VECTKEY_Pos) | (SCB->AIRCR & SCB_AIRCR_PRIGROUP_Msk) |
+                 SCB_AIRCR_SYSRESETREQ_Msk;
+    __DSB();
+    while (1) { }
+}
+
+bool Drv_FwSwap_AppValid(void)
+{
+    const volatile uint32_t *pVec = (const volatile uint32_t *)FWSWAP_ACTIVE_ADDR;
+    uint32_t sp = pVec[0];
+    uint32_t reset = pVec[1] & ~1u;
+
+    return sp > FWSWAP_SRAM_START && sp <= FWSWAP_SRAM_END && (sp & 3u) == 0u &&
+           reset >= FWSWAP_ACTIVE_ADDR && reset < FWSWAP_ACTIVE_ADDR + FWSWAP_SLOT_SIZE;
+}
+
+void Drv_FwSwap_StartApp(void)
+{
+    const volatile uint32_t *pVec = (const volatile uint32_t *)FWSWAP_ACTIVE_ADDR;
+    void (*pReset)(void) = (void (*)(void))(uintptr_t)pVec[1];
+
+    /* The bootloader never enables an interrupt, the application's SystemInit
+     * puts the clock tree back to reset state */
+    SCB->VTOR = FWSWAP_ACTIVE_ADDR;
+    __set_MSP(pVec[0]);
+    pReset();
+    while (1) { }
+}
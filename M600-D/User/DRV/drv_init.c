@@ -5,6 +5,11 @@
 #include "drv_init.h"
 #include "bsp_gpio.h"
 #include "drv_wdg.h"
+#include "drv_iodevice.h"
+#include "drv_usart.h"
+#include "drv_power.h"
+#include "drv_meter.h"
+#include "drv_scope.h"
 
 static void Dal_System_Init(void)
 {
@@ -13,6 +18,11 @@ static void Dal_System_Init(void)
 
 void Drv_System_Init(void)
 {
+    Drv_Uart_init();     /* RX ring before the USART1 IDLE interrupt is enabled */
     Dal_System_Init();
+    Drv_Meter_Init();
+    Drv_Scope_Init();
+    Drv_IODevice_Init();
+    Drv_Power_Init();
     Drv_WatchDog_Init();
 }
@@ -4,33 +4,205 @@
  ***********************************************************************************/
 #include "drv_iodevice.h"
 #include "drv_delay.h"
+#include "drv_trace.h"
+#include "drv_protect.h"
 #include "bsp_gpio.h"
 #include <stddef.h>
 
 #define IODEVICE_DEBOUNCE_TIME_MS  50u
+#define IODEVICE_FOOT_DEBOUNCE_MS  10u
+#define IODEVICE_EVENT_QUEUE_SIZE  16u   /* power of 2 */
 #define BUZZER_DEFAULT_DURATION_MS 2000u
 
-static IODevice_WorkingMode_EnumDef s_lastStableMode = E_IODEVICE_MODE_NOT_CONNECTED;
-static IODevice_WorkingMode_EnumDef s_pendingMode = E_IODEVICE_MODE_NOT_CONNECTED;
-static uint32_t s_debounceStartTick = 0;
-static uint8_t s_debounceActive = 0;
+/* Per-input integrator full scale (ms at 1 ms tick) */
+static const uint8_t s_integratorMax[E_GPIO_IN_MAX] = {
+    IODEVICE_FOOT_DEBOUNCE_MS,   /* FOOT    */
+    IODEVICE_DEBOUNCE_TIME_MS,   /* SYN_US  */
+    IODEVICE_DEBOUNCE_TIME_MS,   /* SYN_RF  */
+    IODEVICE_DEBOUNCE_TIME_MS,   /* SYN_ESW */
+};
+
+/* Channel switch: pwr_control1~4 all sit on GPIOC, so each transition is one BSRR store */
+#define PWR_CTRL_234_PINS   (pwr_control2_Pin | pwr_control3_Pin | pwr_control4_Pin)
+
+static const BSP_GPIO_Batch_t s_channelBatch[CHANNEL_MAX] = {
+    [CHANNEL_US]    = { 0, BSP_GPIO_BSRR(pwr_control2_Pin, pwr_control3_Pin | pwr_control4_Pin), 0 },
+    [CHANNEL_SW]    = { 0, BSP_GPIO_BSRR(pwr_control3_Pin | pwr_control4_Pin, pwr_control2_Pin), 0 },
+    [CHANNEL_RF]    = { 0, BSP_GPIO_BSRR(pwr_control2_Pin, pwr_control3_Pin | pwr_control4_Pin), 0 },
+    [CHANNEL_NH]    = { 0, BSP_GPIO_BSRR(0, PWR_CTRL_234_PINS), 0 },
+    [CHANNEL_CLOSE] = { 0, BSP_GPIO_BSRR(0, PWR_CTRL_234_PINS | pwr_control1_Pin), 0 },
+    [CHANNEL_READY] = { 0, BSP_GPIO_BSRR(pwr_control1_Pin, 0), 0 },
+};
+
+/* Written by EXTI/SysTick (same preemption level), read by main loop */
+static volatile uint8_t s_integrator[E_GPIO_IN_MAX];
+static volatile uint8_t s_stableMask = 0;
+static volatile uint8_t s_activeMask = 0;
+static uint32_t s_edgeTick[E_GPIO_IN_MAX];
+static IODevice_Event_t s_eventQueue[IODEVICE_EVENT_QUEUE_SIZE];
+static volatile uint8_t s_eventHead = 0;
+static volatile uint8_t s_eventTail = 0;
+
 static bool s_buzzerActive = false;
 static uint32_t s_buzzerStartTime = 0;
 static uint32_t s_buzzerDuration = 0;
 
 /* DAL: only called from DRV; calls BSP */
-static bool Dal_Read_Pin(GPIO_Input_EnumDef pin)
+static void Dal_Write_Pin(GPIO_Output_EnumDef pin, uint8_t state)
+{
+    if (pin >= E_GPIO_OUT_MAX)
+        return;
+    if (Drv_Trace_Output(E_TRACE_REC_PIN, (uint8_t)pin, state ? 1u : 0u))
+        return;
+    BSP_GPIO_WritePin((BSP_GPIO_Output_t)pin, state ? 1 : 0);
+}
+
+static uint8_t Dal_Read_InputMask(void)
+{
+    uint8_t mask;
+
+    if (Drv_Trace_ReplayInput(&mask))
+        return mask;
+    mask = BSP_GPIO_ReadInputMask();
+    Drv_Trace_RecordInput(mask);
+    return mask;
+}
+
+static uint8_t Dal_EXTI_GetAndClear(void)
+{
+    uint8_t pending = BSP_GPIO_EXTI_GetAndClear();
+
+    if (Drv_Trace_ReplayEdges(&pending))
+        return pending;
+    Drv_Trace_RecordEdges(pending);
+    return pending;
+}
+
+static void Dal_Write_Batch(const BSP_GPIO_Batch_t *pBatch)
+{
+    BSP_GPIO_WriteBatch(pBatch);
+}
+
+static void Drv_IODevice_PushEvent(GPIO_Input_EnumDef input, uint8_t level, uint32_t now)
+{
+    uint8_t next = (uint8_t)((s_eventHead + 1u) & (IODEVICE_EVENT_QUEUE_SIZE - 1u));
+    if (next == s_eventTail)
+        return;   /* full: drop, the stable state is still current */
+    s_eventQueue[s_eventHead].input     = input;
+    s_eventQueue[s_eventHead].level     = level;
+    s_eventQueue[s_eventHead].edge_ms   = s_edgeTick[input];
+    s_eventQueue[s_eventHead].stable_ms = now;
+    s_eventHead = next;
+}
+
+void Drv_IODevice_Init(void)
+{
+    uint8_t raw = Dal_Read_InputMask();
+    uint8_t i;
+
+    for (i = 0; i < E_GPIO_IN_MAX; i++)
+        s_integrator[i] = (raw & (1u << i)) ? s_integratorMax[i] : 0;
+    s_stableMask = raw;
+    s_activeMask = 0;
+    s_eventHead = 0;
+    s_eventTail = 0;
+    BSP_GPIO_EXTI_Init();
+}
+
+bool Drv_IODevice_PopEvent(IODevice_Event_t *pEvent)
 {
-    if (pin >= E_GPIO_IN_MAX)
+    if (pEvent == NULL || s_eventTail == s_eventHead)
         return false;
-    return BSP_GPIO_ReadPin((BSP_GPIO_Input_t)pin) ? true : false;
+    *pEvent = s_eventQueue[s_eventTail];
+    s_eventTail = (uint8_t)((s_eventTail + 1u) & (IODEVICE_EVENT_QUEUE_SIZE - 1u));
+    return true;
 }
 
-static void Dal_Write_Pin(GPIO_Output_EnumDef pin, uint8_t state)
+void Drv_IODevice_EdgeFromISR(void)
 {
-    if (pin >= E_GPIO_OUT_MAX)
+    uint8_t pending = Dal_EXTI_GetAndClear();
+    uint32_t now = Dal_GetTick();
+    uint8_t i;
+
+    for (i = 0; i < E_GPIO_IN_MAX; i++) {
+        if ((pending & (1u << i)) && !(s_activeMask & (1u << i))) {
+            s_edgeTick[i] = now;
+            s_activeMask |= (uint8_t)(1u << i);
+        }
+    }
+
+    /* Foot released while pressed: cut the drive now, do not wait for debounce */
+    if ((pending & (1u << E_GPIO_IN_FOOT)) && (s_stableMask & (1u << E_GPIO_IN_FOOT)) &&
+        !(Dal_Read_InputMask() & (1u << E_GPIO_IN_FOOT))) {
+        Drv_Protect_CutFromISR();
+        s_integrator[E_GPIO_IN_FOOT] = 0;
+        s_stableMask &= (uint8_t)~(1u << E_GPIO_IN_FOOT);
+        Drv_IODevice_PushEvent(E_GPIO_IN_FOOT, 0, now);
+    }
+}
+
+static void Drv_IODevice_Integrate(void)
+{
+    uint8_t raw, bit, i;
+    uint32_t now;
+
+    if (s_activeMask == 0)
         return;
-    BSP_GPIO_WritePin((BSP_GPIO_Output_t)pin, state ? 1 : 0);
+    raw = Dal_Read_InputMask();
+    now = Dal_GetTick();
+
+    for (i = 0; i < E_GPIO_IN_MAX; i++) {
+        bit = (uint8_t)(1u << i);
+        if (!(s_activeMask & bit))
+            continue;
+        if (raw & bit) {
+            if (s_integrator[i] < s_integratorMax[i])
+                s_integrator[i]++;
+        } else if (s_integrator[i] > 0) {
+            s_integrator[i]--;
+        }
+
+        if (s_integrator[i] == s_integratorMax[i]) {
+            if (!(s_stableMask & bit)) {
+                s_stableMask |= bit;
+                Drv_IODevice_PushEvent((GPIO_Input_EnumDef)i, 1, now);
+                if (i == E_GPIO_IN_FOOT)
+                    Drv_Protect_ReleaseCut();
+            }
+            s_activeMask &= (uint8_t)~bit;
+        } else if (s_integrator[i] == 0) {
+            if (s_stableMask & bit) {
+                s_stableMask &= (uint8_t)~bit;
+                Drv_IODevice_PushEvent((GPIO_Input_EnumDef)i, 0, now);
+            }
+            s_activeMask &= (uint8_t)~bit;
+        }
+    }
+}
+
+void Drv_IODevice_TickFromISR(void)
+{
+    Drv_IODevice_Integrate();
+    /* Replay: no live edge interrupt. An edge recorded at tick T came after T's integration */
+    if (Drv_Trace_GetMode() == E_TRACE_MODE_REPLAY)
+        Drv_IODevice_EdgeFromISR();
+}
+
+/* Edges can be missed while EXTI lines are borrowed (STOP mode): arm the integrators
+ * for every input whose raw level differs from the debounced one. IRQs disabled. */
+bool Drv_IODevice_Resync(void)
+{
+    uint8_t diff = (uint8_t)(Dal_Read_InputMask() ^ s_stableMask);
+    uint32_t now = Dal_GetTick();
+    uint8_t i;
+
+    for (i = 0; i < E_GPIO_IN_MAX; i++) {
+        if ((diff & (1u << i)) && !(s_activeMask & (1u << i))) {
+            s_edgeTick[i] = now;
+            s_activeMask |= (uint8_t)(1u << i);
+        }
+    }
+    return diff != 0;
 }
 
 void Drv_IODevice_WritePin(GPIO_Output_EnumDef pin, uint8_t state)
@@ -38,13 +210,15 @@ void Drv_IODevice_WritePin(GPIO_Output_EnumDef pin, uint8_t state)
     Dal_Write_Pin(pin, state);
 }
 
+/* Debounced levels (integrators), not a raw pin read */
 void Drv_IODevice_ReadSyncSignals(IODevice_SyncSignals_t *pSignals)
 {
+    uint8_t stable = s_stableMask;
     if (pSignals == NULL)
         return;
-    pSignals->us  = Dal_Read_Pin(E_GPIO_IN_SYN_US)  ? 1 : 0;
-    pSignals->esw = Dal_Read_Pin(E_GPIO_IN_SYN_ESW) ? 1 : 0;
-    pSignals->rf  = Dal_Read_Pin(E_GPIO_IN_SYN_RF)  ? 1 : 0;
+    pSignals->us  = (stable & (1u << E_GPIO_IN_SYN_US))  ? 1 : 0;
+    pSignals->esw = (stable & (1u << E_GPIO_IN_SYN_ESW)) ? 1 : 0;
+    pSignals->rf  = (stable & (1u << E_GPIO_IN_SYN_RF))  ? 1 : 0;
 }
 
 static IODevice_WorkingMode_EnumDef Drv_IODevice_DecodeWorkingMode(const IODevice_SyncSignals_t *pSignals)
@@ -62,76 +236,34 @@ static IODevice_WorkingMode_EnumDef Drv_IODevice_DecodeWorkingMode(const IODevic
     return E_IODEVICE_MODE_ERROR;
 }
 
+/* The signals come debounced from Drv_IODevice_ReadSyncSignals: decode only */
 IODevice_WorkingMode_EnumDef Drv_IODevice_GetWorkingMode(const IODevice_SyncSignals_t *pSignals)
 {
     if (pSignals == NULL)
         return E_IODEVICE_MODE_ERROR;
-    IODevice_WorkingMode_EnumDef currentMode = Drv_IODevice_DecodeWorkingMode(pSignals);
-    uint32_t currentTick = Dal_GetTick();
-    if (currentMode == s_lastStableMode) {
-        s_debounceActive = 0;
-        return s_lastStableMode;
-    }
-    if (!s_debounceActive || currentMode != s_pendingMode) {
-        s_pendingMode = currentMode;
-        s_debounceStartTick = currentTick;
-        s_debounceActive = 1;
-        return s_lastStableMode;
-    }
-    if ((currentTick - s_debounceStartTick) >= IODEVICE_DEBOUNCE_TIME_MS) {
-        s_lastStableMode = s_pendingMode;
-        s_debounceActive = 0;
-    }
-    return s_lastStableMode;
+    return Drv_IODevice_DecodeWorkingMode(pSignals);
 }
 
+/* Sync signals are already debounced by the integrators */
 IODevice_WorkingMode_EnumDef Drv_IODevice_GetProbeStatus(void)
 {
     IODevice_SyncSignals_t s;
     Drv_IODevice_ReadSyncSignals(&s);
-    return Drv_IODevice_GetWorkingMode(&s);
+    return Drv_IODevice_DecodeWorkingMode(&s);
 }
 
 void Drv_IODevice_ChangeChannel(IODevice_Channel_EnumDef channel)
 {
-    switch (channel) {
-        case CHANNEL_US:
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL2, 1);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL3, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL4, 0);
-            break;
-        case CHANNEL_RF:
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL2, 1);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL3, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL4, 0);
-            break;
-        case CHANNEL_SW:
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL2, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL3, 1);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL4, 1);
-            break;
-        case CHANNEL_NH:
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL2, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL3, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL4, 0);
-            break;
-        case CHANNEL_CLOSE:
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL2, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL3, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL4, 0);
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL1, 0);
-            break;
-        case CHANNEL_READY:
-            Dal_Write_Pin(E_GPIO_OUT_PWR_CTRL1, 1);
-            break;
-        default:
-            break;
-    }
+    if (channel >= CHANNEL_MAX)
+        return;
+    if (Drv_Trace_Output(E_TRACE_REC_CHANNEL, (uint8_t)channel, 0))
+        return;
+    Dal_Write_Batch(&s_channelBatch[channel]);
 }
 
 bool Drv_IODevice_GetFootSwitchState(void)
 {
-    return Dal_Read_Pin(E_GPIO_IN_FOOT);
+    return (s_stableMask & (1u << E_GPIO_IN_FOOT)) ? true : false;
 }
 
 void Drv_IODevice_StartBuzzer(uint32_t duration_ms)
@@ -5,7 +5,6 @@
 #ifndef DRV_IODEVICE_H
 #define DRV_IODEVICE_H
 
-#include "stm32f10x.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -67,6 +66,20 @@ typedef struct {
     uint8_t rf;
 } IODevice_SyncSignals_t;
 
+/* Debounced input transition, queued from interrupt context */
+typedef struct {
+    GPIO_Input_EnumDef input;
+    uint8_t  level;       /* debounced level after the transition */
+    uint32_t edge_ms;     /* tick of the first raw edge */
+    uint32_t stable_ms;   /* tick the new level was accepted */
+} IODevice_Event_t;
+
+void Drv_IODevice_Init(void);
+bool Drv_IODevice_PopEvent(IODevice_Event_t *pEvent);
+void Drv_IODevice_EdgeFromISR(void);   /* EXTI15_10_IRQHandler only */
+void Drv_IODevice_TickFromISR(void);   /* SysTick_Handler only, 1 ms */
+bool Drv_IODevice_Resync(void);         /* after STOP, IRQs disabled; true if any input moved */
+
 void Drv_IODevice_ReadSyncSignals(IODevice_SyncSignals_t *pSignals);
 IODevice_WorkingMode_EnumDef Drv_IODevice_GetWorkingMode(const IODevice_SyncSignals_t *pSignals);
 IODevice_WorkingMode_EnumDef Drv_IODevice_GetProbeStatus(void);
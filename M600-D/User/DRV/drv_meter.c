@@ -0,0 +1,131 @@
+/************************************************************************************
+ * @file     : drv_meter.c
+ * @brief    : Delivered power and energy metering - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_meter.h"
+#include "bsp_adc.h"
+#include "bsp_dac.h"
+#include "bsp_delay.h"
+
+/* Energy is carried as mJ plus a 2^-40 mJ fraction, so nothing is lost between blocks */
+#define METER_FRAC_BITS     40u
+#define METER_FRAC_MASK     ((1ull << METER_FRAC_BITS) - 1u)
+
+typedef struct {
+    uint32_t scale;             /* 2^-40 mJ per (voltage raw x current raw) sample */
+    uint64_t frac;
+    volatile uint32_t mj;       /* free-running, read by the APP */
+    uint32_t winStartMj;
+    volatile uint32_t winMj;    /* energy of the last complete window */
+} Meter_Accu_t;
+
+static Meter_Accu_t s_accu[E_METER_CH_MAX];
+static Meter_Stats_t s_stats;
+static uint32_t s_winBlocks = 1;
+static uint32_t s_winCount = 0;
+static uint32_t s_winUs = 1;
+
+/* DAL: only called from DRV; calls BSP */
+static uint32_t Dal_Meter_GetCycles(void)
+{
+    return BSP_GetCycles();
+}
+
+static uint32_t Dal_Meter_GetScanNs(void)
+{
+    return BSP_ADC_GetScanNs();
+}
+
+static uint16_t Dal_Meter_GetSupplyCode(void)
+{
+    return BSP_DAC_GetValue();
+}
+
+/**
+ * 2^-40 mJ per raw product: (3300/4096 mV)^2 x gains [mV x mA = uW] x scan [ns],
+ * ordered so the 64-bit intermediate stays below 2^54 for any 16-bit gain product.
+ */
+static uint32_t Meter_Scale(uint32_t scanNs, uint32_t gainProduct)
+{
+    uint64_t k = ((uint64_t)BSP_ADC_REF_MV * BSP_ADC_REF_MV * scanNs << 16) / 1000000u;
+
+    return (uint32_t)((k * gainProduct) / 1000000u);
+}
+
+static void Meter_Add(Meter_Accu_t *pAccu, uint32_t sum)
+{
+    pAccu->frac += (uint64_t)sum * pAccu->scale;
+    pAccu->mj += (uint32_t)(pAccu->frac >> METER_FRAC_BITS);
+    pAccu->frac &= METER_FRAC_MASK;
+}
+
+void Drv_Meter_Init(void)
+{
+    uint32_t scanNs = Dal_Meter_GetScanNs();
+    uint32_t blockNs = scanNs * BSP_ADC_BLOCK_SCANS;
+
+    s_accu[E_METER_CH_RF].scale  = Meter_Scale(scanNs, METER_RF_U_MV_PER_MV * METER_RF_I_MA_PER_MV);
+    s_accu[E_METER_CH_ESW].scale = Meter_Scale(scanNs, METER_ESW_U_MV_PER_MV * METER_ESW_I_MA_PER_MV);
+
+    s_winBlocks = (METER_POWER_WINDOW_MS * 1000000u) / blockNs;
+    if (s_winBlocks == 0)
+        s_winBlocks = 1;
+    s_winUs = (s_winBlocks * blockNs) / 1000u;
+
+    s_stats.scanNs = scanNs;
+    s_stats.budgetCycles = (uint32_t)(((uint64_t)blockNs * SystemCoreClock) / 1000000000u);
+}
+
+/**
+ * Runs every BSP_ADC_BLOCK_SCANS scans (~220 us); keep it short and branch-light.
+ * ESW: sum of u x i per pair. RF: sum of i, times the supply code once per block.
+ */
+void Drv_Meter_BlockFromISR(const uint16_t *pScans)
+{
+    uint32_t t0 = Dal_Meter_GetCycles();
+    uint32_t sumEsw = 0;
+    uint32_t sumRf = 0;
+    uint32_t i;
+    uint8_t ch;
+
+    for (i = 0; i < BSP_ADC_BLOCK_SCANS; i++, pScans += BSP_ADC_CH_MAX) {
+        if (pScans[BSP_ADC_CH_ESW_I] > METER_I_DEADBAND)
+            sumEsw += (uint32_t)pScans[BSP_ADC_CH_ESW_U] * pScans[BSP_ADC_CH_ESW_I];
+        if (pScans[BSP_ADC_CH_RF_I] > METER_I_DEADBAND)
+            sumRf += pScans[BSP_ADC_CH_RF_I];
+    }
+    Meter_Add(&s_accu[E_METER_CH_ESW], sumEsw);
+    Meter_Add(&s_accu[E_METER_CH_RF], sumRf * Dal_Meter_GetSupplyCode());
+
+    if (++s_winCount >= s_winBlocks) {
+        s_winCount = 0;
+        for (ch = 0; ch < E_METER_CH_MAX; ch++) {
+            s_accu[ch].winMj = s_accu[ch].mj - s_accu[ch].winStartMj;
+            s_accu[ch].winStartMj = s_accu[ch].mj;
+        }
+    }
+
+    s_stats.blocks++;
+    s_stats.lastCycles = Dal_Meter_GetCycles() - t0;
+    if (s_stats.lastCycles > s_stats.maxCycles)
+        s_stats.maxCycles = s_stats.lastCycles;
+}
+
+uint32_t Drv_Meter_GetEnergyMj(Meter_Channel_EnumDef ch)
+{
+    if (ch >= E_METER_CH_MAX)
+        return 0;
+    return s_accu[ch].mj;
+}
+
+uint32_t Drv_Meter_GetPowerMw(Meter_Channel_EnumDef ch)
+{
+    if (ch >= E_METER_CH_MAX)
+        return 0;
+    return (uint32_t)(((uint64_t)s_accu[ch].winMj * 1000000u) / s_winUs);
+}
+
+const Meter_Stats_t* Drv_Meter_GetStats(void)
+{
+    return &s_stats;
+}
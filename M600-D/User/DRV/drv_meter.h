@@ -0,0 +1,56 @@
+/************************************************************************************
+ * @file     : drv_meter.h
+ * @brief    : Delivered power and energy metering - DRV API, DAL calls BSP (Std lib)
+ * @details  : ADC1/ADC2 sample each voltage/current pair at the same instant. Every half
+ *             DMA ring (BSP_ADC_BLOCK_SCANS scans) the products are summed and scaled
+ *             into a free-running millijoule counter per output; shots and sessions take
+ *             differences of the counter and never reset it. RF has no voltage sense:
+ *             its voltage is the supply DAC code, read once per block.
+ ***********************************************************************************/
+#ifndef DRV_METER_H
+#define DRV_METER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Sense front-end gains, nominal board values */
+#define METER_ESW_U_MV_PER_MV   100u    /* ESW HV divider: output mV per ADC mV */
+#define METER_ESW_I_MA_PER_MV   10u     /* ESW current sense: output mA per ADC mV */
+#define METER_RF_U_MV_PER_MV    10u     /* RF supply: output mV per DAC mV (3.3 V -> 33 V) */
+#define METER_RF_I_MA_PER_MV    1u      /* RF current sense: output mA per ADC mV */
+#define METER_I_DEADBAND        8u      /* current samples at or below this (raw) are offset noise */
+#define METER_POWER_WINDOW_MS   100u    /* averaging window of Drv_Meter_GetPowerMw */
+
+typedef enum {
+    E_METER_CH_RF = 0,
+    E_METER_CH_ESW,
+    E_METER_CH_MAX
+} Meter_Channel_EnumDef;
+
+typedef struct {
+    uint32_t blocks;            /* blocks integrated since boot */
+    uint32_t budgetCycles;      /* CPU cycles between two blocks */
+    uint32_t lastCycles;        /* cycles spent on the last block */
+    uint32_t maxCycles;         /* worst block since boot */
+    uint32_t scanNs;            /* one pair-sample period */
+} Meter_Stats_t;
+
+void Drv_Meter_Init(void);
+/** Free-running delivered energy, wraps at 2^32 mJ; use differences. */
+uint32_t Drv_Meter_GetEnergyMj(Meter_Channel_EnumDef ch);
+/** Mean delivered power over the last METER_POWER_WINDOW_MS. */
+uint32_t Drv_Meter_GetPowerMw(Meter_Channel_EnumDef ch);
+const Meter_Stats_t* Drv_Meter_GetStats(void);
+
+/* DMA1_Channel1_IRQHandler only: one half ring of BSP_ADC_BLOCK_SCANS scans */
+void Drv_Meter_BlockFromISR(const uint16_t *pScans);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_METER_H */
@@ -0,0 +1,134 @@
+/************************************************************************************
+ * @file     : drv_power.c
+ * @brief    : Idle accounting, WFI sleep and STOP mode - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_power.h"
+#include "drv_iodevice.h"
+#include "drv_wdg.h"
+#include "bsp_power.h"
+#include "bsp_delay.h"
+#include <stddef.h>
+
+static Power_Stats_t s_stats = {0};
+static uint32_t s_lastCycles = 0;       /* end of the previous WFI */
+static uint32_t s_windowCycles = 0;
+static uint32_t s_idleCycles = 0;
+static volatile bool s_supplyWarning = false;
+
+/* DAL: only called from DRV; calls BSP */
+static uint32_t Dal_Power_GetCycles(void)
+{
+    return BSP_GetCycles();
+}
+
+static void Dal_Power_Sleep(void)
+{
+    BSP_Power_Sleep();
+}
+
+static uint8_t Dal_Power_Stop(uint32_t ms, uint32_t *pElapsedMs)
+{
+    return BSP_Power_Stop(ms, pElapsedMs);
+}
+
+static void Dal_Power_TickAdvance(uint32_t ms)
+{
+    BSP_SysTick_Advance(ms);
+}
+
+static bool Dal_Power_IsSupplyLow(void)
+{
+    return BSP_Power_IsSupplyLow() != 0;
+}
+
+void Drv_Power_Init(void)
+{
+    BSP_Power_Init();
+    s_lastCycles = Dal_Power_GetCycles();
+}
+
+static void Drv_Power_Account(uint32_t busy, uint32_t idle)
+{
+    uint32_t load;
+
+    s_windowCycles += busy + idle;
+    s_idleCycles += idle;
+    if (s_windowCycles < SystemCoreClock)
+        return;
+    load = 1000u - s_idleCycles / (s_windowCycles / 1000u);
+    s_stats.loadPermille = (uint16_t)load;
+    if (load > s_stats.peakPermille)
+        s_stats.peakPermille = (uint16_t)load;
+    s_windowCycles = 0;
+    s_idleCycles = 0;
+}
+
+void Drv_Power_Idle(bool allowSleep)
+{
+    uint32_t now = Dal_Power_GetCycles();
+    uint32_t busy = now - s_lastCycles;
+
+    if (allowSleep) {
+        Dal_Power_Sleep();
+        s_stats.sleeps++;
+    }
+    s_lastCycles = Dal_Power_GetCycles();
+    Drv_Power_Account(busy, s_lastCycles - now);
+}
+
+uint8_t Drv_Power_Stop(uint32_t ms)
+{
+    uint32_t elapsed = 0;
+    uint8_t bsp;
+    uint8_t wake = 0;
+
+    Drv_WatchDogFeed();
+    __disable_irq();
+    bsp = Dal_Power_Stop(ms, &elapsed);
+    Dal_Power_TickAdvance(elapsed);
+    if (Drv_IODevice_Resync())
+        wake |= DRV_POWER_WAKE_INPUT;
+    __enable_irq();
+    Drv_WatchDogFeed();
+
+    if (bsp & BSP_POWER_WAKE_FOOT)
+        wake |= DRV_POWER_WAKE_FOOT;
+    if (bsp & BSP_POWER_WAKE_SYNC)
+        wake |= DRV_POWER_WAKE_SYNC;
+    if (bsp & BSP_POWER_WAKE_UART)
+        wake |= DRV_POWER_WAKE_UART;
+    if (bsp & BSP_POWER_WAKE_ALARM)
+        wake |= DRV_POWER_WAKE_TIMER;
+
+    s_stats.stops++;
+    s_stats.stopMs += elapsed;
+    s_stats.lastWake = wake;
+    /* STOP time is neither busy nor idle CPU time */
+    s_lastCycles = Dal_Power_GetCycles();
+    return wake;
+}
+
+const Power_Stats_t* Drv_Power_GetStats(void)
+{
+    return &s_stats;
+}
+
+void Drv_Power_PvdFromISR(void)
+{
+    BSP_Power_PvdFromISR();
+    s_supplyWarning = true;
+    s_stats.supplyWarnings++;
+}
+
+bool Drv_Power_TakeSupplyWarning(void)
+{
+    bool warning = s_supplyWarning;
+
+    s_supplyWarning = false;
+    return warning;
+}
+
+bool Drv_Power_IsSupplyLow(void)
+{
+    return Dal_Power_IsSupplyLow();
+}
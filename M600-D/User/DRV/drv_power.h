@@ -0,0 +1,57 @@
+/************************************************************************************
+ * @file     : drv_power.h
+ * @brief    : Idle accounting, WFI sleep and STOP mode - DRV API, DAL calls BSP (Std lib)
+ * @details  : Drv_Power_Idle() ends every main-loop pass: the time since the previous
+ *             pass is counted as busy, the WFI that follows as idle, and the ratio is
+ *             published once per second as CPU load. Drv_Power_Stop() enters STOP for
+ *             at most DRV_POWER_STOP_MAX_MS and restores clocks, tick and input
+ *             debounce state; the caller decides when the system is idle enough.
+ *             A PVD interrupt latches a supply warning for the APP to act on once.
+ ***********************************************************************************/
+#ifndef DRV_POWER_H
+#define DRV_POWER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DRV_POWER_STOP_MAX_MS   300u    /* one STOP period, below the IWDG timeout (410 ms) */
+
+/* Wake-up reasons, Drv_Power_Stop */
+#define DRV_POWER_WAKE_FOOT     (1u << 0)   /* foot switch edge */
+#define DRV_POWER_WAKE_SYNC     (1u << 1)   /* probe sync RF/ESW edge, IO_SYN_US change (polled) */
+#define DRV_POWER_WAKE_UART     (1u << 2)   /* USART1 RX activity (first frame is lost) */
+#define DRV_POWER_WAKE_TIMER    (1u << 3)   /* RTC alarm, period elapsed */
+#define DRV_POWER_WAKE_INPUT    (1u << 4)   /* input level changed without an edge (IO_SYN_US) */
+
+typedef struct {
+    uint16_t loadPermille;      /* CPU busy share over the last second */
+    uint16_t peakPermille;      /* highest loadPermille since boot */
+    uint32_t sleeps;            /* WFI entries */
+    uint32_t stops;             /* STOP periods */
+    uint32_t stopMs;            /* total time in STOP */
+    uint8_t  lastWake;          /* DRV_POWER_WAKE_* of the last STOP period */
+    uint16_t supplyWarnings;    /* PVD events since boot */
+} Power_Stats_t;
+
+void Drv_Power_Init(void);
+/** End of a main-loop pass: account busy time, then WFI if allowSleep. */
+void Drv_Power_Idle(bool allowSleep);
+/** Enter STOP for up to ms; returns DRV_POWER_WAKE_*. Clocks and tick are restored. */
+uint8_t Drv_Power_Stop(uint32_t ms);
+const Power_Stats_t* Drv_Power_GetStats(void);
+/** True once per PVD event: VDD is about to fail, commit what must survive. */
+bool Drv_Power_TakeSupplyWarning(void);
+bool Drv_Power_IsSupplyLow(void);
+
+/* PVD_IRQHandler only */
+void Drv_Power_PvdFromISR(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_POWER_H */
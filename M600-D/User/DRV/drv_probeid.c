@@ -0,0 +1,447 @@
+/************************************************************************************
+ * @file     : drv_probeid.c
+ * @brief    : Probe identity and calibration cache - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_probeid.h"
+#include "bsp_i2c.h"
+#include "bsp_delay.h"
+#include <string.h>
+#include <stddef.h>
+
+#define PROBEID_I2C_ADDR        0xA0u   /* I2C_Send7bitAddress takes the address left-aligned */
+#define PROBEID_CRC_POLY        0x8005u /* same CRC16 as the mainboard parameter blocks */
+#define PROBEID_CRC_INIT        0xFFFFu
+#define PROBEID_CRC_NONE        0xFFFFu
+#define PROBEID_REG_DONE        0x05u
+#define PROBEID_SN_MIN          8u
+
+#define PROBEID_KEY_LEN         (PROBEID_ADDR_SN + PROBEID_SN_MAX - PROBEID_ADDR_REG)
+#define PROBEID_USAGE_CRC_AT    (PROBEID_USAGE_SIZE - 2u)
+
+typedef enum {
+    E_PROBEID_STEP_IDLE = 0,
+    E_PROBEID_STEP_SETTLE,
+    E_PROBEID_STEP_KEY,
+    E_PROBEID_STEP_IMAGE,
+    E_PROBEID_STEP_USAGE,
+    E_PROBEID_STEP_WRITE,
+    E_PROBEID_STEP_WRITE_WAIT,
+    E_PROBEID_STEP_VERIFY,
+} ProbeId_Step_EnumDef;
+
+static ProbeId_State_EnumDef s_state = E_PROBEID_NONE;
+static ProbeId_State_EnumDef s_result = E_PROBEID_NONE;     /* decided, usage still to read */
+static ProbeId_Step_EnumDef s_step = E_PROBEID_STEP_IDLE;
+static uint32_t s_attachMs = 0;
+static uint8_t s_retry = 0;
+static uint16_t s_offset = 0;
+static uint8_t s_image[PROBEID_IMAGE_SIZE];
+static ProbeId_Info_t s_info;
+static ProbeId_Info_t s_cache[PROBEID_CACHE_SIZE];
+static uint8_t s_cacheUsed = 0;
+static uint8_t s_cacheNext = 0;
+static ProbeId_Stats_t s_stats;
+static uint8_t s_usageBuf[2u * PROBEID_USAGE_SIZE];
+static ProbeId_Usage_t s_usage;
+static uint8_t s_usageCopy = 1;         /* copy holding s_usage; writes go to the other */
+static uint8_t s_writePage = 0;
+static uint32_t s_writeMs = 0;
+
+/* DAL: only called from DRV; calls BSP */
+static uint32_t Dal_ProbeId_GetTick(void)
+{
+    return BSP_GetTick_ms();
+}
+
+/* Random read: address byte, then a sequential read of len bytes */
+static bool Dal_ProbeId_Read(uint8_t addr, uint8_t *pBuf, uint16_t len)
+{
+    if (BSP_I2C2_Transmit(PROBEID_I2C_ADDR, &addr, 1) != 0)
+        return false;
+    return BSP_I2C2_Receive(PROBEID_I2C_ADDR, pBuf, len) == 0;
+}
+
+/* Page write: address byte plus up to PROBEID_PAGE bytes, no page crossing */
+static bool Dal_ProbeId_WritePage(uint8_t addr, const uint8_t *pData)
+{
+    uint8_t buf[1u + PROBEID_PAGE];
+
+    buf[0] = addr;
+    memcpy(&buf[1], pData, PROBEID_PAGE);
+    return BSP_I2C2_Transmit(PROBEID_I2C_ADDR, buf, sizeof(buf)) == 0;
+}
+
+static void Dal_ProbeId_Delay(uint32_t ms)
+{
+    BSP_Delay_ms(ms);
+}
+
+static uint16_t ProbeId_Crc16(const uint8_t *pData, uint16_t len)
+{
+    uint16_t crc = PROBEID_CRC_INIT;
+    uint16_t i;
+    uint8_t j;
+
+    for (i = 0; i < len; i++) {
+        crc ^= (uint16_t)pData[i] << 8;
+        for (j = 0; j < 8u; j++)
+            crc = (crc & 0x8000u) ? (uint16_t)((crc << 1) ^ PROBEID_CRC_POLY) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static uint16_t ProbeId_U16(uint8_t addr)
+{
+    return (uint16_t)((s_image[addr] << 8) | s_image[addr + 1u]);
+}
+
+static uint32_t ProbeId_Get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void ProbeId_Put32(uint8_t *p, uint32_t val)
+{
+    p[0] = (uint8_t)(val >> 24);
+    p[1] = (uint8_t)(val >> 16);
+    p[2] = (uint8_t)(val >> 8);
+    p[3] = (uint8_t)val;
+}
+
+/* Usage record: seq, resonanceKHz (u16), energisedS, shots (u32), sessions (u16), CRC16,
+ * big-endian */
+static void ProbeId_UsageEncode(uint8_t *p, const ProbeId_Usage_t *pUsage)
+{
+    uint16_t crc;
+
+    p[0] = (uint8_t)(pUsage->seq >> 8);
+    p[1] = (uint8_t)pUsage->seq;
+    p[2] = (uint8_t)(pUsage->resonanceKHz >> 8);
+    p[3] = (uint8_t)pUsage->resonanceKHz;
+    ProbeId_Put32(&p[4], pUsage->energisedS);
+    ProbeId_Put32(&p[8], pUsage->shots);
+    p[12] = (uint8_t)(pUsage->sessions >> 8);
+    p[13] = (uint8_t)pUsage->sessions;
+    crc = ProbeId_Crc16(p, PROBEID_USAGE_CRC_AT);
+    p[14] = (uint8_t)(crc >> 8);
+    p[15] = (uint8_t)crc;
+}
+
+static bool ProbeId_UsageDecode(const uint8_t *p, ProbeId_Usage_t *pUsage)
+{
+    if (ProbeId_Crc16(p, PROBEID_USAGE_CRC_AT) != (uint16_t)((p[14] << 8) | p[15]))
+        return false;
+    pUsage->seq          = (uint16_t)((p[0] << 8) | p[1]);
+    pUsage->resonanceKHz = (uint16_t)((p[2] << 8) | p[3]);
+    pUsage->energisedS   = ProbeId_Get32(&p[4]);
+    pUsage->shots        = ProbeId_Get32(&p[8]);
+    pUsage->sessions     = (uint16_t)((p[12] << 8) | p[13]);
+    return true;
+}
+
+/* Newer valid copy wins (seq compared modulo 2^16); none valid: a fresh probe */
+static void ProbeId_UsageSelect(void)
+{
+    ProbeId_Usage_t copy[2];
+    bool valid0 = ProbeId_UsageDecode(&s_usageBuf[0], &copy[0]);
+    bool valid1 = ProbeId_UsageDecode(&s_usageBuf[PROBEID_USAGE_SIZE], &copy[1]);
+
+    if (valid0 && (!valid1 || (int16_t)(copy[0].seq - copy[1].seq) > 0)) {
+        s_usage = copy[0];
+        s_usageCopy = 0;
+    } else if (valid1) {
+        s_usage = copy[1];
+        s_usageCopy = 1;
+    } else {
+        memset(&s_usage, 0, sizeof(s_usage));
+        s_usageCopy = 1;
+    }
+}
+
+static uint8_t ProbeId_UsageTarget(void)
+{
+    return (uint8_t)(PROBEID_ADDR_USAGE + (s_usageCopy ^ 1u) * PROBEID_USAGE_SIZE);
+}
+
+static uint16_t ProbeId_Range(uint16_t val, uint16_t lo, uint16_t hi)
+{
+    return (val >= lo && val <= hi) ? val : 0u;
+}
+
+/* SN key from the registration block, s_image holds it at its own addresses */
+static void ProbeId_DecodeKey(ProbeId_Info_t *pInfo)
+{
+    uint8_t len = s_image[PROBEID_ADDR_REG + 1u];
+
+    pInfo->registered = (s_image[PROBEID_ADDR_REG] == PROBEID_REG_DONE);
+    pInfo->snLen = (len >= PROBEID_SN_MIN && len <= PROBEID_SN_MAX) ? len : 0u;
+    memset(pInfo->sn, 0, sizeof(pInfo->sn));
+    memcpy(pInfo->sn, &s_image[PROBEID_ADDR_SN], pInfo->snLen);
+    pInfo->crc = ProbeId_U16(PROBEID_ADDR_CRC);
+}
+
+static void ProbeId_Decode(ProbeId_Info_t *pInfo)
+{
+    uint8_t i;
+
+    ProbeId_DecodeKey(pInfo);
+    pInfo->model = (s_image[PROBEID_ADDR_MODEL] >= 1u && s_image[PROBEID_ADDR_MODEL] <= 4u) ?
+                   s_image[PROBEID_ADDR_MODEL] : 0u;
+    for (i = 0; i < 2u; i++)
+        pInfo->overTempC[i] = (s_image[PROBEID_ADDR_OVERTEMP + i] == 0xFFu) ? 0u : s_image[PROBEID_ADDR_OVERTEMP + i];
+    pInfo->usFreqKHz      = ProbeId_Range(ProbeId_U16(PROBEID_ADDR_US_FREQ), 700u, 1400u);
+    pInfo->headTempLimit  = ProbeId_Range(ProbeId_U16(PROBEID_ADDR_HEAD_TEMP), 250u, 480u);
+    pInfo->boardTempLimit = ProbeId_Range(ProbeId_U16(PROBEID_ADDR_BOARD_TEMP), 250u, 480u);
+    pInfo->dcdcSet        = ProbeId_Range(ProbeId_U16(PROBEID_ADDR_DCDC), 600u, 2000u);
+    pInfo->rfTempLimit    = ProbeId_Range(ProbeId_U16(PROBEID_ADDR_RF_TEMP), 250u, 480u);
+}
+
+static const ProbeId_Info_t* ProbeId_CacheFind(const ProbeId_Info_t *pKey)
+{
+    uint8_t i;
+
+    for (i = 0; i < s_cacheUsed; i++) {
+        if (s_cache[i].crc == pKey->crc && s_cache[i].snLen == pKey->snLen &&
+            memcmp(s_cache[i].sn, pKey->sn, pKey->snLen) == 0)
+            return &s_cache[i];
+    }
+    return NULL;
+}
+
+/* Same SN with a new CRC (recalibrated) replaces its old entry, otherwise round robin */
+static void ProbeId_CachePut(const ProbeId_Info_t *pInfo)
+{
+    uint8_t i;
+
+    for (i = 0; i < s_cacheUsed; i++) {
+        if (s_cache[i].snLen == pInfo->snLen && memcmp(s_cache[i].sn, pInfo->sn, pInfo->snLen) == 0)
+            break;
+    }
+    if (i == s_cacheUsed) {
+        i = s_cacheNext;
+        s_cacheNext = (uint8_t)((s_cacheNext + 1u) % PROBEID_CACHE_SIZE);
+        if (s_cacheUsed < PROBEID_CACHE_SIZE)
+            s_cacheUsed++;
+    }
+    s_cache[i] = *pInfo;
+}
+
+static bool ProbeId_Finish(ProbeId_State_EnumDef state)
+{
+    s_state = state;
+    s_step = E_PROBEID_STEP_IDLE;
+    s_stats.lastMs = (uint16_t)(Dal_ProbeId_GetTick() - s_attachMs);
+    return true;
+}
+
+/* Calibration decided: the usage record is read on every insertion, cache hit or not */
+static bool ProbeId_ReadUsage(ProbeId_State_EnumDef result)
+{
+    s_result = result;
+    s_offset = 0;
+    s_step = E_PROBEID_STEP_USAGE;
+    return false;
+}
+
+static void ProbeId_WriteDone(bool ok)
+{
+    if (ok) {
+        ProbeId_UsageDecode(s_usageBuf, &s_usage);
+        s_usageCopy ^= 1u;
+        s_stats.usageWrites++;
+    } else {
+        s_stats.usageErrors++;
+    }
+    s_step = E_PROBEID_STEP_IDLE;
+}
+
+/* Bus error: retry the same step on the next call, give up after PROBEID_RETRY_MAX */
+static bool ProbeId_BusError(void)
+{
+    s_stats.busErrors++;
+    if (++s_retry < PROBEID_RETRY_MAX)
+        return false;
+    if (s_step >= E_PROBEID_STEP_WRITE) {
+        ProbeId_WriteDone(false);
+        return false;
+    }
+    return ProbeId_Finish(E_PROBEID_ABSENT);
+}
+
+static bool ProbeId_ImageDone(void)
+{
+    uint16_t stored = ProbeId_U16(PROBEID_ADDR_CRC);
+
+    s_stats.reads++;
+    if (stored == PROBEID_CRC_NONE) {
+        ProbeId_Decode(&s_info);
+        return ProbeId_ReadUsage(E_PROBEID_LEGACY);
+    }
+    if (ProbeId_Crc16(s_image, PROBEID_ADDR_CRC) != stored) {
+        s_stats.crcErrors++;
+        return ProbeId_Finish(E_PROBEID_CORRUPT);
+    }
+    ProbeId_Decode(&s_info);
+    if (s_info.snLen != 0)
+        ProbeId_CachePut(&s_info);
+    return ProbeId_ReadUsage(E_PROBEID_VALID);
+}
+
+void Drv_ProbeId_Attach(void)
+{
+    s_state = E_PROBEID_BUSY;
+    s_step = E_PROBEID_STEP_SETTLE;
+    s_attachMs = Dal_ProbeId_GetTick();
+    s_retry = 0;
+}
+
+void Drv_ProbeId_Detach(void)
+{
+    s_state = E_PROBEID_NONE;
+    s_step = E_PROBEID_STEP_IDLE;
+}
+
+bool Drv_ProbeId_Process(void)
+{
+    const ProbeId_Info_t *pHit;
+    uint16_t len;
+
+    switch (s_step) {
+    case E_PROBEID_STEP_SETTLE:
+        if (Dal_ProbeId_GetTick() - s_attachMs >= PROBEID_SETTLE_MS)
+            s_step = E_PROBEID_STEP_KEY;
+        return false;
+
+    case E_PROBEID_STEP_KEY:
+        if (!Dal_ProbeId_Read(PROBEID_ADDR_REG, &s_image[PROBEID_ADDR_REG], PROBEID_KEY_LEN) ||
+            !Dal_ProbeId_Read(PROBEID_ADDR_CRC, &s_image[PROBEID_ADDR_CRC], 2u))
+            return ProbeId_BusError();
+        s_retry = 0;
+        ProbeId_DecodeKey(&s_info);
+        pHit = (s_info.crc != PROBEID_CRC_NONE && s_info.snLen != 0) ? ProbeId_CacheFind(&s_info) : NULL;
+        if (pHit != NULL) {
+            s_info = *pHit;
+            s_stats.hits++;
+            return ProbeId_ReadUsage(E_PROBEID_VALID);
+        }
+        s_offset = 0;
+        s_step = E_PROBEID_STEP_IMAGE;
+        return false;
+
+    case E_PROBEID_STEP_IMAGE:
+        len = PROBEID_IMAGE_SIZE - s_offset;
+        if (len > PROBEID_CHUNK)
+            len = PROBEID_CHUNK;
+        if (!Dal_ProbeId_Read((uint8_t)s_offset, &s_image[s_offset], len))
+            return ProbeId_BusError();
+        s_retry = 0;
+        s_offset += len;
+        if (s_offset < PROBEID_IMAGE_SIZE)
+            return false;
+        return ProbeId_ImageDone();
+
+    case E_PROBEID_STEP_USAGE:
+        if (!Dal_ProbeId_Read((uint8_t)(PROBEID_ADDR_USAGE + s_offset), &s_usageBuf[s_offset], PROBEID_CHUNK))
+            return ProbeId_BusError();
+        s_retry = 0;
+        s_offset += PROBEID_CHUNK;
+        if (s_offset < sizeof(s_usageBuf))
+            return false;
+        ProbeId_UsageSelect();
+        return ProbeId_Finish(s_result);
+
+    case E_PROBEID_STEP_WRITE:
+        if (!Dal_ProbeId_WritePage((uint8_t)(ProbeId_UsageTarget() + s_writePage * PROBEID_PAGE),
+                                   &s_usageBuf[s_writePage * PROBEID_PAGE]))
+            return ProbeId_BusError();
+        s_retry = 0;
+        s_writeMs = Dal_ProbeId_GetTick();
+        s_step = E_PROBEID_STEP_WRITE_WAIT;
+        return false;
+
+    case E_PROBEID_STEP_WRITE_WAIT:
+        if (Dal_ProbeId_GetTick() - s_writeMs < PROBEID_TWR_MS)
+            return false;
+        s_writePage++;
+        s_step = (s_writePage * PROBEID_PAGE < PROBEID_USAGE_SIZE) ? E_PROBEID_STEP_WRITE : E_PROBEID_STEP_VERIFY;
+        return false;
+
+    case E_PROBEID_STEP_VERIFY:
+        if (!Dal_ProbeId_Read(ProbeId_UsageTarget(), &s_usageBuf[PROBEID_USAGE_SIZE], PROBEID_USAGE_SIZE))
+            return ProbeId_BusError();
+        ProbeId_WriteDone(memcmp(s_usageBuf, &s_usageBuf[PROBEID_USAGE_SIZE], PROBEID_USAGE_SIZE) == 0);
+        return false;
+
+    default:
+        return false;
+    }
+}
+
+ProbeId_State_EnumDef Drv_ProbeId_GetState(void)
+{
+    return s_state;
+}
+
+const ProbeId_Info_t* Drv_ProbeId_Get(void)
+{
+    return (s_state == E_PROBEID_VALID || s_state == E_PROBEID_LEGACY) ? &s_info : NULL;
+}
+
+bool Drv_ProbeId_IsUsable(void)
+{
+    return s_state != E_PROBEID_BUSY && s_state != E_PROBEID_CORRUPT;
+}
+
+const ProbeId_Stats_t* Drv_ProbeId_GetStats(void)
+{
+    return &s_stats;
+}
+
+const ProbeId_Usage_t* Drv_ProbeId_GetUsage(void)
+{
+    return (Drv_ProbeId_Get() != NULL) ? &s_usage : NULL;
+}
+
+bool Drv_ProbeId_IsWriting(void)
+{
+    return s_step >= E_PROBEID_STEP_WRITE;
+}
+
+/* s_usageBuf[0..15] holds the record in flight, [16..31] its read-back */
+bool Drv_ProbeId_WriteUsage(const ProbeId_Usage_t *pUsage, bool urgent)
+{
+    ProbeId_Usage_t next;
+    uint32_t elapsed;
+    uint8_t page;
+
+    if (pUsage == NULL || Drv_ProbeId_Get() == NULL)
+        return false;
+    if (s_step != E_PROBEID_STEP_IDLE && !(urgent && Drv_ProbeId_IsWriting()))
+        return false;
+    /* Taking over: the EEPROM NACKs until the page it is programming is done */
+    if (s_step == E_PROBEID_STEP_WRITE_WAIT) {
+        elapsed = Dal_ProbeId_GetTick() - s_writeMs;
+        if (elapsed < PROBEID_TWR_MS)
+            Dal_ProbeId_Delay(PROBEID_TWR_MS - elapsed);
+    }
+    next = *pUsage;
+    next.seq = (uint16_t)(s_usage.seq + 1u);
+    ProbeId_UsageEncode(s_usageBuf, &next);
+    s_retry = 0;
+    s_writePage = 0;
+    if (!urgent) {
+        s_step = E_PROBEID_STEP_WRITE;
+        return true;
+    }
+    /* Supply failing: both pages now, no read-back */
+    for (page = 0; page < PROBEID_USAGE_SIZE / PROBEID_PAGE; page++) {
+        if (!Dal_ProbeId_WritePage((uint8_t)(ProbeId_UsageTarget() + page * PROBEID_PAGE),
+                                   &s_usageBuf[page * PROBEID_PAGE])) {
+            ProbeId_WriteDone(false);
+            return true;
+        }
+        Dal_ProbeId_Delay(PROBEID_TWR_MS);
+    }
+    ProbeId_WriteDone(true);
+    return true;
+}
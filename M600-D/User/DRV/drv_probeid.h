@@ -0,0 +1,124 @@
+/************************************************************************************
+ * @file     : drv_probeid.h
+ * @brief    : Probe identity and calibration cache - DRV API, DAL calls BSP (Std lib)
+ * @details  : The probe AT24C02 (I2C2) keeps model, SN and calibration trims in the
+ *             legacy block layout. On insertion the SN key is read first; a probe seen
+ *             before with the same image CRC is served from RAM at once, otherwise the
+ *             image is read sequentially, PROBEID_CHUNK bytes per Drv_ProbeId_Process()
+ *             call, and checked against the CRC16 in the block behind the trims, which
+ *             covers every block before it. Probes written before the CRC existed (CRC
+ *             word erased) are accepted with the per-field range checks only and are
+ *             not cached.
+ *             Usage (energised time, shots, sessions) lives behind the image in two
+ *             CRC-checked copies; the newer valid one counts and a write always goes
+ *             to the other, so a write torn by power loss leaves the previous record.
+ *             It is re-read on every insertion, the probe may have been used elsewhere.
+ *             The record also carries the US resonance last found on this probe, so a
+ *             probe moved between mainboards keeps its own search start.
+ ***********************************************************************************/
+#ifndef DRV_PROBEID_H
+#define DRV_PROBEID_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* AT24C02 byte addresses (legacy blocks of 8 bytes, trims big-endian) */
+#define PROBEID_ADDR_MODEL          0x00u   /* block 0: model 1..4 */
+#define PROBEID_ADDR_OVERTEMP       0x10u   /* block 2: two over-temperature limits, degC */
+#define PROBEID_ADDR_REG            0x18u   /* block 3: registration flag, SN length */
+#define PROBEID_ADDR_SN             0x20u   /* blocks 4..6: SN */
+#define PROBEID_ADDR_US_FREQ        0x40u   /* US resonance trim, kHz */
+#define PROBEID_ADDR_HEAD_TEMP      0x50u   /* head temperature limit, 0.1 degC */
+#define PROBEID_ADDR_BOARD_TEMP     0x60u   /* board temperature limit, 0.1 degC */
+#define PROBEID_ADDR_DCDC           0x70u   /* DCDC set point, legacy units */
+#define PROBEID_ADDR_RF_TEMP        0x80u   /* RF head temperature limit, 0.1 degC */
+#define PROBEID_ADDR_CRC            0x88u   /* block 17: CRC16 over blocks 0..16 (0x00..0x87), 0xFFFF: none */
+#define PROBEID_IMAGE_SIZE          0x8Au
+#define PROBEID_ADDR_USAGE          0xA0u   /* usage record, copy 0; copy 1 follows */
+#define PROBEID_USAGE_SIZE          16u
+#define PROBEID_PAGE                8u      /* AT24C02 write page */
+#define PROBEID_TWR_MS              6u      /* write cycle 5 ms max, +1 for the tick granularity */
+
+#define PROBEID_SN_MAX              24u
+#define PROBEID_CHUNK               16u     /* bytes per bus transaction, ~1.7 ms at 100 kHz */
+#define PROBEID_SETTLE_MS           50u     /* contact bounce after insertion */
+#define PROBEID_RETRY_MAX           3u      /* bus errors before the probe counts as without EEPROM */
+#define PROBEID_CACHE_SIZE          4u
+
+typedef enum {
+    E_PROBEID_NONE = 0,         /* no probe */
+    E_PROBEID_BUSY,             /* settling or reading */
+    E_PROBEID_VALID,            /* CRC checked */
+    E_PROBEID_LEGACY,           /* no CRC written, fields range checked */
+    E_PROBEID_CORRUPT,          /* CRC mismatch, calibration unusable */
+    E_PROBEID_ABSENT,           /* EEPROM does not answer */
+} ProbeId_State_EnumDef;
+
+/* Typed view; a trim of 0 means "not set on this probe", keep the host value */
+typedef struct {
+    uint8_t  model;                     /* 1..4, 0: unknown */
+    uint8_t  registered;                /* installation registration done */
+    uint8_t  overTempC[2];              /* legacy limits, degC, 0: not set */
+    uint8_t  snLen;
+    char     sn[PROBEID_SN_MAX + 1u];   /* zero terminated */
+    uint16_t usFreqKHz;                 /* 700..1400 */
+    uint16_t headTempLimit;             /* 250..480 (0.1 degC) */
+    uint16_t boardTempLimit;            /* 250..480 (0.1 degC) */
+    uint16_t dcdcSet;                   /* 600..2000 */
+    uint16_t rfTempLimit;               /* 250..480 (0.1 degC) */
+    uint16_t crc;                       /* image CRC, cache key together with the SN */
+} ProbeId_Info_t;
+
+/* Lifetime usage stored on the probe */
+typedef struct {
+    uint16_t seq;               /* record generation, assigned by the driver */
+    uint16_t resonanceKHz;      /* US resonance last found, 0: unknown */
+    uint32_t energisedS;
+    uint32_t shots;
+    uint16_t sessions;
+} ProbeId_Usage_t;
+
+typedef struct {
+    uint16_t hits;              /* insertions served from the cache */
+    uint16_t reads;             /* full image reads */
+    uint16_t crcErrors;
+    uint16_t busErrors;
+    uint16_t lastMs;            /* insertion to result, last probe */
+    uint16_t usageWrites;       /* usage records committed and verified */
+    uint16_t usageErrors;       /* usage writes failed or not read back */
+} ProbeId_Stats_t;
+
+/** Probe inserted (or changed): restart identification. */
+void Drv_ProbeId_Attach(void);
+void Drv_ProbeId_Detach(void);
+/** One bus transaction at most; true on the call that finishes identification. */
+bool Drv_ProbeId_Process(void);
+ProbeId_State_EnumDef Drv_ProbeId_GetState(void);
+/** Typed view for VALID and LEGACY probes, NULL otherwise. */
+const ProbeId_Info_t* Drv_ProbeId_Get(void);
+/** False while identifying or when the stored calibration is corrupt. */
+bool Drv_ProbeId_IsUsable(void);
+const ProbeId_Stats_t* Drv_ProbeId_GetStats(void);
+
+/** Usage record of the identified probe (zeros if it has none yet), NULL otherwise. */
+const ProbeId_Usage_t* Drv_ProbeId_GetUsage(void);
+/**
+ * Commit a new usage record (seq is ignored and set to the stored one + 1). Normally
+ * one page per Drv_ProbeId_Process() call plus the write cycle in between; urgent
+ * writes both pages at once and blocks ~2 x PROBEID_TWR_MS (supply failing), taking
+ * over a normal write in progress (one more PROBEID_TWR_MS at most if a page of it is
+ * still being programmed). False if no probe is identified, or if a normal
+ * write is already in progress.
+ */
+bool Drv_ProbeId_WriteUsage(const ProbeId_Usage_t *pUsage, bool urgent);
+bool Drv_ProbeId_IsWriting(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_PROBEID_H */
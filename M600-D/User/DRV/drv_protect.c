@@ -0,0 +1,138 @@
+/************************************************************************************
+ * @file     : drv_protect.c
+ * @brief    : Over-current protection - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_protect.h"
+#include "drv_delay.h"
+#include "drv_blackbox.h"
+#include "drv_dac.h"
+#include "bsp_adc.h"
+#include "bsp_tim.h"
+#include "bsp_gpio.h"
+
+#define PROTECT_ADC_REF_MV      3300u
+#define PROTECT_ADC_RESOLUTION  4096u
+
+static volatile bool s_tripped = false;
+static volatile bool s_armed = false;
+static volatile bool s_cut = false;
+static ADC_Channel_EnumDef s_armedChannel = E_ADC_CHANNEL_MAX;
+static uint16_t s_armedLimitMv = 0;
+static Protect_FaultRecord_t s_fault;
+
+/* DAL: only called from DRV; calls BSP */
+static BSP_ADC_Channel_t Dal_Protect_MapChannel(ADC_Channel_EnumDef ch)
+{
+    switch (ch) {
+        case E_ADC_CHANNEL_US_I:  return BSP_ADC_CH_US_I;
+        case E_ADC_CHANNEL_RF_I:  return BSP_ADC_CH_RF_I;
+        case E_ADC_CHANNEL_ESW_I: return BSP_ADC_CH_ESW_I;
+        default:                  return BSP_ADC_CH_MAX;
+    }
+}
+
+static void Dal_Protect_CutOutputs(void)
+{
+    BSP_TIM_EmergencyOff();
+    BSP_GPIO_PwrCtrlOffAll();
+}
+
+/* Same outputs as the trip, through the normal stop paths: no TIM1 break, no latch */
+static void Dal_Protect_StopOutputs(void)
+{
+    BSP_GPIO_PwrCtrlOffAll();
+    BSP_TIM1_PwmStop();
+    BSP_TIM3_GateStop();
+    BSP_TIM4_OutputsOff();
+}
+
+/* ESW+/ESW- low before PWM1 is back: a CCR written while cut must not show at the press */
+static void Dal_Protect_RunOutputs(void)
+{
+    BSP_TIM4_SetCompare3(0);
+    BSP_TIM4_SetCompare4(0);
+    BSP_TIM4_OutputsOn();
+}
+
+bool Drv_Protect_Arm(ADC_Channel_EnumDef channel, uint16_t limit_mv)
+{
+    BSP_ADC_Channel_t bch = Dal_Protect_MapChannel(channel);
+    if (bch == BSP_ADC_CH_MAX || limit_mv == 0 || s_tripped)
+        return false;
+    if (limit_mv > PROTECT_ADC_REF_MV)
+        limit_mv = PROTECT_ADC_REF_MV;
+
+    s_armedChannel = channel;
+    s_armedLimitMv = limit_mv;
+    s_armed = true;
+    BSP_ADC_AWD_Config(bch, (uint16_t)(((uint32_t)limit_mv * PROTECT_ADC_RESOLUTION) / PROTECT_ADC_REF_MV));
+    return true;
+}
+
+void Drv_Protect_Disarm(void)
+{
+    BSP_ADC_AWD_Disable();
+    s_armed = false;
+}
+
+bool Drv_Protect_IsTripped(void)
+{
+    return s_tripped;
+}
+
+const Protect_FaultRecord_t* Drv_Protect_GetFault(void)
+{
+    return &s_fault;
+}
+
+/* Outputs stay cut until the APP clears the latch with the channels closed */
+void Drv_Protect_Clear(void)
+{
+    if (!s_tripped)
+        return;
+    s_tripped = false;
+    BSP_TIM_OutputsRestore();
+}
+
+void Drv_Protect_TripFromISR(void)
+{
+    uint16_t raw;
+
+    /* Cut first, book-keep after */
+    Dal_Protect_CutOutputs();
+    BSP_ADC_AWD_Disable();
+    if (!s_armed)
+        return;
+
+    raw = BSP_ADC_AWD_ReadTrip(Dal_Protect_MapChannel(s_armedChannel));
+    s_fault.channel  = s_armedChannel;
+    s_fault.limit_mv = s_armedLimitMv;
+    s_fault.value_mv = (uint16_t)(((uint32_t)raw * PROTECT_ADC_REF_MV) / PROTECT_ADC_RESOLUTION);
+    s_fault.tick_ms  = Dal_GetTick();
+    s_fault.trip_count++;
+    s_armed = false;
+    s_tripped = true;
+    Drv_BlackBox_Record(E_BB_EVT_TRIP, (uint8_t)s_fault.channel, s_fault.value_mv);
+}
+
+void Drv_Protect_CutFromISR(void)
+{
+    s_cut = true;
+    Dal_Protect_StopOutputs();
+    Drv_DAC_CutFromISR();
+}
+
+bool Drv_Protect_IsCut(void)
+{
+    return s_cut;
+}
+
+/* TIM4 stays forced off while a trip is latched: Drv_Protect_Clear restores it */
+void Drv_Protect_ReleaseCut(void)
+{
+    if (!s_cut)
+        return;
+    s_cut = false;
+    if (!s_tripped)
+        Dal_Protect_RunOutputs();
+}
@@ -0,0 +1,50 @@
+/************************************************************************************
+ * @file     : drv_protect.h
+ * @brief    : Over-current protection - DRV API, DAL calls BSP (Std lib)
+ * @details  : ADC1 analog watchdog on the active current channel. On trip the AWD
+ *             interrupt cuts TIM1/TIM4 outputs and pwr_control1~4, then latches a
+ *             fault record. Latched until Drv_Protect_Clear().
+ *             Drv_Protect_CutFromISR is the same cut for a normal stop that cannot wait
+ *             for the main loop (foot release): nothing is latched, but until the foot
+ *             is pressed again (Drv_Protect_ReleaseCut) the DAC, TIM4 ESW and TIM3 gate
+ *             drivers refuse to start, so a main loop pass still in flight cannot undo it.
+ ***********************************************************************************/
+#ifndef DRV_PROTECT_H
+#define DRV_PROTECT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "drv_adc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    ADC_Channel_EnumDef channel;   /* channel that tripped */
+    uint16_t limit_mv;             /* armed threshold (mV) */
+    uint16_t value_mv;             /* sample seen in the trip interrupt (mV) */
+    uint32_t tick_ms;              /* BSP tick at trip */
+    uint16_t trip_count;           /* trips since boot */
+} Protect_FaultRecord_t;
+
+bool Drv_Protect_Arm(ADC_Channel_EnumDef channel, uint16_t limit_mv);
+void Drv_Protect_Disarm(void);
+bool Drv_Protect_IsTripped(void);
+const Protect_FaultRecord_t* Drv_Protect_GetFault(void);
+void Drv_Protect_Clear(void);
+
+/** Called from ADC1_2_IRQHandler only. */
+void Drv_Protect_TripFromISR(void);
+/** Non-latching: TIM1 MOE off, TIM3 gate stopped, TIM4 CH3/CH4 forced inactive, DAC ramp
+ *  stopped at 0, pwr_control1~4 off. */
+void Drv_Protect_CutFromISR(void);
+bool Drv_Protect_IsCut(void);
+/** Debounced foot press (Drv_IODevice_TickFromISR): drive may start again. */
+void Drv_Protect_ReleaseCut(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_PROTECT_H */
@@ -0,0 +1,181 @@
+/************************************************************************************
+ * @file     : drv_scope.c
+ * @brief    : RTT scope streaming - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_scope.h"
+#include "bsp_adc.h"
+#include "bsp_dac.h"
+#include "bsp_delay.h"
+#include "SEGGER_RTT.h"
+#include <string.h>
+
+#define SCOPE_HEADER_WORDS  (4u + SCOPE_SEL_MAX / 2u)
+#define SCOPE_VAR_NUM       (E_SCOPE_SRC_MAX - E_SCOPE_SRC_TARGET)
+
+/* Scope source -> scan slot, ADC sources only */
+static const uint8_t s_adcSlot[E_SCOPE_SRC_DAC] = {
+    BSP_ADC_CH_US_I, BSP_ADC_CH_RF_I, BSP_ADC_CH_ESW_U,
+    BSP_ADC_CH_ESW_I, BSP_ADC_CH_HP_PRE, BSP_ADC_CH_HAND_NTC,
+};
+
+static uint8_t s_rttBuf[SCOPE_RTT_BUF_SIZE];
+static uint8_t s_sel[SCOPE_SEL_MAX];
+static volatile uint8_t s_count = 0;
+static uint8_t s_div = 1;
+static uint8_t s_divCnt = 0;
+static uint16_t s_seq = 0;
+static uint16_t s_header[SCOPE_HEADER_WORDS];
+static uint8_t s_headerBytes = 0;
+static volatile bool s_headerPending = false;
+static volatile uint16_t s_var[SCOPE_VAR_NUM];
+static uint32_t s_periodNs = 0;
+static Scope_Stats_t s_stats;
+
+/* DAL: only called from DRV; calls BSP */
+static uint32_t Dal_Scope_GetCycles(void)
+{
+    return BSP_GetCycles();
+}
+
+static uint32_t Dal_Scope_GetScanNs(void)
+{
+    return BSP_ADC_GetScanNs();
+}
+
+static uint16_t Dal_Scope_GetDacCode(void)
+{
+    return BSP_DAC_GetValue();
+}
+
+/* Only the DMA ISR writes this channel, so the unlocked write is safe. 1 when all of it went in, 0 if none */
+static bool Dal_Scope_Write(const void *pData, uint16_t len)
+{
+    return SEGGER_RTT_WriteSkipNoLock(SCOPE_RTT_CHANNEL, pData, len) != 0u;
+}
+
+static uint32_t Dal_Scope_Lock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static void Dal_Scope_Unlock(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+void Drv_Scope_Init(void)
+{
+    SEGGER_RTT_ConfigUpBuffer(SCOPE_RTT_CHANNEL, "Scope", s_rttBuf, sizeof(s_rttBuf),
+                              SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+}
+
+bool Drv_Scope_Select(const uint8_t *pSources, uint8_t count, uint8_t div)
+{
+    uint8_t *pIds = (uint8_t *)&s_header[4];
+    uint32_t primask;
+    uint8_t i;
+
+    if (count > SCOPE_SEL_MAX || div == 0 || (count != 0 && pSources == NULL))
+        return false;
+    for (i = 0; i < count; i++) {
+        if (pSources[i] >= E_SCOPE_SRC_MAX)
+            return false;
+    }
+
+    /* Stop the ISR before touching the selection it reads */
+    s_count = 0;
+    primask = Dal_Scope_Lock();
+    memcpy(s_sel, pSources, count);
+    s_div = div;
+    s_divCnt = 0;
+    s_periodNs = Dal_Scope_GetScanNs() * BSP_ADC_BLOCK_SCANS * div;
+    s_header[0] = SCOPE_HEADER_MAGIC;
+    s_header[1] = (uint16_t)(count | (uint16_t)div << 8);
+    s_header[2] = (uint16_t)s_periodNs;
+    s_header[3] = (uint16_t)(s_periodNs >> 16);
+    memset(pIds, 0, SCOPE_SEL_MAX);
+    memcpy(pIds, pSources, count);
+    s_headerBytes = (uint8_t)(8u + ((count + 1u) & ~1u));
+    s_headerPending = (count != 0);
+    memset(&s_stats, 0, sizeof(s_stats));
+    s_count = count;
+    Dal_Scope_Unlock(primask);
+    return true;
+}
+
+uint8_t Drv_Scope_GetCount(void)
+{
+    return s_count;
+}
+
+uint32_t Drv_Scope_GetPeriodNs(void)
+{
+    return s_periodNs;
+}
+
+const Scope_Stats_t* Drv_Scope_GetStats(void)
+{
+    return &s_stats;
+}
+
+void Drv_Scope_SetVar(Scope_Source_EnumDef src, uint16_t value)
+{
+    if (src >= E_SCOPE_SRC_TARGET && src < E_SCOPE_SRC_MAX)
+        s_var[src - E_SCOPE_SRC_TARGET] = value;
+}
+
+/**
+ * Runs every BSP_ADC_BLOCK_SCANS scans after the meter; returns at once when stopped
+ * or between divided samples. The seq advances on a skipped record too.
+ */
+void Drv_Scope_BlockFromISR(const uint16_t *pScans)
+{
+    uint16_t rec[1u + SCOPE_SEL_MAX];
+    uint8_t count = s_count;
+    uint32_t t0;
+    uint32_t cycles;
+    uint32_t sum;
+    uint8_t src;
+    uint8_t i;
+    uint8_t k;
+
+    if (count == 0 || ++s_divCnt < s_div)
+        return;
+    s_divCnt = 0;
+    t0 = Dal_Scope_GetCycles();
+
+    if (s_headerPending) {
+        if (!Dal_Scope_Write(s_header, s_headerBytes))
+            return;
+        s_headerPending = false;
+    }
+
+    rec[0] = s_seq;
+    s_seq = (uint16_t)((s_seq + 1u) & SCOPE_SEQ_MASK);
+    for (i = 0; i < count; i++) {
+        src = s_sel[i];
+        if (src < E_SCOPE_SRC_DAC) {
+            const uint16_t *p = &pScans[s_adcSlot[src]];
+            sum = 0;
+            for (k = 0; k < BSP_ADC_BLOCK_SCANS; k++, p += BSP_ADC_CH_MAX)
+                sum += *p;
+            rec[1u + i] = (uint16_t)(sum / BSP_ADC_BLOCK_SCANS);
+        } else if (src == E_SCOPE_SRC_DAC) {
+            rec[1u + i] = Dal_Scope_GetDacCode();
+        } else {
+            rec[1u + i] = s_var[src - E_SCOPE_SRC_TARGET];
+        }
+    }
+
+    if (!Dal_Scope_Write(rec, (uint16_t)((1u + count) * sizeof(uint16_t)))) {
+        s_stats.dropped++;
+        return;
+    }
+    cycles = Dal_Scope_GetCycles() - t0;
+    s_stats.samples++;
+    s_stats.cycles += cycles;
+    if (cycles > s_stats.maxCycles)
+        s_stats.maxCycles = cycles;
+}
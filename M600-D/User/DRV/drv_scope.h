@@ -0,0 +1,75 @@
+/************************************************************************************
+ * @file     : drv_scope.h
+ * @brief    : RTT scope streaming - DRV API, DAL calls BSP (Std lib)
+ * @details  : Packed binary samples on RTT up-buffer SCOPE_RTT_CHANNEL, beside the log
+ *             on channel 0. One sample per ADC DMA half ring (BSP_ADC_BLOCK_SCANS scans,
+ *             ~4.5 kHz) divided by the selected rate divider. ADC sources are the block
+ *             mean (raw), DAC is the supply code, TARGET/STATE are the last values the
+ *             APP regulator wrote with Drv_Scope_SetVar.
+ *             Stream of little-endian u16 words. A header record is sent whenever the
+ *             selection changes: SCOPE_HEADER_MAGIC, count (u8), divider (u8), sample
+ *             period ns (u32), source ids (u8 each, padded to even). Each sample record
+ *             is seq (u16, masked by SCOPE_SEQ_MASK so it never equals the magic) and
+ *             one u16 per selected source. Records are written whole or skipped when
+ *             the host falls behind; lost samples show as seq gaps.
+ *             There is no scope down-buffer: the selection arrives as the "scope" line on
+ *             the shared command down-buffer 0 (app_system.c) and calls Drv_Scope_Select.
+ *             One line reader and parser serve every command, RTT Viewer types into
+ *             channel 0, and a second down-buffer would need its own RAM and polling.
+ ***********************************************************************************/
+#ifndef DRV_SCOPE_H
+#define DRV_SCOPE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SCOPE_RTT_CHANNEL       1u
+#define SCOPE_RTT_BUF_SIZE      2048u  /* ~20 ms of 8 sources at full rate */
+#define SCOPE_SEL_MAX           8u     /* sources per sample */
+#define SCOPE_HEADER_MAGIC      0xFFFFu
+#define SCOPE_SEQ_MASK          0x7FFFu
+
+typedef enum {
+    /* ADC block means, raw */
+    E_SCOPE_SRC_US_I = 0,
+    E_SCOPE_SRC_RF_I,
+    E_SCOPE_SRC_ESW_U,
+    E_SCOPE_SRC_ESW_I,
+    E_SCOPE_SRC_HP_PRE,
+    E_SCOPE_SRC_HAND_NTC,
+    /* Supply DAC code */
+    E_SCOPE_SRC_DAC,
+    /* Written by the active APP regulator */
+    E_SCOPE_SRC_TARGET,         /* regulation target (mV) */
+    E_SCOPE_SRC_STATE,          /* regulator/sequencer state */
+    E_SCOPE_SRC_MAX,
+} Scope_Source_EnumDef;
+
+typedef struct {
+    uint32_t samples;           /* sample records written */
+    uint32_t dropped;           /* sample records skipped, RTT buffer full */
+    uint32_t cycles;            /* CPU cycles spent on written records */
+    uint32_t maxCycles;         /* worst single record */
+} Scope_Stats_t;
+
+void Drv_Scope_Init(void);
+/** count 0 stops streaming; div 1..255 blocks per sample. Returns false on a bad selection. */
+bool Drv_Scope_Select(const uint8_t *pSources, uint8_t count, uint8_t div);
+uint8_t Drv_Scope_GetCount(void);
+uint32_t Drv_Scope_GetPeriodNs(void);
+const Scope_Stats_t* Drv_Scope_GetStats(void);
+/** APP side: latest value of E_SCOPE_SRC_TARGET / E_SCOPE_SRC_STATE, picked up by the next sample */
+void Drv_Scope_SetVar(Scope_Source_EnumDef src, uint16_t value);
+
+/* DMA1_Channel1_IRQHandler only: one half ring of BSP_ADC_BLOCK_SCANS scans */
+void Drv_Scope_BlockFromISR(const uint16_t *pScans);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_SCOPE_H */
@@ -8,16 +8,278 @@
 * @copyright: Copyright (c) 2050
 **********************************************************************************/
 #include "drv_si5351.h"
-#include "bsp_i2c.h"
+#include "drv_protect.h"
+#include "bsp_SI5351.h"
+#include "bsp_tim.h"
+#include "bsp_delay.h"
 
+#define SI5351_CLK0_ON      (0x4F | SI_CLK_SRC_PLL_A)   /* US carrier: MS integer, MultiSynth source, 8 mA */
+#define SI5351_CLK1_ON      (0x4F | SI_CLK_SRC_PLL_B)   /* MS integer, MultiSynth source, 8 mA */
+#define SI5351_PLLA_RESET   0x20
+#define SI5351_PLLB_RESET   0x80
+#define SI5351_XTAL_8PF     0x92
+#define SI5351_OEB_CLK01    0xFC                        /* CLK0 (US) and CLK1 (RF) enabled, CLK2 unused */
+
+static bool s_SI5351Ready = false;
+static bool s_rfRunning = false;
+static SI5351_RfPlan_t s_rfPlan;
+static SI5351_RfStats_t s_rfStats;
+static uint16_t s_usKHz = 0;            ///< CLK0 output, 0: off
+static uint16_t s_usMsDiv = 0;          ///< CLK0 MultiSynth divider in use
+
+/* DAL: only called from DRV; calls BSP */
+static bool Dal_SI5351_Write(uint8_t reg, const uint8_t *pData, uint8_t len)
+{
+    if(BSP_SI5351_WriteRegs(reg, pData, len) != 0)
+    {
+        s_rfStats.i2cErrors++;
+        return false;
+    }
+    return true;
+}
+
+static bool Dal_SI5351_WriteReg(uint8_t reg, uint8_t value)
+{
+    return Dal_SI5351_Write(reg, &value, 1);
+}
+
+/**
+ * @brief Program the SI5351 once; called when a US/RF probe is detected, not at boot
+ */
 void Drv_SI5351_Init(void)
 {
-    // Initialize the SI5351
+    if(s_SI5351Ready)
+    {
+        return;
+    }
+    // Crystal load, all outputs powered down until a module starts them; the output
+    // enables come up cleared, CLK0/CLK1 are then switched by their CLKx_CONTROL alone
+    s_SI5351Ready = Dal_SI5351_WriteReg(SI_XTAL_LOAD, SI5351_XTAL_8PF)
+                 && Dal_SI5351_WriteReg(SI_CLK0_CONTROL, SI_POWEROFF)
+                 && Dal_SI5351_WriteReg(SI_CLK1_CONTROL, SI_POWEROFF)
+                 && Dal_SI5351_WriteReg(SI_CLK2_CONTROL, SI_POWEROFF)
+                 && Dal_SI5351_WriteReg(SI_OUTPUT_ENABLE, SI5351_OEB_CLK01);
+}
+
+bool Drv_SI5351_IsReady(void)
+{
+    return s_SI5351Ready;
 }
 
+uint16_t Drv_SI5351_SetPulseWidthus(uint16_t pulse_width_us)
+{
+    if(pulse_width_us < SI5351_US_PERIOD_MIN_US)
+    {
+        Drv_SI5351_StopBurst();
+        return 0;
+    }
+    if(pulse_width_us > SI5351_US_PERIOD_MAX_US)
+    {
+        pulse_width_us = SI5351_US_PERIOD_MAX_US;
+    }
+    pulse_width_us = (pulse_width_us / SI5351_US_PERIOD_STEP_US) * SI5351_US_PERIOD_STEP_US;
+    Drv_SI5351_SetBurst(pulse_width_us, SI5351_US_BURST_ON_US);
+    return pulse_width_us;
+}
+
+void Drv_SI5351_SetBurst(uint16_t period_us, uint16_t on_us)
+{
+    if(period_us == 0 || on_us == 0)
+    {
+        Drv_SI5351_StopBurst();
+        return;
+    }
+    if(on_us > period_us)
+    {
+        on_us = period_us;
+    }
+    // Not restarted between a foot release cut and the next press
+    if(Drv_Protect_IsCut())
+    {
+        return;
+    }
+    BSP_TIM3_GateSet(period_us, on_us);
+}
+
+void Drv_SI5351_StopBurst(void)
+{
+    BSP_TIM3_GateStop();
+}
+
+/**
+ * @brief AN619 parameter block: P3[15:8], P3[7:0], P1[17:16], P1[15:8], P1[7:0],
+ *        P3[19:16]|P2[19:16], P2[15:8], P2[7:0]
+ */
+static void SI5351_PackParams(uint8_t *pReg, uint32_t p1, uint32_t p2, uint32_t p3)
+{
+    pReg[0] = (uint8_t)(p3 >> 8);
+    pReg[1] = (uint8_t)p3;
+    pReg[2] = (uint8_t)((p1 >> 16) & 0x03);
+    pReg[3] = (uint8_t)(p1 >> 8);
+    pReg[4] = (uint8_t)p1;
+    pReg[5] = (uint8_t)(((p3 >> 12) & 0xF0) | ((p2 >> 16) & 0x0F));
+    pReg[6] = (uint8_t)(p2 >> 8);
+    pReg[7] = (uint8_t)p2;
+}
+
+/**
+ * @brief PLL parameters for a whole-kHz VCO: VCO = XTAL x (a + b / c), c = SI5351_PLL_DENOM
+ */
+static void SI5351_PackPll(uint8_t *pReg, uint32_t pllHz)
+{
+    uint32_t a = pllHz / SI5351_XTAL_HZ;
+    uint32_t b = (pllHz % SI5351_XTAL_HZ) / (SI5351_XTAL_HZ / SI5351_PLL_DENOM);
+
+    SI5351_PackParams(pReg,
+                      128u * a + (128u * b) / SI5351_PLL_DENOM - 512u,
+                      128u * b - SI5351_PLL_DENOM * ((128u * b) / SI5351_PLL_DENOM),
+                      SI5351_PLL_DENOM);
+}
+
+/**
+ * @brief Encode a dead time in tDTS ticks into BDTR.DTG, rounding up to the next step
+ *        (1, 2, 8 or 16 ticks depending on the range)
+ * @return Ticks actually encoded
+ */
+static uint32_t SI5351_EncodeDtg(uint32_t ticks, uint8_t *pDtg)
+{
+    uint32_t k;
+
+    if(ticks <= 127u)
+    {
+        *pDtg = (uint8_t)ticks;
+        return ticks;
+    }
+    if(ticks <= 254u)
+    {
+        k = (ticks + 1u) / 2u;
+        *pDtg = (uint8_t)(0x80u | (k - 64u));
+        return k * 2u;
+    }
+    if(ticks <= 504u)
+    {
+        k = (ticks + 7u) / 8u;
+        *pDtg = (uint8_t)(0xC0u | (k - 32u));
+        return k * 8u;
+    }
+    k = (ticks > 1008u) ? 63u : (ticks + 15u) / 16u;
+    *pDtg = (uint8_t)(0xE0u | (k - 32u));
+    return k * 16u;
+}
+
+void Drv_SI5351_PlanRf(uint16_t frequency_khz, uint16_t dead_time_ns, uint8_t msDiv, SI5351_RfPlan_t *pPlan)
+{
+    uint32_t clkHz;
+    uint32_t ticks;
+    uint32_t maxTicks;
+
+    if(frequency_khz < SI5351_RF_FREQ_MIN_KHZ)
+    {
+        frequency_khz = SI5351_RF_FREQ_MIN_KHZ;
+    }
+    else if(frequency_khz > SI5351_RF_FREQ_MAX_KHZ)
+    {
+        frequency_khz = SI5351_RF_FREQ_MAX_KHZ;
+    }
+    if(dead_time_ns < SI5351_RF_DEADTIME_MIN_NS)
+    {
+        dead_time_ns = SI5351_RF_DEADTIME_MIN_NS;
+    }
+    pPlan->freqKHz = frequency_khz;
+    pPlan->period = SI5351_RF_ETR_TICKS;
+    pPlan->pulse = SI5351_RF_ETR_TICKS / 2u;
+
+    // At most a quarter period: each output keeps half its on-time, and any setting in
+    // the 2:1 range stays below half of any other period while a retune is in progress
+    ticks = ((uint32_t)dead_time_ns * SI5351_TIM_DTS_MHZ + 999u) / 1000u;
+    maxTicks = (SI5351_TIM_DTS_MHZ * 1000u) / (4u * frequency_khz);
+    if(ticks > maxTicks)
+    {
+        ticks = maxTicks;
+    }
+    ticks = SI5351_EncodeDtg(ticks, &pPlan->dtg);
+    pPlan->deadTimeNs = (uint16_t)((ticks * 1000u) / SI5351_TIM_DTS_MHZ);
+
+    // CLK1 = VCO / msDiv; keep the divider while the VCO stays in range, otherwise start
+    // from mid-range so later retunes have room both ways
+    clkHz = (uint32_t)frequency_khz * 1000u * SI5351_RF_ETR_TICKS;
+    if(msDiv == 0 || (uint64_t)clkHz * msDiv < SI5351_PLL_MIN_HZ || (uint64_t)clkHz * msDiv > SI5351_PLL_MAX_HZ)
+    {
+        msDiv = (uint8_t)((((SI5351_PLL_MIN_HZ + SI5351_PLL_MAX_HZ) / 2u) / clkHz) & ~1u);
+    }
+    pPlan->msDiv = msDiv;
+    pPlan->pllHz = clkHz * msDiv;
+    SI5351_PackPll(pPlan->pllReg, pPlan->pllHz);
+}
+
+/**
+ * @brief Bridge idle, CLK1 reprogrammed from scratch, bridge restarted on a locked clock
+ */
+static bool SI5351_RfRestart(const SI5351_RfPlan_t *pPlan)
+{
+    uint8_t msReg[8];
+
+    BSP_TIM1_PwmStop();
+    s_rfRunning = false;
+    SI5351_PackParams(msReg, 128u * pPlan->msDiv - 512u, 0, 1u);
+    if(!Dal_SI5351_WriteReg(SI_CLK1_CONTROL, SI_POWEROFF)
+    || !Dal_SI5351_Write(SI_SYNTH_PLL_B, pPlan->pllReg, sizeof(pPlan->pllReg))
+    || !Dal_SI5351_Write(SI_SYNTH_MS_1, msReg, sizeof(msReg))
+    || !Dal_SI5351_WriteReg(SI_PLL_RESET, SI5351_PLLB_RESET)
+    || !Dal_SI5351_WriteReg(SI_CLK1_CONTROL, SI5351_CLK1_ON))
+    {
+        return false;
+    }
+    BSP_Delay_ms(SI5351_PLL_LOCK_MS);
+    BSP_TIM1_PwmStart(pPlan->period, pPlan->pulse, pPlan->dtg);
+    s_rfPlan = *pPlan;
+    s_rfRunning = true;
+    s_rfStats.restarts++;
+    return true;
+}
+
+/**
+ * @brief Same divider: only the PLL B fraction changes, no PLL reset. The dead time moves
+ *        first when it shrinks and last when it grows, so the one in force never exceeds a
+ *        quarter of the period in force. ARR/CCR1 do not change (fixed ETR ticks per period).
+ */
+static bool SI5351_RfRetune(const SI5351_RfPlan_t *pPlan)
+{
+    bool shrink = pPlan->deadTimeNs <= s_rfPlan.deadTimeNs;
+
+    if(shrink)
+    {
+        BSP_TIM1_SetDeadTime(pPlan->dtg);
+    }
+    if(memcmp(pPlan->pllReg, s_rfPlan.pllReg, sizeof(pPlan->pllReg)) != 0
+    && !Dal_SI5351_Write(SI_SYNTH_PLL_B, pPlan->pllReg, sizeof(pPlan->pllReg)))
+    {
+        return false;
+    }
+    if(!shrink)
+    {
+        BSP_TIM1_SetDeadTime(pPlan->dtg);
+    }
+    s_rfPlan = *pPlan;
+    s_rfStats.retunes++;
+    return true;
+}
+
+/**
+ * @brief US carrier on CLK0 (PLL A). Inside the PLL range only the PLL A fraction is
+ *        rewritten (no PLL reset), so a resonance sweep or tracking step is one burst
+ *        write; a divider change powers CLK0 down and resets PLL A.
+ * @param frequency kHz; 700 and below switches CLK0 off, above 1400 is clamped
+ * @return Frequency now on CLK0, 0 when off or on an I2C error
+ */
 uint16_t Drv_SI5351_SetFrequency(uint16_t frequency)
 {
-    // Set the frequency of the SI5351
+    uint8_t pllReg[8];
+    uint8_t msReg[8];
+    uint32_t hz;
+    uint16_t msDiv = s_usMsDiv;
+    bool ok;
+
     if(frequency <= 700)
     {
         frequency = 0;
@@ -26,57 +288,91 @@ uint16_t Drv_SI5351_SetFrequency(uint16_t frequency)
     {
         frequency = 1400;
     }
-    // Set the frequency of the SI5351
+    if(frequency == s_usKHz)
+    {
+        return frequency;
+    }
+    if(frequency == 0)
+    {
+        Dal_SI5351_WriteReg(SI_CLK0_CONTROL, SI_POWEROFF);
+        s_usKHz = 0;
+        s_usMsDiv = 0;
+        return 0;
+    }
+
+    // CLK0 = VCO / msDiv, same divider rule as the RF clock
+    hz = (uint32_t)frequency * 1000u;
+    if(s_usKHz == 0 || hz * msDiv < SI5351_PLL_MIN_HZ || hz * msDiv > SI5351_PLL_MAX_HZ)
+    {
+        msDiv = (uint16_t)((((SI5351_PLL_MIN_HZ + SI5351_PLL_MAX_HZ) / 2u) / hz) & ~1u);
+    }
+    SI5351_PackPll(pllReg, hz * msDiv);
+    if(s_usKHz != 0 && msDiv == s_usMsDiv)
+    {
+        ok = Dal_SI5351_Write(SI_SYNTH_PLL_A, pllReg, sizeof(pllReg));
+    }
+    else
+    {
+        SI5351_PackParams(msReg, 128u * msDiv - 512u, 0, 1u);
+        ok = Dal_SI5351_WriteReg(SI_CLK0_CONTROL, SI_POWEROFF)
+          && Dal_SI5351_Write(SI_SYNTH_PLL_A, pllReg, sizeof(pllReg))
+          && Dal_SI5351_Write(SI_SYNTH_MS_0, msReg, sizeof(msReg))
+          && Dal_SI5351_WriteReg(SI_PLL_RESET, SI5351_PLLA_RESET)
+          && Dal_SI5351_WriteReg(SI_CLK0_CONTROL, SI5351_CLK0_ON);
+    }
+    if(!ok)
+    {
+        Dal_SI5351_WriteReg(SI_CLK0_CONTROL, SI_POWEROFF);
+        frequency = 0;
+        msDiv = 0;
+    }
+    s_usKHz = frequency;
+    s_usMsDiv = msDiv;
     return frequency;
 }
 
-uint16_t Drv_SI5351_SetPulseWidthus(uint16_t pulse_width_us)
+/**
+ * @brief Complementary RF drive: TIM1 CH1/CH1N clocked by SI5351 CLK1 through ETR
+ * @param frequency_khz 700..1400 kHz (RF: 1000 kHz)
+ * @param dead_time_ns Dead time on both edges, clamped to [SI5351_RF_DEADTIME_MIN_NS, T/4]
+ * @return false on an I2C error, outputs idle low
+ */
+bool Drv_SI5351_SetComplementaryPWM(uint16_t frequency_khz, uint16_t dead_time_ns)
 {
-    // Set the pulse width of the SI5351 
-    // input 0.5ms value to 5, 20ms value to 200
-    if(pulse_width_us < 500)
+    SI5351_RfPlan_t plan;
+    bool ok;
+
+    Drv_SI5351_PlanRf(frequency_khz, dead_time_ns, s_rfRunning ? s_rfPlan.msDiv : 0, &plan);
+    if(s_rfRunning && plan.msDiv == s_rfPlan.msDiv)
+    {
+        ok = SI5351_RfRetune(&plan);
+    }
+    else
     {
-        pulse_width_us = 0;
+        ok = SI5351_RfRestart(&plan);
     }
-    else if(pulse_width_us > 20000)
+    if(!ok)
     {
-        pulse_width_us = 20000;
+        Drv_SI5351_StopComplementaryPWM();
     }
-    // Set the pulse width of the SI5351
-    pulse_width_us = (pulse_width_us/500)*500;
+    return ok;
+}
 
-    // BSP Control Pulse Width Register
-    return pulse_width_us;
+void Drv_SI5351_StopComplementaryPWM(void)
+{
+    BSP_TIM1_PwmStop();
+    s_rfRunning = false;
+    Dal_SI5351_WriteReg(SI_CLK1_CONTROL, SI_POWEROFF);
 }
 
-/**
- * @brief Set SI5351 to output complementary PWM signals with dead time
- * @param frequency_khz Frequency in kHz (for RF: 1000kHz = 1MHz)
- * @param dead_time_ns Dead time in nanoseconds
- * @note This function configures SI5351 to output complementary PWM signals
- *       with dead time for RF module. The actual implementation depends on
- *       hardware design - SI5351 may generate clock signals that are then
- *       used by MCU timers to generate complementary PWM, or SI5351 may
- *       have additional logic to generate PWM directly.
- */
-void Drv_SI5351_SetComplementaryPWM(uint16_t frequency_khz, uint16_t dead_time_ns)
-{
-    // TODO: Implement I2C communication with SI5351 to configure:
-    // 1. Set output frequency to frequency_khz (for RF: 1000kHz = 1MHz)
-    // 2. Configure complementary outputs (CLK0 and CLK1 or CLK2)
-    // 3. Set dead time between complementary signals
-    // 
-    // Example I2C register configuration:
-    // - SI5351_CLK0_CTRL: Configure CLK0 output
-    // - SI5351_CLK1_CTRL: Configure CLK1 output (complementary)
-    // - SI5351_CLK2_CTRL: Configure CLK2 output if needed
-    // - Calculate PLL and divider values for desired frequency
-    // - Configure phase offset for dead time
-    
-    // Placeholder: Set frequency (this may need to be called separately)
-    Drv_SI5351_SetFrequency(frequency_khz);
-    
-    /* TODO: DAL -> BSP_I2C1_Transmit(addr, buf, len) for SI5351 I2C config */
+const SI5351_RfPlan_t *Drv_SI5351_GetRfPlan(void)
+{
+    return s_rfRunning ? &s_rfPlan : NULL;
+}
+
+const SI5351_RfStats_t *Drv_SI5351_GetRfStats(void)
+{
+    return &s_rfStats;
 }
 
 /**************************End of file********************************/
@@ -1,7 +1,16 @@
 /************************************************************************************
 * @file     : drv_si5351.h
-* @brief    : 
-* @details  : 
+* @brief    : SI5351 clock generator and the RF drive built on it
+* @details  : RF: SI5351 CLK1 (PLL B, integer MultiSynth) feeds TIM1 ETR at
+*             SI5351_RF_ETR_TICKS x the RF frequency; TIM1 CH1/CH1N give the
+*             complementary pair, dead time from the TIM1 dead-time generator.
+*             A retune inside the PLL range only rewrites the PLL B fraction
+*             (no PLL reset, bridge keeps running); otherwise the bridge idles
+*             low while CLK1 is reprogrammed.
+*             US: the carrier is CLK0 (PLL A, integer MultiSynth), retuned the same
+*             way as CLK1; it is gated in bursts on MCU_CTR_US_RF by TIM3 and DMA;
+*             a new period/on-time is preloaded and starts at the next period
+*             boundary, so nothing in the main loop keeps time.
 * @author   : \.rumi
 * @date     : 2025-01-23
 * @version  : V1.0.0
@@ -20,10 +29,57 @@ extern "C" {
 #endif
 
 
+#define SI5351_RF_ETR_TICKS         12u         ///< TIM1 counts per RF period: 16.8 MHz ETR at 1400 kHz, < CK_INT/4
+#define SI5351_RF_FREQ_MIN_KHZ      700u
+#define SI5351_RF_FREQ_MAX_KHZ      1400u
+#define SI5351_RF_DEADTIME_MIN_NS   50u         ///< the bridge never runs without dead time
+#define SI5351_TIM_DTS_MHZ          72u         ///< TIM1 dead-time clock, tDTS = CK_INT (CKD = DIV1)
+#define SI5351_XTAL_HZ              25000000u
+#define SI5351_PLL_MIN_HZ           600000000u
+#define SI5351_PLL_MAX_HZ           900000000u
+#define SI5351_PLL_DENOM            25000u      ///< 1 kHz steps: any whole-kHz VCO is exact
+#define SI5351_PLL_LOCK_MS          2u          ///< PLL reset to stable output
+#define SI5351_US_PERIOD_MIN_US     500u
+#define SI5351_US_PERIOD_MAX_US     20000u
+#define SI5351_US_PERIOD_STEP_US    500u
+#define SI5351_US_BURST_ON_US       500u        ///< on-time per period; the level sets the period
+
+/** One complete RF drive setting, computed by Drv_SI5351_PlanRf */
+typedef struct
+{
+    uint16_t freqKHz;           ///< RF frequency after clamping
+    uint16_t deadTimeNs;        ///< dead time actually applied, DTG rounded up
+    uint8_t  dtg;               ///< TIM1 BDTR.DTG
+    uint16_t period;            ///< TIM1 ETR ticks per period (ARR + 1)
+    uint16_t pulse;             ///< TIM1 CCR1, 50 %
+    uint8_t  msDiv;             ///< CLK1 MultiSynth integer divider, even
+    uint32_t pllHz;             ///< PLL B VCO
+    uint8_t  pllReg[8];         ///< PLL B parameters, registers 34..41
+} SI5351_RfPlan_t;
+
+typedef struct
+{
+    uint16_t retunes;           ///< PLL fraction only, bridge kept running
+    uint16_t restarts;          ///< bridge idled, CLK1 reprogrammed (start or out of PLL range)
+    uint16_t i2cErrors;
+} SI5351_RfStats_t;
+
 void Drv_SI5351_Init(void);
+bool Drv_SI5351_IsReady(void);
 uint16_t Drv_SI5351_SetFrequency(uint16_t frequency);
+/** Burst repetition period in 500 us steps with SI5351_US_BURST_ON_US on; 0 stops. Returns the period applied */
 uint16_t Drv_SI5351_SetPulseWidthus(uint16_t pulse_width_us);
-void Drv_SI5351_SetComplementaryPWM(uint16_t frequency_khz, uint16_t dead_time_ns);
+/** Gate period and on-time (us); on_us >= period_us is continuous. Takes effect within one period */
+void Drv_SI5351_SetBurst(uint16_t period_us, uint16_t on_us);
+void Drv_SI5351_StopBurst(void);
+/** Pure computation; a non-zero msDiv is kept if the VCO stays in range (no PLL reset) */
+void Drv_SI5351_PlanRf(uint16_t frequency_khz, uint16_t dead_time_ns, uint8_t msDiv, SI5351_RfPlan_t *pPlan);
+/** Start, or retune without glitches; on an I2C error the outputs stay off and false is returned */
+bool Drv_SI5351_SetComplementaryPWM(uint16_t frequency_khz, uint16_t dead_time_ns);
+void Drv_SI5351_StopComplementaryPWM(void);
+/** Setting in force, NULL while stopped */
+const SI5351_RfPlan_t *Drv_SI5351_GetRfPlan(void);
+const SI5351_RfStats_t *Drv_SI5351_GetRfStats(void);
 
 
 #ifdef __cplusplus
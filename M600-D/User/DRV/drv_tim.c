@@ -3,18 +3,25 @@
  * @brief    : Timer driver - DRV calls DAL, DAL calls BSP (Std lib)
  ***********************************************************************************/
 #include "drv_tim.h"
+#include "drv_protect.h"
 #include "bsp_tim.h"
 
 #define BSP_TIM4_PERIOD  65535u
 
+/* Held at 0 while the foot release cut stands (Drv_Protect_ReleaseCut zeroes both again) */
 static void Dal_TIM4_SetCompare3(uint16_t pulse)
 {
-    BSP_TIM4_SetCompare3(pulse);
+    BSP_TIM4_SetCompare3(Drv_Protect_IsCut() ? 0 : pulse);
 }
 
 static void Dal_TIM4_SetCompare4(uint16_t pulse)
 {
-    BSP_TIM4_SetCompare4(pulse);
+    BSP_TIM4_SetCompare4(Drv_Protect_IsCut() ? 0 : pulse);
+}
+
+static void Dal_TIM7_SetFan(uint8_t on_slots)
+{
+    BSP_TIM7_FanSet(on_slots);
 }
 
 void Drv_TIM4_SetCompare3(uint16_t pulse)
@@ -36,3 +43,16 @@ void Drv_TIM4_SetESW_N(bool state)
 {
     Dal_TIM4_SetCompare4(state ? BSP_TIM4_PERIOD : 0);
 }
+
+uint16_t Drv_TIM7_SetFanDuty(uint16_t permille)
+{
+    uint32_t slots;
+
+    if(permille > 1000u)
+    {
+        permille = 1000u;
+    }
+    slots = ((uint32_t)permille * BSP_TIM7_FAN_SLOTS + 500u) / 1000u;
+    Dal_TIM7_SetFan((uint8_t)slots);
+    return (uint16_t)(slots * 1000u / BSP_TIM7_FAN_SLOTS);
+}
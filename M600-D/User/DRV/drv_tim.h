@@ -1,11 +1,10 @@
 /************************************************************************************
  * @file     : drv_tim.h
- * @brief    : Timer driver - DRV API, DAL calls BSP (Std lib). TIM4 CH3/CH4 for ESW.
+ * @brief    : Timer driver - DRV API, DAL calls BSP (Std lib). TIM4 CH3/CH4 for ESW, TIM7 for the fan.
  ***********************************************************************************/
 #ifndef DRV_TIM_H
 #define DRV_TIM_H
 
-#include "stm32f10x.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -17,6 +16,8 @@ void Drv_TIM4_SetCompare3(uint16_t pulse);
 void Drv_TIM4_SetCompare4(uint16_t pulse);
 void Drv_TIM4_SetESW_P(bool state);   /* TIM4_CH3: high = 65535, low = 0 */
 void Drv_TIM4_SetESW_N(bool state);   /* TIM4_CH4: high = 65535, low = 0 */
+/** Fan duty in permille, rounded to the 2.5 % PWM step; returns the duty applied */
+uint16_t Drv_TIM7_SetFanDuty(uint16_t permille);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,449 @@
+/************************************************************************************
+ * @file     : drv_trace.c
+ * @brief    : Sensor/command trace recorder and replay - DRV calls DAL, DAL calls BSP (Std lib)
+ ***********************************************************************************/
+#include "drv_trace.h"
+#include "bsp_delay.h"
+#include <stddef.h>
+#include <string.h>
+
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1u)
+#define TRACE_FRAME_MASK    (TRACE_FRAME_QUEUE - 1u)
+
+typedef struct {
+    uint8_t len;
+    uint8_t buf[TRACE_FRAME_MAX];
+} Trace_Frame_t;
+
+static Trace_Record_t s_ring[TRACE_RING_SIZE];
+static volatile uint16_t s_head = 0;
+static volatile uint16_t s_count = 0;
+static volatile Trace_Mode_EnumDef s_mode = E_TRACE_MODE_OFF;
+static Trace_Stats_t s_stats;
+
+/* Record side: last logged value per seam, so unchanged samples cost one compare */
+static uint16_t s_adcLast[E_ADC_CHANNEL_MAX];
+static uint32_t s_adcSeen = 0;
+static uint8_t s_inputLast = 0;
+static bool s_inputSeen = false;
+
+/* Inputs as they stood before the oldest record still in the ring */
+static uint16_t s_baseAdc[E_ADC_CHANNEL_MAX];
+static uint32_t s_baseAdcValid = 0;
+static uint8_t s_baseInput = 0;
+static bool s_baseInputValid = false;
+
+/* Replay side: inputs are applied on the recorded time base, outputs are matched in order */
+static uint16_t s_inCursor = 0;
+static uint16_t s_outCursor = 0;
+static uint32_t s_replayBaseTick = 0;
+static uint32_t s_replayStartTick = 0;
+static bool s_replayAnchored = false;
+static uint16_t s_replayAdc[E_ADC_CHANNEL_MAX];
+static uint32_t s_replayAdcValid = 0;
+static uint8_t s_replayInput = 0;
+static bool s_replayInputValid = false;
+static uint8_t s_replayEdges = 0;
+static Trace_Frame_t s_frameQ[TRACE_FRAME_QUEUE];
+static uint8_t s_frameHead = 0;
+static uint8_t s_frameCount = 0;
+static bool s_frameOpen = false;     /* tail slot is being filled from FRAME_DATA */
+
+/* DAL: only called from DRV; calls BSP */
+static uint32_t Dal_Trace_GetTick(void)
+{
+    return BSP_GetTick_ms();
+}
+
+static uint32_t Dal_Trace_GetCycles(void)
+{
+    return BSP_GetCycles();
+}
+
+static uint32_t Dal_Trace_Lock(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    return primask;
+}
+
+static void Dal_Trace_Unlock(uint32_t primask)
+{
+    __set_PRIMASK(primask);
+}
+
+static const Trace_Record_t* Trace_At(uint16_t index)
+{
+    return &s_ring[(uint16_t)(s_head - s_count + index) & TRACE_RING_MASK];
+}
+
+static bool Trace_IsOutput(uint8_t type)
+{
+    return type >= E_TRACE_REC_PIN && type < E_TRACE_REC_MAX;
+}
+
+/* Fold a record about to be overwritten into the base state */
+static void Trace_Evict(const Trace_Record_t *pRec)
+{
+    if (pRec->type == E_TRACE_REC_ADC && pRec->arg < E_ADC_CHANNEL_MAX) {
+        s_baseAdc[pRec->arg] = pRec->value;
+        s_baseAdcValid |= 1u << pRec->arg;
+    } else if (pRec->type == E_TRACE_REC_INPUT) {
+        s_baseInput = (uint8_t)pRec->value;
+        s_baseInputValid = true;
+    }
+}
+
+static void Trace_Put(uint8_t type, uint8_t arg, uint16_t value)
+{
+    uint32_t t0 = Dal_Trace_GetCycles();
+    uint32_t primask = Dal_Trace_Lock();
+    Trace_Record_t *pRec = &s_ring[s_head];
+
+    if (s_count == TRACE_RING_SIZE)
+        Trace_Evict(pRec);
+    pRec->tick_ms = Dal_Trace_GetTick();
+    pRec->type = type;
+    pRec->arg = arg;
+    pRec->value = value;
+    s_head = (uint16_t)((s_head + 1u) & TRACE_RING_MASK);
+    if (s_count < TRACE_RING_SIZE)
+        s_count++;
+    else
+        s_stats.overwritten++;
+    s_stats.records++;
+    s_stats.cycles += Dal_Trace_GetCycles() - t0;
+    Dal_Trace_Unlock(primask);
+}
+
+static Trace_Frame_t* Trace_FrameTail(void)
+{
+    return &s_frameQ[(uint8_t)(s_frameHead + s_frameCount) & TRACE_FRAME_MASK];
+}
+
+static void Trace_FrameClose(void)
+{
+    s_frameCount++;
+    s_frameOpen = false;
+}
+
+/*
+ * Apply every input record whose tick has been reached. Caller holds the lock.
+ * Stops at a frame while the queue is full, so frames are never dropped; a
+ * FRAME_DATA record whose FRAME was overwritten by the wrap is skipped.
+ */
+static void Trace_ReplayAdvance(void)
+{
+    uint32_t now;
+
+    /* Wrapped ring: anchor on the first seam call so replay keeps the recorded loop phase */
+    if (!s_replayAnchored) {
+        s_replayStartTick = Dal_Trace_GetTick();
+        s_replayAnchored = true;
+    }
+    now = Dal_Trace_GetTick() - s_replayStartTick + s_replayBaseTick;
+
+    while (s_inCursor < s_count) {
+        const Trace_Record_t *pRec = Trace_At(s_inCursor);
+        if ((int32_t)(pRec->tick_ms - now) > 0)
+            break;
+        switch (pRec->type) {
+            case E_TRACE_REC_ADC:
+                if (pRec->arg < E_ADC_CHANNEL_MAX) {
+                    s_replayAdc[pRec->arg] = pRec->value;
+                    s_replayAdcValid |= 1u << pRec->arg;
+                }
+                break;
+            case E_TRACE_REC_INPUT:
+                s_replayInput = (uint8_t)pRec->value;
+                s_replayInputValid = true;
+                break;
+            case E_TRACE_REC_EDGE:
+                s_replayEdges |= (uint8_t)pRec->value;
+                break;
+            case E_TRACE_REC_FRAME: {
+                Trace_Frame_t *pFrame;
+                if (s_frameCount >= TRACE_FRAME_QUEUE)
+                    return;
+                pFrame = Trace_FrameTail();
+                pFrame->len = pRec->arg;
+                pFrame->buf[0] = (uint8_t)pRec->value;
+                pFrame->buf[1] = (uint8_t)(pRec->value >> 8);
+                s_frameOpen = true;
+                if (pFrame->len <= 2u)
+                    Trace_FrameClose();
+                break;
+            }
+            case E_TRACE_REC_FRAME_DATA:
+                if (s_frameOpen && (uint16_t)pRec->arg + 1u < TRACE_FRAME_MAX) {
+                    Trace_Frame_t *pFrame = Trace_FrameTail();
+                    pFrame->buf[pRec->arg] = (uint8_t)pRec->value;
+                    pFrame->buf[pRec->arg + 1u] = (uint8_t)(pRec->value >> 8);
+                    if ((uint16_t)pRec->arg + 2u >= pFrame->len)
+                        Trace_FrameClose();
+                }
+                break;
+            default:
+                break;
+        }
+        s_inCursor++;
+    }
+}
+
+bool Drv_Trace_Start(Trace_Mode_EnumDef mode)
+{
+    uint32_t primask;
+
+    if (mode >= E_TRACE_MODE_MAX)
+        return false;
+    if (mode == E_TRACE_MODE_REPLAY && s_count == 0)
+        return false;
+
+    primask = Dal_Trace_Lock();
+    if (mode == E_TRACE_MODE_RECORD) {
+        s_head = 0;
+        s_count = 0;
+        s_adcSeen = 0;
+        s_inputSeen = false;
+        s_baseAdcValid = 0;
+        s_baseInputValid = false;
+        memset(&s_stats, 0, sizeof(s_stats));
+        /* Start marker: replay of an unwrapped ring starts on the recorded start tick */
+        Trace_Put(E_TRACE_REC_NONE, 0, 0);
+    } else if (mode == E_TRACE_MODE_REPLAY) {
+        s_inCursor = 0;
+        s_outCursor = 0;
+        s_replayBaseTick = Trace_At(0)->tick_ms;
+        s_replayStartTick = Dal_Trace_GetTick();
+        s_replayAnchored = (Trace_At(0)->type == E_TRACE_REC_NONE);
+        memcpy(s_replayAdc, s_baseAdc, sizeof(s_replayAdc));
+        s_replayAdcValid = s_baseAdcValid;
+        s_replayInput = s_baseInput;
+        s_replayInputValid = s_baseInputValid;
+        s_replayEdges = 0;
+        s_frameHead = 0;
+        s_frameCount = 0;
+        s_frameOpen = false;
+        s_stats.mismatches = 0;
+        s_stats.firstMismatch = 0;
+    }
+    s_mode = mode;
+    Dal_Trace_Unlock(primask);
+    return true;
+}
+
+void Drv_Trace_Stop(void)
+{
+    s_mode = E_TRACE_MODE_OFF;
+}
+
+Trace_Mode_EnumDef Drv_Trace_GetMode(void)
+{
+    return s_mode;
+}
+
+bool Drv_Trace_IsReplayDone(void)
+{
+    return s_inCursor >= s_count && s_outCursor >= s_count;
+}
+
+const Trace_Stats_t* Drv_Trace_GetStats(void)
+{
+    return &s_stats;
+}
+
+uint16_t Drv_Trace_GetCount(void)
+{
+    return s_count;
+}
+
+/** Copy records oldest-first starting at index first; returns records copied. */
+uint16_t Drv_Trace_Copy(uint16_t first, Trace_Record_t *pOut, uint16_t max)
+{
+    uint16_t n = 0;
+    uint32_t primask;
+
+    if (pOut == NULL)
+        return 0;
+    primask = Dal_Trace_Lock();
+    while (n < max && (uint16_t)(first + n) < s_count) {
+        pOut[n] = *Trace_At((uint16_t)(first + n));
+        n++;
+    }
+    Dal_Trace_Unlock(primask);
+    return n;
+}
+
+bool Drv_Trace_Load(const Trace_Record_t *pRecs, uint16_t n)
+{
+    uint32_t primask;
+
+    if (pRecs == NULL || n > TRACE_RING_SIZE)
+        return false;
+    primask = Dal_Trace_Lock();
+    s_mode = E_TRACE_MODE_OFF;
+    memcpy(s_ring, pRecs, n * sizeof(Trace_Record_t));
+    s_head = (uint16_t)(n & TRACE_RING_MASK);
+    s_count = n;
+    s_baseAdcValid = 0;
+    s_baseInputValid = false;
+    Dal_Trace_Unlock(primask);
+    return true;
+}
+
+/* Compare and update of the last value are one step: the seams are called from ISRs too */
+uint16_t Drv_Trace_RecordAdc(ADC_Channel_EnumDef channel, uint16_t raw)
+{
+    uint16_t last;
+    uint32_t primask;
+
+    if (s_mode != E_TRACE_MODE_RECORD || channel >= E_ADC_CHANNEL_MAX)
+        return raw;
+    primask = Dal_Trace_Lock();
+    last = s_adcLast[channel];
+    if (!(s_adcSeen & (1u << channel)) ||
+        (uint16_t)(raw > last ? raw - last : last - raw) > TRACE_ADC_DEADBAND) {
+        s_adcLast[channel] = raw;
+        s_adcSeen |= 1u << channel;
+        Trace_Put(E_TRACE_REC_ADC, (uint8_t)channel, raw);
+    } else {
+        raw = last;
+    }
+    Dal_Trace_Unlock(primask);
+    return raw;
+}
+
+bool Drv_Trace_ReplayAdc(ADC_Channel_EnumDef channel, uint16_t *pRaw)
+{
+    bool valid = false;
+    uint32_t primask;
+
+    if (s_mode != E_TRACE_MODE_REPLAY || channel >= E_ADC_CHANNEL_MAX || pRaw == NULL)
+        return false;
+    primask = Dal_Trace_Lock();
+    Trace_ReplayAdvance();
+    if (s_replayAdcValid & (1u << channel)) {
+        *pRaw = s_replayAdc[channel];
+        valid = true;
+    }
+    Dal_Trace_Unlock(primask);
+    return valid;
+}
+
+void Drv_Trace_RecordInput(uint8_t mask)
+{
+    uint32_t primask;
+
+    if (s_mode != E_TRACE_MODE_RECORD)
+        return;
+    primask = Dal_Trace_Lock();
+    if (!s_inputSeen || mask != s_inputLast) {
+        s_inputLast = mask;
+        s_inputSeen = true;
+        Trace_Put(E_TRACE_REC_INPUT, 0, mask);
+    }
+    Dal_Trace_Unlock(primask);
+}
+
+bool Drv_Trace_ReplayInput(uint8_t *pMask)
+{
+    bool valid;
+    uint32_t primask;
+
+    if (s_mode != E_TRACE_MODE_REPLAY || pMask == NULL)
+        return false;
+    primask = Dal_Trace_Lock();
+    Trace_ReplayAdvance();
+    valid = s_replayInputValid;
+    if (valid)
+        *pMask = s_replayInput;
+    Dal_Trace_Unlock(primask);
+    return valid;
+}
+
+void Drv_Trace_RecordEdges(uint8_t pending)
+{
+    if (s_mode != E_TRACE_MODE_RECORD || pending == 0)
+        return;
+    Trace_Put(E_TRACE_REC_EDGE, 0, pending);
+}
+
+/** Replay: edges whose tick has been reached, cleared as they are taken. */
+bool Drv_Trace_ReplayEdges(uint8_t *pPending)
+{
+    uint32_t primask;
+
+    if (s_mode != E_TRACE_MODE_REPLAY || pPending == NULL)
+        return false;
+    primask = Dal_Trace_Lock();
+    Trace_ReplayAdvance();
+    *pPending = s_replayEdges;
+    s_replayEdges = 0;
+    Dal_Trace_Unlock(primask);
+    return true;
+}
+
+/* One lock around the whole frame: an ISR record must not land between its parts */
+void Drv_Trace_RecordFrame(const uint8_t *pData, uint16_t len)
+{
+    uint8_t i;
+    uint32_t primask;
+
+    if (s_mode != E_TRACE_MODE_RECORD || pData == NULL || len == 0)
+        return;
+    if (len > TRACE_FRAME_MAX)
+        len = TRACE_FRAME_MAX;
+    primask = Dal_Trace_Lock();
+    Trace_Put(E_TRACE_REC_FRAME, (uint8_t)len, (uint16_t)(pData[0] | ((len > 1u ? pData[1] : 0u) << 8)));
+    for (i = 2; i < len; i += 2)
+        Trace_Put(E_TRACE_REC_FRAME_DATA, i, (uint16_t)(pData[i] | ((i + 1u < len ? pData[i + 1] : 0u) << 8)));
+    Dal_Trace_Unlock(primask);
+}
+
+/** Replay: fetch the oldest frame whose tick has been reached; returns its length or 0. */
+uint8_t Drv_Trace_PopFrame(uint8_t *pBuf, uint8_t size)
+{
+    uint8_t len = 0;
+    uint32_t primask;
+    const Trace_Frame_t *pFrame;
+
+    if (s_mode != E_TRACE_MODE_REPLAY || pBuf == NULL)
+        return 0;
+    primask = Dal_Trace_Lock();
+    Trace_ReplayAdvance();
+    if (s_frameCount > 0) {
+        pFrame = &s_frameQ[s_frameHead];
+        len = (pFrame->len < size) ? pFrame->len : size;
+        memcpy(pBuf, pFrame->buf, len);
+        s_frameHead = (uint8_t)((s_frameHead + 1u) & TRACE_FRAME_MASK);
+        s_frameCount--;
+    }
+    Dal_Trace_Unlock(primask);
+    return len;
+}
+
+bool Drv_Trace_Output(Trace_RecType_EnumDef type, uint8_t arg, uint16_t value)
+{
+    uint32_t primask;
+    const Trace_Record_t *pRec;
+
+    if (s_mode == E_TRACE_MODE_RECORD) {
+        Trace_Put((uint8_t)type, arg, value);
+        return false;
+    }
+    if (s_mode != E_TRACE_MODE_REPLAY)
+        return false;
+
+    primask = Dal_Trace_Lock();
+    while (s_outCursor < s_count && !Trace_IsOutput(Trace_At(s_outCursor)->type))
+        s_outCursor++;
+    pRec = (s_outCursor < s_count) ? Trace_At(s_outCursor) : NULL;
+    if (pRec == NULL || pRec->type != type || pRec->arg != arg || pRec->value != value) {
+        if (s_stats.mismatches++ == 0)
+            s_stats.firstMismatch = s_outCursor;
+    }
+    if (pRec != NULL)
+        s_outCursor++;
+    Dal_Trace_Unlock(primask);
+    return true;
+}
@@ -0,0 +1,101 @@
+/************************************************************************************
+ * @file     : drv_trace.h
+ * @brief    : Sensor/command trace recorder and replay - DRV API, DAL calls BSP (Std lib)
+ * @details  : Fixed 8-byte records in a RAM ring written at the Dal_* seams: ADC
+ *             samples, raw input mask, EXTI edges, received protocol frames (inputs) and
+ *             output pins, channel switches, DAC targets (outputs). The record tick
+ *             stands in for Dal_GetTick. Recording overwrites the oldest records and
+ *             is cheap enough to stay enabled.
+ *             While recording, an ADC sample within TRACE_ADC_DEADBAND of the last
+ *             recorded one is handed to the firmware as that one: a quiet channel costs
+ *             no records, and the firmware runs on exactly what replay feeds back.
+ *             Records pushed out of the ring are folded into a base state (last ADC
+ *             value per channel, input mask), so a wrapped ring replays from the inputs
+ *             as they stood at its oldest record.
+ *             Replay feeds input records back through the same seams on the
+ *             recorded time base and compares every output against the recorded
+ *             sequence. Pin and channel writes are not driven to hardware in replay;
+ *             recorded edges are handed to the debouncer on the tick, live ones are dropped.
+ ***********************************************************************************/
+#ifndef DRV_TRACE_H
+#define DRV_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "drv_adc.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TRACE_RING_SIZE         2048u  /* records, power of 2 (16 KB RAM): ~20 s of shooting */
+#define TRACE_ADC_DEADBAND      4u     /* raw LSB, ~3 mV: held while recording, see above */
+#define TRACE_FRAME_MAX         64u    /* bytes kept per protocol frame */
+#define TRACE_FRAME_QUEUE       4u     /* replay: frames due in one pass */
+
+typedef enum {
+    E_TRACE_MODE_OFF = 0,
+    E_TRACE_MODE_RECORD,
+    E_TRACE_MODE_REPLAY,
+    E_TRACE_MODE_MAX,
+} Trace_Mode_EnumDef;
+
+typedef enum {
+    E_TRACE_REC_NONE = 0,       /* recording start marker */
+    /* inputs */
+    E_TRACE_REC_ADC,            /* arg: ADC_Channel_EnumDef, value: raw */
+    E_TRACE_REC_INPUT,          /* value: raw input mask, on change */
+    E_TRACE_REC_FRAME,          /* arg: length, value: bytes 0..1 */
+    E_TRACE_REC_FRAME_DATA,     /* arg: offset, value: two bytes */
+    E_TRACE_REC_EDGE,           /* value: EXTI pending mask (input bits) */
+    /* outputs */
+    E_TRACE_REC_PIN,            /* arg: GPIO_Output_EnumDef, value: level */
+    E_TRACE_REC_CHANNEL,        /* arg: IODevice_Channel_EnumDef */
+    E_TRACE_REC_DAC,            /* value: target mV */
+    E_TRACE_REC_MAX,
+} Trace_RecType_EnumDef;
+
+typedef struct {
+    uint32_t tick_ms;           /* BSP tick when recorded */
+    uint8_t type;               /* Trace_RecType_EnumDef */
+    uint8_t arg;
+    uint16_t value;
+} Trace_Record_t;
+
+typedef struct {
+    uint32_t records;           /* records written since last record start */
+    uint32_t overwritten;       /* oldest records lost to wrap */
+    uint32_t cycles;            /* CPU cycles spent writing records */
+    uint32_t mismatches;        /* replay: outputs that differed from the trace */
+    uint32_t firstMismatch;     /* replay: record index of the first difference */
+} Trace_Stats_t;
+
+bool Drv_Trace_Start(Trace_Mode_EnumDef mode);
+void Drv_Trace_Stop(void);
+Trace_Mode_EnumDef Drv_Trace_GetMode(void);
+bool Drv_Trace_IsReplayDone(void);
+const Trace_Stats_t* Drv_Trace_GetStats(void);
+uint16_t Drv_Trace_GetCount(void);
+uint16_t Drv_Trace_Copy(uint16_t first, Trace_Record_t *pOut, uint16_t max);
+/** Replace the ring with records copied out of another run (no base state); stops the trace. */
+bool Drv_Trace_Load(const Trace_Record_t *pRecs, uint16_t n);
+
+/* Input seams: record mode logs the value; replay returns true with the replayed value */
+/** Returns the sample the firmware uses: raw, or the last recorded one within the deadband. */
+uint16_t Drv_Trace_RecordAdc(ADC_Channel_EnumDef channel, uint16_t raw);
+bool Drv_Trace_ReplayAdc(ADC_Channel_EnumDef channel, uint16_t *pRaw);
+void Drv_Trace_RecordInput(uint8_t mask);
+bool Drv_Trace_ReplayInput(uint8_t *pMask);
+void Drv_Trace_RecordEdges(uint8_t pending);
+bool Drv_Trace_ReplayEdges(uint8_t *pPending);
+void Drv_Trace_RecordFrame(const uint8_t *pData, uint16_t len);
+uint8_t Drv_Trace_PopFrame(uint8_t *pBuf, uint8_t size);
+
+/** Output seam: records or compares; returns true when the hardware write must be skipped. */
+bool Drv_Trace_Output(Trace_RecType_EnumDef type, uint8_t arg, uint16_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DRV_TRACE_H */
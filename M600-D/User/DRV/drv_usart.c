@@ -93,6 +93,20 @@ void Drv_USART1_Rx(void)
     DMA_Cmd(DMA1_Channel5, ENABLE);
 }
 
+/* 主循环取出已接收字节（IDLE中断写入，单生产者/单消费者） */
+uint16_t Drv_USART1_Read(uint8_t *pBuf, uint16_t max)
+{
+    uint32_t len = CBuff_GetLength(&s_USART1_RxBuffer);
+
+    if (pBuf == NULL)
+        return 0;
+    if (len > max)
+        len = max;
+    if (len == 0 || !CBuff_Pop(&s_USART1_RxBuffer, pBuf, len))
+        return 0;
+    return (uint16_t)len;
+}
+
 void Drv_USART2_Rx(void)
 {
     // 停止DMA接收（防止数据被覆盖）
@@ -5,7 +5,6 @@
 #ifndef DRV_USART_H
 #define DRV_USART_H
 
-#include "stm32f10x.h"
 #include <stdint.h>
 #include "stdbool.h"
 
@@ -19,6 +18,7 @@ extern "C" {
 void Drv_USART1_Send(const uint8_t *pData, uint32_t Len);
 void Drv_USART2_Send(const uint8_t *pData, uint32_t Len);
 void Drv_USART1_Rx(void);
+uint16_t Drv_USART1_Read(uint8_t *pBuf, uint16_t max);
 bool Drv_GetUSART1_DMA_SendStatus(void);
 bool Drv_GetUSART2_DMA_SendStatus(void);
 void Drv_Uart_init(void);
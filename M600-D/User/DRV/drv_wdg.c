@@ -4,7 +4,8 @@
  ***********************************************************************************/
 #include "drv_wdg.h"
 #include "bsp_iwdg.h"
-#include "stm32f10x_rcc.h"
+#include "drv_blackbox.h"
+#include "stm32f10x.h"
 
 static void Dal_WDG_Init(void)
 {
@@ -27,9 +28,9 @@ void Drv_WatchDogFeed(void)
     Dal_WDG_Feed();
 }
 
-void Drv_WatchDogResartCheck(void)
+/* resetFlags: RCC_CSR as latched by Drv_BlackBox_Init; the flags are already cleared */
+void Drv_WatchDogResartCheck(uint32_t resetFlags)
 {
-    if (RCC_GetFlagStatus(RCC_FLAG_IWDGRST) != RESET) {
-        RCC_ClearFlag();
-    }
+    if (resetFlags & RCC_CSR_IWDGRSTF)
+        Drv_BlackBox_Record(E_BB_EVT_WDG_RESET, 0, 0);
 }
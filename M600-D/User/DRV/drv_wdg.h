@@ -5,7 +5,6 @@
 #ifndef DRV_WDG_H
 #define DRV_WDG_H
 
-#include "stm32f10x.h"
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -14,7 +13,8 @@ extern "C" {
 
 uint8_t Drv_WatchDog_Init(void);
 void Drv_WatchDogFeed(void);
-void Drv_WatchDogResartCheck(void);
+/** resetFlags: RCC_CSR latched at boot (Drv_BlackBox_Init) */
+void Drv_WatchDogResartCheck(uint32_t resetFlags);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,108 @@
+/**
+* Copyright (c) 2023, AstroCeta, Inc. All rights reserved.
+* \file lib_seqlock.c
+* \brief Sequence lock for single-writer shared state with versioned snapshots.
+* \date 2025-07-30
+* \author AstroCeta, Inc.
+**/
+#include "lib_seqlock.h"
+
+/* Single core: only the compiler may reorder the data copy around Seq */
+#if defined(__CC_ARM)
+#define SEQLOCK_BARRIER()   __schedule_barrier()
+#else
+#define SEQLOCK_BARRIER()   __asm volatile ("" ::: "memory")
+#endif
+
+/**
+* @brief Init the sequence lock.
+* @param lock: Pointer to the lock.
+* @return None.
+**/
+void SeqLock_Init(SeqLock_t *lock)
+{
+    lock->Seq = 0;
+}
+
+/**
+* @brief Open a write section; readers retry until SeqLock_WriteEnd.
+* @param lock: Pointer to the lock.
+* @return None.
+**/
+void SeqLock_WriteBegin(SeqLock_t *lock)
+{
+    lock->Seq++;
+    SEQLOCK_BARRIER();
+}
+
+/**
+* @brief Close a write section and publish a new version.
+* @param lock: Pointer to the lock.
+* @return None.
+**/
+void SeqLock_WriteEnd(SeqLock_t *lock)
+{
+    SEQLOCK_BARRIER();
+    lock->Seq++;
+}
+
+/**
+* @brief Write a field only when its value changed.
+* @param lock: Pointer to the lock guarding pDst.
+* @param pDst: Field in the shared state.
+* @param pSrc: New value.
+* @param len: Field size in bytes.
+* @return true if the value changed and a new version was published.
+**/
+bool SeqLock_Update(SeqLock_t *lock, void *pDst, const void *pSrc, uint32_t len)
+{
+    if (memcmp(pDst, pSrc, len) == 0)
+        return false;
+
+    SeqLock_WriteBegin(lock);
+    memcpy(pDst, pSrc, len);
+    SeqLock_WriteEnd(lock);
+    return true;
+}
+
+/**
+* @brief Take a consistent snapshot if the version differs from *pVersion.
+* @param lock: Pointer to the lock guarding pSrc.
+* @param pDst: Snapshot destination.
+* @param pSrc: Shared state.
+* @param len: Size in bytes.
+* @param pVersion: In: version the caller holds. Out: version copied.
+* @return true if a newer snapshot was copied; false if unchanged or a write was in progress.
+**/
+bool SeqLock_Read(const SeqLock_t *lock, void *pDst, const void *pSrc, uint32_t len, uint32_t *pVersion)
+{
+    uint32_t seq;
+    uint32_t retry;
+
+    for (retry = 0; retry < SEQLOCK_READ_RETRY; retry++) {
+        seq = lock->Seq;
+        if (seq & 1u)
+            continue;
+        if ((seq >> 1) == *pVersion)
+            return false;
+        SEQLOCK_BARRIER();
+        memcpy(pDst, pSrc, len);
+        SEQLOCK_BARRIER();
+        if (lock->Seq == seq) {
+            *pVersion = seq >> 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* @brief Get the current version.
+* @param lock: Pointer to the lock.
+* @return Number of completed writes since init.
+**/
+uint32_t SeqLock_GetVersion(const SeqLock_t *lock)
+{
+    return lock->Seq >> 1;
+}
+/**************************End of file********************************/
@@ -0,0 +1,42 @@
+/**
+* Copyright (c) 2023, AstroCeta, Inc. All rights reserved.
+* \file lib_seqlock.h
+* \brief Sequence lock for single-writer shared state with versioned snapshots.
+* \date 2025-07-30
+* \author AstroCeta, Inc.
+**/
+#ifndef LIB_SEQLOCK_H
+#define LIB_SEQLOCK_H
+
+#include <string.h>
+#include <stdbool.h>
+#include "stdint.h"
+
+#ifdef __cplusplus
+#include <iostream>
+extern "C" {
+#endif
+
+/* Bounded retries so a reader in an ISR never spins on a writer it preempted */
+#define SEQLOCK_READ_RETRY      4u
+
+/*
+ * Seq is odd while a write is in progress; Seq / 2 is the version.
+ * One writer context per lock (main loop or one ISR); readers may be anywhere.
+ */
+typedef struct {
+    volatile uint32_t Seq;
+} SeqLock_t;
+
+void SeqLock_Init(SeqLock_t *lock);
+void SeqLock_WriteBegin(SeqLock_t *lock);
+void SeqLock_WriteEnd(SeqLock_t *lock);
+bool SeqLock_Update(SeqLock_t *lock, void *pDst, const void *pSrc, uint32_t len);
+bool SeqLock_Read(const SeqLock_t *lock, void *pDst, const void *pSrc, uint32_t len, uint32_t *pVersion);
+uint32_t SeqLock_GetVersion(const SeqLock_t *lock);
+
+#ifdef __cplusplus
+}
+#endif
+#endif  // LIB_SEQLOCK_H
+/**************************End of file********************************/
@@ -4,6 +4,8 @@
 #include <stdarg.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
 #include "app_system.h"
 
 #if LOG_USE_RTT
@@ -20,7 +22,35 @@ static char log_buf[LOG_BUF_SIZE];
 static uint32_t Log_TimeStamp=0;
 static LogFun_Def LogFunList[10];
 
+uint8_t Log_DomainLevel[LOG_DOMAIN_MAX] =
+{
+    LOG_GLOBAL_LEVEL, LOG_GLOBAL_LEVEL, LOG_GLOBAL_LEVEL, LOG_GLOBAL_LEVEL,
+    LOG_GLOBAL_LEVEL, LOG_GLOBAL_LEVEL, LOG_GLOBAL_LEVEL, LOG_GLOBAL_LEVEL,
+};
+
+static const char * const s_DomainName[LOG_DOMAIN_MAX] =
+{
+    "COMM", "US", "RF", "SW", "NPH", "MEM", "DRV", "SYS",
+};
+
+// 限流：按调用点（格式串地址）计数，格式化之前判定
+typedef struct
+{
+    const char *fmt;            // NULL为空闲
+    uint32_t start;             // 窗口起点
+    uint16_t count;             // 本窗口已输出
+    uint16_t suppressed;        // 本窗口被抑制
+    uint8_t level;
+    uint8_t domain;
+} LogRate_Slot;
+
+static LogRate_Slot s_RateSlot[LOG_RATE_SLOTS];
+static uint8_t s_RateBurst = LOG_RATE_BURST;
+static uint32_t s_SuppressedTotal = 0;
+static bool s_InCommand = false;        // 命令回显整段输出，不限流
+
 void Log_LoopFun(char *data);
+static void Log_LevelFun(char *data);
 
 int Log_UART_Transmit(uint8_t *data, uint16_t len) {
 #if LOG_USE_UART
@@ -42,6 +72,7 @@ void Log_Init(void) {
 #endif
     SEGGER_RTT_printf(0, "[info] Log System Initialized\r\n");
     Log_RegisterFunction("loop", Log_LoopFun);
+    Log_RegisterFunction("log", Log_LevelFun);
 }
 
 static void Log_Output(const char *str, uint16_t len) {
@@ -54,10 +85,7 @@ static void Log_Output(const char *str, uint16_t len) {
 #endif
 }
 
-void Log_Printf(uint8_t level, const char *file, int line, const char *fmt, ...) {
-    if (level > LOG_GLOBAL_LEVEL) return;
-
-    va_list args;
+static void Log_VPrintf(uint8_t level, uint8_t domain, const char *file, int line, const char *fmt, va_list args) {
     int offset = 0;
 
     const char *tag = "UNK";
@@ -91,7 +119,7 @@ void Log_Printf(uint8_t level, const char *file, int line, const char *fmt, ...)
 #endif
 
     // 标签
-    offset += snprintf(log_buf + offset, LOG_BUF_SIZE - offset, "[%s] ", tag);
+    offset += snprintf(log_buf + offset, LOG_BUF_SIZE - offset, "[%s] [%s] ", tag, s_DomainName[domain]);
 
     // 文件信息 (可选)
 #if LOG_ENABLE_FILE_INFO
@@ -105,9 +133,11 @@ void Log_Printf(uint8_t level, const char *file, int line, const char *fmt, ...)
 
     // 3. 格式化用户内容
     if (offset < LOG_BUF_SIZE) {
-        va_start(args, fmt);
         offset += vsnprintf(log_buf + offset, LOG_BUF_SIZE - offset, fmt, args);
-        va_end(args);
+    }
+    // 截断时vsnprintf返回的是完整长度
+    if (offset > LOG_BUF_SIZE - 1) {
+        offset = LOG_BUF_SIZE - 1;
     }
 
     // 4. 结尾处理 (颜色复位 + 换行)
@@ -125,6 +155,80 @@ void Log_Printf(uint8_t level, const char *file, int line, const char *fmt, ...)
     Log_Output(log_buf, offset);
 }
 
+// 不经等级和限流判定直接输出，用于汇总、Hex和命令回显
+static void Log_Raw(uint8_t level, uint8_t domain, const char *fmt, ...) {
+    va_list args;
+
+    va_start(args, fmt);
+    Log_VPrintf(level, domain, "", 0, fmt, args);
+    va_end(args);
+}
+
+static void Log_RateFlush(LogRate_Slot *pSlot) {
+    if (pSlot->suppressed != 0) {
+        Log_Raw(pSlot->level, pSlot->domain, "%d repeats suppressed: %s", pSlot->suppressed, pSlot->fmt);
+        pSlot->suppressed = 0;
+    }
+}
+
+/**
+ * @brief 同一调用点每窗口前s_RateBurst条放行；找不到空位时替换窗口最早的调用点；
+ *        RTT命令执行期间的输出是被请求的，全部放行
+ */
+static bool Log_RateAllow(uint8_t level, uint8_t domain, const char *fmt) {
+    uint32_t now = Drv_Delay_GetTickMs();
+    LogRate_Slot *pSlot = NULL;
+    LogRate_Slot *pOldest = &s_RateSlot[0];
+    uint8_t i;
+
+    if (s_RateBurst == 0 || s_InCommand) return true;
+    for (i = 0; i < LOG_RATE_SLOTS; i++) {
+        if (s_RateSlot[i].fmt == fmt) {
+            pSlot = &s_RateSlot[i];
+            break;
+        }
+        if (s_RateSlot[i].fmt == NULL) {
+            pOldest = &s_RateSlot[i];
+        } else if (pOldest->fmt != NULL && (int32_t)(s_RateSlot[i].start - pOldest->start) < 0) {
+            pOldest = &s_RateSlot[i];
+        }
+    }
+    if (pSlot == NULL) {
+        pSlot = pOldest;
+        if (pSlot->fmt != NULL) {
+            Log_RateFlush(pSlot);
+        }
+        pSlot->fmt = fmt;
+        pSlot->start = now;
+        pSlot->count = 0;
+        pSlot->suppressed = 0;
+    } else if (now - pSlot->start >= LOG_RATE_WINDOW_MS) {
+        Log_RateFlush(pSlot);
+        pSlot->start = now;
+        pSlot->count = 0;
+    }
+    pSlot->level = level;
+    pSlot->domain = domain;
+    if (pSlot->count < s_RateBurst) {
+        pSlot->count++;
+        return true;
+    }
+    if (pSlot->suppressed < 0xFFFFu) pSlot->suppressed++;
+    s_SuppressedTotal++;
+    return false;
+}
+
+void Log_Printf(uint8_t level, uint8_t domain, const char *file, int line, const char *fmt, ...) {
+    va_list args;
+
+    if (level > LOG_GLOBAL_LEVEL || domain >= LOG_DOMAIN_MAX || level > Log_DomainLevel[domain]) return;
+    if (!Log_RateAllow(level, domain, fmt)) return;
+
+    va_start(args, fmt);
+    Log_VPrintf(level, domain, file, line, fmt, args);
+    va_end(args);
+}
+
 // 十六进制打印工具
 void Log_Hex(uint8_t level, const char *tag, const void *data, uint16_t len) {
     if (level > LOG_GLOBAL_LEVEL) return;
@@ -133,7 +237,7 @@ void Log_Hex(uint8_t level, const char *tag, const void *data, uint16_t len) {
     char hex_buf[64]; // 临时行缓冲
     
     // 打印头部
-    Log_Printf(level, "", 0, "--- %s Hex Dump (%d bytes) ---", tag, len);
+    Log_Raw(level, LOG_DOMAIN_SYS, "--- %s Hex Dump (%d bytes) ---", tag, len);
     
     for (uint16_t i = 0; i < len; i += 16) {
         int n = 0;
@@ -160,7 +264,7 @@ void Log_Hex(uint8_t level, const char *tag, const void *data, uint16_t len) {
         n += snprintf(hex_buf + n, sizeof(hex_buf) - n, "|");
         
         // 直接输出这一行，不带前缀，保持整洁
-        Log_Printf(level, "", 0, "%s", hex_buf);
+        Log_Raw(level, LOG_DOMAIN_SYS, "%s", hex_buf);
     }
 }
 
@@ -168,7 +272,15 @@ void Log_Process(uint8_t taskTick) {
     static char LogCmd[256];
     static char KeyBuf[16];
     int GetKey;
+    uint32_t now = Drv_Delay_GetTickMs();
     Log_TimeStamp += taskTick;
+    // 窗口已结束的调用点输出汇总并释放，重复停止后汇总也能及时出来
+    for (uint8_t i = 0; i < LOG_RATE_SLOTS; i++) {
+        if (s_RateSlot[i].fmt != NULL && now - s_RateSlot[i].start >= LOG_RATE_WINDOW_MS) {
+            Log_RateFlush(&s_RateSlot[i]);
+            s_RateSlot[i].fmt = NULL;
+        }
+    }
     if (SEGGER_RTT_HasKey()) 
     {
         memset(LogCmd, 0, sizeof(LogCmd));
@@ -182,10 +294,10 @@ void Log_Process(uint8_t taskTick) {
             }
             LogCmd[idx++] = (char)GetKey;
         }
-        // 执行注册的函数
+        // 执行注册的函数，无参数的命令可不带空格
         uint8_t keyIndex = 0;
         bool found = true;
-        while(LogCmd[keyIndex] != ' ') {
+        while(LogCmd[keyIndex] != ' ' && LogCmd[keyIndex] != '\0') {
             KeyBuf[keyIndex] = LogCmd[keyIndex];
             keyIndex++;
             if (keyIndex >= sizeof(KeyBuf) - 1) {
@@ -197,7 +309,9 @@ void Log_Process(uint8_t taskTick) {
             KeyBuf[keyIndex] = '\0';
             for (uint8_t i = 0; i < 10; i++) {
                 if (LogFunList[i].isUsed && (strcmp(LogFunList[i].Fun_Name, KeyBuf) == 0)) {
+                    s_InCommand = true;
                     LogFunList[i].Fun_Def(&LogCmd[keyIndex+1]);
+                    s_InCommand = false;
                     break;
                 }
             }
@@ -225,5 +339,43 @@ void Log_LoopFun(char *data) {
     SEGGER_RTT_printf(0, "Log_LoopFun executed: %s\r\n", data);
 }
 
+static bool Log_NameEqual(const char *name, const char *input) {
+    while (*name != '\0' && toupper((unsigned char)*input) == *name) {
+        name++;
+        input++;
+    }
+    return *name == '\0' && *input == '\0';
+}
+
+/**
+ * @brief RTT command: log [<domain>|all <level>] [rate <n>]，等级0~4，无参数时显示当前设置
+ */
+static void Log_LevelFun(char *data) {
+    char *name = strtok(data, " ");
+    char *value = strtok(NULL, " ");
+    uint8_t level;
+    uint8_t i;
+
+    if (name != NULL && value != NULL) {
+        if (Log_NameEqual("RATE", name)) {
+            s_RateBurst = (uint8_t)strtoul(value, NULL, 10);
+        } else {
+            // 编译期已去掉高于LOG_GLOBAL_LEVEL的日志
+            level = (uint8_t)strtoul(value, NULL, 10);
+            if (level > LOG_GLOBAL_LEVEL) level = LOG_GLOBAL_LEVEL;
+            for (i = 0; i < LOG_DOMAIN_MAX; i++) {
+                if (Log_NameEqual("ALL", name) || Log_NameEqual(s_DomainName[i], name)) {
+                    Log_DomainLevel[i] = level;
+                }
+            }
+        }
+    }
+    for (i = 0; i < LOG_DOMAIN_MAX; i++) {
+        Log_Raw(LOG_LEVEL_INFO, LOG_DOMAIN_SYS, "Log %s: level %d", s_DomainName[i], Log_DomainLevel[i]);
+    }
+    Log_Raw(LOG_LEVEL_INFO, LOG_DOMAIN_SYS, "Log rate: %d per %d ms per call site, %d suppressed",
+            s_RateBurst, LOG_RATE_WINDOW_MS, s_SuppressedTotal);
+}
+
 
 /**************************End of file********************************/
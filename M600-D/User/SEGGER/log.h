@@ -25,11 +25,31 @@
 #define LOG_LEVEL_INFO          3
 #define LOG_LEVEL_DEBUG         4
 
-// 4. 当前全局日志等级
+// 4. 当前全局日志等级：编译期上限，也是各模块运行时等级的初值
 #ifndef LOG_GLOBAL_LEVEL
 #define LOG_GLOBAL_LEVEL        LOG_LEVEL_DEBUG     // 当前日志等级
 #endif
 
+// 5. 模块日志域：源文件在包含log.h之前定义LOG_DOMAIN，未定义的归入SYS
+#define LOG_DOMAIN_COMM         0
+#define LOG_DOMAIN_US           1
+#define LOG_DOMAIN_RF           2
+#define LOG_DOMAIN_SW           3
+#define LOG_DOMAIN_NPH          4
+#define LOG_DOMAIN_MEM          5
+#define LOG_DOMAIN_DRV          6
+#define LOG_DOMAIN_SYS          7
+#define LOG_DOMAIN_MAX          8
+
+#ifndef LOG_DOMAIN
+#define LOG_DOMAIN              LOG_DOMAIN_SYS
+#endif
+
+// 6. 限流：同一调用点每个窗口最多输出LOG_RATE_BURST条，其余只计数，窗口结束后输出汇总
+#define LOG_RATE_SLOTS          8       // 同时跟踪的调用点数
+#define LOG_RATE_WINDOW_MS      1000
+#define LOG_RATE_BURST          3       // 运行时可由 log rate <n> 修改，0为不限流
+
 /* =========================================== */
 
 // 颜色代码
@@ -53,7 +73,7 @@
 
 // 核心函数声明
 void Log_Init(void);
-void Log_Printf(uint8_t level, const char *file, int line, const char *fmt, ...);
+void Log_Printf(uint8_t level, uint8_t domain, const char *file, int line, const char *fmt, ...);
 void Log_Hex(uint8_t level, const char *tag, const void *data, uint16_t len);
 void Log_Process(uint8_t taskTick);
 // 串口发送接口 (需要在外部实现，例如在 main.c 或 usart.c 中)
@@ -68,30 +88,37 @@ typedef struct
     void   (*Fun_Def)(char *);
 }LogFun_Def;
 
+// 各模块运行时日志等级，宏在格式化和参数求值之前比较
+extern uint8_t Log_DomainLevel[LOG_DOMAIN_MAX];
+#define LOG_ENABLED(level)      ((level) <= Log_DomainLevel[LOG_DOMAIN])
 
 // 宏定义封装
 #if (LOG_GLOBAL_LEVEL >= LOG_LEVEL_ERROR)
-    #define LOG_E(fmt, ...) Log_Printf(LOG_LEVEL_ERROR, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define LOG_E(fmt, ...) do { if (LOG_ENABLED(LOG_LEVEL_ERROR)) \
+        Log_Printf(LOG_LEVEL_ERROR, LOG_DOMAIN, __FILE__, __LINE__, fmt, ##__VA_ARGS__); } while (0)
 #else
-    #define LOG_E(fmt, ...)
+    #define LOG_E(fmt, ...) do { } while (0)
 #endif
 
 #if (LOG_GLOBAL_LEVEL >= LOG_LEVEL_WARN)
-    #define LOG_W(fmt, ...) Log_Printf(LOG_LEVEL_WARN, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define LOG_W(fmt, ...) do { if (LOG_ENABLED(LOG_LEVEL_WARN)) \
+        Log_Printf(LOG_LEVEL_WARN, LOG_DOMAIN, __FILE__, __LINE__, fmt, ##__VA_ARGS__); } while (0)
 #else
-    #define LOG_W(fmt, ...)
+    #define LOG_W(fmt, ...) do { } while (0)
 #endif
 
 #if (LOG_GLOBAL_LEVEL >= LOG_LEVEL_INFO)
-    #define LOG_I(fmt, ...) Log_Printf(LOG_LEVEL_INFO, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define LOG_I(fmt, ...) do { if (LOG_ENABLED(LOG_LEVEL_INFO)) \
+        Log_Printf(LOG_LEVEL_INFO, LOG_DOMAIN, __FILE__, __LINE__, fmt, ##__VA_ARGS__); } while (0)
 #else
-    #define LOG_I(fmt, ...)
+    #define LOG_I(fmt, ...) do { } while (0)
 #endif
 
 #if (LOG_GLOBAL_LEVEL >= LOG_LEVEL_DEBUG)
-    #define LOG_D(fmt, ...) Log_Printf(LOG_LEVEL_DEBUG, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define LOG_D(fmt, ...) do { if (LOG_ENABLED(LOG_LEVEL_DEBUG)) \
+        Log_Printf(LOG_LEVEL_DEBUG, LOG_DOMAIN, __FILE__, __LINE__, fmt, ##__VA_ARGS__); } while (0)
 #else
-    #define LOG_D(fmt, ...)
+    #define LOG_D(fmt, ...) do { } while (0)
 #endif
 
 // Hex Dump 宏
@@ -22,18 +22,22 @@
 #include "stm32f10x.h"
 #include "app_system.h"
 #include "drv_init.h"
+#include "drv_boottime.h"
 
 int main(void)
 {
-    SystemInit();
+    /* SystemInit() already ran from Reset_Handler, running it again restarts HSE/PLL */
     SystemCoreClockUpdate();
+    Drv_BootTime_Start();
     NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);
 
     Drv_System_Init();   /* DAL -> BSP: GPIO, ADC, DAC, TIM, USART, I2C, SysTick */
+    Drv_BootTime_Mark(E_BOOT_PHASE_DRV);
 
     __disable_irq();
     System_Init();
     __enable_irq();
+    Drv_BootTime_Mark(E_BOOT_PHASE_SYSTEM);
 
     while (1)
     {
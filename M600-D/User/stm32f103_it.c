@@ -1,57 +1,108 @@
 /************************************************************************************
  * @file     : stm32f103_it.c
  * @brief    : M600-D interrupt handlers - ported from M600
- * @details  : Cortex fault + DMA1 Ch4/Ch5 (USART1 TX/RX) + DMA1 Ch6/Ch7 (USART2 RX/TX) + USART1/USART2 (IDLE). Std lib.
+ * @details  : Cortex fault + DMA1 Ch4/Ch5 (USART1 TX/RX) + DMA1 Ch6/Ch7 (USART2 RX/TX) + USART1/USART2 (IDLE)
+ *             + ADC1_2 (AWD over-current trip) + DMA1 Ch1 (ADC pair blocks -> energy meter, RTT scope)
+ *             + EXTI15_10 (foot / probe sync edges) + PVD (supply warning)
+ *             + DMA2 Ch3 (DAC ramp done). Std lib.
  ***********************************************************************************/
 #include "stm32f103_it.h"
 #include "stm32f10x_conf.h"
 #include "bsp_delay.h"
+#include "bsp_power.h"
+#include "bsp_adc.h"
+#include "drv_protect.h"
+#include "drv_iodevice.h"
+#include "drv_dac.h"
+#include "drv_usart.h"
+#include "drv_meter.h"
+#include "drv_scope.h"
+#include "drv_power.h"
 
 /* -----------------------------------------------------------------------------
  * Cortex-M3 exception handlers
  * ----------------------------------------------------------------------------- */
 
-void NMI_Handler(void)
+/* NMI / HardFault / MemManage / BusFault / UsageFault: cmb_fault.S
+ * (black-box snapshot, RTT backtrace, then reset) */
+
+void SVC_Handler(void)
 {
-    while (1) { }
 }
 
-//void HardFault_Handler(void)
-//{
-//    while (1) { }
-//}
+void DebugMon_Handler(void)
+{
+}
 
-void MemManage_Handler(void)
+void PendSV_Handler(void)
 {
-    while (1) { }
 }
 
-void BusFault_Handler(void)
+/* SysTick: 1ms tick for BSP_Delay / BSP_GetTick_ms, input debounce integrators */
+void SysTick_Handler(void)
 {
-    while (1) { }
+    BSP_SysTick_Inc();
+    Drv_IODevice_TickFromISR();
 }
 
-void UsageFault_Handler(void)
+/* -----------------------------------------------------------------------------
+ * ADC1_2 - analog watchdog (over-current). Outputs are cut inside the handler.
+ * ----------------------------------------------------------------------------- */
+void ADC1_2_IRQHandler(void)
 {
-    while (1) { }
+    if (ADC_GetITStatus(ADC1, ADC_IT_AWD) != RESET)
+    {
+        Drv_Protect_TripFromISR();
+        ADC_ClearITPendingBit(ADC1, ADC_IT_AWD);
+    }
+    if (ADC_GetITStatus(ADC2, ADC_IT_AWD) != RESET)
+    {
+        Drv_Protect_TripFromISR();
+        ADC_ClearITPendingBit(ADC2, ADC_IT_AWD);
+    }
 }
 
-void SVC_Handler(void)
+/* -----------------------------------------------------------------------------
+ * DMA1 Channel1 (ADC1+ADC2) - half ring filled, integrate it while DMA fills the other
+ * ----------------------------------------------------------------------------- */
+void DMA1_Channel1_IRQHandler(void)
 {
+    if (DMA_GetITStatus(DMA1_IT_HT1) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA1_IT_HT1);
+        Drv_Meter_BlockFromISR(BSP_ADC_GetBlock(0));
+        Drv_Scope_BlockFromISR(BSP_ADC_GetBlock(0));
+    }
+    if (DMA_GetITStatus(DMA1_IT_TC1) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA1_IT_TC1);
+        Drv_Meter_BlockFromISR(BSP_ADC_GetBlock(1));
+        Drv_Scope_BlockFromISR(BSP_ADC_GetBlock(1));
+    }
 }
 
-void DebugMon_Handler(void)
+/* -----------------------------------------------------------------------------
+ * EXTI15_10 - MCU_FOOT(PC14), IO_SYN_US/RF/ESW(PC10/11/12), both edges
+ * ----------------------------------------------------------------------------- */
+void EXTI15_10_IRQHandler(void)
 {
+    Drv_IODevice_EdgeFromISR();
 }
 
-void PendSV_Handler(void)
+/* -----------------------------------------------------------------------------
+ * RTC alarm (EXTI17) - STOP mode wake-up, the wake reason is read from EXTI->PR
+ * ----------------------------------------------------------------------------- */
+void RTCAlarm_IRQHandler(void)
 {
+    BSP_Power_AlarmFromISR();
 }
 
-/* SysTick: 1ms tick for BSP_Delay / BSP_GetTick_ms */
-void SysTick_Handler(void)
+/* -----------------------------------------------------------------------------
+ * PVD (EXTI16) - VDD below the warning level, the APP commits usage counters
+ * ----------------------------------------------------------------------------- */
+void PVD_IRQHandler(void)
 {
-    BSP_SysTick_Inc();
+    Drv_Power_PvdFromISR();
 }
 
 /* -----------------------------------------------------------------------------
@@ -62,7 +113,8 @@ void DMA1_Channel4_IRQHandler(void)
     if (DMA_GetITStatus(DMA1_IT_TC4) != RESET)
     {
         DMA_ClearITPendingBit(DMA1_IT_TC4);
-        /* Optional: user callback for TX complete */
+        /* Release the channel so BSP_USART1_DMA_TxStatus reports idle */
+        DMA_Cmd(DMA1_Channel4, DISABLE);
     }
     if (DMA_GetITStatus(DMA1_IT_TE4) != RESET)
         DMA_ClearITPendingBit(DMA1_IT_TE4);
@@ -127,8 +179,9 @@ void USART1_IRQHandler(void)
 {
     if (USART_GetITStatus(USART1, USART_IT_IDLE) != RESET)
     {
-        USART_ClearITPendingBit(USART1, USART_IT_IDLE);
-        /* Optional: frame end - process BSP_USART1_RxBuf, restart DMA, etc. */
+        /* IDLE is cleared by the SR read above followed by a DR read */
+        (void)USART_ReceiveData(USART1);
+        Drv_USART1_Rx();
     }
 }
 
@@ -143,3 +196,15 @@ void USART2_IRQHandler(void)
         /* Optional: frame end - process BSP_USART2_RxBuf, restart DMA, etc. */
     }
 }
+
+/* -----------------------------------------------------------------------------
+ * DMA2 Channel3 (DAC1 ramp) - last sample transferred
+ * ----------------------------------------------------------------------------- */
+void DMA2_Channel3_IRQHandler(void)
+{
+    if (DMA_GetITStatus(DMA2_IT_TC3) != RESET)
+    {
+        DMA_ClearITPendingBit(DMA2_IT_TC3);
+        Drv_DAC_RampDoneFromISR();
+    }
+}
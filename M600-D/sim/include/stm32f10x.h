@@ -0,0 +1,63 @@
+/************************************************************************************
+ * @file     : stm32f10x.h
+ * @brief    : Host simulator - device header wrapper (x86-64 Linux)
+ * @details  : Found before Libraries/CMSIS on the sim include path. Pulls in the real
+ *             stm32f10x.h and CMSIS 1.30 core_cm3.h with __GNUC__ hidden, so the Cortex-M3
+ *             inline asm intrinsics are skipped; the host versions below call into the sim
+ *             core (sim/sim_core.c). Peripheral and core register blocks keep their real
+ *             addresses, the sim maps host memory there before main().
+ ***********************************************************************************/
+#ifndef SIM_STM32F10X_H
+#define SIM_STM32F10X_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* ---------- Core intrinsics, sim/sim_core.c ---------- */
+/* Every intrinsic is a point where pending interrupts may be taken */
+void     __enable_irq(void);
+void     __disable_irq(void);
+void     __enable_fault_irq(void);
+void     __disable_fault_irq(void);
+void     __NOP(void);
+void     __WFI(void);
+void     __WFE(void);
+void     __SEV(void);
+void     __ISB(void);
+void     __DSB(void);
+void     __DMB(void);
+void     __CLREX(void);
+uint32_t __get_PRIMASK(void);
+void     __set_PRIMASK(uint32_t priMask);
+uint32_t __get_BASEPRI(void);
+void     __set_BASEPRI(uint32_t basePri);
+uint32_t __get_FAULTMASK(void);
+void     __set_FAULTMASK(uint32_t faultMask);
+uint32_t __get_CONTROL(void);
+void     __set_CONTROL(uint32_t control);
+uint32_t __get_PSP(void);
+void     __set_PSP(uint32_t topOfProcStack);
+uint32_t __get_MSP(void);
+void     __set_MSP(uint32_t topOfMainStack);
+uint32_t __REV(uint32_t value);
+uint32_t __REV16(uint16_t value);
+int32_t  __REVSH(int16_t value);
+uint32_t __RBIT(uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define __INLINE    inline
+#define __ASM       __asm
+
+#pragma push_macro("__GNUC__")
+#undef __GNUC__
+#include_next "stm32f10x.h"
+#pragma pop_macro("__GNUC__")
+
+#endif /* SIM_STM32F10X_H */
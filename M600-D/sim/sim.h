@@ -0,0 +1,169 @@
+/************************************************************************************
+ * @file     : sim.h
+ * @brief    : Host simulator - public API for the session runner and host tests
+ * @details  : The firmware (APP/DRV/LIB/BSP, StdPeriph, system file) is built unmodified
+ *             as a shared object and loaded once per boot, so every reset starts from
+ *             fresh statics. Peripheral and core registers live at their real addresses;
+ *             firmware accesses are trapped page-wise and handled by register-level
+ *             models (sim_*.c). Time is virtual: it advances with every intrinsic and
+ *             trapped access and jumps to the next event on WFI.
+ *             Two ways to run: Sim_Start() runs main() on its own stack and Sim_RunFor()
+ *             lets it go for a stretch of virtual time; without Sim_Start() the caller is
+ *             the CPU, may call firmware functions through SIM_FW() and Sim_RunFor() only
+ *             idles (timers fire, interrupts are taken).
+ ***********************************************************************************/
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SIM_NS(x)       ((uint64_t)(x))
+#define SIM_US(x)       ((uint64_t)(x) * 1000ull)
+#define SIM_MS(x)       ((uint64_t)(x) * 1000000ull)
+#define SIM_S(x)        ((uint64_t)(x) * 1000000000ull)
+
+typedef enum {
+    E_SIM_RESET_POWER = 0,      /* power-on: SRAM and .noinit lost */
+    E_SIM_RESET_SOFT,           /* SYSRESETREQ */
+    E_SIM_RESET_IWDG,           /* independent watchdog expired */
+    E_SIM_RESET_PIN,            /* NRST */
+} Sim_ResetCause;
+
+typedef enum {
+    E_SIM_STOP_TIME = 0,        /* Sim_RunFor period elapsed */
+    E_SIM_STOP_RESET,           /* firmware reset and Sim_SetAutoReboot(false) */
+    E_SIM_STOP_REQUEST,         /* Sim_RequestStop from a hook */
+} Sim_StopReason;
+
+/* ---------- Lifecycle ---------- */
+/** Map the MCU address space and install the traps; once per process. pImage: firmware .so */
+void Sim_Init(const char *pImage);
+/** Second image booted instead of pImage when present (bootloader); its branch into the
+ *  flash array (the application's reset vector) loads and starts pImage */
+void Sim_SetBootImage(const char *pBoot);
+/** Load the image(s) and reset all models; SystemInit() runs on the next Sim_RunFor */
+void Sim_Boot(Sim_ResetCause cause);
+/** Run main() on the firmware stack from the next Sim_RunFor on */
+void Sim_Start(void);
+Sim_StopReason Sim_RunFor(uint64_t ns);
+void Sim_RequestStop(void);
+/** Reboot by itself on a firmware reset (default) or return E_SIM_STOP_RESET */
+void Sim_SetAutoReboot(bool on);
+uint32_t Sim_GetResetCount(void);
+Sim_ResetCause Sim_GetLastReset(void);
+/** Called after each reboot, before SystemInit */
+void Sim_SetBootHook(void (*fn)(Sim_ResetCause cause));
+
+/* ---------- Time ---------- */
+uint64_t Sim_Now(void);
+/** One-shot callback in virtual time; re-arm from the callback for periodic work */
+typedef struct Sim_Timer {
+    uint64_t at;
+    void (*fn)(void *pCtx);
+    void *pCtx;
+    struct Sim_Timer *pNext;
+    bool armed;
+} Sim_Timer;
+void Sim_TimerStart(Sim_Timer *pTimer, uint64_t at, void (*fn)(void *pCtx), void *pCtx);
+void Sim_TimerStop(Sim_Timer *pTimer);
+
+/* ---------- Profiling ---------- */
+/**
+ * While on, every instruction of the image is single-stepped and costs one core cycle of
+ * virtual time, so DWT CYCCNT deltas taken by the firmware count the code it ran (x86-64
+ * instructions at -O1 stand in for Thumb-2 ones; no wait states or pipeline refills).
+ * Intrinsics cost one cycle, trapped peripheral accesses keep their fixed cost.
+ * Thousands of times slower than a normal run: profile short windows only.
+ */
+void Sim_Profile(bool on);
+/** Image instructions executed while profiling, since the process started */
+uint64_t Sim_Profile_GetInsns(void);
+
+/* ---------- Firmware access ---------- */
+void *Sim_Sym(const char *pName);
+/** Typed firmware function or variable from the loaded image, e.g. SIM_FW(Drv_DAC_Init)() */
+#define SIM_FW(sym)     (*(__typeof__(&(sym)))Sim_Sym(#sym))
+/** Host view of an MCU register (no trap, no side effects) */
+volatile uint32_t *Sim_Reg(uint32_t addr);
+/** Buffer in simulated SRAM above the firmware's, for DMA-visible test data */
+void *Sim_SramAlloc(size_t len);
+uint32_t Sim_GetCoreHz(void);
+/** Trapped register accesses per model and timer events so far, to stderr */
+void Sim_PrintStats(void);
+
+/* ---------- Pins ---------- */
+/** Port 'A'..'G'. level 0/1 drives the pin from outside, -1 releases it (pull or float) */
+void Sim_Pin_Drive(char port, uint8_t pin, int level);
+/** Resolved level as the MCU sees it */
+int  Sim_Pin_Get(char port, uint8_t pin);
+/** Output register change on a port, after the write */
+typedef void (*Sim_PinWatchFn)(char port, uint16_t odr, uint16_t changed, void *pCtx);
+void Sim_Pin_Watch(Sim_PinWatchFn fn, void *pCtx);
+
+/* ---------- Analog ---------- */
+/** Source for ADC input channel 0..17, in mV at virtual time t */
+typedef uint32_t (*Sim_AnalogFn)(uint64_t t, void *pCtx);
+void Sim_Adc_SetSource(uint8_t channel, Sim_AnalogFn fn, void *pCtx);
+void Sim_Adc_SetMv(uint8_t channel, uint32_t mv);
+/** DAC channel 1 output latch: every DHR -> DOR transfer, repeated codes included */
+typedef void (*Sim_DacWatchFn)(uint16_t code, void *pCtx);
+void Sim_Dac_Watch(Sim_DacWatchFn fn, void *pCtx);
+uint16_t Sim_Dac_Get(void);
+
+/* ---------- Timers ---------- */
+/** TIM1 ETR clock (SI5351 CLK1 when the model is wired), 0: stopped */
+void Sim_Tim_SetEtrHz(uint32_t hz);
+/** TIM1 CH1 output: true when PWM edges come out (CEN, MOE, CC1E, clocked) */
+bool Sim_Tim1_Running(void);
+
+/* ---------- Serial ---------- */
+/** Host side of USART n (1, 2): bytes to the MCU at the configured line rate */
+void Sim_Uart_Send(uint8_t n, const void *pData, size_t len);
+/** Bytes the MCU sent so far, consumed */
+size_t Sim_Uart_Recv(uint8_t n, void *pBuf, size_t max);
+size_t Sim_Uart_RxPending(uint8_t n);
+uint32_t Sim_Uart_GetBaud(uint8_t n);
+uint32_t Sim_Uart_GetDropped(uint8_t n);
+
+/* ---------- I2C devices ---------- */
+/** Probe AT24C02 on I2C2: attach/detach and raw contents (256 bytes) */
+void Sim_Eeprom_Attach(bool attached);
+uint8_t *Sim_Eeprom_Mem(void);
+/** SI5351 on I2C1: CLKn output frequency from the written PLL/multisynth registers, 0 when off */
+uint32_t Sim_Si5351_GetHz(uint8_t clk);
+uint32_t Sim_Si5351_GetWrites(void);
+
+/* ---------- Flash ---------- */
+uint8_t *Sim_Flash_Mem(void);
+typedef struct {
+    uint32_t erases;
+    uint32_t programs;
+    uint64_t busyNs;            /* time the controller was busy */
+} Sim_FlashStats;
+const Sim_FlashStats *Sim_Flash_GetStats(void);
+/** Power is cut in the middle of the n-th erase/program operation from now (0: off) */
+void Sim_Flash_CutAfter(uint32_t ops);
+
+/* ---------- Power ---------- */
+/** VDD seen by the PVD, mV */
+void Sim_Power_SetVdd(uint32_t mv);
+/** Time spent in STOP since boot */
+uint64_t Sim_Power_GetStopNs(void);
+
+/* ---------- RTT ---------- */
+/** Bytes from the target's up buffer ch, consumed */
+size_t Sim_Rtt_Read(uint8_t ch, void *pBuf, size_t max);
+/** Into the down buffer 0, e.g. a log command line */
+size_t Sim_Rtt_Write(const void *pData, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SIM_H */
@@ -0,0 +1,257 @@
+/************************************************************************************
+ * @file     : sim_adc.c
+ * @brief    : Host simulator - ADC1/ADC2 regular group, dual simultaneous mode, AWD
+ * @details  : A conversion ends (sample time + 12.5) ADC clocks after it started; the
+ *             input is taken from the channel source at that instant. In regular
+ *             simultaneous mode ADC1 paces both and ADC1_DR carries ADC2's result in its
+ *             upper half for the DMA. The analog watchdog is checked per conversion, so
+ *             trip latency is one conversion plus the interrupt entry, as on the part.
+ *             Calibration finishes at once. Injected channels are not modelled.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_ADC_CHANNELS    18u
+#define SIM_ADC_VREF_MV     3300u
+
+typedef struct {
+    uint32_t base;
+    bool running;               /* scan in progress */
+    uint32_t rank;              /* next rank to finish */
+    uint64_t tPs;               /* end of the current conversion, ps */
+    Sim_Timer timer;
+} Sim_AdcUnit;
+
+static Sim_AdcUnit s_unit[2] = { { ADC1_BASE, false, 0, 0, { 0 } }, { ADC2_BASE, false, 0, 0, { 0 } } };
+static struct {
+    Sim_AnalogFn fn;
+    void *pCtx;
+    uint32_t mv;
+} s_src[SIM_ADC_CHANNELS];
+
+static const uint16_t s_sampleHalf[8] = { 3, 15, 27, 57, 83, 111, 143, 479 };   /* 2x (sample + 12.5) */
+
+static ADC_TypeDef *Sim_Adc_Bd(const Sim_AdcUnit *pUnit)
+{
+    return (ADC_TypeDef *)Sim_Backdoor(pUnit->base);
+}
+
+static bool Sim_Adc_Dual(void)
+{
+    return ((SIM_BD(ADC1)->CR1 >> 16) & 0xFu) == 6u;     /* regular simultaneous only */
+}
+
+static uint32_t Sim_Adc_Channel(const ADC_TypeDef *pBd, uint32_t rank)
+{
+    if (rank < 6u)
+        return (pBd->SQR3 >> (rank * 5u)) & 0x1Fu;
+    if (rank < 12u)
+        return (pBd->SQR2 >> ((rank - 6u) * 5u)) & 0x1Fu;
+    return (pBd->SQR1 >> ((rank - 12u) * 5u)) & 0x1Fu;
+}
+
+static uint32_t Sim_Adc_Ranks(const ADC_TypeDef *pBd)
+{
+    return (pBd->CR1 & ADC_CR1_SCAN) ? ((pBd->SQR1 >> 20) & 0xFu) + 1u : 1u;
+}
+
+/* Conversion time of a channel in ps at the current ADC clock */
+static uint64_t Sim_Adc_ConvPs(const ADC_TypeDef *pBd, uint32_t ch)
+{
+    uint32_t smp = ch < 10u ? (pBd->SMPR2 >> (ch * 3u)) & 7u : (pBd->SMPR1 >> ((ch - 10u) * 3u)) & 7u;
+    uint32_t clk = Sim_Rcc_AdcClk();
+    uint32_t halfCycles = s_sampleHalf[smp] + 25u;
+
+    return (uint64_t)halfCycles * 500000000000ull / (clk != 0u ? clk : 1u);
+}
+
+static uint16_t Sim_Adc_Sample(uint32_t ch)
+{
+    uint32_t mv;
+
+    if (ch >= SIM_ADC_CHANNELS)
+        return 0;
+    if (s_src[ch].fn != NULL)
+        mv = s_src[ch].fn(Sim_Now(), s_src[ch].pCtx);
+    else
+        mv = s_src[ch].mv;
+    if ((ch == 16u || ch == 17u) && !(SIM_BD(ADC1)->CR2 & ADC_CR2_TSVREFE))
+        return 0;
+    mv = mv * 4096u / SIM_ADC_VREF_MV;
+    return (uint16_t)(mv > 4095u ? 4095u : mv);
+}
+
+static void Sim_Adc_UpdateIrq(void)
+{
+    bool level = false;
+    uint32_t i;
+
+    for (i = 0; i < 2u; i++) {
+        ADC_TypeDef *pBd = Sim_Adc_Bd(&s_unit[i]);
+        if (((pBd->SR & ADC_SR_AWD) && (pBd->CR1 & ADC_CR1_AWDIE)) ||
+            ((pBd->SR & ADC_SR_EOC) && (pBd->CR1 & ADC_CR1_EOCIE)))
+            level = true;
+    }
+    Sim_IrqLine(ADC1_2_IRQn, level);
+}
+
+static void Sim_Adc_Watchdog(ADC_TypeDef *pBd, uint32_t ch, uint16_t v)
+{
+    if (!(pBd->CR1 & ADC_CR1_AWDEN))
+        return;
+    if ((pBd->CR1 & ADC_CR1_AWDSGL) && ch != (pBd->CR1 & ADC_CR1_AWDCH))
+        return;
+    if (v > (pBd->HTR & 0xFFFu) || v < (pBd->LTR & 0xFFFu))
+        pBd->SR |= ADC_SR_AWD;
+}
+
+static uint16_t Sim_Adc_Convert(ADC_TypeDef *pBd, uint32_t rank)
+{
+    uint32_t ch = Sim_Adc_Channel(pBd, rank);
+    uint16_t v = Sim_Adc_Sample(ch);
+
+    if (pBd->CR2 & ADC_CR2_ALIGN)
+        v = (uint16_t)(v << 4);
+    Sim_Adc_Watchdog(pBd, ch, v);
+    pBd->SR |= ADC_SR_EOC;
+    return v;
+}
+
+static void Sim_Adc_Done(void *pCtx);
+
+static void Sim_Adc_Schedule(Sim_AdcUnit *pUnit)
+{
+    ADC_TypeDef *pBd = Sim_Adc_Bd(pUnit);
+
+    pUnit->tPs += Sim_Adc_ConvPs(pBd, Sim_Adc_Channel(pBd, pUnit->rank));
+    Sim_TimerStart(&pUnit->timer, (pUnit->tPs + 999u) / 1000u, Sim_Adc_Done, pUnit);
+}
+
+static void Sim_Adc_Start(Sim_AdcUnit *pUnit)
+{
+    pUnit->running = true;
+    pUnit->rank = 0;
+    pUnit->tPs = Sim_Now() * 1000u;
+    Sim_Adc_Schedule(pUnit);
+}
+
+static void Sim_Adc_Done(void *pCtx)
+{
+    Sim_AdcUnit *pUnit = pCtx;
+    ADC_TypeDef *pBd = Sim_Adc_Bd(pUnit);
+    uint32_t v1;
+    uint32_t v2 = 0;
+    bool dual = (pUnit == &s_unit[0]) && Sim_Adc_Dual();
+
+    v1 = Sim_Adc_Convert(pBd, pUnit->rank);
+    if (dual) {
+        v2 = Sim_Adc_Convert(SIM_BD(ADC2), pUnit->rank);
+        SIM_BD(ADC2)->DR = v2;
+    }
+    pBd->DR = v1 | (v2 << 16);
+    if (++pUnit->rank >= Sim_Adc_Ranks(pBd)) {
+        pUnit->rank = 0;
+        if (!(pBd->CR2 & ADC_CR2_CONT))
+            pUnit->running = false;
+    }
+    Sim_Adc_UpdateIrq();
+    if (pUnit == &s_unit[0] && (pBd->CR2 & ADC_CR2_DMA))
+        Sim_Dma_Request(1u, 1u);
+    if (pUnit->running && (pBd->CR2 & ADC_CR2_ADON)) {
+        Sim_Adc_Schedule(pUnit);
+    } else {
+        pUnit->running = false;
+    }
+}
+
+static void Sim_Adc_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    Sim_AdcUnit *pUnit = &s_unit[(addr & ~0x3FFu) == ADC1_BASE ? 0 : 1];
+    ADC_TypeDef *pBd = Sim_Adc_Bd(pUnit);
+
+    if (!write || (addr & ~0x3FFu) != pUnit->base)
+        return;
+    switch (addr & 0x3FCu) {
+    case 0x00u:     /* SR: rc_w0 */
+        pBd->SR = old & val & 0x1Fu;
+        break;
+    case 0x08u:     /* CR2 */
+        pBd->CR2 = val & ~(ADC_CR2_CAL | ADC_CR2_RSTCAL | ADC_CR2_SWSTART | ADC_CR2_JSWSTART);
+        if (!(val & ADC_CR2_ADON)) {
+            pUnit->running = false;
+            Sim_TimerStop(&pUnit->timer);
+            break;
+        }
+        /* ADON written again with no other bit changed, or SWSTART with the software
+         * trigger selected */
+        if (((old & ADC_CR2_ADON) && old == val) ||
+            ((val & ADC_CR2_SWSTART) && (val & ADC_CR2_EXTTRIG) && ((val >> 17) & 7u) == 7u)) {
+            if (!pUnit->running && !(pUnit == &s_unit[1] && Sim_Adc_Dual()))
+                Sim_Adc_Start(pUnit);
+            if (pUnit->running)
+                pBd->SR |= ADC_SR_STRT;
+        }
+        break;
+    case 0x4Cu:     /* DR: read-only */
+        pBd->DR = old;
+        break;
+    default:
+        break;
+    }
+    Sim_Adc_UpdateIrq();
+}
+
+void Sim_Adc_SetSource(uint8_t channel, Sim_AnalogFn fn, void *pCtx)
+{
+    if (channel >= SIM_ADC_CHANNELS)
+        SIM_FATAL("no ADC channel %u", channel);
+    s_src[channel].fn = fn;
+    s_src[channel].pCtx = pCtx;
+}
+
+void Sim_Adc_SetMv(uint8_t channel, uint32_t mv)
+{
+    if (channel >= SIM_ADC_CHANNELS)
+        SIM_FATAL("no ADC channel %u", channel);
+    s_src[channel].fn = NULL;
+    s_src[channel].mv = mv;
+}
+
+static void Sim_Adc_Init(void)
+{
+    Sim_MapRegs(ADC1_BASE, 0x800u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Adc_Post);
+    s_src[16].mv = 1430u;       /* temperature sensor at 25 C */
+    s_src[17].mv = 1200u;       /* VREFINT */
+}
+
+static void Sim_Adc_Reset(Sim_ResetCause cause)
+{
+    uint32_t i;
+
+    (void)cause;
+    memset(Sim_Backdoor(ADC1_BASE), 0, 0x800u);
+    for (i = 0; i < 2u; i++) {
+        Sim_TimerStop(&s_unit[i].timer);
+        s_unit[i].running = false;
+        Sim_Adc_Bd(&s_unit[i])->HTR = 0xFFFu;
+    }
+}
+
+/* ADCCLK is off in STOP: the scan in progress finishes after wake-up */
+static void Sim_Adc_Stop(bool enter)
+{
+    uint32_t i;
+
+    for (i = 0; i < 2u; i++) {
+        if (!s_unit[i].running)
+            continue;
+        if (enter) {
+            Sim_TimerStop(&s_unit[i].timer);
+        } else {
+            s_unit[i].tPs = Sim_Now() * 1000u;
+            Sim_Adc_Schedule(&s_unit[i]);
+        }
+    }
+}
+
+const Sim_Model g_simModelAdc = { "adc", Sim_Adc_Init, Sim_Adc_Reset, Sim_Adc_Stop };
@@ -0,0 +1,38 @@
+/************************************************************************************
+ * @file     : sim_backtrace.c
+ * @brief    : Host simulator - CmBacktrace stand-in
+ * @details  : cm_backtrace.c walks a Cortex-M stack between linker symbols the host image
+ *             does not have, and the fault entry (cmb_fault.S) is Thumb code. Faults in
+ *             the simulator end in a host signal with a symbolised PC instead.
+ ***********************************************************************************/
+#include "cm_backtrace.h"
+#include "SEGGER_RTT.h"
+
+void cm_backtrace_init(const char *firmware_name, const char *hardware_ver, const char *software_ver)
+{
+    SEGGER_RTT_printf(0, "[sim] %s hw %s sw %s, no backtrace on the host\r\n",
+                      firmware_name, hardware_ver, software_ver);
+}
+
+void cm_backtrace_firmware_info(void)
+{
+}
+
+size_t cm_backtrace_call_stack(uint32_t *buffer, size_t size, uint32_t sp)
+{
+    (void)buffer;
+    (void)size;
+    (void)sp;
+    return 0;
+}
+
+void cm_backtrace_assert(uint32_t sp)
+{
+    (void)sp;
+}
+
+void cm_backtrace_fault(uint32_t fault_handler_lr, uint32_t fault_handler_sp)
+{
+    (void)fault_handler_lr;
+    (void)fault_handler_sp;
+}
@@ -0,0 +1,1703 @@
+/************************************************************************************
+ * @file     : sim_core.c
+ * @brief    : Host simulator - address space, register traps, virtual time, NVIC, run control
+ * @details  : Flash, SRAM, peripherals and the core region are mapped at their MCU addresses.
+ *             Peripheral/core pages with a model hook are protected: the access faults,
+ *             the pre hook runs, the load or store is done on the backdoor, then the post
+ *             hook sees the old and new word. Plain MOV forms are emulated in the fault
+ *             handler; any other instruction gets the page opened and is single-stepped
+ *             (TF). Bit-band aliases are resolved the same way. Models keep their state
+ *             in a second, unprotected mapping of the same memory (the backdoor).
+ *             Interrupts are taken at intrinsics (__enable_irq, __NOP, __WFI...) and at
+ *             trapped accesses; in the latter case the handler injects a call to
+ *             Sim_IrqEntry into the interrupted context, which saves all registers like
+ *             an exception entry would. Handlers never run inside a signal handler.
+ *             main() runs on a ucontext coroutine whose stack is in simulated SRAM, so
+ *             DMA descriptors pointing at locals resolve to the same memory.
+ ***********************************************************************************/
+#define _GNU_SOURCE
+#include "sim_int.h"
+#include <dlfcn.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#define SIM_PAGE            4096u
+#define SIM_PAGE_MASK       (~(uintptr_t)(SIM_PAGE - 1u))
+#define SIM_HOOK_MAX        64u
+#define SIM_EXC_NUM         (16 + 60)
+#define SIM_SPIN_READS      8u              /* identical polling reads before time skips ahead */
+#define SIM_ENTRY_NS        170u            /* 12 cycles exception entry at 72 MHz */
+#define SIM_RED_ZONE        128
+#define SIM_TF              0x100
+
+/* CMSIS 1.30 core_cm3.h has no DWT block definition */
+#define SIM_DWT_CTRL        0xE0001000u
+#define SIM_DWT_CYCCNT      0xE0001004u
+#define SIM_DBGMCU_IDCODE   0xE0042000u
+
+typedef struct {
+    uint32_t base;
+    uint32_t size;
+    uint8_t *pBd;
+    uint8_t *pTrap;             /* per page SIM_TRAP_* */
+} Sim_Area;
+
+typedef struct {
+    uint32_t base;
+    uint32_t size;
+    uint8_t trap;
+    Sim_Hook pre;
+    Sim_Hook post;
+    uint64_t reads;             /* trapped accesses, for Sim_PrintStats */
+    uint64_t writes;
+} Sim_HookDef;
+
+typedef struct {
+    bool active;
+    bool write;
+    bool bitband;
+    uint32_t addr;              /* target register address */
+    uint32_t bit;               /* bit-band bit */
+    uint32_t old;
+    uintptr_t host;             /* faulting word */
+    uintptr_t page;             /* host page opened for the step */
+    int prot;                   /* protection to restore */
+    const Sim_HookDef *pHook;
+} Sim_Step;
+
+/* MOV load/store decoded at the faulting RIP */
+typedef struct {
+    uint8_t len;                /* instruction bytes */
+    uint8_t size;               /* memory access width */
+    uint8_t regSize;            /* register operand width */
+    bool store;
+    bool sext;                  /* MOVSX */
+    int reg;                    /* gregs index of the register operand, -1: immediate */
+    uint32_t imm;
+} Sim_Insn;
+
+static const int s_gregOf[16] = {
+    REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+};
+
+static const Sim_Model *const s_models[] = {
+    &g_simModelRcc, &g_simModelGpio, &g_simModelDma, &g_simModelAdc, &g_simModelDac,
+    &g_simModelTim, &g_simModelUsart, &g_simModelI2c, &g_simModelFlash,
+};
+#define SIM_MODEL_NUM       (sizeof(s_models) / sizeof(s_models[0]))
+
+static Sim_Area s_flash = { SIM_FLASH_BASE, SIM_FLASH_SIZE, NULL, NULL };
+static Sim_Area s_periph = { SIM_PERIPH_BASE, SIM_PERIPH_SIZE, NULL, NULL };
+static Sim_Area s_core = { SIM_CORE_BASE, SIM_CORE_SIZE, NULL, NULL };
+static Sim_HookDef s_hooks[SIM_HOOK_MAX];
+static uint32_t s_hookNum = 0;
+static Sim_Step s_step;
+static uint8_t s_altStack[64 * 1024];
+
+/* Virtual time */
+static uint64_t s_now = 0;
+static Sim_Timer *s_timers = NULL;
+static uint32_t s_inModel = 0;
+static uintptr_t s_spinRip = 0;
+static uint32_t s_spinAddr = 0;
+static uint32_t s_spinCount = 0;
+
+/* Core state */
+static uint32_t s_primask = 0;
+static uint32_t s_basepri = 0;
+static uint32_t s_faultmask = 0;
+static uint32_t s_irqEn[2];
+static uint32_t s_irqPend[2];
+static uint32_t s_irqAct[2];
+static bool s_irqLine[64];
+static bool s_sysTickPend = false;
+static bool s_pendSvPend = false;
+static uint16_t s_level[16];
+static uint32_t s_depth = 0;
+static bool s_wakeEvt = false;
+static bool s_inStop = false;
+static uint64_t s_stopNs = 0;
+static uint64_t s_stopEnter = 0;
+/* SysTick: VAL counts down from LOAD, reloads at 0 */
+static Sim_Timer s_stTimer;
+static uint64_t s_stBase = 0;            /* time VAL was last LOAD */
+static bool s_stCountFlag = false;
+static uint64_t s_cycBase = 0;
+static uint32_t s_cycAtBase = 0;
+
+/* Image and run control */
+static const char *s_pImage = NULL;
+static const char *s_pBootImage = NULL;
+static const char *s_pLoaded = NULL;
+static void *s_pDl = NULL;
+static uintptr_t s_imageBase = 0;
+static uintptr_t s_imageEnd = 0;
+static uintptr_t s_textBase = 0;         /* executable segment, page aligned */
+static uintptr_t s_textEnd = 0;
+static void (*s_vec[SIM_EXC_NUM])(void);
+static uint8_t *s_pNoInit = NULL;
+static size_t s_noInitLen = 0;
+/* Saved .noinit per image (bootloader and application) */
+static struct {
+    const char *pPath;
+    uint8_t *pData;
+    size_t len;
+} s_noInitSave[2];
+static ucontext_t s_hostCtx;
+static ucontext_t s_fwCtx;
+static bool s_started = false;
+static bool s_onFw = false;
+static uint64_t s_stopAt = 0;
+static bool s_stopReq = false;
+static bool s_resetReq = false;
+static Sim_ResetCause s_resetCause = E_SIM_RESET_POWER;
+static Sim_ResetCause s_lastReset = E_SIM_RESET_POWER;
+static uint32_t s_resets = 0;
+static bool s_autoReboot = true;
+static bool s_jumpReq = false;
+static void (*s_bootHook)(Sim_ResetCause cause) = NULL;
+static uint32_t s_sramTop = SIM_SRAM_BASE + SIM_SRAM_SIZE;
+static volatile uint32_t s_progress = 0;
+static uint64_t s_timerFires = 0;
+static struct {
+    void (*fn)(void *pCtx);
+    uint64_t n;
+} s_timerStats[16];
+static uint64_t s_polls = 0;
+static uint64_t s_emulated = 0;
+static uint64_t s_stepped = 0;
+/* Instruction-level profiling: every image instruction is trapped and costs one core cycle.
+ * Outside the image the text is not executable, so host code is not stepped: re-entry
+ * faults and turns TF back on. */
+static volatile bool s_profile = false;
+static bool s_profOut = false;           /* image text PROT_READ, waiting for re-entry */
+static uint64_t s_profInsns = 0;
+static uint64_t s_profFrac = 0;          /* ns * SYSCLK carried between instructions */
+
+static const char *const s_excNames[SIM_EXC_NUM] = {
+    NULL, "Reset_Handler", "NMI_Handler", "HardFault_Handler", "MemManage_Handler",
+    "BusFault_Handler", "UsageFault_Handler", NULL, NULL, NULL, NULL, "SVC_Handler",
+    "DebugMon_Handler", NULL, "PendSV_Handler", "SysTick_Handler",
+    "WWDG_IRQHandler", "PVD_IRQHandler", "TAMPER_IRQHandler", "RTC_IRQHandler",
+    "FLASH_IRQHandler", "RCC_IRQHandler", "EXTI0_IRQHandler", "EXTI1_IRQHandler",
+    "EXTI2_IRQHandler", "EXTI3_IRQHandler", "EXTI4_IRQHandler", "DMA1_Channel1_IRQHandler",
+    "DMA1_Channel2_IRQHandler", "DMA1_Channel3_IRQHandler", "DMA1_Channel4_IRQHandler",
+    "DMA1_Channel5_IRQHandler", "DMA1_Channel6_IRQHandler", "DMA1_Channel7_IRQHandler",
+    "ADC1_2_IRQHandler", "USB_HP_CAN1_TX_IRQHandler", "USB_LP_CAN1_RX0_IRQHandler",
+    "CAN1_RX1_IRQHandler", "CAN1_SCE_IRQHandler", "EXTI9_5_IRQHandler", "TIM1_BRK_IRQHandler",
+    "TIM1_UP_IRQHandler", "TIM1_TRG_COM_IRQHandler", "TIM1_CC_IRQHandler", "TIM2_IRQHandler",
+    "TIM3_IRQHandler", "TIM4_IRQHandler", "I2C1_EV_IRQHandler", "I2C1_ER_IRQHandler",
+    "I2C2_EV_IRQHandler", "I2C2_ER_IRQHandler", "SPI1_IRQHandler", "SPI2_IRQHandler",
+    "USART1_IRQHandler", "USART2_IRQHandler", "USART3_IRQHandler", "EXTI15_10_IRQHandler",
+    "RTCAlarm_IRQHandler", "USBWakeUp_IRQHandler", "TIM8_BRK_IRQHandler", "TIM8_UP_IRQHandler",
+    "TIM8_TRG_COM_IRQHandler", "TIM8_CC_IRQHandler", "ADC3_IRQHandler", "FSMC_IRQHandler",
+    "SDIO_IRQHandler", "TIM5_IRQHandler", "SPI3_IRQHandler", "UART4_IRQHandler",
+    "UART5_IRQHandler", "TIM6_IRQHandler", "TIM7_IRQHandler", "DMA2_Channel1_IRQHandler",
+    "DMA2_Channel2_IRQHandler", "DMA2_Channel3_IRQHandler", "DMA2_Channel4_5_IRQHandler",
+};
+
+void Sim_IrqEntry(void);
+void Sim_IrqEntryC(void);
+void Sim_Poll(uint32_t ns);
+static void Sim_TakeIrqs(void);
+static void Sim_SysTickRestart(void);
+static void Sim_CycRefresh(void);
+
+/* ---------- Diagnostics ---------- */
+
+static void Sim_PrintAddr(const char *pWhat, uintptr_t pc)
+{
+    Dl_info info;
+
+    if (dladdr((void *)pc, &info) && info.dli_sname != NULL)
+        fprintf(stderr, "sim: %s %s+0x%lx\n", pWhat, info.dli_sname,
+                (unsigned long)(pc - (uintptr_t)info.dli_saddr));
+    else
+        fprintf(stderr, "sim: %s 0x%lx\n", pWhat, (unsigned long)pc);
+}
+
+void Sim_Fatal(const char *pFile, int line, const char *pFmt, ...)
+{
+    va_list ap;
+
+    fprintf(stderr, "sim: fatal at %.3f ms (%s:%d): ", (double)s_now / 1e6, pFile, line);
+    va_start(ap, pFmt);
+    vfprintf(stderr, pFmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    fflush(stderr);
+    fflush(stdout);
+    _exit(3);
+}
+
+/* ---------- Address space ---------- */
+
+static uint8_t *Sim_MapArea(Sim_Area *pArea, int prot)
+{
+    int fd = memfd_create("m600", 0);
+    void *p;
+
+    if (fd < 0 || ftruncate(fd, pArea->size) != 0)
+        SIM_FATAL("memfd: %s", strerror(errno));
+    p = mmap((void *)(uintptr_t)pArea->base, pArea->size, prot,
+             MAP_SHARED | MAP_FIXED_NOREPLACE, fd, 0);
+    if (p != (void *)(uintptr_t)pArea->base)
+        SIM_FATAL("cannot map 0x%08X: %s", pArea->base, strerror(errno));
+    pArea->pBd = mmap(NULL, pArea->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (pArea->pBd == MAP_FAILED)
+        SIM_FATAL("backdoor mmap: %s", strerror(errno));
+    pArea->pTrap = calloc(pArea->size / SIM_PAGE, 1);
+    close(fd);
+    return pArea->pBd;
+}
+
+static void Sim_MapPlain(uint32_t base, uint32_t size, int prot)
+{
+    void *p = mmap((void *)(uintptr_t)base, size, prot,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE | MAP_NORESERVE, -1, 0);
+
+    if (p != (void *)(uintptr_t)base)
+        SIM_FATAL("cannot map 0x%08X: %s", base, strerror(errno));
+}
+
+static Sim_Area *Sim_AreaOf(uint32_t addr)
+{
+    if (addr - s_periph.base < s_periph.size)
+        return &s_periph;
+    if (addr - s_core.base < s_core.size)
+        return &s_core;
+    if (addr - s_flash.base < s_flash.size)
+        return &s_flash;
+    return NULL;
+}
+
+static int Sim_PageProt(const Sim_Area *pArea, uint32_t addr)
+{
+    uint8_t trap = pArea->pTrap[(addr - pArea->base) / SIM_PAGE];
+
+    if (pArea == &s_flash)
+        return PROT_READ;
+    if (trap & SIM_TRAP_RD)
+        return PROT_NONE;
+    if (trap & SIM_TRAP_WR)
+        return PROT_READ;
+    return PROT_READ | PROT_WRITE;
+}
+
+void *Sim_Backdoor(uint32_t addr)
+{
+    Sim_Area *pArea = Sim_AreaOf(addr);
+
+    if (pArea == NULL)
+        SIM_FATAL("no backdoor for 0x%08X", addr);
+    return pArea->pBd + (addr - pArea->base);
+}
+
+volatile uint32_t *Sim_Reg(uint32_t addr)
+{
+    return (volatile uint32_t *)Sim_Backdoor(addr);
+}
+
+void Sim_MapRegs(uint32_t base, uint32_t size, uint8_t trap, Sim_Hook pre, Sim_Hook post)
+{
+    Sim_Area *pArea = Sim_AreaOf(base);
+    uint32_t a;
+
+    if (pArea == NULL || s_hookNum >= SIM_HOOK_MAX)
+        SIM_FATAL("cannot hook 0x%08X", base);
+    s_hooks[s_hookNum++] = (Sim_HookDef){ base, size, trap, pre, post, 0, 0 };
+    for (a = base & ~(SIM_PAGE - 1u); a < base + size; a += SIM_PAGE) {
+        pArea->pTrap[(a - pArea->base) / SIM_PAGE] |= trap;
+        mprotect((void *)(uintptr_t)a, SIM_PAGE, Sim_PageProt(pArea, a));
+    }
+}
+
+static const Sim_HookDef *Sim_FindHook(uint32_t addr)
+{
+    uint32_t i;
+
+    for (i = 0; i < s_hookNum; i++) {
+        if (addr - s_hooks[i].base < s_hooks[i].size)
+            return &s_hooks[i];
+    }
+    return NULL;
+}
+
+/* MCU address as used by the DMA: SRAM/stack/flash/peripherals are identity mapped, the
+ * image's own statics are below 4 GiB of the image base (checked at load) */
+uintptr_t Sim_HostAddr(uint32_t addr, uint32_t len)
+{
+    uintptr_t p = (s_imageBase & ~(uintptr_t)0xFFFFFFFFu) | addr;
+
+    /* Only the mapped windows: a truncated image pointer may land between them */
+    if (addr - SIM_FLASH_BASE < SIM_FLASH_SIZE || addr - SIM_SRAM_BASE < SIM_STACK_BASE + SIM_STACK_SIZE - SIM_SRAM_BASE)
+        return addr;
+    if (addr >= SIM_PERIPH_BASE && addr < SIM_PERIPH_BASE + SIM_PERIPH_SIZE)
+        return addr;
+    if (s_pDl != NULL && p >= s_imageBase && p + len <= s_imageEnd)
+        return p;
+    SIM_FATAL("DMA address 0x%08X (%u bytes) is not in SRAM, flash or the image", addr, len);
+}
+
+/* Peripheral register access on behalf of the DMA: hooks run as for a CPU store */
+void Sim_BusWrite(uint32_t addr, uint32_t val, uint8_t size)
+{
+    const Sim_HookDef *pHook = Sim_FindHook(addr);
+    uint32_t *pWord = (uint32_t *)Sim_Backdoor(addr & ~3u);
+    uint32_t old = *pWord;
+
+    if (pHook != NULL && pHook->pre != NULL && (pHook->trap & SIM_TRAP_RD))
+        pHook->pre(addr, true, old, 0);
+    old = *pWord;
+    if (size == 4)
+        *pWord = val;
+    else if (size == 2)
+        *(uint16_t *)Sim_Backdoor(addr & ~1u) = (uint16_t)val;
+    else
+        *(uint8_t *)Sim_Backdoor(addr) = (uint8_t)val;
+    if (pHook != NULL && pHook->post != NULL)
+        pHook->post(addr, true, old, *pWord);
+}
+
+uint32_t Sim_BusRead(uint32_t addr, uint8_t size)
+{
+    const Sim_HookDef *pHook = Sim_FindHook(addr);
+    uint32_t *pWord = (uint32_t *)Sim_Backdoor(addr & ~3u);
+    uint32_t v;
+
+    if (pHook != NULL && pHook->pre != NULL && (pHook->trap & SIM_TRAP_RD))
+        pHook->pre(addr, false, *pWord, 0);
+    v = *pWord >> ((addr & 3u) * 8u);
+    if (pHook != NULL && pHook->post != NULL && (pHook->trap & SIM_TRAP_RD))
+        pHook->post(addr, false, *pWord, *pWord);
+    return size == 4 ? v : (size == 2 ? (v & 0xFFFFu) : (v & 0xFFu));
+}
+
+/* ---------- Virtual time ---------- */
+
+uint64_t Sim_Now(void)
+{
+    return s_now;
+}
+
+void Sim_TimerStop(Sim_Timer *pTimer)
+{
+    Sim_Timer **pp;
+
+    if (!pTimer->armed)
+        return;
+    for (pp = &s_timers; *pp != NULL; pp = &(*pp)->pNext) {
+        if (*pp == pTimer) {
+            *pp = pTimer->pNext;
+            break;
+        }
+    }
+    pTimer->armed = false;
+}
+
+void Sim_TimerStart(Sim_Timer *pTimer, uint64_t at, void (*fn)(void *pCtx), void *pCtx)
+{
+    Sim_Timer **pp;
+
+    Sim_TimerStop(pTimer);
+    pTimer->at = at < s_now ? s_now : at;
+    pTimer->fn = fn;
+    pTimer->pCtx = pCtx;
+    pTimer->armed = true;
+    for (pp = &s_timers; *pp != NULL && (*pp)->at <= pTimer->at; pp = &(*pp)->pNext) { }
+    pTimer->pNext = *pp;
+    *pp = pTimer;
+}
+
+uint64_t Sim_NextEvent(void)
+{
+    return s_timers != NULL ? s_timers->at : UINT64_MAX;
+}
+
+static void Sim_CountTimer(void (*fn)(void *pCtx))
+{
+    uint32_t i;
+
+    for (i = 0; i < sizeof(s_timerStats) / sizeof(s_timerStats[0]); i++) {
+        if (s_timerStats[i].fn == fn || s_timerStats[i].fn == NULL) {
+            s_timerStats[i].fn = fn;
+            s_timerStats[i].n++;
+            return;
+        }
+    }
+}
+
+static void Sim_AdvanceTo(uint64_t t)
+{
+    Sim_Timer *p;
+
+    s_inModel++;
+    while ((p = s_timers) != NULL && p->at <= t) {
+        s_timers = p->pNext;
+        p->armed = false;
+        if (p->at > s_now)
+            s_now = p->at;
+        s_timerFires++;
+        Sim_CountTimer(p->fn);
+        p->fn(p->pCtx);
+    }
+    s_inModel--;
+    if (t > s_now)
+        s_now = t;
+    Sim_CycRefresh();
+}
+
+/* ---------- NVIC ---------- */
+
+static uint32_t Sim_PriGroup(void)
+{
+    return (SIM_BD(SCB)->AIRCR & SCB_AIRCR_PRIGROUP_Msk) >> SCB_AIRCR_PRIGROUP_Pos;
+}
+
+/* Priority of exception number exc as (preempt << 8 | sub << 4) with 4 implemented bits */
+static uint32_t Sim_ExcPrio(int exc, uint32_t *pPreempt)
+{
+    uint32_t shift = Sim_PriGroup() + 1u;
+    uint32_t raw;
+
+    if (shift < 4u)
+        shift = 4u;
+    if (exc >= 16)
+        raw = SIM_BD(NVIC)->IP[exc - 16];
+    else if (exc >= 4)
+        raw = SIM_BD(SCB)->SHP[exc - 4];
+    else
+        raw = 0;
+    raw &= 0xF0u;
+    *pPreempt = raw >> shift;
+    return ((raw >> shift) << 8) | (((raw >> 4) & ((1u << (shift - 4u)) - 1u)) << 4);
+}
+
+static bool Sim_ExcPending(int exc)
+{
+    if (exc == 15)
+        return s_sysTickPend;
+    if (exc == 14)
+        return s_pendSvPend;
+    if (exc < 16)
+        return false;
+    exc -= 16;
+    return (s_irqPend[exc >> 5] & s_irqEn[exc >> 5] & (1u << (exc & 31))) != 0;
+}
+
+/* Highest priority pending exception that may preempt now, -1 if none */
+static int Sim_NextExc(bool ignoreMask)
+{
+    uint32_t bestKey = UINT32_MAX;
+    uint32_t preempt;
+    uint32_t key;
+    uint32_t level;
+    int best = -1;
+    int exc;
+
+    if (!s_sysTickPend && !s_pendSvPend &&
+        (s_irqPend[0] & s_irqEn[0]) == 0 && (s_irqPend[1] & s_irqEn[1]) == 0)
+        return -1;
+    for (exc = 14; exc < SIM_EXC_NUM; exc++) {
+        if (!Sim_ExcPending(exc))
+            continue;
+        key = (Sim_ExcPrio(exc, &preempt) << 8) | (uint32_t)exc;
+        if (key < bestKey) {
+            bestKey = key;
+            best = exc;
+        }
+    }
+    if (best < 0)
+        return -1;
+    Sim_ExcPrio(best, &preempt);
+    level = s_depth != 0 ? s_level[s_depth - 1u] : 0x100u;
+    if (preempt >= level)
+        return -1;
+    if (!ignoreMask) {
+        if (s_primask || s_faultmask)
+            return -1;
+        if (s_basepri != 0) {
+            uint32_t bp;
+            uint32_t shift = Sim_PriGroup() + 1u;
+            bp = (s_basepri & 0xF0u) >> (shift < 4u ? 4u : shift);
+            if (preempt >= bp)
+                return -1;
+        }
+    }
+    return best;
+}
+
+static void Sim_Dispatch(int exc)
+{
+    void (*fn)(void) = s_vec[exc];
+    uint32_t preempt;
+    int irq = exc - 16;
+
+    Sim_ExcPrio(exc, &preempt);
+    if (exc == 15)
+        s_sysTickPend = false;
+    else if (exc == 14)
+        s_pendSvPend = false;
+    else
+        s_irqPend[irq >> 5] &= ~(1u << (irq & 31));
+    if (fn == NULL)
+        SIM_FATAL("exception %d (%s) has no handler: Default_Handler loops forever",
+                  exc, s_excNames[exc] != NULL ? s_excNames[exc] : "?");
+    if (s_depth >= 16u)
+        SIM_FATAL("exception nesting too deep");
+    if (irq >= 0)
+        s_irqAct[irq >> 5] |= 1u << (irq & 31);
+    s_level[s_depth++] = (uint16_t)preempt;
+    Sim_AdvanceTo(s_now + SIM_ENTRY_NS);
+    fn();
+    s_depth--;
+    if (irq >= 0) {
+        s_irqAct[irq >> 5] &= ~(1u << (irq & 31));
+        if (s_irqLine[irq])
+            s_irqPend[irq >> 5] |= 1u << (irq & 31);
+    }
+}
+
+static void Sim_TakeIrqs(void)
+{
+    int exc;
+
+    if (s_inModel != 0)
+        return;
+    while ((exc = Sim_NextExc(false)) >= 0)
+        Sim_Dispatch(exc);
+}
+
+void Sim_IrqPend(int irqn)
+{
+    if (irqn == SysTick_IRQn)
+        s_sysTickPend = true;
+    else if (irqn == PendSV_IRQn)
+        s_pendSvPend = true;
+    else if (irqn >= 0)
+        s_irqPend[irqn >> 5] |= 1u << (irqn & 31);
+}
+
+void Sim_IrqLine(int irqn, bool level)
+{
+    if (irqn < 0 || irqn >= 64)
+        return;
+    if (level && !s_irqLine[irqn])
+        Sim_IrqPend(irqn);
+    s_irqLine[irqn] = level;
+}
+
+void Sim_Wake(void)
+{
+    s_wakeEvt = true;
+}
+
+bool Sim_InStop(void)
+{
+    return s_inStop;
+}
+
+void Sim_RequestReset(Sim_ResetCause cause)
+{
+    if (!s_resetReq) {
+        s_resetReq = true;
+        s_resetCause = cause;
+    }
+}
+
+void Sim_RequestStop(void)
+{
+    s_stopReq = true;
+}
+
+/* ---------- SysTick / DWT ---------- */
+
+static uint64_t Sim_SysTickHz(void)
+{
+    uint32_t hz = Sim_Rcc_SysClk();
+
+    if ((SIM_BD(SysTick)->CTRL & SysTick_CTRL_CLKSOURCE_Msk) == 0)
+        hz /= 8u;
+    return hz != 0 ? hz : 1u;
+}
+
+/* Whole ns per tick would run a 72 MHz SysTick 7 % fast: scale the count instead */
+static uint64_t Sim_SysTickNs(uint64_t ticks)
+{
+    return ticks * 1000000000ull / Sim_SysTickHz();
+}
+
+static uint32_t Sim_SysTickVal(void)
+{
+    uint32_t load = SIM_BD(SysTick)->LOAD & 0xFFFFFFu;
+    uint64_t ticks;
+
+    if ((SIM_BD(SysTick)->CTRL & SysTick_CTRL_ENABLE_Msk) == 0 || s_inStop)
+        return SIM_BD(SysTick)->VAL;
+    ticks = (s_now - s_stBase) * Sim_SysTickHz() / 1000000000ull;
+    return ticks >= load ? 0u : load - (uint32_t)ticks;
+}
+
+static void Sim_SysTickWrap(void *pCtx)
+{
+    (void)pCtx;
+    s_stCountFlag = true;
+    if (SIM_BD(SysTick)->CTRL & SysTick_CTRL_TICKINT_Msk)
+        Sim_IrqPend(SysTick_IRQn);
+    s_stBase = s_now;
+    Sim_SysTickRestart();
+}
+
+static void Sim_SysTickRestart(void)
+{
+    uint32_t load = SIM_BD(SysTick)->LOAD & 0xFFFFFFu;
+
+    Sim_TimerStop(&s_stTimer);
+    if ((SIM_BD(SysTick)->CTRL & SysTick_CTRL_ENABLE_Msk) == 0 || load == 0 || s_inStop)
+        return;
+    /* The wrap is the reload, one tick after VAL reaches 0 */
+    Sim_TimerStart(&s_stTimer, s_stBase + Sim_SysTickNs((uint64_t)load + 1u),
+                   Sim_SysTickWrap, NULL);
+}
+
+uint32_t Sim_GetCoreHz(void)
+{
+    return Sim_Rcc_SysClk();
+}
+
+static uint32_t Sim_Cycles(void)
+{
+    return s_cycAtBase + (uint32_t)((s_now - s_cycBase) * Sim_Rcc_SysClk() / 1000000000ull);
+}
+
+/* Called by the RCC model before SYSCLK changes */
+void Sim_Core_ClockChange(void)
+{
+    uint32_t val = Sim_SysTickVal();
+
+    s_cycAtBase = Sim_Cycles();
+    s_cycBase = s_now;
+    SIM_BD(SysTick)->VAL = val;
+}
+
+void Sim_Core_ClockChanged(void)
+{
+    uint32_t load = SIM_BD(SysTick)->LOAD & 0xFFFFFFu;
+
+    s_stBase = s_now - Sim_SysTickNs(load - (SIM_BD(SysTick)->VAL & 0xFFFFFFu));
+    Sim_SysTickRestart();
+    Sim_CycRefresh();
+}
+
+static void Sim_ScsPre(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    (void)old;
+    (void)val;
+    if (addr >= (uint32_t)(uintptr_t)&SysTick->VAL && addr < (uint32_t)(uintptr_t)&SysTick->VAL + 4u) {
+        SIM_BD(SysTick)->VAL = Sim_SysTickVal();
+    } else if (addr >= (uint32_t)(uintptr_t)&SysTick->CTRL && addr < (uint32_t)(uintptr_t)&SysTick->CTRL + 4u) {
+        if (s_stCountFlag)
+            SIM_BD(SysTick)->CTRL |= SysTick_CTRL_COUNTFLAG_Msk;
+        if (!write)
+            s_stCountFlag = false;
+    } else if (addr >= (uint32_t)(uintptr_t)NVIC && addr < (uint32_t)(uintptr_t)&NVIC->IP[0]) {
+        int i;
+        for (i = 0; i < 2; i++) {
+            SIM_BD(NVIC)->ISER[i] = s_irqEn[i];
+            SIM_BD(NVIC)->ICER[i] = s_irqEn[i];
+            SIM_BD(NVIC)->ISPR[i] = s_irqPend[i];
+            SIM_BD(NVIC)->ICPR[i] = s_irqPend[i];
+            SIM_BD(NVIC)->IABR[i] = s_irqAct[i];
+        }
+    } else if (addr >= (uint32_t)(uintptr_t)&SCB->ICSR && addr < (uint32_t)(uintptr_t)&SCB->ICSR + 4u) {
+        uint32_t icsr = 0;
+        int exc = Sim_NextExc(true);
+        if (exc >= 0)
+            icsr |= ((uint32_t)exc << SCB_ICSR_VECTPENDING_Pos) | SCB_ICSR_ISRPENDING_Msk;
+        if (s_sysTickPend)
+            icsr |= SCB_ICSR_PENDSTSET_Msk;
+        if (s_pendSvPend)
+            icsr |= SCB_ICSR_PENDSVSET_Msk;
+        SIM_BD(SCB)->ICSR = icsr;
+    }
+}
+
+static void Sim_ScsPost(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    uint32_t off;
+    int i;
+
+    if (!write) {
+        if (addr >= (uint32_t)(uintptr_t)&SysTick->CTRL && addr < (uint32_t)(uintptr_t)&SysTick->CTRL + 4u)
+            SIM_BD(SysTick)->CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+        return;
+    }
+    addr &= ~3u;
+    if (addr == (uint32_t)(uintptr_t)&SysTick->CTRL) {
+        if (old & ~val & SysTick_CTRL_ENABLE_Msk) {
+            /* Freeze VAL with the old enable still visible */
+            SIM_BD(SysTick)->CTRL = old;
+            SIM_BD(SysTick)->VAL = Sim_SysTickVal();
+        } else if (val & ~old & SysTick_CTRL_ENABLE_Msk) {
+            /* Counting resumes from VAL; 0 reloads LOAD on the first tick */
+            uint32_t load = SIM_BD(SysTick)->LOAD & 0xFFFFFFu;
+            uint32_t cur = SIM_BD(SysTick)->VAL & 0xFFFFFFu;
+            SIM_BD(SysTick)->CTRL = val & 7u;
+            s_stBase = s_now - (cur == 0 || cur > load ? 0u : Sim_SysTickNs(load - cur));
+        }
+        SIM_BD(SysTick)->CTRL = (val & 7u) | (s_stCountFlag ? SysTick_CTRL_COUNTFLAG_Msk : 0u);
+        Sim_SysTickRestart();
+    } else if (addr == (uint32_t)(uintptr_t)&SysTick->VAL) {
+        /* Any write clears VAL and COUNTFLAG, the next tick reloads */
+        SIM_BD(SysTick)->VAL = 0;
+        s_stCountFlag = false;
+        SIM_BD(SysTick)->CTRL &= ~SysTick_CTRL_COUNTFLAG_Msk;
+        s_stBase = s_now - Sim_SysTickNs(SIM_BD(SysTick)->LOAD & 0xFFFFFFu);
+        Sim_SysTickRestart();
+    } else if (addr == (uint32_t)(uintptr_t)&SysTick->LOAD) {
+        SIM_BD(SysTick)->LOAD = val & 0xFFFFFFu;
+    } else if (addr >= (uint32_t)(uintptr_t)NVIC && addr < (uint32_t)(uintptr_t)&NVIC->IP[0]) {
+        off = addr - (uint32_t)(uintptr_t)NVIC;
+        i = (int)((off & 0x7Fu) >> 2);
+        if (i < 2) {
+            switch (off & ~0x7Fu) {
+            case 0x000: s_irqEn[i] |= val; break;
+            case 0x080: s_irqEn[i] &= ~val; break;
+            case 0x100: s_irqPend[i] |= val; break;
+            case 0x180: s_irqPend[i] &= ~val; break;
+            default: break;
+            }
+        }
+        Sim_ScsPre(addr, false, 0, 0);
+    } else if (addr == (uint32_t)(uintptr_t)&SCB->AIRCR) {
+        if ((val >> 16) != 0x05FAu) {
+            SIM_BD(SCB)->AIRCR = old;
+            return;
+        }
+        SIM_BD(SCB)->AIRCR = (0xFA05u << 16) | (val & SCB_AIRCR_PRIGROUP_Msk);
+        if (val & (SCB_AIRCR_SYSRESETREQ_Msk | SCB_AIRCR_VECTRESET_Msk))
+            Sim_RequestReset(E_SIM_RESET_SOFT);
+    } else if (addr == (uint32_t)(uintptr_t)&SCB->ICSR) {
+        if (val & SCB_ICSR_PENDSTSET_Msk)
+            s_sysTickPend = true;
+        if (val & SCB_ICSR_PENDSTCLR_Msk)
+            s_sysTickPend = false;
+        if (val & SCB_ICSR_PENDSVSET_Msk)
+            s_pendSvPend = true;
+        if (val & SCB_ICSR_PENDSVCLR_Msk)
+            s_pendSvPend = false;
+        SIM_BD(SCB)->ICSR = 0;
+    } else if (addr == (uint32_t)(uintptr_t)&NVIC->STIR) {
+        Sim_IrqPend((int)(val & 0x1FFu));
+    }
+}
+
+/* CYCCNT is kept current whenever time moves, so reading it needs no trap (the power
+ * accounting reads it on every main loop pass) */
+static void Sim_CycRefresh(void)
+{
+    *(uint32_t *)Sim_Backdoor(SIM_DWT_CYCCNT) = Sim_Cycles();
+}
+
+static void Sim_DwtPost(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    (void)old;
+    if (write && (addr & ~3u) == SIM_DWT_CYCCNT) {
+        s_cycAtBase = val;
+        s_cycBase = s_now;
+    }
+}
+
+static void Sim_CoreReset(void)
+{
+    memset(s_core.pBd, 0, s_core.size);
+    *(uint32_t *)&SIM_BD(SCB)->CPUID = 0x411FC231u;
+    SIM_BD(SCB)->AIRCR = 0xFA05u << 16;
+    *(uint32_t *)&SIM_BD(SysTick)->CALIB = 9000u;
+    *(uint32_t *)Sim_Backdoor(SIM_DBGMCU_IDCODE) = 0x10036414u;  /* high density, rev Z */
+    memset(s_irqEn, 0, sizeof(s_irqEn));
+    memset(s_irqPend, 0, sizeof(s_irqPend));
+    memset(s_irqAct, 0, sizeof(s_irqAct));
+    memset(s_irqLine, 0, sizeof(s_irqLine));
+    s_sysTickPend = false;
+    s_pendSvPend = false;
+    s_depth = 0;
+    s_primask = 0;
+    s_basepri = 0;
+    s_faultmask = 0;
+    s_stCountFlag = false;
+    s_wakeEvt = false;
+    s_inStop = false;
+    Sim_TimerStop(&s_stTimer);
+    s_cycBase = s_now;
+    s_cycAtBase = 0;
+    Sim_CycRefresh();
+}
+
+/* ---------- Traps ---------- */
+
+static bool Sim_EntryWanted(void)
+{
+    if (s_inModel != 0 || s_step.active)
+        return false;
+    if (s_onFw && (s_now >= s_stopAt || s_resetReq || s_stopReq || s_jumpReq))
+        return true;
+    return Sim_NextExc(false) >= 0;
+}
+
+/* Push a call to Sim_IrqEntry onto the interrupted context, past the red zone */
+static void Sim_InjectEntry(ucontext_t *pUc)
+{
+    greg_t *g = pUc->uc_mcontext.gregs;
+    uint64_t sp = (uint64_t)g[REG_RSP] - SIM_RED_ZONE - 8u;
+
+    *(uint64_t *)sp = (uint64_t)g[REG_RIP];
+    g[REG_RSP] = (greg_t)sp;
+    g[REG_RIP] = (greg_t)(uintptr_t)Sim_IrqEntry;
+}
+
+/* Time stands still while the CPU polls a register: skip to the next event instead */
+static void Sim_SpinCheck(uintptr_t rip, uint32_t addr)
+{
+    uint64_t next;
+
+    if (rip != s_spinRip || addr != s_spinAddr) {
+        s_spinRip = rip;
+        s_spinAddr = addr;
+        s_spinCount = 0;
+        return;
+    }
+    if (++s_spinCount < SIM_SPIN_READS)
+        return;
+    s_spinCount = 0;
+    next = Sim_NextEvent();
+    if (s_onFw && next > s_stopAt)
+        next = s_stopAt;
+    if (next != UINT64_MAX && next > s_now)
+        Sim_AdvanceTo(next);
+}
+
+/* MOV r/m, MOV imm, MOVZX/MOVSX and the moffs forms with 8/16/32-bit memory operands;
+ * false for anything else (64-bit, AH..BH, RMW instructions), which is single-stepped */
+static bool Sim_Decode(const uint8_t *p, Sim_Insn *pIn)
+{
+    const uint8_t *p0 = p;
+    bool opSize = false;
+    bool addr32 = false;
+    uint8_t rex = 0;
+    uint8_t op;
+    uint8_t modrm;
+    uint8_t immLen = 0;
+    uint32_t regNo;
+
+    memset(pIn, 0, sizeof(*pIn));
+    for (;; p++) {
+        if (*p == 0x66u)
+            opSize = true;
+        else if (*p == 0x67u)
+            addr32 = true;
+        else
+            break;
+    }
+    if ((*p & 0xF0u) == 0x40u)
+        rex = *p++;
+    if (rex & 0x08u)
+        return false;
+    pIn->regSize = opSize ? 2u : 4u;
+    pIn->size = pIn->regSize;
+    op = *p++;
+    switch (op) {
+    case 0x88u: pIn->size = 1u; pIn->regSize = 1u; pIn->store = true; break;
+    case 0x89u: pIn->store = true; break;
+    case 0x8Au: pIn->size = 1u; pIn->regSize = 1u; break;
+    case 0x8Bu: break;
+    case 0xC6u: pIn->size = 1u; pIn->store = true; immLen = 1u; break;
+    case 0xC7u: pIn->store = true; immLen = opSize ? 2u : 4u; break;
+    case 0xA0u: case 0xA1u: case 0xA2u: case 0xA3u:
+        if (!(op & 1u))
+            pIn->size = pIn->regSize = 1u;
+        pIn->store = (op & 2u) != 0u;
+        pIn->reg = REG_RAX;
+        pIn->len = (uint8_t)(p - p0 + (addr32 ? 4 : 8));
+        return true;
+    case 0x0Fu:
+        op = *p++;
+        if ((op & 0xF6u) != 0xB6u)      /* B6 B7 BE BF */
+            return false;
+        pIn->size = (op & 1u) ? 2u : 1u;
+        pIn->sext = (op & 8u) != 0u;
+        break;
+    default:
+        return false;
+    }
+    modrm = *p++;
+    if ((modrm >> 6) == 3u)
+        return false;
+    if ((modrm & 7u) == 4u) {
+        if ((modrm >> 6) == 0u && (*p & 7u) == 5u)
+            p += 4;
+        p++;
+    } else if ((modrm >> 6) == 0u && (modrm & 7u) == 5u) {
+        p += 4;
+    }
+    if ((modrm >> 6) == 1u)
+        p += 1;
+    else if ((modrm >> 6) == 2u)
+        p += 4;
+    regNo = ((modrm >> 3) & 7u) | ((rex & 0x04u) ? 8u : 0u);
+    if (immLen != 0u) {
+        if (regNo != 0u)
+            return false;
+        pIn->reg = -1;
+        pIn->imm = immLen == 1u ? *p : (immLen == 2u ? *(const uint16_t *)p : *(const uint32_t *)p);
+        p += immLen;
+    } else {
+        if (pIn->regSize == 1u && rex == 0u && regNo >= 4u)
+            return false;
+        pIn->reg = s_gregOf[regNo];
+    }
+    pIn->len = (uint8_t)(p - p0);
+    return true;
+}
+
+/* Load into the register operand: 32-bit writes clear the upper half, narrower keep it */
+static void Sim_SetReg(greg_t *pReg, uint8_t regSize, uint32_t v)
+{
+    uint64_t r = (uint64_t)*pReg;
+
+    if (regSize == 4u)
+        r = v;
+    else if (regSize == 2u)
+        r = (r & ~0xFFFFull) | (v & 0xFFFFu);
+    else
+        r = (r & ~0xFFull) | (v & 0xFFu);
+    *pReg = (greg_t)r;
+}
+
+static void Sim_StepPost(void)
+{
+    uint32_t *pWord = (uint32_t *)Sim_Backdoor(s_step.addr & ~3u);
+    uint32_t val = *pWord;
+
+    if (s_step.pHook != NULL && s_step.pHook->post != NULL &&
+        (s_step.write || (s_step.pHook->trap & SIM_TRAP_RD))) {
+        s_inModel++;
+        s_step.pHook->post(s_step.addr, s_step.write, s_step.old, val);
+        s_inModel--;
+    } else if (s_step.write && Sim_AreaOf(s_step.addr) == &s_flash) {
+        *pWord = s_step.old;    /* flash is not writable without the controller */
+    }
+}
+
+/* The access done on the backdoor, no page opened */
+static void Sim_Emulate(ucontext_t *pUc, const Sim_Insn *pIn)
+{
+    greg_t *g = pUc->uc_mcontext.gregs;
+    uint32_t *pWord = (uint32_t *)Sim_Backdoor(s_step.addr & ~3u);
+    uint8_t *pByte = (uint8_t *)Sim_Backdoor(s_step.addr);
+    uint32_t v;
+
+    if (pIn->store) {
+        v = pIn->reg < 0 ? pIn->imm : (uint32_t)g[pIn->reg];
+        if (s_step.bitband)
+            *pWord = (s_step.old & ~(1u << s_step.bit)) | ((v & 1u) << s_step.bit);
+        else
+            memcpy(pByte, &v, pIn->size);
+    } else {
+        if (s_step.bitband) {
+            v = (s_step.old >> s_step.bit) & 1u;
+        } else {
+            v = 0;
+            memcpy(&v, pByte, pIn->size);
+        }
+        if (pIn->sext)
+            v = pIn->size == 1u ? (uint32_t)(int32_t)(int8_t)v : (uint32_t)(int32_t)(int16_t)v;
+        Sim_SetReg(&g[pIn->reg], pIn->regSize, v);
+    }
+    g[REG_RIP] += pIn->len;
+    Sim_StepPost();
+}
+
+static void Sim_ProfileText(bool exec)
+{
+    if (s_textEnd > s_textBase)
+        mprotect((void *)s_textBase, s_textEnd - s_textBase, exec ? PROT_READ | PROT_EXEC : PROT_READ);
+    s_profOut = !exec;
+}
+
+static void Sim_ProfileCycle(void)
+{
+    uint32_t hz = Sim_Rcc_SysClk();
+
+    s_profInsns++;
+    s_profFrac += 1000000000ull;
+    if (s_profFrac >= hz) {
+        Sim_AdvanceTo(s_now + s_profFrac / hz);
+        s_profFrac %= hz;
+    }
+}
+
+/* Profiling: one core cycle per image instruction; leaving the image (intrinsics, models,
+ * the test) stops the stepping until the text is entered again */
+static void Sim_ProfileStep(ucontext_t *pUc)
+{
+    uintptr_t rip = (uintptr_t)pUc->uc_mcontext.gregs[REG_RIP];
+
+    if (rip < s_textBase || rip >= s_textEnd) {
+        Sim_ProfileText(false);
+        return;
+    }
+    pUc->uc_mcontext.gregs[REG_EFL] |= SIM_TF;
+    s_progress++;
+    Sim_ProfileCycle();
+}
+
+static void Sim_OnSegv(int sig, siginfo_t *pInfo, void *pv)
+{
+    ucontext_t *pUc = pv;
+    uintptr_t host = (uintptr_t)pInfo->si_addr;
+    bool write = (pUc->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+    uint32_t addr = (uint32_t)host;
+    Sim_Area *pArea;
+    uint32_t *pWord;
+    Sim_Insn insn;
+
+    (void)sig;
+    s_progress++;
+    /* Profiling: back into the image text */
+    if (s_profOut && host == (uintptr_t)pUc->uc_mcontext.gregs[REG_RIP] &&
+        host >= s_textBase && host < s_textEnd) {
+        Sim_ProfileText(true);
+        if (s_profile)
+            Sim_ProfileStep(pUc);
+        return;
+    }
+    if (host >> 32 != 0 || s_step.active || s_inModel != 0) {
+        Sim_PrintAddr("fault at", (uintptr_t)pUc->uc_mcontext.gregs[REG_RIP]);
+        SIM_FATAL("%s of 0x%lx%s", write ? "write" : "read", (unsigned long)host,
+                  s_inModel != 0 ? " inside a model" : "");
+    }
+    /* Instruction fetch from the flash array: the bootloader branching to the application */
+    if (host == (uintptr_t)pUc->uc_mcontext.gregs[REG_RIP] && addr - SIM_FLASH_BASE < SIM_FLASH_SIZE &&
+        s_pBootImage != NULL && s_pLoaded == s_pBootImage) {
+        pUc->uc_mcontext.gregs[REG_RIP] = (greg_t)(uintptr_t)Sim_JumpImage;
+        return;
+    }
+    if (Sim_EntryWanted()) {
+        Sim_InjectEntry(pUc);
+        return;
+    }
+    memset(&s_step, 0, sizeof(s_step));
+    s_step.write = write;
+    if (addr - SIM_BITBAND_BASE < SIM_BITBAND_SIZE) {
+        s_step.bitband = true;
+        s_step.bit = ((addr - SIM_BITBAND_BASE) >> 2) & 31u;
+        s_step.addr = SIM_PERIPH_BASE + (((addr - SIM_BITBAND_BASE) >> 5) & ~3u);
+        s_step.prot = PROT_NONE;
+    } else {
+        s_step.addr = addr;
+    }
+    pArea = Sim_AreaOf(s_step.addr);
+    if (pArea == NULL) {
+        Sim_PrintAddr("fault at", (uintptr_t)pUc->uc_mcontext.gregs[REG_RIP]);
+        SIM_FATAL("%s of unmapped MCU address 0x%08X", write ? "write" : "read", addr);
+    }
+    if (!s_step.bitband)
+        s_step.prot = Sim_PageProt(pArea, addr);
+    s_step.pHook = Sim_FindHook(s_step.addr);
+    if (s_step.pHook != NULL) {
+        if (write)
+            ((Sim_HookDef *)s_step.pHook)->writes++;
+        else
+            ((Sim_HookDef *)s_step.pHook)->reads++;
+    }
+    pWord = (uint32_t *)Sim_Backdoor(s_step.addr & ~3u);
+
+    s_inModel++;
+    Sim_AdvanceTo(s_now + SIM_ACCESS_NS);
+    if (!write)
+        Sim_SpinCheck((uintptr_t)pUc->uc_mcontext.gregs[REG_RIP], s_step.addr);
+    if (s_step.pHook != NULL && s_step.pHook->pre != NULL)
+        s_step.pHook->pre(s_step.addr, write, *pWord, 0);
+    s_inModel--;
+    s_step.old = *pWord;
+    if (Sim_Decode((const uint8_t *)pUc->uc_mcontext.gregs[REG_RIP], &insn) &&
+        insn.store == write && ((s_step.addr & 3u) + insn.size <= 4u || s_step.bitband)) {
+        s_emulated++;
+        Sim_Emulate(pUc, &insn);
+        return;
+    }
+    s_stepped++;
+    s_step.host = host & ~(uintptr_t)3u;
+    s_step.page = host & SIM_PAGE_MASK;
+    s_step.active = true;
+    mprotect((void *)s_step.page, SIM_PAGE, PROT_READ | PROT_WRITE);
+    if (s_step.bitband)
+        *(uint32_t *)s_step.host = (s_step.old >> s_step.bit) & 1u;
+    pUc->uc_mcontext.gregs[REG_EFL] |= SIM_TF;
+}
+
+static void Sim_OnTrap(int sig, siginfo_t *pInfo, void *pv)
+{
+    ucontext_t *pUc = pv;
+    uint32_t *pWord;
+    uint32_t val;
+
+    (void)sig;
+    (void)pInfo;
+    pUc->uc_mcontext.gregs[REG_EFL] &= ~SIM_TF;
+    if (!s_step.active && !s_profile)
+        SIM_FATAL("unexpected SIGTRAP");
+    if (s_step.active) {
+        pWord = (uint32_t *)Sim_Backdoor(s_step.addr & ~3u);
+        if (s_step.bitband) {
+            if (s_step.write) {
+                val = *(volatile uint32_t *)s_step.host & 1u;
+                *pWord = (s_step.old & ~(1u << s_step.bit)) | (val << s_step.bit);
+            }
+        }
+        mprotect((void *)s_step.page, SIM_PAGE, s_step.prot);
+        s_step.active = false;
+        Sim_StepPost();
+    }
+    if (s_profile)
+        Sim_ProfileStep(pUc);
+}
+
+/* Wall clock guard: a firmware loop that never polls a register stops virtual time */
+static void Sim_OnAlarm(int sig, siginfo_t *pInfo, void *pv)
+{
+    static uint32_t s_last = 0;
+    static uint32_t s_stuck = 0;
+    ucontext_t *pUc = pv;
+
+    (void)sig;
+    (void)pInfo;
+    if (s_progress != s_last || s_inModel != 0) {
+        s_last = s_progress;
+        s_stuck = 0;
+        return;
+    }
+    if (++s_stuck >= 10u) {
+        Sim_PrintAddr("no register access or intrinsic for 10 s, CPU at",
+                      (uintptr_t)pUc->uc_mcontext.gregs[REG_RIP]);
+        SIM_FATAL("firmware stuck in a loop without time");
+    }
+}
+
+static void Sim_InstallTraps(void)
+{
+    struct sigaction sa;
+    stack_t ss;
+    struct itimerval it;
+
+    ss.ss_sp = s_altStack;
+    ss.ss_size = sizeof(s_altStack);
+    ss.ss_flags = 0;
+    sigaltstack(&ss, NULL);
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    sa.sa_sigaction = Sim_OnSegv;
+    sigaction(SIGSEGV, &sa, NULL);
+    sigaction(SIGBUS, &sa, NULL);
+    sa.sa_sigaction = Sim_OnTrap;
+    sigaction(SIGTRAP, &sa, NULL);
+    sa.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+    sa.sa_sigaction = Sim_OnAlarm;
+    sigaction(SIGALRM, &sa, NULL);
+    it.it_interval.tv_sec = 1;
+    it.it_interval.tv_usec = 0;
+    it.it_value = it.it_interval;
+    setitimer(ITIMER_REAL, &it, NULL);
+}
+
+/* ---------- Polling, intrinsics ---------- */
+
+/* Back to the host; main() resumes here on the next Sim_RunFor unless the image reset */
+static void Sim_Yield(void)
+{
+    s_onFw = false;
+    swapcontext(&s_fwCtx, &s_hostCtx);
+    s_onFw = true;
+}
+
+static void Sim_CheckStop(void)
+{
+    if (s_onFw && (s_now >= s_stopAt || s_resetReq || s_stopReq || s_jumpReq))
+        Sim_Yield();
+}
+
+void Sim_Poll(uint32_t ns)
+{
+    if (s_inModel != 0)
+        return;
+    s_progress++;
+    s_polls++;
+    /* An intrinsic is one instruction when instructions are being counted */
+    if (s_profile)
+        Sim_ProfileCycle();
+    else
+        Sim_AdvanceTo(s_now + ns);
+    Sim_TakeIrqs();
+    Sim_CheckStop();
+}
+
+void Sim_IrqEntryC(void)
+{
+    Sim_TakeIrqs();
+    Sim_CheckStop();
+}
+
+static void Sim_EnterStop(void)
+{
+    uint32_t i;
+
+    Sim_Core_ClockChange();
+    s_inStop = true;
+    s_stopEnter = s_now;
+    Sim_TimerStop(&s_stTimer);
+    for (i = 0; i < SIM_MODEL_NUM; i++) {
+        if (s_models[i]->stop != NULL)
+            s_models[i]->stop(true);
+    }
+}
+
+static void Sim_ExitStop(void)
+{
+    uint32_t i;
+
+    s_inStop = false;
+    s_stopNs += s_now - s_stopEnter;
+    s_cycBase = s_now;          /* the core clock was off */
+    for (i = 0; i < SIM_MODEL_NUM; i++) {
+        if (s_models[i]->stop != NULL)
+            s_models[i]->stop(false);
+    }
+    Sim_Core_ClockChanged();
+}
+
+/* Where the simulation time goes: trapped accesses per register block, timer events */
+void Sim_Profile(bool on)
+{
+    s_profile = on;
+    Sim_ProfileText(!on);
+}
+
+uint64_t Sim_Profile_GetInsns(void)
+{
+    return s_profInsns;
+}
+
+void Sim_PrintStats(void)
+{
+    uint32_t i;
+
+    fprintf(stderr, "sim: %llu timer events, %llu intrinsics, %llu accesses emulated, %llu single-stepped\n",
+            (unsigned long long)s_timerFires, (unsigned long long)s_polls,
+            (unsigned long long)s_emulated, (unsigned long long)s_stepped);
+    for (i = 0; i < sizeof(s_timerStats) / sizeof(s_timerStats[0]) && s_timerStats[i].fn != NULL; i++) {
+        Dl_info info;
+        fprintf(stderr, "sim: %10llu x %s\n", (unsigned long long)s_timerStats[i].n,
+                dladdr((void *)s_timerStats[i].fn, &info) && info.dli_sname != NULL ? info.dli_sname : "?");
+    }
+    for (i = 0; i < s_hookNum; i++) {
+        if (s_hooks[i].reads + s_hooks[i].writes == 0u)
+            continue;
+        fprintf(stderr, "sim: 0x%08X +0x%05X  %10llu reads %10llu writes\n", s_hooks[i].base,
+                s_hooks[i].size, (unsigned long long)s_hooks[i].reads,
+                (unsigned long long)s_hooks[i].writes);
+    }
+}
+
+uint64_t Sim_Power_GetStopNs(void)
+{
+    return s_stopNs + (s_inStop ? s_now - s_stopEnter : 0);
+}
+
+/* WFI: wake on any pending enabled interrupt that outranks the current level, PRIMASK
+ * or not; SLEEPDEEP (with PWR PDDS clear) is STOP */
+static void Sim_Sleep(void)
+{
+    bool deep = (SIM_BD(SCB)->SCR & SCB_SCR_SLEEPDEEP_Msk) != 0;
+    uint64_t next;
+
+    if (deep)
+        Sim_EnterStop();
+    s_wakeEvt = false;
+    while (Sim_NextExc(true) < 0 && !s_wakeEvt) {
+        if (s_resetReq || s_stopReq || s_jumpReq || s_now >= s_stopAt) {
+            if (!s_onFw)
+                break;
+            Sim_Yield();
+            continue;
+        }
+        next = Sim_NextEvent();
+        if (next > s_stopAt)
+            next = s_stopAt;
+        if (next == UINT64_MAX)
+            SIM_FATAL("WFI with nothing scheduled");
+        s_progress++;
+        Sim_AdvanceTo(next);
+    }
+    if (deep)
+        Sim_ExitStop();
+    Sim_TakeIrqs();
+}
+
+void __enable_irq(void)         { s_primask = 0; Sim_Poll(SIM_INSN_NS); }
+void __disable_irq(void)        { s_primask = 1; Sim_Poll(SIM_INSN_NS); }
+void __enable_fault_irq(void)   { s_faultmask = 0; Sim_Poll(SIM_INSN_NS); }
+void __disable_fault_irq(void)  { s_faultmask = 1; Sim_Poll(SIM_INSN_NS); }
+void __NOP(void)                { Sim_Poll(SIM_INSN_NS); }
+void __WFI(void)                { Sim_Poll(SIM_INSN_NS); Sim_Sleep(); }
+void __WFE(void)                { Sim_Poll(SIM_INSN_NS); Sim_Sleep(); }
+void __SEV(void)                { s_wakeEvt = true; Sim_Poll(SIM_INSN_NS); }
+void __ISB(void)                { Sim_Poll(SIM_INSN_NS); }
+void __DSB(void)                { Sim_Poll(SIM_INSN_NS); }
+void __DMB(void)                { Sim_Poll(SIM_INSN_NS); }
+void __CLREX(void)              { }
+uint32_t __get_PRIMASK(void)    { return s_primask; }
+void __set_PRIMASK(uint32_t priMask) { s_primask = priMask & 1u; Sim_Poll(SIM_INSN_NS); }
+uint32_t __get_BASEPRI(void)    { return s_basepri; }
+void __set_BASEPRI(uint32_t basePri) { s_basepri = basePri & 0xFFu; Sim_Poll(SIM_INSN_NS); }
+uint32_t __get_FAULTMASK(void)  { return s_faultmask; }
+void __set_FAULTMASK(uint32_t faultMask) { s_faultmask = faultMask & 1u; Sim_Poll(SIM_INSN_NS); }
+uint32_t __get_CONTROL(void)    { return 0; }
+void __set_CONTROL(uint32_t control) { (void)control; }
+/* No Cortex-M stack exists: fault capture code sees an empty SRAM stack */
+uint32_t __get_PSP(void)        { return SIM_SRAM_BASE + SIM_SRAM_SIZE; }
+void __set_PSP(uint32_t topOfProcStack) { (void)topOfProcStack; }
+uint32_t __get_MSP(void)        { return SIM_SRAM_BASE + SIM_SRAM_SIZE; }
+void __set_MSP(uint32_t topOfMainStack) { (void)topOfMainStack; }
+uint32_t __REV(uint32_t value)  { return __builtin_bswap32(value); }
+uint32_t __REV16(uint16_t value) { return __builtin_bswap16(value); }
+int32_t __REVSH(int16_t value)  { return (int16_t)__builtin_bswap16((uint16_t)value); }
+
+uint32_t __RBIT(uint32_t value)
+{
+    uint32_t r = 0;
+    int i;
+
+    for (i = 0; i < 32; i++, value >>= 1)
+        r = (r << 1) | (value & 1u);
+    return r;
+}
+
+/* ---------- Image loading ---------- */
+
+/* .noinit of the image: kept across warm resets like the SRAM it lives in on the target */
+static void Sim_FindNoInit(void)
+{
+    struct link_map *pMap = NULL;
+    Elf64_Ehdr eh;
+    Elf64_Shdr *pSh = NULL;
+    char *pNames = NULL;
+    FILE *f;
+    int i;
+
+    s_pNoInit = NULL;
+    s_noInitLen = 0;
+    if (dlinfo(s_pDl, RTLD_DI_LINKMAP, &pMap) != 0 || (f = fopen(s_pLoaded, "rb")) == NULL)
+        return;
+    if (fread(&eh, sizeof(eh), 1, f) == 1 && eh.e_shentsize == sizeof(Elf64_Shdr)) {
+        pSh = calloc(eh.e_shnum, sizeof(Elf64_Shdr));
+        fseek(f, (long)eh.e_shoff, SEEK_SET);
+        if (fread(pSh, sizeof(Elf64_Shdr), eh.e_shnum, f) == eh.e_shnum) {
+            pNames = malloc(pSh[eh.e_shstrndx].sh_size);
+            fseek(f, (long)pSh[eh.e_shstrndx].sh_offset, SEEK_SET);
+            if (fread(pNames, 1, pSh[eh.e_shstrndx].sh_size, f) == pSh[eh.e_shstrndx].sh_size) {
+                for (i = 0; i < eh.e_shnum; i++) {
+                    if (strcmp(pNames + pSh[i].sh_name, ".noinit") == 0) {
+                        s_pNoInit = (uint8_t *)(pMap->l_addr + pSh[i].sh_addr);
+                        s_noInitLen = pSh[i].sh_size;
+                    }
+                }
+            }
+        }
+    }
+    free(pNames);
+    free(pSh);
+    fclose(f);
+}
+
+static uint32_t Sim_NoInitSlot(const char *pPath)
+{
+    return (s_pBootImage != NULL && pPath == s_pBootImage) ? 1u : 0u;
+}
+
+static void Sim_Unload(void)
+{
+    uint32_t slot;
+
+    if (s_pDl == NULL)
+        return;
+    if (s_pNoInit != NULL) {
+        slot = Sim_NoInitSlot(s_pLoaded);
+        s_noInitSave[slot].pData = realloc(s_noInitSave[slot].pData, s_noInitLen);
+        memcpy(s_noInitSave[slot].pData, s_pNoInit, s_noInitLen);
+        s_noInitSave[slot].len = s_noInitLen;
+        s_noInitSave[slot].pPath = s_pLoaded;
+    }
+    Sim_Rtt_Bind(NULL);
+    dlclose(s_pDl);
+    s_pDl = NULL;
+    s_pNoInit = NULL;
+}
+
+static int Sim_PhdrCb(struct dl_phdr_info *pInfo, size_t size, void *pCtx)
+{
+    int i;
+
+    (void)size;
+    if (pInfo->dlpi_addr != *(uintptr_t *)pCtx)
+        return 0;
+    for (i = 0; i < pInfo->dlpi_phnum; i++) {
+        const ElfW(Phdr) *pPh = &pInfo->dlpi_phdr[i];
+
+        if (pPh->p_type != PT_LOAD)
+            continue;
+        if (pInfo->dlpi_addr + pPh->p_vaddr + pPh->p_memsz > s_imageEnd)
+            s_imageEnd = pInfo->dlpi_addr + pPh->p_vaddr + pPh->p_memsz;
+        if (pPh->p_flags & PF_X) {
+            s_textBase = (pInfo->dlpi_addr + pPh->p_vaddr) & SIM_PAGE_MASK;
+            s_textEnd = (pInfo->dlpi_addr + pPh->p_vaddr + pPh->p_memsz + SIM_PAGE - 1u) & SIM_PAGE_MASK;
+        }
+    }
+    return 1;
+}
+
+/* The image's low 32 bits against an identity mapped MCU window */
+static bool Sim_ImageOverlaps(uint32_t base, uint32_t size)
+{
+    uint32_t lo = (uint32_t)s_imageBase;
+    uint32_t hi = (uint32_t)(s_imageEnd - 1u);
+
+    return lo < base + size && hi >= base;
+}
+
+static void Sim_Load(const char *pPath, bool keepNoInit)
+{
+    struct link_map *pMap = NULL;
+    uint32_t slot = Sim_NoInitSlot(pPath);
+    size_t i;
+    int exc;
+
+    s_pDl = dlopen(pPath, RTLD_NOW | RTLD_LOCAL);
+    if (s_pDl == NULL)
+        SIM_FATAL("dlopen: %s", dlerror());
+    s_pLoaded = pPath;
+    dlinfo(s_pDl, RTLD_DI_LINKMAP, &pMap);
+    s_imageBase = pMap->l_addr;
+    s_imageEnd = 0;
+    dl_iterate_phdr(Sim_PhdrCb, &s_imageBase);
+    if ((s_imageBase >> 32) != ((s_imageEnd - 1u) >> 32))
+        SIM_FATAL("image straddles a 4 GiB boundary, DMA addresses would be ambiguous");
+    if (Sim_ImageOverlaps(SIM_FLASH_BASE, SIM_FLASH_SIZE) ||
+        Sim_ImageOverlaps(SIM_SRAM_BASE, SIM_STACK_BASE + SIM_STACK_SIZE - SIM_SRAM_BASE))
+        SIM_FATAL("image at 0x%lx overlaps the MCU windows in its low 32 bits", (unsigned long)s_imageBase);
+    for (exc = 0; exc < SIM_EXC_NUM; exc++)
+        s_vec[exc] = s_excNames[exc] != NULL ? (void (*)(void))dlsym(s_pDl, s_excNames[exc]) : NULL;
+    Sim_FindNoInit();
+    if (s_pNoInit != NULL) {
+        if (keepNoInit && s_noInitSave[slot].pPath == pPath && s_noInitSave[slot].len == s_noInitLen) {
+            memcpy(s_pNoInit, s_noInitSave[slot].pData, s_noInitLen);
+        } else {
+            /* SRAM content after power-up is undefined */
+            for (i = 0; i < s_noInitLen; i++)
+                s_pNoInit[i] = (uint8_t)(i * 0x9Du + (s_now >> 10) + 0x5Au);
+        }
+    }
+    Sim_Rtt_Bind(dlsym(s_pDl, "_SEGGER_RTT"));
+}
+
+void *Sim_Sym(const char *pName)
+{
+    void *p = s_pDl != NULL ? dlsym(s_pDl, pName) : NULL;
+
+    if (p == NULL)
+        SIM_FATAL("symbol %s not in the image", pName);
+    return p;
+}
+
+void *Sim_SramAlloc(size_t len)
+{
+    uint32_t p = (s_sramTop + 7u) & ~7u;
+
+    if (p + len > SIM_STACK_BASE)
+        SIM_FATAL("sim SRAM pool exhausted");
+    s_sramTop = p + (uint32_t)len;
+    return (void *)(uintptr_t)p;
+}
+
+/* ---------- Run control ---------- */
+
+void Sim_Init(const char *pImage)
+{
+    uint32_t i;
+
+    s_pImage = pImage;
+    Sim_MapArea(&s_flash, PROT_READ);
+    Sim_MapArea(&s_periph, PROT_READ | PROT_WRITE);
+    Sim_MapArea(&s_core, PROT_READ | PROT_WRITE);
+    memset(s_flash.pBd, 0xFF, s_flash.size);
+    Sim_MapPlain(SIM_SYSMEM_BASE, SIM_PAGE, PROT_READ | PROT_WRITE);
+    *(volatile uint16_t *)(uintptr_t)0x1FFFF7E0u = 512u;              /* flash size, KiB */
+    *(volatile uint32_t *)(uintptr_t)0x1FFFF7E8u = 0x0657FF36u;       /* unique ID */
+    *(volatile uint32_t *)(uintptr_t)0x1FFFF7ECu = 0x34324B43u;
+    *(volatile uint32_t *)(uintptr_t)0x1FFFF7F0u = 0x43086622u;
+    Sim_MapPlain(SIM_SRAM_BASE, SIM_STACK_BASE + SIM_STACK_SIZE - SIM_SRAM_BASE, PROT_READ | PROT_WRITE);
+    Sim_MapPlain(SIM_BITBAND_BASE, SIM_BITBAND_SIZE, PROT_NONE);
+
+    Sim_MapRegs((uint32_t)(uintptr_t)SysTick, 0x10u, SIM_TRAP_WR | SIM_TRAP_RD, Sim_ScsPre, Sim_ScsPost);
+    Sim_MapRegs((uint32_t)(uintptr_t)NVIC, 0xE04u, SIM_TRAP_WR | SIM_TRAP_RD, Sim_ScsPre, Sim_ScsPost);
+    Sim_MapRegs((uint32_t)(uintptr_t)SCB, 0x100u, SIM_TRAP_WR | SIM_TRAP_RD, Sim_ScsPre, Sim_ScsPost);
+    Sim_MapRegs(SIM_DWT_CTRL, 0x100u, SIM_TRAP_WR, NULL, Sim_DwtPost);
+    for (i = 0; i < SIM_MODEL_NUM; i++) {
+        if (s_models[i]->init != NULL)
+            s_models[i]->init();
+    }
+    Sim_InstallTraps();
+}
+
+void Sim_SetBootImage(const char *pBoot)
+{
+    s_pBootImage = pBoot;
+}
+
+void Sim_SetAutoReboot(bool on)
+{
+    s_autoReboot = on;
+}
+
+void Sim_SetBootHook(void (*fn)(Sim_ResetCause cause))
+{
+    s_bootHook = fn;
+}
+
+uint32_t Sim_GetResetCount(void)
+{
+    return s_resets;
+}
+
+Sim_ResetCause Sim_GetLastReset(void)
+{
+    return s_lastReset;
+}
+
+void Sim_Boot(Sim_ResetCause cause)
+{
+    bool warm = (cause != E_SIM_RESET_POWER);
+    uint32_t i;
+
+    if (s_pDl != NULL)
+        s_resets++;
+    Sim_Unload();
+    s_started = false;
+    s_resetReq = false;
+    s_jumpReq = false;
+    s_lastReset = cause;
+    Sim_CoreReset();
+    for (i = 0; i < SIM_MODEL_NUM; i++) {
+        if (s_models[i]->reset != NULL)
+            s_models[i]->reset(cause);
+    }
+    if (!warm)
+        memset((void *)(uintptr_t)SIM_SRAM_BASE, 0xA5, SIM_SRAM_SIZE);
+    Sim_Load(s_pBootImage != NULL ? s_pBootImage : s_pImage, warm);
+    if (s_bootHook != NULL)
+        s_bootHook(cause);
+}
+
+/* Bootloader hand-over: the application image replaces the bootloader, core state as after
+ * the jump (interrupts as left, peripherals untouched) */
+void Sim_JumpImage(void)
+{
+    s_jumpReq = true;
+    Sim_Poll(SIM_INSN_NS);
+    SIM_FATAL("image jump not taken");
+}
+
+static void Sim_FwEntry(void)
+{
+    void (*sysInit)(void) = (void (*)(void))Sim_Sym("SystemInit");
+    int (*fwMain)(void) = (int (*)(void))Sim_Sym("M600_Main");
+
+    sysInit();
+    fwMain();
+    SIM_FATAL("main() returned");
+}
+
+void Sim_Start(void)
+{
+    getcontext(&s_fwCtx);
+    s_fwCtx.uc_stack.ss_sp = (void *)(uintptr_t)SIM_STACK_BASE;
+    s_fwCtx.uc_stack.ss_size = SIM_STACK_SIZE;
+    s_fwCtx.uc_link = NULL;
+    makecontext(&s_fwCtx, Sim_FwEntry, 0);
+    s_started = true;
+}
+
+static void Sim_Idle(void)
+{
+    uint64_t next;
+
+    while (s_now < s_stopAt && !s_resetReq && !s_stopReq) {
+        Sim_TakeIrqs();
+        next = Sim_NextEvent();
+        if (next > s_stopAt)
+            next = s_stopAt;
+        Sim_AdvanceTo(next);
+    }
+    Sim_TakeIrqs();
+}
+
+Sim_StopReason Sim_RunFor(uint64_t ns)
+{
+    uint64_t end = s_now + ns;
+    bool run;
+
+    s_stopReq = false;
+    for (;;) {
+        s_stopAt = end;
+        if (s_started) {
+            s_onFw = true;
+            swapcontext(&s_hostCtx, &s_fwCtx);
+            s_onFw = false;
+        } else {
+            Sim_Idle();
+        }
+        if (s_jumpReq) {
+            s_jumpReq = false;
+            Sim_Unload();
+            Sim_Load(s_pImage, s_lastReset != E_SIM_RESET_POWER);
+            Sim_Start();
+            continue;
+        }
+        if (s_resetReq) {
+            run = s_started;
+            if (!s_autoReboot) {
+                s_started = false;
+                return E_SIM_STOP_RESET;
+            }
+            Sim_Boot(s_resetCause);
+            if (run)
+                Sim_Start();
+            continue;
+        }
+        if (s_stopReq)
+            return E_SIM_STOP_REQUEST;
+        if (s_now >= end)
+            return E_SIM_STOP_TIME;
+    }
+}
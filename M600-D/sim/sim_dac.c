@@ -0,0 +1,110 @@
+/************************************************************************************
+ * @file     : sim_dac.c
+ * @brief    : Host simulator - DAC channel 1 (PA4)
+ * @details  : DHR moves to DOR one APB1 cycle after the write when the trigger is off,
+ *             otherwise at the selected trigger (TIM6 TRGO or SWTRIG). With DMAEN1 each
+ *             trigger also requests the next sample on DMA2 Channel3, so the sample the
+ *             DMA has just written appears at the following trigger, as on the part.
+ *             Channel 2 and the wave generators are not modelled.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_DAC_TSEL_TIM6   0u
+#define SIM_DAC_TSEL_SW     7u
+
+static uint16_t s_dhr = 0;
+static Sim_DacWatchFn s_watch = NULL;
+static void *s_pWatchCtx = NULL;
+
+static void Sim_Dac_Output(uint16_t code)
+{
+    SIM_BD(DAC)->DOR1 = code;
+    if (s_watch != NULL)
+        s_watch(code, s_pWatchCtx);
+}
+
+static void Sim_Dac_Transfer(void)
+{
+    uint32_t cr = SIM_BD(DAC)->CR;
+
+    if (!(cr & DAC_CR_EN1))
+        return;
+    Sim_Dac_Output(s_dhr);
+    if (cr & DAC_CR_DMAEN1)
+        Sim_Dma_Request(2u, 3u);
+}
+
+/* TIM6 TRGO */
+void Sim_Dac_Trigger(void)
+{
+    uint32_t cr = SIM_BD(DAC)->CR;
+
+    if ((cr & DAC_CR_TEN1) && ((cr & DAC_CR_TSEL1) >> 3) == SIM_DAC_TSEL_TIM6)
+        Sim_Dac_Transfer();
+}
+
+static void Sim_Dac_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    uint32_t cr = SIM_BD(DAC)->CR;
+    bool load = true;
+
+    (void)old;
+    if (!write)
+        return;
+    switch ((addr & ~3u) - DAC_BASE) {
+    case 0x04u:     /* SWTRIGR */
+        SIM_BD(DAC)->SWTRIGR = 0;
+        if ((val & DAC_SWTRIGR_SWTRIG1) && (cr & DAC_CR_TEN1) && ((cr & DAC_CR_TSEL1) >> 3) == SIM_DAC_TSEL_SW)
+            Sim_Dac_Transfer();
+        return;
+    case 0x08u:     /* DHR12R1 */
+        s_dhr = (uint16_t)(val & 0xFFFu);
+        break;
+    case 0x0Cu:     /* DHR12L1 */
+        s_dhr = (uint16_t)((val >> 4) & 0xFFFu);
+        break;
+    case 0x10u:     /* DHR8R1 */
+        s_dhr = (uint16_t)((val & 0xFFu) << 4);
+        break;
+    case 0x20u:     /* DHR12RD */
+        s_dhr = (uint16_t)(val & 0xFFFu);
+        break;
+    case 0x2Cu:     /* DOR1: read-only */
+    case 0x30u:
+        SIM_BD(DAC)->DOR1 = old;
+        return;
+    default:
+        load = false;
+        break;
+    }
+    if (load && (cr & DAC_CR_EN1) && !(cr & DAC_CR_TEN1))
+        Sim_Dac_Output(s_dhr);
+}
+
+void Sim_Dac_Watch(Sim_DacWatchFn fn, void *pCtx)
+{
+    s_watch = fn;
+    s_pWatchCtx = pCtx;
+}
+
+uint16_t Sim_Dac_Get(void)
+{
+    return (uint16_t)SIM_BD(DAC)->DOR1;
+}
+
+static void Sim_Dac_Init(void)
+{
+    Sim_MapRegs(DAC_BASE, 0x400u, SIM_TRAP_WR, NULL, Sim_Dac_Post);
+}
+
+static void Sim_Dac_Reset(Sim_ResetCause cause)
+{
+    (void)cause;
+    memset(Sim_Backdoor(DAC_BASE), 0, 0x400u);
+    s_dhr = 0;
+    if (s_watch != NULL)
+        s_watch(0, s_pWatchCtx);
+}
+
+const Sim_Model g_simModelDac = { "dac", Sim_Dac_Init, Sim_Dac_Reset, NULL };
@@ -0,0 +1,238 @@
+/************************************************************************************
+ * @file     : sim_dma.c
+ * @brief    : Host simulator - DMA1 (7 channels) and DMA2 (5 channels)
+ * @details  : One item moves per peripheral request (Sim_Dma_Request), through the
+ *             peripheral's register hooks, so a DMA store to GPIOx_BSRR or DAC_DHR12R1
+ *             behaves like a CPU store. Current pointers and the reload count are latched
+ *             when EN goes high; CNDTR counts down in the register. EN is never cleared by
+ *             the hardware, as on the part, even in normal mode after the last item.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_DMA_CH_MAX      7u
+
+typedef struct {
+    uint32_t par;               /* current peripheral address */
+    uint32_t mar;               /* current memory address */
+    uint32_t reload;            /* CNDTR at enable */
+    uint32_t last;              /* last item written */
+    void (*onEnable)(bool enabled);
+} Sim_DmaChan;
+
+static Sim_DmaChan s_chan[2][SIM_DMA_CH_MAX];
+
+static DMA_TypeDef *Sim_Dma_Unit(uint8_t dma)
+{
+    return dma == 1u ? DMA1 : DMA2;
+}
+
+static DMA_Channel_TypeDef *Sim_Dma_Chan(uint8_t dma, uint8_t ch)
+{
+    return (DMA_Channel_TypeDef *)(uintptr_t)((dma == 1u ? DMA1_BASE : DMA2_BASE) + 0x08u + 20u * (ch - 1u));
+}
+
+static int Sim_Dma_Irqn(uint8_t dma, uint8_t ch)
+{
+    if (dma == 1u)
+        return DMA1_Channel1_IRQn + (int)(ch - 1u);
+    return ch >= 4u ? DMA2_Channel4_5_IRQn : DMA2_Channel1_IRQn + (int)(ch - 1u);
+}
+
+static void Sim_Dma_UpdateIrq(uint8_t dma, uint8_t ch)
+{
+    uint32_t isr = SIM_BD(Sim_Dma_Unit(dma))->ISR;
+    uint32_t ccr;
+    bool level = false;
+    uint8_t c;
+
+    for (c = 1; c <= (dma == 1u ? 7u : 5u); c++) {
+        if (Sim_Dma_Irqn(dma, c) != Sim_Dma_Irqn(dma, ch))
+            continue;
+        ccr = SIM_BD(Sim_Dma_Chan(dma, c))->CCR;
+        if (((isr >> ((c - 1u) * 4u)) & (ccr >> 0) & 0xEu) != 0u)
+            level = true;
+    }
+    Sim_IrqLine(Sim_Dma_Irqn(dma, ch), level);
+}
+
+static void Sim_Dma_Flag(uint8_t dma, uint8_t ch, uint32_t flags)
+{
+    SIM_BD(Sim_Dma_Unit(dma))->ISR |= (flags | DMA_ISR_GIF1) << ((ch - 1u) * 4u);
+    Sim_Dma_UpdateIrq(dma, ch);
+}
+
+static bool Sim_Dma_IsPeriph(uint32_t addr)
+{
+    return addr - SIM_PERIPH_BASE < SIM_PERIPH_SIZE;
+}
+
+static uint32_t Sim_Dma_Load(uint32_t addr, uint8_t size)
+{
+    uintptr_t p;
+
+    if (Sim_Dma_IsPeriph(addr))
+        return Sim_BusRead(addr, size);
+    p = Sim_HostAddr(addr, size);
+    return size == 4u ? *(uint32_t *)p : (size == 2u ? *(uint16_t *)p : *(uint8_t *)p);
+}
+
+static void Sim_Dma_Store(uint32_t addr, uint32_t val, uint8_t size)
+{
+    uintptr_t p;
+
+    if (Sim_Dma_IsPeriph(addr)) {
+        Sim_BusWrite(addr, val, size);
+        return;
+    }
+    p = Sim_HostAddr(addr, size);
+    if (size == 4u)
+        *(uint32_t *)p = val;
+    else if (size == 2u)
+        *(uint16_t *)p = (uint16_t)val;
+    else
+        *(uint8_t *)p = (uint8_t)val;
+}
+
+static bool Sim_Dma_Transfer(uint8_t dma, uint8_t ch)
+{
+    DMA_Channel_TypeDef *pBd = SIM_BD(Sim_Dma_Chan(dma, ch));
+    Sim_DmaChan *pCh = &s_chan[dma - 1u][ch - 1u];
+    uint32_t ccr = pBd->CCR;
+    uint8_t psize = (uint8_t)(1u << ((ccr >> 8) & 3u));
+    uint8_t msize = (uint8_t)(1u << ((ccr >> 10) & 3u));
+    uint32_t par = pCh->par;
+    uint32_t mar = pCh->mar;
+    uint32_t left;
+    uint32_t val;
+
+    if (!(ccr & DMA_CCR1_EN) || pBd->CNDTR == 0u)
+        return false;
+    /* Pointers and count move before the bus access: a store to a peripheral may raise
+     * the next request (TXE) from inside its hook, and that item must be the next one */
+    if (ccr & DMA_CCR1_PINC)
+        pCh->par += psize;
+    if (ccr & DMA_CCR1_MINC)
+        pCh->mar += msize;
+    left = --pBd->CNDTR;
+    if (left == 0u && (ccr & DMA_CCR1_CIRC)) {
+        pBd->CNDTR = pCh->reload;
+        pCh->par = pBd->CPAR;
+        pCh->mar = pBd->CMAR;
+    }
+    if (ccr & DMA_CCR1_DIR) {
+        val = Sim_Dma_Load(mar, msize);
+        Sim_Dma_Store(par, val, psize);
+    } else {
+        val = Sim_Dma_Load(par, psize);
+        Sim_Dma_Store(mar, val, msize);
+    }
+    pCh->last = val;
+    if (left == pCh->reload - pCh->reload / 2u)
+        Sim_Dma_Flag(dma, ch, DMA_ISR_HTIF1);
+    if (left == 0u)
+        Sim_Dma_Flag(dma, ch, DMA_ISR_TCIF1);
+    return true;
+}
+
+bool Sim_Dma_Request(uint8_t dma, uint8_t ch)
+{
+    return Sim_Dma_Transfer(dma, ch);
+}
+
+uint32_t Sim_Dma_LastWrite(uint8_t dma, uint8_t ch)
+{
+    return s_chan[dma - 1u][ch - 1u].last;
+}
+
+void Sim_Dma_OnEnable(uint8_t dma, uint8_t ch, void (*fn)(bool enabled))
+{
+    s_chan[dma - 1u][ch - 1u].onEnable = fn;
+}
+
+static void Sim_Dma_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    uint8_t dma = addr >= DMA2_BASE ? 2u : 1u;
+    uint32_t off = (addr & ~3u) - (dma == 1u ? DMA1_BASE : DMA2_BASE);
+    uint8_t ch;
+    uint32_t reg;
+    DMA_Channel_TypeDef *pBd;
+    Sim_DmaChan *pCh;
+
+    if (!write)
+        return;
+    if (off == 0x00u) {         /* ISR: read-only */
+        SIM_BD(Sim_Dma_Unit(dma))->ISR = old;
+        return;
+    }
+    if (off == 0x04u) {         /* IFCR: clear, CGIF clears the whole channel */
+        uint32_t clr = val;
+        for (ch = 0; ch < 7u; ch++) {
+            if (val & (1u << (ch * 4u)))
+                clr |= 0xFu << (ch * 4u);
+        }
+        SIM_BD(Sim_Dma_Unit(dma))->ISR &= ~clr;
+        SIM_BD(Sim_Dma_Unit(dma))->IFCR = 0;
+        /* GIF stays while any other flag of the channel is still set */
+        for (ch = 1; ch <= 7u; ch++) {
+            if (SIM_BD(Sim_Dma_Unit(dma))->ISR & (0xEu << ((ch - 1u) * 4u)))
+                SIM_BD(Sim_Dma_Unit(dma))->ISR |= 1u << ((ch - 1u) * 4u);
+            if (ch <= (dma == 1u ? 7u : 5u))
+                Sim_Dma_UpdateIrq(dma, ch);
+        }
+        return;
+    }
+    ch = (uint8_t)((off - 0x08u) / 20u + 1u);
+    reg = (off - 0x08u) % 20u;
+    if (ch > (dma == 1u ? 7u : 5u))
+        return;
+    pBd = SIM_BD(Sim_Dma_Chan(dma, ch));
+    pCh = &s_chan[dma - 1u][ch - 1u];
+    switch (reg) {
+    case 0x00u:                 /* CCR */
+        if (val & ~old & DMA_CCR1_EN) {
+            pCh->par = pBd->CPAR;
+            pCh->mar = pBd->CMAR;
+            pCh->reload = pBd->CNDTR;
+        }
+        Sim_Dma_UpdateIrq(dma, ch);
+        if (((val ^ old) & DMA_CCR1_EN) && pCh->onEnable != NULL)
+            pCh->onEnable((val & DMA_CCR1_EN) != 0u);
+        if ((val & ~old & DMA_CCR1_EN) && (val & DMA_CCR1_MEM2MEM)) {
+            while (Sim_Dma_Transfer(dma, ch)) { }
+        }
+        break;
+    case 0x04u:                 /* CNDTR: read-only while enabled */
+        if (pBd->CCR & DMA_CCR1_EN)
+            pBd->CNDTR = old;
+        else
+            pBd->CNDTR = val & 0xFFFFu;
+        break;
+    default:
+        break;
+    }
+}
+
+static void Sim_Dma_Init(void)
+{
+    Sim_MapRegs(DMA1_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Dma_Post);
+    Sim_MapRegs(DMA2_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Dma_Post);
+}
+
+static void Sim_Dma_Reset(Sim_ResetCause cause)
+{
+    uint32_t d;
+    uint32_t c;
+
+    (void)cause;
+    memset(Sim_Backdoor(DMA1_BASE), 0, 0x800u);
+    for (d = 0; d < 2u; d++) {
+        for (c = 0; c < SIM_DMA_CH_MAX; c++) {
+            void (*fn)(bool) = s_chan[d][c].onEnable;
+            memset(&s_chan[d][c], 0, sizeof(s_chan[d][c]));
+            s_chan[d][c].onEnable = fn;
+        }
+    }
+}
+
+const Sim_Model g_simModelDma = { "dma", Sim_Dma_Init, Sim_Dma_Reset, NULL };
@@ -0,0 +1,271 @@
+/************************************************************************************
+ * @file     : sim_flash.c
+ * @brief    : Host simulator - embedded flash controller (KEYR/SR/CR/AR, WRPR)
+ * @details  : Half-word programming takes 52 us and a page erase 20 ms (RM0008 typical);
+ *             BSY is up meanwhile and the cells change when it drops. Programming a half
+ *             word that is not erased (and not 0x0000) sets PGERR, a protected page
+ *             WRPRTERR. Write protection comes from the option bytes at 0x1FFFF808, so a
+ *             host test can protect pages before Sim_Boot.
+ *             A reset while BSY leaves the operation half done: an erase has cleared the
+ *             first half of the page, a program has written the low byte only. With
+ *             Sim_Flash_CutAfter the power fails in the middle of the n-th operation.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_FLASH_PAGE          0x800u
+#define SIM_FLASH_PROG_NS       SIM_US(52)
+#define SIM_FLASH_ERASE_NS      SIM_MS(20)
+#define SIM_FLASH_MASS_NS       SIM_MS(40)
+#define SIM_FLASH_KEY1          0x45670123u
+#define SIM_FLASH_KEY2          0xCDEF89ABu
+#define SIM_FLASH_OPTB          0x1FFFF800u
+
+typedef enum {
+    E_SIM_FLASH_OP_NONE = 0,
+    E_SIM_FLASH_OP_PROG,
+    E_SIM_FLASH_OP_ERASE,
+    E_SIM_FLASH_OP_MASS,
+} Sim_FlashOp;
+
+static struct {
+    Sim_FlashOp op;
+    uint32_t addr;
+    uint16_t data;
+    uint16_t before;
+    uint64_t start;
+    bool key1;
+    bool keyFail;               /* wrong key sequence: locked until reset */
+    uint32_t cutAfter;
+    Sim_Timer timer;
+    Sim_Timer cutTimer;
+} s_fl;
+
+static Sim_FlashStats s_stats;
+
+uint8_t *Sim_Flash_Mem(void)
+{
+    return Sim_Backdoor(SIM_FLASH_BASE);
+}
+
+const Sim_FlashStats *Sim_Flash_GetStats(void)
+{
+    return &s_stats;
+}
+
+void Sim_Flash_CutAfter(uint32_t ops)
+{
+    s_fl.cutAfter = ops;
+}
+
+static bool Sim_Flash_Protected(uint32_t addr)
+{
+    uint32_t page = (addr - SIM_FLASH_BASE) / SIM_FLASH_PAGE;
+    uint32_t bit = page / 2u < 31u ? page / 2u : 31u;
+
+    return (SIM_BD(FLASH)->WRPR & (1u << bit)) == 0u;
+}
+
+static void Sim_Flash_UpdateIrq(void)
+{
+    uint32_t cr = SIM_BD(FLASH)->CR;
+    uint32_t sr = SIM_BD(FLASH)->SR;
+
+    Sim_IrqLine(FLASH_IRQn, ((cr & FLASH_CR_EOPIE) && (sr & FLASH_SR_EOP)) ||
+                            ((cr & FLASH_CR_ERRIE) && (sr & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR))));
+}
+
+static void Sim_Flash_Done(void *pCtx)
+{
+    uint8_t *pMem = Sim_Flash_Mem();
+
+    (void)pCtx;
+    switch (s_fl.op) {
+    case E_SIM_FLASH_OP_PROG:
+        *(uint16_t *)(pMem + (s_fl.addr - SIM_FLASH_BASE)) = s_fl.data;
+        s_stats.programs++;
+        break;
+    case E_SIM_FLASH_OP_ERASE:
+        memset(pMem + (s_fl.addr - SIM_FLASH_BASE), 0xFF, SIM_FLASH_PAGE);
+        s_stats.erases++;
+        break;
+    case E_SIM_FLASH_OP_MASS:
+        memset(pMem, 0xFF, SIM_FLASH_SIZE);
+        s_stats.erases++;
+        break;
+    default:
+        return;
+    }
+    s_stats.busyNs += Sim_Now() - s_fl.start;
+    s_fl.op = E_SIM_FLASH_OP_NONE;
+    SIM_BD(FLASH)->SR = (SIM_BD(FLASH)->SR & ~FLASH_SR_BSY) | FLASH_SR_EOP;
+    SIM_BD(FLASH)->CR &= ~FLASH_CR_STRT;
+    Sim_Flash_UpdateIrq();
+}
+
+static void Sim_Flash_Cut(void *pCtx)
+{
+    (void)pCtx;
+    Sim_RequestReset(E_SIM_RESET_POWER);
+}
+
+static void Sim_Flash_Begin(Sim_FlashOp op, uint32_t addr, uint64_t ns)
+{
+    s_fl.op = op;
+    s_fl.addr = addr;
+    s_fl.start = Sim_Now();
+    SIM_BD(FLASH)->SR |= FLASH_SR_BSY;
+    Sim_TimerStart(&s_fl.timer, Sim_Now() + ns, Sim_Flash_Done, NULL);
+    if (s_fl.cutAfter != 0u && --s_fl.cutAfter == 0u)
+        Sim_TimerStart(&s_fl.cutTimer, Sim_Now() + ns / 2u, Sim_Flash_Cut, NULL);
+}
+
+/* Reset or power loss with BSY up */
+static void Sim_Flash_Abort(void)
+{
+    uint8_t *pMem = Sim_Flash_Mem();
+    uint16_t *pHalf;
+
+    switch (s_fl.op) {
+    case E_SIM_FLASH_OP_PROG:
+        pHalf = (uint16_t *)(pMem + (s_fl.addr - SIM_FLASH_BASE));
+        *pHalf = (uint16_t)((s_fl.before & 0xFF00u) | (s_fl.data & 0x00FFu));
+        break;
+    case E_SIM_FLASH_OP_ERASE:
+        memset(pMem + (s_fl.addr - SIM_FLASH_BASE), 0xFF, SIM_FLASH_PAGE / 2u);
+        break;
+    case E_SIM_FLASH_OP_MASS:
+        memset(pMem, 0xFF, SIM_FLASH_SIZE / 2u);
+        break;
+    default:
+        break;
+    }
+    s_fl.op = E_SIM_FLASH_OP_NONE;
+}
+
+static void Sim_Flash_RegPost(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    FLASH_TypeDef *pBd = SIM_BD(FLASH);
+
+    if (!write)
+        return;
+    switch ((addr & ~3u) - (uint32_t)(uintptr_t)FLASH) {
+    case 0x04u:     /* KEYR */
+        pBd->KEYR = 0;
+        if (s_fl.keyFail || !(pBd->CR & FLASH_CR_LOCK)) {
+            break;
+        } else if (!s_fl.key1 && val == SIM_FLASH_KEY1) {
+            s_fl.key1 = true;
+        } else if (s_fl.key1 && val == SIM_FLASH_KEY2) {
+            s_fl.key1 = false;
+            pBd->CR &= ~FLASH_CR_LOCK;
+        } else {
+            s_fl.key1 = false;
+            s_fl.keyFail = true;
+        }
+        break;
+    case 0x0Cu:     /* SR: BSY read-only, flags w1c */
+        pBd->SR = old & ~(val & (FLASH_SR_PGERR | FLASH_SR_WRPRTERR | FLASH_SR_EOP));
+        break;
+    case 0x10u:     /* CR */
+        if (old & FLASH_CR_LOCK) {
+            pBd->CR = old | (val & FLASH_CR_LOCK);
+            break;
+        }
+        if (s_fl.op != E_SIM_FLASH_OP_NONE) {
+            pBd->CR = (old & ~(FLASH_CR_EOPIE | FLASH_CR_ERRIE)) | (val & (FLASH_CR_EOPIE | FLASH_CR_ERRIE));
+            break;
+        }
+        if ((val & FLASH_CR_STRT) && !(old & FLASH_CR_STRT)) {
+            if (val & FLASH_CR_MER) {
+                Sim_Flash_Begin(E_SIM_FLASH_OP_MASS, SIM_FLASH_BASE, SIM_FLASH_MASS_NS);
+            } else if (val & FLASH_CR_PER) {
+                uint32_t page = pBd->AR & ~(SIM_FLASH_PAGE - 1u);
+                if (page - SIM_FLASH_BASE >= SIM_FLASH_SIZE || Sim_Flash_Protected(page)) {
+                    pBd->SR |= FLASH_SR_WRPRTERR;
+                    pBd->CR = val & ~FLASH_CR_STRT;
+                } else {
+                    Sim_Flash_Begin(E_SIM_FLASH_OP_ERASE, page, SIM_FLASH_ERASE_NS);
+                }
+            }
+        }
+        break;
+    case 0x14u:     /* AR */
+    case 0x1Cu:     /* OBR, WRPR: read-only */
+    case 0x20u:
+        if ((addr & ~3u) != (uint32_t)(uintptr_t)&FLASH->AR)
+            *(uint32_t *)Sim_Backdoor(addr & ~3u) = old;
+        break;
+    default:
+        break;
+    }
+    Sim_Flash_UpdateIrq();
+}
+
+/* CPU store into the flash array: a program operation when PG is set, ignored otherwise */
+static void Sim_Flash_ArrayPost(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    FLASH_TypeDef *pBd = SIM_BD(FLASH);
+    uint32_t shift = (addr & 2u) * 8u;
+    uint16_t before = (uint16_t)(old >> shift);
+    uint16_t data = (uint16_t)(val >> shift);
+
+    if (!write)
+        return;
+    *(uint32_t *)Sim_Backdoor(addr & ~3u) = old;     /* cells change when BSY drops */
+    if ((pBd->CR & (FLASH_CR_PG | FLASH_CR_LOCK)) != FLASH_CR_PG || s_fl.op != E_SIM_FLASH_OP_NONE)
+        return;
+    if (Sim_Flash_Protected(addr)) {
+        pBd->SR |= FLASH_SR_WRPRTERR;
+    } else if (before != 0xFFFFu && data != 0x0000u) {
+        pBd->SR |= FLASH_SR_PGERR;
+    } else {
+        s_fl.data = data;
+        s_fl.before = before;
+        Sim_Flash_Begin(E_SIM_FLASH_OP_PROG, addr & ~1u, SIM_FLASH_PROG_NS);
+    }
+    Sim_Flash_UpdateIrq();
+}
+
+static void Sim_Flash_Init(void)
+{
+    uint8_t *pOpt = (uint8_t *)(uintptr_t)SIM_FLASH_OPTB;
+
+    Sim_MapRegs((uint32_t)(uintptr_t)FLASH, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Flash_RegPost);
+    Sim_MapRegs(SIM_FLASH_BASE, SIM_FLASH_SIZE, SIM_TRAP_WR, NULL, Sim_Flash_ArrayPost);
+    /* Factory option bytes: RDP off, no write protection (byte, complement pairs) */
+    memset(pOpt, 0xFF, 16u);
+    pOpt[0] = 0xA5u;
+    pOpt[1] = 0x5Au;
+    pOpt[2] = 0xFFu;
+    pOpt[3] = 0x00u;
+    pOpt[8] = 0xFFu;
+    pOpt[9] = 0x00u;
+    pOpt[10] = 0xFFu;
+    pOpt[11] = 0x00u;
+    pOpt[12] = 0xFFu;
+    pOpt[13] = 0x00u;
+    pOpt[14] = 0xFFu;
+    pOpt[15] = 0x00u;
+}
+
+static void Sim_Flash_Reset(Sim_ResetCause cause)
+{
+    const uint8_t *pOpt = (const uint8_t *)(uintptr_t)SIM_FLASH_OPTB;
+    FLASH_TypeDef *pBd = SIM_BD(FLASH);
+
+    (void)cause;
+    Sim_TimerStop(&s_fl.timer);
+    Sim_TimerStop(&s_fl.cutTimer);
+    Sim_Flash_Abort();
+    s_fl.key1 = false;
+    s_fl.keyFail = false;
+    memset(pBd, 0, sizeof(*pBd));
+    pBd->ACR = 0x30u;
+    pBd->CR = FLASH_CR_LOCK;
+    pBd->OBR = 0x03FFFFFCu;
+    pBd->WRPR = (uint32_t)pOpt[8] | ((uint32_t)pOpt[10] << 8) | ((uint32_t)pOpt[12] << 16) |
+                ((uint32_t)pOpt[14] << 24);
+}
+
+const Sim_Model g_simModelFlash = { "flash", Sim_Flash_Init, Sim_Flash_Reset, NULL };
@@ -0,0 +1,239 @@
+/************************************************************************************
+ * @file     : sim_gpio.c
+ * @brief    : Host simulator - GPIO ports A..G, AFIO and EXTI
+ * @details  : IDR is recomputed whenever an output, a pin mode or an external drive
+ *             changes, so the firmware reads it without a trap. Floating inputs nobody
+ *             drives read 0 (board pull-downs on the foot switch and sync lines); pulled
+ *             inputs follow ODR. Input edges go to EXTI through the AFIO_EXTICR mapping.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_GPIO_PORTS      7u
+#define SIM_GPIO_WATCH_MAX  8u
+#define SIM_EXTI_LINES      19u
+
+static uint16_t s_driveMask[SIM_GPIO_PORTS];
+static uint16_t s_driveLevel[SIM_GPIO_PORTS];
+static struct {
+    Sim_PinWatchFn fn;
+    void *pCtx;
+} s_watch[SIM_GPIO_WATCH_MAX];
+static uint32_t s_watchNum = 0;
+
+static GPIO_TypeDef *Sim_Gpio_Port(uint32_t idx)
+{
+    return (GPIO_TypeDef *)(uintptr_t)(GPIOA_BASE + idx * 0x400u);
+}
+
+static uint32_t Sim_Gpio_Index(char port)
+{
+    uint32_t idx = (uint32_t)(port - 'A');
+
+    if (idx >= SIM_GPIO_PORTS)
+        SIM_FATAL("no GPIO port %c", port);
+    return idx;
+}
+
+/* CNF[1:0] MODE[1:0] of a pin */
+static uint32_t Sim_Gpio_Cfg(uint32_t idx, uint32_t pin)
+{
+    GPIO_TypeDef *pBd = SIM_BD(Sim_Gpio_Port(idx));
+    uint32_t cr = pin < 8u ? pBd->CRL : pBd->CRH;
+
+    return (cr >> ((pin & 7u) * 4u)) & 0xFu;
+}
+
+static uint32_t Sim_Gpio_Level(uint32_t idx, uint32_t pin)
+{
+    uint32_t cfg = Sim_Gpio_Cfg(idx, pin);
+    uint32_t odr = (SIM_BD(Sim_Gpio_Port(idx))->ODR >> pin) & 1u;
+    bool driven = (s_driveMask[idx] >> pin) & 1u;
+    uint32_t ext = (s_driveLevel[idx] >> pin) & 1u;
+
+    if ((cfg & 3u) != 0u) {
+        /* Output: push-pull drives, open-drain only pulls low */
+        if (cfg & 8u)
+            return driven ? ext : 1u;  /* alternate function, idle high */
+        if (cfg & 4u)
+            return odr == 0u ? 0u : (driven ? ext : 1u);
+        return odr;
+    }
+    switch (cfg >> 2) {
+    case 0:         /* analog */
+        return 0u;
+    case 2:         /* pull-up / pull-down */
+        return driven ? ext : odr;
+    default:        /* floating */
+        return driven ? ext : 0u;
+    }
+}
+
+/* ---------- EXTI ---------- */
+
+static void Sim_Exti_Update(void)
+{
+    uint32_t act = SIM_BD(EXTI)->PR & SIM_BD(EXTI)->IMR;
+    uint32_t i;
+
+    for (i = 0; i < 5u; i++)
+        Sim_IrqLine(EXTI0_IRQn + (int)i, (act >> i) & 1u);
+    Sim_IrqLine(EXTI9_5_IRQn, (act & 0x03E0u) != 0);
+    Sim_IrqLine(EXTI15_10_IRQn, (act & 0xFC00u) != 0);
+    Sim_IrqLine(PVD_IRQn, (act >> 16) & 1u);
+    Sim_IrqLine(RTCAlarm_IRQn, (act >> 17) & 1u);
+}
+
+void Sim_Exti_Edge(uint8_t line, bool rising)
+{
+    uint32_t bit = 1u << line;
+
+    if (line >= SIM_EXTI_LINES)
+        return;
+    if (!((rising ? SIM_BD(EXTI)->RTSR : SIM_BD(EXTI)->FTSR) & bit))
+        return;
+    if (SIM_BD(EXTI)->IMR & bit)
+        SIM_BD(EXTI)->PR |= bit;
+    if (SIM_BD(EXTI)->EMR & bit)
+        Sim_Wake();
+    Sim_Exti_Update();
+}
+
+static void Sim_Exti_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    if (!write)
+        return;
+    switch ((addr & ~3u) - EXTI_BASE) {
+    case 0x10u:     /* SWIER */
+        SIM_BD(EXTI)->PR |= val & ~old & SIM_BD(EXTI)->IMR;
+        break;
+    case 0x14u:     /* PR: rc_w1 */
+        SIM_BD(EXTI)->PR = old & ~val;
+        SIM_BD(EXTI)->SWIER &= ~val;
+        break;
+    default:
+        break;
+    }
+    Sim_Exti_Update();
+}
+
+/* ---------- Ports ---------- */
+
+static void Sim_Gpio_Refresh(uint32_t idx)
+{
+    GPIO_TypeDef *pBd = SIM_BD(Sim_Gpio_Port(idx));
+    uint32_t idr = 0;
+    uint32_t changed;
+    uint32_t pin;
+    uint32_t src;
+
+    for (pin = 0; pin < 16u; pin++)
+        idr |= Sim_Gpio_Level(idx, pin) << pin;
+    changed = (pBd->IDR ^ idr) & 0xFFFFu;
+    pBd->IDR = idr;
+    for (pin = 0; changed != 0u && pin < 16u; pin++) {
+        if (!((changed >> pin) & 1u))
+            continue;
+        src = (SIM_BD(AFIO)->EXTICR[pin >> 2] >> ((pin & 3u) * 4u)) & 0xFu;
+        if (src == idx)
+            Sim_Exti_Edge((uint8_t)pin, (idr >> pin) & 1u);
+    }
+}
+
+static void Sim_Gpio_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    uint32_t idx = (addr - GPIOA_BASE) / 0x400u;
+    GPIO_TypeDef *pBd = SIM_BD(Sim_Gpio_Port(idx));
+    uint32_t odr = pBd->ODR;
+    uint32_t changed;
+    uint32_t i;
+
+    if (!write)
+        return;
+    switch ((addr & 0x3FCu)) {
+    case 0x08u:     /* IDR: read-only */
+        pBd->IDR = old;
+        break;
+    case 0x10u:     /* BSRR: set wins over reset */
+        odr = (odr & ~(val >> 16)) | (val & 0xFFFFu);
+        pBd->BSRR = 0;
+        break;
+    case 0x14u:     /* BRR */
+        odr &= ~(val & 0xFFFFu);
+        pBd->BRR = 0;
+        break;
+    default:
+        break;
+    }
+    changed = (pBd->ODR ^ odr) & 0xFFFFu;
+    if ((addr & 0x3FCu) == 0x0Cu)
+        changed = (old ^ pBd->ODR) & 0xFFFFu;
+    pBd->ODR = odr & 0xFFFFu;
+    Sim_Gpio_Refresh(idx);
+    if (changed != 0u) {
+        for (i = 0; i < s_watchNum; i++)
+            s_watch[i].fn((char)('A' + idx), (uint16_t)pBd->ODR, (uint16_t)changed, s_watch[i].pCtx);
+    }
+}
+
+void Sim_Gpio_Input(char port, uint8_t pin, int level)
+{
+    uint32_t idx = Sim_Gpio_Index(port);
+
+    if (level < 0) {
+        s_driveMask[idx] &= (uint16_t)~(1u << pin);
+    } else {
+        s_driveMask[idx] |= (uint16_t)(1u << pin);
+        if (level)
+            s_driveLevel[idx] |= (uint16_t)(1u << pin);
+        else
+            s_driveLevel[idx] &= (uint16_t)~(1u << pin);
+    }
+    Sim_Gpio_Refresh(idx);
+}
+
+void Sim_Pin_Drive(char port, uint8_t pin, int level)
+{
+    Sim_Gpio_Input(port, pin, level);
+}
+
+int Sim_Pin_Get(char port, uint8_t pin)
+{
+    return (int)Sim_Gpio_Level(Sim_Gpio_Index(port), pin);
+}
+
+void Sim_Pin_Watch(Sim_PinWatchFn fn, void *pCtx)
+{
+    if (s_watchNum >= SIM_GPIO_WATCH_MAX)
+        SIM_FATAL("too many pin watchers");
+    s_watch[s_watchNum].fn = fn;
+    s_watch[s_watchNum].pCtx = pCtx;
+    s_watchNum++;
+}
+
+/* ---------- Model ---------- */
+
+static void Sim_Gpio_Init(void)
+{
+    Sim_MapRegs(EXTI_BASE, 0x400u, SIM_TRAP_WR, NULL, Sim_Exti_Post);
+    Sim_MapRegs(GPIOA_BASE, SIM_GPIO_PORTS * 0x400u, SIM_TRAP_WR, NULL, Sim_Gpio_Post);
+}
+
+static void Sim_Gpio_Reset(Sim_ResetCause cause)
+{
+    uint32_t i;
+
+    (void)cause;
+    memset(Sim_Backdoor(AFIO_BASE), 0, 0x800u);
+    for (i = 0; i < SIM_GPIO_PORTS; i++) {
+        GPIO_TypeDef *pBd = SIM_BD(Sim_Gpio_Port(i));
+        memset(pBd, 0, 0x400u);
+        pBd->CRL = 0x44444444u;
+        pBd->CRH = 0x44444444u;
+        Sim_Gpio_Refresh(i);
+    }
+    /* No edges from the reset itself */
+    memset(Sim_Backdoor(EXTI_BASE), 0, 0x400u);
+}
+
+const Sim_Model g_simModelGpio = { "gpio", Sim_Gpio_Init, Sim_Gpio_Reset, NULL };
@@ -0,0 +1,479 @@
+/************************************************************************************
+ * @file     : sim_i2c.c
+ * @brief    : Host simulator - I2C1/I2C2 master, SI5351 on I2C1, probe AT24C02 on I2C2
+ * @details  : Event level model of the master as StdPeriph's I2C_CheckEvent sees it:
+ *             START/STOP take one bit time, address and data bytes nine, at the rate set
+ *             in CCR. SB clears on SR1 read + DR write, ADDR on SR1 read + SR2 read, BTF
+ *             with the next DR access. In receive mode a byte is clocked in whenever DR is
+ *             empty; a byte the master NACKs (ACK off) is the slave's last, it releases
+ *             SDA and further bytes read 0xFF. BUSY/MSL stay until the byte before STOP
+ *             is read, so the BYTE_RECEIVED event still matches after STOP was requested.
+ *             The AT24C02 NACKs its address for 5 ms after a write; the SI5351 model
+ *             keeps its register file and feeds CLK1 to TIM1 ETR.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_I2C_SR1_SB      0x0001u
+#define SIM_I2C_SR1_ADDR    0x0002u
+#define SIM_I2C_SR1_BTF     0x0004u
+#define SIM_I2C_SR1_RXNE    0x0040u
+#define SIM_I2C_SR1_TXE     0x0080u
+#define SIM_I2C_SR1_AF      0x0400u
+#define SIM_I2C_SR2_MSL     0x0001u
+#define SIM_I2C_SR2_BUSY    0x0002u
+#define SIM_I2C_SR2_TRA     0x0004u
+
+#define SIM_EEPROM_ADDR     0x50u
+#define SIM_EEPROM_PAGE     8u
+#define SIM_EEPROM_TWR_NS   SIM_MS(5)
+#define SIM_SI5351_ADDR     0x60u
+#define SIM_SI5351_XTAL_HZ  25000000u
+
+typedef struct {
+    uint8_t addr;                                   /* 7-bit */
+    bool (*start)(bool read);                       /* address phase, true: ACK */
+    bool (*write)(uint8_t b);
+    uint8_t (*read)(void);
+    void (*stop)(void);
+} Sim_I2cDev;
+
+typedef enum {
+    E_SIM_I2C_IDLE = 0,
+    E_SIM_I2C_START,            /* SB set, waiting for the address */
+    E_SIM_I2C_ADDR,             /* address byte on the bus */
+    E_SIM_I2C_TX,
+    E_SIM_I2C_RX,
+} Sim_I2cPhase;
+
+typedef struct {
+    uint32_t base;
+    const Sim_I2cDev *pDevs[2];
+    const Sim_I2cDev *pCur;
+    Sim_I2cPhase phase;
+    bool read;
+    uint16_t sr1Seen;           /* SR1 as last read: SB/ADDR clear only if the CPU saw them */
+    bool rxBusy;                /* byte being clocked in */
+    bool nacked;                /* slave released SDA after a NACK */
+    bool stopPending;           /* STOP requested in receive mode */
+    bool startPending;          /* START requested while the bus is still busy */
+    Sim_Timer timer;
+} Sim_I2c;
+
+static Sim_I2c s_i2c[2];
+
+/* ---------- AT24C02 ---------- */
+
+static struct {
+    bool attached;
+    uint8_t mem[256];
+    uint8_t ptr;
+    bool gotPtr;
+    uint8_t page[SIM_EEPROM_PAGE];
+    uint8_t pageLen;
+    uint8_t pageBase;
+    uint64_t busyUntil;
+} s_eeprom = { true, { 0 }, 0, false, { 0 }, 0, 0, 0 };
+
+static bool Sim_Eeprom_Start(bool read)
+{
+    if (!s_eeprom.attached || Sim_Now() < s_eeprom.busyUntil)
+        return false;
+    s_eeprom.gotPtr = read;
+    s_eeprom.pageLen = 0;
+    return true;
+}
+
+static bool Sim_Eeprom_Write(uint8_t b)
+{
+    if (!s_eeprom.gotPtr) {
+        s_eeprom.ptr = b;
+        s_eeprom.pageBase = b & (uint8_t)~(SIM_EEPROM_PAGE - 1u);
+        s_eeprom.gotPtr = true;
+        return true;
+    }
+    /* The page latch wraps inside the page, as on the part */
+    s_eeprom.page[s_eeprom.ptr % SIM_EEPROM_PAGE] = b;
+    if (s_eeprom.pageLen < SIM_EEPROM_PAGE)
+        s_eeprom.pageLen++;
+    s_eeprom.ptr = (uint8_t)(s_eeprom.pageBase + ((s_eeprom.ptr + 1u) % SIM_EEPROM_PAGE));
+    return true;
+}
+
+static uint8_t Sim_Eeprom_Read(void)
+{
+    return s_eeprom.mem[s_eeprom.ptr++];
+}
+
+static void Sim_Eeprom_Stop(void)
+{
+    uint32_t i;
+    uint8_t first;
+
+    if (s_eeprom.pageLen == 0u)
+        return;
+    /* The latched bytes end at ptr - 1 inside the page */
+    first = (uint8_t)((s_eeprom.ptr - s_eeprom.pageLen) % SIM_EEPROM_PAGE);
+    for (i = 0; i < s_eeprom.pageLen; i++) {
+        uint8_t off = (uint8_t)((first + i) % SIM_EEPROM_PAGE);
+        s_eeprom.mem[s_eeprom.pageBase + off] = s_eeprom.page[off];
+    }
+    s_eeprom.pageLen = 0;
+    s_eeprom.busyUntil = Sim_Now() + SIM_EEPROM_TWR_NS;
+}
+
+static const Sim_I2cDev s_eepromDev = {
+    SIM_EEPROM_ADDR, Sim_Eeprom_Start, Sim_Eeprom_Write, Sim_Eeprom_Read, Sim_Eeprom_Stop
+};
+
+void Sim_Eeprom_Attach(bool attached)
+{
+    s_eeprom.attached = attached;
+}
+
+uint8_t *Sim_Eeprom_Mem(void)
+{
+    return s_eeprom.mem;
+}
+
+/* ---------- SI5351 ---------- */
+
+static struct {
+    uint8_t reg[256];
+    uint8_t ptr;
+    bool gotPtr;
+    uint32_t writes;
+} s_si5351;
+
+/* a + b/c of a PLL or multisynth parameter block, x128 */
+static double Sim_Si5351_Ratio(uint8_t at)
+{
+    const uint8_t *r = &s_si5351.reg[at];
+    uint32_t p3 = ((uint32_t)(r[5] >> 4) << 16) | ((uint32_t)r[0] << 8) | r[1];
+    uint32_t p1 = ((uint32_t)(r[2] & 3u) << 16) | ((uint32_t)r[3] << 8) | r[4];
+    uint32_t p2 = ((uint32_t)(r[5] & 0xFu) << 16) | ((uint32_t)r[6] << 8) | r[7];
+
+    return ((double)p1 + 512.0 + (p3 != 0u ? (double)p2 / p3 : 0.0)) / 128.0;
+}
+
+uint32_t Sim_Si5351_GetHz(uint8_t clk)
+{
+    uint8_t ctrl;
+    uint8_t msAt;
+    double vco;
+    double div;
+
+    if (clk > 2u)
+        return 0;
+    ctrl = s_si5351.reg[16u + clk];
+    msAt = (uint8_t)(42u + 8u * clk);
+    if ((s_si5351.reg[3] & (1u << clk)) || (ctrl & 0x80u) || ((ctrl >> 2) & 3u) != 3u)
+        return 0;
+    vco = SIM_SI5351_XTAL_HZ * Sim_Si5351_Ratio((ctrl & 0x20u) ? 34u : 26u);
+    div = ((s_si5351.reg[msAt + 2u] >> 2) & 3u) == 3u ? 4.0 : Sim_Si5351_Ratio(msAt);
+    if (div < 4.0)
+        return 0;
+    return (uint32_t)(vco / div / (double)(1u << ((s_si5351.reg[msAt + 2u] >> 4) & 7u)) + 0.5);
+}
+
+uint32_t Sim_Si5351_GetWrites(void)
+{
+    return s_si5351.writes;
+}
+
+static bool Sim_Si5351_Start(bool read)
+{
+    s_si5351.gotPtr = read;
+    return true;
+}
+
+static bool Sim_Si5351_Write(uint8_t b)
+{
+    if (!s_si5351.gotPtr) {
+        s_si5351.ptr = b;
+        s_si5351.gotPtr = true;
+        return true;
+    }
+    s_si5351.reg[s_si5351.ptr++] = b;
+    s_si5351.writes++;
+    return true;
+}
+
+static uint8_t Sim_Si5351_Read(void)
+{
+    return s_si5351.reg[s_si5351.ptr++];
+}
+
+/* Outputs follow the registers at the end of each transaction */
+static void Sim_Si5351_Stop(void)
+{
+    Sim_Tim_SetEtrHz(Sim_Si5351_GetHz(1));
+}
+
+static const Sim_I2cDev s_si5351Dev = {
+    SIM_SI5351_ADDR, Sim_Si5351_Start, Sim_Si5351_Write, Sim_Si5351_Read, Sim_Si5351_Stop
+};
+
+/* ---------- Master ---------- */
+
+static I2C_TypeDef *Sim_I2c_Bd(const Sim_I2c *pI)
+{
+    return (I2C_TypeDef *)Sim_Backdoor(pI->base);
+}
+
+static uint64_t Sim_I2c_BitNs(const Sim_I2c *pI)
+{
+    uint32_t ccr = Sim_I2c_Bd(pI)->CCR & 0xFFFu;
+    uint32_t pclk = Sim_Rcc_Pclk1();
+
+    if (ccr == 0u || pclk == 0u)
+        return 10000u;
+    return 2000000000ull * ccr / pclk;
+}
+
+static void Sim_I2c_UpdateIrq(const Sim_I2c *pI)
+{
+    I2C_TypeDef *pBd = Sim_I2c_Bd(pI);
+    bool ev = (pBd->CR2 & I2C_CR2_ITEVTEN) &&
+              ((pBd->SR1 & (SIM_I2C_SR1_SB | SIM_I2C_SR1_ADDR | SIM_I2C_SR1_BTF)) ||
+               ((pBd->CR2 & I2C_CR2_ITBUFEN) && (pBd->SR1 & (SIM_I2C_SR1_RXNE | SIM_I2C_SR1_TXE))));
+    bool er = (pBd->CR2 & I2C_CR2_ITERREN) && (pBd->SR1 & SIM_I2C_SR1_AF);
+
+    Sim_IrqLine(pI == &s_i2c[0] ? I2C1_EV_IRQn : I2C2_EV_IRQn, ev);
+    Sim_IrqLine(pI == &s_i2c[0] ? I2C1_ER_IRQn : I2C2_ER_IRQn, er);
+}
+
+static void Sim_I2c_After(Sim_I2c *pI, uint64_t bits, void (*fn)(void *pCtx))
+{
+    Sim_TimerStart(&pI->timer, Sim_Now() + bits * Sim_I2c_BitNs(pI), fn, pI);
+}
+
+static void Sim_I2c_StartDone(void *pCtx)
+{
+    Sim_I2c *pI = pCtx;
+    I2C_TypeDef *pBd = Sim_I2c_Bd(pI);
+
+    pBd->CR1 &= ~I2C_CR1_START;
+    pBd->SR1 = SIM_I2C_SR1_SB;
+    pBd->SR2 = SIM_I2C_SR2_MSL | SIM_I2C_SR2_BUSY;
+    pI->phase = E_SIM_I2C_START;
+    pI->sr1Seen = 0;
+    Sim_I2c_UpdateIrq(pI);
+}
+
+static void Sim_I2c_StopDone(void *pCtx)
+{
+    Sim_I2c *pI = pCtx;
+    I2C_TypeDef *pBd = Sim_I2c_Bd(pI);
+
+    pBd->CR1 &= ~I2C_CR1_STOP;
+    pBd->SR2 = 0;
+    pBd->SR1 &= SIM_I2C_SR1_AF | SIM_I2C_SR1_RXNE;
+    if (pI->pCur != NULL)
+        pI->pCur->stop();
+    pI->pCur = NULL;
+    pI->phase = E_SIM_I2C_IDLE;
+    pI->stopPending = false;
+    if (pI->startPending) {
+        pI->startPending = false;
+        Sim_I2c_After(pI, 1u, Sim_I2c_StartDone);
+    }
+    Sim_I2c_UpdateIrq(pI);
+}
+
+static void Sim_I2c_RxDone(void *pCtx)
+{
+    Sim_I2c *pI = pCtx;
+    I2C_TypeDef *pBd = Sim_I2c_Bd(pI);
+
+    pI->rxBusy = false;
+    pBd->DR = (pI->pCur != NULL && !pI->nacked) ? pI->pCur->read() : 0xFFu;
+    pBd->SR1 |= SIM_I2C_SR1_RXNE;
+    if (!(pBd->CR1 & I2C_CR1_ACK))
+        pI->nacked = true;
+    Sim_I2c_UpdateIrq(pI);
+}
+
+static void Sim_I2c_RxNext(Sim_I2c *pI)
+{
+    if (pI->phase != E_SIM_I2C_RX || pI->rxBusy || pI->stopPending ||
+        (Sim_I2c_Bd(pI)->SR1 & (SIM_I2C_SR1_RXNE | SIM_I2C_SR1_ADDR)))
+        return;
+    pI->rxBusy = true;
+    Sim_I2c_After(pI, 9u, Sim_I2c_RxDone);
+}
+
+static void Sim_I2c_AddrDone(void *pCtx)
+{
+    Sim_I2c *pI = pCtx;
+    I2C_TypeDef *pBd = Sim_I2c_Bd(pI);
+    uint8_t a = (uint8_t)(pBd->DR & 0xFFu);
+    uint32_t i;
+
+    pI->read = (a & 1u) != 0u;
+    pI->nacked = false;
+    pI->pCur = NULL;
+    for (i = 0; i < 2u; i++) {
+        if (pI->pDevs[i] != NULL && pI->pDevs[i]->addr == (a >> 1))
+            pI->pCur = pI->pDevs[i];
+    }
+    if (pI->pCur == NULL || !pI->pCur->start(pI->read)) {
+        pI->pCur = NULL;
+        pBd->SR1 |= SIM_I2C_SR1_AF;
+        pI->phase = E_SIM_I2C_TX;       /* nobody there: only STOP helps */
+    } else {
+        pBd->SR1 |= SIM_I2C_SR1_ADDR;
+        if (pI->read) {
+            pI->phase = E_SIM_I2C_RX;
+        } else {
+            pI->phase = E_SIM_I2C_TX;
+            pBd->SR1 |= SIM_I2C_SR1_TXE;
+            pBd->SR2 |= SIM_I2C_SR2_TRA;
+        }
+    }
+    Sim_I2c_UpdateIrq(pI);
+}
+
+static void Sim_I2c_TxDone(void *pCtx)
+{
+    Sim_I2c *pI = pCtx;
+    I2C_TypeDef *pBd = Sim_I2c_Bd(pI);
+
+    if (pI->pCur != NULL && pI->pCur->write((uint8_t)pBd->DR))
+        pBd->SR1 |= SIM_I2C_SR1_TXE | SIM_I2C_SR1_BTF;
+    else
+        pBd->SR1 |= SIM_I2C_SR1_AF;
+    if (pBd->CR1 & I2C_CR1_STOP)
+        Sim_I2c_After(pI, 1u, Sim_I2c_StopDone);
+    Sim_I2c_UpdateIrq(pI);
+}
+
+static Sim_I2c *Sim_I2c_Find(uint32_t addr)
+{
+    return (addr & ~0x3FFu) == I2C1_BASE ? &s_i2c[0] : ((addr & ~0x3FFu) == I2C2_BASE ? &s_i2c[1] : NULL);
+}
+
+static void Sim_I2c_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    Sim_I2c *pI = Sim_I2c_Find(addr);
+    I2C_TypeDef *pBd;
+
+    if (pI == NULL)
+        return;
+    pBd = Sim_I2c_Bd(pI);
+    switch (addr & 0x3FCu) {
+    case 0x00u:     /* CR1 */
+        if (!write)
+            return;
+        if (val & I2C_CR1_SWRST) {
+            Sim_TimerStop(&pI->timer);
+            pBd->SR1 = 0;
+            pBd->SR2 = 0;
+            pI->phase = E_SIM_I2C_IDLE;
+            pI->pCur = NULL;
+            pI->rxBusy = false;
+            pI->stopPending = false;
+            pI->startPending = false;
+            break;
+        }
+        if (!(val & I2C_CR1_PE))
+            break;
+        if ((val & ~old & I2C_CR1_START) && !(pBd->CR1 & I2C_CR1_STOP)) {
+            if (pI->phase == E_SIM_I2C_IDLE && !pI->timer.armed)
+                Sim_I2c_After(pI, 1u, Sim_I2c_StartDone);
+            else if (pI->phase == E_SIM_I2C_TX && !pI->timer.armed)
+                Sim_I2c_After(pI, 1u, Sim_I2c_StartDone);      /* repeated start */
+            else
+                pI->startPending = true;
+        } else if (val & ~old & I2C_CR1_START) {
+            pI->startPending = true;
+        }
+        if (val & ~old & I2C_CR1_STOP) {
+            if (pI->phase == E_SIM_I2C_RX)
+                pI->stopPending = true;     /* after the byte in progress */
+            else if (!pI->timer.armed)
+                Sim_I2c_After(pI, 1u, Sim_I2c_StopDone);
+        }
+        break;
+    case 0x10u:     /* DR */
+        if (write) {
+            pBd->SR1 &= ~SIM_I2C_SR1_BTF;
+            if (pI->phase == E_SIM_I2C_START && (pI->sr1Seen & SIM_I2C_SR1_SB)) {
+                pBd->SR1 &= ~SIM_I2C_SR1_SB;
+                pI->phase = E_SIM_I2C_ADDR;
+                Sim_I2c_After(pI, 9u, Sim_I2c_AddrDone);
+            } else if (pI->phase == E_SIM_I2C_TX) {
+                pBd->SR1 &= ~SIM_I2C_SR1_TXE;
+                Sim_I2c_After(pI, 9u, Sim_I2c_TxDone);
+            }
+        } else {
+            pBd->SR1 &= ~(SIM_I2C_SR1_RXNE | SIM_I2C_SR1_BTF);
+            if (pI->phase == E_SIM_I2C_RX && pI->stopPending && !pI->rxBusy)
+                Sim_I2c_After(pI, 1u, Sim_I2c_StopDone);
+            else
+                Sim_I2c_RxNext(pI);
+        }
+        pI->sr1Seen = 0;
+        break;
+    case 0x14u:     /* SR1: rc_w0 error flags */
+        if (write) {
+            pBd->SR1 = old & (val | 0x00FFu);
+            break;
+        }
+        pI->sr1Seen = (uint16_t)pBd->SR1;
+        return;
+    case 0x18u:     /* SR2: read-only */
+        if (write) {
+            pBd->SR2 = old;
+            break;
+        }
+        if (pI->sr1Seen & pBd->SR1 & SIM_I2C_SR1_ADDR) {
+            pBd->SR1 &= ~SIM_I2C_SR1_ADDR;
+            pI->sr1Seen = 0;
+            Sim_I2c_RxNext(pI);
+        }
+        break;
+    default:
+        if (!write)
+            return;
+        break;
+    }
+    Sim_I2c_UpdateIrq(pI);
+}
+
+/* ---------- Model ---------- */
+
+static void Sim_I2c_Init(void)
+{
+    s_i2c[0].base = I2C1_BASE;
+    s_i2c[0].pDevs[0] = &s_si5351Dev;
+    s_i2c[1].base = I2C2_BASE;
+    s_i2c[1].pDevs[0] = &s_eepromDev;
+    memset(s_eeprom.mem, 0xFF, sizeof(s_eeprom.mem));
+    Sim_MapRegs(I2C1_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_I2c_Post);
+    Sim_MapRegs(I2C2_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_I2c_Post);
+}
+
+static void Sim_I2c_Reset(Sim_ResetCause cause)
+{
+    uint32_t i;
+
+    for (i = 0; i < 2u; i++) {
+        Sim_TimerStop(&s_i2c[i].timer);
+        memset(Sim_Backdoor(s_i2c[i].base), 0, 0x24u);
+        s_i2c[i].phase = E_SIM_I2C_IDLE;
+        s_i2c[i].pCur = NULL;
+        s_i2c[i].rxBusy = false;
+        s_i2c[i].stopPending = false;
+        s_i2c[i].startPending = false;
+    }
+    /* The SI5351 is on the board supply: only a power cycle clears it */
+    if (cause == E_SIM_RESET_POWER) {
+        memset(s_si5351.reg, 0, sizeof(s_si5351.reg));
+        s_si5351.reg[3] = 0xFFu;
+        s_si5351.writes = 0;
+    }
+    Sim_Tim_SetEtrHz(Sim_Si5351_GetHz(1));
+}
+
+const Sim_Model g_simModelI2c = { "i2c", Sim_I2c_Init, Sim_I2c_Reset, NULL };
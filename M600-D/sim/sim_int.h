@@ -0,0 +1,117 @@
+/************************************************************************************
+ * @file     : sim_int.h
+ * @brief    : Host simulator - interfaces between the sim core and the peripheral models
+ * @details  : Models keep their state in the register backdoor (SIM_BD), the same bytes
+ *             the firmware sees at the real address, so reads need no hook unless they
+ *             have side effects. Hooks run inside the trap handler: they may change
+ *             registers, start timers and raise interrupt lines, never call firmware code.
+ ***********************************************************************************/
+#ifndef SIM_INT_H
+#define SIM_INT_H
+
+#include "sim.h"
+#include "stm32f10x.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SIM_FLASH_BASE      0x08000000u
+#define SIM_FLASH_SIZE      0x00080000u
+#define SIM_SYSMEM_BASE     0x1FFFF000u
+#define SIM_SRAM_BASE       0x20000000u
+#define SIM_SRAM_SIZE       0x00010000u
+#define SIM_STACK_BASE      0x20100000u     /* firmware main() stack, DMA-visible */
+#define SIM_STACK_SIZE      0x00100000u
+#define SIM_PERIPH_BASE     0x40000000u
+#define SIM_PERIPH_SIZE     0x00030000u
+#define SIM_BITBAND_BASE    0x42000000u
+#define SIM_BITBAND_SIZE    0x02000000u
+#define SIM_CORE_BASE       0xE0000000u
+#define SIM_CORE_SIZE       0x00100000u
+
+#define SIM_TRAP_WR         0x01u           /* write hook, reads go straight to memory */
+#define SIM_TRAP_RD         0x02u           /* read hook as well */
+
+/* Virtual CPU time per intrinsic call and per trapped register access */
+#define SIM_INSN_NS         250u
+#define SIM_ACCESS_NS       100u
+
+/* Host pointer to the backdoor copy of an MCU register block */
+#define SIM_BD(p)           ((__typeof__(p))Sim_Backdoor((uint32_t)(uintptr_t)(p)))
+
+#define SIM_FATAL(...)      Sim_Fatal(__FILE__, __LINE__, __VA_ARGS__)
+
+/**
+ * pre: before the access (reads: refresh the value the CPU is about to load).
+ * post: after it; write: old and new word, the hook decides what the register keeps.
+ * addr is the accessed byte address, old/val the aligned 32-bit word around it.
+ */
+typedef void (*Sim_Hook)(uint32_t addr, bool write, uint32_t old, uint32_t val);
+
+void Sim_MapRegs(uint32_t base, uint32_t size, uint8_t trap, Sim_Hook pre, Sim_Hook post);
+void *Sim_Backdoor(uint32_t addr);
+uintptr_t Sim_HostAddr(uint32_t addr, uint32_t len);
+void Sim_Fatal(const char *pFile, int line, const char *pFmt, ...)
+    __attribute__((noreturn, format(printf, 3, 4)));
+
+/* Interrupts: level lines, the NVIC re-pends a line still high when the handler returns */
+void Sim_IrqLine(int irqn, bool level);
+void Sim_IrqPend(int irqn);
+/* Reset request from a model (AIRCR, IWDG), taken at the next poll */
+void Sim_RequestReset(Sim_ResetCause cause);
+/* Wake a WFI/STOP wait without an interrupt (event) */
+void Sim_Wake(void);
+bool Sim_InStop(void);
+uint64_t Sim_NextEvent(void);
+
+/* Model life cycle, called by the core in this order */
+typedef struct {
+    const char *pName;
+    void (*init)(void);                     /* once: map registers */
+    void (*reset)(Sim_ResetCause cause);    /* every boot: reset values */
+    void (*stop)(bool enter);               /* STOP mode entry / exit */
+} Sim_Model;
+
+extern const Sim_Model g_simModelRcc;
+extern const Sim_Model g_simModelGpio;
+extern const Sim_Model g_simModelDma;
+extern const Sim_Model g_simModelAdc;
+extern const Sim_Model g_simModelDac;
+extern const Sim_Model g_simModelTim;
+extern const Sim_Model g_simModelUsart;
+extern const Sim_Model g_simModelI2c;
+extern const Sim_Model g_simModelFlash;
+
+/* Clocks (sim_rcc.c) */
+uint32_t Sim_Rcc_SysClk(void);
+uint32_t Sim_Rcc_Pclk1(void);
+uint32_t Sim_Rcc_Pclk2(void);
+uint32_t Sim_Rcc_AdcClk(void);
+uint32_t Sim_Rcc_TimClk(uint32_t timBase);
+bool Sim_Rcc_Lsi(void);
+
+/* EXTI lines outside GPIO (16 PVD, 17 RTC alarm), rising edge (sim_gpio.c) */
+void Sim_Exti_Edge(uint8_t line, bool rising);
+void Sim_Gpio_Input(char port, uint8_t pin, int level);
+
+/* DMA request from a peripheral (sim_dma.c); false when the channel is off or done */
+bool Sim_Dma_Request(uint8_t dma, uint8_t ch);
+uint32_t Sim_Dma_LastWrite(uint8_t dma, uint8_t ch);
+void Sim_Dma_OnEnable(uint8_t dma, uint8_t ch, void (*fn)(bool enabled));
+
+/* Trapped write of a peripheral register done by the DMA, runs the register's hook */
+void Sim_BusWrite(uint32_t addr, uint32_t val, uint8_t size);
+uint32_t Sim_BusRead(uint32_t addr, uint8_t size);
+
+/* TIM6 TRGO for the DAC (sim_tim.c -> sim_dac.c) */
+void Sim_Dac_Trigger(void);
+
+/* SYSCLK about to change / changed (sim_rcc.c -> sim_core.c): SysTick and CYCCNT rebase */
+void Sim_Core_ClockChange(void);
+void Sim_Core_ClockChanged(void);
+/* Bootloader hand-over to the application image; does not return */
+void Sim_JumpImage(void) __attribute__((noreturn));
+
+/* RTT control block of the loaded image (sim_rtt.c) */
+void Sim_Rtt_Bind(void *pCb);
+
+#endif /* SIM_INT_H */
@@ -0,0 +1,257 @@
+/************************************************************************************
+ * @file     : sim_main.c
+ * @brief    : Host simulator - session runner
+ * @details  : m600_sim <image.so> <session.sim> boots the firmware and plays a script,
+ *             one command per line ('#' starts a comment):
+ *               run <ms>                    let the firmware run
+ *               reset <power|soft|pin>      reboot
+ *               pin <Pxn> <0|1|z>           drive a pin from outside, z releases it
+ *               adc <ch> <mV> [sine|square|triangle <amp mV> <Hz>]
+ *                                           ADC input, fixed or a waveform around mV
+ *               vdd <mV>                    supply seen by the PVD
+ *               eeprom <attach|detach>      probe AT24C02 on I2C2
+ *               uart <n> <hex bytes...>     host -> USARTn
+ *               rtt <text>                  RTT down buffer 0 (log console), CR LF appended
+ *               expect-rtt <text>           RTT channel 0 output since the last expect-rtt
+ *               expect-uart <n> <hex...>    USARTn output since the last expect-uart
+ *               expect-resets <n>           firmware resets since boot
+ *             RTT channel 0 is echoed to stdout. At the end the runner prints the
+ *             virtual time covered per wall clock second (M600_SIM_STATS=1: where the
+ *             time went).
+ ***********************************************************************************/
+#define _GNU_SOURCE
+#include "sim.h"
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SIM_MAIN_LOG_MAX    (1u << 20)
+#define SIM_MAIN_SLICE_NS   SIM_MS(1)
+
+static char s_rtt[SIM_MAIN_LOG_MAX];
+static size_t s_rttLen = 0;
+static uint8_t s_uart[2][SIM_MAIN_LOG_MAX];
+static size_t s_uartLen[2] = { 0, 0 };
+static bool s_echo = true;
+
+typedef enum {
+    E_SIM_WAVE_SINE = 0,
+    E_SIM_WAVE_SQUARE,
+    E_SIM_WAVE_TRIANGLE,
+} Sim_WaveShape;
+
+static struct {
+    Sim_WaveShape shape;
+    double offsetMv;
+    double ampMv;
+    double hz;
+} s_wave[18];
+
+static uint32_t Sim_Main_Wave(uint64_t t, void *pCtx)
+{
+    const __typeof__(s_wave[0]) *pW = pCtx;
+    double phase = fmod((double)t * 1e-9 * pW->hz, 1.0);
+    double v;
+
+    switch (pW->shape) {
+    case E_SIM_WAVE_SQUARE:
+        v = phase < 0.5 ? 1.0 : -1.0;
+        break;
+    case E_SIM_WAVE_TRIANGLE:
+        v = phase < 0.5 ? 4.0 * phase - 1.0 : 3.0 - 4.0 * phase;
+        break;
+    default:
+        v = sin(2.0 * M_PI * phase);
+        break;
+    }
+    v = pW->offsetMv + pW->ampMv * v;
+    return v <= 0.0 ? 0u : (uint32_t)(v + 0.5);
+}
+
+static void Sim_Main_Drain(void)
+{
+    char buf[512];
+    size_t n;
+    uint8_t u;
+
+    while ((n = Sim_Rtt_Read(0, buf, sizeof(buf))) != 0u) {
+        if (s_echo)
+            fwrite(buf, 1, n, stdout);
+        if (s_rttLen + n > sizeof(s_rtt)) {
+            memmove(s_rtt, s_rtt + sizeof(s_rtt) / 2u, sizeof(s_rtt) / 2u);
+            s_rttLen -= sizeof(s_rtt) / 2u;
+        }
+        memcpy(s_rtt + s_rttLen, buf, n);
+        s_rttLen += n;
+    }
+    for (u = 0; u < 2u; u++) {
+        while ((n = Sim_Uart_Recv((uint8_t)(u + 1u), buf, sizeof(buf))) != 0u) {
+            if (s_uartLen[u] + n > sizeof(s_uart[u]))
+                s_uartLen[u] = 0;
+            memcpy(s_uart[u] + s_uartLen[u], buf, n);
+            s_uartLen[u] += n;
+        }
+    }
+}
+
+static void Sim_Main_Run(uint64_t ns)
+{
+    uint64_t end = Sim_Now() + ns;
+
+    while (Sim_Now() < end) {
+        Sim_RunFor(end - Sim_Now() < SIM_MAIN_SLICE_NS ? end - Sim_Now() : SIM_MAIN_SLICE_NS);
+        Sim_Main_Drain();
+    }
+}
+
+static size_t Sim_Main_Hex(char *pArgs, uint8_t *pOut, size_t max)
+{
+    char *pTok;
+    size_t n = 0;
+
+    for (pTok = strtok(pArgs, " \t"); pTok != NULL && n < max; pTok = strtok(NULL, " \t"))
+        pOut[n++] = (uint8_t)strtoul(pTok, NULL, 16);
+    return n;
+}
+
+static bool Sim_Main_Find(const void *pHay, size_t hayLen, const void *pNeedle, size_t len)
+{
+    return len == 0u || memmem(pHay, hayLen, pNeedle, len) != NULL;
+}
+
+static bool Sim_Main_Line(char *pLine, const char *pFile, int lineNo)
+{
+    char *pCmd;
+    char *pArgs;
+    uint8_t bytes[512];
+    size_t n;
+
+    pLine[strcspn(pLine, "#\r\n")] = '\0';
+    pCmd = strtok(pLine, " \t");
+    if (pCmd == NULL)
+        return true;
+    pArgs = strtok(NULL, "");
+    if (pArgs == NULL)
+        pArgs = "";
+    while (isspace((unsigned char)*pArgs))
+        pArgs++;
+
+    if (strcmp(pCmd, "run") == 0) {
+        Sim_Main_Run(SIM_US(strtod(pArgs, NULL) * 1000.0));
+    } else if (strcmp(pCmd, "reset") == 0) {
+        Sim_Boot(strcmp(pArgs, "soft") == 0 ? E_SIM_RESET_SOFT :
+                 strcmp(pArgs, "pin") == 0 ? E_SIM_RESET_PIN : E_SIM_RESET_POWER);
+        Sim_Start();
+    } else if (strcmp(pCmd, "pin") == 0) {
+        char level[8] = "";
+        char port = 0;
+        unsigned pin = 0;
+        if (sscanf(pArgs, "P%c%u %7s", &port, &pin, level) != 3)
+            goto syntax;
+        Sim_Pin_Drive(port, (uint8_t)pin, level[0] == 'z' ? -1 : atoi(level));
+    } else if (strcmp(pCmd, "adc") == 0) {
+        char shape[16] = "";
+        unsigned ch = 0;
+        unsigned mv = 0;
+        double amp = 0.0;
+        double hz = 0.0;
+        int n = sscanf(pArgs, "%u %u %15s %lf %lf", &ch, &mv, shape, &amp, &hz);
+        if (n == 2 && ch < 18u) {
+            Sim_Adc_SetMv((uint8_t)ch, mv);
+        } else if (n == 5 && ch < 18u) {
+            s_wave[ch].shape = strcmp(shape, "square") == 0 ? E_SIM_WAVE_SQUARE :
+                               strcmp(shape, "triangle") == 0 ? E_SIM_WAVE_TRIANGLE : E_SIM_WAVE_SINE;
+            s_wave[ch].offsetMv = mv;
+            s_wave[ch].ampMv = amp;
+            s_wave[ch].hz = hz;
+            Sim_Adc_SetSource((uint8_t)ch, Sim_Main_Wave, &s_wave[ch]);
+        } else {
+            goto syntax;
+        }
+    } else if (strcmp(pCmd, "vdd") == 0) {
+        Sim_Power_SetVdd((uint32_t)strtoul(pArgs, NULL, 10));
+    } else if (strcmp(pCmd, "eeprom") == 0) {
+        Sim_Eeprom_Attach(strcmp(pArgs, "detach") != 0);
+    } else if (strcmp(pCmd, "uart") == 0) {
+        uint8_t u = (uint8_t)strtoul(pArgs, &pArgs, 10);
+        n = Sim_Main_Hex(pArgs, bytes, sizeof(bytes));
+        Sim_Uart_Send(u, bytes, n);
+    } else if (strcmp(pCmd, "rtt") == 0) {
+        Sim_Rtt_Write(pArgs, strlen(pArgs));
+        Sim_Rtt_Write("\r\n", 2u);
+    } else if (strcmp(pCmd, "expect-rtt") == 0) {
+        if (!Sim_Main_Find(s_rtt, s_rttLen, pArgs, strlen(pArgs))) {
+            fprintf(stderr, "%s:%d: RTT output has no \"%s\"\n", pFile, lineNo, pArgs);
+            return false;
+        }
+        s_rttLen = 0;
+    } else if (strcmp(pCmd, "expect-uart") == 0) {
+        uint8_t u = (uint8_t)strtoul(pArgs, &pArgs, 10);
+        if (u < 1u || u > 2u)
+            goto syntax;
+        n = Sim_Main_Hex(pArgs, bytes, sizeof(bytes));
+        if (!Sim_Main_Find(s_uart[u - 1u], s_uartLen[u - 1u], bytes, n)) {
+            fprintf(stderr, "%s:%d: USART%u sent %zu bytes, not the expected sequence\n",
+                    pFile, lineNo, u, s_uartLen[u - 1u]);
+            return false;
+        }
+        s_uartLen[u - 1u] = 0;
+    } else if (strcmp(pCmd, "expect-resets") == 0) {
+        if (Sim_GetResetCount() != strtoul(pArgs, NULL, 10)) {
+            fprintf(stderr, "%s:%d: %u resets\n", pFile, lineNo, Sim_GetResetCount());
+            return false;
+        }
+    } else {
+        goto syntax;
+    }
+    return true;
+
+syntax:
+    fprintf(stderr, "%s:%d: cannot parse \"%s %s\"\n", pFile, lineNo, pCmd, pArgs);
+    return false;
+}
+
+static double Sim_Main_Wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    char line[1024];
+    FILE *f;
+    double wall;
+    int lineNo = 0;
+    bool ok = true;
+
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <m600_fw.so> <session.sim>\n", argv[0]);
+        return 2;
+    }
+    if ((f = fopen(argv[2], "r")) == NULL) {
+        perror(argv[2]);
+        return 2;
+    }
+    s_echo = getenv("M600_SIM_QUIET") == NULL;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    Sim_Init(argv[1]);
+    wall = Sim_Main_Wall();
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_Start();
+    while (ok && fgets(line, sizeof(line), f) != NULL)
+        ok = Sim_Main_Line(line, argv[2], ++lineNo);
+    fclose(f);
+    wall = Sim_Main_Wall() - wall;
+    printf("\nsim: %.3f s simulated in %.3f s wall, %.2f sim-s/wall-s, %u resets, %.3f s in STOP\n",
+           (double)Sim_Now() / 1e9, wall, wall > 0.0 ? (double)Sim_Now() / 1e9 / wall : 0.0,
+           Sim_GetResetCount(), (double)Sim_Power_GetStopNs() / 1e9);
+    if (getenv("M600_SIM_STATS") != NULL)
+        Sim_PrintStats();
+    return ok ? 0 : 1;
+}
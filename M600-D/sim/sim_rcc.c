@@ -0,0 +1,458 @@
+/************************************************************************************
+ * @file     : sim_rcc.c
+ * @brief    : Host simulator - RCC, PWR/PVD, backup domain, RTC and IWDG models
+ * @details  : Oscillators become ready after their start-up time, SWS follows SW, the
+ *             reset flags in RCC_CSR accumulate until RMVF like on the part. The RTC
+ *             and the IWDG run from the LSI (40 kHz nominal) and keep running in STOP.
+ *             The backup domain (BDCR, RTC, BKP) survives every reset but a power-on.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_HSI_HZ          8000000u
+#define SIM_HSE_HZ          8000000u
+#define SIM_LSI_HZ          40000u
+#define SIM_HSE_START_NS    SIM_US(1500)
+#define SIM_PLL_LOCK_NS     SIM_US(200)
+#define SIM_LSI_START_NS    SIM_US(85)
+
+#define SIM_CSR_FLAGS       0xFC000000u
+#define SIM_CSR_PINRSTF     (1u << 26)
+#define SIM_CSR_PORRSTF     (1u << 27)
+#define SIM_CSR_SFTRSTF     (1u << 28)
+#define SIM_CSR_IWDGRSTF    (1u << 29)
+#define SIM_CSR_RMVF        (1u << 24)
+
+static Sim_Timer s_hseTimer;
+static Sim_Timer s_pllTimer;
+static Sim_Timer s_lsiTimer;
+static Sim_Timer s_alarmTimer;
+static Sim_Timer s_iwdgTimer;
+static uint32_t s_vddMv = 3300u;
+
+/* RTC counter: CNT = s_rtcCnt0 + ticks since s_rtcT0 */
+static uint32_t s_rtcCnt0 = 0;
+static uint64_t s_rtcT0 = 0;
+static bool s_rtcRun = false;
+/* IWDG */
+static bool s_iwdgOn = false;
+static bool s_iwdgUnlocked = false;
+static uint64_t s_iwdgReload = 0;
+
+/* ---------- Clocks ---------- */
+
+static uint32_t Sim_Rcc_SysClkFrom(uint32_t cfgr)
+{
+    uint32_t src;
+    uint32_t mul;
+
+    switch ((cfgr & RCC_CFGR_SWS) >> 2) {
+    case 1:
+        return SIM_HSE_HZ;
+    case 2:
+        src = (cfgr & RCC_CFGR_PLLSRC) ? ((cfgr & RCC_CFGR_PLLXTPRE) ? SIM_HSE_HZ / 2u : SIM_HSE_HZ)
+                                       : SIM_HSI_HZ / 2u;
+        mul = ((cfgr & RCC_CFGR_PLLMULL) >> 18) + 2u;
+        return src * (mul > 16u ? 16u : mul);
+    default:
+        return SIM_HSI_HZ;
+    }
+}
+
+static uint32_t Sim_Rcc_HclkFrom(uint32_t cfgr)
+{
+    static const uint8_t s_ahbShift[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9 };
+
+    return Sim_Rcc_SysClkFrom(cfgr) >> s_ahbShift[(cfgr & RCC_CFGR_HPRE) >> 4];
+}
+
+/* Core clock (HCLK) */
+uint32_t Sim_Rcc_SysClk(void)
+{
+    return Sim_Rcc_HclkFrom(SIM_BD(RCC)->CFGR);
+}
+
+static uint32_t Sim_Rcc_ApbShift(uint32_t ppre)
+{
+    return (ppre & 4u) ? (ppre & 3u) + 1u : 0u;
+}
+
+uint32_t Sim_Rcc_Pclk1(void)
+{
+    return Sim_Rcc_SysClk() >> Sim_Rcc_ApbShift((SIM_BD(RCC)->CFGR & RCC_CFGR_PPRE1) >> 8);
+}
+
+uint32_t Sim_Rcc_Pclk2(void)
+{
+    return Sim_Rcc_SysClk() >> Sim_Rcc_ApbShift((SIM_BD(RCC)->CFGR & RCC_CFGR_PPRE2) >> 11);
+}
+
+uint32_t Sim_Rcc_AdcClk(void)
+{
+    return Sim_Rcc_Pclk2() / ((((SIM_BD(RCC)->CFGR & RCC_CFGR_ADCPRE) >> 14) + 1u) * 2u);
+}
+
+/* TIMxCLK: PCLKx, doubled when the APB prescaler is not 1. TIM1/TIM8 are on APB2 */
+uint32_t Sim_Rcc_TimClk(uint32_t timBase)
+{
+    bool apb2 = (timBase == TIM1_BASE || timBase == TIM8_BASE);
+    uint32_t ppre = apb2 ? (SIM_BD(RCC)->CFGR & RCC_CFGR_PPRE2) >> 11 : (SIM_BD(RCC)->CFGR & RCC_CFGR_PPRE1) >> 8;
+    uint32_t pclk = apb2 ? Sim_Rcc_Pclk2() : Sim_Rcc_Pclk1();
+
+    return Sim_Rcc_ApbShift(ppre) != 0 ? pclk * 2u : pclk;
+}
+
+bool Sim_Rcc_Lsi(void)
+{
+    return (SIM_BD(RCC)->CSR & RCC_CSR_LSIRDY) != 0;
+}
+
+static void Sim_Rcc_HseReady(void *pCtx)
+{
+    (void)pCtx;
+    if (SIM_BD(RCC)->CR & RCC_CR_HSEON)
+        SIM_BD(RCC)->CR |= RCC_CR_HSERDY;
+}
+
+static void Sim_Rcc_PllReady(void *pCtx)
+{
+    (void)pCtx;
+    if (SIM_BD(RCC)->CR & RCC_CR_PLLON)
+        SIM_BD(RCC)->CR |= RCC_CR_PLLRDY;
+}
+
+static void Sim_Rtc_Reschedule(void);
+static void Sim_Iwdg_Reschedule(void);
+
+static void Sim_Rcc_LsiReady(void *pCtx)
+{
+    (void)pCtx;
+    if (SIM_BD(RCC)->CSR & RCC_CSR_LSION) {
+        SIM_BD(RCC)->CSR |= RCC_CSR_LSIRDY;
+        Sim_Rtc_Reschedule();
+    }
+}
+
+static void Sim_Rcc_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    if (!write)
+        return;
+    switch (addr & ~3u) {
+    case RCC_BASE + 0x00u:      /* CR */
+        val = (val & ~(RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY)) |
+              (old & (RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY));
+        if (val & RCC_CR_HSION)
+            val |= RCC_CR_HSIRDY;
+        else
+            val &= ~RCC_CR_HSIRDY;
+        if (!(val & RCC_CR_HSEON))
+            val &= ~RCC_CR_HSERDY;
+        else if (!(old & RCC_CR_HSEON))
+            Sim_TimerStart(&s_hseTimer, Sim_Now() + SIM_HSE_START_NS, Sim_Rcc_HseReady, NULL);
+        if (!(val & RCC_CR_PLLON))
+            val &= ~RCC_CR_PLLRDY;
+        else if (!(old & RCC_CR_PLLON))
+            Sim_TimerStart(&s_pllTimer, Sim_Now() + SIM_PLL_LOCK_NS, Sim_Rcc_PllReady, NULL);
+        SIM_BD(RCC)->CR = val;
+        break;
+    case RCC_BASE + 0x04u:      /* CFGR: SWS follows SW when the source is ready */
+    {
+        uint32_t sw = val & RCC_CFGR_SW;
+        uint32_t sws = (old & RCC_CFGR_SWS) >> 2;
+        uint32_t cr = SIM_BD(RCC)->CR;
+
+        if ((sw == 1u && (cr & RCC_CR_HSERDY)) || (sw == 2u && (cr & RCC_CR_PLLRDY)) || sw == 0u)
+            sws = sw;
+        val = (val & ~RCC_CFGR_SWS) | (sws << 2);
+        SIM_BD(RCC)->CFGR = old;
+        Sim_Core_ClockChange();
+        SIM_BD(RCC)->CFGR = val;
+        Sim_Core_ClockChanged();
+        break;
+    }
+    case RCC_BASE + 0x08u:      /* CIR: flags read-only, clear bits write-only */
+        SIM_BD(RCC)->CIR = (old & 0xFFu & ~(val >> 16)) | (val & 0x1F00u);
+        break;
+    case RCC_BASE + 0x20u:      /* BDCR */
+        if (val & RCC_BDCR_BDRST) {
+            SIM_BD(RCC)->BDCR = RCC_BDCR_BDRST;
+            memset(Sim_Backdoor(RTC_BASE), 0, 0x30u);
+            memset(Sim_Backdoor(BKP_BASE), 0, 0x400u);
+            SIM_BD(RTC)->CRL = RTC_CRL_RTOFF;
+            s_rtcCnt0 = 0;
+            s_rtcT0 = Sim_Now();
+        } else {
+            SIM_BD(RCC)->BDCR = (val & ~RCC_BDCR_LSERDY) | ((val & RCC_BDCR_LSEON) ? RCC_BDCR_LSERDY : 0u);
+        }
+        Sim_Rtc_Reschedule();
+        break;
+    case RCC_BASE + 0x24u:      /* CSR */
+        val = (val & (RCC_CSR_LSION | SIM_CSR_RMVF)) | (old & (SIM_CSR_FLAGS | RCC_CSR_LSIRDY));
+        if (!(val & RCC_CSR_LSION))
+            val &= ~RCC_CSR_LSIRDY;
+        else if (!(old & RCC_CSR_LSION))
+            Sim_TimerStart(&s_lsiTimer, Sim_Now() + SIM_LSI_START_NS, Sim_Rcc_LsiReady, NULL);
+        if (val & SIM_CSR_RMVF)
+            val &= ~(SIM_CSR_FLAGS | SIM_CSR_RMVF);
+        SIM_BD(RCC)->CSR = val;
+        Sim_Rtc_Reschedule();
+        break;
+    default:
+        break;
+    }
+}
+
+/* ---------- PWR / PVD ---------- */
+
+static bool Sim_Pwr_Pvdo(void)
+{
+    uint32_t cr = SIM_BD(PWR)->CR;
+    uint32_t levelMv = 2200u + 100u * ((cr & PWR_CR_PLS) >> 5);
+
+    return (cr & PWR_CR_PVDE) && s_vddMv < levelMv;
+}
+
+static void Sim_Pwr_Update(void)
+{
+    bool pvdo = Sim_Pwr_Pvdo();
+    bool was = (SIM_BD(PWR)->CSR & PWR_CSR_PVDO) != 0;
+
+    if (pvdo)
+        SIM_BD(PWR)->CSR |= PWR_CSR_PVDO;
+    else
+        SIM_BD(PWR)->CSR &= ~PWR_CSR_PVDO;
+    if (pvdo != was)
+        Sim_Exti_Edge(16, pvdo);
+}
+
+void Sim_Power_SetVdd(uint32_t mv)
+{
+    s_vddMv = mv;
+    Sim_Pwr_Update();
+}
+
+static void Sim_Pwr_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    (void)old;
+    if (!write)
+        return;
+    if ((addr & ~3u) == PWR_BASE) {
+        if (val & PWR_CR_CWUF)
+            SIM_BD(PWR)->CSR &= ~PWR_CSR_WUF;
+        if (val & PWR_CR_CSBF)
+            SIM_BD(PWR)->CSR &= ~PWR_CSR_SBF;
+        SIM_BD(PWR)->CR = val & ~(PWR_CR_CWUF | PWR_CR_CSBF);
+        Sim_Pwr_Update();
+    } else {
+        SIM_BD(PWR)->CSR = (old & ~PWR_CSR_EWUP) | (val & PWR_CSR_EWUP);
+    }
+}
+
+/* ---------- RTC ---------- */
+
+static bool Sim_Rtc_Clocked(void)
+{
+    uint32_t bdcr = SIM_BD(RCC)->BDCR;
+
+    return (bdcr & RCC_BDCR_RTCEN) && (bdcr & RCC_BDCR_RTCSEL) == RCC_BDCR_RTCSEL_LSI && Sim_Rcc_Lsi();
+}
+
+static uint64_t Sim_Rtc_TickNs(void)
+{
+    uint32_t prl = ((SIM_BD(RTC)->PRLH & 0xFu) << 16) | SIM_BD(RTC)->PRLL;
+
+    return (uint64_t)(prl + 1u) * 1000000000ull / SIM_LSI_HZ;
+}
+
+static uint32_t Sim_Rtc_Cnt(void)
+{
+    if (!s_rtcRun)
+        return s_rtcCnt0;
+    return s_rtcCnt0 + (uint32_t)((Sim_Now() - s_rtcT0) / Sim_Rtc_TickNs());
+}
+
+static void Sim_Rtc_Rebase(uint32_t cnt)
+{
+    s_rtcCnt0 = cnt;
+    s_rtcT0 = Sim_Now();
+}
+
+static void Sim_Rtc_Alarm(void *pCtx)
+{
+    (void)pCtx;
+    SIM_BD(RTC)->CRL |= RTC_CRL_ALRF;
+    Sim_Exti_Edge(17, true);
+    Sim_Exti_Edge(17, false);
+    Sim_IrqLine(RTC_IRQn, (SIM_BD(RTC)->CRH & RTC_CRH_ALRIE) != 0);
+}
+
+static void Sim_Rtc_Reschedule(void)
+{
+    uint32_t cnt = Sim_Rtc_Cnt();
+    uint32_t alr = ((uint32_t)SIM_BD(RTC)->ALRH << 16) | SIM_BD(RTC)->ALRL;
+    bool run = Sim_Rtc_Clocked();
+
+    if (run != s_rtcRun) {
+        Sim_Rtc_Rebase(cnt);
+        s_rtcRun = run;
+    }
+    Sim_TimerStop(&s_alarmTimer);
+    if (run && alr > cnt)
+        Sim_TimerStart(&s_alarmTimer, s_rtcT0 + (uint64_t)(alr - s_rtcCnt0) * Sim_Rtc_TickNs(),
+                       Sim_Rtc_Alarm, NULL);
+}
+
+static void Sim_Rtc_Pre(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    uint32_t cnt = Sim_Rtc_Cnt();
+
+    (void)addr;
+    (void)write;
+    (void)old;
+    (void)val;
+    SIM_BD(RTC)->CNTH = (uint16_t)(cnt >> 16);
+    SIM_BD(RTC)->CNTL = (uint16_t)cnt;
+}
+
+static void Sim_Rtc_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    uint32_t off = (addr & ~3u) - RTC_BASE;
+
+    if (!write)
+        return;
+    switch (off) {
+    case 0x04u:     /* CRL: RSF/flags rc_w0, RTOFF read-only, writes complete at once */
+        SIM_BD(RTC)->CRL = (uint16_t)((old & val & 0x0Fu) | (val & RTC_CRL_CNF) | RTC_CRL_RTOFF | RTC_CRL_RSF);
+        break;
+    case 0x18u:     /* CNTH */
+    case 0x1Cu:     /* CNTL */
+        Sim_Rtc_Rebase(((uint32_t)SIM_BD(RTC)->CNTH << 16) | SIM_BD(RTC)->CNTL);
+        break;
+    case 0x08u:     /* PRLH */
+    case 0x0Cu:     /* PRLL */
+        Sim_Rtc_Rebase(Sim_Rtc_Cnt());
+        break;
+    default:
+        break;
+    }
+    (void)val;
+    Sim_IrqLine(RTC_IRQn, (SIM_BD(RTC)->CRH & SIM_BD(RTC)->CRL & RTC_CRL_ALRF & RTC_CRH_ALRIE) != 0);
+    Sim_Rtc_Reschedule();
+}
+
+/* ---------- IWDG ---------- */
+
+static void Sim_Iwdg_Expire(void *pCtx)
+{
+    (void)pCtx;
+    Sim_RequestReset(E_SIM_RESET_IWDG);
+}
+
+static void Sim_Iwdg_Reschedule(void)
+{
+    uint32_t pr = SIM_BD(IWDG)->PR & 7u;
+    uint32_t rlr = SIM_BD(IWDG)->RLR & 0xFFFu;
+    uint64_t tickNs = (uint64_t)(4u << (pr > 6u ? 6u : pr)) * 1000000000ull / SIM_LSI_HZ;
+
+    if (!s_iwdgOn)
+        return;
+    Sim_TimerStart(&s_iwdgTimer, s_iwdgReload + (uint64_t)(rlr + 1u) * tickNs, Sim_Iwdg_Expire, NULL);
+}
+
+static void Sim_Iwdg_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    if (!write)
+        return;
+    switch ((addr & ~3u) - IWDG_BASE) {
+    case 0x00u:     /* KR */
+        SIM_BD(IWDG)->KR = 0;
+        s_iwdgUnlocked = ((val & 0xFFFFu) == 0x5555u);
+        if ((val & 0xFFFFu) == 0xCCCCu) {
+            s_iwdgOn = true;
+            SIM_BD(RCC)->CSR |= RCC_CSR_LSION | RCC_CSR_LSIRDY;    /* forced on by the IWDG */
+        }
+        if ((val & 0xFFFFu) == 0xAAAAu || (val & 0xFFFFu) == 0xCCCCu) {
+            s_iwdgReload = Sim_Now();
+            Sim_Iwdg_Reschedule();
+        }
+        break;
+    case 0x04u:     /* PR */
+    case 0x08u:     /* RLR */
+        if (!s_iwdgUnlocked)
+            *(uint32_t *)Sim_Backdoor(addr & ~3u) = old;
+        break;
+    default:
+        *(uint32_t *)Sim_Backdoor(addr & ~3u) = old;
+        break;
+    }
+}
+
+/* ---------- Model ---------- */
+
+static void Sim_Rcc_Init(void)
+{
+    Sim_MapRegs(RCC_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Rcc_Post);
+    Sim_MapRegs(PWR_BASE, 0x400u, SIM_TRAP_WR, NULL, Sim_Pwr_Post);
+    Sim_MapRegs(RTC_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, Sim_Rtc_Pre, Sim_Rtc_Post);
+    Sim_MapRegs(IWDG_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Iwdg_Post);
+}
+
+static void Sim_Rcc_Reset(Sim_ResetCause cause)
+{
+    uint32_t csr = SIM_BD(RCC)->CSR & SIM_CSR_FLAGS;
+    uint32_t bdcr = SIM_BD(RCC)->BDCR;
+
+    Sim_TimerStop(&s_hseTimer);
+    Sim_TimerStop(&s_pllTimer);
+    Sim_TimerStop(&s_lsiTimer);
+    Sim_TimerStop(&s_iwdgTimer);
+    memset(Sim_Backdoor(RCC_BASE), 0, 0x400u);
+    memset(Sim_Backdoor(PWR_BASE), 0, 0x400u);
+    memset(Sim_Backdoor(IWDG_BASE), 0, 0x400u);
+    SIM_BD(RCC)->CR = 0x00000083u;
+    SIM_BD(IWDG)->RLR = 0xFFFu;
+    s_iwdgOn = false;
+    s_iwdgUnlocked = false;
+
+    switch (cause) {
+    case E_SIM_RESET_POWER:
+        csr = SIM_CSR_PORRSTF | SIM_CSR_PINRSTF;
+        bdcr = 0;
+        memset(Sim_Backdoor(RTC_BASE), 0, 0x400u);
+        memset(Sim_Backdoor(BKP_BASE), 0, 0x400u);
+        SIM_BD(RTC)->CRL = RTC_CRL_RTOFF;
+        SIM_BD(RTC)->PRLL = 0x8000u;
+        s_rtcCnt0 = 0;
+        s_rtcT0 = Sim_Now();
+        s_rtcRun = false;
+        Sim_TimerStop(&s_alarmTimer);
+        break;
+    case E_SIM_RESET_SOFT:
+        csr |= SIM_CSR_SFTRSTF | SIM_CSR_PINRSTF;
+        break;
+    case E_SIM_RESET_IWDG:
+        csr |= SIM_CSR_IWDGRSTF | SIM_CSR_PINRSTF;
+        break;
+    default:
+        csr |= SIM_CSR_PINRSTF;
+        break;
+    }
+    SIM_BD(RCC)->CSR = csr;
+    /* LSI is off after any reset: the RTC stops until the firmware turns it back on */
+    SIM_BD(RCC)->BDCR = bdcr;
+    SIM_BD(RTC)->CRL &= (uint16_t)~RTC_CRL_RSF;
+    Sim_Rtc_Reschedule();
+    Sim_Pwr_Update();
+}
+
+/* STOP: HSE and PLL off, HSI becomes the system clock; LSI, RTC and IWDG keep going */
+static void Sim_Rcc_Stop(bool enter)
+{
+    if (enter)
+        return;
+    SIM_BD(RCC)->CR &= ~(RCC_CR_HSEON | RCC_CR_HSERDY | RCC_CR_PLLON | RCC_CR_PLLRDY);
+    SIM_BD(RCC)->CR |= RCC_CR_HSION | RCC_CR_HSIRDY;
+    SIM_BD(RCC)->CFGR &= ~(RCC_CFGR_SW | RCC_CFGR_SWS);
+}
+
+const Sim_Model g_simModelRcc = { "rcc", Sim_Rcc_Init, Sim_Rcc_Reset, Sim_Rcc_Stop };
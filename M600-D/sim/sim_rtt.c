@@ -0,0 +1,69 @@
+/************************************************************************************
+ * @file     : sim_rtt.c
+ * @brief    : Host simulator - debug probe side of SEGGER RTT
+ * @details  : Reads the up buffers and fills down buffer 0 of the loaded image's
+ *             _SEGGER_RTT control block directly, as J-Link does over SWD. Nothing is
+ *             available until the firmware has initialised the block.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include "SEGGER_RTT.h"
+#include <string.h>
+
+static SEGGER_RTT_CB *s_pCb = NULL;
+
+void Sim_Rtt_Bind(void *pCb)
+{
+    s_pCb = pCb;
+}
+
+static bool Sim_Rtt_Ready(void)
+{
+    return s_pCb != NULL && memcmp(s_pCb->acID, "SEGGER RTT", 11) == 0;
+}
+
+size_t Sim_Rtt_Read(uint8_t ch, void *pBuf, size_t max)
+{
+    SEGGER_RTT_BUFFER_UP *pUp;
+    uint8_t *p = pBuf;
+    size_t n = 0;
+    unsigned rd;
+
+    if (!Sim_Rtt_Ready() || ch >= (unsigned)s_pCb->MaxNumUpBuffers)
+        return 0;
+    pUp = (SEGGER_RTT_BUFFER_UP *)&s_pCb->aUp[ch];
+    if (pUp->pBuffer == NULL || pUp->SizeOfBuffer == 0u)
+        return 0;
+    rd = pUp->RdOff;
+    while (n < max && rd != pUp->WrOff) {
+        p[n++] = (uint8_t)pUp->pBuffer[rd];
+        if (++rd >= pUp->SizeOfBuffer)
+            rd = 0;
+    }
+    pUp->RdOff = rd;
+    return n;
+}
+
+size_t Sim_Rtt_Write(const void *pData, size_t len)
+{
+    SEGGER_RTT_BUFFER_DOWN *pDown;
+    const uint8_t *p = pData;
+    size_t n = 0;
+    unsigned wr;
+    unsigned next;
+
+    if (!Sim_Rtt_Ready() || s_pCb->MaxNumDownBuffers < 1)
+        return 0;
+    pDown = (SEGGER_RTT_BUFFER_DOWN *)&s_pCb->aDown[0];
+    if (pDown->pBuffer == NULL || pDown->SizeOfBuffer == 0u)
+        return 0;
+    wr = pDown->WrOff;
+    while (n < len) {
+        next = wr + 1u >= pDown->SizeOfBuffer ? 0u : wr + 1u;
+        if (next == pDown->RdOff)
+            break;
+        pDown->pBuffer[wr] = (char)p[n++];
+        wr = next;
+    }
+    pDown->WrOff = wr;
+    return n;
+}
@@ -0,0 +1,390 @@
+/************************************************************************************
+ * @file     : sim_tim.c
+ * @brief    : Host simulator - TIM1..TIM7 time base, compare events, DMA requests, break
+ * @details  : Up-counting only. The counter is computed from the elapsed virtual time, so
+ *             a timer costs nothing until something consumes its events: a virtual timer
+ *             is armed only for update/compare events with a DMA request, an interrupt
+ *             or TRGO to the DAC (TIM6). Flags of the others are brought up to date when
+ *             the firmware reads the timer. ARR, PSC and CCRx preloads load at the update
+ *             event (or UG). TIM1 counts ETR edges in external clock mode 2 (Sim_Tim_SetEtrHz,
+ *             driven by the SI5351 model). BG sets BIF and clears MOE like a break input.
+ *             Output waveforms are not generated; tests read the registers and the state.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_TIM_NUM         7u
+
+typedef struct {
+    uint8_t dma;
+    uint8_t ch;
+} Sim_DmaReq;
+
+typedef struct {
+    uint32_t base;
+    int irqUp;
+    int irqCc;
+    Sim_DmaReq up;
+    Sim_DmaReq cc[4];
+    /* counter state */
+    bool run;
+    uint64_t t0Ps;              /* time of cnt0 */
+    uint32_t cnt0;
+    uint32_t arr;               /* shadow registers */
+    uint32_t psc;
+    uint32_t ccr[4];
+    Sim_Timer timer;
+} Sim_TimUnit;
+
+static Sim_TimUnit s_tim[SIM_TIM_NUM] = {
+    { TIM1_BASE, TIM1_UP_IRQn, TIM1_CC_IRQn, { 1, 5 }, { { 1, 2 }, { 1, 3 }, { 1, 6 }, { 1, 4 } } },
+    { TIM2_BASE, TIM2_IRQn, TIM2_IRQn, { 1, 2 }, { { 1, 5 }, { 1, 7 }, { 1, 1 }, { 1, 7 } } },
+    { TIM3_BASE, TIM3_IRQn, TIM3_IRQn, { 1, 3 }, { { 1, 6 }, { 0, 0 }, { 1, 2 }, { 1, 3 } } },
+    { TIM4_BASE, TIM4_IRQn, TIM4_IRQn, { 1, 7 }, { { 1, 1 }, { 1, 4 }, { 1, 5 }, { 0, 0 } } },
+    { TIM5_BASE, TIM5_IRQn, TIM5_IRQn, { 2, 2 }, { { 2, 5 }, { 2, 4 }, { 2, 2 }, { 2, 1 } } },
+    { TIM6_BASE, TIM6_IRQn, TIM6_IRQn, { 2, 3 }, { { 0, 0 } } },
+    { TIM7_BASE, TIM7_IRQn, TIM7_IRQn, { 2, 4 }, { { 0, 0 } } },
+};
+static uint32_t s_etrHz = 0;
+static bool s_frozen = false;
+
+static TIM_TypeDef *Sim_Tim_Bd(const Sim_TimUnit *pTim)
+{
+    return (TIM_TypeDef *)Sim_Backdoor(pTim->base);
+}
+
+static bool Sim_Tim_Basic(const Sim_TimUnit *pTim)
+{
+    return pTim->base == TIM6_BASE || pTim->base == TIM7_BASE;
+}
+
+static uint64_t Sim_Tim_NowPs(void)
+{
+    return Sim_Now() * 1000u;
+}
+
+/* Counter clock before the prescaler, 0 when nothing clocks the counter */
+static uint32_t Sim_Tim_ClkHz(const Sim_TimUnit *pTim)
+{
+    TIM_TypeDef *pBd = Sim_Tim_Bd(pTim);
+
+    if (!Sim_Tim_Basic(pTim) && ((pBd->SMCR & TIM_SMCR_ECE) ||
+                                 ((pBd->SMCR & TIM_SMCR_SMS) == 7u && (pBd->SMCR & TIM_SMCR_TS) == TIM_SMCR_TS))) {
+        if (pTim->base != TIM1_BASE)
+            return 0;
+        return s_etrHz >> ((pBd->SMCR & TIM_SMCR_ETPS) >> 12);
+    }
+    return Sim_Rcc_TimClk(pTim->base);
+}
+
+static uint64_t Sim_Tim_TickPs(const Sim_TimUnit *pTim)
+{
+    uint32_t hz = Sim_Tim_ClkHz(pTim);
+
+    return hz == 0u ? 0u : (uint64_t)(pTim->psc + 1u) * 1000000000000ull / hz;
+}
+
+static bool Sim_Tim_Counting(const Sim_TimUnit *pTim)
+{
+    return pTim->run && !s_frozen && Sim_Tim_TickPs(pTim) != 0u;
+}
+
+static void Sim_Tim_UpdateIrq(const Sim_TimUnit *pTim)
+{
+    TIM_TypeDef *pBd = Sim_Tim_Bd(pTim);
+    uint32_t act = pBd->SR & pBd->DIER;
+
+    if (pTim->irqUp == pTim->irqCc) {
+        Sim_IrqLine(pTim->irqUp, (act & 0x5Fu) != 0u);
+    } else {
+        Sim_IrqLine(pTim->irqUp, (act & TIM_SR_UIF) != 0u);
+        Sim_IrqLine(pTim->irqCc, (act & 0x1Eu) != 0u);
+        Sim_IrqLine(TIM1_BRK_IRQn, (act & TIM_SR_BIF) != 0u);
+    }
+}
+
+static void Sim_Tim_LoadShadows(Sim_TimUnit *pTim)
+{
+    TIM_TypeDef *pBd = Sim_Tim_Bd(pTim);
+
+    pTim->arr = pBd->ARR & 0xFFFFu;
+    pTim->psc = pBd->PSC & 0xFFFFu;
+    pTim->ccr[0] = pBd->CCR1 & 0xFFFFu;
+    pTim->ccr[1] = pBd->CCR2 & 0xFFFFu;
+    pTim->ccr[2] = pBd->CCR3 & 0xFFFFu;
+    pTim->ccr[3] = pBd->CCR4 & 0xFFFFu;
+}
+
+/* Update event: preloads to the shadows, UIF, and what the caller asks for */
+static void Sim_Tim_Update(Sim_TimUnit *pTim, bool requests)
+{
+    TIM_TypeDef *pBd = Sim_Tim_Bd(pTim);
+
+    if (pBd->CR1 & TIM_CR1_UDIS)
+        return;
+    Sim_Tim_LoadShadows(pTim);
+    pBd->SR |= TIM_SR_UIF;
+    if (!requests)
+        return;
+    if ((pBd->DIER & TIM_DIER_UDE) && pTim->up.dma != 0u)
+        Sim_Dma_Request(pTim->up.dma, pTim->up.ch);
+    if (pTim->base == TIM6_BASE && (pBd->CR2 & TIM_CR2_MMS) == TIM_CR2_MMS_1)
+        Sim_Dac_Trigger();
+}
+
+static void Sim_Tim_Compare(Sim_TimUnit *pTim, uint32_t i, bool requests)
+{
+    TIM_TypeDef *pBd = Sim_Tim_Bd(pTim);
+
+    pBd->SR |= (uint16_t)(TIM_SR_CC1IF << i);
+    if (requests && (pBd->DIER & (TIM_DIER_CC1DE << i)) && pTim->cc[i].dma != 0u)
+        Sim_Dma_Request(pTim->cc[i].dma, pTim->cc[i].ch);
+}
+
+/* Compare flags for counter values a..b (inclusive) */
+static void Sim_Tim_CompareRange(Sim_TimUnit *pTim, uint32_t a, uint32_t b)
+{
+    uint32_t i;
+
+    if (Sim_Tim_Basic(pTim))
+        return;
+    for (i = 0; i < 4u; i++) {
+        if (pTim->ccr[i] >= a && pTim->ccr[i] <= b)
+            Sim_Tim_Compare(pTim, i, false);
+    }
+}
+
+/* n counter ticks without DMA requests (nobody consumes them): CNT and flags only */
+static void Sim_Tim_Advance(Sim_TimUnit *pTim, uint64_t n)
+{
+    uint64_t toUpd;
+    uint32_t period = pTim->arr + 1u;
+
+    pTim->t0Ps += n * Sim_Tim_TickPs(pTim);
+    if (n == 0u)
+        return;
+    toUpd = pTim->cnt0 <= pTim->arr ? period - pTim->cnt0 : 0x10000u - pTim->cnt0 + period;
+    if (n < toUpd) {
+        Sim_Tim_CompareRange(pTim, pTim->cnt0 + 1u, pTim->cnt0 + (uint32_t)n);
+        pTim->cnt0 += (uint32_t)n;
+    } else {
+        Sim_Tim_CompareRange(pTim, pTim->cnt0 + 1u, pTim->arr);
+        n -= toUpd;
+        Sim_Tim_Update(pTim, false);
+        period = pTim->arr + 1u;
+        if (n >= period)
+            Sim_Tim_CompareRange(pTim, 0u, pTim->arr);
+        pTim->cnt0 = (uint32_t)(n % period);
+        Sim_Tim_CompareRange(pTim, 0u, pTim->cnt0);
+    }
+}
+
+/* Bring CNT and the flags up to now */
+static void Sim_Tim_Sync(Sim_TimUnit *pTim)
+{
+    uint64_t now = Sim_Tim_NowPs();
+
+    if (!Sim_Tim_Counting(pTim) || now <= pTim->t0Ps) {
+        pTim->t0Ps = now;
+    } else {
+        Sim_Tim_Advance(pTim, (now - pTim->t0Ps) / Sim_Tim_TickPs(pTim));
+        Sim_Tim_UpdateIrq(pTim);
+    }
+    Sim_Tim_Bd(pTim)->CNT = pTim->cnt0;
+}
+
+static void Sim_Tim_Event(void *pCtx);
+
+/* Arm the next event somebody listens to */
+static void Sim_Tim_Schedule(Sim_TimUnit *pTim)
+{
+    TIM_TypeDef *pBd = Sim_Tim_Bd(pTim);
+    uint64_t tick = Sim_Tim_TickPs(pTim);
+    uint64_t best = UINT64_MAX;
+    uint64_t d;
+    uint32_t period = pTim->arr + 1u;
+    uint32_t i;
+    bool upUsed;
+
+    Sim_TimerStop(&pTim->timer);
+    if (!Sim_Tim_Counting(pTim))
+        return;
+    upUsed = (pBd->DIER & (TIM_DIER_UDE | TIM_DIER_UIE)) ||
+             (pTim->base == TIM6_BASE && (pBd->CR2 & TIM_CR2_MMS) == TIM_CR2_MMS_1);
+    if (upUsed)
+        best = pTim->cnt0 <= pTim->arr ? period - pTim->cnt0 : 0x10000u - pTim->cnt0 + period;
+    for (i = 0; i < 4u && !Sim_Tim_Basic(pTim); i++) {
+        if (!(pBd->DIER & ((TIM_DIER_CC1IE | TIM_DIER_CC1DE) << i)) || pTim->ccr[i] > pTim->arr)
+            continue;
+        d = pTim->ccr[i] > pTim->cnt0 ? pTim->ccr[i] - pTim->cnt0 : period - pTim->cnt0 + pTim->ccr[i];
+        if (d < best)
+            best = d;
+    }
+    if (best != UINT64_MAX)
+        Sim_TimerStart(&pTim->timer, (pTim->t0Ps + best * tick + 999u) / 1000u, Sim_Tim_Event, pTim);
+}
+
+static void Sim_Tim_Event(void *pCtx)
+{
+    Sim_TimUnit *pTim = pCtx;
+    uint64_t tick = Sim_Tim_TickPs(pTim);
+    uint64_t n = (Sim_Tim_NowPs() - pTim->t0Ps) / tick;
+    uint32_t i;
+
+    /* Up to the tick before the event, then the event tick with its requests */
+    if (n != 0u) {
+        Sim_Tim_Advance(pTim, n - 1u);
+        pTim->t0Ps += tick;
+        if (pTim->cnt0 >= pTim->arr) {
+            pTim->cnt0 = 0;
+            Sim_Tim_Update(pTim, true);
+        } else {
+            pTim->cnt0++;
+        }
+        for (i = 0; i < 4u && !Sim_Tim_Basic(pTim); i++) {
+            if (pTim->ccr[i] == pTim->cnt0)
+                Sim_Tim_Compare(pTim, i, true);
+        }
+        Sim_Tim_Bd(pTim)->CNT = pTim->cnt0;
+        Sim_Tim_UpdateIrq(pTim);
+    }
+    Sim_Tim_Schedule(pTim);
+}
+
+static Sim_TimUnit *Sim_Tim_Find(uint32_t addr)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_TIM_NUM; i++) {
+        if ((addr & ~0x3FFu) == s_tim[i].base)
+            return &s_tim[i];
+    }
+    return NULL;
+}
+
+static void Sim_Tim_Pre(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    Sim_TimUnit *pTim = Sim_Tim_Find(addr);
+
+    (void)write;
+    (void)old;
+    (void)val;
+    if (pTim != NULL)
+        Sim_Tim_Sync(pTim);
+}
+
+static void Sim_Tim_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    Sim_TimUnit *pTim = Sim_Tim_Find(addr);
+    TIM_TypeDef *pBd;
+    uint32_t i;
+
+    if (pTim == NULL || !write)
+        return;
+    pBd = Sim_Tim_Bd(pTim);
+    switch (addr & 0x3FCu) {
+    case 0x00u:     /* CR1 */
+        if ((old ^ val) & TIM_CR1_CEN)
+            pTim->t0Ps = Sim_Tim_NowPs();
+        pTim->run = (val & TIM_CR1_CEN) != 0u;
+        break;
+    case 0x10u:     /* SR: rc_w0 */
+        pBd->SR = old & val;
+        break;
+    case 0x14u:     /* EGR: UG, CCxG, BG; reads as 0 */
+        pBd->EGR = 0;
+        if (val & TIM_EGR_UG) {
+            pTim->cnt0 = 0;
+            pTim->t0Ps = Sim_Tim_NowPs();
+            Sim_Tim_Update(pTim, true);
+        }
+        for (i = 0; i < 4u && !Sim_Tim_Basic(pTim); i++) {
+            if (val & (TIM_EGR_CC1G << i))
+                Sim_Tim_Compare(pTim, i, true);
+        }
+        if ((val & TIM_EGR_BG) && pTim->base == TIM1_BASE) {
+            pBd->SR |= TIM_SR_BIF;
+            pBd->BDTR &= (uint16_t)~TIM_BDTR_MOE;
+        }
+        break;
+    case 0x24u:     /* CNT */
+        pTim->cnt0 = val & 0xFFFFu;
+        pTim->t0Ps = Sim_Tim_NowPs();
+        break;
+    case 0x2Cu:     /* ARR */
+        if (!(pBd->CR1 & TIM_CR1_ARPE))
+            pTim->arr = val & 0xFFFFu;
+        break;
+    case 0x34u:     /* CCR1..4 */
+    case 0x38u:
+    case 0x3Cu:
+    case 0x40u:
+        i = ((addr & 0x3FCu) - 0x34u) / 4u;
+        if (!(((i < 2u ? pBd->CCMR1 : pBd->CCMR2) >> ((i & 1u) * 8u)) & TIM_CCMR1_OC1PE))
+            pTim->ccr[i] = val & 0xFFFFu;
+        break;
+    default:
+        break;
+    }
+    Sim_Tim_UpdateIrq(pTim);
+    Sim_Tim_Schedule(pTim);
+}
+
+void Sim_Tim_SetEtrHz(uint32_t hz)
+{
+    Sim_Tim_Sync(&s_tim[0]);
+    s_etrHz = hz;
+    Sim_Tim_Schedule(&s_tim[0]);
+}
+
+bool Sim_Tim1_Running(void)
+{
+    TIM_TypeDef *pBd = Sim_Tim_Bd(&s_tim[0]);
+
+    return s_tim[0].run && (pBd->BDTR & TIM_BDTR_MOE) && (pBd->CCER & TIM_CCER_CC1E) &&
+           Sim_Tim_ClkHz(&s_tim[0]) != 0u;
+}
+
+static void Sim_Tim_Init(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_TIM_NUM; i++)
+        Sim_MapRegs(s_tim[i].base, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, Sim_Tim_Pre, Sim_Tim_Post);
+}
+
+static void Sim_Tim_Reset(Sim_ResetCause cause)
+{
+    uint32_t i;
+
+    (void)cause;
+    s_frozen = false;
+    for (i = 0; i < SIM_TIM_NUM; i++) {
+        Sim_TimerStop(&s_tim[i].timer);
+        memset(Sim_Tim_Bd(&s_tim[i]), 0, 0x400u);
+        Sim_Tim_Bd(&s_tim[i])->ARR = 0xFFFFu;
+        s_tim[i].run = false;
+        s_tim[i].cnt0 = 0;
+        s_tim[i].t0Ps = Sim_Tim_NowPs();
+        Sim_Tim_LoadShadows(&s_tim[i]);
+    }
+}
+
+/* Timer kernels are unclocked in STOP */
+static void Sim_Tim_Stop(bool enter)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_TIM_NUM; i++) {
+        Sim_Tim_Sync(&s_tim[i]);
+        if (enter)
+            Sim_TimerStop(&s_tim[i].timer);
+    }
+    s_frozen = enter;
+    for (i = 0; i < SIM_TIM_NUM && !enter; i++) {
+        s_tim[i].t0Ps = Sim_Tim_NowPs();
+        Sim_Tim_Schedule(&s_tim[i]);
+    }
+}
+
+const Sim_Model g_simModelTim = { "tim", Sim_Tim_Init, Sim_Tim_Reset, Sim_Tim_Stop };
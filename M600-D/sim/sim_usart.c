@@ -0,0 +1,345 @@
+/************************************************************************************
+ * @file     : sim_usart.c
+ * @brief    : Host simulator - USART1/USART2 (8N1) with DMA, IDLE detection and RX pin
+ * @details  : Bytes take 10 bit times at the rate set in BRR, both ways. TX: TDR feeds
+ *             the shift register, TXE requests the next byte from DMA when DMAT is set.
+ *             RX: the host's bytes arrive back to back; each one drives the RX pin low for
+ *             its start bit (an EXTI line mapped to the pin sees it even in STOP) and lands
+ *             in DR at its stop bit. The USART kernel is unclocked in STOP, so a byte that
+ *             arrives there is lost, only its edge wakes the part. IDLE rises one frame
+ *             after the last byte and clears with an SR read followed by a DR read.
+ ***********************************************************************************/
+#include "sim_int.h"
+#include <string.h>
+
+#define SIM_UART_NUM        2u
+#define SIM_UART_QUEUE      65536u
+#define SIM_UART_DEF_BAUD   115200u
+
+typedef struct {
+    uint8_t buf[SIM_UART_QUEUE];
+    uint32_t head;
+    uint32_t tail;
+} Sim_UartQueue;
+
+typedef struct {
+    uint32_t base;
+    int irqn;
+    char rxPort;
+    uint8_t rxPin;
+    uint8_t dmaTx;              /* DMA1 channels */
+    uint8_t dmaRx;
+    Sim_UartQueue toMcu;
+    Sim_UartQueue fromMcu;
+    /* TX */
+    bool shifting;
+    uint8_t tdr;                /* DR is two registers: TDR written, RDR read */
+    uint8_t shift;
+    Sim_Timer txTimer;
+    /* RX */
+    bool rxBusy;
+    uint8_t rxByte;
+    Sim_Timer rxTimer;
+    Sim_Timer idleTimer;
+    bool srRead;
+    uint32_t dropped;
+} Sim_Uart;
+
+static Sim_Uart s_uart[SIM_UART_NUM];
+
+static USART_TypeDef *Sim_Uart_Bd(const Sim_Uart *pU)
+{
+    return (USART_TypeDef *)Sim_Backdoor(pU->base);
+}
+
+static Sim_Uart *Sim_Uart_Get(uint8_t n)
+{
+    if (n < 1u || n > SIM_UART_NUM)
+        SIM_FATAL("no USART%u", n);
+    return &s_uart[n - 1u];
+}
+
+static uint32_t Sim_Uart_Queued(const Sim_UartQueue *pQ)
+{
+    return pQ->head - pQ->tail;
+}
+
+static bool Sim_Uart_Push(Sim_UartQueue *pQ, uint8_t b)
+{
+    if (Sim_Uart_Queued(pQ) >= SIM_UART_QUEUE)
+        return false;
+    pQ->buf[pQ->head++ % SIM_UART_QUEUE] = b;
+    return true;
+}
+
+static uint32_t Sim_Uart_Baud(const Sim_Uart *pU)
+{
+    uint32_t brr = Sim_Uart_Bd(pU)->BRR & 0xFFFFu;
+    uint32_t pclk = pU->base == USART1_BASE ? Sim_Rcc_Pclk2() : Sim_Rcc_Pclk1();
+
+    if (!(Sim_Uart_Bd(pU)->CR1 & USART_CR1_UE) || brr < 16u)
+        return SIM_UART_DEF_BAUD;
+    return pclk / brr;
+}
+
+static uint64_t Sim_Uart_FrameNs(const Sim_Uart *pU)
+{
+    return 10000000000ull / Sim_Uart_Baud(pU);
+}
+
+static void Sim_Uart_UpdateIrq(const Sim_Uart *pU)
+{
+    USART_TypeDef *pBd = Sim_Uart_Bd(pU);
+    uint32_t act = pBd->SR & pBd->CR1 & (USART_SR_TXE | USART_SR_TC | USART_SR_RXNE | USART_SR_IDLE);
+
+    if ((pBd->CR1 & USART_CR1_RXNEIE) && (pBd->SR & USART_SR_ORE))
+        act |= USART_SR_ORE;
+    Sim_IrqLine(pU->irqn, act != 0u);
+}
+
+/* ---------- TX ---------- */
+
+static void Sim_Uart_TxStart(Sim_Uart *pU);
+
+static void Sim_Uart_TxDone(void *pCtx)
+{
+    Sim_Uart *pU = pCtx;
+    USART_TypeDef *pBd = Sim_Uart_Bd(pU);
+
+    pU->shifting = false;
+    Sim_Uart_Push(&pU->fromMcu, pU->shift);
+    if (!(pBd->SR & USART_SR_TXE))
+        Sim_Uart_TxStart(pU);
+    else
+        pBd->SR |= USART_SR_TC;
+    Sim_Uart_UpdateIrq(pU);
+}
+
+/* TDR -> shift register, TXE up and the next DMA request */
+static void Sim_Uart_TxStart(Sim_Uart *pU)
+{
+    USART_TypeDef *pBd = Sim_Uart_Bd(pU);
+
+    pU->shift = pU->tdr;
+    pU->shifting = true;
+    pBd->SR |= USART_SR_TXE;
+    Sim_TimerStart(&pU->txTimer, Sim_Now() + Sim_Uart_FrameNs(pU), Sim_Uart_TxDone, pU);
+    if (pBd->CR3 & USART_CR3_DMAT)
+        Sim_Dma_Request(1u, pU->dmaTx);
+}
+
+static void Sim_Uart_TxRequest(Sim_Uart *pU)
+{
+    USART_TypeDef *pBd = Sim_Uart_Bd(pU);
+
+    if ((pBd->SR & USART_SR_TXE) && (pBd->CR3 & USART_CR3_DMAT) && (pBd->CR1 & USART_CR1_TE))
+        Sim_Dma_Request(1u, pU->dmaTx);
+}
+
+static void Sim_Uart1_TxDmaEnable(bool enabled)
+{
+    if (enabled)
+        Sim_Uart_TxRequest(&s_uart[0]);
+}
+
+static void Sim_Uart2_TxDmaEnable(bool enabled)
+{
+    if (enabled)
+        Sim_Uart_TxRequest(&s_uart[1]);
+}
+
+/* ---------- RX ---------- */
+
+static void Sim_Uart_RxNext(Sim_Uart *pU);
+
+static void Sim_Uart_Idle(void *pCtx)
+{
+    Sim_Uart *pU = pCtx;
+
+    if (Sim_Uart_Bd(pU)->CR1 & USART_CR1_RE) {
+        Sim_Uart_Bd(pU)->SR |= USART_SR_IDLE;
+        Sim_Uart_UpdateIrq(pU);
+    }
+}
+
+static void Sim_Uart_RxStop(void *pCtx)
+{
+    Sim_Uart *pU = pCtx;
+    USART_TypeDef *pBd = Sim_Uart_Bd(pU);
+
+    Sim_Gpio_Input(pU->rxPort, pU->rxPin, 1);
+    pU->rxBusy = false;
+    if (Sim_InStop() || (pBd->CR1 & (USART_CR1_UE | USART_CR1_RE)) != (USART_CR1_UE | USART_CR1_RE)) {
+        pU->dropped++;
+    } else {
+        if (pBd->SR & USART_SR_RXNE) {
+            pBd->SR |= USART_SR_ORE;
+            pU->dropped++;
+        } else {
+            pBd->DR = pU->rxByte;
+            pBd->SR |= USART_SR_RXNE;
+            if ((pBd->CR3 & USART_CR3_DMAR) && Sim_Dma_Request(1u, pU->dmaRx))
+                pBd->SR &= ~USART_SR_RXNE;
+        }
+        Sim_TimerStart(&pU->idleTimer, Sim_Now() + Sim_Uart_FrameNs(pU), Sim_Uart_Idle, pU);
+    }
+    Sim_Uart_UpdateIrq(pU);
+    Sim_Uart_RxNext(pU);
+}
+
+static void Sim_Uart_RxNext(Sim_Uart *pU)
+{
+    if (pU->rxBusy || Sim_Uart_Queued(&pU->toMcu) == 0u)
+        return;
+    pU->rxByte = pU->toMcu.buf[pU->toMcu.tail++ % SIM_UART_QUEUE];
+    pU->rxBusy = true;
+    Sim_TimerStop(&pU->idleTimer);
+    Sim_Gpio_Input(pU->rxPort, pU->rxPin, 0);      /* start bit */
+    Sim_TimerStart(&pU->rxTimer, Sim_Now() + Sim_Uart_FrameNs(pU), Sim_Uart_RxStop, pU);
+}
+
+/* ---------- Registers ---------- */
+
+static Sim_Uart *Sim_Uart_Find(uint32_t addr)
+{
+    uint32_t i;
+
+    for (i = 0; i < SIM_UART_NUM; i++) {
+        if ((addr & ~0x3FFu) == s_uart[i].base)
+            return &s_uart[i];
+    }
+    return NULL;
+}
+
+static void Sim_Uart_Post(uint32_t addr, bool write, uint32_t old, uint32_t val)
+{
+    Sim_Uart *pU = Sim_Uart_Find(addr);
+    USART_TypeDef *pBd;
+
+    if (pU == NULL)
+        return;
+    pBd = Sim_Uart_Bd(pU);
+    switch (addr & 0x3FCu) {
+    case 0x00u:     /* SR: rc_w0 for RXNE/TC, the rest read-only */
+        if (write) {
+            pBd->SR = old & (val | ~(USART_SR_RXNE | USART_SR_TC | USART_SR_LBD | USART_SR_CTS));
+            pU->srRead = false;
+        } else {
+            pU->srRead = true;
+            return;
+        }
+        break;
+    case 0x04u:     /* DR */
+        if (write) {
+            pU->tdr = (uint8_t)val;
+            pBd->DR = old;                      /* reads still see RDR */
+            pBd->SR &= ~(USART_SR_TXE | USART_SR_TC);
+            if ((pBd->CR1 & (USART_CR1_UE | USART_CR1_TE)) != (USART_CR1_UE | USART_CR1_TE))
+                pBd->SR |= USART_SR_TXE;        /* not transmitting: the byte goes nowhere */
+            else if (!pU->shifting)
+                Sim_Uart_TxStart(pU);
+        } else {
+            pBd->SR &= ~USART_SR_RXNE;
+            if (pU->srRead)
+                pBd->SR &= ~(USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE | USART_SR_PE);
+            pU->srRead = false;
+        }
+        break;
+    case 0x0Cu:     /* CR1 */
+    case 0x14u:     /* CR3 */
+        if (!write)
+            return;
+        Sim_Uart_TxRequest(pU);
+        break;
+    default:
+        if (!write)
+            return;
+        break;
+    }
+    Sim_Uart_UpdateIrq(pU);
+}
+
+/* ---------- Host side ---------- */
+
+void Sim_Uart_Send(uint8_t n, const void *pData, size_t len)
+{
+    Sim_Uart *pU = Sim_Uart_Get(n);
+    const uint8_t *p = pData;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (!Sim_Uart_Push(&pU->toMcu, p[i]))
+            SIM_FATAL("USART%u host queue full", n);
+    }
+    Sim_Uart_RxNext(pU);
+}
+
+size_t Sim_Uart_Recv(uint8_t n, void *pBuf, size_t max)
+{
+    Sim_Uart *pU = Sim_Uart_Get(n);
+    uint8_t *p = pBuf;
+    size_t i = 0;
+
+    while (i < max && Sim_Uart_Queued(&pU->fromMcu) != 0u)
+        p[i++] = pU->fromMcu.buf[pU->fromMcu.tail++ % SIM_UART_QUEUE];
+    return i;
+}
+
+size_t Sim_Uart_RxPending(uint8_t n)
+{
+    return Sim_Uart_Queued(&Sim_Uart_Get(n)->fromMcu);
+}
+
+uint32_t Sim_Uart_GetBaud(uint8_t n)
+{
+    return Sim_Uart_Baud(Sim_Uart_Get(n));
+}
+
+uint32_t Sim_Uart_GetDropped(uint8_t n)
+{
+    return Sim_Uart_Get(n)->dropped;
+}
+
+/* ---------- Model ---------- */
+
+static void Sim_Uart_Init(void)
+{
+    s_uart[0].base = USART1_BASE;
+    s_uart[0].irqn = USART1_IRQn;
+    s_uart[0].rxPort = 'A';
+    s_uart[0].rxPin = 10u;
+    s_uart[0].dmaTx = 4u;
+    s_uart[0].dmaRx = 5u;
+    s_uart[1].base = USART2_BASE;
+    s_uart[1].irqn = USART2_IRQn;
+    s_uart[1].rxPort = 'A';
+    s_uart[1].rxPin = 3u;
+    s_uart[1].dmaTx = 7u;
+    s_uart[1].dmaRx = 6u;
+    Sim_MapRegs(USART1_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Uart_Post);
+    Sim_MapRegs(USART2_BASE, 0x400u, SIM_TRAP_WR | SIM_TRAP_RD, NULL, Sim_Uart_Post);
+    Sim_Dma_OnEnable(1u, 4u, Sim_Uart1_TxDmaEnable);
+    Sim_Dma_OnEnable(1u, 7u, Sim_Uart2_TxDmaEnable);
+}
+
+static void Sim_Uart_Reset(Sim_ResetCause cause)
+{
+    uint32_t i;
+
+    (void)cause;
+    for (i = 0; i < SIM_UART_NUM; i++) {
+        Sim_Uart *pU = &s_uart[i];
+        USART_TypeDef *pBd = Sim_Uart_Bd(pU);
+        Sim_TimerStop(&pU->txTimer);
+        Sim_TimerStop(&pU->idleTimer);
+        memset(pBd, 0, 0x20u);
+        pBd->SR = USART_SR_TXE | USART_SR_TC;
+        pU->shifting = false;
+        pU->srRead = false;
+        /* The host keeps sending through a reset; only the line idles high */
+        if (!pU->rxBusy)
+            Sim_Gpio_Input(pU->rxPort, pU->rxPin, 1);
+    }
+}
+
+const Sim_Model g_simModelUsart = { "usart", Sim_Uart_Init, Sim_Uart_Reset, NULL };
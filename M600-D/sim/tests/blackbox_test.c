@@ -0,0 +1,67 @@
+/************************************************************************************
+ * @file     : blackbox_test.c
+ * @brief    : Host test - black-box reset cause latching (drv_blackbox, drv_wdg)
+ * @details  : RCC_CSR flags accumulate until RMVF. Power-on, then a pin reset and a
+ *             watchdog reset: each boot must see only its own cause, the ring must
+ *             survive the non-power resets and the watchdog event must be recorded once.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_blackbox.h"
+
+#define CSR_PINRSTF     0x04u       /* RCC_CSR[31:24] */
+#define CSR_PORRSTF     0x08u
+#define CSR_IWDGRSTF    0x20u
+
+/* Events recorded since the last E_BB_EVT_BOOT: boot flags and watchdog events */
+static void LastBoot(uint16_t *pFlags, unsigned *pWdg)
+{
+    BlackBox_Event_t evt;
+    uint16_t count = SIM_FW(Drv_BlackBox_GetCount)();
+    uint16_t i;
+
+    *pFlags = 0xFFFFu;
+    *pWdg = 0;
+    for (i = 0; i < count; i++) {
+        SIM_FW(Drv_BlackBox_Copy)(i, &evt, 1);
+        if (evt.type == E_BB_EVT_BOOT) {
+            *pFlags = evt.value;
+            *pWdg = 0;
+        } else if (evt.type == E_BB_EVT_WDG_RESET) {
+            (*pWdg)++;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint16_t flags;
+    unsigned wdg;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+    LastBoot(&flags, &wdg);
+    SIM_CHECK(!SIM_FW(Drv_BlackBox_HasHistory)(), "history after power-on");
+    SIM_CHECK(flags & CSR_PORRSTF, "power-on boot flags 0x%02X", flags);
+
+    Sim_Test_Reboot(E_SIM_RESET_PIN);
+    Sim_Test_Run(300);
+    LastBoot(&flags, &wdg);
+    SIM_CHECK(SIM_FW(Drv_BlackBox_HasHistory)(), "ring lost on a pin reset");
+    SIM_CHECK(flags == CSR_PINRSTF, "pin reset boot flags 0x%02X", flags);
+
+    Sim_Test_Reboot(E_SIM_RESET_IWDG);
+    Sim_Test_Run(300);
+    LastBoot(&flags, &wdg);
+    SIM_CHECK(SIM_FW(Drv_BlackBox_HasHistory)(), "ring lost on a watchdog reset");
+    /* An internal reset drives NRST as well, so PINRSTF comes with it */
+    SIM_CHECK((flags & ~CSR_PINRSTF) == CSR_IWDGRSTF, "watchdog reset boot flags 0x%02X", flags);
+    SIM_CHECK(wdg == 1u, "%u watchdog events", wdg);
+
+    Sim_Test_Reboot(E_SIM_RESET_SOFT);
+    Sim_Test_Run(300);
+    LastBoot(&flags, &wdg);
+    SIM_CHECK(wdg == 0u, "watchdog event repeated after a software reset");
+    printf("blackbox: %u events kept over pin, watchdog and software resets\n",
+           SIM_FW(Drv_BlackBox_GetCount)());
+    return Sim_Test_Done();
+}
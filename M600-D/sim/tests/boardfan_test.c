@@ -0,0 +1,218 @@
+/************************************************************************************
+ * @file     : boardfan_test.c
+ * @brief    : Host test - peak board temperature under the fan control (app_fan, drv_tim, bsp_tim)
+ * @details  : The test is the CPU and plays TreatMgr's loop against a board model: 300 J/K,
+ *             0.5 W/K in still air plus 2 W/K at full fan, 3 W idle plus 40 W at full
+ *             output, 25 C ambient. Heat_REF01/02 follow the board with a 20 s lag and
+ *             reach the firmware through the ADC (PA6/PA5). Every 100 ms App_Fan_Process
+ *             gets the mode's output and the fan blows at the duty the driver applied.
+ *             The old control (averaged sensors once a second, on above 85 C, off below
+ *             80 C, replayed here through Drv_ADC_ReadVoltage) runs the same profile:
+ *             5 min idle, 20 min full output, 5 min off, 10 min at 60 %, 10 min idle.
+ *             Cases: nominal, REF01 open, REF02 reading 25 C low, fan stalled. The new
+ *             control must keep the board cooler than the old in every case and under the
+ *             old 85 C start point whenever the fan turns, record the sensor faults, flag
+ *             the stall during output and put the duty it reports on PD2. Reported: peak
+ *             board temperature and minutes above 85 C, old and new, and fan duty.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_fan.h"
+#include "drv_adc.h"
+#include "drv_blackbox.h"
+#include "bsp_delay.h"
+#include "bsp_gpio.h"
+
+#define FAN_PORT            'D'
+#define FAN_PIN             2u
+#define REF01_IN            6u          /* ADC_IN6, PA6 */
+#define REF02_IN            5u          /* ADC_IN5, PA5 */
+#define STEP_MS             100u
+#define AMBIENT_C           25.0
+#define HEAT_CAP            300.0       /* J/K */
+#define G_STILL             0.5         /* W/K */
+#define G_FAN               2.0         /* W/K at full fan */
+#define P_IDLE              3.0         /* W */
+#define P_OUTPUT            40.0        /* W at full output */
+#define SENSOR_TAU_S        20.0
+#define OLD_ON              850u        /* 0.1 C */
+#define OLD_OFF             800u
+
+typedef enum {
+    E_CASE_NOMINAL = 0,
+    E_CASE_REF01_OPEN,
+    E_CASE_REF02_LOW,
+    E_CASE_STALL,
+    E_CASE_MAX,
+} Case_EnumDef;
+
+typedef struct {
+    double peakC;
+    double hotS;                        /* above 85 C */
+    double dutyS;                       /* fan duty integrated, full-speed seconds */
+    double stallAtS;                    /* flagged after this much output, < 0 never */
+    unsigned pinOn, pinSlots;           /* PD2 over 20 ms at the end of the full-output phase */
+    uint16_t pinDuty;
+} Run_t;
+
+/* Output profile, seconds and permille */
+static const struct {
+    unsigned s;
+    uint16_t output;
+} s_profile[] = {
+    { 300u, 0u }, { 1200u, 1000u }, { 300u, 0u }, { 600u, 600u }, { 600u, 0u },
+};
+
+static const char *const s_names[E_CASE_MAX] = {
+    "nominal", "REF01 open", "REF02 reading 25 C low", "fan stalled",
+};
+
+static uint64_t s_pinRise;
+static uint64_t s_pinHighNs;
+
+static void FanWatch(char port, uint16_t odr, uint16_t changed, void *pCtx)
+{
+    (void)pCtx;
+    if (port != FAN_PORT || !(changed & (1u << FAN_PIN)))
+        return;
+    if ((odr >> FAN_PIN) & 1u)
+        s_pinRise = Sim_Now();
+    else if (s_pinRise != 0u)
+        s_pinHighNs += Sim_Now() - s_pinRise;
+}
+
+/* Sensor voltages as the placeholder conversion in the firmware reads them: 33 mV per C */
+static void Sensors(Case_EnumDef c, double sensC)
+{
+    uint32_t mv = (uint32_t)(sensC * 33.0 + 0.5);
+
+    Sim_Adc_SetMv(REF01_IN, c == E_CASE_REF01_OPEN ? 3300u : mv);
+    Sim_Adc_SetMv(REF02_IN, c == E_CASE_REF02_LOW ? mv - 25u * 33u : mv);
+}
+
+/* A fan fault of this kind in the blackbox */
+static bool Recorded(Fan_Fault_EnumDef fault)
+{
+    BlackBox_Event_t evts[BLACKBOX_RING_SIZE];
+    uint16_t i, n = SIM_FW(Drv_BlackBox_Copy)(0, evts, BLACKBOX_RING_SIZE);
+
+    for (i = 0; i < n; i++) {
+        if (evts[i].type == E_BB_EVT_FAN && evts[i].arg == fault)
+            return true;
+    }
+    return false;
+}
+
+/* 100 ms on the firmware clock, SysTick moved on rather than simulated */
+static void Step(void)
+{
+    SIM_FW(BSP_SysTick_Advance)(STEP_MS - 1u);
+    Sim_RunFor(SIM_MS(1));
+}
+
+/* Old bang-bang control on the same ADC path, once a second */
+static bool OldFan(bool on)
+{
+    uint16_t mv1 = (uint16_t)SIM_FW(Drv_ADC_ReadVoltage)(E_ADC_CHANNEL_Heat_REF01);
+    uint16_t mv2 = (uint16_t)SIM_FW(Drv_ADC_ReadVoltage)(E_ADC_CHANNEL_Heat_REF02);
+    uint16_t temp = (uint16_t)(((uint32_t)(mv1 + mv2) / 2u) * 1000u / 3300u);
+
+    if (temp > OLD_ON)
+        return true;
+    if (temp < OLD_OFF)
+        return false;
+    return on;
+}
+
+static Run_t Session(Case_EnumDef c, bool fw)
+{
+    Run_t run = { AMBIENT_C, 0.0, 0.0, -1.0, 0u, 0u, 0u };
+    double board = AMBIENT_C, sens = AMBIENT_C, dt = STEP_MS / 1000.0, fan = 0.0, outputS = 0.0;
+    unsigned p, k, steps;
+    uint64_t t0;
+    bool oldOn = false;
+
+    /* Power-on: the fan module starts from its reset state */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    SIM_FW(Drv_BlackBox_Init)();
+    Sensors(c, sens);
+
+    for (p = 0; p < sizeof(s_profile) / sizeof(s_profile[0]); p++) {
+        steps = s_profile[p].s * 1000u / STEP_MS;
+        for (k = 0; k < steps; k++) {
+            Step();
+            if (fw) {
+                SIM_FW(App_Fan_Process)(s_profile[p].output);
+                fan = SIM_FW(App_Fan_GetDuty)() / (double)FAN_DUTY_FULL;
+                if (run.stallAtS < 0.0 && SIM_FW(App_Fan_IsStalled)())
+                    run.stallAtS = outputS;
+            } else if (k % (1000u / STEP_MS) == 0u) {
+                oldOn = OldFan(oldOn);
+                fan = oldOn ? 1.0 : 0.0;
+            }
+            run.dutyS += fan * dt;
+            if (c == E_CASE_STALL)
+                fan = 0.0;
+            outputS += s_profile[p].output != 0u ? dt : 0.0;
+
+            board += (P_IDLE + P_OUTPUT * s_profile[p].output / 1000.0 -
+                      (G_STILL + G_FAN * fan) * (board - AMBIENT_C)) * dt / HEAT_CAP;
+            sens += (board - sens) * dt / SENSOR_TAU_S;
+            Sensors(c, sens);
+            run.peakC = board > run.peakC ? board : run.peakC;
+            run.hotS += board > OLD_ON / 10.0 ? dt : 0.0;
+        }
+
+        /* End of the full-output phase: what PD2 does over one 20 ms PWM period */
+        if (fw && s_profile[p].output == 1000u) {
+            run.pinDuty = SIM_FW(App_Fan_GetDuty)();
+            s_pinRise = Sim_Pin_Get(FAN_PORT, FAN_PIN) ? Sim_Now() : 0u;
+            s_pinHighNs = 0;
+            t0 = Sim_Now();
+            Sim_RunFor(SIM_MS(20));
+            if (s_pinRise != 0u && Sim_Pin_Get(FAN_PORT, FAN_PIN))
+                s_pinHighNs += Sim_Now() - s_pinRise;
+            run.pinOn = (unsigned)((s_pinHighNs + SIM_US(250)) / SIM_US(500));
+            run.pinSlots = (unsigned)((Sim_Now() - t0) / SIM_US(500));
+        }
+    }
+    return run;
+}
+
+int main(int argc, char **argv)
+{
+    Run_t old, now;
+    Case_EnumDef c;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+    Sim_Pin_Watch(FanWatch, NULL);
+
+    for (c = E_CASE_NOMINAL; c < E_CASE_MAX; c++) {
+        old = Session(c, false);
+        now = Session(c, true);
+        SIM_CHECK(now.pinSlots == 40u && now.pinOn * 1000u / 40u == now.pinDuty,
+                  "%s: PD2 high %u of %u slots, duty %u", s_names[c], now.pinOn, now.pinSlots, now.pinDuty);
+        if (c == E_CASE_STALL) {
+            SIM_CHECK(now.stallAtS >= 0.0 && now.stallAtS < 1200.0, "stall not flagged during full output");
+            SIM_CHECK(Recorded(E_FAN_FAULT_STALL), "stall not in the blackbox");
+            printf("boardfan: %-22s peak %.1f C either way (no airflow), stall flagged %.1f min into output\n",
+                   s_names[c], now.peakC, now.stallAtS / 60.0);
+            continue;
+        }
+        SIM_CHECK(now.peakC < old.peakC, "%s: peak %.1f C, old %.1f C", s_names[c], now.peakC, old.peakC);
+        SIM_CHECK(now.hotS == 0.0, "%s: %.0f s above 85 C", s_names[c], now.hotS);
+        SIM_CHECK(now.stallAtS < 0.0 && !Recorded(E_FAN_FAULT_STALL), "%s: stall flagged with the fan turning",
+                  s_names[c]);
+        SIM_CHECK(Recorded(E_FAN_FAULT_SENSOR1) == (c == E_CASE_REF01_OPEN), "%s: REF01 fault %s", s_names[c],
+                  Recorded(E_FAN_FAULT_SENSOR1) ? "recorded" : "missing");
+        SIM_CHECK(Recorded(E_FAN_FAULT_MISMATCH) == (c == E_CASE_REF02_LOW), "%s: mismatch %s", s_names[c],
+                  Recorded(E_FAN_FAULT_MISMATCH) ? "recorded" : "missing");
+        printf("boardfan: %-22s peak %.1f C -> %.1f C, above 85 C %.1f -> %.1f min, fan duty %.0f -> %.0f "
+               "full-speed s\n", s_names[c], old.peakC, now.peakC, old.hotS / 60.0, now.hotS / 60.0, old.dutyS,
+               now.dutyS);
+    }
+    return Sim_Test_Done();
+}
@@ -0,0 +1,128 @@
+/************************************************************************************
+ * @file     : boottime_test.c
+ * @brief    : Host test - power-on to first protocol reply (drv_boottime, app_comm)
+ * @details  : The host sends GET_STATUS every 1 ms once USART1 runs, until the first reply.
+ *             Reported: reply time from reset, the drv_boottime phases from main(), and
+ *             what the work moved off the boot path costs when the test runs it as the
+ *             CPU: the second SystemInit (HSE and PLL restart) and programming the
+ *             SI5351 over I2C1. Before the change both ran ahead of the main loop and
+ *             GET_STATUS was never answered, so the old time-to-main-loop is the present
+ *             one plus those two. The boot RTT command must then print every phase, none
+ *             of them lost to the log rate limit.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_comm.h"
+#include "drv_boottime.h"
+#include "drv_si5351.h"
+#include "bsp_i2c.h"
+#include "bsp_gpio.h"
+#include <string.h>
+
+#define SEND_EVERY_MS   1.0     /* 0.7 ms frame, then an idle line: the driver reads on IDLE */
+#define SLICE_MS        0.05
+#define READY_MAX_MS    100.0
+
+static uint8_t s_rx[512];
+static size_t s_rxLen = 0;
+
+static void SendGetStatus(void)
+{
+    static const uint8_t frame[] = {
+        PROTOCOL_HEADER_0, PROTOCOL_HEADER_1, PROTOCOL_DIR_HOST_TO_DEV, PROTOCOL_MODULE_ULTRASOUND,
+        PROTOCOL_CMD_GET_STATUS, 0, PROTOCOL_TAIL_0, PROTOCOL_TAIL_1,
+    };
+
+    Sim_Uart_Send(1, frame, sizeof(frame));
+}
+
+/* A complete GET_STATUS reply received */
+static bool GotReply(void)
+{
+    size_t i;
+
+    s_rxLen += Sim_Uart_Recv(1, s_rx + s_rxLen, sizeof(s_rx) - s_rxLen);
+    for (i = 0; i + PROTOCOL_FRAME_HEAD_LEN + 2u <= s_rxLen; i++) {
+        if (s_rx[i] == PROTOCOL_HEADER_0 && s_rx[i + 1u] == PROTOCOL_HEADER_1 &&
+            s_rx[i + 2u] == PROTOCOL_DIR_DEV_TO_HOST && s_rx[i + 4u] == PROTOCOL_CMD_GET_STATUS &&
+            i + PROTOCOL_FRAME_HEAD_LEN + s_rx[i + 5u] + 2u <= s_rxLen)
+            return true;
+    }
+    return false;
+}
+
+/* As the boot command names them */
+static const char *const s_phases[E_BOOT_PHASE_MAX] = {
+    "main", "drv", "system", "first_rx", "ready", "preload", "si5351",
+};
+
+static double PhaseMs(BootTime_Phase_EnumDef phase)
+{
+    uint32_t us = SIM_FW(Drv_BootTime_GetUs)(phase);
+
+    return us == BOOTTIME_NOT_REACHED ? -1.0 : us / 1000.0;
+}
+
+int main(int argc, char **argv)
+{
+    double t, nextSend = 0.0;
+    double readyMs = -1.0;
+    uint64_t t0, t1;
+    double sysInitMs, si5351Ms;
+    double drvMs, systemMs;
+    char line[32];
+    unsigned i, printed = 0;
+
+    Sim_Test_Init(argc, argv);
+    t0 = Sim_Now();
+    for (t = 0.0; t < READY_MAX_MS; t += SLICE_MS) {
+        /* Bytes are clocked at the USART1 rate: the host keeps asking once it is set up */
+        if (t >= nextSend && Sim_Uart_GetBaud(1) != 0u) {
+            SendGetStatus();
+            nextSend += SEND_EVERY_MS;
+        }
+        Sim_Test_Run(SLICE_MS);
+        if (GotReply()) {
+            readyMs = (double)(Sim_Now() - t0) / 1e6;
+            break;
+        }
+    }
+    SIM_CHECK(readyMs >= 0.0, "no GET_STATUS reply within %.0f ms of power-on", READY_MAX_MS);
+    drvMs = PhaseMs(E_BOOT_PHASE_DRV);
+    systemMs = PhaseMs(E_BOOT_PHASE_SYSTEM);
+    SIM_CHECK(drvMs >= 0.0 && systemMs >= drvMs && PhaseMs(E_BOOT_PHASE_READY) >= systemMs,
+              "boot phases drv %.3f, system %.3f, ready %.3f ms", drvMs, systemMs, PhaseMs(E_BOOT_PHASE_READY));
+    SIM_CHECK(PhaseMs(E_BOOT_PHASE_SI5351) < 0.0, "SI5351 programmed at boot without a probe");
+    printf("boottime: now: drivers %.2f ms, main loop %.2f ms from main(); first GET_STATUS reply sent "
+           "%.2f ms from main() (host asking every %.0f ms), received %.2f ms after power-on\n", drvMs,
+           systemMs, PhaseMs(E_BOOT_PHASE_READY), SEND_EVERY_MS, readyMs);
+
+    /* The boot command: one line per phase, through the same call site, past the rate limit window */
+    Sim_Test_Run(2000);
+    Sim_Test_LogClear();
+    Sim_Rtt_Write("boot\n", 5);
+    Sim_Test_Run(1500);
+    for (i = 0; i < E_BOOT_PHASE_MAX; i++) {
+        snprintf(line, sizeof(line), "Boot %s: ", s_phases[i]);
+        printed += Sim_Test_Log(line) != NULL ? 1u : 0u;
+        SIM_CHECK(Sim_Test_Log(line) != NULL, "boot command: phase %s not printed", s_phases[i]);
+    }
+    SIM_CHECK(Sim_Test_Log("suppressed: Boot") == NULL, "boot command: phases rate-limited");
+    printf("boottime: boot command printed %u of %u phases\n", printed, (unsigned)E_BOOT_PHASE_MAX);
+
+    /* The deferred work, with the test as the CPU */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    t1 = Sim_Now();
+    SIM_FW(SystemInit)();
+    sysInitMs = (double)(Sim_Now() - t1) / 1e6;
+    SIM_FW(BSP_I2C1_Init)();
+    t1 = Sim_Now();
+    SIM_FW(Drv_SI5351_Init)();
+    si5351Ms = (double)(Sim_Now() - t1) / 1e6;
+    SIM_CHECK(SIM_FW(Drv_SI5351_IsReady)(), "SI5351 init over I2C1 failed");
+    printf("boottime: before: + second SystemInit %.2f ms + SI5351 programming %.2f ms, main loop "
+           "%.2f ms from main(), GET_STATUS not answered\n", sysInitMs, si5351Ms,
+           systemMs + sysInitMs + si5351Ms);
+    return Sim_Test_Done();
+}
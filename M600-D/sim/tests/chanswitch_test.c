@@ -0,0 +1,165 @@
+/************************************************************************************
+ * @file     : chanswitch_test.c
+ * @brief    : Host test - pwr_control1~4 channel switch-over (drv_iodevice, bsp_gpio)
+ * @details  : The test is the CPU: BSP and the IO device driver are set up and every
+ *             GPIOC output change is recorded. For every channel to every channel, from
+ *             pwr_control1 on and off, Drv_IODevice_ChangeChannel must reach the same
+ *             pins as the old pin-by-pin sequence (replayed here through GPIO_SetBits /
+ *             GPIO_ResetBits, as BSP_GPIO_WritePin did) in one store, with no
+ *             intermediate combination on the pins. Reported: switch-over time from the
+ *             first to the last pin change and intermediate states, old and new.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_iodevice.h"
+#include "bsp_gpio.h"
+
+#define PWR_PINS        (pwr_control1_Pin | pwr_control2_Pin | pwr_control3_Pin | pwr_control4_Pin)
+#define CHANGE_MAX      8u
+
+typedef struct {
+    uint16_t pins[CHANGE_MAX];  /* pwr pins after each change */
+    uint64_t at[CHANGE_MAX];
+    unsigned changes;
+} Record_t;
+
+static Record_t s_rec;
+
+static const char *const s_names[CHANNEL_MAX] = { "US", "SW", "RF", "NH", "CLOSE", "READY" };
+
+static void PwrWatch(char port, uint16_t odr, uint16_t changed, void *pCtx)
+{
+    (void)pCtx;
+    if (port != 'C' || (changed & PWR_PINS) == 0u)
+        return;
+    if (s_rec.changes < CHANGE_MAX) {
+        s_rec.pins[s_rec.changes] = odr & PWR_PINS;
+        s_rec.at[s_rec.changes] = Sim_Now();
+    }
+    s_rec.changes++;
+}
+
+static void Pin(uint16_t pin, uint8_t state)
+{
+    if (state)
+        SIM_FW(GPIO_SetBits)(GPIOC, pin);
+    else
+        SIM_FW(GPIO_ResetBits)(GPIOC, pin);
+}
+
+/* Drv_IODevice_ChangeChannel before the BSRR table, one pin at a time */
+static void OldChangeChannel(IODevice_Channel_EnumDef channel)
+{
+    switch (channel) {
+        case CHANNEL_US:
+        case CHANNEL_RF:
+            Pin(pwr_control2_Pin, 1);
+            Pin(pwr_control3_Pin, 0);
+            Pin(pwr_control4_Pin, 0);
+            break;
+        case CHANNEL_SW:
+            Pin(pwr_control2_Pin, 0);
+            Pin(pwr_control3_Pin, 1);
+            Pin(pwr_control4_Pin, 1);
+            break;
+        case CHANNEL_NH:
+            Pin(pwr_control2_Pin, 0);
+            Pin(pwr_control3_Pin, 0);
+            Pin(pwr_control4_Pin, 0);
+            break;
+        case CHANNEL_CLOSE:
+            Pin(pwr_control2_Pin, 0);
+            Pin(pwr_control3_Pin, 0);
+            Pin(pwr_control4_Pin, 0);
+            Pin(pwr_control1_Pin, 0);
+            break;
+        case CHANNEL_READY:
+            Pin(pwr_control1_Pin, 1);
+            break;
+        default:
+            break;
+    }
+}
+
+static uint16_t PwrPins(void)
+{
+    return SIM_FW(GPIO_ReadOutputData)(GPIOC) & PWR_PINS;
+}
+
+/* Start state: everything off, then pwr_control1 on or not, then the from channel */
+static uint16_t Start(IODevice_Channel_EnumDef from, bool ready)
+{
+    SIM_FW(Drv_IODevice_ChangeChannel)(CHANNEL_CLOSE);
+    if (ready)
+        SIM_FW(Drv_IODevice_ChangeChannel)(CHANNEL_READY);
+    SIM_FW(Drv_IODevice_ChangeChannel)(from);
+    Sim_RunFor(SIM_US(10));
+    return PwrPins();
+}
+
+/* One switch: pins reached, intermediate combinations seen, first to last change */
+static uint16_t Switch(void (*fn)(IODevice_Channel_EnumDef), IODevice_Channel_EnumDef to, uint16_t start,
+                       unsigned *pGlitches, uint64_t *pSpan)
+{
+    unsigned k;
+    uint16_t end;
+
+    s_rec.changes = 0;
+    fn(to);
+    end = PwrPins();
+    SIM_CHECK(s_rec.changes <= CHANGE_MAX, "%u pin changes for one switch", s_rec.changes);
+    *pGlitches = 0;
+    for (k = 0; k + 1u < s_rec.changes; k++)
+        *pGlitches += (s_rec.pins[k] != start && s_rec.pins[k] != end) ? 1u : 0u;
+    *pSpan = s_rec.changes > 1u ? s_rec.at[s_rec.changes - 1u] - s_rec.at[0] : 0u;
+    return end;
+}
+
+int main(int argc, char **argv)
+{
+    IODevice_Channel_EnumDef from, to;
+    unsigned r, glitches, oldGlitches = 0, oldSwitches = 0, newMaxChanges = 0, switches = 0;
+    uint64_t span, oldSpan = 0, newSpan = 0;
+    uint16_t start, oldEnd, newEnd;
+    bool ready;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks, BSP and IO device driver */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    SIM_FW(Drv_IODevice_Init)();
+    Sim_Pin_Watch(PwrWatch, NULL);
+
+    for (r = 0; r < 2u; r++) {
+        ready = r != 0u;
+        for (from = CHANNEL_US; from < CHANNEL_MAX; from++) {
+            for (to = CHANNEL_US; to < CHANNEL_MAX; to++) {
+                start = Start(from, ready);
+                oldEnd = Switch(OldChangeChannel, to, start, &glitches, &span);
+                oldGlitches += glitches;
+                oldSwitches += glitches != 0u ? 1u : 0u;
+                oldSpan = span > oldSpan ? span : oldSpan;
+
+                SIM_CHECK(Start(from, ready) == start, "%s -> %s: start state differs", s_names[from], s_names[to]);
+                newEnd = Switch(SIM_FW(Drv_IODevice_ChangeChannel), to, start, &glitches, &span);
+                newSpan = span > newSpan ? span : newSpan;
+                newMaxChanges = s_rec.changes > newMaxChanges ? s_rec.changes : newMaxChanges;
+                SIM_CHECK(newEnd == oldEnd, "%s -> %s (pwr_control1 %s): pins 0x%03X, old sequence 0x%03X",
+                          s_names[from], s_names[to], ready ? "on" : "off", newEnd, oldEnd);
+                SIM_CHECK(s_rec.changes <= 1u && glitches == 0u, "%s -> %s: %u pin changes, %u intermediate",
+                          s_names[from], s_names[to], s_rec.changes, glitches);
+                switches++;
+            }
+        }
+    }
+    printf("chanswitch: %u switches (every channel to every channel, pwr_control1 on and off), same pins as "
+           "the old sequence\n", switches);
+    printf("chanswitch: old pin by pin: %u switches went through %u intermediate combinations, first to "
+           "last pin change up to %.2f us\n", oldSwitches, oldGlitches, (double)oldSpan / 1e3);
+    printf("chanswitch: new BSRR table: at most %u pin change per switch, %.2f us, no intermediate "
+           "combination\n", newMaxChanges, (double)newSpan / 1e3);
+    return Sim_Test_Done();
+}
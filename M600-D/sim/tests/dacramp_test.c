@@ -0,0 +1,165 @@
+/************************************************************************************
+ * @file     : dacramp_test.c
+ * @brief    : Host test - DAC ramps through TIM6 + DMA2 Channel3 (drv_dac, bsp_dac)
+ * @details  : The test is the CPU: BSP and the DAC driver are set up and every DHR -> DOR
+ *             latch is recorded. For long, short and single-step ramps, both curves, up
+ *             and down: every step must be held one full TIM6 period, the last one
+ *             included, the output must end on the target code, the steps must not go
+ *             backwards, and the done callback must come once, from the DMA interrupt
+ *             (never inside Drv_DAC_RampTo), just after the last step went out. A ramp
+ *             replaced half way must not call its done callback.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_dac.h"
+#include "bsp_gpio.h"
+
+#define DAC_REF_MV      3300u
+#define DAC_CODES       4095u
+#define LATCH_MAX       256u
+
+typedef struct {
+    uint16_t code;
+    uint64_t at;
+} Latch_t;
+
+static Latch_t s_latch[LATCH_MAX];
+static unsigned s_latches = 0;
+static bool s_inRampTo = false;
+static unsigned s_done = 0;
+static unsigned s_doneInCaller = 0;
+static uint16_t s_doneMv = 0;
+static uint64_t s_doneAt = 0;
+
+static void DacWatch(uint16_t code, void *pCtx)
+{
+    (void)pCtx;
+    if (s_latches < LATCH_MAX) {
+        s_latch[s_latches].code = code;
+        s_latch[s_latches].at = Sim_Now();
+    }
+    s_latches++;
+}
+
+static void Done(uint16_t voltage_mv)
+{
+    s_done++;
+    s_doneInCaller += s_inRampTo ? 1u : 0u;
+    s_doneMv = voltage_mv;
+    s_doneAt = Sim_Now();
+}
+
+static uint16_t Code(uint16_t mv)
+{
+    return (uint16_t)(((uint32_t)mv * DAC_CODES) / DAC_REF_MV);
+}
+
+static bool RampTo(uint16_t mv, uint16_t slope, DAC_Ease_EnumDef ease)
+{
+    bool ok;
+
+    s_latches = 0;
+    s_done = 0;
+    s_inRampTo = true;
+    ok = SIM_FW(Drv_DAC_RampTo)(mv, slope, ease, Done);
+    s_inRampTo = false;
+    return ok;
+}
+
+/* One ramp to completion; the latches after the start are the TIM6 steps */
+static void Ramp(uint16_t fromMv, uint16_t mv, uint16_t slope, DAC_Ease_EnumDef ease)
+{
+    uint32_t requested, startMv;
+    uint64_t t0, period, hold, minHold = UINT64_MAX, maxHold = 0;
+    unsigned first, last, k, steps;
+    int dir;
+
+    /* The ramp starts from what DOR holds, which rounds fromMv down by up to 1 mV */
+    SIM_FW(Drv_DAC_SetVoltage)(fromMv);
+    Sim_RunFor(SIM_US(10));
+    startMv = ((uint32_t)Sim_Dac_Get() * DAC_REF_MV) / DAC_CODES;
+    requested = ((uint32_t)(startMv > mv ? startMv - mv : mv - startMv) * 1000u) / slope;
+    dir = mv >= startMv ? 1 : -1;
+    t0 = Sim_Now();
+    SIM_CHECK(RampTo(mv, slope, ease), "ramp to %u mV refused", mv);
+    Sim_RunFor(SIM_MS(requested / 1000u + 10u));
+
+    SIM_CHECK(s_done == 1u && s_doneInCaller == 0u, "%u -> %u mV: %u done calls, %u inside RampTo",
+              fromMv, mv, s_done, s_doneInCaller);
+    SIM_CHECK(s_doneMv == mv, "%u -> %u mV: done reported %u mV", fromMv, mv, s_doneMv);
+    SIM_CHECK(Sim_Dac_Get() == Code(mv), "%u -> %u mV: output code %u, target %u", fromMv, mv,
+              Sim_Dac_Get(), Code(mv));
+    SIM_CHECK(!SIM_FW(Drv_DAC_IsRamping)(), "%u -> %u mV: still ramping", fromMv, mv);
+
+    /* The stop latch at start, the TIM6 steps, then the stop latch at TC: same time as the last step */
+    first = (s_latches > 0u && s_latch[0].at - t0 < SIM_US(5)) ? 1u : 0u;
+    last = s_latches - 1u;
+    if (last > first && s_latch[last].code == s_latch[last - 1u].code && s_latch[last].at - s_latch[last - 1u].at < SIM_US(5))
+        last--;
+    steps = last - first + 1u;
+    SIM_CHECK(steps >= 1u && steps <= DAC_RAMP_MAX_SAMPLES, "%u -> %u mV: %u steps", fromMv, mv, steps);
+    /* The first step comes one period after RampTo returns */
+    period = steps > 1u ? s_latch[first + 1u].at - s_latch[first].at : s_latch[first].at - t0;
+    SIM_CHECK(s_latch[first].at - t0 <= period + SIM_US(10), "%u -> %u mV: first step after %.1f us",
+              fromMv, mv, (double)(s_latch[first].at - t0) / 1e3);
+    for (k = first; k <= last; k++) {
+        hold = (k == last ? s_doneAt : s_latch[k + 1u].at) - s_latch[k].at;
+        if (k < last) {
+            minHold = hold < minHold ? hold : minHold;
+            maxHold = hold > maxHold ? hold : maxHold;
+        }
+        if (k > first)
+            SIM_CHECK((int)(s_latch[k].code - s_latch[k - 1u].code) * dir >= 0, "%u -> %u mV: step %u goes back",
+                      fromMv, mv, k - first);
+    }
+    if (steps > 1u)
+        SIM_CHECK(minHold + SIM_US(1) >= period && maxHold <= period + SIM_US(1),
+                  "%u -> %u mV: steps held %.1f .. %.1f us, period %.1f us", fromMv, mv,
+                  (double)minHold / 1e3, (double)maxHold / 1e3, (double)period / 1e3);
+    SIM_CHECK(s_latch[last].code == Code(mv), "%u -> %u mV: last step code %u", fromMv, mv, s_latch[last].code);
+    SIM_CHECK(s_doneAt >= s_latch[last].at && s_doneAt - s_latch[last].at < SIM_US(20),
+              "%u -> %u mV: done %.1f us after the last step", fromMv, mv,
+              (double)(s_doneAt - s_latch[last].at) / 1e3);
+    SIM_CHECK(s_latch[last].at - t0 <= (uint64_t)requested * 1000u + period + SIM_US(10),
+              "%u -> %u mV: %.2f ms for %.2f ms requested", fromMv, mv,
+              (double)(s_latch[last].at - t0) / 1e6, (double)requested / 1e3);
+
+    printf("dacramp: %4u -> %4u mV %-6s %6.2f ms requested: %2u steps of %7.1f us, every step held "
+           "%.1f .. %.1f us, on target after %7.2f ms, done %.1f us after the last step\n",
+           fromMv, mv, ease == E_DAC_EASE_LINEAR ? "linear" : "scurve", (double)requested / 1e3, steps,
+           (double)period / 1e3, (double)(steps > 1u ? minHold : period) / 1e3,
+           (double)(steps > 1u ? maxHold : period) / 1e3, (double)(s_latch[last].at - t0) / 1e6,
+           (double)(s_doneAt - s_latch[last].at) / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks, BSP and the DAC driver */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    SIM_FW(Drv_DAC_Init)();
+    Sim_Dac_Watch(DacWatch, NULL);
+
+    Ramp(0, 2000, 10, E_DAC_EASE_LINEAR);       /* 200 ms, 64 samples */
+    Ramp(2000, 500, 100, E_DAC_EASE_SCURVE);    /* 15 ms */
+    Ramp(500, 520, 10, E_DAC_EASE_SCURVE);      /* 2 ms, the fastest pacing */
+    Ramp(1000, 1004, 100, E_DAC_EASE_LINEAR);   /* 40 us: a single step */
+    Ramp(1200, 1200, 10, E_DAC_EASE_LINEAR);    /* nothing to do: done still from the ISR */
+
+    /* Replaced half way: the first done never comes, the second does */
+    SIM_FW(Drv_DAC_SetVoltage)(0);
+    SIM_CHECK(RampTo(3000, 10, E_DAC_EASE_SCURVE), "ramp to 3000 mV refused");
+    Sim_RunFor(SIM_MS(100));
+    SIM_CHECK(SIM_FW(Drv_DAC_IsRamping)() && s_done == 0u, "ramp to 3000 mV not running half way");
+    SIM_CHECK(RampTo(1000, 10, E_DAC_EASE_SCURVE), "ramp to 1000 mV refused");
+    Sim_RunFor(SIM_MS(400));
+    SIM_CHECK(s_done == 1u && s_doneMv == 1000u && s_doneInCaller == 0u,
+              "replaced ramp: %u done calls, last %u mV", s_done, s_doneMv);
+    SIM_CHECK(Sim_Dac_Get() == Code(1000), "replaced ramp: output code %u", Sim_Dac_Get());
+    printf("dacramp: ramp replaced half way: one done call, for the second target\n");
+    return Sim_Test_Done();
+}
@@ -0,0 +1,248 @@
+/************************************************************************************
+ * @file     : footbounce_test.c
+ * @brief    : Host test - foot switch debounce and release cut (drv_iodevice, drv_protect)
+ * @details  : The test is the CPU: BSP and the IO device driver are set up and PC14 is
+ *             driven with contact bounce, 20 us .. 1 ms between flips for up to 5 ms.
+ *             Reported: press detection latency from the first edge, release cut
+ *             latency (pwr_control1 low, TIM1 stopped, TIM3 gate stopped, TIM4 ESW+/ESW-
+ *             forced inactive, DAC at 0) with a ramp, ESW on and both timers running,
+ *             false presses from isolated glitches while released, and what short dips do
+ *             while pressed. A main loop pass still in flight after the cut must not
+ *             bring the ramp, ESW or the gate back; the next press gives TIM4 its PWM
+ *             mode back. The release cut must not latch: TIM1 starts again right after.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_iodevice.h"
+#include "drv_dac.h"
+#include "drv_tim.h"
+#include "drv_si5351.h"
+#include "bsp_gpio.h"
+#include "bsp_tim.h"
+
+#define FOOT_PORT       'C'
+#define FOOT_PIN        14u
+#define TIM3_CR1        0x40000400u
+#define TIM4_CCMR2      0x4000081Cu
+#define TIM4_CCR3       0x4000083Cu
+#define TIM4_CCR4       0x40000840u
+#define OCM_FORCED_LOW  4u
+#define OCM_PWM1        6u
+#define PRESSES         200u
+#define GLITCHES        1000u
+#define DIPS            200u
+
+static uint32_t s_seed = 4711u;
+static uint64_t s_pwrOffAt = 0;
+static uint64_t s_dacZeroAt = 0;
+
+static uint32_t Rand(uint32_t lo, uint32_t hi)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return lo + (s_seed >> 8) % (hi - lo + 1u);
+}
+
+static void PwrWatch(char port, uint16_t odr, uint16_t changed, void *pCtx)
+{
+    (void)pCtx;
+    if (port == 'C' && (changed & pwr_control1_Pin) && !(odr & pwr_control1_Pin) && s_pwrOffAt == 0u)
+        s_pwrOffAt = Sim_Now();
+}
+
+static void DacWatch(uint16_t code, void *pCtx)
+{
+    (void)pCtx;
+    if (code == 0u && s_dacZeroAt == 0u)
+        s_dacZeroAt = Sim_Now();
+}
+
+/* Debounced events since the last call: presses and releases */
+static void Events(unsigned *pPress, unsigned *pRelease)
+{
+    IODevice_Event_t evt;
+
+    *pPress = 0;
+    *pRelease = 0;
+    while (SIM_FW(Drv_IODevice_PopEvent)(&evt)) {
+        if (evt.input != E_GPIO_IN_FOOT)
+            continue;
+        if (evt.level)
+            (*pPress)++;
+        else
+            (*pRelease)++;
+    }
+}
+
+/* Contact bounce towards level: flips at 20 us .. 1 ms for up to 5 ms, then level */
+static void Bounce(int level)
+{
+    uint64_t end = Sim_Now() + SIM_US(Rand(0, 5000));
+    int now = level;
+
+    while (Sim_Now() < end) {
+        Sim_Pin_Drive(FOOT_PORT, FOOT_PIN, now);
+        Sim_RunFor(SIM_US(Rand(20, 1000)));
+        now = !now;
+    }
+    Sim_Pin_Drive(FOOT_PORT, FOOT_PIN, level);
+}
+
+/* Pin at level long enough for any integrator to settle */
+static void Settle(int level)
+{
+    Sim_Pin_Drive(FOOT_PORT, FOOT_PIN, level);
+    Sim_RunFor(SIM_MS(30));
+}
+
+static bool Gate(void)
+{
+    return (*Sim_Reg(TIM3_CR1) & 1u) != 0u;
+}
+
+/* TIM4 OC3M/OC4M both at mode */
+static bool EswMode(uint32_t mode)
+{
+    uint32_t ccmr2 = *Sim_Reg(TIM4_CCMR2);
+
+    return ((ccmr2 >> 4) & 7u) == mode && ((ccmr2 >> 12) & 7u) == mode;
+}
+
+/* ESW+ or ESW- driven: PWM1 with a compare above 0 */
+static bool Esw(void)
+{
+    return EswMode(OCM_PWM1) && (*Sim_Reg(TIM4_CCR3) != 0u || *Sim_Reg(TIM4_CCR4) != 0u);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned press, release, i;
+    unsigned falsePress = 0;
+    unsigned dipCuts = 0;
+    uint64_t t0, t;
+    uint64_t sum = 0;
+    uint64_t maxNs = 0;
+    uint64_t minNs = UINT64_MAX;
+    uint64_t cutNs = 0;
+    uint64_t stopNs = 0;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks, BSP, DAC and IO device driver, foot released */
+    Sim_Pin_Drive(FOOT_PORT, FOOT_PIN, 0);
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    SIM_FW(Drv_DAC_Init)();
+    SIM_FW(Drv_IODevice_Init)();
+    Sim_Tim_SetEtrHz(1000000u);
+    Sim_Pin_Watch(PwrWatch, NULL);
+    Sim_Dac_Watch(DacWatch, NULL);
+    Settle(0);
+    Events(&press, &release);
+
+    /* Press detection latency from the first edge */
+    for (i = 0; i < PRESSES; i++) {
+        t0 = Sim_Now();
+        Bounce(1);
+        while (!SIM_FW(Drv_IODevice_GetFootSwitchState)() && Sim_Now() - t0 < SIM_MS(50))
+            Sim_RunFor(SIM_US(10));
+        t = Sim_Now() - t0;
+        SIM_CHECK(SIM_FW(Drv_IODevice_GetFootSwitchState)(), "press %u not detected in 50 ms", i);
+        sum += t;
+        minNs = t < minNs ? t : minNs;
+        maxNs = t > maxNs ? t : maxNs;
+        Settle(1);
+        Events(&press, &release);
+        SIM_CHECK(press == 1u && release == 0u, "press %u: %u press, %u release events", i, press, release);
+        Settle(0);
+        Events(&press, &release);
+    }
+    printf("footbounce: %u bounced presses detected after %.2f ms avg, %.2f min, %.2f max "
+           "(integrator %u ms)\n", PRESSES, (double)sum / PRESSES / 1e6, (double)minNs / 1e6,
+           (double)maxNs / 1e6, 10u);
+
+    /* Release while everything drives: ramp up, TIM1 PWM, TIM3 gate, channel on */
+    for (i = 0; i < PRESSES; i++) {
+        Settle(1);
+        Events(&press, &release);
+        SIM_CHECK(EswMode(OCM_PWM1) && *Sim_Reg(TIM4_CCR3) == 0u && *Sim_Reg(TIM4_CCR4) == 0u,
+                  "press %u: TIM4 not back to PWM1 at 0", i);
+        SIM_FW(Drv_IODevice_ChangeChannel)(CHANNEL_US);
+        SIM_FW(Drv_IODevice_ChangeChannel)(CHANNEL_READY);
+        SIM_FW(BSP_TIM1_PwmStart)(100, 50, 10);
+        SIM_FW(Drv_SI5351_SetBurst)(1000, 500);
+        SIM_FW(Drv_TIM4_SetESW_P)(true);
+        SIM_FW(Drv_TIM4_SetESW_N)(true);
+        SIM_CHECK(SIM_FW(Drv_DAC_RampTo)(2000, 1, E_DAC_EASE_LINEAR, NULL), "ramp %u refused", i);
+        Sim_RunFor(SIM_US(Rand(1000, 20000)));
+        SIM_CHECK(Sim_Tim1_Running() && Gate() && Esw() && SIM_FW(Drv_DAC_IsRamping)(), "outputs %u not running",
+                  i);
+
+        s_pwrOffAt = 0;
+        s_dacZeroAt = 0;
+        t0 = Sim_Now();
+        Sim_Pin_Drive(FOOT_PORT, FOOT_PIN, 0);
+        while ((Sim_Tim1_Running() || Gate() || Esw()) && Sim_Now() - t0 < SIM_MS(1))
+            Sim_RunFor(SIM_US(1));
+        t = Sim_Now() - t0;
+        SIM_CHECK(!Sim_Tim1_Running() && !Gate(), "release %u: TIM1/TIM3 still running", i);
+        SIM_CHECK(EswMode(OCM_FORCED_LOW) && *Sim_Reg(TIM4_CCR3) == 0u && *Sim_Reg(TIM4_CCR4) == 0u,
+                  "release %u: TIM4 ESW not forced inactive", i);
+        SIM_CHECK(s_pwrOffAt != 0u && s_dacZeroAt != 0u && !SIM_FW(Drv_DAC_IsRamping)(),
+                  "release %u: pwr_control1 or DAC not cut", i);
+        stopNs = t > stopNs ? t : stopNs;
+        t = (s_pwrOffAt > s_dacZeroAt ? s_pwrOffAt : s_dacZeroAt) - t0;
+        cutNs = t > cutNs ? t : cutNs;
+
+        /* The main loop pass that was running when the foot lifted carries on */
+        SIM_FW(Drv_TIM4_SetESW_P)(true);
+        SIM_FW(Drv_SI5351_SetBurst)(1000, 500);
+        SIM_CHECK(!SIM_FW(Drv_DAC_RampTo)(2000, 1, E_DAC_EASE_LINEAR, NULL) && !SIM_FW(Drv_DAC_SetVoltage)(1000),
+                  "release %u: DAC restarted after the cut", i);
+        Sim_RunFor(SIM_US(100));
+        SIM_CHECK(*Sim_Reg(TIM4_CCR3) == 0u && !Gate() && Sim_Dac_Get() == 0u,
+                  "release %u: ESW+ or the gate restarted after the cut", i);
+
+        /* The rest of the bounce must not bring a press back */
+        Bounce(0);
+        Settle(0);
+        Events(&press, &release);
+        SIM_CHECK(press == 0u && release == 1u, "release %u: %u press, %u release events", i, press, release);
+        SIM_CHECK(Sim_Dac_Get() == 0u, "release %u: DAC at %u", i, Sim_Dac_Get());
+
+        /* Not latched: the drive starts again */
+        SIM_FW(BSP_TIM1_PwmStart)(100, 50, 10);
+        Sim_RunFor(SIM_US(100));
+        SIM_CHECK(Sim_Tim1_Running(), "release %u: TIM1 latched off", i);
+        SIM_FW(BSP_TIM1_PwmStop)();
+    }
+    printf("footbounce: %u releases under drive: pwr_control1 and DAC cut within %.1f us, TIM1/TIM3/TIM4 "
+           "within %.1f us of the first edge, no restart until the next press, no latch\n", PRESSES,
+           (double)cutNs / 1e3, (double)stopNs / 1e3);
+
+    /* Isolated glitches while released, 20 us .. 9 ms wide */
+    for (i = 0; i < GLITCHES; i++) {
+        Sim_Pin_Drive(FOOT_PORT, FOOT_PIN, 1);
+        Sim_RunFor(SIM_US(Rand(20, 9000)));
+        Settle(0);
+        Events(&press, &release);
+        falsePress += press;
+    }
+    SIM_CHECK(falsePress == 0u, "%u false presses from %u glitches", falsePress, GLITCHES);
+
+    /* Short dips while pressed: the release path acts on the first falling edge */
+    Settle(1);
+    Events(&press, &release);
+    for (i = 0; i < DIPS; i++) {
+        Sim_Pin_Drive(FOOT_PORT, FOOT_PIN, 0);
+        Sim_RunFor(SIM_US(Rand(20, 2000)));
+        Settle(1);
+        Events(&press, &release);
+        dipCuts += release;
+        SIM_CHECK(SIM_FW(Drv_IODevice_GetFootSwitchState)(), "dip %u: foot not pressed again", i);
+    }
+    printf("footbounce: %u glitches while released, %u false presses; %u dips while pressed, "
+           "%u cuts, all re-pressed after the integrator\n", GLITCHES, falsePress, DIPS, dipCuts);
+    return Sim_Test_Done();
+}
@@ -0,0 +1,140 @@
+/************************************************************************************
+ * @file     : meter_test.c
+ * @brief    : Host test - delivered energy metering (drv_meter) and the status reply layout
+ * @details  : ESW_U is held at 3.0 V (300 V) and ESW_I carries 10 ms half-sine pulses of
+ *             0.8 V peak (8 A) every 50 ms: 2400 W peak, 15.28 J per pulse. Over 40 pulses
+ *             the metered ESW energy must be within 0.5 % of the integral and the 100 ms
+ *             power within 2 % of the mean. A window of blocks is then profiled instruction
+ *             by instruction (Sim_Profile): the cycles drv_meter takes per block, as its DWT
+ *             count gives them, must stay under 10 % of the time between two blocks.
+ *             GET_STATUS without data or with PROTOCOL_STATUS_BASE must answer in the V1.0
+ *             length; PROTOCOL_STATUS_EXT adds the appended fields. Reported: energy and
+ *             power error, cycles per block and share of the budget, reply lengths.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_comm.h"
+#include "drv_meter.h"
+#include <math.h>
+#include <string.h>
+
+#define ESW_U_IN            8u          /* ADC_IN8, PB0 */
+#define ESW_I_IN            9u          /* ADC_IN9, PB1 */
+#define U_MV                3000.0
+#define I_PEAK_MV           800.0
+#define PEAK_W              (U_MV * METER_ESW_U_MV_PER_MV * I_PEAK_MV * METER_ESW_I_MA_PER_MV / 1e6)
+#define PULSE_NS            SIM_MS(10)
+#define PERIOD_NS           SIM_MS(50)
+#define LEAD_NS             SIM_MS(20)  /* first pulse after the window opens */
+#define PULSES              40u
+#define PROFILE_MS          20u
+#define ENERGY_TOL_PCT      0.5
+#define POWER_TOL_PCT       2.0
+#define BUDGET_MAX_PCT      10u
+#define SW_BASE_LEN         9u          /* V1.0 SW_GetStatus_Reply_t, packed */
+#define SW_EXT_LEN          19u
+
+static uint64_t s_t0;
+
+static uint32_t EswI(uint64_t t, void *pCtx)
+{
+    uint64_t phase;
+
+    (void)pCtx;
+    if (t < s_t0 + LEAD_NS)
+        return 0u;
+    phase = (t - s_t0 - LEAD_NS) % PERIOD_NS;
+    if (phase >= PULSE_NS)
+        return 0u;
+    return (uint32_t)(I_PEAK_MV * sin(M_PI * (double)phase / (double)PULSE_NS) + 0.5);
+}
+
+/* GET_STATUS to the shockwave module; returns the reply's data length, 0 if none */
+static unsigned StatusLen(const uint8_t *pData, uint8_t len)
+{
+    uint8_t frame[PROTOCOL_FRAME_HEAD_LEN + 1u + 2u] = {
+        PROTOCOL_HEADER_0, PROTOCOL_HEADER_1, PROTOCOL_DIR_HOST_TO_DEV, PROTOCOL_MODULE_SHOCKWAVE,
+        PROTOCOL_CMD_GET_STATUS, len,
+    };
+    uint8_t rx[128];
+    size_t n = 0, i;
+
+    if (len > 0u)
+        memcpy(&frame[PROTOCOL_FRAME_HEAD_LEN], pData, len);
+    frame[PROTOCOL_FRAME_HEAD_LEN + len] = PROTOCOL_TAIL_0;
+    frame[PROTOCOL_FRAME_HEAD_LEN + len + 1u] = PROTOCOL_TAIL_1;
+    Sim_Uart_Recv(1, rx, sizeof(rx));
+    Sim_Uart_Send(1, frame, PROTOCOL_FRAME_HEAD_LEN + len + 2u);
+    Sim_Test_Run(20);
+    n = Sim_Uart_Recv(1, rx, sizeof(rx));
+    for (i = 0; i + PROTOCOL_FRAME_HEAD_LEN + 2u <= n; i++) {
+        if (rx[i] == PROTOCOL_HEADER_0 && rx[i + 1u] == PROTOCOL_HEADER_1 &&
+            rx[i + 2u] == PROTOCOL_DIR_DEV_TO_HOST && rx[i + 3u] == PROTOCOL_MODULE_SHOCKWAVE &&
+            rx[i + 4u] == PROTOCOL_CMD_GET_STATUS && i + PROTOCOL_FRAME_HEAD_LEN + rx[i + 5u] + 2u <= n)
+            return rx[i + 5u];
+    }
+    return 0u;
+}
+
+int main(int argc, char **argv)
+{
+    static const uint8_t base = PROTOCOL_STATUS_BASE, ext = PROTOCOL_STATUS_EXT;
+    double expectMj, gotMj, meanMw, errE, errP;
+    uint32_t e0, powerMw, blocks, last, lastMax = 0, n = 0;
+    uint64_t sum = 0;
+    const Meter_Stats_t *pStats;
+    unsigned ms, lenNone, lenBase, lenExt;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Adc_SetMv(ESW_U_IN, (uint32_t)U_MV);
+    Sim_Adc_SetSource(ESW_I_IN, EswI, NULL);
+    Sim_Test_Run(200);
+
+    /* Energy against the integral: peak power x pulse x 2/pi per pulse, W x ms = mJ */
+    s_t0 = Sim_Now();
+    e0 = SIM_FW(Drv_Meter_GetEnergyMj)(E_METER_CH_ESW);
+    Sim_Test_Run(PULSES * (double)PERIOD_NS / 1e6);
+    gotMj = (double)(uint32_t)(SIM_FW(Drv_Meter_GetEnergyMj)(E_METER_CH_ESW) - e0);
+    expectMj = PEAK_W * (double)PULSE_NS / 1e6 * 2.0 / M_PI * PULSES;
+    errE = (gotMj - expectMj) * 100.0 / expectMj;
+    SIM_CHECK(fabs(errE) <= ENERGY_TOL_PCT, "ESW energy %.0f mJ, %.0f mJ applied (%+.3f %%)", gotMj, expectMj,
+              errE);
+
+    /* A 100 ms window holds two pulses */
+    powerMw = SIM_FW(Drv_Meter_GetPowerMw)(E_METER_CH_ESW);
+    meanMw = expectMj / PULSES / ((double)PERIOD_NS / 1e6) * 1000.0;
+    errP = (powerMw - meanMw) * 100.0 / meanMw;
+    SIM_CHECK(fabs(errP) <= POWER_TOL_PCT, "ESW power %u mW, %.0f mW mean applied (%+.2f %%)", powerMw, meanMw,
+              errP);
+
+    /* Cycles per block: the firmware's own DWT count with every instruction costing a cycle */
+    pStats = SIM_FW(Drv_Meter_GetStats)();
+    blocks = pStats->blocks;
+    Sim_Profile(true);
+    for (ms = 0; ms < PROFILE_MS; ms++) {
+        Sim_Test_Run(1);
+        last = pStats->lastCycles;
+        lastMax = last > lastMax ? last : lastMax;
+        sum += last;
+        n++;
+    }
+    Sim_Profile(false);
+    blocks = pStats->blocks - blocks;
+    SIM_CHECK(blocks >= PROFILE_MS * 4u, "%u blocks in %u ms", blocks, PROFILE_MS);
+    SIM_CHECK(lastMax > 0u && lastMax * 100u <= pStats->budgetCycles * BUDGET_MAX_PCT,
+              "%u cycles per block, budget %u", lastMax, pStats->budgetCycles);
+
+    /* Status reply: V1.0 length unless the appended fields are asked for */
+    lenNone = StatusLen(NULL, 0);
+    lenBase = StatusLen(&base, 1);
+    lenExt = StatusLen(&ext, 1);
+    SIM_CHECK(lenNone == SW_BASE_LEN && lenBase == SW_BASE_LEN, "base status reply %u/%u bytes, V1.0 has %u",
+              lenNone, lenBase, SW_BASE_LEN);
+    SIM_CHECK(lenExt == SW_EXT_LEN, "extended status reply %u bytes, expected %u", lenExt, SW_EXT_LEN);
+
+    printf("meter: ESW %u pulses of %.0f W peak: %.0f mJ metered, %.0f mJ applied (%+.3f %%); power %u mW, "
+           "%.0f mW mean (%+.2f %%)\n", PULSES, PEAK_W, gotMj, expectMj, errE, powerMw, meanMw, errP);
+    printf("meter: %u blocks profiled, %llu cycles per block mean, %u worst, budget %u (%.1f %%)\n", blocks,
+           (unsigned long long)(sum / n), lastMax, pStats->budgetCycles, lastMax * 100.0 / pStats->budgetCycles);
+    printf("meter: SW status reply %u bytes (no data), %u (base), %u (ext)\n", lenNone, lenBase, lenExt);
+    return Sim_Test_Done();
+}
@@ -0,0 +1,209 @@
+/************************************************************************************
+ * @file     : overcurrent_test.c
+ * @brief    : Host test - hardware over-current trip through the ADC1/ADC2 analog watchdog
+ * @details  : The test is the CPU: BSP is set up, TIM1 drives the bridge, TIM4 CH3/CH4 and
+ *             pwr_control1~4 are on, and Drv_Protect is armed on US_I, RF_I or ESW_I. The
+ *             current channel gets an injected trace: noise well below the limit, then a
+ *             step or a ramp (1 .. 100 mV/us) through it at a random instant. Reported:
+ *             latency from the crossing to pwr_control1 low and to TIM1 stopped, the fault
+ *             record, the latch (TIM1 cannot restart before Drv_Protect_Clear) and false
+ *             trips from noise just under the limit.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_protect.h"
+#include "bsp_gpio.h"
+#include "bsp_tim.h"
+
+#define LIMIT_MV        1500u
+#define TRIPS           300u
+#define NOISE_MS        200u
+#define PWR_PINS        (pwr_control1_Pin | pwr_control2_Pin | pwr_control3_Pin | pwr_control4_Pin)
+#define TIM4_CCMR2      0x4000081Cu
+#define TIM4_CCR3       0x4000083Cu
+#define TIM4_CCR4       0x40000840u
+#define OCM_FORCED_LOW  4u
+
+typedef struct {
+    ADC_Channel_EnumDef channel;
+    uint8_t adcIn;              /* ADC input of the channel */
+    const char *pName;
+} Channel_t;
+
+static const Channel_t s_channels[] = {
+    { E_ADC_CHANNEL_US_I,  0u, "US_I"  },
+    { E_ADC_CHANNEL_RF_I,  1u, "RF_I"  },
+    { E_ADC_CHANNEL_ESW_I, 9u, "ESW_I" },
+};
+
+/* Injected trace: noise around baseMv until tStart, then a ramp of slope mV/us (0: step) to peakMv */
+static struct {
+    uint32_t baseMv;
+    uint32_t noiseMv;
+    uint32_t peakMv;
+    uint64_t tStart;
+    uint32_t slope;
+} s_trace;
+
+static uint32_t s_seed = 2718u;
+static uint64_t s_pwrOffAt = 0;
+
+static uint32_t Rand(uint32_t lo, uint32_t hi)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return lo + (s_seed >> 8) % (hi - lo + 1u);
+}
+
+static uint32_t Trace(uint64_t t, void *pCtx)
+{
+    uint64_t mv;
+
+    (void)pCtx;
+    if (t < s_trace.tStart)
+        return s_trace.baseMv - s_trace.noiseMv + Rand(0, 2u * s_trace.noiseMv);
+    if (s_trace.slope == 0u)
+        return s_trace.peakMv;
+    mv = s_trace.baseMv + (t - s_trace.tStart) * s_trace.slope / 1000u;
+    return mv > s_trace.peakMv ? s_trace.peakMv : (uint32_t)mv;
+}
+
+/* Noise-free crossing of LIMIT_MV: the AWD trips above HTR */
+static uint64_t Crossing(void)
+{
+    if (s_trace.slope == 0u)
+        return s_trace.tStart;
+    return s_trace.tStart + ((uint64_t)(LIMIT_MV - s_trace.baseMv) * 1000u + s_trace.slope - 1u) / s_trace.slope;
+}
+
+static void PwrWatch(char port, uint16_t odr, uint16_t changed, void *pCtx)
+{
+    (void)pCtx;
+    if (port == 'C' && (changed & pwr_control1_Pin) && !(odr & pwr_control1_Pin) && s_pwrOffAt == 0u)
+        s_pwrOffAt = Sim_Now();
+}
+
+/* Everything driving: bridge PWM, TIM4 CH3/CH4, all four channels */
+static void Drive(void)
+{
+    SIM_FW(GPIO_SetBits)(GPIOC, PWR_PINS);
+    SIM_FW(BSP_TIM1_PwmStart)(100, 50, 10);
+    SIM_FW(BSP_TIM4_SetCompare3)(30000);
+    SIM_FW(BSP_TIM4_SetCompare4)(30000);
+}
+
+static bool Tim4Off(void)
+{
+    uint32_t ccmr2 = *Sim_Reg(TIM4_CCMR2);
+
+    return ((ccmr2 >> 4) & 7u) == OCM_FORCED_LOW && ((ccmr2 >> 12) & 7u) == OCM_FORCED_LOW &&
+           *Sim_Reg(TIM4_CCR3) == 0u && *Sim_Reg(TIM4_CCR4) == 0u;
+}
+
+int main(int argc, char **argv)
+{
+    const Channel_t *pCh;
+    const Protect_FaultRecord_t *pFault;
+    uint64_t cross, t, tim1At;
+    uint64_t pwrSum = 0, pwrMax = 0, tim1Sum = 0, tim1Max = 0;
+    uint64_t stepMax = 0, rampMax = 0;
+    uint16_t trips0;
+    unsigned i, falseTrips = 0;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks and BSP, TIM1 clocked at 1 MHz on ETR */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    Sim_Tim_SetEtrHz(1000000u);
+    Sim_Pin_Watch(PwrWatch, NULL);
+    for (i = 0; i < sizeof(s_channels) / sizeof(s_channels[0]); i++)
+        Sim_Adc_SetMv(s_channels[i].adcIn, 200u);
+
+    for (i = 0; i < TRIPS; i++) {
+        pCh = &s_channels[i % 3u];
+        s_trace.baseMv = LIMIT_MV * 6u / 10u;
+        s_trace.noiseMv = 50u;
+        s_trace.peakMv = LIMIT_MV * 13u / 10u;
+        s_trace.tStart = UINT64_MAX;
+        s_trace.slope = (i / 3u) % 2u ? Rand(1, 100) : 0u;
+        Sim_Adc_SetSource(pCh->adcIn, Trace, NULL);
+
+        trips0 = SIM_FW(Drv_Protect_GetFault)()->trip_count;
+        SIM_CHECK(SIM_FW(Drv_Protect_Arm)(pCh->channel, LIMIT_MV), "trip %u: arm on %s refused", i, pCh->pName);
+        Drive();
+        Sim_RunFor(SIM_US(50));
+        SIM_CHECK(Sim_Tim1_Running() && !SIM_FW(Drv_Protect_IsTripped)(), "trip %u: not driving before the fault", i);
+        s_trace.tStart = Sim_Now() + SIM_US(Rand(200, 2000));
+
+        /* Up to just before the crossing (the threshold is within one LSB of it), then TIM1 to a
+         * quarter microsecond; an interrupt running at the stop time may carry past it */
+        cross = Crossing();
+        s_pwrOffAt = 0;
+        Sim_RunFor(cross - SIM_US(1) - Sim_Now());
+        SIM_CHECK(!SIM_FW(Drv_Protect_IsTripped)() || Sim_Now() > cross, "trip %u: %s tripped before the crossing",
+                  i, pCh->pName);
+        if (Sim_Now() < cross)
+            Sim_RunFor(cross - Sim_Now());
+        tim1At = 0;
+        for (t = 0; t < SIM_US(100) && (tim1At == 0u || s_pwrOffAt == 0u); t += SIM_NS(250)) {
+            Sim_RunFor(SIM_NS(250));
+            if (tim1At == 0u && !Sim_Tim1_Running())
+                tim1At = Sim_Now();
+        }
+        SIM_CHECK(tim1At != 0u && s_pwrOffAt != 0u, "trip %u: %s not cut 100 us after the crossing", i, pCh->pName);
+        SIM_CHECK(SIM_FW(Drv_Protect_IsTripped)(), "trip %u: %s not latched", i, pCh->pName);
+        SIM_CHECK((SIM_FW(GPIO_ReadOutputData)(GPIOC) & PWR_PINS) == 0u, "trip %u: pwr_control left on", i);
+        SIM_CHECK(Tim4Off(), "trip %u: TIM4 CH3/CH4 still driving", i);
+        pwrSum += s_pwrOffAt - cross;
+        pwrMax = s_pwrOffAt - cross > pwrMax ? s_pwrOffAt - cross : pwrMax;
+        tim1Sum += tim1At - cross;
+        tim1Max = tim1At - cross > tim1Max ? tim1At - cross : tim1Max;
+        t = (s_pwrOffAt > tim1At ? s_pwrOffAt : tim1At) - cross;
+        if (s_trace.slope == 0u)
+            stepMax = t > stepMax ? t : stepMax;
+        else
+            rampMax = t > rampMax ? t : rampMax;
+
+        pFault = SIM_FW(Drv_Protect_GetFault)();
+        SIM_CHECK(pFault->channel == pCh->channel && pFault->limit_mv == LIMIT_MV && pFault->value_mv >= LIMIT_MV &&
+                  pFault->trip_count == (uint16_t)(trips0 + 1u),
+                  "trip %u: fault record channel %d, limit %u, value %u mV, count %u", i, pFault->channel,
+                  pFault->limit_mv, pFault->value_mv, pFault->trip_count);
+
+        /* Latched: the bridge does not restart until the APP clears it */
+        SIM_FW(BSP_TIM1_PwmStart)(100, 50, 10);
+        Sim_RunFor(SIM_US(20));
+        SIM_CHECK(!Sim_Tim1_Running(), "trip %u: TIM1 restarted before Drv_Protect_Clear", i);
+        SIM_FW(BSP_TIM1_PwmStop)();
+        Sim_Adc_SetMv(pCh->adcIn, 200u);
+        SIM_FW(Drv_Protect_Clear)();
+    }
+    printf("overcurrent: %u trips on US_I/RF_I/ESW_I: pwr_control1 low %.2f us avg, %.2f max; TIM1 stopped "
+           "%.2f us avg, %.2f max after the crossing (steps %.2f max, 1..100 mV/us ramps %.2f max)\n",
+           TRIPS, (double)pwrSum / TRIPS / 1e3, (double)pwrMax / 1e3, (double)tim1Sum / TRIPS / 1e3,
+           (double)tim1Max / 1e3, (double)stepMax / 1e3, (double)rampMax / 1e3);
+    SIM_CHECK(pwrMax < SIM_US(20) && tim1Max < SIM_US(20), "trip latency over 20 us");
+
+    /* Noise just under the limit: no trip */
+    for (i = 0; i < sizeof(s_channels) / sizeof(s_channels[0]); i++) {
+        pCh = &s_channels[i];
+        s_trace.baseMv = LIMIT_MV - 60u;
+        s_trace.noiseMv = 55u;
+        s_trace.tStart = UINT64_MAX;
+        Sim_Adc_SetSource(pCh->adcIn, Trace, NULL);
+        SIM_FW(Drv_Protect_Arm)(pCh->channel, LIMIT_MV);
+        Drive();
+        Sim_RunFor(SIM_MS(NOISE_MS));
+        falseTrips += SIM_FW(Drv_Protect_IsTripped)() ? 1u : 0u;
+        SIM_CHECK(Sim_Tim1_Running(), "%s: bridge stopped by noise under the limit", pCh->pName);
+        SIM_FW(Drv_Protect_Clear)();
+        SIM_FW(Drv_Protect_Disarm)();
+        Sim_Adc_SetMv(pCh->adcIn, 200u);
+    }
+    SIM_CHECK(falseTrips == 0u, "%u false trips", falseTrips);
+    printf("overcurrent: %u ms of noise up to 5 mV under the limit per channel: %u false trips\n",
+           NOISE_MS, falseTrips);
+    return Sim_Test_Done();
+}
@@ -0,0 +1,338 @@
+/************************************************************************************
+ * @file     : probeid_test.c
+ * @brief    : Host test - probe EEPROM identification over I2C2 (drv_probeid)
+ * @details  : An ultrasound probe with a calibrated AT24C02 is inserted, pulled and
+ *             inserted again: the image is read in PROBEID_CHUNK reads, the CRC in
+ *             block 17 covers blocks 0..16, the second insertion is a cache hit. A
+ *             flipped byte in block 16 (outside the RF trim) must read as corrupt and an
+ *             erased CRC word as legacy. The US resonance found on a probe is kept in its
+ *             usage record, not in the mainboard US parameter block (whose CRC must stay
+ *             at byte 12 for the units in the field), and a second probe starts without it.
+ *             Usage writes: a commit must land in the copy not holding the current record
+ *             and leave that one intact; a second normal write meanwhile is refused. A
+ *             write torn after every byte of its 16 (mid-page and between the two pages)
+ *             must read back on re-insertion as the previous record. An urgent write
+ *             after the first page of a normal one must take it over: same seq, its own
+ *             counts, the page-wise write not resumed. The newer copy wins across the
+ *             seq wrap. Reported: seq and counts after each case.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_probeid.h"
+#include "app_usage.h"
+#include "app_memory.h"
+#include <stddef.h>
+#include <string.h>
+
+#define PROBE_SN    "M600US0001"
+#define PROBE_SN2   "M600US0002"
+#define USAGE_CRC_AT        (PROBEID_USAGE_SIZE - 2u)
+#define WRITE_WAIT_MS       200u
+
+static uint16_t Crc16(const uint8_t *p, uint16_t len)
+{
+    uint16_t crc = 0xFFFFu;
+    uint8_t j;
+
+    while (len-- != 0u) {
+        crc ^= (uint16_t)(*p++ << 8);
+        for (j = 0; j < 8u; j++)
+            crc = (crc & 0x8000u) ? (uint16_t)((crc << 1) ^ 0x8005u) : (uint16_t)(crc << 1);
+    }
+    return crc;
+}
+
+static void Put16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void WriteImage(bool withCrc, const char *pSn)
+{
+    uint8_t *pMem = Sim_Eeprom_Mem();
+
+    memset(pMem, 0xFF, 256u);
+    pMem[PROBEID_ADDR_MODEL] = 1u;
+    pMem[PROBEID_ADDR_OVERTEMP] = 42u;
+    pMem[PROBEID_ADDR_OVERTEMP + 1u] = 45u;
+    pMem[PROBEID_ADDR_REG] = 0x05u;
+    pMem[PROBEID_ADDR_REG + 1u] = (uint8_t)strlen(pSn);
+    memcpy(&pMem[PROBEID_ADDR_SN], pSn, strlen(pSn));
+    Put16(&pMem[PROBEID_ADDR_US_FREQ], 1000u);
+    Put16(&pMem[PROBEID_ADDR_HEAD_TEMP], 420u);
+    Put16(&pMem[PROBEID_ADDR_BOARD_TEMP], 450u);
+    Put16(&pMem[PROBEID_ADDR_DCDC], 1200u);
+    Put16(&pMem[PROBEID_ADDR_RF_TEMP], 430u);
+    pMem[PROBEID_ADDR_RF_TEMP + 4u] = 0x5Au;     /* rest of block 16, covered as well */
+    if (withCrc)
+        Put16(&pMem[PROBEID_ADDR_CRC], Crc16(pMem, PROBEID_ADDR_CRC));
+}
+
+static uint32_t Get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+static void Put32(uint8_t *p, uint32_t v)
+{
+    Put16(&p[0], (uint16_t)(v >> 16));
+    Put16(&p[2], (uint16_t)v);
+}
+
+static uint8_t *UsageCopy(uint8_t copy)
+{
+    return &Sim_Eeprom_Mem()[PROBEID_ADDR_USAGE + copy * PROBEID_USAGE_SIZE];
+}
+
+/* Stored usage copy as the driver lays it out; false on a CRC mismatch */
+static bool UsageRead(uint8_t copy, ProbeId_Usage_t *pUsage)
+{
+    const uint8_t *p = UsageCopy(copy);
+
+    memset(pUsage, 0, sizeof(*pUsage));
+    if (Crc16(p, USAGE_CRC_AT) != (uint16_t)(p[14] << 8 | p[15]))
+        return false;
+    pUsage->seq = (uint16_t)(p[0] << 8 | p[1]);
+    pUsage->resonanceKHz = (uint16_t)(p[2] << 8 | p[3]);
+    pUsage->energisedS = Get32(&p[4]);
+    pUsage->shots = Get32(&p[8]);
+    pUsage->sessions = (uint16_t)(p[12] << 8 | p[13]);
+    return true;
+}
+
+static void UsageWrite(uint8_t copy, const ProbeId_Usage_t *pUsage)
+{
+    uint8_t *p = UsageCopy(copy);
+
+    Put16(&p[0], pUsage->seq);
+    Put16(&p[2], pUsage->resonanceKHz);
+    Put32(&p[4], pUsage->energisedS);
+    Put32(&p[8], pUsage->shots);
+    Put16(&p[12], pUsage->sessions);
+    Put16(&p[14], Crc16(p, USAGE_CRC_AT));
+}
+
+static bool SameCounts(const ProbeId_Usage_t *pA, const ProbeId_Usage_t *pB)
+{
+    return pA->seq == pB->seq && pA->resonanceKHz == pB->resonanceKHz && pA->energisedS == pB->energisedS &&
+           pA->shots == pB->shots && pA->sessions == pB->sessions;
+}
+
+/* Sync lines US/RF/ESW on PC10/PC11/PC12: 0/1/1 ultrasound, 1/1/1 nothing connected */
+static void Probe(bool inserted)
+{
+    Sim_Pin_Drive('C', 10, inserted ? 0 : 1);
+    Sim_Pin_Drive('C', 11, 1);
+    Sim_Pin_Drive('C', 12, 1);
+    Sim_Test_Run(400);
+}
+
+/* Normal write to completion; the copy it went to, 0xFF if it did not finish */
+static uint8_t Commit(const ProbeId_Usage_t *pUsage)
+{
+    uint8_t before[2u * PROBEID_USAGE_SIZE];
+    uint32_t ms;
+
+    memcpy(before, UsageCopy(0), sizeof(before));
+    SIM_CHECK(SIM_FW(Drv_ProbeId_WriteUsage)(pUsage, false), "normal write refused");
+    SIM_CHECK(!SIM_FW(Drv_ProbeId_WriteUsage)(pUsage, false), "second normal write taken during the first");
+    for (ms = 0; ms < WRITE_WAIT_MS && SIM_FW(Drv_ProbeId_IsWriting)(); ms++)
+        Sim_Test_Run(1);
+    if (SIM_FW(Drv_ProbeId_IsWriting)())
+        return 0xFFu;
+    if (memcmp(before, UsageCopy(0), PROBEID_USAGE_SIZE) != 0)
+        return memcmp(&before[PROBEID_USAGE_SIZE], UsageCopy(1), PROBEID_USAGE_SIZE) == 0 ? 0u : 0xFEu;
+    return 1u;
+}
+
+/* Usage after pulling and re-inserting the probe, zeros if none */
+static ProbeId_Usage_t Reinsert(void)
+{
+    ProbeId_Usage_t usage;
+    const ProbeId_Usage_t *pUsage;
+
+    Probe(false);
+    Probe(true);
+    pUsage = SIM_FW(Drv_ProbeId_GetUsage)();
+    memset(&usage, 0, sizeof(usage));
+    if (pUsage != NULL)
+        usage = *pUsage;
+    return usage;
+}
+
+static void UsageWrites(void)
+{
+    uint8_t oldMem[256], newMem[256];
+    ProbeId_Usage_t base, rec, stored, other, got;
+    ProbeId_Stats_t stats;
+    uint8_t target, page0[PROBEID_PAGE], k, torn = 0;
+    uint32_t ms;
+
+    /* Commit: the other copy, the current one untouched */
+    base = *SIM_FW(Drv_ProbeId_GetUsage)();
+    stats = *SIM_FW(Drv_ProbeId_GetStats)();
+    rec = base;
+    rec.energisedS = 3600u;
+    rec.shots = 1200u;
+    rec.sessions = 7u;
+    target = Commit(&rec);
+    SIM_CHECK(target <= 1u, "commit: target copy %u", target);
+    rec.seq = (uint16_t)(base.seq + 1u);
+    got = *SIM_FW(Drv_ProbeId_GetUsage)();
+    SIM_CHECK(SameCounts(&got, &rec), "commit: seq %u, %u s, %u shots, %u sessions", got.seq, got.energisedS,
+              got.shots, got.sessions);
+    SIM_CHECK(target <= 1u && UsageRead(target, &stored) && SameCounts(&stored, &rec) &&
+              UsageRead(target ^ 1u, &other) && SameCounts(&other, &base), "commit: copies seq %u/%u",
+              stored.seq, other.seq);
+    SIM_CHECK(SIM_FW(Drv_ProbeId_GetStats)()->usageWrites == stats.usageWrites + 1u &&
+              SIM_FW(Drv_ProbeId_GetStats)()->usageErrors == stats.usageErrors, "commit: %u writes, %u errors",
+              SIM_FW(Drv_ProbeId_GetStats)()->usageWrites, SIM_FW(Drv_ProbeId_GetStats)()->usageErrors);
+    got = Reinsert();
+    SIM_CHECK(SameCounts(&got, &rec), "commit, re-inserted: seq %u, %u shots", got.seq, got.shots);
+    printf("probeid: commit went to copy %u, seq %u, %u s, %u shots, %u sessions; copy %u kept seq %u\n",
+           target, got.seq, got.energisedS, got.shots, got.sessions, target ^ 1u, base.seq);
+
+    /* Torn after every byte: the previous record survives */
+    base = rec;
+    memcpy(oldMem, Sim_Eeprom_Mem(), sizeof(oldMem));
+    rec.shots = 1300u;
+    rec.sessions = 8u;
+    target = Commit(&rec);
+    rec.seq = (uint16_t)(base.seq + 1u);
+    memcpy(newMem, Sim_Eeprom_Mem(), sizeof(newMem));
+    SIM_CHECK(target <= 1u, "torn: target copy %u", target);
+    for (k = 1; target <= 1u && k <= PROBEID_USAGE_SIZE; k++) {
+        memcpy(Sim_Eeprom_Mem(), oldMem, sizeof(oldMem));
+        memcpy(UsageCopy(target), &newMem[PROBEID_ADDR_USAGE + target * PROBEID_USAGE_SIZE], k);
+        got = Reinsert();
+        if (!SameCounts(&got, k < PROBEID_USAGE_SIZE ? &base : &rec)) {
+            SIM_CHECK(false, "torn after %u bytes: seq %u, %u shots", k, got.seq, got.shots);
+            continue;
+        }
+        torn += (k < PROBEID_USAGE_SIZE) ? 1u : 0u;
+    }
+    /* Re-inserted torn mid-page: the next write goes to the torn copy again */
+    memcpy(Sim_Eeprom_Mem(), oldMem, sizeof(oldMem));
+    memcpy(UsageCopy(target), &newMem[PROBEID_ADDR_USAGE + target * PROBEID_USAGE_SIZE], PROBEID_PAGE / 2u);
+    got = Reinsert();
+    SIM_CHECK(SameCounts(&got, &base), "torn mid-page: seq %u", got.seq);
+    SIM_CHECK(Commit(&rec) == target, "after a torn write: not rewritten into copy %u", target);
+    got = Reinsert();
+    SIM_CHECK(SameCounts(&got, &rec), "after a torn write, re-inserted: seq %u, %u shots", got.seq, got.shots);
+    printf("probeid: write torn after 1..%u of %u bytes: %u read back as seq %u, the whole one as seq %u\n",
+           PROBEID_USAGE_SIZE - 1u, PROBEID_USAGE_SIZE, torn, base.seq, rec.seq);
+
+    /* Urgent write after the first page of a normal one */
+    base = rec;
+    target = target ^ 1u;
+    stats = *SIM_FW(Drv_ProbeId_GetStats)();
+    memcpy(page0, UsageCopy(target), sizeof(page0));
+    rec.shots = 1400u;
+    SIM_CHECK(SIM_FW(Drv_ProbeId_WriteUsage)(&rec, false), "normal write refused");
+    for (ms = 0; ms < WRITE_WAIT_MS && memcmp(page0, UsageCopy(target), sizeof(page0)) == 0; ms++)
+        Sim_Test_Run(1);
+    SIM_CHECK(SIM_FW(Drv_ProbeId_IsWriting)() && !UsageRead(target, &stored), "no page-wise write in flight");
+    rec.energisedS = 3700u;
+    rec.shots = 1450u;
+    rec.sessions = 9u;
+    SIM_CHECK(SIM_FW(Drv_ProbeId_WriteUsage)(&rec, true), "urgent write refused");
+    rec.seq = (uint16_t)(base.seq + 1u);
+    got = *SIM_FW(Drv_ProbeId_GetUsage)();
+    SIM_CHECK(!SIM_FW(Drv_ProbeId_IsWriting)() && SameCounts(&got, &rec), "urgent: writing %d, seq %u, %u shots",
+              SIM_FW(Drv_ProbeId_IsWriting)(), got.seq, got.shots);
+    memcpy(newMem, Sim_Eeprom_Mem(), sizeof(newMem));
+    Sim_Test_Run(WRITE_WAIT_MS);
+    SIM_CHECK(memcmp(newMem, Sim_Eeprom_Mem(), sizeof(newMem)) == 0, "page-wise write resumed after the urgent one");
+    SIM_CHECK(UsageRead(target, &stored) && SameCounts(&stored, &rec) && UsageRead(target ^ 1u, &other) &&
+              SameCounts(&other, &base), "urgent: copies seq %u/%u", stored.seq, other.seq);
+    SIM_CHECK(SIM_FW(Drv_ProbeId_GetStats)()->usageWrites == stats.usageWrites + 1u, "urgent: %u writes",
+              SIM_FW(Drv_ProbeId_GetStats)()->usageWrites - stats.usageWrites);
+    got = Reinsert();
+    SIM_CHECK(SameCounts(&got, &rec), "urgent, re-inserted: seq %u, %u shots", got.seq, got.shots);
+    printf("probeid: urgent write %u ms into a page-wise one took it over: seq %u, %u s, %u shots, "
+           "%u sessions\n", ms, got.seq, got.energisedS, got.shots, got.sessions);
+
+    /* Seq wrap: 0x0000 is newer than 0xFFFF */
+    rec.seq = 0xFFFFu;
+    rec.shots = 1500u;
+    UsageWrite(0, &rec);
+    rec.seq = 0x0000u;
+    rec.shots = 1501u;
+    UsageWrite(1, &rec);
+    got = Reinsert();
+    SIM_CHECK(SameCounts(&got, &rec), "seq wrap: seq %u, %u shots", got.seq, got.shots);
+}
+
+int main(int argc, char **argv)
+{
+    const ProbeId_Info_t *pInfo;
+    const ProbeId_Stats_t *pStats;
+    const ProbeId_Usage_t *pUsage;
+    uint8_t probeA[256];
+
+    Sim_Test_Init(argc, argv);
+    WriteImage(true, PROBE_SN);
+    Probe(false);
+    Probe(true);
+    SIM_CHECK(SIM_FW(Drv_ProbeId_GetState)() == E_PROBEID_VALID, "state %d",
+              SIM_FW(Drv_ProbeId_GetState)());
+    pInfo = SIM_FW(Drv_ProbeId_Get)();
+    SIM_CHECK(pInfo != NULL, "no probe info");
+    if (pInfo != NULL) {
+        SIM_CHECK(strcmp(pInfo->sn, PROBE_SN) == 0, "SN %s", pInfo->sn);
+        SIM_CHECK(pInfo->model == 1u && pInfo->usFreqKHz == 1000u && pInfo->rfTempLimit == 430u,
+                  "model %u US %u kHz RF limit %u", pInfo->model, pInfo->usFreqKHz, pInfo->rfTempLimit);
+    }
+    SIM_CHECK(Sim_Test_Log("Probe id: SN " PROBE_SN) != NULL, "identification not logged");
+
+    Probe(false);
+    Probe(true);
+    pStats = SIM_FW(Drv_ProbeId_GetStats)();
+    SIM_CHECK(pStats->hits == 1u && pStats->reads == 1u, "%u hits, %u reads", pStats->hits, pStats->reads);
+    printf("probeid: first insertion read the image, second served from the cache in %u ms\n",
+           pStats->lastMs);
+
+    SIM_CHECK(sizeof(US_TreatParams_t) == 14u && offsetof(US_TreatParams_t, CrcCode) == 12u,
+              "US parameter block %u bytes, CRC at %u", (unsigned)sizeof(US_TreatParams_t),
+              (unsigned)offsetof(US_TreatParams_t, CrcCode));
+    SIM_FW(App_Usage_SetResonance)(1032u);
+    Sim_Test_Run(200);
+    pUsage = SIM_FW(Drv_ProbeId_GetUsage)();
+    SIM_CHECK(pUsage != NULL && pUsage->resonanceKHz == 1032u && pUsage->seq == 1u,
+              "resonance %u kHz, seq %u", pUsage ? pUsage->resonanceKHz : 0u, pUsage ? pUsage->seq : 0u);
+    memcpy(probeA, Sim_Eeprom_Mem(), sizeof(probeA));
+
+    /* Another probe on the same mainboard: no resonance of its own yet */
+    WriteImage(true, PROBE_SN2);
+    Probe(false);
+    Probe(true);
+    pUsage = SIM_FW(Drv_ProbeId_GetUsage)();
+    SIM_CHECK(pUsage != NULL && pUsage->resonanceKHz == 0u, "second probe resonance %u kHz",
+              pUsage ? pUsage->resonanceKHz : 0u);
+
+    memcpy(Sim_Eeprom_Mem(), probeA, sizeof(probeA));
+    Probe(false);
+    Probe(true);
+    pUsage = SIM_FW(Drv_ProbeId_GetUsage)();
+    SIM_CHECK(pUsage != NULL && pUsage->resonanceKHz == 1032u, "first probe back, resonance %u kHz",
+              pUsage ? pUsage->resonanceKHz : 0u);
+    printf("probeid: resonance 1032 kHz stored on probe " PROBE_SN ", not seen on " PROBE_SN2 "\n");
+    UsageWrites();
+
+    /* Block 16 byte flipped behind the RF trim, cache gone with the power */
+    Sim_Eeprom_Mem()[PROBEID_ADDR_RF_TEMP + 4u] ^= 0xFFu;
+    Sim_Test_Reboot(E_SIM_RESET_POWER);
+    Probe(false);
+    Probe(true);
+    SIM_CHECK(SIM_FW(Drv_ProbeId_GetState)() == E_PROBEID_CORRUPT, "state %d",
+              SIM_FW(Drv_ProbeId_GetState)());
+    SIM_CHECK(Sim_Test_Log("calibration CRC error") != NULL, "CRC error not logged");
+
+    WriteImage(false, PROBE_SN);
+    Sim_Test_Reboot(E_SIM_RESET_POWER);
+    Probe(false);
+    Probe(true);
+    SIM_CHECK(SIM_FW(Drv_ProbeId_GetState)() == E_PROBEID_LEGACY, "state %d",
+              SIM_FW(Drv_ProbeId_GetState)());
+    return Sim_Test_Done();
+}
@@ -0,0 +1,412 @@
+/************************************************************************************
+ * @file     : program_test.c
+ * @brief    : Host test - on-device treatment programs (app_program)
+ * @details  : A four-step ultrasound program is uploaded over USART1 and the engine is
+ *             stepped through every millisecond of delivered time: steps must change
+ *             exactly on their boundaries, ramps must give the interpolated level (up and
+ *             down), frequency must be sent on entering a step that has one and the
+ *             progress must count down per step. Jumps over steps, as a stalled loop
+ *             gives them, must carry the last skipped frequency. Uploads with a bad
+ *             length, count, level, frequency, ramp, duration or total must be rejected
+ *             and leave the loaded program alone. A three-step shock wave program is
+ *             then run on virtual time: the published status must show each step and
+ *             level within one TreatMgr pass of its time, an upload while it runs must be
+ *             refused and output must stop at the program's end. Reported: steps and
+ *             level changes seen, boundary lag, upload bytes against the commands a host
+ *             would otherwise send.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_comm.h"
+#include "app_memory.h"
+#include "app_program.h"
+#include "app_session.h"
+#include "app_shockwave.h"
+#include "app_ultrasound.h"
+#include <math.h>
+#include <string.h>
+
+#define ESW_U_IN            8u          /* ADC_IN8, PB0 */
+#define ESW_I_IN            9u          /* ADC_IN9, PB1 */
+#define HAND_NTC_IN         13u         /* ADC_IN13, PC3 */
+#define TIM4_CCR4           0x40000840u
+#define SUPPLY_MV           3250.0      /* 325 V */
+#define CHARGE_TAU_NS       SIM_MS(30)
+#define DUMP_TAU_NS         SIM_MS(8)
+#define PASS_MS             10u         /* TreatMgr pass */
+#define US_LEVEL_MIN        1u
+
+/* Ultrasound: hold, ramp up, drop, ramp down; frequency only where it changes */
+static const Program_Step_t s_us[] = {
+    { 2u, 1000u, 3u, 0u },
+    { 3u, 0u,    9u, 2u },
+    { 1u, 1200u, 5u, 0u },
+    { 2u, 0u,    2u, 1u },
+};
+#define US_STEPS            (sizeof(s_us) / sizeof(s_us[0]))
+
+/* Shock wave: level 5 at frequency 8, ramp to 11, then 13 at frequency 16 */
+static const Program_Step_t s_sw[] = {
+    { 1u, 8u,  5u,  0u },
+    { 2u, 0u,  11u, 1u },
+    { 1u, 16u, 13u, 0u },
+};
+#define SW_STEPS            (sizeof(s_sw) / sizeof(s_sw[0]))
+#define SW_TOTAL_MS         4000u
+
+/* Storage capacitor: voltage v at t, charging or being dumped from then on */
+static struct {
+    double v;
+    uint64_t t;
+    bool dump;
+} s_cap;
+
+static double CapAt(uint64_t t)
+{
+    double x = (double)(t - s_cap.t);
+
+    if (s_cap.dump)
+        return s_cap.v * exp(-x / (double)DUMP_TAU_NS);
+    return SUPPLY_MV + (s_cap.v - SUPPLY_MV) * exp(-x / (double)CHARGE_TAU_NS);
+}
+
+static uint32_t EswU(uint64_t t, void *pCtx)
+{
+    bool dump = *Sim_Reg(TIM4_CCR4) != 0u;
+
+    (void)pCtx;
+    if (t >= s_cap.t && dump != s_cap.dump) {
+        s_cap.v = CapAt(t);
+        s_cap.t = t;
+        s_cap.dump = dump;
+    }
+    return (uint32_t)(CapAt(t) + 0.5);
+}
+
+/* Buzzer (PC13): sounds as output starts and as it stops, the session's edges */
+static struct {
+    bool armed;
+    int onLevel;
+    uint64_t onAt;
+    uint64_t offAt;
+} s_buzzer;
+
+static void BuzzerWatch(char port, uint16_t odr, uint16_t changed, void *pCtx)
+{
+    int level = (odr >> 13) & 1;
+
+    (void)pCtx;
+    if (port != 'C' || !(changed & (1u << 13)) || !s_buzzer.armed)
+        return;
+    if (s_buzzer.onAt == 0u) {
+        s_buzzer.onAt = Sim_Now();
+        s_buzzer.onLevel = level;
+    } else if (level == s_buzzer.onLevel && s_buzzer.offAt == 0u) {
+        s_buzzer.offAt = Sim_Now();
+    }
+}
+
+/* Frame to the device, the reply's data into pReply; returns its length, -1 if none */
+static int Request(uint8_t module, uint8_t cmd, const uint8_t *pData, uint8_t len, uint8_t *pReply)
+{
+    uint8_t frame[PROTOCOL_FRAME_MAX];
+    uint8_t rx[256];
+    size_t n, i;
+
+    frame[0] = PROTOCOL_HEADER_0;
+    frame[1] = PROTOCOL_HEADER_1;
+    frame[2] = PROTOCOL_DIR_HOST_TO_DEV;
+    frame[3] = module;
+    frame[4] = cmd;
+    frame[5] = len;
+    memcpy(&frame[PROTOCOL_FRAME_HEAD_LEN], pData, len);
+    frame[PROTOCOL_FRAME_HEAD_LEN + len] = PROTOCOL_TAIL_0;
+    frame[PROTOCOL_FRAME_HEAD_LEN + len + 1u] = PROTOCOL_TAIL_1;
+    Sim_Uart_Recv(1, rx, sizeof(rx));
+    Sim_Uart_Send(1, frame, PROTOCOL_FRAME_HEAD_LEN + len + 2u);
+    Sim_Test_Run(30);
+    n = Sim_Uart_Recv(1, rx, sizeof(rx));
+    for (i = 0; i + PROTOCOL_FRAME_HEAD_LEN + 2u <= n; i++) {
+        if (rx[i] == PROTOCOL_HEADER_0 && rx[i + 1u] == PROTOCOL_HEADER_1 &&
+            rx[i + 2u] == PROTOCOL_DIR_DEV_TO_HOST && rx[i + 3u] == module && rx[i + 4u] == cmd &&
+            i + PROTOCOL_FRAME_HEAD_LEN + rx[i + 5u] + 2u <= n) {
+            memcpy(pReply, &rx[i + PROTOCOL_FRAME_HEAD_LEN], rx[i + 5u]);
+            return rx[i + 5u];
+        }
+    }
+    return -1;
+}
+
+/* SET_PROGRAM with count steps; the wire length may be forced (0: from count) */
+static uint8_t Upload(uint8_t module, const Program_Step_t *pSteps, uint8_t count, uint8_t len,
+                      uint8_t *pCount, uint16_t *pTotalS)
+{
+    uint8_t data[1u + PROGRAM_STEP_MAX * PROGRAM_STEP_LEN + PROGRAM_STEP_LEN];
+    uint8_t reply[8] = { 0xFFu };
+    uint8_t *p = &data[1];
+    uint8_t i;
+
+    data[0] = count;
+    for (i = 0; i < count && i <= PROGRAM_STEP_MAX; i++, p += PROGRAM_STEP_LEN) {
+        p[0] = (uint8_t)pSteps[i].duration_s;
+        p[1] = (uint8_t)(pSteps[i].duration_s >> 8);
+        p[2] = pSteps[i].level;
+        p[3] = (uint8_t)pSteps[i].frequency;
+        p[4] = (uint8_t)(pSteps[i].frequency >> 8);
+        p[5] = pSteps[i].ramp_s;
+    }
+    if (len == 0u)
+        len = (uint8_t)(p - data);
+    SIM_CHECK(Request(module, PROTOCOL_CMD_SET_PROGRAM, data, len, reply) == 4, "no SET_PROGRAM reply");
+    *pCount = reply[1];
+    *pTotalS = (uint16_t)(reply[2] | reply[3] << 8);
+    return reply[0];
+}
+
+/* The engine's contract, from the step table: step index and level at elapsed ms */
+static uint8_t Expect(const Program_Step_t *pSteps, uint8_t count, uint8_t levelMin, uint32_t ms,
+                      uint8_t *pStep, uint32_t *pEndMs)
+{
+    uint32_t start = 0, in, ramp;
+    int32_t from;
+    uint8_t i;
+
+    for (i = 0; i + 1u < count && ms >= start + pSteps[i].duration_s * 1000u; i++)
+        start += pSteps[i].duration_s * 1000u;
+    *pStep = i;
+    *pEndMs = start + pSteps[i].duration_s * 1000u;
+    in = ms - start;
+    ramp = pSteps[i].ramp_s * 1000u;
+    if (in >= ramp)
+        return pSteps[i].level;
+    from = (i == 0u) ? levelMin : pSteps[i - 1u].level;
+    return (uint8_t)(from + ((int32_t)pSteps[i].level - from) * (int32_t)in / (int32_t)ramp);
+}
+
+static uint32_t s_failed;
+
+/* Every millisecond of the ultrasound program through the engine */
+static void SweepUs(uint32_t *pApplies)
+{
+    Program_Target_t target;
+    Program_Result_EnumDef result;
+    uint8_t level, last = 0, step, lastStep = 0xFFu, progStep;
+    uint16_t remain;
+    uint32_t ms, endMs;
+    bool enter;
+
+    SIM_CHECK(SIM_FW(App_Program_Start)(PROTOCOL_MODULE_ULTRASOUND) == 8000u, "start: program length");
+    for (ms = 0; ms < 8000u; ms++) {
+        memset(&target, 0, sizeof(target));
+        result = SIM_FW(App_Program_Process)(PROTOCOL_MODULE_ULTRASOUND, ms, &target);
+        level = Expect(s_us, US_STEPS, US_LEVEL_MIN, ms, &step, &endMs);
+        enter = step != lastStep;
+        SIM_FW(App_Program_GetProgress)(PROTOCOL_MODULE_ULTRASOUND, &progStep, &remain);
+        if (result != ((enter || level != last) ? E_PROGRAM_APPLY : E_PROGRAM_HOLD) ||
+            (result == E_PROGRAM_APPLY && (target.level != level ||
+                                           target.frequency != (enter ? s_us[step].frequency : 0u))) ||
+            progStep != step + 1u || remain != (endMs - ms + 999u) / 1000u) {
+            if (s_failed++ < 5u)
+                SIM_CHECK(false, "at %u ms: result %d level %u freq %u step %u remain %u, expected level %u "
+                          "step %u remain %u", ms, result, target.level, target.frequency, progStep, remain,
+                          level, step + 1u, (endMs - ms + 999u) / 1000u);
+        }
+        if (result == E_PROGRAM_APPLY)
+            (*pApplies)++;
+        last = level;
+        lastStep = step;
+    }
+    SIM_CHECK(SIM_FW(App_Program_Process)(PROTOCOL_MODULE_ULTRASOUND, 8000u, &target) == E_PROGRAM_END,
+              "no end at 8000 ms");
+    SIM_FW(App_Program_Stop)(PROTOCOL_MODULE_ULTRASOUND);
+}
+
+/* Restart, first step, then one jump to ms: the target there */
+static Program_Target_t JumpUs(uint32_t ms, Program_Result_EnumDef *pResult)
+{
+    Program_Target_t target;
+
+    SIM_FW(App_Program_Start)(PROTOCOL_MODULE_ULTRASOUND);
+    SIM_FW(App_Program_Process)(PROTOCOL_MODULE_ULTRASOUND, 0u, &target);
+    memset(&target, 0, sizeof(target));
+    *pResult = SIM_FW(App_Program_Process)(PROTOCOL_MODULE_ULTRASOUND, ms, &target);
+    return target;
+}
+
+/* Returns the number of uploads tried */
+static uint8_t RejectUs(void)
+{
+    static const struct {
+        const char *pWhat;
+        Program_Step_t step;
+        uint8_t count;
+        uint8_t len;
+        uint8_t result;
+    } s_bad[] = {
+        { "length short of count", { 2u, 1000u, 3u, 0u },    2u,  1u + PROGRAM_STEP_LEN, CONFIG_RESULT_FAIL },
+        { "count over max",        { 1u, 1000u, 3u, 0u },    PROGRAM_STEP_MAX + 1u, 0u,  CONFIG_RESULT_FAIL },
+        { "level 0",               { 2u, 1000u, 0u, 0u },    1u,  0u, CONFIG_RESULT_OVER_LIMIT },
+        { "level over max",        { 2u, 1000u, WORK_LEVEL_MAX + 1u, 0u }, 1u, 0u, CONFIG_RESULT_OVER_LIMIT },
+        { "frequency under min",   { 2u, 699u,  3u, 0u },    1u,  0u, CONFIG_RESULT_OVER_LIMIT },
+        { "frequency over max",    { 2u, 1401u, 3u, 0u },    1u,  0u, CONFIG_RESULT_OVER_LIMIT },
+        { "ramp over duration",    { 2u, 1000u, 3u, 3u },    1u,  0u, CONFIG_RESULT_OVER_LIMIT },
+        { "duration 0",            { 0u, 1000u, 3u, 0u },    1u,  0u, CONFIG_RESULT_OVER_LIMIT },
+        { "total over max",        { PROGRAM_TIME_MAX_S / 2u + 1u, 1000u, 3u, 0u }, 2u, 0u,
+          CONFIG_RESULT_OVER_LIMIT },
+    };
+    Program_Step_t steps[PROGRAM_STEP_MAX + 1u];
+    uint8_t reply[8] = { 0xFFu, 0xFFu };
+    uint8_t i, j, result, count;
+    uint16_t totalS;
+
+    for (i = 0; i < sizeof(s_bad) / sizeof(s_bad[0]); i++) {
+        for (j = 0; j <= PROGRAM_STEP_MAX; j++)
+            steps[j] = s_bad[i].step;
+        result = Upload(PROTOCOL_MODULE_ULTRASOUND, steps, s_bad[i].count, s_bad[i].len, &count, &totalS);
+        SIM_CHECK(result == s_bad[i].result && count == 0u && totalS == 0u, "%s: result %u count %u total %u, "
+                  "expected result %u", s_bad[i].pWhat, result, count, totalS, s_bad[i].result);
+    }
+    /* No data at all, not even the count */
+    SIM_CHECK(Request(PROTOCOL_MODULE_ULTRASOUND, PROTOCOL_CMD_SET_PROGRAM, reply, 0u, reply) == 4 &&
+              reply[0] == CONFIG_RESULT_FAIL && reply[1] == 0u, "empty SET_PROGRAM: result %u count %u", reply[0],
+              reply[1]);
+    /* Heat takes no frequency */
+    steps[0] = (Program_Step_t){ 2u, 1u, 20u, 0u };
+    result = Upload(PROTOCOL_MODULE_HEAT, steps, 1u, 0u, &count, &totalS);
+    SIM_CHECK(result == CONFIG_RESULT_OVER_LIMIT, "heat step with a frequency: result %u", result);
+    SIM_CHECK(SIM_FW(App_Program_IsArmed)(PROTOCOL_MODULE_ULTRASOUND) &&
+              SIM_FW(App_Program_Start)(PROTOCOL_MODULE_ULTRASOUND) == 8000u,
+              "loaded program changed by rejected uploads");
+    SIM_FW(App_Program_Stop)(PROTOCOL_MODULE_ULTRASOUND);
+    return (uint8_t)(sizeof(s_bad) / sizeof(s_bad[0]) + 2u);
+}
+
+/* Power-on to the idle point: no head, foot down, SW parameters cached */
+static void Idle(void)
+{
+    SW_TreatParams_t params = { 420u, 100u, 3000u, 0u, 3000u, 0u, 0u };
+
+    memset(&s_cap, 0, sizeof(s_cap));
+    s_cap.v = SUPPLY_MV;
+    Sim_Pin_Drive('C', 10, 1);
+    Sim_Pin_Drive('C', 11, 1);
+    Sim_Pin_Drive('C', 12, 1);
+    Sim_Pin_Drive('C', 14, 0);
+    Sim_Test_Reboot(E_SIM_RESET_POWER);
+    Sim_Adc_SetSource(ESW_U_IN, EswU, NULL);
+    Sim_Adc_SetMv(ESW_I_IN, 100u);
+    Sim_Adc_SetMv(HAND_NTC_IN, 300u);
+    Sim_Test_Run(300);
+    SIM_CHECK(SIM_FW(App_Memory_SaveSWParams)(&params), "SW parameters not saved");
+    Sim_Test_Run(300);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t start[5] = { WORK_STATE_START, (uint8_t)SW_WORK_POINT_MAX, (uint8_t)(SW_WORK_POINT_MAX >> 8), 0u, 0u };
+    const SW_GetStatus_Reply_t *pStatus;
+    Program_Result_EnumDef result;
+    Program_Target_t target;
+    uint8_t reply[8];
+    uint8_t count, level, levelBack, step, stepBack, lastStep = 0, lastLevel = 0, seenSteps = 0, busy, rejects;
+    uint16_t totalS;
+    uint32_t applies = 0, levelChanges = 0, endMs, endBack, ms, e, lag = 0, lagMax = 0, badStatus = 0, totalMs;
+    bool uploaded = false;
+
+    Sim_Test_Init(argc, argv);
+    Idle();
+
+    /* Ultrasound program: upload, every millisecond, jumps, rejects */
+    SIM_CHECK(Upload(PROTOCOL_MODULE_ULTRASOUND, s_us, US_STEPS, 0u, &count, &totalS) == CONFIG_RESULT_SUCCESS &&
+              count == US_STEPS && totalS == 8u, "upload: %u steps, %u s", count, totalS);
+    SIM_CHECK(SIM_FW(App_Program_IsArmed)(PROTOCOL_MODULE_ULTRASOUND) &&
+              !SIM_FW(App_Program_IsArmed)(PROTOCOL_MODULE_SHOCKWAVE), "program armed for the wrong module");
+    SIM_CHECK(SIM_FW(App_Program_Process)(PROTOCOL_MODULE_ULTRASOUND, 0u, &target) == E_PROGRAM_HOLD,
+              "program ran before start");
+    SweepUs(&applies);
+
+    /* Over step 2 (no frequency) into step 3: its frequency and level */
+    target = JumpUs(5500u, &result);
+    SIM_CHECK(result == E_PROGRAM_APPLY && target.level == 5u && target.frequency == 1200u,
+              "jump into step 3: result %d level %u freq %u", result, target.level, target.frequency);
+    SIM_FW(App_Program_Stop)(PROTOCOL_MODULE_ULTRASOUND);
+    /* Over steps 2 and 3 into step 4 (no frequency): step 3's carried, level halfway down its ramp */
+    target = JumpUs(6500u, &result);
+    SIM_FW(App_Program_GetProgress)(PROTOCOL_MODULE_ULTRASOUND, &step, &totalS);
+    SIM_CHECK(result == E_PROGRAM_APPLY && target.level == 4u && target.frequency == 1200u,
+              "jump into step 4: result %d level %u freq %u", result, target.level, target.frequency);
+    SIM_CHECK(step == 4u && totalS == 2u, "jump into step 4: progress step %u remain %u s", step, totalS);
+    SIM_FW(App_Program_Stop)(PROTOCOL_MODULE_ULTRASOUND);
+    rejects = RejectUs();
+    SIM_CHECK(Upload(PROTOCOL_MODULE_ULTRASOUND, s_us, 0u, 0u, &count, &totalS) == CONFIG_RESULT_SUCCESS &&
+              !SIM_FW(App_Program_IsArmed)(PROTOCOL_MODULE_ULTRASOUND), "0 steps did not clear the program");
+
+    /* Shock wave program on virtual time: status every millisecond */
+    SIM_CHECK(Upload(PROTOCOL_MODULE_SHOCKWAVE, s_sw, SW_STEPS, 0u, &count, &totalS) == CONFIG_RESULT_SUCCESS &&
+              count == SW_STEPS && totalS == 4u, "SW upload: %u steps, %u s", count, totalS);
+    Sim_Pin_Drive('C', 12, 0);
+    Sim_Test_Run(500);
+    Sim_Pin_Drive('C', 14, 1);
+    Sim_Test_Run(100);
+    pStatus = &SIM_FW(App_Comm_GetSWTransData)()->TxStatus;
+    totalMs = SIM_FW(App_Session_GetModeTotalMs)(E_TREATMGR_STATE_SHOCK_WAVE);
+    Sim_Pin_Watch(BuzzerWatch, NULL);
+    s_buzzer.armed = true;
+    Request(PROTOCOL_MODULE_SHOCKWAVE, PROTOCOL_CMD_SET_WORK_STATE, start, sizeof(start), reply);
+    for (ms = 0; ms < 6000u && s_buzzer.offAt == 0u; ms++) {
+        Sim_Test_Run(1);
+        if (s_buzzer.onAt == 0u)
+            continue;
+        /* Status of the last pass: delivered time from a pass back up to now */
+        e = (uint32_t)((Sim_Now() - s_buzzer.onAt) / SIM_MS(1));
+        if (e < PASS_MS || e >= SW_TOTAL_MS)
+            continue;
+        level = Expect(s_sw, SW_STEPS, 1u, e, &step, &endMs);
+        levelBack = Expect(s_sw, SW_STEPS, 1u, e - PASS_MS, &stepBack, &endBack);
+        if (pStatus->program_step != lastStep) {
+            lag = e - (endMs - s_sw[step].duration_s * 1000u);
+            lagMax = (pStatus->program_step > 1u && lag > lagMax) ? lag : lagMax;
+            SIM_CHECK(pStatus->program_step == step + 1u && (s_sw[step].frequency == 0u ||
+                                                             pStatus->frequency == s_sw[step].frequency),
+                      "at %u ms: step %u at frequency %u published, step %u expected", e, pStatus->program_step,
+                      pStatus->frequency, step + 1u);
+            seenSteps++;
+            lastStep = pStatus->program_step;
+        }
+        if (pStatus->program_step != step + 1u && pStatus->program_step != stepBack + 1u)
+            badStatus++;
+        if ((pStatus->work_level < level || pStatus->work_level > levelBack) &&
+            (pStatus->work_level > level || pStatus->work_level < levelBack))
+            badStatus++;
+        if (pStatus->step_remain != (endMs - e + 999u) / 1000u && pStatus->step_remain != (endBack - e + PASS_MS +
+                                                                                          999u) / 1000u)
+            badStatus++;
+        levelChanges += (pStatus->work_level != lastLevel) ? 1u : 0u;
+        lastLevel = pStatus->work_level;
+        if (e >= 1500u && !uploaded) {
+            busy = Upload(PROTOCOL_MODULE_SHOCKWAVE, s_sw, SW_STEPS, 0u, &count, &totalS);
+            SIM_CHECK(busy == CONFIG_RESULT_FAIL && count == 0u, "upload while running: result %u", busy);
+            uploaded = true;
+        }
+    }
+    Sim_Test_Run(3u * PASS_MS);
+    totalMs = SIM_FW(App_Session_GetModeTotalMs)(E_TREATMGR_STATE_SHOCK_WAVE) - totalMs;
+    lag = s_buzzer.offAt != 0u ? (uint32_t)((s_buzzer.offAt - s_buzzer.onAt) / SIM_MS(1)) : 0u;
+    SIM_CHECK(s_buzzer.onAt != 0u, "SW program never started");
+    SIM_CHECK(seenSteps == SW_STEPS && lastStep == SW_STEPS, "%u of %u steps seen", seenSteps, (unsigned)SW_STEPS);
+    SIM_CHECK(badStatus == 0u, "%u published steps, levels or remaining times off the program", badStatus);
+    SIM_CHECK(lagMax <= PASS_MS, "step boundary %u ms late", lagMax);
+    SIM_CHECK(lag >= SW_TOTAL_MS && lag <= SW_TOTAL_MS + PASS_MS && totalMs >= SW_TOTAL_MS &&
+              totalMs <= SW_TOTAL_MS + PASS_MS, "output stopped %u ms after start, %u ms delivered, program %u ms",
+              lag, totalMs, SW_TOTAL_MS);
+    SIM_CHECK(pStatus->work_state == 0u && pStatus->program_step == 0u &&
+              SIM_FW(App_Program_IsArmed)(PROTOCOL_MODULE_SHOCKWAVE), "after the end: state %u step %u, program "
+              "kept %d", pStatus->work_state, pStatus->program_step, SIM_FW(App_Program_IsArmed)(PROTOCOL_MODULE_SHOCKWAVE));
+
+    printf("program: US %u steps over 8000 ms: %u applies, boundaries and ramps exact to the ms, "
+           "skipped-step frequency carried, %u bad uploads rejected\n", (unsigned)US_STEPS, applies, rejects);
+    printf("program: SW %u steps on virtual time: %u level changes published, boundaries at most %u ms late, "
+           "output stopped %u ms after start (%u ms delivered); one %u-byte upload instead of %u host commands\n",
+           (unsigned)SW_STEPS, levelChanges, lagMax, lag, totalMs, 1u + (unsigned)SW_STEPS * PROGRAM_STEP_LEN,
+           levelChanges);
+    return Sim_Test_Done();
+}
@@ -0,0 +1,227 @@
+/************************************************************************************
+ * @file     : rfdrive_test.c
+ * @brief    : Host test - RF complementary drive, SI5351 CLK1 into TIM1 ETR (drv_si5351, bsp_tim)
+ * @details  : Drv_SI5351_PlanRf over 600 .. 1500 kHz x 0 .. 1000 ns, decoded here from the
+ *             register values as the parts would: PLL B parameters to the VCO, CLK1 = VCO /
+ *             msDiv must be SI5351_RF_ETR_TICKS x the clamped frequency exactly, VCO in
+ *             range, divider even; BDTR.DTG (RM0008 encoding, tDTS = 1/72 MHz) at least the
+ *             clamped request and at most a quarter period. Then with the test as the CPU,
+ *             Drv_SI5351_SetComplementaryPWM on the bus: TIM1 ARR/CCR1/BDTR/CCER/SMCR and
+ *             the CLK1 frequency the SI5351 model puts out, retunes inside the PLL range
+ *             without a PLL reset or a bridge stop, stop to safe idle, and a trip (TIM1
+ *             break) that a retune must not undo.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_si5351.h"
+#include "bsp_i2c.h"
+#include "bsp_gpio.h"
+#include "bsp_tim.h"
+
+#define TIM1_SMCR       0x40012C08u
+#define TIM1_SR         0x40012C10u
+#define TIM1_CCMR1      0x40012C18u
+#define TIM1_CCER       0x40012C20u
+#define TIM1_ARR        0x40012C2Cu
+#define TIM1_CCR1       0x40012C34u
+#define TIM1_BDTR       0x40012C44u
+
+#define BDTR_MOE        (1u << 15)
+#define BDTR_OSSI       (1u << 10)
+#define BDTR_BKE        (1u << 12)
+#define SMCR_ECE        (1u << 14)
+#define SR_BIF          (1u << 7)
+#define CCER_CH1_PAIR   0x000Fu         /* CC1E, CC1P, CC1NE, CC1NP */
+#define CCER_CH1_ON     0x0005u         /* both enabled, active high */
+#define CCMR1_OC1_PWM1  (6u << 4)
+
+#define DTS_MHZ         72u
+
+/* RM0008 BDTR.DTG: dead time in tDTS ticks */
+static uint32_t DtgTicks(uint8_t dtg)
+{
+    if ((dtg & 0x80u) == 0u)
+        return dtg;
+    if ((dtg & 0xC0u) == 0x80u)
+        return (64u + (dtg & 0x3Fu)) * 2u;
+    if ((dtg & 0xE0u) == 0xC0u)
+        return (32u + (dtg & 0x1Fu)) * 8u;
+    return (32u + (dtg & 0x1Fu)) * 16u;
+}
+
+/* AN619 PLL block: VCO = XTAL x (P1 + 512 + P2 / P3) / 128 */
+static double PllHz(const uint8_t *r)
+{
+    uint32_t p3 = ((uint32_t)(r[5] & 0xF0u) << 12) | ((uint32_t)r[0] << 8) | r[1];
+    uint32_t p1 = ((uint32_t)(r[2] & 0x03u) << 16) | ((uint32_t)r[3] << 8) | r[4];
+    uint32_t p2 = ((uint32_t)(r[5] & 0x0Fu) << 16) | ((uint32_t)r[6] << 8) | r[7];
+
+    return (double)SI5351_XTAL_HZ * ((double)p1 + 512.0 + (double)p2 / (double)p3) / 128.0;
+}
+
+static uint16_t Clamp(uint16_t v, uint16_t lo, uint16_t hi)
+{
+    return v < lo ? lo : (v > hi ? hi : v);
+}
+
+/* Every plan over the range: register values decoded independently of the driver */
+static void Plans(void)
+{
+    SI5351_RfPlan_t plan;
+    uint16_t khz, ns, fKhz, want;
+    uint32_t ticks, quarter, plans = 0, capped = 0, dtgMax = 0, divMin = 255, divMax = 0;
+    double vco, clk;
+
+    for (khz = 600; khz <= 1500; khz++) {
+        for (ns = 0; ns <= 1000; ns += 5) {
+            SIM_FW(Drv_SI5351_PlanRf)(khz, ns, 0, &plan);
+            fKhz = Clamp(khz, SI5351_RF_FREQ_MIN_KHZ, SI5351_RF_FREQ_MAX_KHZ);
+            want = ns < SI5351_RF_DEADTIME_MIN_NS ? SI5351_RF_DEADTIME_MIN_NS : ns;
+            vco = PllHz(plan.pllReg);
+            clk = vco / plan.msDiv;
+            ticks = DtgTicks(plan.dtg);
+            quarter = DTS_MHZ * 1000u / (4u * fKhz);
+            plans++;
+
+            SIM_CHECK(plan.freqKHz == fKhz && plan.period == SI5351_RF_ETR_TICKS &&
+                      plan.pulse == SI5351_RF_ETR_TICKS / 2u,
+                      "%u kHz: plan %u kHz, period %u, pulse %u", khz, plan.freqKHz, plan.period, plan.pulse);
+            SIM_CHECK(vco == (double)plan.pllHz && vco >= SI5351_PLL_MIN_HZ && vco <= SI5351_PLL_MAX_HZ,
+                      "%u kHz: VCO %.1f Hz decoded, plan %u Hz", khz, vco, plan.pllHz);
+            SIM_CHECK(plan.msDiv % 2u == 0u && plan.msDiv >= 8u && clk == (double)fKhz * 1000.0 * SI5351_RF_ETR_TICKS,
+                      "%u kHz: CLK1 %.3f Hz with divider %u", khz, clk, plan.msDiv);
+            SIM_CHECK(ticks * 1000u / DTS_MHZ == plan.deadTimeNs, "%u kHz %u ns: DTG 0x%02X is %u ticks, plan %u ns",
+                      khz, ns, plan.dtg, ticks, plan.deadTimeNs);
+            SIM_CHECK(ticks <= quarter, "%u kHz %u ns: %u ticks over a quarter period", khz, ns, ticks);
+            SIM_CHECK(ticks * 1000u >= (uint32_t)want * DTS_MHZ || ticks == quarter,
+                      "%u kHz %u ns: %u ticks under the request, quarter period %u", khz, ns, ticks, quarter);
+            capped += (uint32_t)want * DTS_MHZ > ticks * 1000u ? 1u : 0u;
+            dtgMax = ticks > dtgMax ? ticks : dtgMax;
+            divMin = plan.msDiv < divMin ? plan.msDiv : divMin;
+            divMax = plan.msDiv > divMax ? plan.msDiv : divMax;
+        }
+    }
+    printf("rfdrive: %u plans 600..1500 kHz x 0..1000 ns: CLK1 exactly %u x f, VCO 600..900 MHz, dividers "
+           "%u..%u even; DTG at least the request (min %u ns) and at most T/4, %u capped at exactly T/4, "
+           "up to %u ticks\n", plans, SI5351_RF_ETR_TICKS, divMin, divMax, SI5351_RF_DEADTIME_MIN_NS, capped, dtgMax);
+}
+
+/* TIM1 and CLK1 as the driver left them for the plan in force */
+static void CheckDrive(const char *pWhat)
+{
+    const SI5351_RfPlan_t *pPlan = SIM_FW(Drv_SI5351_GetRfPlan)();
+    uint32_t bdtr = *Sim_Reg(TIM1_BDTR);
+
+    SIM_CHECK(pPlan != NULL, "%s: no plan in force", pWhat);
+    if (pPlan == NULL)
+        return;
+    SIM_CHECK(*Sim_Reg(TIM1_ARR) == pPlan->period - 1u && *Sim_Reg(TIM1_CCR1) == pPlan->pulse,
+              "%s: ARR %u, CCR1 %u", pWhat, *Sim_Reg(TIM1_ARR), *Sim_Reg(TIM1_CCR1));
+    SIM_CHECK((bdtr & 0xFFu) == pPlan->dtg && (bdtr & BDTR_MOE) && (bdtr & BDTR_OSSI) && !(bdtr & BDTR_BKE),
+              "%s: BDTR 0x%04X, DTG wanted 0x%02X", pWhat, bdtr, pPlan->dtg);
+    SIM_CHECK((*Sim_Reg(TIM1_CCER) & CCER_CH1_PAIR) == CCER_CH1_ON && (*Sim_Reg(TIM1_CCMR1) & 0x70u) == CCMR1_OC1_PWM1,
+              "%s: CCER 0x%04X, CCMR1 0x%04X", pWhat, *Sim_Reg(TIM1_CCER), *Sim_Reg(TIM1_CCMR1));
+    SIM_CHECK(*Sim_Reg(TIM1_SMCR) & SMCR_ECE, "%s: TIM1 not on the ETR clock", pWhat);
+    SIM_CHECK(Sim_Si5351_GetHz(1) == (uint32_t)pPlan->freqKHz * 1000u * SI5351_RF_ETR_TICKS,
+              "%s: CLK1 %u Hz for %u kHz", pWhat, Sim_Si5351_GetHz(1), pPlan->freqKHz);
+    SIM_CHECK(Sim_Tim1_Running(), "%s: bridge not running", pWhat);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint16_t khz[] = { 700, 850, 1000, 1200, 1400 };
+    static const uint16_t ns[] = { 0, 50, 100, 250, 500, 1000 };
+    const SI5351_RfStats_t *pStats;
+    char what[48];
+    uint32_t writes, restarts;
+    unsigned f, d, soft = 0;
+    uint16_t k;
+
+    Sim_Test_Init(argc, argv);
+    Plans();
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks, BSP, SI5351 on I2C1 */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    SIM_FW(BSP_I2C1_Init)();
+    SIM_FW(Drv_SI5351_Init)();
+    SIM_CHECK(SIM_FW(Drv_SI5351_IsReady)(), "SI5351 init over I2C1 failed");
+    pStats = SIM_FW(Drv_SI5351_GetRfStats)();
+
+    /* Idle after boot: outputs off until the first start */
+    SIM_CHECK(!(*Sim_Reg(TIM1_BDTR) & BDTR_MOE) && !Sim_Tim1_Running(), "TIM1 outputs on after BSP_Init");
+
+    /* Every frequency x dead time from a stop: full restart */
+    for (f = 0; f < sizeof(khz) / sizeof(khz[0]); f++) {
+        for (d = 0; d < sizeof(ns) / sizeof(ns[0]); d++) {
+            SIM_FW(Drv_SI5351_StopComplementaryPWM)();
+            SIM_CHECK(SIM_FW(Drv_SI5351_SetComplementaryPWM)(khz[f], ns[d]), "%u kHz %u ns refused", khz[f], ns[d]);
+            Sim_RunFor(SIM_US(50));
+            snprintf(what, sizeof(what), "start %u kHz %u ns", khz[f], ns[d]);
+            CheckDrive(what);
+        }
+    }
+
+    /* Retunes from 1000 kHz: PLL B fraction and DTG only, never a stop */
+    SIM_FW(Drv_SI5351_StopComplementaryPWM)();
+    SIM_FW(Drv_SI5351_SetComplementaryPWM)(1000, 100);
+    Sim_RunFor(SIM_US(50));
+    restarts = pStats->restarts;
+    for (k = 1000; k <= 1200; k += 10) {
+        writes = Sim_Si5351_GetWrites();
+        SIM_CHECK(SIM_FW(Drv_SI5351_SetComplementaryPWM)(k, (uint16_t)(50u + (k % 7u) * 40u)), "retune %u refused", k);
+        SIM_CHECK(Sim_Tim1_Running(), "retune to %u kHz stopped the bridge", k);
+        SIM_CHECK(Sim_Si5351_GetWrites() - writes <= 8u, "retune to %u kHz: %u SI5351 registers written", k,
+                  Sim_Si5351_GetWrites() - writes);
+        Sim_RunFor(SIM_US(20));
+        snprintf(what, sizeof(what), "retune %u kHz", k);
+        CheckDrive(what);
+        soft++;
+    }
+    for (k = 1190; k >= 810; k -= 20) {
+        SIM_FW(Drv_SI5351_SetComplementaryPWM)(k, 100);
+        SIM_CHECK(Sim_Tim1_Running(), "retune to %u kHz stopped the bridge", k);
+        Sim_RunFor(SIM_US(20));
+        snprintf(what, sizeof(what), "retune %u kHz", k);
+        CheckDrive(what);
+        soft++;
+    }
+    SIM_CHECK(pStats->restarts == restarts, "%u restarts during in-range retunes", pStats->restarts - restarts);
+
+    /* Out of the PLL range: one restart */
+    SIM_FW(Drv_SI5351_SetComplementaryPWM)(1400, 100);
+    Sim_RunFor(SIM_MS(3));
+    CheckDrive("retune 1400 kHz");
+    SIM_CHECK(pStats->restarts == restarts + 1u, "1400 kHz from 810 kHz: %u restarts", pStats->restarts - restarts);
+    printf("rfdrive: %u starts checked on TIM1 and CLK1; %u retunes in the PLL range with the bridge running, "
+           "8 SI5351 registers each, no restart; out of range: one restart\n",
+           (unsigned)(sizeof(khz) / sizeof(khz[0]) * sizeof(ns) / sizeof(ns[0])), soft);
+
+    /* Stop: safe idle, CLK1 off */
+    SIM_FW(Drv_SI5351_StopComplementaryPWM)();
+    Sim_RunFor(SIM_US(20));
+    SIM_CHECK(!(*Sim_Reg(TIM1_BDTR) & BDTR_MOE) && (*Sim_Reg(TIM1_BDTR) & BDTR_OSSI) && !Sim_Tim1_Running(),
+              "stop: BDTR 0x%04X", *Sim_Reg(TIM1_BDTR));
+    SIM_CHECK(Sim_Si5351_GetHz(1) == 0u && SIM_FW(Drv_SI5351_GetRfPlan)() == NULL, "stop: CLK1 at %u Hz",
+              Sim_Si5351_GetHz(1));
+
+    /* Trip while driving: break latched, a retune must not bring MOE back */
+    SIM_FW(Drv_SI5351_SetComplementaryPWM)(1000, 100);
+    Sim_RunFor(SIM_MS(3));
+    SIM_FW(BSP_TIM_EmergencyOff)();
+    Sim_RunFor(SIM_US(5));
+    SIM_CHECK(!(*Sim_Reg(TIM1_BDTR) & BDTR_MOE) && (*Sim_Reg(TIM1_SR) & SR_BIF) && !Sim_Tim1_Running(),
+              "trip: BDTR 0x%04X, SR 0x%04X", *Sim_Reg(TIM1_BDTR), *Sim_Reg(TIM1_SR));
+    SIM_FW(Drv_SI5351_SetComplementaryPWM)(1010, 150);
+    SIM_FW(Drv_SI5351_SetComplementaryPWM)(1400, 150);
+    Sim_RunFor(SIM_MS(3));
+    SIM_CHECK(!(*Sim_Reg(TIM1_BDTR) & BDTR_MOE) && !Sim_Tim1_Running(), "trip: MOE back after a retune/restart");
+    SIM_FW(BSP_TIM_OutputsRestore)();
+    Sim_RunFor(SIM_US(20));
+    CheckDrive("restore after trip");
+    printf("rfdrive: stop idles CH1/CH1N low (MOE off, OSSI) with CLK1 off; a trip latches the break "
+           "through a retune and a restart until BSP_TIM_OutputsRestore\n");
+    return Sim_Test_Done();
+}
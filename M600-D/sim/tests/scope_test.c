@@ -0,0 +1,228 @@
+/************************************************************************************
+ * @file     : scope_test.c
+ * @brief    : Host test - RTT scope streaming (drv_scope)
+ * @details  : The selection is typed as a "scope" line into the command down-buffer, the
+ *             stream is read from RTT up-buffer 1 every millisecond and decoded. US_I
+ *             ramps 1 mV per ms, ESW_U, HP_PRE and HAND_NTC are held and then stepped:
+ *             every sample must match its source within 1 LSB (the ramp over the block
+ *             before the previous read up to the current one), DAC the supply code, seq must run without
+ *             gaps, nothing may be dropped and the rate must follow the divider. A window
+ *             is then profiled instruction by instruction (Sim_Profile): the cycles per
+ *             sample the firmware's DWT count gives must stay under 10 % of the time
+ *             between two blocks. Reported: rate, samples checked, cycles per sample.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_meter.h"
+#include "drv_scope.h"
+#include <string.h>
+
+#define US_I_IN             0u          /* ADC_IN0, PA0 */
+#define ESW_U_IN            8u          /* ADC_IN8, PB0 */
+#define HP_PRE_IN           12u         /* ADC_IN12, PC2 */
+#define HAND_NTC_IN         13u         /* ADC_IN13, PC3 */
+#define ADC_VREF_MV         3300u
+#define RAMP_MV0            500u
+#define STREAM_MS           200u
+#define DIV                 4u
+#define PROFILE_MS          10u
+#define BUDGET_MAX_PCT      10u
+
+/* Order of the command line below */
+enum { SEL_US_I, SEL_ESW_U, SEL_HP_PRE, SEL_NTC, SEL_DAC, SEL_NUM };
+
+static const uint16_t s_mvA[SEL_DAC] = { 0u, 1200u, 2000u, 300u };
+static const uint16_t s_mvB[SEL_DAC] = { 0u, 2900u, 700u, 1650u };
+
+static struct {
+    uint8_t buf[4096];
+    size_t len;
+    uint8_t count;
+    uint8_t div;
+    uint32_t periodNs;
+    uint32_t headers;
+    uint32_t samples;
+    uint32_t gaps;
+    uint32_t bad;
+    int32_t seq;
+    uint16_t last[SCOPE_SEL_MAX];
+} s_rx;
+
+static uint64_t s_t0;
+
+static uint32_t RampMv(uint64_t t)
+{
+    return RAMP_MV0 + (uint32_t)((t - s_t0) / SIM_MS(1));
+}
+
+static uint32_t UsI(uint64_t t, void *pCtx)
+{
+    (void)pCtx;
+    return RampMv(t);
+}
+
+static uint16_t Raw(uint32_t mv)
+{
+    mv = mv * 4096u / ADC_VREF_MV;
+    return (uint16_t)(mv > 4095u ? 4095u : mv);
+}
+
+static bool Near(uint16_t v, uint16_t lo, uint16_t hi)
+{
+    return v + 1u >= lo && v <= hi + 1u;
+}
+
+static void HoldMv(const uint16_t *pMv)
+{
+    Sim_Adc_SetMv(ESW_U_IN, pMv[SEL_ESW_U]);
+    Sim_Adc_SetMv(HP_PRE_IN, pMv[SEL_HP_PRE]);
+    Sim_Adc_SetMv(HAND_NTC_IN, pMv[SEL_NTC]);
+}
+
+static uint16_t Word(size_t i)
+{
+    return (uint16_t)(s_rx.buf[2u * i] | s_rx.buf[2u * i + 1u] << 8);
+}
+
+/*
+ * Decode what is there: header and sample records. Held sources are checked against pMv
+ * (NULL while a step may be in flight), the ramp against its value from one sample period
+ * before the previous read (tPrev) up to now.
+ */
+static void Drain(const uint16_t *pMv, uint64_t tPrev)
+{
+    size_t n, i = 0, words, rec;
+    uint16_t w, v;
+    uint8_t k;
+
+    n = Sim_Rtt_Read(SCOPE_RTT_CHANNEL, s_rx.buf + s_rx.len, sizeof(s_rx.buf) - s_rx.len);
+    s_rx.len += n;
+    words = s_rx.len / 2u;
+    while (i < words) {
+        w = Word(i);
+        if (w == SCOPE_HEADER_MAGIC) {
+            if (i + 2u > words || i + 4u + ((Word(i + 1u) & 0xFFu) + 1u) / 2u > words)
+                break;
+            s_rx.count = (uint8_t)Word(i + 1u);
+            s_rx.div = (uint8_t)(Word(i + 1u) >> 8);
+            s_rx.periodNs = Word(i + 2u) | (uint32_t)Word(i + 3u) << 16;
+            s_rx.headers++;
+            s_rx.seq = -1;
+            i += 4u + (s_rx.count + 1u) / 2u;
+            continue;
+        }
+        rec = 1u + s_rx.count;
+        if (s_rx.count == 0u || i + rec > words)
+            break;
+        if (s_rx.seq >= 0 && w != (uint16_t)((s_rx.seq + 1) & SCOPE_SEQ_MASK))
+            s_rx.gaps++;
+        s_rx.seq = w;
+        for (k = 0; k < s_rx.count; k++)
+            s_rx.last[k] = Word(i + 1u + k);
+        if (s_rx.count == SEL_NUM) {
+            v = s_rx.last[SEL_US_I];
+            if (!Near(v, Raw(RampMv(tPrev - s_rx.periodNs)), Raw(RampMv(Sim_Now()))) ||
+                s_rx.last[SEL_DAC] != Sim_Dac_Get())
+                s_rx.bad++;
+            for (k = SEL_ESW_U; pMv != NULL && k < SEL_DAC; k++) {
+                if (!Near(s_rx.last[k], Raw(pMv[k]), Raw(pMv[k])))
+                    s_rx.bad++;
+            }
+        }
+        s_rx.samples++;
+        i += rec;
+    }
+    memmove(s_rx.buf, s_rx.buf + 2u * i, s_rx.len - 2u * i);
+    s_rx.len -= 2u * i;
+}
+
+static void Stream(uint32_t ms, const uint16_t *pMv)
+{
+    uint64_t tPrev;
+
+    while (ms-- > 0u) {
+        tPrev = Sim_Now();
+        Sim_Test_Run(1);
+        Drain(pMv, tPrev);
+    }
+}
+
+static void Command(const char *pLine)
+{
+    Sim_Test_LogClear();
+    Sim_Rtt_Write(pLine, strlen(pLine));
+    Stream(20, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    const Scope_Stats_t *pStats;
+    Scope_Stats_t stats;
+    uint32_t samples, expect, budget, perSample, divSamples;
+    uint64_t insns;
+
+    Sim_Test_Init(argc, argv);
+    s_t0 = Sim_Now();
+    Sim_Adc_SetSource(US_I_IN, UsI, NULL);
+    HoldMv(s_mvA);
+    Sim_Test_Run(300);
+
+    /* Selection over the command down-buffer, stream against the sources */
+    Command("scope us_i esw_u hp_pre ntc dac\n");
+    SIM_CHECK(Sim_Test_Log("Scope: 5 sources every") != NULL, "scope command not taken");
+    SIM_CHECK(s_rx.headers == 1u && s_rx.count == SEL_NUM && s_rx.div == 1u, "header: %u seen, %u sources, div %u",
+              s_rx.headers, s_rx.count, s_rx.div);
+    SIM_CHECK(s_rx.periodNs == SIM_FW(Drv_Scope_GetPeriodNs)(), "header period %u ns, firmware %u", s_rx.periodNs,
+              SIM_FW(Drv_Scope_GetPeriodNs)());
+    samples = s_rx.samples;
+    Stream(STREAM_MS, s_mvA);
+    HoldMv(s_mvB);
+    Stream(2, NULL);
+    Stream(STREAM_MS, s_mvB);
+    samples = s_rx.samples - samples;
+    expect = (uint32_t)((2u * STREAM_MS + 2u) * 1000000ull / s_rx.periodNs);
+    pStats = SIM_FW(Drv_Scope_GetStats)();
+    SIM_CHECK(s_rx.bad == 0u, "%u sample values off their source", s_rx.bad);
+    SIM_CHECK(s_rx.gaps == 0u && pStats->dropped == 0u, "%u seq gaps, %u dropped", s_rx.gaps, pStats->dropped);
+    SIM_CHECK(samples + 2u >= expect && samples <= expect + 2u, "%u samples in %u ms, %u expected", samples,
+              2u * STREAM_MS + 2u, expect);
+    printf("scope: 5 sources every %u ns (%.2f kHz), %u samples checked, %u off, %u seq gaps, %u dropped\n",
+           s_rx.periodNs, 1e6 / s_rx.periodNs, samples, s_rx.bad, s_rx.gaps, pStats->dropped);
+
+    /* Divider: a new header, a quarter of the rate */
+    Command("scope esw_u div 4\n");
+    SIM_CHECK(s_rx.headers == 2u && s_rx.count == 1u && s_rx.div == DIV, "div header: %u seen, %u sources, div %u",
+              s_rx.headers, s_rx.count, s_rx.div);
+    divSamples = s_rx.samples;
+    Stream(STREAM_MS, s_mvB);
+    divSamples = s_rx.samples - divSamples;
+    expect = (uint32_t)(STREAM_MS * 1000000ull / s_rx.periodNs);
+    SIM_CHECK(s_rx.last[0] == Raw(s_mvB[SEL_ESW_U]) || s_rx.last[0] + 1u == Raw(s_mvB[SEL_ESW_U]),
+              "ESW_U %u, %u expected", s_rx.last[0], Raw(s_mvB[SEL_ESW_U]));
+    SIM_CHECK(divSamples + 1u >= expect && divSamples <= expect + 1u && s_rx.gaps == 0u,
+              "div %u: %u samples in %u ms, %u expected, %u gaps", DIV, divSamples, STREAM_MS, expect, s_rx.gaps);
+
+    /* Cost of a sample: the firmware's own DWT count, every instruction a cycle from the selection on */
+    insns = Sim_Profile_GetInsns();
+    Sim_Profile(true);
+    Command("scope us_i esw_u hp_pre ntc dac\n");
+    Stream(PROFILE_MS, s_mvB);
+    Sim_Profile(false);
+    stats = *SIM_FW(Drv_Scope_GetStats)();
+    budget = SIM_FW(Drv_Meter_GetStats)()->budgetCycles;
+    perSample = stats.samples ? stats.cycles / stats.samples : 0u;
+    SIM_CHECK(stats.samples > 0u, "no samples in %u profiled ms", PROFILE_MS);
+    SIM_CHECK(stats.maxCycles > 0u && stats.maxCycles * 100u <= budget * BUDGET_MAX_PCT,
+              "%u cycles per sample worst, budget %u", stats.maxCycles, budget);
+    SIM_CHECK(s_rx.bad == 0u && s_rx.gaps == 0u, "profiled: %u off, %u gaps", s_rx.bad, s_rx.gaps);
+
+    /* Off stops the stream */
+    Command("scope off\n");
+    samples = s_rx.samples;
+    Stream(20, NULL);
+    SIM_CHECK(SIM_FW(Drv_Scope_GetCount)() == 0u && s_rx.samples == samples, "scope still on");
+    printf("scope: div %u gives %u samples in %u ms; 5 sources cost %u cycles per sample mean, %u worst, "
+           "budget %u per block (%.1f %%; %u samples, %llu instructions profiled)\n", DIV, divSamples, STREAM_MS,
+           perSample, stats.maxCycles, budget, stats.maxCycles * 100.0 / budget, stats.samples,
+           (unsigned long long)(Sim_Profile_GetInsns() - insns));
+    return Sim_Test_Done();
+}
@@ -0,0 +1,160 @@
+/************************************************************************************
+ * @file     : sessionclock_test.c
+ * @brief    : Host test - treatment session clock under loop overruns (app_session)
+ * @details  : The test is the CPU and plays a mode's main loop: BSP (SysTick) is set up
+ *             and a session is driven through App_Session_Start / Resume / Pause / Stop
+ *             with the 10 ms pass overrunning at random, from a microsecond up to a
+ *             second, with the foot switch pausing and resuming the output. Every pass,
+ *             energised and paused time must match the virtual clock to within one tick
+ *             (no error carried over from earlier segments) and remaining time must be
+ *             the budget minus energised time; the session must expire on the first pass
+ *             after the budget. One session runs across the 32-bit tick wrap. Reported:
+ *             error at the end and what the old per-pass countdown (RemainTime -=
+ *             TREAT_TASK_TIME) gave for the same passes.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_session.h"
+#include "bsp_delay.h"
+#include "bsp_gpio.h"
+
+#define PASS_US             10000u      /* nominal loop pass */
+#define BUDGET_S            60u
+#define SESSIONS            4u
+#define TICK_NS             (SIM_MS(1) + SIM_US(5))     /* one tick, and the reads are a few us apart */
+
+static uint32_t s_seed = 1618u;
+static App_Session_t s_session;
+
+static uint32_t Rand(uint32_t lo, uint32_t hi)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return lo + (s_seed >> 8) % (hi - lo + 1u);
+}
+
+/* One loop pass: nominal, or overrun by up to 40 ms, or now and then by up to a second */
+static uint64_t PassNs(void)
+{
+    uint32_t r = Rand(0, 99);
+
+    if (r < 50u)
+        return SIM_US(PASS_US);
+    if (r < 95u)
+        return SIM_US(PASS_US + Rand(1, 40000));
+    return SIM_US(PASS_US + Rand(40000, 1000000));
+}
+
+static uint64_t Diff(uint64_t a, uint64_t b)
+{
+    return a > b ? a - b : b - a;
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t refOn, refOff, segStart, t0, pass;
+    uint64_t maxErr = 0, endErr = 0, overrunNs = 0, lateMax = 0;
+    uint32_t energised, paused, remain, oldRemain, oldPasses, modeTotal0;
+    unsigned s, passes, totalPasses = 0, overruns = 0, pauses = 0;
+    double oldEndS = 0.0;
+    bool on;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks, BSP, SysTick at 1 ms */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    Sim_RunFor(SIM_MS(5));
+
+    for (s = 0; s < SESSIONS; s++) {
+        /* The last session starts 100 s before the tick wraps */
+        if (s == SESSIONS - 1u)
+            SIM_FW(BSP_SysTick_Advance)(0xFFFFFFFFu - SIM_FW(BSP_GetTick_ms)() - 100000u);
+        modeTotal0 = SIM_FW(App_Session_GetModeTotalMs)(E_TREATMGR_STATE_ULTRASOUND);
+
+        /* SetWorkParams, then WORKING on the next pass; 0.3 ms into a tick */
+        Sim_RunFor(SIM_US(300));
+        SIM_FW(App_Session_Start)(&s_session, E_TREATMGR_STATE_ULTRASOUND, BUDGET_S);
+        t0 = Sim_Now();
+        segStart = t0;
+        refOn = 0;
+        refOff = 0;
+        on = false;
+        oldRemain = BUDGET_S;
+        oldPasses = 0;
+        for (passes = 0; ; passes++) {
+            pass = PassNs();
+            overruns += pass > SIM_US(PASS_US) ? 1u : 0u;
+            overrunNs += pass - SIM_US(PASS_US);
+            Sim_RunFor(pass);
+
+            /* Where the mode reads the clock: remaining time first, as Process does */
+            remain = SIM_FW(App_Session_GetRemainMs)(&s_session);
+            energised = SIM_FW(App_Session_GetEnergisedMs)(&s_session);
+            paused = SIM_FW(App_Session_GetPausedMs)(&s_session);
+            if (on)
+                refOn += Sim_Now() - segStart;
+            else
+                refOff += Sim_Now() - segStart;
+            segStart = Sim_Now();
+            maxErr = Diff((uint64_t)energised * 1000000u, refOn) > maxErr ?
+                     Diff((uint64_t)energised * 1000000u, refOn) : maxErr;
+            maxErr = Diff((uint64_t)paused * 1000000u, refOff) > maxErr ?
+                     Diff((uint64_t)paused * 1000000u, refOff) : maxErr;
+            SIM_CHECK(Diff((uint64_t)energised * 1000000u, refOn) <= TICK_NS &&
+                      Diff((uint64_t)paused * 1000000u, refOff) <= TICK_NS,
+                      "session %u pass %u: energised %u ms / paused %u ms, clock %.3f / %.3f ms", s, passes,
+                      energised, paused, (double)refOn / 1e6, (double)refOff / 1e6);
+            SIM_CHECK(remain == (energised >= BUDGET_S * 1000u ? 0u : BUDGET_S * 1000u - energised),
+                      "session %u pass %u: remaining %u ms, energised %u ms", s, passes, remain, energised);
+
+            /* The old countdown, on the same passes */
+            if (on && oldRemain != 0u) {
+                oldRemain = oldRemain >= TREAT_TASK_TIME ? oldRemain - TREAT_TASK_TIME : 0u;
+                if (oldRemain == 0u)
+                    oldEndS = (double)refOn / 1e9;
+                oldPasses++;
+            }
+
+            if (remain == 0u) {
+                SIM_CHECK(refOn + TICK_NS >= SIM_S(BUDGET_S), "session %u: expired at %.3f s energised", s,
+                          (double)refOn / 1e9);
+                lateMax = refOn > SIM_S(BUDGET_S) + lateMax ? refOn - SIM_S(BUDGET_S) : lateMax;
+                break;
+            }
+            SIM_CHECK(refOn < SIM_S(BUDGET_S) + TICK_NS, "session %u: %.3f s energised, not expired", s,
+                      (double)refOn / 1e9);
+
+            /* Foot switch: 5 % of passes flip the output */
+            if (Rand(0, 99) < 5u) {
+                on = !on;
+                pauses += on ? 0u : 1u;
+                if (on)
+                    SIM_FW(App_Session_Resume)(&s_session);
+                else
+                    SIM_FW(App_Session_Pause)(&s_session);
+            }
+        }
+        SIM_FW(App_Session_Stop)(&s_session);
+        energised = SIM_FW(App_Session_GetEnergisedMs)(&s_session);
+        endErr = Diff((uint64_t)energised * 1000000u, refOn) > endErr ?
+                 Diff((uint64_t)energised * 1000000u, refOn) : endErr;
+        SIM_CHECK(SIM_FW(App_Session_GetModeTotalMs)(E_TREATMGR_STATE_ULTRASOUND) - modeTotal0 == energised,
+                  "session %u: mode total grew by %u ms, session %u ms", s,
+                  SIM_FW(App_Session_GetModeTotalMs)(E_TREATMGR_STATE_ULTRASOUND) - modeTotal0, energised);
+        SIM_CHECK(SIM_FW(App_Session_GetDeliveredSec)(&s_session) == energised / 1000u,
+                  "session %u: delivered %u s", s, SIM_FW(App_Session_GetDeliveredSec)(&s_session));
+        totalPasses += passes + 1u;
+        printf("sessionclock: session %u%s: %u passes over %.1f s, energised %u ms vs %.3f ms on the clock, "
+               "old countdown at 0 after %u passes, %.2f s energised\n", s,
+               s == SESSIONS - 1u ? " (across the tick wrap)" : "", passes + 1u, (double)(Sim_Now() - t0) / 1e9,
+               energised, (double)refOn / 1e6, oldPasses, oldEndS);
+    }
+    SIM_CHECK(totalPasses >= 1000u && overruns >= 1000u, "only %u overruns in %u passes", overruns, totalPasses);
+    printf("sessionclock: %u passes, %u overrun (%.1f s of overrun in total), %u pauses: energised/paused "
+           "within %.3f ms of the clock on every pass, %.3f ms at the end; expiry %.1f ms after the budget at "
+           "most (one pass)\n", totalPasses, overruns, (double)overrunNs / 1e9, pauses, (double)maxErr / 1e6,
+           (double)endErr / 1e6, (double)lateMax / 1e6);
+    return Sim_Test_Done();
+}
@@ -0,0 +1,101 @@
+/************************************************************************************
+ * @file     : sim_test.c
+ * @brief    : Host tests - shared helpers on top of the simulator API
+ ***********************************************************************************/
+#define _GNU_SOURCE
+#include "sim_test.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define SIM_TEST_LOG_MAX    (1u << 20)
+
+static char s_log[SIM_TEST_LOG_MAX + 1u];
+static size_t s_logLen = 0;
+static unsigned s_fails = 0;
+static const char *s_pName = "test";
+static const char *s_pBoot = NULL;
+
+void Sim_Test_Init(int argc, char **argv)
+{
+    if (argc != 2 && argc != 3) {
+        fprintf(stderr, "usage: %s <m600_fw.so> [m600_boot.so]\n", argv[0]);
+        exit(2);
+    }
+    s_pBoot = argc == 3 ? argv[2] : NULL;
+    s_pName = strrchr(argv[0], '/') != NULL ? strrchr(argv[0], '/') + 1 : argv[0];
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    Sim_Init(argv[1]);
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_Start();
+}
+
+const char *Sim_Test_BootImage(void)
+{
+    if (s_pBoot == NULL) {
+        fprintf(stderr, "%s: needs the bootloader image as second argument\n", s_pName);
+        exit(2);
+    }
+    return s_pBoot;
+}
+
+void Sim_Test_Reboot(Sim_ResetCause cause)
+{
+    Sim_Boot(cause);
+    Sim_Start();
+    Sim_Test_LogClear();
+}
+
+static void Sim_Test_Drain(void)
+{
+    static int s_verbose = -1;
+    char buf[512];
+    size_t n;
+
+    if (s_verbose < 0)
+        s_verbose = getenv("M600_SIM_VERBOSE") != NULL;
+    while ((n = Sim_Rtt_Read(0, buf, sizeof(buf))) != 0u) {
+        if (s_verbose)
+            fwrite(buf, 1, n, stdout);
+        if (s_logLen + n > SIM_TEST_LOG_MAX) {
+            memmove(s_log, s_log + SIM_TEST_LOG_MAX / 2u, SIM_TEST_LOG_MAX / 2u);
+            s_logLen -= SIM_TEST_LOG_MAX / 2u;
+        }
+        memcpy(s_log + s_logLen, buf, n);
+        s_logLen += n;
+        s_log[s_logLen] = '\0';
+    }
+}
+
+void Sim_Test_Run(double ms)
+{
+    uint64_t end = Sim_Now() + (uint64_t)(ms * 1e6);
+
+    while (Sim_Now() < end) {
+        Sim_RunFor(end - Sim_Now() < SIM_MS(1) ? end - Sim_Now() : SIM_MS(1));
+        Sim_Test_Drain();
+    }
+}
+
+const char *Sim_Test_Log(const char *pText)
+{
+    return memmem(s_log, s_logLen, pText, strlen(pText));
+}
+
+void Sim_Test_LogClear(void)
+{
+    Sim_Test_Drain();
+    s_logLen = 0;
+    s_log[0] = '\0';
+}
+
+void Sim_Test_Fail(void)
+{
+    s_fails++;
+}
+
+int Sim_Test_Done(void)
+{
+    printf("%s: %s (%u failed checks, %.3f s simulated)\n", s_pName, s_fails == 0u ? "PASS" : "FAIL",
+           s_fails, (double)Sim_Now() / 1e9);
+    return s_fails == 0u ? 0 : 1;
+}
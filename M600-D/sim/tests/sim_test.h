@@ -0,0 +1,41 @@
+/************************************************************************************
+ * @file     : sim_test.h
+ * @brief    : Host tests - shared helpers on top of the simulator API
+ * @details  : A test is an executable taking the firmware image and the bootloader
+ *             image as arguments (ctest passes m600_fw.so m600_boot.so); the firmware
+ *             runs alone unless the test boots through Sim_Test_BootImage(). SIM_CHECK reports file:line and counts the
+ *             failure; Sim_Test_Done() prints the verdict and gives the exit code.
+ *             RTT channel 0 is collected while running, M600_SIM_VERBOSE=1 echoes it.
+ ***********************************************************************************/
+#ifndef SIM_TEST_H
+#define SIM_TEST_H
+
+#include "sim.h"
+#include <stdio.h>
+
+#define SIM_CHECK(cond, ...)                                                    \
+    do {                                                                        \
+        if (!(cond)) {                                                          \
+            fprintf(stderr, "%s:%d: check failed: %s: ", __FILE__, __LINE__, #cond); \
+            fprintf(stderr, __VA_ARGS__);                                       \
+            fputc('\n', stderr);                                                \
+            Sim_Test_Fail();                                                    \
+        }                                                                       \
+    } while (0)
+
+/** Map the image from argv, power-on boot, main() started */
+void Sim_Test_Init(int argc, char **argv);
+/** Bootloader image from argv, for Sim_SetBootImage */
+const char *Sim_Test_BootImage(void);
+/** Power-on (or other) reboot of the same image, log cleared */
+void Sim_Test_Reboot(Sim_ResetCause cause);
+/** Run ms of virtual time in 1 ms slices, collecting RTT channel 0 */
+void Sim_Test_Run(double ms);
+/** Text logged since the last Sim_Test_LogClear(); NULL if not there */
+const char *Sim_Test_Log(const char *pText);
+void Sim_Test_LogClear(void);
+void Sim_Test_Fail(void);
+/** Verdict to stdout, exit code for main() */
+int Sim_Test_Done(void);
+
+#endif /* SIM_TEST_H */
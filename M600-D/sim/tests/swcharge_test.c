@@ -0,0 +1,323 @@
+/************************************************************************************
+ * @file     : swcharge_test.c
+ * @brief    : Host test - shock wave shot pacing by storage capacitor charge (app_shockwave)
+ * @details  : The firmware runs a shock wave treatment at requested frequency 16 against a
+ *             model of the storage capacitor on ESW_U (PB0, 10 mV per V): it charges
+ *             towards the supply with the charger's time constant and is dumped into the
+ *             head with 8 ms while PWM_ESW- (TIM4 CCR4) is on; ESW_U is read with +-5 mV of
+ *             noise. A shot counts as under-charged when the capacitor is below the level's
+ *             target fraction of full charge as ESW- opens. The old fixed interval is
+ *             replayed here on the same model, each PWM state held to the next 10 ms
+ *             TreatMgr pass as the firmware does: at frequency 16, and at the fastest
+ *             frequency level that never fires under-charged on the charger (the
+ *             conservative setting). For a 30 ms and a 45 ms charger at levels 1, 13 and
+ *             26 the governed firmware must fire no under-charged shot, at least as many
+ *             shots as the conservative fixed interval, and publish a max_rate that
+ *             matches the rate it reaches. With the supply sagging mid-run it must relearn
+ *             full charge and keep firing; with the charger stuck further down it must
+ *             hold fire, report a charge fault and resume once charge is back. Reported:
+ *             shots per minute, under-charged shots and rates, fixed and governed.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_comm.h"
+#include "app_memory.h"
+#include "app_shockwave.h"
+#include "app_treatmgr.h"
+#include <math.h>
+#include <string.h>
+
+#define ESW_U_IN            8u          /* ADC_IN8, PB0 */
+#define ESW_I_IN            9u          /* ADC_IN9, PB1 */
+#define HAND_NTC_IN         13u         /* ADC_IN13, PC3 */
+#define TIM4_CCR4           0x40000840u
+#define SUPPLY_MV           3250.0      /* 325 V */
+#define SAG_MV              3100.0      /* 310 V */
+#define STUCK_MV            3030.0      /* 303 V, still above the voltage alarm */
+#define DUMP_TAU_NS         SIM_MS(8)
+#define NOISE_MV            5u
+#define FREQ                16u
+#define RUN_S               30u
+
+typedef struct {
+    unsigned shots, under;
+    double hz;
+    double margin;              /* lowest voltage over target as ESW- opens, mV */
+} Result_t;
+
+/* Storage capacitor: voltage v at t, charging or being dumped from then on */
+static struct {
+    double v;
+    uint64_t t;
+    bool dump;
+    double supply;
+    double full;                /* shots are judged against this full charge */
+    uint64_t tauNs;
+    uint8_t level;
+    Result_t res;
+    uint64_t first, last;
+} s_cap;
+
+static const uint8_t s_levels[] = { 1u, 13u, 26u };
+static const unsigned s_taus[] = { 30u, 45u };
+static uint32_t s_seed = 1414u;
+
+static uint32_t Rand(uint32_t lo, uint32_t hi)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return lo + (s_seed >> 8) % (hi - lo + 1u);
+}
+
+/* Level's charge target as a fraction of full charge, % */
+static double TargetPct(uint8_t level)
+{
+    uint32_t l = level > 1u ? level : 1u;
+
+    return (double)(SW_CHARGE_READY_PCT_MIN + (SW_CHARGE_READY_PCT_MAX - SW_CHARGE_READY_PCT_MIN) *
+                    (l - 1u) / (SW_WORK_LEVEL_MAX - 1u));
+}
+
+/* A PWM state lasts until the first TreatMgr pass at least ms after it began */
+static uint32_t Passes(uint32_t ms)
+{
+    return (ms + TREAT_TASK_TIME - 1u) / TREAT_TASK_TIME * TREAT_TASK_TIME;
+}
+
+/* PWM_ESW- high time as App_Shockwave_CalculateESW_NHighTime gives it */
+static uint32_t DumpMs(uint8_t level)
+{
+    return (3000u + (level - 1u) * 280u + 500u) / 1000u;
+}
+
+static double CapAt(uint64_t t)
+{
+    double x = (double)(t - s_cap.t);
+
+    if (s_cap.dump)
+        return s_cap.v * exp(-x / (double)DUMP_TAU_NS);
+    return s_cap.supply + (s_cap.v - s_cap.supply) * exp(-x / (double)s_cap.tauNs);
+}
+
+static void CapReset(unsigned tauMs, uint8_t level, double supply)
+{
+    memset(&s_cap, 0, sizeof(s_cap));
+    s_cap.v = supply;
+    s_cap.supply = supply;
+    s_cap.full = supply;
+    s_cap.tauNs = SIM_MS(tauMs);
+    s_cap.level = level;
+    s_cap.res.margin = 1e9;
+}
+
+static void CapCount(void)
+{
+    memset(&s_cap.res, 0, sizeof(s_cap.res));
+    s_cap.res.margin = 1e9;
+}
+
+/* ESW- switched at t: a shot is judged by the charge it opens on */
+static void CapSwitch(uint64_t t, bool dump)
+{
+    double v = CapAt(t);
+    double target = s_cap.full * TargetPct(s_cap.level) / 100.0;
+
+    if (dump) {
+        s_cap.res.shots++;
+        s_cap.res.under += v < target ? 1u : 0u;
+        s_cap.res.margin = v - target < s_cap.res.margin ? v - target : s_cap.res.margin;
+        if (s_cap.res.shots == 1u)
+            s_cap.first = t;
+        s_cap.last = t;
+    }
+    s_cap.v = v;
+    s_cap.t = t;
+    s_cap.dump = dump;
+}
+
+static Result_t CapResult(void)
+{
+    Result_t res = s_cap.res;
+
+    res.hz = res.shots > 1u ? (res.shots - 1u) / ((double)(s_cap.last - s_cap.first) / 1e9) : 0.0;
+    return res;
+}
+
+/* ESW- as the firmware left it: every pass reads ESW_I and ESW_U right after the PWM step */
+static void Track(uint64_t t)
+{
+    bool dump = *Sim_Reg(TIM4_CCR4) != 0u;
+
+    if (t >= s_cap.t && dump != s_cap.dump)
+        CapSwitch(t, dump);
+}
+
+static uint32_t EswU(uint64_t t, void *pCtx)
+{
+    (void)pCtx;
+    Track(t);
+    return (uint32_t)(CapAt(t) + (double)Rand(0, 2u * NOISE_MV) - NOISE_MV + 0.5);
+}
+
+static uint32_t EswI(uint64_t t, void *pCtx)
+{
+    (void)pCtx;
+    Track(t);
+    return 100u;
+}
+
+/* The old fixed interval on the model, every state held to the next pass: ESW+ and the wait,
+ * then ESW- for the level's time, a new cycle once the frequency level's period is up */
+static Result_t Fixed(unsigned tauMs, uint8_t level, uint8_t freq)
+{
+    uint32_t lead = Passes(SW_PWM_ESW_P_HIGH_TIME_MS) + Passes(SW_PWM_ESW_P_WAIT_TIME_MS);
+    uint64_t t;
+
+    CapReset(tauMs, level, SUPPLY_MV);
+    for (t = 0; t < SIM_S(RUN_S); t += SIM_MS(Passes(1000u / freq))) {
+        CapSwitch(t + SIM_MS(lead), true);
+        CapSwitch(t + SIM_MS(lead + Passes(DumpMs(level))), false);
+    }
+    return CapResult();
+}
+
+static void SendFrame(uint8_t module, uint8_t cmd, const uint8_t *pData, uint8_t len)
+{
+    uint8_t frame[PROTOCOL_FRAME_MAX];
+
+    frame[0] = PROTOCOL_HEADER_0;
+    frame[1] = PROTOCOL_HEADER_1;
+    frame[2] = PROTOCOL_DIR_HOST_TO_DEV;
+    frame[3] = module;
+    frame[4] = cmd;
+    frame[5] = len;
+    memcpy(&frame[PROTOCOL_FRAME_HEAD_LEN], pData, len);
+    frame[PROTOCOL_FRAME_HEAD_LEN + len] = PROTOCOL_TAIL_0;
+    frame[PROTOCOL_FRAME_HEAD_LEN + len + 1u] = PROTOCOL_TAIL_1;
+    Sim_Uart_Send(1, frame, PROTOCOL_FRAME_HEAD_LEN + len + 2u);
+}
+
+/* Power-on, shock wave head in, foot down, start at the level and frequency 16 */
+static void Start(unsigned tauMs, uint8_t level)
+{
+    SW_TreatParams_t params = { 420u, 100u, 3000u, 0u, 3000u, 0u, 0u };
+    uint8_t start[5] = { WORK_STATE_START, (uint8_t)SW_WORK_POINT_MAX, (uint8_t)(SW_WORK_POINT_MAX >> 8), level, FREQ };
+
+    CapReset(tauMs, level, SUPPLY_MV);
+    Sim_Pin_Drive('C', 10, 1);
+    Sim_Pin_Drive('C', 11, 1);
+    Sim_Pin_Drive('C', 12, 1);
+    Sim_Pin_Drive('C', 14, 0);
+    Sim_Test_Reboot(E_SIM_RESET_POWER);
+    Sim_Adc_SetSource(ESW_U_IN, EswU, NULL);
+    Sim_Adc_SetSource(ESW_I_IN, EswI, NULL);
+    Sim_Adc_SetMv(HAND_NTC_IN, 300u);
+    Sim_Test_Run(300);
+
+    /* Parameters are kept in the memory cache, the head's INIT loads them */
+    SIM_CHECK(SIM_FW(App_Memory_SaveSWParams)(&params), "SW parameters not saved");
+    Sim_Pin_Drive('C', 12, 0);
+    Sim_Test_Run(500);
+    Sim_Pin_Drive('C', 14, 1);
+    Sim_Test_Run(100);
+    SendFrame(PROTOCOL_MODULE_SHOCKWAVE, PROTOCOL_CMD_SET_WORK_STATE, start, sizeof(start));
+
+    /* The first shots learn the lead-in; count from a second on */
+    Sim_Test_Run(1000);
+    SIM_CHECK(s_cap.res.shots > 0u, "%u ms charger, level %u: no shot fired", tauMs, level);
+    CapCount();
+}
+
+static SW_GetStatus_Reply_t Status(void)
+{
+    SW_GetStatus_Reply_t status;
+    uint32_t ver = 0;
+
+    memset(&status, 0, sizeof(status));
+    SIM_FW(App_Comm_ReadStatus)(PROTOCOL_MODULE_SHOCKWAVE, &status, sizeof(status), &ver);
+    return status;
+}
+
+/* The charger's supply changes at now; full is what the shots are judged against from then on */
+static void Supply(double supply, double full)
+{
+    CapSwitch(Sim_Now(), s_cap.dump);
+    s_cap.supply = supply;
+    s_cap.full = full;
+    CapCount();
+}
+
+int main(int argc, char **argv)
+{
+    Result_t fixed, safe, gov, sag, stuck, back;
+    unsigned t, l, f, fSafe = 0;
+    uint8_t rate, error;
+
+    Sim_Test_Init(argc, argv);
+
+    /* Conservative fixed setting: the fastest frequency level never under-charged on the weak charger */
+    for (f = FREQ; f >= 1u && fSafe == 0u; f--) {
+        fSafe = f;
+        for (l = 0; l < sizeof(s_levels); l++)
+            fSafe = Fixed(s_taus[1], s_levels[l], (uint8_t)f).under != 0u ? 0u : fSafe;
+    }
+    SIM_CHECK(fSafe != 0u, "no fixed frequency level keeps up with the %u ms charger", s_taus[1]);
+
+    printf("swcharge: %u s per run, requested frequency %u, conservative fixed frequency %u\n", RUN_S, FREQ,
+           fSafe);
+    for (t = 0; t < sizeof(s_taus) / sizeof(s_taus[0]); t++) {
+        for (l = 0; l < sizeof(s_levels); l++) {
+            fixed = Fixed(s_taus[t], s_levels[l], FREQ);
+            safe = Fixed(s_taus[t], s_levels[l], (uint8_t)fSafe);
+            Start(s_taus[t], s_levels[l]);
+            Sim_Test_Run(RUN_S * 1000.0);
+            gov = CapResult();
+            rate = Status().max_rate;
+            SIM_CHECK(fixed.under != 0u, "%u ms, level %u: fixed frequency %u never under-charged", s_taus[t],
+                      s_levels[l], FREQ);
+            SIM_CHECK(gov.under == 0u, "%u ms, level %u: %u of %u shots under-charged", s_taus[t], s_levels[l],
+                      gov.under, gov.shots);
+            SIM_CHECK(gov.shots >= safe.shots, "%u ms, level %u: %u shots, fixed frequency %u gave %u",
+                      s_taus[t], s_levels[l], gov.shots, fSafe, safe.shots);
+            SIM_CHECK(gov.hz <= FREQ * 1.01, "%u ms, level %u: %.2f Hz", s_taus[t], s_levels[l], gov.hz);
+            SIM_CHECK(fabs(rate / 10.0 - gov.hz) <= gov.hz * 0.1, "%u ms, level %u: max_rate %u.%u Hz, fired "
+                      "at %.2f Hz", s_taus[t], s_levels[l], rate / 10u, rate % 10u, gov.hz);
+            printf("swcharge: %u ms charger, level %2u: fixed f%u %4.0f/min (%4.1f %% under) | fixed f%u %4.0f/min "
+                   "(%u under) | governed %4.0f/min, %u under, %.2f Hz, max_rate %u.%u Hz, %.0f mV over target "
+                   "at worst\n", s_taus[t], s_levels[l], FREQ, fixed.shots * 60.0 / RUN_S,
+                   fixed.under * 100.0 / fixed.shots, fSafe, safe.shots * 60.0 / RUN_S, safe.under,
+                   gov.shots * 60.0 / RUN_S, gov.under, gov.hz, rate / 10u, rate % 10u, gov.margin);
+        }
+    }
+
+    /* Supply sags to 310 V half-way: full charge is relearned, the level's target follows */
+    Start(s_taus[0], 26u);
+    Sim_Test_Run(RUN_S * 500.0);
+    gov = CapResult();
+    Supply(SAG_MV, SAG_MV);
+    Sim_Test_Run(RUN_S * 500.0);
+    sag = CapResult();
+    SIM_CHECK(Sim_Test_Log("relearned") != NULL, "full charge not relearned after the sag");
+    SIM_CHECK(sag.under == 0u, "after the sag: %u of %u shots under-charged", sag.under, sag.shots);
+    SIM_CHECK(sag.hz >= gov.hz * 0.8, "after the sag: %.2f Hz, %.2f Hz before", sag.hz, gov.hz);
+    printf("swcharge: supply 325 V -> 310 V at level 26: %.2f Hz -> %.2f Hz, %u under-charged shots, full "
+           "charge relearned\n", gov.hz, sag.hz, sag.under);
+
+    /* Charger failing: stuck at 303 V, too far down to relearn, judged against 325 V; then back */
+    Start(s_taus[0], 26u);
+    Sim_Test_Run(RUN_S * 250.0);
+    Supply(STUCK_MV, SUPPLY_MV);
+    Sim_Test_Run(RUN_S * 250.0);
+    stuck = CapResult();
+    error = Status().error_code;
+    SIM_CHECK(stuck.under == 0u, "charger stuck: %u of %u shots under-charged", stuck.under, stuck.shots);
+    SIM_CHECK(error == E_SW_ERROR_CHARGE_FAULT && Sim_Test_Log("holding fire") != NULL,
+              "charger stuck: error code %u, no charge fault", error);
+    Supply(SUPPLY_MV, SUPPLY_MV);
+    Sim_Test_Run(2000);
+    back = CapResult();
+    SIM_CHECK(back.shots > 0u && back.under == 0u && Status().error_code == E_SW_ERROR_NONE,
+              "charger back: %u shots, %u under-charged, error code %u", back.shots, back.under,
+              Status().error_code);
+    printf("swcharge: charger stuck at 303 V: %u shots in %.1f s, none under-charged, charge fault %u reported; "
+           "back at 325 V: %.2f Hz, fault cleared\n", stuck.shots, RUN_S / 4.0, error, back.hz);
+    return Sim_Test_Done();
+}
@@ -0,0 +1,160 @@
+/************************************************************************************
+ * @file     : thermalderate_test.c
+ * @brief    : Host test - predictive thermal derating against a head model (app_thermal, drv_si5351)
+ * @details  : The test is the CPU and plays a mode's one-second derate loop against a
+ *             thermal plant: a first-order head (time constant, full-power rise) behind a
+ *             lagging NTC, read as the ADC gives it (0.1 C steps, +-0.05 C noise). Each
+ *             second the firmware's App_Thermal_Update gets the reading and the power
+ *             actually applied; the scale goes out as App_UltraSound_ApplyBurst does it
+ *             (burst period through Drv_SI5351_SetPulseWidthus, 500 us steps) or as
+ *             App_Shockwave_LoadShotParams does (longer shot period). The old behaviour
+ *             runs at the level's power until the reading passes TempLimit and stops;
+ *             the new one keeps that stop as the backstop. Every head must run the full
+ *             session with derating, never reaching the backstop. Reported per head:
+ *             uninterrupted minutes and energy (full-power minutes), old and new, and the
+ *             highest head and NTC temperatures.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_thermal.h"
+#include "drv_si5351.h"
+#include "bsp_gpio.h"
+
+#define SESSION_S           1800u       /* 30 min */
+#define LIMIT               420u        /* TempLimit, 0.1 C */
+#define START_C             32.0        /* head on skin at the start */
+#define SUBSTEPS            20u         /* plant integration steps per second */
+#define SW_PERIOD_MS        100u        /* shock wave level: 10 Hz */
+
+typedef struct {
+    const char *pName;
+    double tauS;                        /* head time constant */
+    double gainC;                       /* head rise at full mode power, steady state */
+    double ntcTauS;                     /* NTC lag */
+    uint16_t periodUs;                  /* ultrasound level period, 0 = shock wave */
+    uint16_t swNominal;                 /* shock wave level power, permille */
+} Head_t;
+
+typedef struct {
+    unsigned seconds;                   /* until the backstop stop, or the whole session */
+    double energy;                      /* full-power seconds */
+    double headMax, ntcMax;
+    uint16_t minScale;
+} Run_t;
+
+static const Head_t s_heads[] = {
+    { "nominal head, US full power",  180.0, 20.0,  5.0,   500u,   0u },
+    { "nominal head, SW 70 %",        180.0, 20.0,  5.0,     0u, 700u },
+    { "fast hot head, US 50 %",        60.0, 50.0,  4.0,  1000u,   0u },
+    { "slow head, slow NTC, SW full", 420.0, 18.0, 30.0,     0u, 1000u },
+    { "prior off (tau/2.5, x2), US",  72.0, 40.0,  5.0,   500u,   0u },
+    { "mild head, SW full",           240.0, 13.0,  8.0,     0u, 1000u },
+};
+
+static uint32_t s_seed = 2718u;
+
+static uint32_t Rand(uint32_t lo, uint32_t hi)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return lo + (s_seed >> 8) % (hi - lo + 1u);
+}
+
+/* The NTC as the ADC reports it, 0.1 C: rounded after +-0.05 C of noise */
+static uint16_t Reading(double ntcC)
+{
+    return (uint16_t)(ntcC * 10.0 + (double)Rand(0, 100) / 100.0);
+}
+
+/* Power the mode puts out at this scale, permille of its full power */
+static uint16_t Apply(const Head_t *pHead, uint16_t scale)
+{
+    uint32_t period;
+
+    if (pHead->periodUs == 0u) {
+        period = SW_PERIOD_MS;
+        if (scale != 0u && scale < THERMAL_SCALE_FULL)
+            period = period * THERMAL_SCALE_FULL / scale;
+        return (uint16_t)(pHead->swNominal * SW_PERIOD_MS / period);
+    }
+    period = pHead->periodUs;
+    if (scale != 0u && scale < THERMAL_SCALE_FULL)
+        period = period * THERMAL_SCALE_FULL / scale;
+    if (period > SI5351_US_PERIOD_MAX_US)
+        period = SI5351_US_PERIOD_MAX_US;
+    period -= period % SI5351_US_PERIOD_STEP_US;
+    period = SIM_FW(Drv_SI5351_SetPulseWidthus)((uint16_t)period);
+    return period != 0u ? (uint16_t)(SI5351_US_BURST_ON_US * THERMAL_SCALE_FULL / period) : 0u;
+}
+
+static uint16_t Nominal(const Head_t *pHead)
+{
+    return pHead->periodUs != 0u ? (uint16_t)(SI5351_US_BURST_ON_US * THERMAL_SCALE_FULL / pHead->periodUs) :
+                                   pHead->swNominal;
+}
+
+/* One session; derate false is the old behaviour */
+static Run_t Session(const Head_t *pHead, bool derate)
+{
+    App_Thermal_t thermal;
+    Run_t run = { 0, 0.0, START_C, START_C, THERMAL_SCALE_FULL };
+    double head = START_C, ntc = START_C, dt = 1.0 / SUBSTEPS;
+    uint16_t nominal = Nominal(pHead), applied, temp, scale = THERMAL_SCALE_FULL;
+    unsigned k;
+
+    temp = Reading(ntc);
+    SIM_FW(App_Thermal_Start)(&thermal, temp);
+    applied = derate ? Apply(pHead, scale) : nominal;
+    for (run.seconds = 0; run.seconds < SESSION_S; run.seconds++) {
+        for (k = 0; k < SUBSTEPS; k++) {
+            head += (pHead->gainC * applied / THERMAL_SCALE_FULL - (head - START_C)) * dt / pHead->tauS;
+            ntc += (head - ntc) * dt / pHead->ntcTauS;
+        }
+        run.energy += applied / (double)THERMAL_SCALE_FULL;
+        run.headMax = head > run.headMax ? head : run.headMax;
+        run.ntcMax = ntc > run.ntcMax ? ntc : run.ntcMax;
+
+        /* Backstop: the TempLimit check of every pass */
+        temp = Reading(ntc);
+        if (temp > LIMIT) {
+            run.seconds++;
+            break;
+        }
+        if (derate) {
+            scale = SIM_FW(App_Thermal_Update)(&thermal, temp, LIMIT, applied, nominal);
+            applied = Apply(pHead, scale);
+        }
+    }
+    run.minScale = thermal.minScale;
+    return run;
+}
+
+int main(int argc, char **argv)
+{
+    Run_t old, now;
+    unsigned i;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks and BSP for the TIM3 gate */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+
+    for (i = 0; i < sizeof(s_heads) / sizeof(s_heads[0]); i++) {
+        old = Session(&s_heads[i], false);
+        now = Session(&s_heads[i], true);
+        SIM_FW(Drv_SI5351_StopBurst)();
+        SIM_CHECK(old.seconds < SESSION_S, "%s: old run never reached the limit", s_heads[i].pName);
+        SIM_CHECK(now.seconds == SESSION_S, "%s: stopped by the backstop after %u s (NTC %.2f C)",
+                  s_heads[i].pName, now.seconds, now.ntcMax);
+        SIM_CHECK(now.energy > old.energy, "%s: energy %.1f min, old %.1f min", s_heads[i].pName,
+                  now.energy / 60.0, old.energy / 60.0);
+        SIM_CHECK(now.headMax <= LIMIT / 10.0 && now.ntcMax <= LIMIT / 10.0, "%s: head %.2f C, NTC %.2f C",
+                  s_heads[i].pName, now.headMax, now.ntcMax);
+        printf("thermalderate: %-30s old %4.1f min (%4.1f full-power min), new %4.1f min (%4.1f), lowest scale "
+               "%u, max head %.2f C / NTC %.2f C\n", s_heads[i].pName, old.seconds / 60.0, old.energy / 60.0,
+               now.seconds / 60.0, now.energy / 60.0, now.minScale, now.headMax, now.ntcMax);
+    }
+    return Sim_Test_Done();
+}
@@ -0,0 +1,193 @@
+/************************************************************************************
+ * @file     : trace_test.c
+ * @brief    : Host test - trace record and replay (drv_trace)
+ * @details  : A shock wave session is recorded from idle: head inserted, parameters and
+ *             start sent over USART1, shots against a model of the storage capacitor on
+ *             ESW_U with +-2 LSB of ADC noise, stop, head pulled. The records are copied
+ *             out, the firmware is powered up again to the same idle point, the records are
+ *             loaded and replayed with the head out and nothing sent: every output must
+ *             match the recording and the ring must not have wrapped. Idle recording must
+ *             cost no records. A further window of the session is profiled instruction by
+ *             instruction (Sim_Profile) for the cycles the firmware's DWT count gives per
+ *             record. The ring must hold 15 s of shooting. Reported: records per second
+ *             idle and shooting, seconds of shooting the ring holds, cycles per record.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_comm.h"
+#include "app_memory.h"
+#include "app_shockwave.h"
+#include "drv_trace.h"
+#include <math.h>
+#include <string.h>
+
+#define ESW_U_IN            8u          /* ADC_IN8, PB0 */
+#define ESW_I_IN            9u          /* ADC_IN9, PB1 */
+#define HAND_NTC_IN         13u         /* ADC_IN13, PC3 */
+#define TIM4_CCR4           0x40000840u
+#define SUPPLY_MV           3250.0      /* 325 V */
+#define CHARGE_TAU_NS       SIM_MS(30)
+#define DUMP_TAU_NS         SIM_MS(8)
+#define NOISE_MV            2u          /* ~2 LSB */
+#define IDLE_MS             300u
+#define SHOOT_MS            3000u
+#define PROFILE_MS          100u
+#define CYCLES_PER_REC_MAX  400u
+#define RING_SHOOT_S_MIN    15u
+
+/* Storage capacitor: voltage v at t, charging or being dumped from then on */
+static struct {
+    double v;
+    uint64_t t;
+    bool dump;
+} s_cap;
+
+static uint32_t s_seed;
+static Trace_Record_t s_recs[TRACE_RING_SIZE];
+
+static uint32_t Rand(uint32_t lo, uint32_t hi)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return lo + (s_seed >> 8) % (hi - lo + 1u);
+}
+
+static double CapAt(uint64_t t)
+{
+    double x = (double)(t - s_cap.t);
+
+    if (s_cap.dump)
+        return s_cap.v * exp(-x / (double)DUMP_TAU_NS);
+    return SUPPLY_MV + (s_cap.v - SUPPLY_MV) * exp(-x / (double)CHARGE_TAU_NS);
+}
+
+static uint32_t EswU(uint64_t t, void *pCtx)
+{
+    bool dump = *Sim_Reg(TIM4_CCR4) != 0u;
+
+    (void)pCtx;
+    if (t >= s_cap.t && dump != s_cap.dump) {
+        s_cap.v = CapAt(t);
+        s_cap.t = t;
+        s_cap.dump = dump;
+    }
+    return (uint32_t)(CapAt(t) + (double)Rand(0, 2u * NOISE_MV) - NOISE_MV + 0.5);
+}
+
+static void SendFrame(uint8_t module, uint8_t cmd, const uint8_t *pData, uint8_t len)
+{
+    uint8_t frame[PROTOCOL_FRAME_MAX];
+
+    frame[0] = PROTOCOL_HEADER_0;
+    frame[1] = PROTOCOL_HEADER_1;
+    frame[2] = PROTOCOL_DIR_HOST_TO_DEV;
+    frame[3] = module;
+    frame[4] = cmd;
+    frame[5] = len;
+    memcpy(&frame[PROTOCOL_FRAME_HEAD_LEN], pData, len);
+    frame[PROTOCOL_FRAME_HEAD_LEN + len] = PROTOCOL_TAIL_0;
+    frame[PROTOCOL_FRAME_HEAD_LEN + len + 1u] = PROTOCOL_TAIL_1;
+    Sim_Uart_Send(1, frame, PROTOCOL_FRAME_HEAD_LEN + len + 2u);
+}
+
+/* Power-on to the idle point every run starts from: no head, foot down, parameters cached */
+static void Idle(void)
+{
+    SW_TreatParams_t params = { 420u, 100u, 3000u, 0u, 3000u, 0u, 0u };
+
+    memset(&s_cap, 0, sizeof(s_cap));
+    s_cap.v = SUPPLY_MV;
+    s_seed = 3232u;
+    Sim_Pin_Drive('C', 10, 1);
+    Sim_Pin_Drive('C', 11, 1);
+    Sim_Pin_Drive('C', 12, 1);
+    Sim_Pin_Drive('C', 14, 0);
+    Sim_Test_Reboot(E_SIM_RESET_POWER);
+    Sim_Adc_SetSource(ESW_U_IN, EswU, NULL);
+    Sim_Adc_SetMv(ESW_I_IN, 100u);
+    Sim_Adc_SetMv(HAND_NTC_IN, 300u);
+    Sim_Test_Run(IDLE_MS);
+    SIM_CHECK(SIM_FW(App_Memory_SaveSWParams)(&params), "SW parameters not saved");
+    Sim_Test_Run(IDLE_MS);
+}
+
+/* Shock wave head in, foot, start at level 13 and frequency 16 */
+static void Shoot(void)
+{
+    uint8_t start[5] = { WORK_STATE_START, (uint8_t)SW_WORK_POINT_MAX, (uint8_t)(SW_WORK_POINT_MAX >> 8), 13u,
+                         16u };
+
+    Sim_Pin_Drive('C', 12, 0);
+    Sim_Test_Run(500);
+    Sim_Pin_Drive('C', 14, 1);
+    Sim_Test_Run(100);
+    SendFrame(PROTOCOL_MODULE_SHOCKWAVE, PROTOCOL_CMD_SET_WORK_STATE, start, sizeof(start));
+    Sim_Test_Run(1000);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t stop[5] = { WORK_STATE_STOP, 0u, 0u, 0u, 0u };
+    Trace_Stats_t stats, before;
+    uint16_t count;
+    uint32_t idleRecs, shootRecs, ms;
+    uint64_t insns;
+
+    Sim_Test_Init(argc, argv);
+
+    /* Record: idle, the session, idle again */
+    Idle();
+    SIM_CHECK(SIM_FW(Drv_Trace_Start)(E_TRACE_MODE_RECORD), "recording not started");
+    Sim_Test_Run(1000);
+    idleRecs = SIM_FW(Drv_Trace_GetStats)()->records;
+    Shoot();
+    before = *SIM_FW(Drv_Trace_GetStats)();
+    Sim_Test_Run(SHOOT_MS);
+    shootRecs = SIM_FW(Drv_Trace_GetStats)()->records - before.records;
+    SendFrame(PROTOCOL_MODULE_SHOCKWAVE, PROTOCOL_CMD_SET_WORK_STATE, stop, sizeof(stop));
+    Sim_Test_Run(200);
+    Sim_Pin_Drive('C', 12, 1);
+    Sim_Test_Run(500);
+    SIM_FW(Drv_Trace_Stop)();
+    stats = *SIM_FW(Drv_Trace_GetStats)();
+    count = SIM_FW(Drv_Trace_Copy)(0, s_recs, TRACE_RING_SIZE);
+    SIM_CHECK(idleRecs <= E_ADC_CHANNEL_MAX + 1u, "idle: %u records in 1 s", idleRecs);
+    SIM_CHECK(TRACE_RING_SIZE * SHOOT_MS >= RING_SHOOT_S_MIN * 1000u * shootRecs, "ring of %u holds less than "
+              "%u s of shooting at %u records in %u ms", TRACE_RING_SIZE, RING_SHOOT_S_MIN, shootRecs, SHOOT_MS);
+    SIM_CHECK(stats.overwritten == 0u, "session of %u records wrapped the ring, %u lost", stats.records,
+              stats.overwritten);
+    SIM_CHECK(count == stats.records && count > 0u, "%u records copied of %u", count, stats.records);
+
+    /* Replay from the same idle point: head out, nothing sent, inputs from the trace only */
+    Idle();
+    SIM_CHECK(SIM_FW(Drv_Trace_Load)(s_recs, count), "%u records not loaded", count);
+    SIM_CHECK(SIM_FW(Drv_Trace_Start)(E_TRACE_MODE_REPLAY), "replay not started");
+    for (ms = 0; ms < 10000u && !SIM_FW(Drv_Trace_IsReplayDone)(); ms += 10u)
+        Sim_Test_Run(10);
+    SIM_CHECK(SIM_FW(Drv_Trace_IsReplayDone)(), "replay not done after %u ms", ms);
+    SIM_CHECK(SIM_FW(Drv_Trace_GetStats)()->mismatches == 0u, "replay: %u outputs differ, first at record %u",
+              SIM_FW(Drv_Trace_GetStats)()->mismatches, SIM_FW(Drv_Trace_GetStats)()->firstMismatch);
+    SIM_FW(Drv_Trace_Stop)();
+    printf("trace: session of %u records replayed in %u ms, %u mismatches\n", count, ms,
+           SIM_FW(Drv_Trace_GetStats)()->mismatches);
+
+    /* Cost of a record: the firmware's own DWT count over a profiled window of shooting */
+    Idle();
+    SIM_CHECK(SIM_FW(Drv_Trace_Start)(E_TRACE_MODE_RECORD), "recording not started");
+    Shoot();
+    before = *SIM_FW(Drv_Trace_GetStats)();
+    insns = Sim_Profile_GetInsns();
+    Sim_Profile(true);
+    Sim_Test_Run(PROFILE_MS);
+    Sim_Profile(false);
+    stats = *SIM_FW(Drv_Trace_GetStats)();
+    stats.records -= before.records;
+    stats.cycles -= before.cycles;
+    SIM_CHECK(stats.records > 0u, "no records in %u profiled ms", PROFILE_MS);
+    SIM_CHECK(stats.records > 0u && stats.cycles / stats.records <= CYCLES_PER_REC_MAX,
+              "%u cycles per record", stats.records ? stats.cycles / stats.records : 0u);
+    printf("trace: %u records/s idle, %.0f records/s shooting, ring of %u holds %.1f s of shooting; "
+           "%u cycles per record (%u records, %llu instructions profiled)\n", idleRecs,
+           shootRecs * 1000.0 / SHOOT_MS, TRACE_RING_SIZE, TRACE_RING_SIZE * (double)SHOOT_MS / 1000.0 /
+           (shootRecs ? shootRecs : 1u), stats.records ? stats.cycles / stats.records : 0u, stats.records,
+           (unsigned long long)(Sim_Profile_GetInsns() - insns));
+    return Sim_Test_Done();
+}
@@ -0,0 +1,344 @@
+/************************************************************************************
+ * @file     : update_test.c
+ * @brief    : Host test - firmware update over USART1 through the bootloader (app_update,
+ *             drv_fwswap, Boot/boot_main.c) on the simulated flash controller
+ * @details  : The part boots through the bootloader image with a factory image in the
+ *             active slot. A host client streams new images with two chunks in flight,
+ *             rewinding to next_offset on any refusal. Covered: write protection of the
+ *             bootloader pages, ABORT and the inactivity timeout (back to NORMAL mode,
+ *             resumable), the effective update throughput at 115200 and 921600 baud,
+ *             a power cut while application page 0 is rewritten, confirmation of a
+ *             trial image and the rollback of one that is never confirmed.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_comm.h"
+#include "app_update.h"
+#include "drv_fwswap.h"
+#include <string.h>
+
+#define IMG_SIZE            (20u * FWSWAP_PAGE_SIZE)
+#define IMG_V1              0x00010000u
+#define IMG_V2              0x00020000u
+#define IMG_V3              0x00030000u
+#define IMG_REHEARSAL       0x0002FFFFu     /* v2 content, header of its own */
+#define REPLY_TIMEOUT_MS    100.0
+#define SLICE_MS            0.1
+#define FLASH_WRPR          0x40022020u
+#define USART1_BRR          0x40013808u
+#define USART1_BRR_921600   0x4Eu           /* 72 MHz / 16 / 4.875 */
+
+static uint8_t s_img[3][IMG_SIZE];          /* v1, v2, v3 */
+static uint8_t s_rx[4096];
+static size_t s_rxLen = 0;
+
+static uint32_t Crc32(const uint8_t *p, uint32_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    int k;
+
+    while (len--) {
+        crc ^= *p++;
+        for (k = 0; k < 8; k++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+    }
+    return ~crc;
+}
+
+static void PutU32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t GetU32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/* Image linked at the active slot: SP at the top of SRAM, reset handler inside */
+static void MakeImage(uint8_t *pImg, uint32_t seed)
+{
+    uint32_t i;
+
+    for (i = 0; i < IMG_SIZE; i++) {
+        seed = seed * 1103515245u + 12345u;
+        pImg[i] = (uint8_t)(seed >> 16);
+    }
+    PutU32(&pImg[0], 0x2000C000u);
+    PutU32(&pImg[4], FWSWAP_ACTIVE_ADDR + 0x1F1u);
+}
+
+static void SendFrame(uint8_t cmd, const uint8_t *pData, uint8_t len)
+{
+    uint8_t frame[PROTOCOL_FRAME_MAX];
+
+    frame[0] = PROTOCOL_HEADER_0;
+    frame[1] = PROTOCOL_HEADER_1;
+    frame[2] = PROTOCOL_DIR_HOST_TO_DEV;
+    frame[3] = PROTOCOL_MODULE_SYSTEM;
+    frame[4] = cmd;
+    frame[5] = len;
+    memcpy(&frame[PROTOCOL_FRAME_HEAD_LEN], pData, len);
+    frame[PROTOCOL_FRAME_HEAD_LEN + len] = PROTOCOL_TAIL_0;
+    frame[PROTOCOL_FRAME_HEAD_LEN + len + 1u] = PROTOCOL_TAIL_1;
+    Sim_Uart_Send(1, frame, PROTOCOL_FRAME_HEAD_LEN + len + 2u);
+}
+
+/* Next system-module reply from the device, the data field copied to pData */
+static bool PollReply(uint8_t *pCmd, uint8_t *pData)
+{
+    size_t len;
+    size_t i = 0;
+
+    s_rxLen += Sim_Uart_Recv(1, s_rx + s_rxLen, sizeof(s_rx) - s_rxLen);
+    while (i + PROTOCOL_FRAME_HEAD_LEN + 2u <= s_rxLen) {
+        if (s_rx[i] != PROTOCOL_HEADER_0 || s_rx[i + 1u] != PROTOCOL_HEADER_1) {
+            i++;
+            continue;
+        }
+        len = PROTOCOL_FRAME_HEAD_LEN + s_rx[i + 5u] + 2u;
+        if (i + len > s_rxLen)
+            break;
+        if (s_rx[i + 3u] == PROTOCOL_MODULE_SYSTEM) {
+            *pCmd = s_rx[i + 4u];
+            memcpy(pData, &s_rx[i + PROTOCOL_FRAME_HEAD_LEN], s_rx[i + 5u]);
+            memmove(s_rx, s_rx + i + len, s_rxLen - i - len);
+            s_rxLen -= i + len;
+            return true;
+        }
+        i += len;
+    }
+    memmove(s_rx, s_rx + i, s_rxLen - i);
+    s_rxLen -= i;
+    return false;
+}
+
+/* Request/reply; the first byte after an idle period may only wake the part from STOP,
+ * so the host resends when no reply comes (app_comm.h) */
+static bool Request(uint8_t cmd, const uint8_t *pData, uint8_t len, uint8_t *pReply)
+{
+    uint8_t got;
+    int tries;
+    double t;
+
+    for (tries = 0; tries < 3; tries++) {
+        SendFrame(cmd, pData, len);
+        for (t = 0.0; t < REPLY_TIMEOUT_MS; t += SLICE_MS) {
+            Sim_Test_Run(SLICE_MS);
+            if (PollReply(&got, pReply) && got == cmd)
+                return true;
+        }
+    }
+    return false;
+}
+
+static bool Begin(const uint8_t *pImg, uint32_t version, uint32_t *pNext)
+{
+    uint8_t req[12];
+    uint8_t reply[16];
+
+    PutU32(&req[0], IMG_SIZE);
+    PutU32(&req[4], Crc32(pImg, IMG_SIZE));
+    PutU32(&req[8], version);
+    if (!Request(PROTOCOL_CMD_UPDATE_BEGIN, req, sizeof(req), reply) || reply[0] != UPDATE_RESULT_OK)
+        return false;
+    *pNext = GetU32(&reply[1]);
+    return true;
+}
+
+/* Chunks stop at page boundaries */
+static uint32_t ChunkLen(uint32_t offset, uint32_t end)
+{
+    uint32_t n = PROTOCOL_UPDATE_CHUNK_MAX;
+
+    if (n > end - offset)
+        n = end - offset;
+    if (n > FWSWAP_PAGE_SIZE - offset % FWSWAP_PAGE_SIZE)
+        n = FWSWAP_PAGE_SIZE - offset % FWSWAP_PAGE_SIZE;
+    return n;
+}
+
+static void SendChunk(const uint8_t *pImg, uint32_t offset, uint32_t end)
+{
+    uint8_t req[8 + PROTOCOL_UPDATE_CHUNK_MAX];
+    uint32_t n = ChunkLen(offset, end);
+
+    PutU32(&req[0], offset);
+    memcpy(&req[4], &pImg[offset], n);
+    PutU32(&req[4 + n], Crc32(&pImg[offset], n));
+    SendFrame(PROTOCOL_CMD_UPDATE_DATA, req, (uint8_t)(n + 8u));
+}
+
+/* Stream [next, end) with PROTOCOL_UPDATE_WINDOW chunks in flight; false on a stall */
+static bool Stream(const uint8_t *pImg, uint32_t next, uint32_t end, unsigned *pNaks)
+{
+    uint32_t send = next;
+    uint32_t resume = next;
+    unsigned inFlight = 0;
+    bool rewind = false;
+    uint8_t cmd;
+    uint8_t reply[16];
+    double idle = 0.0;
+
+    while (next < end) {
+        while (!rewind && inFlight < PROTOCOL_UPDATE_WINDOW && send < end) {
+            SendChunk(pImg, send, end);
+            send += ChunkLen(send, end);
+            inFlight++;
+        }
+        Sim_Test_Run(SLICE_MS);
+        if (!PollReply(&cmd, reply) || cmd != PROTOCOL_CMD_UPDATE_DATA) {
+            if ((idle += SLICE_MS) > REPLY_TIMEOUT_MS)
+                return false;
+            continue;
+        }
+        idle = 0.0;
+        inFlight--;
+        if (reply[0] == UPDATE_RESULT_OK) {
+            next = GetU32(&reply[1]);
+        } else if (!rewind) {
+            (*pNaks)++;
+            rewind = true;
+            resume = GetU32(&reply[1]);
+        }
+        if (rewind && inFlight == 0u) {
+            rewind = false;
+            next = send = resume;
+        }
+    }
+    return true;
+}
+
+static bool End(void)
+{
+    uint8_t reply[16];
+
+    return Request(PROTOCOL_CMD_UPDATE_END, NULL, 0, reply) && reply[0] == UPDATE_RESULT_OK;
+}
+
+/* Whole update, returns the time from BEGIN to the END reply in seconds, 0 on failure */
+static double Update(const uint8_t *pImg, uint32_t version, unsigned *pNaks)
+{
+    uint64_t t0 = Sim_Now();
+    uint32_t next;
+
+    *pNaks = 0;
+    if (!Begin(pImg, version, &next) || next != 0u || !Stream(pImg, 0, IMG_SIZE, pNaks) || !End())
+        return 0.0;
+    return (double)(Sim_Now() - t0) / 1e9;
+}
+
+/* Run until the application logs its start after the bootloader, returns seconds */
+static double WaitApp(double maxMs)
+{
+    uint64_t t0 = Sim_Now();
+    double t;
+
+    for (t = 0.0; t < maxMs && Sim_Test_Log("System initialized.") == NULL; t += 10.0)
+        Sim_Test_Run(10.0);
+    return (double)(Sim_Now() - t0) / 1e9;
+}
+
+static FwSwap_State_EnumDef State(void)
+{
+    return SIM_FW(Drv_FwSwap_GetState)();
+}
+
+int main(int argc, char **argv)
+{
+    const uint8_t *pFlash;
+    uint32_t resets;
+    uint32_t next;
+    uint32_t i;
+    unsigned naks;
+    double secs;
+    double swap;
+
+    for (i = 0; i < 3u; i++)
+        MakeImage(s_img[i], 0x1234u * (i + 1u));
+
+    /* Factory state: bootloader and v1 programmed through SWD, option bytes untouched */
+    Sim_Test_Init(argc, argv);
+    /* No probe connected: the treatment manager idles, updates are accepted */
+    Sim_Pin_Drive('C', 10, 1);
+    Sim_Pin_Drive('C', 11, 1);
+    Sim_Pin_Drive('C', 12, 1);
+    pFlash = Sim_Flash_Mem();
+    memcpy(Sim_Flash_Mem() + (FWSWAP_ACTIVE_ADDR - FWSWAP_BOOT_ADDR), s_img[0], IMG_SIZE);
+    Sim_SetBootImage(Sim_Test_BootImage());
+    Sim_Test_Reboot(E_SIM_RESET_POWER);
+    resets = Sim_GetResetCount();
+    WaitApp(2000.0);
+    SIM_CHECK(Sim_Test_Log("System initialized.") != NULL, "application not started by the bootloader");
+    SIM_CHECK((*Sim_Reg(FLASH_WRPR) & FWSWAP_BOOT_WRP) == 0u, "bootloader pages not write-protected, WRPR 0x%08X",
+              *Sim_Reg(FLASH_WRPR));
+    SIM_CHECK(Sim_GetResetCount() - resets == 1u, "%u resets to apply the option bytes",
+              Sim_GetResetCount() - resets);
+    Sim_Test_Run(500);
+
+    /* ABORT after three pages: back to NORMAL mode, the verified pages are kept */
+    Sim_Test_LogClear();
+    SIM_CHECK(Begin(s_img[1], IMG_REHEARSAL, &next) && next == 0u, "BEGIN refused");
+    SIM_CHECK(Stream(s_img[1], 0, 3u * FWSWAP_PAGE_SIZE, &naks), "stream stalled");
+    Sim_Test_Run(200);
+    {
+        uint8_t reply[16];
+        SIM_CHECK(Request(PROTOCOL_CMD_UPDATE_ABORT, NULL, 0, reply) && reply[0] == UPDATE_RESULT_OK,
+                  "ABORT refused");
+    }
+    SIM_CHECK(Sim_Test_Log("session aborted") != NULL && Sim_Test_Log("changed to NORMAL_MODE") != NULL,
+              "ABORT did not end the session");
+    SIM_CHECK(Begin(s_img[1], IMG_REHEARSAL, &next) && next == 3u * FWSWAP_PAGE_SIZE,
+              "BEGIN after ABORT resumes at %u, 3 pages verified", next);
+
+    /* Host gone: the session times out into NORMAL mode */
+    Sim_Test_LogClear();
+    SIM_CHECK(Stream(s_img[1], next, next + FWSWAP_PAGE_SIZE, &naks), "stream stalled");
+    Sim_Test_Run(UPDATE_IDLE_TIMEOUT_MS + 500.0);
+    SIM_CHECK(Sim_Test_Log("session timed out") != NULL && Sim_Test_Log("changed to NORMAL_MODE") != NULL,
+              "no timeout after %u ms without data", UPDATE_IDLE_TIMEOUT_MS);
+    Sim_Test_Run(500);
+
+    /* v2 at 115200, power cut while the bootloader rewrites application page 0:
+     * step 0 of page 0 is 1026 flash operations, step 1 erases and refills page 0 */
+    secs = Update(s_img[1], IMG_V2, &naks);
+    SIM_CHECK(secs > 0.0, "update at 115200 failed");
+    printf("update: 115200 baud, %u KB in %.2f s: %.0f B/s effective, %u refusals\n",
+           IMG_SIZE / 1024u, secs, secs > 0.0 ? IMG_SIZE / secs : 0.0, naks);
+    Sim_Test_LogClear();
+    resets = Sim_GetResetCount();
+    Sim_Flash_CutAfter(1500);
+    swap = WaitApp(20000.0);
+    Sim_Flash_CutAfter(0);
+    SIM_CHECK(memcmp(pFlash + (FWSWAP_ACTIVE_ADDR - FWSWAP_BOOT_ADDR), s_img[1], IMG_SIZE) == 0,
+              "active slot is not v2 after the interrupted swap");
+    SIM_CHECK(memcmp(pFlash + (FWSWAP_STAGING_ADDR - FWSWAP_BOOT_ADDR), s_img[0], IMG_SIZE) == 0,
+              "staging slot does not hold v1");
+    SIM_CHECK(State() == E_FWSWAP_TRIAL, "state %d after the swap", State());
+    printf("update: swap with a power cut in page 0 resumed, application up after %.2f s, %u resets\n",
+           swap, Sim_GetResetCount() - resets);
+    Sim_Test_Run(UPDATE_CONFIRM_MS + 1000.0);
+    SIM_CHECK(State() == E_FWSWAP_CONFIRMED, "v2 not confirmed, state %d", State());
+
+    /* v3 at 921600, never confirmed: rolled back after FWSWAP_TRIAL_BOOTS boots */
+    *Sim_Reg(USART1_BRR) = USART1_BRR_921600;
+    secs = Update(s_img[2], IMG_V3, &naks);
+    SIM_CHECK(secs > 0.0, "update at %u baud failed", Sim_Uart_GetBaud(1));
+    printf("update: %u baud, %u KB in %.2f s: %.0f B/s effective, %u refusals\n", Sim_Uart_GetBaud(1),
+           IMG_SIZE / 1024u, secs, secs > 0.0 ? IMG_SIZE / secs : 0.0, naks);
+    Sim_Test_LogClear();
+    swap = WaitApp(20000.0);
+    SIM_CHECK(State() == E_FWSWAP_TRIAL, "v3 not on trial, state %d", State());
+    printf("update: %u KB swap, application up %.2f s after END\n", IMG_SIZE / 1024u, swap);
+    for (i = 0; i < FWSWAP_TRIAL_BOOTS; i++) {
+        Sim_Test_Reboot(E_SIM_RESET_PIN);
+        WaitApp(20000.0);
+    }
+    SIM_CHECK(State() == E_FWSWAP_REVERTED, "v3 not rolled back, state %d", State());
+    SIM_CHECK(memcmp(pFlash + (FWSWAP_ACTIVE_ADDR - FWSWAP_BOOT_ADDR), s_img[1], IMG_SIZE) == 0,
+              "active slot is not v2 after the rollback");
+    SIM_CHECK(Sim_Test_Log("was not confirmed") != NULL, "rollback not reported");
+    return Sim_Test_Done();
+}
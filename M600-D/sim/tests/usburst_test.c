@@ -0,0 +1,221 @@
+/************************************************************************************
+ * @file     : usburst_test.c
+ * @brief    : Host test - ultrasound burst gate timeline, TIM3 + DMA1 into PB14 (drv_si5351, bsp_tim)
+ * @details  : The test is the CPU: BSP is set up and every MCU_CTR_US_RF (PB14) edge is
+ *             recorded. Drv_SI5351_SetPulseWidthus and Drv_SI5351_SetBurst are called at
+ *             random instants with random periods and duties, including stops, clamps
+ *             and continuous gates, and the CPU does nothing in between. The edges must
+ *             match a model of TIM3 with ARR/CCR3 preload: a request applies from the
+ *             next period boundary (a running burst is never cut), the gate rises at
+ *             every boundary and falls on-time later, a stop drops it at once and a start
+ *             opens a burst at once. Reported: bursts, worst edge deviation from the
+ *             model and worst request-to-effect latency against the period in force.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "drv_si5351.h"
+#include "bsp_gpio.h"
+#include "bsp_tim.h"
+
+#define GATE_PORT       'B'
+#define GATE_PIN        14u
+#define RUN_MS          4000u
+#define EDGES_MAX       65536u
+#define GUARD_NS        SIM_US(3)       /* requests are kept this far from a boundary */
+#define TOL_NS          SIM_NS(500)     /* a start counts from CEN, a few bus writes after its UG rise */
+
+typedef struct {
+    uint64_t at;
+    uint8_t level;
+} Edge_t;
+
+/* TIM3 as the gate sees it: values latched at the boundary b, requested ones pending */
+static struct {
+    bool run;
+    bool level;
+    uint64_t b;
+    uint32_t periodUs, onUs;
+    uint32_t reqPeriodUs, reqOnUs;
+    bool fallPending;
+} s_model;
+
+static Edge_t s_edges[EDGES_MAX];
+static unsigned s_edgeNum = 0;
+static Edge_t s_expect[EDGES_MAX];
+static unsigned s_expectNum = 0;
+static unsigned s_bursts = 0;
+static uint32_t s_seed = 3141u;
+
+static uint32_t Rand(uint32_t lo, uint32_t hi)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return lo + (s_seed >> 8) % (hi - lo + 1u);
+}
+
+static void GateWatch(char port, uint16_t odr, uint16_t changed, void *pCtx)
+{
+    (void)pCtx;
+    if (port != GATE_PORT || !(changed & (1u << GATE_PIN)))
+        return;
+    if (s_edgeNum < EDGES_MAX) {
+        s_edges[s_edgeNum].at = Sim_Now();
+        s_edges[s_edgeNum].level = (odr >> GATE_PIN) & 1u;
+    }
+    s_edgeNum++;
+}
+
+static void Expect(uint64_t at, bool level)
+{
+    if (s_model.level == level)
+        return;
+    s_model.level = level;
+    if (s_expectNum < EDGES_MAX) {
+        s_expect[s_expectNum].at = at;
+        s_expect[s_expectNum].level = level ? 1u : 0u;
+    }
+    s_expectNum++;
+}
+
+/* Rise at the boundary, fall on-time later unless the gate is continuous */
+static void Boundary(uint64_t at)
+{
+    s_model.b = at;
+    s_model.periodUs = s_model.reqPeriodUs;
+    s_model.onUs = s_model.reqOnUs;
+    Expect(at, true);
+    s_model.fallPending = s_model.onUs < s_model.periodUs;
+    s_bursts++;
+}
+
+static uint64_t NextBoundary(void)
+{
+    return s_model.b + SIM_US(s_model.periodUs);
+}
+
+/* Model events up to t */
+static void Advance(uint64_t t)
+{
+    while (s_model.run) {
+        if (s_model.fallPending && s_model.b + SIM_US(s_model.onUs) <= t) {
+            Expect(s_model.b + SIM_US(s_model.onUs), false);
+            s_model.fallPending = false;
+        } else if (NextBoundary() <= t) {
+            Boundary(NextBoundary());
+        } else {
+            break;
+        }
+    }
+}
+
+/* What the driver makes of a request: period/on-time in force, 0 = stopped */
+static void Apply(uint64_t at, uint32_t periodUs, uint32_t onUs)
+{
+    Advance(at);
+    if (periodUs == 0u || onUs == 0u) {
+        s_model.run = false;
+        s_model.fallPending = false;
+        Expect(at, false);
+        return;
+    }
+    s_model.reqPeriodUs = periodUs;
+    s_model.reqOnUs = onUs > periodUs ? periodUs : onUs;
+    if (!s_model.run) {
+        s_model.run = true;
+        Boundary(at);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t t, q, end, dev, devMax = 0, lat, latMax = 0, latPeriod = 0;
+    uint32_t periodUs, onUs, kind;
+    unsigned i, requests = 0, stops = 0, starts = 0, continuous = 0, latRatioPct = 0;
+    bool wasRunning;
+
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+
+    /* Test as the CPU: clocks and BSP (TIM3 gate, DMA1 Ch2/Ch3 on GPIOB BSRR) */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(SystemInit)();
+    SIM_FW(BSP_Init)();
+    Sim_RunFor(SIM_US(100));
+    SIM_CHECK(Sim_Pin_Get(GATE_PORT, GATE_PIN) == 0, "gate high after BSP_Init");
+    Sim_Pin_Watch(GateWatch, NULL);
+
+    end = Sim_Now() + SIM_MS(RUN_MS);
+    while (Sim_Now() < end) {
+        Sim_RunFor(SIM_US(Rand(1000, 40000)));
+
+        /* Keep clear of a boundary: the two preload writes straddling one is allowed to mix */
+        q = Sim_Now();
+        Advance(q);
+        while (s_model.run && (q - s_model.b < GUARD_NS || NextBoundary() - q < GUARD_NS)) {
+            Sim_RunFor(SIM_US(5));
+            q = Sim_Now();
+            Advance(q);
+        }
+
+        kind = Rand(0, 99);
+        if (kind < 60u) {
+            /* Level change as App_UltraSound_SetLevel makes it: 20 ms .. 0.5 ms, now and then under */
+            periodUs = Rand(0, 21000);
+            periodUs = SIM_FW(Drv_SI5351_SetPulseWidthus)((uint16_t)periodUs);
+            onUs = periodUs != 0u ? SI5351_US_BURST_ON_US : 0u;
+        } else if (kind < 95u) {
+            periodUs = Rand(50, 20000);
+            onUs = Rand(1, periodUs + 200u);
+            SIM_FW(Drv_SI5351_SetBurst)((uint16_t)periodUs, (uint16_t)onUs);
+        } else {
+            periodUs = 0;
+            onUs = 0;
+            SIM_FW(Drv_SI5351_StopBurst)();
+        }
+        requests++;
+        stops += periodUs == 0u ? 1u : 0u;
+        continuous += (periodUs != 0u && onUs >= periodUs) ? 1u : 0u;
+
+        /* Latency: a running burst finishes with the values it started with */
+        if (s_model.run && periodUs != 0u) {
+            lat = NextBoundary() - q;
+            if (lat > latMax) {
+                latMax = lat;
+                latPeriod = SIM_US(s_model.periodUs);
+            }
+            latRatioPct = (unsigned)(lat * 100u / SIM_US(s_model.periodUs)) > latRatioPct ?
+                          (unsigned)(lat * 100u / SIM_US(s_model.periodUs)) : latRatioPct;
+        }
+        wasRunning = s_model.run;
+        Apply(q, periodUs, onUs);
+
+        /* A start counts from the UG inside the call: the rise it made is the boundary */
+        if (!wasRunning && s_model.run && s_edgeNum > 0u && s_edgeNum <= EDGES_MAX &&
+            s_edges[s_edgeNum - 1u].level && s_edges[s_edgeNum - 1u].at >= q && s_expectNum <= EDGES_MAX) {
+            s_model.b = s_edges[s_edgeNum - 1u].at;
+            s_expect[s_expectNum - 1u].at = s_model.b;
+            starts++;
+        }
+    }
+    t = Sim_Now();
+    Advance(t);
+
+    SIM_CHECK(s_edgeNum <= EDGES_MAX && s_expectNum <= EDGES_MAX, "%u edges, %u expected", s_edgeNum, s_expectNum);
+    SIM_CHECK(s_edgeNum == s_expectNum, "%u gate edges, the model has %u", s_edgeNum, s_expectNum);
+    for (i = 0; i < s_edgeNum && i < s_expectNum && i < EDGES_MAX; i++) {
+        dev = s_edges[i].at > s_expect[i].at ? s_edges[i].at - s_expect[i].at : s_expect[i].at - s_edges[i].at;
+        devMax = dev > devMax ? dev : devMax;
+        if (s_edges[i].level != s_expect[i].level || dev > TOL_NS) {
+            SIM_CHECK(false, "edge %u: %s at %.3f us, model %s at %.3f us", i, s_edges[i].level ? "rise" : "fall",
+                      (double)s_edges[i].at / 1e3, s_expect[i].level ? "rise" : "fall", (double)s_expect[i].at / 1e3);
+            break;
+        }
+    }
+    SIM_CHECK(latRatioPct <= 100u, "a request took %u %% of the period in force", latRatioPct);
+    printf("usburst: %u requests over %u ms (%u stops, %u starts, %u continuous), CPU idle in between: %u bursts, "
+           "%u gate edges, all within %.0f ns of the preload model\n", requests, RUN_MS, stops, starts, continuous,
+           s_bursts, s_edgeNum, (double)devMax);
+    printf("usburst: a request applies at the next period boundary, never cutting a burst: worst %.2f ms with "
+           "%.2f ms in force (at most %u %% of the period)\n", (double)latMax / 1e6, (double)latPeriod / 1e6,
+           latRatioPct);
+    return Sim_Test_Done();
+}
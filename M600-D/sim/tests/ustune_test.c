@@ -0,0 +1,149 @@
+/************************************************************************************
+ * @file     : ustune_test.c
+ * @brief    : Host test - ultrasound resonance search and tracking through the SI5351
+ * @details  : An ultrasound probe is inserted and the firmware must program the SI5351
+ *             over I2C1. Then the test is the CPU: every TREAT_TASK_TIME it feeds
+ *             App_USTune_Step and sets the returned frequency with
+ *             Drv_SI5351_SetFrequency, and the transducer model answers on what CLK0
+ *             actually puts out: a series resonance (Lorentzian admittance, loaded Q 40)
+ *             on top of the static capacitance, 1.5 % measurement noise. Reported:
+ *             search time for a full sweep and for a fine scan from the stored hint, and
+ *             the tracking error while the resonance drifts 8 kHz in a minute as the
+ *             head warms up.
+ ***********************************************************************************/
+#include "sim_test.h"
+#include "app_ustune.h"
+#include "app_treatmgr.h"
+#include "drv_si5351.h"
+#include "bsp_i2c.h"
+#include <math.h>
+#include <stdlib.h>
+
+#define US_Q            40.0
+#define US_G0           0.20        /* static capacitance branch, relative */
+#define US_G1           1.00        /* motional branch at resonance */
+#define US_DRIVE_MV     600u        /* DAC set-point during the search */
+#define US_NOISE        0.015
+#define US_DRIFT_KHZ    (-8.0)
+#define US_TRACK_S      60.0
+
+static uint32_t s_seed = 12345u;
+static uint32_t s_clkErrors = 0;
+
+static double Noise(void)
+{
+    s_seed = s_seed * 1103515245u + 12345u;
+    return ((double)((s_seed >> 8) & 0xFFFFu) / 32768.0 - 1.0) * US_NOISE;
+}
+
+/* US_I in mV at the CLK0 frequency for a resonance at frKHz */
+static uint16_t Transducer(uint32_t hz, double frKHz)
+{
+    double x = 2.0 * US_Q * ((double)hz / 1000.0 - frKHz) / frKHz;
+    double g = US_G0 + US_G1 / (1.0 + x * x);
+
+    if (hz == 0u)
+        return 0;
+    return (uint16_t)(US_DRIVE_MV * g * (1.0 + Noise()));
+}
+
+/* One treatment tick: step the tuner on the last sample, put the frequency on CLK0 */
+static uint16_t Tick(US_Tune_t *pTune, double frKHz, uint16_t *pLast)
+{
+    uint32_t hz = Sim_Si5351_GetHz(0);
+    uint16_t mv = Transducer(hz, frKHz);
+    uint16_t f = SIM_FW(App_USTune_Step)(pTune, SIM_FW(App_USTune_Admittance)(mv, US_DRIVE_MV));
+    uint64_t next = Sim_Now() + SIM_MS(TREAT_TASK_TIME);
+
+    if (f != *pLast) {
+        *pLast = SIM_FW(Drv_SI5351_SetFrequency)(f);
+        if (Sim_Si5351_GetHz(0) != (uint32_t)f * 1000u)
+            s_clkErrors++;
+    }
+    if (Sim_Now() < next)
+        Sim_RunFor(next - Sim_Now());
+    return f;
+}
+
+/* Search from hint (0: full sweep), returns the virtual time it took */
+static double Search(US_Tune_t *pTune, uint16_t hint, double frKHz, uint16_t *pLast)
+{
+    uint64_t t0 = Sim_Now();
+    uint32_t ticks = 0;
+
+    SIM_FW(App_USTune_Search)(pTune, hint);
+    *pLast = SIM_FW(Drv_SI5351_SetFrequency)(pTune->freq);
+    while ((pTune->eState == E_US_TUNE_COARSE || pTune->eState == E_US_TUNE_FINE) && ticks++ < 2000u)
+        Tick(pTune, frKHz, pLast);
+    return (double)(Sim_Now() - t0) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    US_Tune_t tune;
+    uint16_t last = 0;
+    double fr = 1032.4;
+    double ms;
+    double err;
+    double sumSq = 0.0;
+    double maxErr = 0.0;
+    uint32_t n = 0;
+    uint32_t ticks;
+    uint32_t writes;
+
+    /* The firmware programs the SI5351 when an ultrasound probe shows up */
+    Sim_Test_Init(argc, argv);
+    Sim_Test_Run(300);
+    Sim_Pin_Drive('C', 10, 0);
+    Sim_Pin_Drive('C', 11, 1);
+    Sim_Pin_Drive('C', 12, 1);
+    Sim_Test_Run(400);
+    SIM_CHECK(Sim_Test_Log("Probe status changed to ULTRASOUND") != NULL, "probe not detected");
+    SIM_CHECK(SIM_FW(Drv_SI5351_IsReady)(), "SI5351 not programmed, %u register writes",
+              Sim_Si5351_GetWrites());
+
+    /* Test as the CPU: I2C1 and the SI5351 set up, then the treatment task by hand */
+    Sim_Boot(E_SIM_RESET_POWER);
+    Sim_RunFor(SIM_US(10));
+    SIM_FW(BSP_I2C1_Init)();
+    SIM_FW(Drv_SI5351_Init)();
+    SIM_CHECK(SIM_FW(Drv_SI5351_IsReady)(), "SI5351 init over I2C1 failed");
+    writes = Sim_Si5351_GetWrites();
+
+    ms = Search(&tune, 0, fr, &last);
+    SIM_CHECK(tune.eState == E_US_TUNE_FOUND, "full sweep ended in state %d", tune.eState);
+    SIM_CHECK(fabs(tune.anchor - fr) <= US_TUNE_FINE_STEP_KHZ, "full sweep found %u kHz, resonance %.1f",
+              tune.anchor, fr);
+    printf("ustune: full sweep %u points, %.0f ms, found %u kHz (resonance %.1f kHz)\n",
+           tune.points, ms, tune.anchor, fr);
+
+    fr = 1027.9;
+    ms = Search(&tune, 1032, fr, &last);
+    SIM_CHECK(tune.eState == E_US_TUNE_FOUND, "hinted search ended in state %d", tune.eState);
+    SIM_CHECK(fabs(tune.anchor - fr) <= US_TUNE_FINE_STEP_KHZ, "hinted search found %u kHz, resonance %.1f",
+              tune.anchor, fr);
+    printf("ustune: fine scan from the stored 1032 kHz %u points, %.0f ms, found %u kHz (resonance %.1f kHz)\n",
+           tune.points, ms, tune.anchor, fr);
+
+    /* Tracking while the head warms up; the first 2 s let it settle */
+    SIM_FW(App_USTune_Track)(&tune);
+    for (ticks = 0; ticks < (uint32_t)(US_TRACK_S * 1000.0 / TREAT_TASK_TIME); ticks++) {
+        double t = (double)ticks * TREAT_TASK_TIME / 1000.0;
+        Tick(&tune, 1027.9 + US_DRIFT_KHZ * t / US_TRACK_S, &last);
+        if (t < 2.0)
+            continue;
+        err = tune.center - (1027.9 + US_DRIFT_KHZ * t / US_TRACK_S);
+        sumSq += err * err;
+        maxErr = fabs(err) > maxErr ? fabs(err) : maxErr;
+        n++;
+    }
+    SIM_CHECK(sqrt(sumSq / n) < 1.5 && maxErr < 3.0, "tracking error rms %.2f kHz, max %.2f kHz",
+              sqrt(sumSq / n), maxErr);
+    SIM_CHECK(s_clkErrors == 0u, "CLK0 off the requested frequency %u times", s_clkErrors);
+    SIM_CHECK(SIM_FW(Drv_SI5351_GetRfStats)()->i2cErrors == 0u, "%u I2C errors",
+              SIM_FW(Drv_SI5351_GetRfStats)()->i2cErrors);
+    printf("ustune: tracking %.0f kHz drift over %.0f s: error rms %.2f kHz, max %.2f kHz, %u moves, "
+           "%u SI5351 register writes\n", US_DRIFT_KHZ, US_TRACK_S, sqrt(sumSq / n), maxErr, tune.moves,
+           Sim_Si5351_GetWrites() - writes);
+    return Sim_Test_Done();
+}